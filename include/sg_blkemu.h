@@ -0,0 +1,95 @@
+#ifndef SG_BLKEMU_H
+#define SG_BLKEMU_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* This header is for the in-process emulated block device found in the
+ * sg3_utils library (libsgutils) on Linux. A "device name" that starts with
+ * SG_BLKEMU_PREFIX (e.g. "blkemu:size=1g,bs=4096") is not opened in the
+ * file system; instead a SCSI direct access block device is emulated in
+ * memory (or over a sparse file) and the commands sent to it through the
+ * pass-through are executed within the calling process. It is intended
+ * for exercising and benchmarking utilities such as sg_dd and sgp_dd
+ * without real hardware. So a file whose name starts with the prefix can
+ * only be opened with a leading directory (e.g. "./blkemu:x"). Options,
+ * comma separated, after the prefix:
+ *      size=NUM    capacity in bytes, suffixes allowed (def: 256m)
+ *      bs=LBS      logical block size: 512 (def), 1024, 2048 or 4096
+ *      file=PATH   back with (sparse) file PATH, else anonymous memory
+ *      lat=US      minimum latency of each command in microseconds
+ *      qd=NUM      maximum number of commands executing at once, later
+ *                  callers wait (def: 0 -> no limit)
+ *      zone=NUM    host managed zoned device with zones of NUM blocks
+ *      conv=NUM    number of leading conventional zones (def: 0)
+ *      oxl=NUM     OPTIMAL TRANSFER LENGTH in logical blocks reported in
+ *                  the Block Limits VPD page (def: 0 -> not reported)
+ *
+ * The file descriptor returned by sg_blkemu_open() is that of the backing
+ * store. It should be given to the pass-through (e.g. set_pt_file_handle()
+ * or sg_blkemu_sg_io() ) and closed with sg_blkemu_close() . */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_BLKEMU_PREFIX "blkemu:"
+#define SG_BLKEMU_MAX_FD 1024   /* emulator fds must be less than this */
+
+/* One SCSI command: inputs then outputs */
+struct sg_blkemu_io {
+    const uint8_t * cdbp;
+    int cdb_len;
+    uint8_t * dinp;             /* data-in buffer, NULL if din_len is 0 */
+    int din_len;
+    const uint8_t * doutp;      /* data-out buffer, NULL if dout_len is 0 */
+    int dout_len;
+    uint8_t * sbp;              /* sense buffer */
+    int mx_sb_len;
+    int status;                 /* [o] SCSI status */
+    int sb_len_wr;              /* [o] bytes of sense written */
+    int din_resid;              /* [o] din_len less bytes actually read */
+    int dout_resid;             /* [o] dout_len less bytes actually used */
+};
+
+/* Returns true if 'device_name' starts with SG_BLKEMU_PREFIX */
+bool sg_blkemu_is_name(const char * device_name);
+
+/* Creates an emulated device from the options in 'device_name'. 'flags' are
+ * open(2) flags: if O_RDONLY (i.e. O_ACCMODE bits are zero) the device is
+ * write protected. Returns file descriptor (>= 0) or a negated errno. */
+int sg_blkemu_open(const char * device_name, int flags, int vb);
+
+/* Returns true if 'fd' was yielded by sg_blkemu_open() and not yet closed */
+bool sg_blkemu_is_fd(int fd);
+
+/* Releases an emulated device (and closes its fd). Returns 0 or a negated
+ * errno. */
+int sg_blkemu_close(int fd);
+
+/* Executes one command on the emulated device associated with 'fd'. Returns
+ * 0 when the command was executed (check iop->status) or a negated errno
+ * (e.g. -EBADF when 'fd' is not an emulator fd). */
+int sg_blkemu_do(int fd, struct sg_blkemu_io * iop, int vb);
+
+/* Executes the command in a sg v3 interface header on the emulated device
+ * associated with 'fd', filling in its output fields as the sg driver's
+ * SG_IO ioctl would. The sg_io_hdr::iovec_count must be zero and the
+ * SG_FLAG_MMAP_IO flag is not supported. Returns 0 or a negated errno. */
+struct sg_io_hdr;
+int sg_blkemu_sg_io(int fd, struct sg_io_hdr * hp, int vb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_BLKEMU_H */
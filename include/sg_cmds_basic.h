@@ -322,15 +322,19 @@ int sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code,
                               int verbose);
 
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
-   negated errno. Implementation calls scsi_pt_open_device(). */
+   negated errno. Implementation calls scsi_pt_open_device() then
+   scsi_pt_pool_enable() so the sg_ll_* functions reuse their pass-through
+   objects on this file descriptor. */
 int sg_cmds_open_device(const char * device_name, bool read_only, int verbose);
 
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
-   negated errno. Implementation calls scsi_pt_open_flags(). */
+   negated errno. Implementation calls scsi_pt_open_flags() then
+   scsi_pt_pool_enable(). */
 int sg_cmds_open_flags(const char * device_name, int flags, int verbose);
 
 /* Returns 0 if successful. If error in Unix returns negated errno.
-   Implementation calls scsi_pt_close_device(). */
+   Implementation calls scsi_pt_close_device() which flushes the pass-through
+   object pool for device_fd. */
 int sg_cmds_close_device(int device_fd);
 
 const char * sg_cmds_version();
@@ -60,11 +60,13 @@ typedef struct sgj_state_t {
     bool pr_packed;             /* 'k' (def: false) only when !pr_pretty */
     bool pr_pretty;             /* 'p' (def: true) */
     bool pr_string;             /* 's' (def: true) */
-    char pr_format;             /*  (def: '\0') */
+    char pr_format;             /* 'B' -> CBOR output (def: '\0') */
     int pr_indent_size;         /* digit (def: 4) */
     int verbose;                /* 'v' (def: 0) incremented each appearance */
     int q_counter;              /* 'q' (def: 0) extra, for using apps */
     int z_counter;              /* 'z' (def: 0) extra, for using apps */
+    bool no_arena;              /* (def: false) set before sgj_start_r() to
+                                 * allocate JSON values on the heap */
 
     /* the following hold state information */
     int first_bad_char;         /* = '\0' */
@@ -73,6 +75,8 @@ typedef struct sgj_state_t {
                                  * element contains a line of plain text. The
                                  * array's JSON name is 'plain_text_output' */
     sgj_opaque_p userp;         /* for temporary usage */
+    sgj_opaque_p strmp;         /* non-NULL after sgj_stream_start() */
+    sgj_opaque_p arenap;        /* JSON values allocated from here */
 } sgj_state;
 
 /* This function tries to convert the in_name C string to the "snake_case"
@@ -143,7 +147,9 @@ bool sgj_init_state(sgj_state * jsp, const char * j_optarg);
  * "utility_invoked" object  (creating it in the case when jsp->pr_leadin is
  * false) and a pointer to that array object is placed in jsp->objectp . The
  * returned pointer is not usually needed but if it is NULL then a heap
- * allocation has failed. */
+ * allocation has failed. Unless jsp->no_arena is true, an arena is made
+ * (pointer in jsp->arenap) from which this tree and JSON values later made
+ * with jsp are allocated in large blocks, rather than one by one. */
 sgj_opaque_p sgj_start_r(const char * util_name, const char * ver_str,
                          int argc, char *argv[], sgj_state * jsp);
 
@@ -357,14 +363,41 @@ void sgj_haj_vb(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 void sgj_hr_str_out(sgj_state * jsp, const char * sp, int slen);
 
 /* Nothing in the in-core JSON tree is actually printed to 'fp' (typically
- * stdout) until this call is made. If jsp is NULL, jsp->pr_as_json is false
+ * stdout) until this call is made, unless sgj_stream_start() has been
+ * called. If jsp is NULL, jsp->pr_as_json is false
  * or jsp->basep is NULL then this function does nothing. If jsp->exit_status
  * is true then a new JSON object named "exit_status" and the 'exit_status'
  * value rendered as a JSON integer is appended to jsp->basep. The in-core
- * JSON tree with jsp->basep as its root is streamed to 'fp'. */
+ * JSON tree with jsp->basep as its root is streamed to 'fp'. If
+ * jsp->pr_format is 'B' that tree is written as CBOR (RFC 8949) instead
+ * of JSON text. */
 void sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                       const char * estr, FILE * fp);
 
+/* Starts streaming mode in which complete parts of the in-core JSON tree
+ * are written to 'fp' (and freed) as sgj_stream_flush() is called, rather
+ * than all at once by sgj_js2file_estr(). The output is the same. Returns
+ * true if streaming has started. Returns false and does nothing if jsp is
+ * NULL, jsp->pr_as_json is false, there is no jsp->basep tree,
+ * jsp->pr_out_hr is true or jsp->pr_format is 'B'. Once started,
+ * sgj_js2file_estr() with a NULL 'jop' finishes the output to this 'fp'
+ * (ignoring its own fp argument). */
+bool sgj_stream_start(sgj_state * jsp, FILE * fp);
+
+/* Opens js_file for writing (truncating it) and calls sgj_stream_start()
+ * on it. If js_file is NULL or "-" then stdout is used. Returns the FILE
+ * if streaming has started, else NULL (after closing any file it opened).
+ * An error opening js_file is not reported; it is expected that the
+ * caller tries again before sgj_js2file_estr() and reports it then. */
+FILE * sgj_stream_start_file(sgj_state * jsp, const char * js_file);
+
+/* If streaming has been started, writes the elements of the JSON array
+ * 'jap' (typically a long list of descriptors) then frees them leaving
+ * 'jap' empty. Anything in the tree ahead of 'jap' is written first, so
+ * after this call only 'jap', its containing objects and their later
+ * members may be added to. Does nothing when not streaming. */
+void sgj_stream_flush(sgj_state * jsp, sgj_opaque_p jap);
+
 /* This function is only needed if the pointer returned from either
  * sgj_new_unattached_object_r() or sgj_new_unattached_array_r() has not
  * been attached into the in-core JSON tree whose root is jsp->basep . */
@@ -373,8 +406,10 @@ void sgj_free_unattached(sgj_opaque_p jop);
 /* If jsp is NULL or jsp->basep is NULL then this function does nothing.
  * This function does bottom up, heap freeing of all the in-core JSON
  * objects and arrays attached to the root JSON object assumed to be
- * found at jsp->basep . After this call jsp->basep, jsp->out_hrp and
- * jsp->userp will all be set to NULL.  */
+ * found at jsp->basep . When that tree is held wholly in the arena
+ * sgj_start_r() attached to jsp->arenap, the arena's blocks are simply
+ * freed. After this call jsp->basep, jsp->out_hrp, jsp->userp and
+ * jsp->arenap will all be set to NULL.  */
 void sgj_finish(sgj_state * jsp);
 
 /* Forms a string of the JSON command line options help and assumes,
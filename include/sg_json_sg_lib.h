@@ -46,6 +46,13 @@ bool sgj_js_designation_descriptor(sgj_state * jsp, sgj_opaque_p jop,
 void sgj_js2file(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                  FILE * fp);
 
+/* Outputs the pass-through command latency statistics (see
+ * sg_pt_stats_get() in sg_pt.h), one line per opcode, service action and
+ * result category, in microseconds to stdout. If JSON output is selected
+ * they are placed in a "pt_latency_statistics" array (in nanoseconds) at
+ * 'jop' instead. Outputs nothing if no commands have been recorded. */
+void sgj_haj_pt_stats(sgj_state * jsp, sgj_opaque_p jop);
+
 #ifdef __cplusplus
 }
 #endif
@@ -284,6 +284,62 @@ bool sg_get_sense_filemark_eom_ili(const uint8_t * sensep, int sb_len,
 bool sg_get_sense_progress_fld(const uint8_t * sensep, int sb_len,
                                int * progress_outp);
 
+/* Enough for every descriptor that fits in 255 bytes of additional sense */
+#define SG_SENSE_MAX_DESC 128
+
+/* Where one sense data descriptor is found by sg_sense_decode(): 'off' is
+ * the offset of its first (type) byte in the sense buffer. 'add_len' is its
+ * additional length clipped to the sense buffer, or -1 when only the type
+ * byte is present. */
+struct sg_sense_desc {
+    uint8_t type;
+    int16_t add_len;
+    uint16_t off;
+};
+
+/* The salient fields of fixed or descriptor format sense data, gathered by
+ * sg_sense_decode() in one pass. Fields whose '_present' (or '_valid') flag
+ * is false are zero. Descriptor specific data not held here (e.g. ATA
+ * status return, user data segment referral, forwarded sense) can be found
+ * in the sense buffer with desc[]. */
+struct sg_sense_decoded {
+    uint8_t response_code;      /* 0x70 to 0x73 */
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t ascq;
+    bool descriptor_format;     /* response code 0x72 or 0x73 */
+    bool deferred;              /* response code 0x71 or 0x73 */
+    bool sdat_ovfl;
+    bool info_present;
+    bool info_valid;            /* VALID bit associated with 'info' */
+    bool cmd_spec_present;
+    bool sks_valid;             /* SKSV set, 'sks' holds its three bytes */
+    bool progress_present;      /* from 'sks' or another progress desc */
+    bool filemark;
+    bool eom;
+    bool ili;
+    bool nvme_present;          /* sg3_utils NVMe status descriptor */
+    bool nvme_dnr;
+    bool nvme_more;
+    uint8_t fru;                /* field replaceable unit code */
+    uint8_t sks[3];             /* sense key specific bytes; byte 0: SKSV */
+    uint16_t progress;          /* divide by 65536 for fraction complete */
+    uint16_t nvme_sct_sc;
+    int len;                    /* bytes of sense buffer holding sense data */
+    uint64_t info;
+    uint64_t cmd_spec;
+    int num_desc;               /* descriptor format: entries in desc[] */
+    struct sg_sense_desc desc[SG_SENSE_MAX_DESC];
+};
+
+/* Decodes the sense buffer 'sensep' of 'sb_len' bytes, in fixed or
+ * descriptor format, into '*sdp' without allocating or formatting. Returns
+ * true if the response code is 0x70 to 0x73; otherwise returns false with
+ * only sdp->response_code (the lower 7 bits of byte 0) and sdp->len set.
+ * Only the first sdp->num_desc elements of sdp->desc[] are written. */
+bool sg_sense_decode(const uint8_t * sensep, int sb_len,
+                     struct sg_sense_decoded * sdp);
+
 /* Closely related to sg_print_sense(). Puts decoded sense data in 'buff'.
  * Usually multiline with multiple '\n' including one trailing. If
  * 'raw_sinfo' set appends sense buffer in hex. 'leadin' is string prepended
@@ -294,6 +350,15 @@ bool sg_get_sense_progress_fld(const uint8_t * sensep, int sb_len,
 int sg_get_sense_str(const char * leadin, const uint8_t * sense_buffer,
                      int sb_len, bool raw_sinfo, int buff_len, char * buff);
 
+/* Same as sg_get_sense_str() but takes the result of an earlier call to
+ * sg_sense_decode() on 'sense_buffer' (and 'sb_len') so that the decoding
+ * is not repeated. 'sdp' may be NULL in which case this function decodes
+ * the sense buffer itself. */
+int sg_get_sense_decoded_str(const char * leadin,
+                             const uint8_t * sense_buffer, int sb_len,
+                             const struct sg_sense_decoded * sdp,
+                             bool raw_sinfo, int buff_len, char * buff);
+
 /* Decode descriptor format sense descriptors (assumes sense buffer is
  * in descriptor format). 'leadin' is string prepended to each line written
  * to 'b', NULL treated as "". Returns the number of bytes written to 'b'
@@ -700,6 +765,28 @@ void hex2stderr(const uint8_t * b_str, int len, int no_ascii);
 int sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
                  uint8_t * mp_arr, int * mp_arr_len, int max_arr_len_and);
 
+/* Streaming version of sg_f2hex_arr() for inputs of any size. The input
+ * syntax is the same, apart from no_space mode where separators between
+ * pairs of hex digits are ignored (and a pair may straddle two lines).
+ * There is no limit on the input length, nor on the length of a line.
+ * sg_hex_strm_open() opens fname ('-' for stdin); a regular file is mapped
+ * into memory when possible, otherwise it is read through a fixed size
+ * window. If skip_first is true the first hexadecimal value on each line is
+ * skipped (ignored when as_binary or no_space is true). On success returns
+ * 0 and writes the new object to *hspp, otherwise returns an error code.
+ * sg_hex_strm_read() decodes up to max_len bytes into bp, writing the
+ * number decoded to *lenp; that will be less than max_len only at the end
+ * of the input, and 0 once the end has been reached. Returns 0 or an error
+ * code (e.g. SG_LIB_SYNTAX_ERROR) in which case *lenp bytes are valid.
+ * sg_hex_strm_close() releases all resources held by hsp. */
+struct sg_hex_strm;
+
+int sg_hex_strm_open(const char * fname, bool as_binary, bool no_space,
+                     bool skip_first, struct sg_hex_strm ** hspp);
+int sg_hex_strm_read(struct sg_hex_strm * hsp, uint8_t * bp, int max_len,
+                     int * lenp);
+void sg_hex_strm_close(struct sg_hex_strm * hsp);
+
 /* Returns true when executed on big endian machine; else returns false.
  * Useful for displaying ATA identify words (which need swapping on a
  * big endian machine). */
@@ -711,6 +798,26 @@ bool sg_is_big_endian();
 bool sg_all_zeros(const uint8_t * bp, int b_len);
 bool sg_all_ffs(const uint8_t * bp, int b_len);
 
+/* Examines 'num_blks' blocks, each 'blk_sz' bytes long, starting at 'bp'.
+ * sg_blks_zero_bitmap() looks for blocks that are all zeros while
+ * sg_blks_addr_bitmap() looks for blocks that hold the low 32 bits of
+ * their address, big endian, in every 4 byte word (or only in the first
+ * word if 'first_only' is true); the first block's address is
+ * 'first_addr' and the addresses ascend. That is the pattern sg_dd and
+ * sgp_dd write with iflag=00,ff . If 'bitmap' is non-NULL, it should be
+ * at least (num_blks + 7) / 8 bytes long; bit (k % 8) of bitmap[k / 8] is
+ * set if block k matches, otherwise it is cleared. Returns the number of
+ * blocks that match. SIMD instructions are used when the CPU has them. */
+int sg_blks_zero_bitmap(const uint8_t * bp, int blk_sz, int num_blks,
+                        uint8_t * bitmap);
+int sg_blks_addr_bitmap(const uint8_t * bp, int blk_sz, int num_blks,
+                        uint32_t first_addr, bool first_only,
+                        uint8_t * bitmap);
+
+/* Returns the name of the implementation the functions above use (e.g.
+ * "avx2", "sse2", "neon" or "scalar"). */
+const char * sg_blk_scan_impl_str(void);
+
 /* Returns true and exits when a byte < 0x20 or DEL is detected. If no
  * such byte is found by *(up + len - 1) then false is returned. */
 bool sg_has_control_char(const uint8_t * up, int len);
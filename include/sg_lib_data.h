@@ -129,9 +129,13 @@ extern const struct sg_lib_value_name_t sg_lib_zoning_out_arr[];
 extern const struct sg_lib_value_name_t sg_lib_zoning_in_arr[];
 extern const struct sg_lib_value_name_t sg_lib_read_attr_arr[];
 extern const struct sg_lib_value_name_t sg_lib_read_pos_arr[];
+extern const uint8_t sg_lib_normal_opcodes_pdt_class[32];
+extern const uint16_t sg_lib_normal_opcodes_idx[][256];
 extern const struct sg_lib_asc_ascq_range_t sg_lib_asc_ascq_range[];
 extern const struct sg_lib_simple_value_name_t sg_lib_sstatus_str_arr[];
 extern const struct sg_lib_asc_ascq_t sg_lib_asc_ascq[];
+extern const uint16_t sg_lib_asc_ascq_idx[257];
+extern const uint8_t sg_lib_asc_ascq_range_map[32];
 extern const struct sg_lib_value_name_t sg_lib_scsi_feature_sets[];
 extern const char * const sg_lib_sense_key_desc[];
 extern const char * const sg_lib_pdt_strs[];
@@ -145,6 +145,17 @@ void set_scsi_pt_task_attr(struct sg_pt_base * objp, int attribute,
  * are given, use the pass-through default. */
 #define SCSI_PT_FLAGS_QUEUE_AT_TAIL 0x10
 #define SCSI_PT_FLAGS_QUEUE_AT_HEAD 0x20
+/* Only acted on by do_scsi_pt_submit(): more submissions follow so the
+ * OS interface may hold this command back and send it with the next one
+ * submitted without this flag (or at the next do_scsi_pt_reap() on the
+ * same fd). Lets Linux batch commands to NVMe generic char devices. */
+#define SCSI_PT_FLAGS_MORE 0x40
+/* Ask for the completion of this command to be polled for rather than
+ * signalled by an interrupt, trading CPU time for latency. In Linux this
+ * is SGV4_FLAG_HIPRI for sg devices with the v4 interface and an io_uring
+ * set up with IORING_SETUP_IOPOLL for READs and WRITEs to NVMe generic
+ * char devices (e.g. /dev/ng0n1). Ignored elsewhere. */
+#define SCSI_PT_FLAGS_HIPRI 0x80
 /* Set (potentially OS dependent) flags for pass-through mechanism.
  * Apart from contradictions, flags can be OR-ed together. */
 void set_scsi_pt_flags(struct sg_pt_base * objp, int flags);
@@ -178,6 +189,73 @@ int do_scsi_pt(struct sg_pt_base * objp, int fd, int timeout_secs,
 int do_nvm_pt(struct sg_pt_base * objp, int submq, int timeout_secs,
               int verbose);
 
+/* Asynchronous variant of do_scsi_pt(). Queues the command held in objp on
+ * the device associated with fd and returns without waiting for it to
+ * complete. The object (and its cdb, sense and data buffers) must not be
+ * changed or destructed until do_scsi_pt_reap() hands it back. Many
+ * commands (each with its own object) may be outstanding on the same fd.
+ * Returns 0 if queued, otherwise the same values as do_scsi_pt(). Returns
+ * -EAGAIN if too many commands are already outstanding on fd. */
+int do_scsi_pt_submit(struct sg_pt_base * objp, int fd, int timeout_secs,
+                      int verbose);
+
+/* Fetches a completed command submitted on fd by do_scsi_pt_submit().
+ * Commands may complete in a different order to which they were submitted.
+ * If none has completed and 'wait' is true then waits for one, otherwise
+ * returns -EAGAIN. Also returns -EAGAIN if no commands are outstanding.
+ * On completion *objpp is set to the object given to do_scsi_pt_submit()
+ * and the return value is what do_scsi_pt() would have returned for it;
+ * then get_scsi_pt_result_category() and friends can be used on *objpp.
+ * If *objpp is set to NULL then the (negated errno) error could not be
+ * attributed to any outstanding command. */
+int do_scsi_pt_reap(int fd, bool wait, struct sg_pt_base ** objpp,
+                    int verbose);
+
+/* Returns a file descriptor that poll(2) or select(2) will report as
+ * readable when do_scsi_pt_reap() on fd will not wait. The caller should
+ * not read from or close the returned file descriptor. Returns a negated
+ * errno value (e.g. -ENOSYS) if no such file descriptor is available. */
+int get_pt_poll_fd(int fd, int verbose);
+
+/* Returns the number of commands submitted on fd by do_scsi_pt_submit()
+ * that have not yet been returned by do_scsi_pt_reap(). */
+int get_pt_num_pending(int fd);
+
+/* Frees the state kept for fd by do_scsi_pt_submit(), get_pt_poll_fd()
+ * and do_scsi_pt_mrq() (e.g. worker threads and a pipe); commands not yet
+ * reaped are dropped. scsi_pt_close_device() does this. If fd is closed
+ * some other way (e.g. close(2)) call this function first. */
+void scsi_pt_async_release(int fd);
+
+/* Multiple requests (MRQ). Sends the 'num' commands held in objpp[0] to
+ * objpp[num - 1] to the device associated with fd as one batch. On Linux
+ * with a sg driver that supports it (version 4.0.30 or later) this is a
+ * single ioctl(SG_IOSUBMIT) of an array of sg_io_v4 objects; elsewhere it
+ * is emulated with do_scsi_pt() or do_scsi_pt_submit(). Without
+ * SCSI_PT_MRQ_IMMED it waits for the commands to complete and then the
+ * outcome of each can be examined with get_scsi_pt_result_category() and
+ * friends. With SCSI_PT_MRQ_STOP_IF (ignored with IMMED) the batch stops
+ * at the first command that does not complete with GOOD status. With
+ * SCSI_PT_MRQ_IMMED the commands are only submitted and
+ * do_scsi_pt_mrq_reap() fetches them as they complete. If num_donep is
+ * given then *num_donep is set to the number of commands completed (or,
+ * with IMMED, submitted); objects beyond that were not acted upon.
+ * Returns 0, or the same error values as do_scsi_pt(). Do not mix
+ * MRQ IMMED and do_scsi_pt_submit() on the same fd. */
+#define SCSI_PT_MRQ_IMMED 0x1
+#define SCSI_PT_MRQ_STOP_IF 0x2
+int do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int fd,
+                   int timeout_secs, int mrq_flags, int * num_donep,
+                   int verbose);
+
+/* Fetches up to 'max' completed commands that were submitted on fd by
+ * do_scsi_pt_mrq() with SCSI_PT_MRQ_IMMED, placing their objects in
+ * objpp[0], objpp[1], etc. If 'wait' is true and none have completed then
+ * waits for at least one. Returns the number placed in objpp (0 if none
+ * are ready or outstanding) or a negated errno value. */
+int do_scsi_pt_mrq_reap(int fd, bool wait, struct sg_pt_base ** objpp,
+                        int max, int verbose);
+
 #define SCSI_PT_RESULT_GOOD 0
 #define SCSI_PT_RESULT_STATUS 1 /* other than GOOD and CHECK CONDITION */
 #define SCSI_PT_RESULT_SENSE 2
@@ -242,6 +320,144 @@ int get_scsi_pt_duration_ms(const struct sg_pt_base * objp);
  * lower layers (and hardware) took to execute the command just completed. */
 uint64_t get_pt_duration_ns(const struct sg_pt_base * objp);
 
+/* Opt-in command latency statistics, kept per thread without locking as
+ * log-linear (HDR style, about 6% resolution) histograms keyed by opcode,
+ * service action (if any) and result category (SCSI_PT_RESULT_*). When
+ * enabled, do_scsi_pt() and do_nvm_pt() time each command. They are enabled
+ * by sg_pt_stats_enable(true) or by setting the SG3_UTILS_PT_STATS
+ * environment variable; in the latter case the statistics are written as
+ * JSON at process exit to stderr or, if the variable's value is neither
+ * empty, "1" nor "-", to the file it names (appended). sgj_haj_pt_stats()
+ * in sg_json_sg_lib.h outputs them on demand. */
+#define SG_PT_STATS_ENV "SG3_UTILS_PT_STATS"
+
+#define SG_PT_STATS_KIND_SCSI 0
+#define SG_PT_STATS_KIND_NVME_ADMIN 1
+#define SG_PT_STATS_KIND_NVME_NVM 2
+
+struct sg_pt_stats_ent {
+    int kind;           /* SG_PT_STATS_KIND_*, -1 for a summary */
+    int opcode;         /* -1 for a summary of all opcodes */
+    int serv_act;       /* -1 if opcode has no service action */
+    int category;       /* SCSI_PT_RESULT_*, -1 for a summary */
+    uint64_t count;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t sum_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;   /* 99.9th percentile */
+};
+
+void sg_pt_stats_enable(bool enable);
+bool sg_pt_stats_on(void);
+/* Monotonic clock in nanoseconds used for the statistics */
+uint64_t sg_pt_stats_now_ns(void);
+/* Called by OS interfaces (and applications that bypass them) once per
+ * completed command. cmdp points to the SCSI cdb or NVMe command. */
+void sg_pt_stats_record(int kind, const uint8_t * cmdp, int category,
+                        uint64_t dur_ns);
+/* Zeroes all counters; best called while no commands are in flight */
+void sg_pt_stats_reset(void);
+/* Merges the statistics of all threads, one entry per opcode, service
+ * action and category, into arr. Returns the number of entries available
+ * (which may exceed max_num, only max_num are written). */
+int sg_pt_stats_get(struct sg_pt_stats_ent * arr, int max_num);
+/* Merges all entries with the given opcode (all opcodes if -1) into
+ * *sump. Returns false if there are none. */
+bool sg_pt_stats_summary(int opcode, struct sg_pt_stats_ent * sump);
+
+/* Binary command trace. When started, by sg_pt_trace_start() or by setting
+ * the SG3_UTILS_PT_TRACE environment variable to the output file name,
+ * each command completed by do_scsi_pt(), do_nvm_pt() and the asynchronous
+ * interface is appended as a compact record (command, data lengths, start
+ * time, duration, status and sense data, but not the data itself) to a per
+ * thread buffer. Buffers are written to the file when full, by
+ * sg_pt_trace_flush(), sg_pt_trace_stop() and at process exit. The sg_trace
+ * utility decodes, summarizes and replays these files. */
+#define SG_PT_TRACE_ENV "SG3_UTILS_PT_TRACE"
+#define SG_PT_TRACE_MAX_CMD_LEN 64      /* NVMe commands are 64 bytes */
+#define SG_PT_TRACE_MAX_SENSE_LEN 96    /* longer sense data truncated */
+
+struct sg_pt_trace_rec {
+    int kind;           /* SG_PT_STATS_KIND_* */
+    int category;       /* SCSI_PT_RESULT_* */
+    int res;            /* value returned by do_scsi_pt() */
+    int status;         /* from get_scsi_pt_status_response() */
+    int thr_id;         /* 1, 2, ... one per recording thread */
+    int cmd_len;
+    int sense_len;
+    uint32_t din_len;   /* requested data-in length */
+    uint32_t dout_len;  /* requested data-out length */
+    uint32_t din_act;   /* actual data-in length */
+    uint32_t dout_act;
+    uint64_t start_ns;  /* from sg_pt_stats_now_ns() */
+    uint64_t dur_ns;
+    uint8_t cmd[SG_PT_TRACE_MAX_CMD_LEN];
+    uint8_t sense[SG_PT_TRACE_MAX_SENSE_LEN];
+};
+
+/* Returns 0 or a negated errno if fname cannot be created */
+int sg_pt_trace_start(const char * fname);
+bool sg_pt_trace_on(void);
+void sg_pt_trace_flush(void);
+void sg_pt_trace_stop(void);
+/* Checks the file header at bp. Returns its length or -1 if bad */
+int sg_pt_trace_hdr_check(const uint8_t * bp, int blen);
+/* Decodes the record at bp into *rp. Returns the number of bytes it
+ * occupies, 0 if blen is too short to hold it or -1 if it is malformed. */
+int sg_pt_trace_decode(const uint8_t * bp, int blen,
+                       struct sg_pt_trace_rec * rp);
+
+/* Command recording. Unlike the trace above, a recording holds each
+ * command together with its complete response (status, sense data, the
+ * data-in bytes and NVMe completion result) so that it can be served back
+ * later. When started, by sg_pt_record_start() or by setting the
+ * SG3_UTILS_PT_RECORD environment variable to the output file name, each
+ * command completed by do_scsi_pt() and do_nvm_pt() is appended to that
+ * file. The library built with './configure --enable-pt_replay' has a
+ * pass-through backend (sg_pt_replay.c) that serves recordings back,
+ * matched by command (e.g. cdb), for benchmarking without the device. */
+#define SG_PT_RECORD_ENV "SG3_UTILS_PT_RECORD"
+
+struct sg_pt_record_rec {
+    int kind;           /* SG_PT_STATS_KIND_* */
+    int category;       /* SCSI_PT_RESULT_* */
+    int res;            /* value returned by do_scsi_pt() */
+    int status;         /* from get_scsi_pt_status_response() */
+    int cmd_len;
+    int sense_len;
+    uint32_t din_len;   /* requested data-in length */
+    uint32_t din_act;   /* data-in bytes recorded (at dinp) */
+    uint32_t dout_len;  /* requested data-out length (data not recorded) */
+    uint32_t result;    /* from get_pt_result() */
+    uint64_t dur_ns;
+    const uint8_t * cmdp;       /* these point into the decoded buffer */
+    const uint8_t * sensep;
+    const uint8_t * dinp;
+};
+
+/* Returns 0 or a negated errno if fname cannot be created */
+int sg_pt_record_start(const char * fname);
+bool sg_pt_record_on(void);
+void sg_pt_record_stop(void);
+/* Checks the file header at bp. Returns its length or -1 if bad */
+int sg_pt_record_hdr_check(const uint8_t * bp, int blen);
+/* Decodes the record at bp into *rp, whose pointers refer to bp. Returns
+ * the number of bytes it occupies, 0 if blen is too short to hold it or
+ * -1 if it is malformed. */
+int sg_pt_record_decode(const uint8_t * bp, int blen,
+                        struct sg_pt_record_rec * rp);
+
+/* For OS interfaces: sg_pt_observe_on() is true when statistics, tracing
+ * or recording is active; then each command should be timed, starting
+ * with sg_pt_stats_now_ns(), and sg_pt_observe_done() called once it has
+ * completed with 'res' being what do_scsi_pt() returns for it and 'dinp'
+ * the data-in buffer (or NULL). */
+bool sg_pt_observe_on(void);
+void sg_pt_observe_done(const struct sg_pt_base * objp, int kind, int res,
+                        uint64_t start_ns, const uint8_t * dinp);
+
 /* The two functions yield requested and actual data transfer lengths in
  * bytes. The second argument is a pointer to the data-in length; the third
  * argument is a pointer to the data-out length. The pointers may be NULL.
@@ -272,6 +488,24 @@ uint32_t get_pt_nvme_nsid(const struct sg_pt_base * objp);
  * scsi_pt_close_device() ).  */
 void destruct_scsi_pt_obj(struct sg_pt_base * objp);
 
+/* Pool of constructed objects, kept per device file descriptor, so that
+ * callers issuing many commands (e.g. the sg_ll_* functions) avoid a
+ * calloc() and a fstat() (to classify dev_fd) per command. Only file
+ * descriptors given to scsi_pt_pool_enable() are pooled; the sg_cmds_open_*
+ * functions do that. scsi_pt_pool_get() yields an object ready to be used
+ * with dev_fd (or NULL if out of memory); it falls back to
+ * construct_scsi_pt_obj_with_fd() if dev_fd is not pooled. scsi_pt_pool_put()
+ * clears objp and keeps it for the next scsi_pt_pool_get() on the same
+ * dev_fd, otherwise it calls destruct_scsi_pt_obj(). scsi_pt_pool_flush()
+ * destroys the objects held for dev_fd (all if dev_fd is -1) and stops
+ * pooling it; scsi_pt_close_device() calls it. If a pooled dev_fd is closed
+ * some other way, call scsi_pt_pool_flush() first. These functions are
+ * thread safe, objects obtained from the pool are not shared. */
+int scsi_pt_pool_enable(int dev_fd, int verbose);
+struct sg_pt_base * scsi_pt_pool_get(int dev_fd, int verbose);
+void scsi_pt_pool_put(struct sg_pt_base * objp);
+void scsi_pt_pool_flush(int dev_fd);
+
 #ifdef SG_LIB_WIN32
 #define SG_LIB_WIN32_DIRECT 1
 
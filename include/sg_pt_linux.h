@@ -123,10 +123,13 @@ struct sg_pt_linux_scsi {
     bool is_sg;
     bool is_bsg;
     bool is_nvme;       /* OS device type, if false ignore nvme_our_snt */
+    bool is_blkemu;     /* in-process emulated device, see sg_blkemu.h */
     bool nvme_our_snt; /* true: our SNTL; false: received NVMe command */
     bool nvme_stat_dnr; /* Do No Retry, part of completion status field */
     bool nvme_stat_more; /* More, part of completion status field */
     bool mdxfer_out;    /* direction of metadata xfer, true->data-out */
+    bool async_more;    /* SCSI_PT_FLAGS_MORE given to set_scsi_pt_flags() */
+    bool hipri;         /* SCSI_PT_FLAGS_HIPRI given to set_scsi_pt_flags() */
     int dev_fd;                 /* -1 if not given (yet) */
     int in_err;
     int os_err;
@@ -135,6 +138,8 @@ struct sg_pt_linux_scsi {
                                  * implies dev_fd is not a NVMe device
                                  * (is_nvme=false) or it is a NVMe char
                                  * device (e.g. /dev/nvme0 ) */
+    uint32_t nvme_lb_sz;        /* logical block size of nvme_nsid, 0 if
+                                 * not yet fetched */
     uint32_t nvme_result;       /* DW0 from completion queue */
     uint32_t nvme_status;       /* SCT|SC: DW3 27:17 from completion queue,
                                  * note: the DNR+More bit are not there.
@@ -146,6 +151,10 @@ struct sg_pt_linux_scsi {
     uint8_t * nvme_id_ctlp;     /* cached response to controller IDENTIFY */
     uint8_t * free_nvme_id_ctlp;
     uint8_t tmf_request[4];
+    int async_tmo;              /* timeout_secs from do_scsi_pt_submit() */
+    int async_res;              /* do_scsi_pt() result from worker thread */
+    struct sg_pt_base * async_next;     /* worker thread queue link */
+    uint64_t stats_start_ns;    /* submit time if sg_pt_observe_on() */
 };
 
 struct sg_pt_base {
@@ -183,6 +192,13 @@ struct sg_pt_base {
 #define NVME_IOCTL_ADMIN64_CMD  _IOWR('N', 0x47, struct nvme_passthru_cmd64)
 #define NVME_IOCTL_IO64_CMD     _IOWR('N', 0x48, struct nvme_passthru_cmd64)
 #endif
+/* io_uring IORING_OP_URING_CMD command (cmd_op) for NVMe generic char
+ * devices (e.g. /dev/ng0n1). Its payload (struct nvme_uring_cmd) has the
+ * same layout as the Linux variant of sg_nvme_passthru_cmd: the trailing
+ * 'result' field is reserved and must be zero. */
+#ifndef NVME_URING_CMD_IO
+#define NVME_URING_CMD_IO       _IOWR('N', 0x80, struct sg_nvme_passthru_cmd)
+#endif
 
 extern bool sg_bsg_nvme_char_major_checked;
 extern int sg_bsg_major;
@@ -193,6 +209,28 @@ void sg_find_bsg_nvme_char_major(int verbose);
 int sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb);
 int sg_linux_get_sg_version(const struct sg_pt_base * vp);
 
+/* io_uring based submission of SNTL READ and WRITE commands to NVMe generic
+ * char devices (e.g. /dev/ng0n1) using IORING_OP_URING_CMD. Other commands
+ * are executed synchronously by sg_nvme_uring_prep() and their completion
+ * is queued on the same ring. Used by the do_scsi_pt_submit() family in
+ * sg_pt_linux.c . sg_nvme_uring_new() returns 0 or a negated errno (e.g.
+ * -EOPNOTSUPP when built without io_uring or the kernel lacks support);
+ * if 'iopoll' is true completions are polled rather than interrupt
+ * driven. The other functions that return int yield 0 or a negated errno
+ * apart from sg_nvme_uring_reap() which yields what do_scsi_pt() would
+ * have returned for *vpp (or -EAGAIN). */
+struct sg_nvme_uring;
+
+int sg_nvme_uring_new(int dev_fd, bool iopoll, struct sg_nvme_uring ** urpp,
+                      int vb);
+void sg_nvme_uring_free(struct sg_nvme_uring * urp);
+int sg_nvme_uring_prep(struct sg_nvme_uring * urp, struct sg_pt_base * vp,
+                       int time_secs, int vb);
+int sg_nvme_uring_enter(struct sg_nvme_uring * urp, int vb);
+int sg_nvme_uring_reap(struct sg_nvme_uring * urp, bool wait,
+                       struct sg_pt_base ** vpp, int vb);
+int sg_nvme_uring_poll_fd(const struct sg_nvme_uring * urp);
+
 /* This trims given NVMe block device name in Linux (e.g. /dev/nvme0n1p5)
  * to the name of its associated char device (e.g. /dev/nvme0). If this
  * occurs true is returned and the char device name is placed in 'b' (as
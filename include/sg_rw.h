@@ -0,0 +1,164 @@
+#ifndef SG_RW_H
+#define SG_RW_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* This is a fast path for issuing many SCSI READ and WRITE commands that
+ * only differ in their starting LBA and number of blocks. The copy
+ * utilities (e.g. sg_dd, sgm_dd and sg_read) issue millions of such
+ * commands, so rebuilding the whole cdb and a new pass-through object for
+ * each one is wasteful. Instead a cdb template is encoded once by
+ * sg_rw_tmpl_init() and then sg_rw_tmpl_patch() only writes the LBA and
+ * TRANSFER LENGTH fields. The sg_rw_ctx object adds a pass-through object
+ * and sense buffer that are allocated once and re-used for every command,
+ * so sg_rw_do() does no memory allocation. */
+
+#define SG_RW_MAX_CDB_LEN 32
+
+/* Bits for the flags argument of sg_rw_tmpl_init() */
+#define SG_RW_FL_DPO 0x1        /* Disable Page Out (cache retention) */
+#define SG_RW_FL_FUA 0x2        /* Force Unit Access */
+
+/* Only sg_rw_tmpl_init() should write to this structure. It is exposed so
+ * that callers can place it on the stack or in their own structures and
+ * so that they can use 'cdb' and 'cdb_len' directly (e.g. with a
+ * sg_io_hdr or sg_io_v4 object). */
+struct sg_rw_tmpl {
+    uint8_t cdb[SG_RW_MAX_CDB_LEN];
+    uint8_t cdb_len;            /* 6, 10, 12, 16 or 32 */
+    uint8_t lba_off;            /* byte offset of LOGICAL BLOCK ADDRESS */
+    uint8_t num_off;            /* byte offset of TRANSFER LENGTH */
+    bool is_write;
+    bool patch_ref_tag;         /* 32 byte variant with protection */
+};
+
+/* Encodes a READ or WRITE cdb template of cdb_len bytes into *tp. cdb_len
+ * may be 6, 10, 12, 16 or 32. 'protect' is placed in the RDPROTECT or
+ * WRPROTECT field (0 to 7) and group_num in the GROUP NUMBER field (0 to
+ * 63); both must be 0 for cdb_len of 6. 'flags' is a bitmask of SG_RW_FL_*
+ * values; also not permitted for cdb_len of 6. The LBA and TRANSFER
+ * LENGTH fields are left as zero. For the 32 byte variants, if 'protect'
+ * is non-zero then sg_rw_tmpl_patch() additionally sets the EXPECTED
+ * INITIAL LOGICAL BLOCK REFERENCE TAG field to the lower 32 bits of the
+ * LBA. Returns 0 on success or SG_LIB_SYNTAX_ERROR if an argument is
+ * invalid. */
+int sg_rw_tmpl_init(struct sg_rw_tmpl * tp, int cdb_len, bool is_write,
+                    int protect, int flags, int group_num);
+
+/* Writes 'lba' and 'num_blks' into the cdb held in *tp and leaves all
+ * other bytes unchanged. Returns 0 on success, SG_LIB_LBA_OUT_OF_RANGE if
+ * any block in the range does not fit in the LBA field, or
+ * SG_LIB_SYNTAX_ERROR if num_blks does not fit in the TRANSFER LENGTH
+ * field (note: 256 blocks is encoded as 0 in the 6 byte variant). */
+int sg_rw_tmpl_patch(struct sg_rw_tmpl * tp, uint64_t lba,
+                     uint32_t num_blks);
+
+/* Opaque context holding a template, a pass-through object associated
+ * with a device file descriptor and a sense buffer. */
+struct sg_rw_ctx;
+struct sg_pt_base;
+
+/* Creates a context that will issue commands built from *tp (which is
+ * copied) to the device associated with sg_fd. 'blk_sz' is the logical
+ * block size in bytes. If timeout_secs <= 0 then 60 seconds is used.
+ * Returns NULL if out of memory or if the pass-through object could not
+ * be associated with sg_fd (with a message if verbose > 0). */
+struct sg_rw_ctx * sg_rw_ctx_new(int sg_fd, const struct sg_rw_tmpl * tp,
+                                 int blk_sz, int timeout_secs, int verbose);
+
+/* Releases the context and its pass-through object. Does not close the
+ * device file descriptor. NULL is ignored. */
+void sg_rw_ctx_free(struct sg_rw_ctx * cp);
+
+/* Issues one READ or WRITE of num_blks starting at lba with data
+ * transferred to or from buff which should be at least num_blks * blk_sz
+ * bytes long. Only the LBA and TRANSFER LENGTH fields of the cdb are
+ * changed and the pass-through object is re-used. Returns 0 on success
+ * (including recovered errors), a SG_LIB_CAT_* value for sense data (e.g.
+ * SG_LIB_CAT_UNIT_ATTENTION or SG_LIB_CAT_MEDIUM_HARD), a value returned
+ * by sg_rw_tmpl_patch() if lba or num_blks is out of range,
+ * SG_LIB_TRANSPORT_ERROR or an errno based value from sg_convert_errno().
+ * If residp is not NULL then the residual byte count is written to it. If
+ * the command yielded sense data it can be fetched with
+ * sg_rw_get_sense(). */
+int sg_rw_do(struct sg_rw_ctx * cp, uint64_t lba, uint32_t num_blks,
+             uint8_t * buff, int * residp, bool noisy);
+
+/* Returns a pointer to the sense buffer of the last command issued by
+ * sg_rw_do() and writes its length to *slenp (0 if there was none). */
+const uint8_t * sg_rw_get_sense(const struct sg_rw_ctx * cp, int * slenp);
+
+/* Returns the re-used pass-through object, for example to fetch the
+ * command duration or to issue a different command on the same file
+ * descriptor (then sg_rw_do() will re-instate its own cdb). */
+struct sg_pt_base * sg_rw_get_pt(struct sg_rw_ctx * cp);
+
+
+/* Support for 'bpt=auto' in the copy utilities. The Block Limits VPD page
+ * gives a starting point, then a short ramp of READs (so it does not
+ * modify the medium) doubles the number of blocks per transfer while
+ * watching throughput and per command latency. */
+
+#define SG_RW_RAMP_MAX_STEPS 8
+#define SG_RW_AUTO_MAX_BYTES (8 * 1024 * 1024) /* used if max_bpt <= 0 */
+
+struct sg_rw_ramp_step {
+    int bpt;
+    int num_cmds;
+    uint32_t avg_lat_us;        /* mean latency per READ */
+    uint64_t bytes_per_sec;
+};
+
+struct sg_rw_bpt_auto {
+    bool vpd_valid;             /* Block Limits VPD page fetched */
+    bool ramp_err;              /* ramp stopped early by READ error */
+    uint16_t opt_xfer_gran;     /* these 3 from VPD, units: blocks, */
+    uint32_t max_xfer_len;      /*   0 means not reported */
+    uint32_t opt_xfer_len;
+    int vpd_bpt;                /* choice based on VPD page alone */
+    int bpt;                    /* final choice */
+    int num_steps;              /* valid elements in step[] */
+    struct sg_rw_ramp_step step[SG_RW_RAMP_MAX_STEPS];
+};
+
+/* Chooses a blocks per transfer (bpt) value for the device associated
+ * with sg_fd, whose logical block size is blk_sz bytes. def_bpt is used
+ * when the Block Limits VPD page does not give an optimal transfer length,
+ * an optimal transfer length that is too large is clamped. The result is
+ * no larger than max_bpt (or SG_RW_AUTO_MAX_BYTES / blk_sz if max_bpt <=
+ * 0), the VPD maximum transfer length or what a cdb_len byte READ can
+ * express. If do_ramp is true then READs of cdb_len bytes are issued
+ * starting at lba and wrapping within the following num_blks blocks (if
+ * num_blks is 0, up to the capacity given by READ CAPACITY). The smallest
+ * bpt within 5% of the best measured throughput is chosen. Results are
+ * written to *bap; bap->bpt is always usable when 0 is returned. Returns
+ * SG_LIB_SYNTAX_ERROR for bad arguments or an errno based value if out of
+ * memory. */
+int sg_rw_bpt_auto(int sg_fd, int blk_sz, int cdb_len, uint64_t lba,
+                   uint64_t num_blks, int def_bpt, int max_bpt, bool do_ramp,
+                   struct sg_rw_bpt_auto * bap, int verbose);
+
+/* Summarizes *bap in b as a single line (without trailing newline).
+ * Returns b. */
+char * sg_rw_bpt_auto_str(const struct sg_rw_bpt_auto * bap, int blk_sz,
+                          int blen, char * b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1385 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1   /* for memfd_create(), fallocate() and SEEK_DATA */
+#endif
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_blkemu.h"
+#include "sg_pt.h"
+#include "sg_lib.h"
+#include "sg_snt.h"
+#include "sg_unaligned.h"
+#include "sg_io_linux.h"
+#include "sg_pr2serr.h"
+
+/* Version 1.00 20261016 */
+
+/* In-process emulated SCSI direct access block device, see sg_blkemu.h .
+ * The backing store is either a (sparse) file or, by default, an anonymous
+ * memfd, accessed with pread(2) and pwrite(2) so that unwritten and
+ * deallocated ranges stay holes: UNMAP and WRITE SAME with the UNMAP bit
+ * punch holes and GET LBA STATUS reports them (found with SEEK_HOLE). The
+ * INQUIRY (apart from the block VPD pages), MODE SENSE(10), MODE SELECT(10)
+ * and REPORT LUNS responses come from the SCSI to NVMe translation code in
+ * sg_snt.c, fed a synthesized NVMe Identify controller and namespace.
+ *
+ * Commands supported: TEST UNIT READY, REQUEST SENSE, INQUIRY, START STOP
+ * UNIT, MODE SENSE(10), MODE SELECT(10), REPORT LUNS, READ CAPACITY(10 and
+ * 16), READ and WRITE(6, 10, 12 and 16), VERIFY(10 and 16), UNMAP, WRITE
+ * SAME(10 and 16), GET LBA STATUS(16), SYNCHRONIZE CACHE(10 and 16) and,
+ * when zoned, REPORT ZONES, RESET WRITE POINTER and FINISH ZONE. A zoned
+ * device is host managed (no logical block provisioning) with unrestricted
+ * reads; writes to sequential write required zones must start at the
+ * zone's write pointer and not cross a zone boundary. Zones are never
+ * explicitly opened or closed. */
+
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO 4
+#endif
+
+#define BLKEMU_DEF_SIZE (256 * 1024 * 1024)
+#define BLKEMU_MAX_GLS_DESC 64      /* GET LBA STATUS descriptors returned */
+#define BLKEMU_UNMAP_MAX_LBAS 0x400000
+#define BLKEMU_UNMAP_MAX_DESC 256
+#define BLKEMU_WS_MAX_LBAS 0x400000
+#define BLKEMU_ID_LEN 4096          /* NVMe Identify response length */
+
+#define INVALID_OPCODE 0x20
+#define LBA_OUT_OF_RANGE 0x21
+#define INVALID_FIELD_IN_CDB 0x24
+#define INVALID_FIELD_IN_PARAM_LIST 0x26
+#define PARAMETER_LIST_LENGTH_ERR 0x1a
+#define WRITE_PROTECTED 0x27
+#define MISCOMPARE_VERIFY_ASC 0x1d
+#define UNALIGNED_WRITE_ASCQ 0x4        /* with asc 0x21 */
+#define WRITE_BOUNDARY_ASCQ 0x5         /* with asc 0x21 */
+
+struct blkemu_dev {
+    bool read_only;
+    bool file_backed;
+    bool zoned;
+    int fd;
+    int lb_shift;               /* log2(logical block size) */
+    int qd;                     /* 0 -> no limit */
+    int in_flight;
+    uint32_t num_zones;
+    uint32_t num_conv;          /* leading conventional zones */
+    uint32_t opt_xfer_len;      /* Block Limits VPD, 0 -> not reported */
+    uint64_t num_lbs;
+    uint64_t zone_lbs;
+    uint64_t lat_ns;
+    uint64_t * wps;             /* per zone write pointer, absolute LBA */
+    pthread_mutex_t lock;       /* protects in_flight, wps and dev_stat */
+    pthread_cond_t qd_cv;
+    struct sg_snt_dev_state_t dev_stat;
+    uint8_t id_ctl[BLKEMU_ID_LEN];
+    uint8_t id_ns[BLKEMU_ID_LEN];
+};
+
+static pthread_mutex_t blkemu_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Indexed by fd. Entries are set and cleared under blkemu_reg_lock but read
+ * without it; closing a device with commands still executing on it is a
+ * caller error (as it is for other devices). */
+static struct blkemu_dev * blkemu_by_fd[SG_BLKEMU_MAX_FD];
+
+static long blkemu_page_sz;
+
+
+static inline uint64_t
+blkemu_zone_start(const struct blkemu_dev * dp, uint32_t z)
+{
+    return (uint64_t)z * dp->zone_lbs;
+}
+
+static inline uint64_t
+blkemu_zone_end(const struct blkemu_dev * dp, uint32_t z)
+{
+    uint64_t e = (uint64_t)(z + 1) * dp->zone_lbs;
+
+    return (e < dp->num_lbs) ? e : dp->num_lbs;
+}
+
+/* Yields the zone condition as in REPORT ZONES: 0x0 (not write pointer),
+ * 0x1 (empty), 0x2 (implicitly open) or 0xe (full) */
+static int
+blkemu_zone_cond(const struct blkemu_dev * dp, uint32_t z)
+{
+    if (z < dp->num_conv)
+        return 0;
+    if (dp->wps[z] == blkemu_zone_start(dp, z))
+        return 0x1;
+    if (dp->wps[z] >= blkemu_zone_end(dp, z))
+        return 0xe;
+    return 0x2;
+}
+
+/* Builds sense data in iop from resp, including the sense key specific
+ * field pointing at an invalid field (compare with sg_pt_linux_nvme.c) */
+static void
+blkemu_sense(const struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+             const struct sg_snt_result_t * resp)
+{
+    bool cdb_pos_v = false;
+    bool param_pos_v = false;
+    bool dsense = !! dp->dev_stat.scsi_dsense;
+    int n;
+    uint8_t * sbp = iop->sbp;
+    uint8_t sks[4];
+
+    if (0 == resp->sstatus)
+        return;
+    iop->status = SAM_STAT_CHECK_CONDITION;
+    n = iop->mx_sb_len;
+    if ((NULL == sbp) || (n < 8) || ((! dsense) && (n < 14)))
+        return;
+    iop->sb_len_wr = dsense ? n : ((n < 18) ? n : 18);
+    memset(sbp, 0, n);
+    if (SPC_SK_ILLEGAL_REQUEST == resp->sk) {
+        if (INVALID_FIELD_IN_CDB == resp->asc)
+            cdb_pos_v = true;
+        else if (INVALID_FIELD_IN_PARAM_LIST == resp->asc)
+            param_pos_v = true;
+    }
+    sg_build_sense_buffer(dsense, sbp, resp->sk, resp->asc, resp->ascq);
+    if ((0 == resp->in_byte) || ((! cdb_pos_v) && (! param_pos_v)))
+        return;
+    memset(sks, 0, sizeof(sks));
+    sks[0] = 0x80;
+    if (cdb_pos_v)
+        sks[0] |= 0x40;
+    if (resp->in_bit < 8) {
+        sks[0] |= 0x8;
+        sks[0] |= (0x7 & resp->in_bit);
+    }
+    sg_put_unaligned_be16(resp->in_byte, sks + 1);
+    if (dsense) {
+        int sl = sbp[7] + 8;
+
+        if (n < (sl + 8))
+            return;
+        sbp[7] = sl;
+        sbp[sl] = 0x2;
+        sbp[sl + 1] = 0x6;
+        memcpy(sbp + sl + 4, sks, 3);
+        iop->sb_len_wr = sl + 8;
+    } else
+        memcpy(sbp + 15, sks, 3);
+}
+
+/* Copies up to n bytes from src to the data-in buffer, limited by the
+ * command's allocation length. Returns number of bytes copied. */
+static int
+blkemu_din(struct sg_blkemu_io * iop, const uint8_t * src, int n,
+           int alloc_len)
+{
+    if (n > alloc_len)
+        n = alloc_len;
+    if (n > iop->din_len)
+        n = iop->din_len;
+    if (n < 0)
+        n = 0;
+    if (n > 0)
+        memcpy(iop->dinp, src, n);
+    iop->din_resid = iop->din_len - n;
+    return n;
+}
+
+static int
+blkemu_pio(struct blkemu_dev * dp, bool is_write, uint8_t * bp, size_t len,
+           uint64_t off)
+{
+    ssize_t res;
+
+    while (len > 0) {
+        if (is_write)
+            res = pwrite(dp->fd, bp, len, (off_t)off);
+        else
+            res = pread(dp->fd, bp, len, (off_t)off);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            return -errno;
+        }
+        if (0 == res) {         /* read past end of a short file */
+            if (is_write)
+                return -EIO;
+            memset(bp, 0, len);
+            break;
+        }
+        bp += res;
+        off += res;
+        len -= res;
+    }
+    return 0;
+}
+
+/* Makes the given range of blocks read back as zeros, punching a hole in
+ * the backing store where page alignment allows. */
+static int
+blkemu_dealloc(struct blkemu_dev * dp, uint64_t lba, uint64_t num)
+{
+    uint64_t off = lba << dp->lb_shift;
+    uint64_t end = (lba + num) << dp->lb_shift;
+    uint64_t a = (off + blkemu_page_sz - 1) & ~(uint64_t)(blkemu_page_sz - 1);
+    uint64_t b = end & ~(uint64_t)(blkemu_page_sz - 1);
+    uint64_t k;
+    uint8_t * zp;
+    int res = 0;
+
+#ifdef HAVE_FALLOCATE
+    if ((a < b) && (0 == fallocate(dp->fd, FALLOC_FL_PUNCH_HOLE |
+                                   FALLOC_FL_KEEP_SIZE, a, b - a))) {
+        zp = (uint8_t *)calloc(1, blkemu_page_sz);
+        if (NULL == zp)
+            return -ENOMEM;
+        if (a > off)
+            res = blkemu_pio(dp, true, zp, a - off, off);
+        if ((0 == res) && (end > b))
+            res = blkemu_pio(dp, true, zp, end - b, b);
+        free(zp);
+        return res;
+    }
+#endif
+    zp = (uint8_t *)calloc(1, blkemu_page_sz);
+    if (NULL == zp)
+        return -ENOMEM;
+    for ( ; (0 == res) && (off < end); off += k) {
+        k = end - off;
+        if (k > (uint64_t)blkemu_page_sz)
+            k = blkemu_page_sz;
+        res = blkemu_pio(dp, true, zp, k, off);
+    }
+    free(zp);
+    return res;
+}
+
+static void
+blkemu_sync(struct blkemu_dev * dp, uint64_t off, uint64_t len)
+{
+    if (! dp->file_backed)
+        return;
+    if (sync_file_range(dp->fd, off, len, SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER))
+        fdatasync(dp->fd);
+}
+
+/* Checks a write against the write pointer rules of a zoned device and, if
+ * allowed, advances the write pointer. Returns 0 or -1 with resp set. */
+static int
+blkemu_zone_write(struct blkemu_dev * dp, uint64_t lba, uint64_t num,
+                  struct sg_snt_result_t * resp)
+{
+    uint32_t z = lba / dp->zone_lbs;
+    int res = 0;
+
+    pthread_mutex_lock(&dp->lock);
+    if (z < dp->num_conv) {
+        if ((lba + num) > blkemu_zone_start(dp, dp->num_conv)) {
+            sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                     LBA_OUT_OF_RANGE, WRITE_BOUNDARY_ASCQ);
+            res = -1;
+        }
+    } else if (lba != dp->wps[z]) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, UNALIGNED_WRITE_ASCQ);
+        res = -1;
+    } else if ((lba + num) > blkemu_zone_end(dp, z)) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, WRITE_BOUNDARY_ASCQ);
+        res = -1;
+    } else
+        dp->wps[z] += num;
+    pthread_mutex_unlock(&dp->lock);
+    return res;
+}
+
+/* Common checks of commands that write. Returns 0 or -1 with resp set. */
+static int
+blkemu_write_check(const struct blkemu_dev * dp, uint64_t lba, uint64_t num,
+                   struct sg_snt_result_t * resp)
+{
+    if ((lba > dp->num_lbs) || (num > (dp->num_lbs - lba))) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, 0);
+        return -1;
+    }
+    if (dp->read_only) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_DATA_PROTECT, WRITE_PROTECTED,
+                                 0);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+blkemu_rw(struct blkemu_dev * dp, struct sg_blkemu_io * iop, bool is_write,
+          uint64_t lba, uint32_t num, bool fua, struct sg_snt_result_t * resp)
+{
+    int res;
+    uint64_t off = lba << dp->lb_shift;
+    uint64_t len = (uint64_t)num << dp->lb_shift;
+
+    if (is_write) {
+        if (blkemu_write_check(dp, lba, num, resp))
+            return -1;
+        if (0 == num)
+            return 0;
+        if (len > (uint64_t)iop->dout_len) {
+            sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                     PARAMETER_LIST_LENGTH_ERR, 0);
+            return -1;
+        }
+        if (dp->zoned && blkemu_zone_write(dp, lba, num, resp))
+            return -1;
+        res = blkemu_pio(dp, true, (uint8_t *)iop->doutp, len, off);
+        if (res)
+            return res;
+        iop->dout_resid = iop->dout_len - (int)len;
+        if (fua)
+            blkemu_sync(dp, off, len);
+        return 0;
+    }
+    if ((lba > dp->num_lbs) || (num > (dp->num_lbs - lba))) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, 0);
+        return -1;
+    }
+    if (len > (uint64_t)iop->din_len)
+        len = iop->din_len;
+    if (len > 0) {
+        res = blkemu_pio(dp, false, iop->dinp, len, off);
+        if (res)
+            return res;
+    }
+    iop->din_resid = iop->din_len - (int)len;
+    return 0;
+}
+
+/* VERIFY(10) and VERIFY(16). BYTCHK=0 only checks the range, BYTCHK=1
+ * compares the data-out with the blocks and BYTCHK=3 compares each block
+ * with a single block of data-out. */
+static int
+blkemu_verify(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+              const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    bool is_16 = (0x8f == cdbp[0]);
+    int bytchk = (cdbp[1] >> 1) & 0x3;
+    int res = 0;
+    uint32_t k, num;
+    uint64_t lba, off;
+    uint64_t lb_sz = 1ULL << dp->lb_shift;
+    const uint8_t * cp;
+    uint8_t * bp;
+
+    lba = is_16 ? sg_get_unaligned_be64(cdbp + 2) :
+                  sg_get_unaligned_be32(cdbp + 2);
+    num = is_16 ? sg_get_unaligned_be32(cdbp + 10) :
+                  sg_get_unaligned_be16(cdbp + 7);
+    if (2 == bytchk) {
+        sg_snt_mk_sense_invalid_fld(resp, true, 1, 2);
+        return -1;
+    }
+    if ((lba > dp->num_lbs) || (num > (dp->num_lbs - lba))) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, 0);
+        return -1;
+    }
+    if ((0 == bytchk) || (0 == num))
+        return 0;
+    if ((uint64_t)iop->dout_len < ((1 == bytchk) ? num * lb_sz : lb_sz)) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 PARAMETER_LIST_LENGTH_ERR, 0);
+        return -1;
+    }
+    bp = (uint8_t *)malloc(lb_sz);
+    if (NULL == bp)
+        return -ENOMEM;
+    cp = iop->doutp;
+    for (k = 0, off = lba << dp->lb_shift; k < num; ++k, off += lb_sz) {
+        res = blkemu_pio(dp, false, bp, lb_sz, off);
+        if (res)
+            break;
+        if (memcmp(bp, cp, lb_sz)) {
+            sg_snt_mk_sense_asc_ascq(resp, SPC_SK_MISCOMPARE,
+                                     MISCOMPARE_VERIFY_ASC, 0);
+            res = -1;
+            break;
+        }
+        if (1 == bytchk)
+            cp += lb_sz;
+    }
+    free(bp);
+    if (0 == res)
+        iop->dout_resid = iop->dout_len -
+                          (int)((1 == bytchk) ? num * lb_sz : lb_sz);
+    return res;
+}
+
+/* WRITE SAME(10) and WRITE SAME(16). With the UNMAP bit set and an all
+ * zeros block (or NDOB) the range is deallocated. */
+static int
+blkemu_write_same(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+                  const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    bool is_16 = (0x93 == cdbp[0]);
+    bool unmap = !! (0x8 & cdbp[1]);
+    bool ndob = is_16 && (0x1 & cdbp[1]);
+    int res = 0;
+    uint32_t k, num;
+    uint64_t lba, off;
+    uint64_t lb_sz = 1ULL << dp->lb_shift;
+    uint8_t * bp;
+
+    lba = is_16 ? sg_get_unaligned_be64(cdbp + 2) :
+                  sg_get_unaligned_be32(cdbp + 2);
+    num = is_16 ? sg_get_unaligned_be32(cdbp + 10) :
+                  sg_get_unaligned_be16(cdbp + 7);
+    if ((0 == num) || (num > BLKEMU_WS_MAX_LBAS)) { /* WSNZ=1 */
+        sg_snt_mk_sense_invalid_fld(resp, true, is_16 ? 10 : 7, -1);
+        return -1;
+    }
+    if (unmap && dp->zoned) {
+        sg_snt_mk_sense_invalid_fld(resp, true, 1, 3);
+        return -1;
+    }
+    if (blkemu_write_check(dp, lba, num, resp))
+        return -1;
+    if ((! ndob) && ((uint64_t)iop->dout_len < lb_sz)) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 PARAMETER_LIST_LENGTH_ERR, 0);
+        return -1;
+    }
+    if (dp->zoned && blkemu_zone_write(dp, lba, num, resp))
+        return -1;
+    if (ndob) {
+        if (unmap)
+            return blkemu_dealloc(dp, lba, num);
+        bp = (uint8_t *)calloc(1, lb_sz);
+        if (NULL == bp)
+            return -ENOMEM;
+    } else {
+        iop->dout_resid = iop->dout_len - (int)lb_sz;
+        if (unmap && sg_all_zeros(iop->doutp, lb_sz))
+            return blkemu_dealloc(dp, lba, num);
+        bp = (uint8_t *)iop->doutp;
+    }
+    for (k = 0, off = lba << dp->lb_shift; k < num; ++k, off += lb_sz) {
+        res = blkemu_pio(dp, true, bp, lb_sz, off);
+        if (res)
+            break;
+    }
+    if (ndob)
+        free(bp);
+    return res;
+}
+
+static int
+blkemu_unmap(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+             const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    int k, res, pl_len, bd_len;
+    uint32_t num;
+    uint64_t lba;
+    const uint8_t * bp;
+
+    if (dp->zoned) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 INVALID_OPCODE, 0);
+        return -1;
+    }
+    pl_len = sg_get_unaligned_be16(cdbp + 7);
+    if (pl_len > iop->dout_len)
+        pl_len = iop->dout_len;
+    if (pl_len < 8)
+        return 0;
+    iop->dout_resid = iop->dout_len - pl_len;
+    bp = iop->doutp;
+    bd_len = sg_get_unaligned_be16(bp + 2);
+    if ((bd_len + 8) > pl_len) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 PARAMETER_LIST_LENGTH_ERR, 0);
+        return -1;
+    }
+    if ((bd_len / 16) > BLKEMU_UNMAP_MAX_DESC) {
+        sg_snt_mk_sense_invalid_fld(resp, false, 2, -1);
+        return -1;
+    }
+    /* check all descriptors before deallocating any */
+    for (k = 0, bp += 8; k < (bd_len / 16); ++k, bp += 16) {
+        lba = sg_get_unaligned_be64(bp);
+        num = sg_get_unaligned_be32(bp + 8);
+        if (blkemu_write_check(dp, lba, num, resp))
+            return -1;
+        if (num > BLKEMU_UNMAP_MAX_LBAS) {
+            sg_snt_mk_sense_invalid_fld(resp, false, 8 + (k * 16) + 8, -1);
+            return -1;
+        }
+    }
+    for (k = 0, bp = iop->doutp + 8; k < (bd_len / 16); ++k, bp += 16) {
+        num = sg_get_unaligned_be32(bp + 8);
+        if (num > 0) {
+            res = blkemu_dealloc(dp, sg_get_unaligned_be64(bp), num);
+            if (res)
+                return res;
+        }
+    }
+    return 0;
+}
+
+/* GET LBA STATUS(16). Extents are found by seeking for data and holes in
+ * the backing store; if that is not supported everything is mapped. */
+static int
+blkemu_get_lba_status(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+                      const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    bool mapped;
+    int n, max_d;
+    uint32_t alloc_len;
+    uint64_t lba, elba, ext;
+    off_t off, d, end;
+    uint8_t * bp;
+    uint8_t arr[8 + (16 * BLKEMU_MAX_GLS_DESC)];
+
+    lba = sg_get_unaligned_be64(cdbp + 2);
+    alloc_len = sg_get_unaligned_be32(cdbp + 10);
+    if (lba >= dp->num_lbs) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, 0);
+        return -1;
+    }
+    max_d = ((int)((alloc_len < sizeof(arr)) ? alloc_len : sizeof(arr)) - 8)
+            / 16;
+    if (max_d < 1)
+        max_d = 1;
+    memset(arr, 0, sizeof(arr));
+    end = (off_t)(dp->num_lbs << dp->lb_shift);
+    for (n = 0, bp = arr + 8; (n < max_d) && (lba < dp->num_lbs); ) {
+        off = (off_t)(lba << dp->lb_shift);
+        d = lseek(dp->fd, off, SEEK_DATA);
+        if (d < 0) {
+            mapped = (ENXIO != errno);  /* ENXIO: only holes after off */
+            elba = dp->num_lbs;
+        } else if (d > off) {
+            mapped = false;
+            elba = ((d < end) ? d : end) >> dp->lb_shift;
+        } else {
+            mapped = true;
+            d = lseek(dp->fd, off, SEEK_HOLE);
+            if ((d < 0) || (d > end))
+                d = end;
+            elba = (d + (1 << dp->lb_shift) - 1) >> dp->lb_shift;
+        }
+        if (elba <= lba)
+            elba = lba + 1;
+        for ( ; (n < max_d) && (lba < elba); ++n, bp += 16) {
+            ext = elba - lba;
+            if (ext > UINT32_MAX)
+                ext = UINT32_MAX;
+            sg_put_unaligned_be64(lba, bp);
+            sg_put_unaligned_be32((uint32_t)ext, bp + 8);
+            bp[12] = mapped ? 0x0 : 0x1;    /* deallocated */
+            lba += ext;
+        }
+    }
+    n = 8 + (n * 16);
+    sg_put_unaligned_be32(n - 4, arr);
+    blkemu_din(iop, arr, n, alloc_len);
+    return 0;
+}
+
+static int
+blkemu_read_cap(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+                const uint8_t * cdbp)
+{
+    uint64_t mx_lba = dp->num_lbs - 1;
+    uint8_t arr[32];
+
+    memset(arr, 0, sizeof(arr));
+    if (0x25 == cdbp[0]) {      /* READ CAPACITY(10) */
+        sg_put_unaligned_be32((mx_lba > UINT32_MAX) ? UINT32_MAX :
+                              (uint32_t)mx_lba, arr);
+        sg_put_unaligned_be32(1 << dp->lb_shift, arr + 4);
+        blkemu_din(iop, arr, 8, 8);
+        return 0;
+    }
+    sg_put_unaligned_be64(mx_lba, arr);
+    sg_put_unaligned_be32(1 << dp->lb_shift, arr + 8);
+    if (dp->zoned)
+        arr[12] = 0x10;         /* RC BASIS=1 */
+    else
+        arr[14] = 0xc0;         /* LBPME=1, LBPRZ=1 */
+    blkemu_din(iop, arr, 32, sg_get_unaligned_be32(cdbp + 10));
+    return 0;
+}
+
+static int
+blkemu_rep_zones(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+                 const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    bool partial = !! (0x80 & cdbp[14]);
+    int ro = 0x3f & cdbp[14];
+    int cond, pos, n, mx;
+    uint32_t z, alloc_len, num_match;
+    uint64_t lba;
+    uint8_t zd[64];
+
+    lba = sg_get_unaligned_be64(cdbp + 2);
+    alloc_len = sg_get_unaligned_be32(cdbp + 10);
+    if (lba >= dp->num_lbs) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 LBA_OUT_OF_RANGE, 0);
+        return -1;
+    }
+    switch (ro) {
+    case 0x0: case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x6:
+    case 0x7: case 0x10: case 0x11: case 0x3f:
+        break;
+    default:
+        sg_snt_mk_sense_invalid_fld(resp, true, 14, 5);
+        return -1;
+    }
+    mx = (alloc_len < (uint32_t)iop->din_len) ? (int)alloc_len : iop->din_len;
+    pos = 64;
+    num_match = 0;
+    pthread_mutex_lock(&dp->lock);
+    for (z = lba / dp->zone_lbs; z < dp->num_zones; ++z) {
+        cond = blkemu_zone_cond(dp, z);
+        if (ro) {
+            if (0x3f == ro) {
+                if (0 != cond)
+                    continue;
+            } else if (0x5 == ro) {     /* FULL */
+                if (0xe != cond)
+                    continue;
+            } else if (ro != cond)      /* 3, 4, 6, 7, 0x10, 0x11 never */
+                continue;
+        }
+        if (partial && ((pos + 64) > mx))
+            break;
+        ++num_match;
+        if (pos >= mx)
+            continue;   /* still counting for the zone list length */
+        memset(zd, 0, sizeof(zd));
+        zd[0] = (z < dp->num_conv) ? 0x1 : 0x2;
+        zd[1] = cond << 4;
+        sg_put_unaligned_be64(blkemu_zone_end(dp, z) -
+                              blkemu_zone_start(dp, z), zd + 8);
+        sg_put_unaligned_be64(blkemu_zone_start(dp, z), zd + 16);
+        sg_put_unaligned_be64((z < dp->num_conv) ? UINT64_MAX : dp->wps[z],
+                              zd + 24);
+        n = ((pos + 64) > mx) ? (mx - pos) : 64;
+        memcpy(iop->dinp + pos, zd, n);
+        pos += 64;
+    }
+    pthread_mutex_unlock(&dp->lock);
+    memset(zd, 0, sizeof(zd));
+    sg_put_unaligned_be32(num_match * 64, zd);
+    sg_put_unaligned_be64(dp->num_lbs - 1, zd + 8);
+    n = (mx < 64) ? mx : 64;
+    if (n > 0)
+        memcpy(iop->dinp, zd, n);
+    iop->din_resid = iop->din_len - ((pos < mx) ? pos : mx);
+    return 0;
+}
+
+/* ZBC OUT: only RESET WRITE POINTER and FINISH ZONE */
+static int
+blkemu_zone_out(struct blkemu_dev * dp, const uint8_t * cdbp,
+                struct sg_snt_result_t * resp)
+{
+    bool all = !! (0x1 & cdbp[14]);
+    int sa = 0x1f & cdbp[1];
+    int res = 0;
+    uint32_t z, z_end;
+    uint64_t zid;
+
+    if ((0x2 != sa) && (0x4 != sa)) {
+        sg_snt_mk_sense_invalid_fld(resp, true, 1, 4);
+        return -1;
+    }
+    if (dp->read_only) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_DATA_PROTECT, WRITE_PROTECTED,
+                                 0);
+        return -1;
+    }
+    if (all) {
+        z = dp->num_conv;
+        z_end = dp->num_zones;
+    } else {
+        zid = sg_get_unaligned_be64(cdbp + 2);
+        if (zid >= dp->num_lbs) {
+            sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                     LBA_OUT_OF_RANGE, 0);
+            return -1;
+        }
+        z = zid / dp->zone_lbs;
+        if ((zid != blkemu_zone_start(dp, z)) || (z < dp->num_conv)) {
+            sg_snt_mk_sense_invalid_fld(resp, true, 2, -1);
+            return -1;
+        }
+        z_end = z + 1;
+    }
+    pthread_mutex_lock(&dp->lock);
+    for ( ; z < z_end; ++z) {
+        if (0x2 == sa)
+            dp->wps[z] = blkemu_zone_end(dp, z);
+        else if (dp->wps[z] != blkemu_zone_start(dp, z)) {
+            dp->wps[z] = blkemu_zone_start(dp, z);
+            res = blkemu_dealloc(dp, dp->wps[z], blkemu_zone_end(dp, z) -
+                                 dp->wps[z]);
+            if (res)
+                break;
+        }
+    }
+    pthread_mutex_unlock(&dp->lock);
+    return res;
+}
+
+/* Block VPD pages and the supported VPD pages page. Returns number of bytes
+ * placed in arr or 0 if the page is left to sg_snt_resp_inq(). */
+static int
+blkemu_vpd(const struct blkemu_dev * dp, int pn, uint8_t * arr, int arr_len)
+{
+    int n = 4;
+
+    memset(arr, 0, arr_len);
+    arr[0] = dp->dev_stat.pdt;
+    arr[1] = pn;
+    switch (pn) {
+    case 0x0:
+        arr[n++] = 0x0;
+        arr[n++] = 0x80;
+        arr[n++] = 0x83;
+        arr[n++] = 0x86;
+        arr[n++] = 0x87;
+        arr[n++] = 0xb0;
+        arr[n++] = 0xb1;
+        if (dp->zoned)
+            arr[n++] = 0xb6;
+        else
+            arr[n++] = 0xb2;
+        break;
+    case 0xb0:          /* Block limits */
+        n = 0x40;
+        arr[4] = 0x1;   /* WSNZ=1 */
+        sg_put_unaligned_be32(dp->opt_xfer_len, arr + 12);
+        if (! dp->zoned) {
+            sg_put_unaligned_be32(BLKEMU_UNMAP_MAX_LBAS, arr + 20);
+            sg_put_unaligned_be32(BLKEMU_UNMAP_MAX_DESC, arr + 24);
+            sg_put_unaligned_be32(blkemu_page_sz >> dp->lb_shift, arr + 28);
+        }
+        sg_put_unaligned_be64(BLKEMU_WS_MAX_LBAS, arr + 36);
+        break;
+    case 0xb2:          /* Logical block provisioning */
+        if (dp->zoned)
+            return 0;
+        n = 8;
+        arr[5] = 0xe4;  /* LBPU=1, LBPWS=1, LBPWS10=1, LBPRZ=1 */
+        arr[6] = 0x2;   /* thin provisioned */
+        break;
+    case 0xb6:          /* Zoned block device characteristics */
+        if (! dp->zoned)
+            return 0;
+        n = 0x40;
+        arr[4] = 0x1;   /* URSWRZ=1 */
+        sg_put_unaligned_be32(UINT32_MAX, arr + 8);
+        sg_put_unaligned_be32(UINT32_MAX, arr + 12);
+        sg_put_unaligned_be32(UINT32_MAX, arr + 16);
+        break;
+    case 0x80:
+    case 0x83:
+    case 0x86:
+    case 0x87:
+    case 0xb1:
+        return 0;
+    default:
+        return -1;
+    }
+    sg_put_unaligned_be16(n - 4, arr + 2);
+    return n;
+}
+
+static int
+blkemu_inquiry(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+               const uint8_t * cdbp, struct sg_snt_result_t * resp)
+{
+    int n;
+    uint32_t alloc_len = sg_get_unaligned_be16(cdbp + 3);
+    uint8_t arr[256];
+
+    if (0x1 & cdbp[1]) {
+        n = blkemu_vpd(dp, cdbp[2], arr, sizeof(arr));
+        if (n < 0) {
+            sg_snt_mk_sense_invalid_fld(resp, true, 2, 7);
+            return -1;
+        } else if (n > 0) {
+            blkemu_din(iop, arr, n, alloc_len);
+            return 0;
+        }
+    }
+    n = sg_snt_resp_inq(&dp->dev_stat, cdbp, dp->id_ctl, dp->id_ns,
+                        iop->dinp, iop->din_len, resp);
+    if (resp->sstatus)
+        return -1;
+    /* the T10 vendor id in these responses is "NVMe", use our own */
+    if (((0 == (0x1 & cdbp[1])) || (0x83 == cdbp[2])) && (n >= 16))
+        memcpy(iop->dinp + 8, "sg3utils", 8);
+    iop->din_resid = iop->din_len - n;
+    return 0;
+}
+
+/* The snt MODE SENSE(10) response has a made up block descriptor */
+static void
+blkemu_fix_mode_bd(const struct blkemu_dev * dp, uint8_t * bp, int n)
+{
+    int bd_len;
+
+    if (n < 8)
+        return;
+    bd_len = sg_get_unaligned_be16(bp + 6);
+    if ((8 == bd_len) && (n >= 16)) {
+        sg_put_unaligned_be32((dp->num_lbs > UINT32_MAX) ? UINT32_MAX :
+                              (uint32_t)dp->num_lbs, bp + 8);
+        sg_put_unaligned_be24(1 << dp->lb_shift, bp + 13);
+    } else if ((16 == bd_len) && (n >= 24)) {
+        sg_put_unaligned_be64(dp->num_lbs, bp + 8);
+        sg_put_unaligned_be32(1 << dp->lb_shift, bp + 20);
+    }
+}
+
+static int
+blkemu_cmd(struct blkemu_dev * dp, struct sg_blkemu_io * iop,
+           struct sg_snt_result_t * resp, int vb)
+{
+    bool fua;
+    int n, sa;
+    const uint8_t * cdbp = iop->cdbp;
+    uint8_t arr[32];
+
+    if (iop->cdb_len < 6) {
+        sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST,
+                                 INVALID_OPCODE, 0);
+        return -1;
+    }
+    fua = !! (0x8 & cdbp[1]);
+    sa = 0x1f & cdbp[1];
+    switch (cdbp[0]) {
+    case 0x0:           /* TEST UNIT READY */
+    case 0x1b:          /* START STOP UNIT */
+        return 0;
+    case 0x3:           /* REQUEST SENSE */
+        memset(arr, 0, sizeof(arr));
+        if (0x1 & cdbp[1]) {
+            arr[0] = 0x72;
+            n = 8;
+        } else {
+            arr[0] = 0x70;
+            arr[7] = 0xa;
+            n = 18;
+        }
+        blkemu_din(iop, arr, n, cdbp[4]);
+        return 0;
+    case 0x12:
+        return blkemu_inquiry(dp, iop, cdbp, resp);
+    case 0x5a:          /* MODE SENSE(10) */
+        pthread_mutex_lock(&dp->lock);
+        n = sg_snt_resp_mode_sense10(&dp->dev_stat, cdbp, iop->dinp,
+                                     iop->din_len, resp);
+        pthread_mutex_unlock(&dp->lock);
+        if (n < 0)
+            return -1;
+        blkemu_fix_mode_bd(dp, iop->dinp, n);
+        iop->din_resid = iop->din_len - n;
+        return 0;
+    case 0x55:          /* MODE SELECT(10) */
+        pthread_mutex_lock(&dp->lock);
+        n = sg_snt_resp_mode_select10(&dp->dev_stat, cdbp, iop->doutp,
+                                      iop->dout_len, resp);
+        pthread_mutex_unlock(&dp->lock);
+        return (n < 0) ? -1 : 0;
+    case 0xa0:          /* REPORT LUNS */
+        n = sg_snt_resp_rluns(&dp->dev_stat, cdbp, dp->id_ctl, 1, iop->dinp,
+                              iop->din_len, resp);
+        if (resp->sstatus)
+            return -1;
+        iop->din_resid = iop->din_len - n;
+        return 0;
+    case 0x25:          /* READ CAPACITY(10) */
+        return blkemu_read_cap(dp, iop, cdbp);
+    case 0x9e:          /* SERVICE ACTION IN(16) */
+        if (0x10 == sa)
+            return blkemu_read_cap(dp, iop, cdbp);
+        if (0x12 == sa)
+            return blkemu_get_lba_status(dp, iop, cdbp, resp);
+        break;
+    case 0x8:           /* READ(6) */
+    case 0xa:           /* WRITE(6) */
+        n = cdbp[4] ? cdbp[4] : 256;
+        return blkemu_rw(dp, iop, (0xa == cdbp[0]),
+                         sg_get_unaligned_be24(cdbp + 1) & 0x1fffff, n,
+                         false, resp);
+    case 0x28:          /* READ(10) */
+    case 0x2a:          /* WRITE(10) */
+        if (iop->cdb_len < 10)
+            break;
+        return blkemu_rw(dp, iop, (0x2a == cdbp[0]),
+                         sg_get_unaligned_be32(cdbp + 2),
+                         sg_get_unaligned_be16(cdbp + 7), fua, resp);
+    case 0xa8:          /* READ(12) */
+    case 0xaa:          /* WRITE(12) */
+        if (iop->cdb_len < 12)
+            break;
+        return blkemu_rw(dp, iop, (0xaa == cdbp[0]),
+                         sg_get_unaligned_be32(cdbp + 2),
+                         sg_get_unaligned_be32(cdbp + 6), fua, resp);
+    case 0x88:          /* READ(16) */
+    case 0x8a:          /* WRITE(16) */
+        if (iop->cdb_len < 16)
+            break;
+        return blkemu_rw(dp, iop, (0x8a == cdbp[0]),
+                         sg_get_unaligned_be64(cdbp + 2),
+                         sg_get_unaligned_be32(cdbp + 10), fua, resp);
+    case 0x2f:          /* VERIFY(10) */
+    case 0x8f:          /* VERIFY(16) */
+        if (iop->cdb_len < ((0x2f == cdbp[0]) ? 10 : 16))
+            break;
+        return blkemu_verify(dp, iop, cdbp, resp);
+    case 0x41:          /* WRITE SAME(10) */
+    case 0x93:          /* WRITE SAME(16) */
+        if (iop->cdb_len < ((0x41 == cdbp[0]) ? 10 : 16))
+            break;
+        return blkemu_write_same(dp, iop, cdbp, resp);
+    case 0x42:          /* UNMAP */
+        if (iop->cdb_len < 10)
+            break;
+        return blkemu_unmap(dp, iop, cdbp, resp);
+    case 0x35:          /* SYNCHRONIZE CACHE(10) */
+    case 0x91:          /* SYNCHRONIZE CACHE(16) */
+        blkemu_sync(dp, 0, 0);  /* 0 length: to end of file */
+        return 0;
+    case 0x95:          /* ZBC IN */
+        if ((! dp->zoned) || (iop->cdb_len < 16))
+            break;
+        if (0 == sa)
+            return blkemu_rep_zones(dp, iop, cdbp, resp);
+        sg_snt_mk_sense_invalid_fld(resp, true, 1, 4);
+        return -1;
+    case 0x94:          /* ZBC OUT */
+        if ((! dp->zoned) || (iop->cdb_len < 16))
+            break;
+        return blkemu_zone_out(dp, cdbp, resp);
+    default:
+        break;
+    }
+    if (vb > 2)
+        pr2ws("%s: unsupported cdb: opcode=0x%x, sa=0x%x\n", __func__,
+              cdbp[0], sa);
+    sg_snt_mk_sense_asc_ascq(resp, SPC_SK_ILLEGAL_REQUEST, INVALID_OPCODE, 0);
+    return -1;
+}
+
+/* Builds the NVMe Identify controller and namespace responses that
+ * sg_snt.c uses for INQUIRY and its VPD pages */
+static void
+blkemu_mk_ids(struct blkemu_dev * dp, const char * device_name)
+{
+    int k, n;
+    uint64_t h = 0xcbf29ce484222325ULL;    /* FNV-1a 64 bit */
+    char b[48];
+
+    for (k = 0; device_name[k]; ++k) {
+        h ^= (uint8_t)device_name[k];
+        h *= 0x100000001b3ULL;
+    }
+    if (! dp->file_backed)      /* anonymous devices differ per open */
+        h ^= ((uint64_t)getpid() << 32) | (uint32_t)dp->fd;
+    memset(b, ' ', sizeof(b));
+    n = snprintf(b, sizeof(b), "%016" PRIx64, h);
+    b[n] = ' ';
+    memcpy(dp->id_ctl + 4, b, 20);              /* SN */
+    memset(b, ' ', sizeof(b));
+    n = snprintf(b, sizeof(b), "%s", dp->zoned ? "sg3_utils blkemu zbc" :
+                                                 "sg3_utils blkemu");
+    b[n] = ' ';
+    memcpy(dp->id_ctl + 24, b, 40);             /* MN */
+    memcpy(dp->id_ctl + 64, "1.00    ", 8);     /* FR */
+    sg_put_unaligned_le32(1, dp->id_ctl + 516); /* NN: 1 namespace */
+    sg_put_unaligned_le64(dp->num_lbs, dp->id_ns);          /* NSZE */
+    sg_put_unaligned_le64(dp->num_lbs, dp->id_ns + 8);      /* NCAP */
+    dp->id_ns[128 + 2] = dp->lb_shift;          /* LBAF0: LBADS */
+    h = (h & 0x000000ffffffffffULL) | 0x0200000000000000ULL;
+    sg_put_unaligned_be64(h, dp->id_ns + 120);  /* EUI64 */
+}
+
+/* Parses the options after SG_BLKEMU_PREFIX. Returns 0 or negated errno. */
+static int
+blkemu_parse(struct blkemu_dev * dp, const char * opts, char * fname,
+             int fname_len, int64_t * sizep, int vb)
+{
+    int64_t ll;
+    char * cp;
+    char * np;
+    char * sp = NULL;
+    char * b = strdup(opts);
+
+    if (NULL == b)
+        return -ENOMEM;
+    *sizep = -1;
+    fname[0] = '\0';
+    for (cp = strtok_r(b, ",", &sp); cp; cp = strtok_r(NULL, ",", &sp)) {
+        np = strchr(cp, '=');
+        if (NULL == np)
+            goto bad;
+        *np++ = '\0';
+        if (0 == strcmp(cp, "file")) {
+            snprintf(fname, fname_len, "%s", np);
+            continue;
+        }
+        ll = sg_get_llnum(np);
+        if (ll < 0)
+            goto bad;
+        if (0 == strcmp(cp, "size"))
+            *sizep = ll;
+        else if (0 == strcmp(cp, "bs")) {
+            if ((512 != ll) && (1024 != ll) && (2048 != ll) && (4096 != ll))
+                goto bad;
+            for (dp->lb_shift = 9; (1LL << dp->lb_shift) < ll; )
+                ++dp->lb_shift;
+        } else if (0 == strcmp(cp, "lat"))
+            dp->lat_ns = (uint64_t)ll * 1000;
+        else if (0 == strcmp(cp, "qd"))
+            dp->qd = (int)ll;
+        else if (0 == strcmp(cp, "zone"))
+            dp->zone_lbs = ll;
+        else if (0 == strcmp(cp, "conv"))
+            dp->num_conv = (uint32_t)ll;
+        else if (0 == strcmp(cp, "oxl"))
+            dp->opt_xfer_len = (uint32_t)ll;
+        else
+            goto bad;
+    }
+    free(b);
+    return 0;
+bad:
+    if (vb)
+        pr2ws("%s: unable to decode option '%s' in '%s'\n", __func__, cp,
+              opts);
+    free(b);
+    return -EINVAL;
+}
+
+/* So that a file backed zoned device keeps its state, a zone's write
+ * pointer is placed after the last non zero block of its first allocated
+ * extent. */
+static uint64_t
+blkemu_find_wp(struct blkemu_dev * dp, uint32_t z)
+{
+    int lb_sz = 1 << dp->lb_shift;
+    off_t s = (off_t)(blkemu_zone_start(dp, z) << dp->lb_shift);
+    off_t e = (off_t)(blkemu_zone_end(dp, z) << dp->lb_shift);
+    off_t d = lseek(dp->fd, s, SEEK_DATA);
+    uint8_t b[4096];
+
+    if ((d < 0) || (d >= e))
+        return blkemu_zone_start(dp, z);
+    d = lseek(dp->fd, d, SEEK_HOLE);
+    if ((d < 0) || (d > e))
+        d = e;
+    d &= ~(off_t)(lb_sz - 1);
+    while (d > s) {     /* trim zero blocks at the end of the extent */
+        if (blkemu_pio(dp, false, b, lb_sz, d - lb_sz) ||
+            (! sg_all_zeros(b, lb_sz)))
+            break;
+        d -= lb_sz;
+    }
+    return (uint64_t)d >> dp->lb_shift;
+}
+
+bool
+sg_blkemu_is_name(const char * device_name)
+{
+    return device_name && (0 == strncmp(device_name, SG_BLKEMU_PREFIX,
+                                        sizeof(SG_BLKEMU_PREFIX) - 1));
+}
+
+bool
+sg_blkemu_is_fd(int fd)
+{
+    return (fd >= 0) && (fd < SG_BLKEMU_MAX_FD) && (NULL != blkemu_by_fd[fd]);
+}
+
+static void
+blkemu_free(struct blkemu_dev * dp)
+{
+    if (dp->fd >= 0)
+        close(dp->fd);
+    pthread_cond_destroy(&dp->qd_cv);
+    pthread_mutex_destroy(&dp->lock);
+    free(dp->wps);
+    free(dp);
+}
+
+int
+sg_blkemu_open(const char * device_name, int flags, int vb)
+{
+    int res;
+    uint32_t z;
+    int64_t size;
+    struct stat st;
+    struct blkemu_dev * dp;
+    char fname[256];
+
+    if (! sg_blkemu_is_name(device_name))
+        return -EINVAL;
+    if (0 == blkemu_page_sz) {
+        blkemu_page_sz = sysconf(_SC_PAGESIZE);
+        if (blkemu_page_sz < 4096)
+            blkemu_page_sz = 4096;
+    }
+    dp = (struct blkemu_dev *)calloc(1, sizeof(*dp));
+    if (NULL == dp)
+        return -ENOMEM;
+    dp->fd = -1;
+    dp->lb_shift = 9;
+    pthread_mutex_init(&dp->lock, NULL);
+    pthread_cond_init(&dp->qd_cv, NULL);
+    res = blkemu_parse(dp, device_name + sizeof(SG_BLKEMU_PREFIX) - 1,
+                       fname, sizeof(fname), &size, vb);
+    if (res)
+        goto err_out;
+    dp->read_only = (0 == (O_ACCMODE & flags));
+    if (fname[0]) {
+        dp->file_backed = true;
+        dp->fd = open(fname, (dp->read_only ? O_RDONLY : (O_RDWR | O_CREAT)) |
+                      O_CLOEXEC, 0644);
+        if (dp->fd < 0) {
+            res = -errno;
+            if (vb)
+                pr2ws("%s: open(%s): %s\n", __func__, fname,
+                      safe_strerror(errno));
+            goto err_out;
+        }
+        if (size < 0) {
+            if (fstat(dp->fd, &st) < 0) {
+                res = -errno;
+                goto err_out;
+            }
+            size = st.st_size ? st.st_size : BLKEMU_DEF_SIZE;
+        }
+    } else {
+        if (size < 0)
+            size = BLKEMU_DEF_SIZE;
+#ifdef HAVE_MEMFD_CREATE
+        dp->fd = memfd_create("sg_blkemu", MFD_CLOEXEC);
+#else
+        {
+            const char * tdir = getenv("TMPDIR");
+
+            snprintf(fname, sizeof(fname), "%s/sg_blkemu_XXXXXX",
+                     tdir ? tdir : "/tmp");
+            dp->fd = mkstemp(fname);
+            if (dp->fd >= 0)
+                unlink(fname);
+        }
+#endif
+        if (dp->fd < 0) {
+            res = -errno;
+            goto err_out;
+        }
+    }
+    dp->num_lbs = (uint64_t)size >> dp->lb_shift;
+    if (0 == dp->num_lbs) {
+        res = -EINVAL;
+        goto err_out;
+    }
+    if (! (dp->read_only && dp->file_backed)) {
+        if ((fstat(dp->fd, &st) < 0) ||
+            ((st.st_size < (off_t)(dp->num_lbs << dp->lb_shift)) &&
+             (ftruncate(dp->fd, (off_t)(dp->num_lbs << dp->lb_shift)) < 0))) {
+            res = -errno;
+            goto err_out;
+        }
+    }
+    if (dp->fd >= SG_BLKEMU_MAX_FD) {
+        res = -EMFILE;
+        goto err_out;
+    }
+    if (dp->zone_lbs > 0) {
+        dp->zoned = true;
+        dp->num_zones = (dp->num_lbs + dp->zone_lbs - 1) / dp->zone_lbs;
+        if (dp->num_conv > dp->num_zones)
+            dp->num_conv = dp->num_zones;
+        dp->wps = (uint64_t *)calloc(dp->num_zones, sizeof(uint64_t));
+        if (NULL == dp->wps) {
+            res = -ENOMEM;
+            goto err_out;
+        }
+        for (z = dp->num_conv; z < dp->num_zones; ++z)
+            dp->wps[z] = blkemu_find_wp(dp, z);
+    } else
+        dp->num_conv = 0;
+    sg_snt_init_dev_stat(&dp->dev_stat);
+    dp->dev_stat.pdt = dp->zoned ? PDT_ZBC : PDT_DISK;
+    dp->dev_stat.wce = true;
+    dp->dev_stat.vb = vb;
+    blkemu_mk_ids(dp, device_name);
+    pthread_mutex_lock(&blkemu_reg_lock);
+    blkemu_by_fd[dp->fd] = dp;
+    pthread_mutex_unlock(&blkemu_reg_lock);
+    if (vb > 1)
+        pr2ws("%s: %s: %" PRIu64 " blocks of %d bytes%s, fd=%d\n", __func__,
+              device_name, dp->num_lbs, 1 << dp->lb_shift,
+              (dp->zoned ? ", zoned" : ""), dp->fd);
+    return dp->fd;
+err_out:
+    blkemu_free(dp);
+    return res;
+}
+
+int
+sg_blkemu_close(int fd)
+{
+    struct blkemu_dev * dp;
+
+    if (! sg_blkemu_is_fd(fd))
+        return -EBADF;
+    pthread_mutex_lock(&blkemu_reg_lock);
+    dp = blkemu_by_fd[fd];
+    blkemu_by_fd[fd] = NULL;
+    pthread_mutex_unlock(&blkemu_reg_lock);
+    if (NULL == dp)
+        return -EBADF;
+    blkemu_free(dp);
+    return 0;
+}
+
+int
+sg_blkemu_do(int fd, struct sg_blkemu_io * iop, int vb)
+{
+    int res;
+    uint64_t start_ns = 0;
+    uint64_t now_ns;
+    struct blkemu_dev * dp;
+    struct timespec ts;
+    struct sg_snt_result_t sres;
+
+    if (! sg_blkemu_is_fd(fd))
+        return -EBADF;
+    dp = blkemu_by_fd[fd];
+    if ((NULL == iop) || (NULL == iop->cdbp))
+        return -EINVAL;
+    if (dp->lat_ns > 0)
+        start_ns = sg_pt_stats_now_ns();
+    if (dp->qd > 0) {
+        pthread_mutex_lock(&dp->lock);
+        while (dp->in_flight >= dp->qd)
+            pthread_cond_wait(&dp->qd_cv, &dp->lock);
+        ++dp->in_flight;
+        pthread_mutex_unlock(&dp->lock);
+    }
+    iop->status = SAM_STAT_GOOD;
+    iop->sb_len_wr = 0;
+    iop->din_resid = iop->din_len;
+    iop->dout_resid = iop->dout_len;
+    memset(&sres, 0, sizeof(sres));
+    res = blkemu_cmd(dp, iop, &sres, vb);
+    if (res > 0)
+        res = 0;
+    if ((res < 0) && sres.sstatus) {
+        blkemu_sense(dp, iop, &sres);
+        res = 0;
+    }
+    if (dp->lat_ns > 0) {
+        now_ns = sg_pt_stats_now_ns();
+        if (now_ns < (start_ns + dp->lat_ns)) {
+            ts.tv_sec = (start_ns + dp->lat_ns - now_ns) / 1000000000;
+            ts.tv_nsec = (start_ns + dp->lat_ns - now_ns) % 1000000000;
+            while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+                ;
+        }
+    }
+    if (dp->qd > 0) {
+        pthread_mutex_lock(&dp->lock);
+        --dp->in_flight;
+        pthread_cond_signal(&dp->qd_cv);
+        pthread_mutex_unlock(&dp->lock);
+    }
+    return res;
+}
+
+int
+sg_blkemu_sg_io(int fd, struct sg_io_hdr * hp, int vb)
+{
+    bool is_din;
+    int res;
+    uint64_t t0;
+    uint8_t * free_bp = NULL;
+    struct sg_blkemu_io bio;
+
+    if ((NULL == hp) || ('S' != hp->interface_id) || (hp->iovec_count > 0) ||
+        (SG_FLAG_MMAP_IO & hp->flags))
+        return -EINVAL;
+    memset(&bio, 0, sizeof(bio));
+    bio.cdbp = hp->cmdp;
+    bio.cdb_len = hp->cmd_len;
+    bio.sbp = hp->sbp;
+    bio.mx_sb_len = hp->mx_sb_len;
+    is_din = ((SG_DXFER_FROM_DEV == hp->dxfer_direction) ||
+              (SG_DXFER_TO_FROM_DEV == hp->dxfer_direction));
+    if (is_din) {
+        bio.dinp = (uint8_t *)hp->dxferp;
+        if ((SG_FLAG_NO_DXFER & hp->flags) || (NULL == bio.dinp)) {
+            /* data is still read but not passed back */
+            free_bp = (uint8_t *)malloc(hp->dxfer_len ? hp->dxfer_len : 1);
+            if (NULL == free_bp)
+                return -ENOMEM;
+            bio.dinp = free_bp;
+        }
+        bio.din_len = hp->dxfer_len;
+    } else if (SG_DXFER_TO_DEV == hp->dxfer_direction) {
+        bio.doutp = (const uint8_t *)hp->dxferp;
+        bio.dout_len = hp->dxfer_len;
+    }
+    t0 = sg_pt_stats_now_ns();
+    res = sg_blkemu_do(fd, &bio, vb);
+    free(free_bp);
+    if (res)
+        return res;
+    hp->status = bio.status;
+    hp->masked_status = (bio.status >> 1) & 0x7f;
+    hp->msg_status = 0;
+    hp->sb_len_wr = bio.sb_len_wr;
+    hp->host_status = 0;
+    hp->driver_status = (bio.sb_len_wr > 0) ? DRIVER_SENSE : 0;
+    hp->resid = is_din ? bio.din_resid : bio.dout_resid;
+    hp->duration = (sg_pt_stats_now_ns() - t0) / 1000000;
+    hp->info = (bio.status || bio.sb_len_wr) ? SG_INFO_CHECK : SG_INFO_OK;
+    return 0;
+}
@@ -42,7 +42,7 @@
 #endif
 
 
-static const char * const version_str = "2.02 20230311";
+static const char * const version_str = "2.03 20261016";
 
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
@@ -71,11 +71,16 @@ sg_cmds_version()
 }
 
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
-   negated errno. */
+   negated errno. The file descriptor is added to the pass-through object
+   pool used by the sg_ll_* functions (see scsi_pt_pool_get()). */
 int
 sg_cmds_open_device(const char * device_name, bool read_only, int verbose)
 {
-    return scsi_pt_open_device(device_name, read_only, verbose);
+    int fd = scsi_pt_open_device(device_name, read_only, verbose);
+
+    if (fd >= 0)
+        scsi_pt_pool_enable(fd, verbose);
+    return fd;
 }
 
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
@@ -83,7 +88,11 @@ sg_cmds_open_device(const char * device_name, bool read_only, int verbose)
 int
 sg_cmds_open_flags(const char * device_name, int flags, int verbose)
 {
-    return scsi_pt_open_flags(device_name, flags, verbose);
+    int fd = scsi_pt_open_flags(device_name, flags, verbose);
+
+    if (fd >= 0)
+        scsi_pt_pool_enable(fd, verbose);
+    return fd;
 }
 
 /* Returns 0 if successful. If error in Unix returns negated errno. */
@@ -368,9 +377,9 @@ sg_cmds_is_nvme(const struct sg_pt_base * ptvp)
 }
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = scsi_pt_pool_get(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -433,7 +442,7 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = scsi_pt_pool_get(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, inq_cdb, sizeof(inq_cdb));
@@ -487,7 +496,7 @@ fini:
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -659,7 +668,7 @@ sg_ll_test_unit_ready_com(struct sg_pt_base * ptvp, int sg_fd, int pack_id,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = scsi_pt_pool_get(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, tur_cdb, sizeof(tur_cdb));
@@ -698,7 +707,7 @@ sg_ll_test_unit_ready_com(struct sg_pt_base * ptvp, int sg_fd, int pack_id,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -777,7 +786,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = scsi_pt_pool_get(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rs_cdb, sizeof(rs_cdb));
@@ -816,7 +825,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
         if (local_cdb)  /* stop caller accessing local sense */
         set_scsi_pt_cdb(ptvp, NULL, 0);
     } else if (ptvp)
-        destruct_scsi_pt_obj(ptvp);
+        scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -872,7 +881,7 @@ sg_ll_report_luns_com(struct sg_pt_base * ptvp, int sg_fd, int select_report,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        if (NULL == ((ptvp = create_pt_obj(report_luns_s))))
+        if (NULL == ((ptvp = create_pt_obj(sg_fd, report_luns_s))))
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rl_cdb, sizeof(rl_cdb));
         set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -905,7 +914,7 @@ sg_ll_report_luns_com(struct sg_pt_base * ptvp, int sg_fd, int select_report,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -74,9 +74,9 @@
 
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = scsi_pt_pool_get(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -115,7 +115,7 @@ sg_ll_sync_cache_10(int sg_fd, bool sync_nv, bool immed, int group,
               sg_get_command_str(sc_cdb, SYNCHRONIZE_CACHE_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, sc_cdb, sizeof(sc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -139,7 +139,7 @@ sg_ll_sync_cache_10(int sg_fd, bool sync_nv, bool immed, int group,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -170,7 +170,7 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
               sg_get_command_str(rc_cdb, SERVICE_ACTION_IN_16_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -195,7 +195,7 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -223,7 +223,7 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
               sg_get_command_str(rc_cdb, READ_CAPACITY_10_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -248,7 +248,7 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -280,7 +280,7 @@ sg_ll_mode_sense6(int sg_fd, bool dbd, int pc, int pg_code, int sub_pg_code,
               sg_get_command_str(modes_cdb, MODE_SENSE6_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -317,7 +317,7 @@ sg_ll_mode_sense6(int sg_fd, bool dbd, int pc, int pg_code, int sub_pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -381,7 +381,7 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -420,7 +420,7 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -471,7 +471,7 @@ sg_ll_mode_select6_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -496,7 +496,7 @@ sg_ll_mode_select6_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -542,7 +542,7 @@ sg_ll_mode_select10_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -567,7 +567,7 @@ sg_ll_mode_select10_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -853,7 +853,7 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, logs_cdb, sizeof(logs_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -886,7 +886,7 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -938,7 +938,7 @@ sg_ll_log_select(int sg_fd, bool pcr, bool sp, int pc, int pg_code,
         hex2stderr(paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, logs_cdb, sizeof(logs_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -963,7 +963,7 @@ sg_ll_log_select(int sg_fd, bool pcr, bool sp, int pc, int pg_code,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1017,7 +1017,7 @@ sg_ll_start_stop_unit_com(struct sg_pt_base * ptvp, int sg_fd, bool immed,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = scsi_pt_pool_get(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, ssuBlk, sizeof(ssuBlk));
@@ -1049,7 +1049,7 @@ sg_ll_start_stop_unit_com(struct sg_pt_base * ptvp, int sg_fd, bool immed,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -1102,7 +1102,7 @@ sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose)
                                  sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, p_cdb, sizeof(p_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1125,6 +1125,6 @@ sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose)
         }
     } else
             ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
@@ -107,9 +107,9 @@
 
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = scsi_pt_pool_get(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -143,7 +143,7 @@ sg_ll_get_lba_status16(int sg_fd, uint64_t start_llba, uint8_t rt,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, getLbaStatCmd, sizeof(getLbaStatCmd));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -179,7 +179,7 @@ sg_ll_get_lba_status16(int sg_fd, uint64_t start_llba, uint8_t rt,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -222,7 +222,7 @@ sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
                                  b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, gls32_cmd, sizeof(gls32_cmd));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -258,7 +258,7 @@ sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -295,7 +295,7 @@ sg_ll_report_tgt_prt_grp2(int sg_fd, void * resp, int mx_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rtpg_cdb, sizeof(rtpg_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -331,7 +331,7 @@ sg_ll_report_tgt_prt_grp2(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -362,7 +362,7 @@ sg_ll_set_tgt_prt_grp(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, stpg_cdb, sizeof(stpg_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -386,7 +386,7 @@ sg_ll_set_tgt_prt_grp(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -417,7 +417,7 @@ sg_ll_report_referrals(int sg_fd, uint64_t start_llba, bool one_seg,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, repRef_cdb, sizeof(repRef_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -453,7 +453,7 @@ sg_ll_report_referrals(int sg_fd, uint64_t start_llba, bool one_seg,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -518,7 +518,7 @@ sg_ll_send_diag_com(struct sg_pt_base * ptvp, int sg_fd, int st_code,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+        ptvp = scsi_pt_pool_get(sg_fd, vb);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, senddiag_cdb, sizeof(senddiag_cdb));
@@ -552,7 +552,7 @@ sg_ll_send_diag_com(struct sg_pt_base * ptvp, int sg_fd, int st_code,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -622,7 +622,7 @@ sg_ll_receive_diag_com(struct sg_pt_base * ptvp, int sg_fd, bool pcv,
         else
             set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     } else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+        ptvp = scsi_pt_pool_get(sg_fd, vb);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
         set_scsi_pt_cdb(ptvp, rcvdiag_cdb, sizeof(rcvdiag_cdb));
@@ -671,7 +671,7 @@ sg_ll_receive_diag_com(struct sg_pt_base * ptvp, int sg_fd, bool pcv,
             set_scsi_pt_cdb(ptvp, NULL, 0);
     } else {
         if (ptvp)
-            destruct_scsi_pt_obj(ptvp);
+            scsi_pt_pool_put(ptvp);
     }
     return ret;
 }
@@ -736,7 +736,7 @@ sg_ll_read_defect10(int sg_fd, bool req_plist, bool req_glist, int dl_format,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rdef_cdb, sizeof(rdef_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -772,7 +772,7 @@ sg_ll_read_defect10(int sg_fd, bool req_plist, bool req_glist, int dl_format,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -799,7 +799,7 @@ sg_ll_read_media_serial_num(int sg_fd, void * resp, int mx_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rmsn_cdb, sizeof(rmsn_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -835,7 +835,7 @@ sg_ll_read_media_serial_num(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -865,7 +865,7 @@ sg_ll_report_id_info(int sg_fd, int itype, void * resp, int max_resp_len,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, rii_cdb, sizeof(rii_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -901,7 +901,7 @@ sg_ll_report_id_info(int sg_fd, int itype, void * resp, int max_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -934,7 +934,7 @@ sg_ll_set_id_info(int sg_fd, int itype, void * paramp, int param_len,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, sii_cdb, sizeof(sii_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -959,7 +959,7 @@ sg_ll_set_id_info(int sg_fd, int itype, void * paramp, int param_len,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1030,7 +1030,7 @@ sg_ll_format_unit_v2(int sg_fd, int fmtpinfo, bool longlist, bool fmtdata,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, fu_cdb, sizeof(fu_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1055,7 +1055,7 @@ sg_ll_format_unit_v2(int sg_fd, int fmtpinfo, bool longlist, bool fmtdata,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1088,7 +1088,7 @@ sg_ll_reassign_blocks(int sg_fd, bool longlba, bool longlist, void * paramp,
         hex2stderr((const uint8_t *)paramp, param_len, -1);
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, reass_cdb, sizeof(reass_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1113,7 +1113,7 @@ sg_ll_reassign_blocks(int sg_fd, bool longlba, bool longlist, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1143,7 +1143,7 @@ sg_ll_persistent_reserve_in(int sg_fd, int rq_servact, void * resp,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, prin_cdb, sizeof(prin_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1179,7 +1179,7 @@ sg_ll_persistent_reserve_in(int sg_fd, int rq_servact, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1215,7 +1215,7 @@ sg_ll_persistent_reserve_out(int sg_fd, int rq_servact, int rq_scope,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, prout_cdb, sizeof(prout_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1240,7 +1240,7 @@ sg_ll_persistent_reserve_out(int sg_fd, int rq_servact, int rq_scope,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1294,7 +1294,7 @@ sg_ll_read_long10(int sg_fd, bool pblock, bool correct, unsigned int lba,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, readLong_cdb, sizeof(readLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1351,7 +1351,7 @@ sg_ll_read_long10(int sg_fd, bool pblock, bool correct, unsigned int lba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1387,7 +1387,7 @@ sg_ll_read_long16(int sg_fd, bool pblock, bool correct, uint64_t llba,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, readLong_cdb, sizeof(readLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1444,7 +1444,7 @@ sg_ll_read_long16(int sg_fd, bool pblock, bool correct, uint64_t llba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1481,7 +1481,7 @@ sg_ll_write_long10(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, writeLong_cdb, sizeof(writeLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1526,7 +1526,7 @@ sg_ll_write_long10(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1564,7 +1564,7 @@ sg_ll_write_long16(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, writeLong_cdb, sizeof(writeLong_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1610,7 +1610,7 @@ sg_ll_write_long16(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1651,7 +1651,7 @@ sg_ll_verify10(int sg_fd, int vrprotect, bool dpo, int bytchk,
             hex2stderr((const uint8_t *)data_out, k, vb < 5);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, v_cdb, sizeof(v_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1692,7 +1692,7 @@ sg_ll_verify10(int sg_fd, int vrprotect, bool dpo, int bytchk,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1733,7 +1733,7 @@ sg_ll_verify16(int sg_fd, int vrprotect, bool dpo, int bytchk, uint64_t llba,
             hex2stderr((const uint8_t *)data_out, k, vb < 5);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return sg_convert_errno(ENOMEM);
     set_scsi_pt_cdb(ptvp, v_cdb, sizeof(v_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -1774,7 +1774,7 @@ sg_ll_verify16(int sg_fd, int vrprotect, bool dpo, int bytchk, uint64_t llba,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -1867,7 +1867,7 @@ sg_ll_ata_pt(int sg_fd, const uint8_t * cdbp, int cdb_len,
             hex2stderr(apt_cdb, cdb_len, -1);
         }
     }
-    if (NULL == ((ptvp = create_pt_obj(cnamep))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cnamep))))
         return -1;
     set_scsi_pt_cdb(ptvp, apt_cdb, cdb_len);
     set_scsi_pt_sense(ptvp, sp, slen);
@@ -1975,7 +1975,7 @@ sg_ll_ata_pt(int sg_fd, const uint8_t * cdbp, int cdb_len,
     }
 
 out:
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2004,7 +2004,7 @@ sg_ll_read_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rbuf_cdb, sizeof(rbuf_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2040,7 +2040,7 @@ sg_ll_read_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2080,7 +2080,7 @@ sg_ll_write_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, wbuf_cdb, sizeof(wbuf_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2105,7 +2105,7 @@ sg_ll_write_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2157,7 +2157,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    ptvp = construct_scsi_pt_obj();
+    ptvp = scsi_pt_pool_get(sg_fd, vb);
     if (NULL == ptvp) {
         pr2ws("%s: out of memory\n", __func__);
         return -1;
@@ -2185,7 +2185,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2229,7 +2229,7 @@ sg_ll_unmap_v2(int sg_fd, bool anchor, int group_num, int timeout_secs,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, u_cdb, sizeof(u_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2253,7 +2253,7 @@ sg_ll_unmap_v2(int sg_fd, bool anchor, int group_num, int timeout_secs,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2282,7 +2282,7 @@ sg_ll_read_block_limits_v2(int sg_fd, bool mloi, void * resp,
                                  false, sizeof(b), b));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, rl_cdb, sizeof(rl_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2323,7 +2323,7 @@ sg_ll_read_block_limits_v2(int sg_fd, bool mloi, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2365,7 +2365,7 @@ sg_ll_receive_copy_results(int sg_fd, int sa, int list_id, void * resp,
                                  false, sizeof(d), d));
     }
 
-    if (NULL == ((ptvp = create_pt_obj(b))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, b))))
         return -1;
     set_scsi_pt_cdb(ptvp, rcvcopyres_cdb, sizeof(rcvcopyres_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2389,7 +2389,7 @@ sg_ll_receive_copy_results(int sg_fd, int sa, int list_id, void * resp,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2427,7 +2427,7 @@ sg_ll_extended_copy(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, xcopy_cdb, sizeof(xcopy_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2451,7 +2451,7 @@ sg_ll_extended_copy(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2507,7 +2507,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cname))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cname))))
         return -1;
     set_scsi_pt_cdb(ptvp, xcopy_cdb, sizeof(xcopy_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2531,7 +2531,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -2605,7 +2605,7 @@ sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
         pr2ws("    %s cdb: %s\n", cdb_s,
               sg_get_command_str(preFetchCdb, cdb_len, false, sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, preFetchCdb, cdb_len);
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -2639,6 +2639,6 @@ sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
     } else
         ret = 0;
 fini:
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
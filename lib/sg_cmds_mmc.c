@@ -42,9 +42,9 @@
 
 
 static struct sg_pt_base *
-create_pt_obj(const char * cname)
+create_pt_obj(int sg_fd, const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = scsi_pt_pool_get(sg_fd, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -78,7 +78,7 @@ sg_ll_set_cd_speed(int sg_fd, int rot_control, int drv_read_speed,
             pr2ws("%02x ", scsCmdBlk[k]);
         pr2ws("\n");
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, scsCmdBlk, sizeof(scsCmdBlk));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -109,7 +109,7 @@ sg_ll_set_cd_speed(int sg_fd, int rot_control, int drv_read_speed,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -153,7 +153,7 @@ sg_ll_get_config(int sg_fd, int rt, int starting, void * resp,
         pr2ws("\n");
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, gcCmdBlk, sizeof(gcCmdBlk));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -203,7 +203,7 @@ sg_ll_get_config(int sg_fd, int rt, int starting, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -249,7 +249,7 @@ sg_ll_get_performance(int sg_fd, int data_type, unsigned int starting_lba,
         pr2ws("\n");
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, gpCmdBlk, sizeof(gpCmdBlk));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -299,7 +299,7 @@ sg_ll_get_performance(int sg_fd, int data_type, unsigned int starting_lba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
 
@@ -334,7 +334,7 @@ sg_ll_set_streaming(int sg_fd, int type, void * paramp, int param_len,
         }
     }
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if (NULL == ((ptvp = create_pt_obj(sg_fd, cdb_s))))
         return -1;
     set_scsi_pt_cdb(ptvp, ssCmdBlk, sizeof(ssCmdBlk));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -365,6 +365,6 @@ sg_ll_set_streaming(int sg_fd, int type, void * paramp, int param_len,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    scsi_pt_pool_put(ptvp);
     return ret;
 }
@@ -86,6 +86,9 @@ sgj_parse_opts(sgj_state * jsp, const char * j_optarg)
         case '8':
             jsp->pr_indent_size = 8;
             break;
+        case 'B':
+            jsp->pr_format = prev_negate ? '\0' : 'B';
+            break;
         case 'e':
             jsp->pr_exit_status = ! prev_negate;
             break;
@@ -156,6 +159,8 @@ sg_json_usage(int char_if_not_j, char * b, int blen)
     n += sg_scn3pr(b, blen, n,
                    "      4    tab pretty output to 4 spaces (def)\n");
     n += sg_scn3pr(b, blen, n, "      8    tab pretty output to 8 spaces\n");
+    n += sg_scn3pr(b, blen, n, "      B    binary output: CBOR (RFC 8949) "
+                   "rather than JSON text\n");
     if (n >= (blen - 1))
         goto fini;
     n += sg_scn3pr(b, blen, n, "      e    show 'exit_status' field\n");
@@ -194,7 +199,8 @@ fini:
 static char *
 sg_json_settings(sgj_state * jsp, char * b, int blen)
 {
-    snprintf(b, blen, "%d%se%sh%sk%sl%sn%so%sp%ss%sv", jsp->pr_indent_size,
+    snprintf(b, blen, "%d%sB%se%sh%sk%sl%sn%so%sp%ss%sv",
+             jsp->pr_indent_size, ('B' == jsp->pr_format) ? "" : "-",
              jsp->pr_exit_status ? "" : "-", jsp->pr_hex ? "" : "-",
              jsp->pr_packed ? "" : "-", jsp->pr_leadin ? "" : "-",
              jsp->pr_name_ex ? "" : "-", jsp->pr_out_hr ? "" : "-",
@@ -232,6 +238,9 @@ sgj_init_state(sgj_state * jsp, const char * j_optarg)
     jsp->basep = NULL;
     jsp->out_hrp = NULL;
     jsp->userp = NULL;
+    jsp->strmp = NULL;
+    jsp->arenap = NULL;
+    jsp->no_arena = false;
 
     cp = getenv(sgj_opts_ev);
     if (cp) {
@@ -244,6 +253,14 @@ sgj_init_state(sgj_state * jsp, const char * j_optarg)
     return j_optarg ? sgj_parse_opts(jsp, j_optarg) : true;
 }
 
+/* New JSON values come from jsp->arenap (if any) but not while streaming
+ * because streamed values are freed as they are written out. */
+static json_arena *
+sgj_arena(const sgj_state * jsp)
+{
+    return (jsp && (NULL == jsp->strmp)) ? (json_arena *)jsp->arenap : NULL;
+}
+
 sgj_opaque_p
 sgj_start_r(const char * util_name, const char * ver_str, int argc,
             char *argv[], sgj_state * jsp)
@@ -252,43 +269,46 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
     json_value * jvp;
     json_value * jv2p = NULL;
     json_value * jap = NULL;
-
+    json_arena * ap;
 
     if (NULL == jsp)
         return NULL;
-    jvp = json_object_new(0);
+    if ((NULL == jsp->arenap) && (! jsp->no_arena))
+        jsp->arenap = json_arena_new(0);        /* NULL: use the heap */
+    ap = (json_arena *)jsp->arenap;
+    jvp = json_object_new_in(ap, 0);
     if (NULL == jvp)
         return NULL;
 
     jsp->basep = jvp;
     if (jsp->pr_leadin) {
-        jap = json_array_new(0);
+        jap = json_array_new_in(ap, 0);
         if  (NULL == jap) {
             json_builder_free((json_value *)jvp);
             return NULL;
         }
         /* assume rest of json_*_new() calls succeed */
-        json_array_push((json_value *)jap, json_integer_new(1));
-        json_array_push((json_value *)jap, json_integer_new(0));
+        json_array_push((json_value *)jap, json_integer_new_in(ap, 1));
+        json_array_push((json_value *)jap, json_integer_new_in(ap, 0));
         json_object_push((json_value *)jvp, "json_format_version",
                          (json_value *)jap);
         if (util_name) {
-            jap = json_array_new(0);
+            jap = json_array_new_in(ap, 0);
             if (argv) {
                 for (k = 0; k < argc; ++k)
                     json_array_push((json_value *)jap,
-                                    json_string_new(argv[k]));
+                                    json_string_new_in(ap, argv[k]));
             }
             jv2p = json_object_push((json_value *)jvp, "utility_invoked",
-                                    json_object_new(0));
+                                    json_object_new_in(ap, 0));
             json_object_push((json_value *)jv2p, "name",
-                             json_string_new(util_name));
+                             json_string_new_in(ap, util_name));
             if (ver_str)
                 json_object_push((json_value *)jv2p, "version_date",
-                                 json_string_new(ver_str));
+                                 json_string_new_in(ap, ver_str));
             else
                 json_object_push((json_value *)jv2p, "version_date",
-                                 json_string_new("0.0"));
+                                 json_string_new_in(ap, "0.0"));
             json_object_push((json_value *)jv2p, "argv", jap);
         }
         if (jsp->verbose) {
@@ -296,22 +316,22 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
             char b[32];
 
             json_object_push((json_value *)jv2p, "environment_variable_name",
-                             json_string_new(sgj_opts_ev));
+                             json_string_new_in(ap, sgj_opts_ev));
             json_object_push((json_value *)jv2p, "environment_variable_value",
-                             json_string_new(cp ? cp : "no available"));
+                             json_string_new_in(ap, cp ? cp : "no available"));
             sg_json_settings(jsp, b, sizeof(b));
             json_object_push((json_value *)jv2p, "json_options",
-                             json_string_new(b));
+                             json_string_new_in(ap, b));
         }
     } else {
         if (jsp->pr_out_hr && util_name)
             jv2p = json_object_push((json_value *)jvp, "utility_invoked",
-                                    json_object_new(0));
+                                    json_object_new_in(ap, 0));
     }
     if (jsp->pr_out_hr && jv2p) {
         jsp->out_hrp = json_object_push((json_value *)jv2p,
                                          "plain_text_output",
-                                        json_array_new(0));
+                                        json_array_new_in(ap, 0));
         if (jsp->pr_leadin && (jsp->verbose > 3)) {
             char * bp = (char *)calloc(4096, 1);
 
@@ -325,6 +345,84 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
     return jvp;
 }
 
+static void
+sgj_get_out_settings(const sgj_state * jsp, json_serialize_opts * osp)
+{
+    memcpy(osp, &def_out_settings, sizeof(*osp));
+    if (jsp->pr_indent_size != def_out_settings.indent_size)
+        osp->indent_size = jsp->pr_indent_size;
+    if (! jsp->pr_pretty)
+        osp->mode = jsp->pr_packed ? json_serialize_mode_packed :
+                                     json_serialize_mode_single_line;
+}
+
+bool
+sgj_stream_start(sgj_state * jsp, FILE * fp)
+{
+    json_serialize_opts out_settings;
+
+    if ((NULL == jsp) || (! jsp->pr_as_json) || (NULL == jsp->basep) ||
+        (NULL == fp) || jsp->strmp)
+        return false;
+    if (jsp->pr_out_hr)   /* 'plain_text_output' grows until the end */
+        return false;
+    if ('B' == jsp->pr_format)  /* CBOR map and array heads hold counts */
+        return false;
+    sgj_get_out_settings(jsp, &out_settings);
+    jsp->strmp = json_stream_new((json_value *)jsp->basep, out_settings, fp);
+    return !! jsp->strmp;
+}
+
+FILE *
+sgj_stream_start_file(sgj_state * jsp, const char * js_file)
+{
+    FILE * fp = stdout;
+
+    if ((NULL == jsp) || (! jsp->pr_as_json))
+        return NULL;
+    if (js_file && ((1 != strlen(js_file)) || ('-' != js_file[0]))) {
+        fp = fopen(js_file, "w");       /* truncate if exists */
+        if (NULL == fp)
+            return NULL;
+    }
+    if (sgj_stream_start(jsp, fp))
+        return fp;
+    if (stdout != fp)
+        fclose(fp);
+    return NULL;
+}
+
+void
+sgj_stream_flush(sgj_state * jsp, sgj_opaque_p jap)
+{
+    if (jsp && jsp->strmp && jap) {
+        if (json_stream_flush((json_stream *)jsp->strmp, (json_value *)jap) &&
+            (jsp->verbose > 3))
+            pr2serr("%s: failed\n", __func__);
+    }
+}
+
+/* Binary (CBOR) output of the tree at jvp. Unlike JSON text no line feed
+ * follows and debug messages go to stderr. */
+static void
+sgj_js2file_cbor(sgj_state * jsp, json_value * jvp, FILE * fp)
+{
+    size_t len = json_cbor_measure(jvp);
+    uint8_t * b = (uint8_t *)malloc(len);
+
+    if (jsp->verbose > 3)
+        pr2serr("%s: CBOR length: %zu bytes\n", __func__, len);
+    if (NULL == b) {
+        if (jsp->verbose > 3)
+            pr2serr("%s: unable to get %zu bytes on heap\n", __func__, len);
+        return;
+    }
+    json_cbor_serialize(b, jvp);
+    if ((len != fwrite(b, 1, len, fp)) && (jsp->verbose > 3))
+        pr2serr("%s: write failed\n", __func__);
+    free(b);
+}
+
 void
 sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                  const char * estr, FILE * fp)
@@ -334,6 +432,7 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
     char * b;
     json_value * jvp = (json_value *)(jop ? jop : jsp->basep);
     json_serialize_opts out_settings;
+    json_stream * strmp;
 
     if (NULL == jvp) {
         fprintf(fp, "%s: json NULL pointers ??\n", __func__);
@@ -353,12 +452,21 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
         }
         sgj_js_nv_istr(jsp, jop, "exit_status", exit_status, NULL, ccp);
     }
-    memcpy(&out_settings, &def_out_settings, sizeof(out_settings));
-    if (jsp->pr_indent_size != def_out_settings.indent_size)
-        out_settings.indent_size = jsp->pr_indent_size;
-    if (! jsp->pr_pretty)
-        out_settings.mode = jsp->pr_packed ? json_serialize_mode_packed :
-                                json_serialize_mode_single_line;
+    if ((NULL == jop) && jsp->strmp) {
+        /* streaming: the rest goes to the FILE given to sgj_stream_start */
+        strmp = (json_stream *)jsp->strmp;
+        jsp->strmp = NULL;
+        fp = json_stream_fp(strmp);
+        if (json_stream_finish(strmp) && (jsp->verbose > 3))
+            pr2serr("%s: stream output failed\n", __func__);
+        fprintf(fp, "\n");
+        return;
+    }
+    if ('B' == jsp->pr_format) {
+        sgj_js2file_cbor(jsp, jvp, fp);
+        return;
+    }
+    sgj_get_out_settings(jsp, &out_settings);
 
     len = json_measure_ex(jvp, out_settings);
     if (len < 1)
@@ -381,12 +489,24 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
 void
 sgj_finish(sgj_state * jsp)
 {
+    if (jsp && jsp->strmp) {
+        json_stream_free((json_stream *)jsp->strmp);
+        jsp->strmp = NULL;
+    }
     if (jsp && jsp->basep) {
-        json_builder_free((json_value *)jsp->basep);
+        json_arena * ap = (json_arena *)jsp->arenap;
+
+        /* a tree wholly in the arena goes when the arena does */
+        if ((NULL == ap) || json_arena_mixed(ap))
+            json_builder_free((json_value *)jsp->basep);
         jsp->basep = NULL;
         jsp->out_hrp = NULL;
         jsp->userp = NULL;
     }
+    if (jsp && jsp->arenap) {
+        json_arena_free((json_arena *)jsp->arenap);
+        jsp->arenap = NULL;
+    }
 }
 
 void
@@ -453,7 +573,7 @@ sgj_pr_hr(sgj_state * jsp, const char * fmt, ...)
             }
         }
         json_array_push((json_value *)jsp->out_hrp,
-                        json_string_new(step ? b + 1 : b));
+                        json_string_new_in(sgj_arena(jsp), step ? b + 1 : b));
         va_end(args);
     } else {    /* do nothing, just consume arguments */
         va_start(args, fmt);
@@ -469,7 +589,8 @@ sgj_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name)
 
     if (jsp && jsp->pr_as_json && sn_name)
         resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                 sn_name, json_object_new(0));
+                                sn_name,
+                                json_object_new_in(sgj_arena(jsp), 0));
     return resp;
 }
 
@@ -477,16 +598,23 @@ sgj_opaque_p
 sgj_snake_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop,
                             const char * conv2sname)
 {
+    sgj_opaque_p resp = NULL;
+
     if (jsp && jsp->pr_as_json && conv2sname) {
         int olen = strlen(conv2sname);
         char * sname = (char *)malloc(olen + 8);
-        int nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        int nlen;
 
-        if (nlen > 0)
-            return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_object_new(0));
+        if (NULL == sname)
+            return NULL;
+        nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        if (nlen > 0)   /* name is copied (or interned) by the push */
+            resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
+                                    sname,
+                                    json_object_new_in(sgj_arena(jsp), 0));
+        free(sname);
     }
-    return NULL;
+    return resp;
 }
 
 /* jop will 'own' returned value (if non-NULL) */
@@ -497,7 +625,7 @@ sgj_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name)
 
     if (jsp && jsp->pr_as_json && sn_name)
         resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                sn_name, json_array_new(0));
+                                sn_name, json_array_new_in(sgj_arena(jsp), 0));
     return resp;
 }
 
@@ -505,37 +633,47 @@ sgj_opaque_p
 sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
                            const char * conv2sname)
 {
+    sgj_opaque_p resp = NULL;
+
     if (jsp && jsp->pr_as_json && conv2sname) {
         int olen = strlen(conv2sname);
         char * sname = (char *)malloc(olen + 8);
-        int nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        int nlen;
 
-        if (nlen > 0)
-            return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_array_new(0));
+        if (NULL == sname)
+            return NULL;
+        nlen = sgj_name_to_snake(conv2sname, sname, olen + 8);
+        if (nlen > 0)   /* name is copied (or interned) by the push */
+            resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
+                                    sname,
+                                    json_array_new_in(sgj_arena(jsp), 0));
+        free(sname);
     }
-    return NULL;
+    return resp;
 }
 
 /* Newly created object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_object_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_object_new(0) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_object_new_in(sgj_arena(jsp), 0) : NULL;
 }
 
 /* Newly created array is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_array_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_array_new(0) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_array_new_in(sgj_arena(jsp), 0) : NULL;
 }
 
 /* Newly created string is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_string_r(sgj_state * jsp, const char * value)
 {
-    return (jsp && jsp->pr_as_json) ? json_string_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_string_new_in(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created string with length object is un-attached to jsp->basep
@@ -543,29 +681,31 @@ sgj_new_unattached_string_r(sgj_state * jsp, const char * value)
 sgj_opaque_p
 sgj_new_unattached_str_len_r(sgj_state * jsp, const char * value, int vlen)
 {
-    return (jsp && jsp->pr_as_json) ? json_string_new_length(vlen, value) :
-                                      NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_string_new_length_in(sgj_arena(jsp), vlen, value) : NULL;
 }
 
 /* Newly created integer object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_integer_r(sgj_state * jsp, uint64_t value)
 {
-    return (jsp && jsp->pr_as_json) ? json_integer_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_integer_new_in(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created boolean object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_bool_r(sgj_state * jsp, bool value)
 {
-    return (jsp && jsp->pr_as_json) ? json_boolean_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+                json_boolean_new_in(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created null object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_null_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_null_new() : NULL;
+    return (jsp && jsp->pr_as_json) ? json_null_new_in(sgj_arena(jsp)) : NULL;
 }
 
 sgj_opaque_p
@@ -575,10 +715,12 @@ sgj_js_nv_s(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json && value) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_string_new(value));
+                                    sn_name,
+                                    json_string_new_in(sgj_arena(jsp),
+                                                       value));
         else
             return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_string_new(value));
+                                   json_string_new_in(sgj_arena(jsp), value));
     } else
         return NULL;
 }
@@ -596,10 +738,13 @@ sgj_js_nv_s_len(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
         }
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_string_new_length(k, value));
+                                    sn_name,
+                                    json_string_new_length_in(sgj_arena(jsp),
+                                                              k, value));
         else
             return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_string_new_length(k, value));
+                                   json_string_new_length_in(sgj_arena(jsp),
+                                                             k, value));
     } else
         return NULL;
 }
@@ -651,10 +796,12 @@ sgj_js_nv_i(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_integer_new(value));
+                                    sn_name,
+                                    json_integer_new_in(sgj_arena(jsp),
+                                                        value));
         else
             return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_integer_new(value));
+                                   json_integer_new_in(sgj_arena(jsp), value));
     }
     else
         return NULL;
@@ -667,10 +814,12 @@ sgj_js_nv_b(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_boolean_new(value));
+                                    sn_name,
+                                    json_boolean_new_in(sgj_arena(jsp),
+                                                        value));
         else
             return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_boolean_new(value));
+                                   json_boolean_new_in(sgj_arena(jsp), value));
     } else
         return NULL;
 }
@@ -799,7 +948,7 @@ sgj_js_nv_s_nex(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if ((NULL == val_s) && (! as_nex))
         /* corner case: assume jop is an array */
         json_array_push((json_value *)(jop ? jop : jsp->basep),
-                         json_string_new(sn_name));
+                         json_string_new_in(sgj_arena(jsp), sn_name));
     else if (NULL == val_s)
         sgj_js_nv_s(jsp, jop, sn_name, nex_s);
     else if (! as_nex)
@@ -1152,13 +1301,13 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
             if (as_json && jsp->pr_out_hr) {
                 eaten = true;
                 json_array_push((json_value *)jsp->out_hrp,
-                                jvp ? jvp : json_null_new());
+                                jvp ? jvp : json_null_new_in(sgj_arena(jsp)));
             }
         } else {        /* assume jop points to named array */
             if (as_json) {
                 eaten = true;
                 json_array_push((json_value *)jop,
-                                jvp ? jvp : json_null_new());
+                                jvp ? jvp : json_null_new_in(sgj_arena(jsp)));
             }
         }
         goto fini;
@@ -1208,7 +1357,7 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
             if (! done) {
                 eaten = true;
                 json_object_push((json_value *)jop, jname,
-                                 jvp ? jvp : json_null_new());
+                                 jvp ? jvp : json_null_new_in(sgj_arena(jsp)));
             }
         }
     }
@@ -1216,7 +1365,8 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         sgj_haj_helper(b + n, blen - n, aname, sep, true, jvp, 0, hex_haj);
 
     if (as_json && jsp->pr_out_hr)
-        json_array_push((json_value *)jsp->out_hrp, json_string_new(b));
+        json_array_push((json_value *)jsp->out_hrp,
+                        json_string_new_in(sgj_arena(jsp), b));
     if (! as_json)
         printf("%s\n", b);
 fini:
@@ -1231,7 +1381,7 @@ sgj_haj_vs(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
     json_value * jvp;
 
     /* make json_value even if jsp->pr_as_json is false */
-    jvp = value ? json_string_new(value) : NULL;
+    jvp = value ? json_string_new_in(sgj_arena(jsp), value) : NULL;
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, false, NULL, NULL);
 }
 
@@ -1242,7 +1392,7 @@ sgj_haj_vi(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_in(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, NULL, NULL);
 }
 
@@ -1253,7 +1403,7 @@ sgj_haj_vistr(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_in(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, val_s,
                  NULL);
 }
@@ -1265,7 +1415,7 @@ sgj_haj_vi_nex(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_in(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, NULL, nex_s);
 }
 
@@ -1277,7 +1427,7 @@ sgj_haj_vistr_nex(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_in(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, val_s,
                nex_s);
 }
@@ -1288,7 +1438,7 @@ sgj_haj_vb(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_boolean_new(value);
+    jvp = json_boolean_new_in(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, false, NULL, NULL);
 }
 
@@ -1313,7 +1463,8 @@ sgj_haj_subo_r(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
                        hex_haj);
 
     if (as_json && jsp->pr_out_hr)
-        json_array_push((json_value *)jsp->out_hrp, json_string_new(b));
+        json_array_push((json_value *)jsp->out_hrp,
+                        json_string_new_in(sgj_arena(jsp), b));
     if (! as_json)
         printf("%s\n", b);
 
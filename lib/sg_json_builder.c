@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 /* This code was fetched from https://github.com/json-parser/json-builder
  * and comes with the 2 clause BSD license (shown above) which is the same
@@ -60,11 +61,275 @@ typedef struct json_builder_value
    size_t additional_length_allocated;
    size_t length_iterated;
 
+   json_arena * arena;  /* NULL when from the heap */
+
 } json_builder_value;
 
 /* Use this to silence clang --analyze warning about 'unix.MallocSizeof' */
 static const int jbv_sz = sizeof (json_builder_value);
 
+#define ARENA_OF(v) (((json_builder_value *) (v))->arena)
+
+
+/*** Arenas (sg3_utils addition)
+ ***/
+#define ARENA_ALIGN 8
+#define ARENA_DEF_BLOCK (64 * 1024)
+#define ARENA_MIN_NAMES 256
+
+typedef struct json_arena_block
+{
+   struct json_arena_block * next;
+   size_t pad;  /* keeps what follows ARENA_ALIGN-ed on 32 bit machines */
+
+} json_arena_block;
+
+typedef struct
+{
+   json_char * name;
+   unsigned int length;
+   unsigned int hash;
+
+} json_arena_name;
+
+struct _json_arena
+{
+   json_arena_block * blocks;  /* head is the one being carved up */
+   char * next;
+   char * end;
+   char * last;                /* most recent allocation, may grow in place */
+   size_t block_size;
+   int mixed;
+
+   json_arena_name * names;    /* open addressing, for interning */
+   unsigned int names_mask;
+   unsigned int names_count;
+};
+
+json_arena * json_arena_new (size_t block_size)
+{
+   json_arena * arena = (json_arena *) calloc (1, sizeof (json_arena));
+
+   if (!arena)
+      return NULL;
+
+   if (block_size < 1024)
+      block_size = ARENA_DEF_BLOCK;
+
+   arena->block_size = (block_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+   return arena;
+}
+
+void json_arena_free (json_arena * arena)
+{
+   json_arena_block * block;
+
+   if (!arena)
+      return;
+
+   while ((block = arena->blocks))
+   {
+      arena->blocks = block->next;
+      free (block);
+   }
+
+   free (arena->names);
+   free (arena);
+}
+
+int json_arena_mixed (json_arena * arena)
+{
+   return arena ? arena->mixed : 0;
+}
+
+static void * arena_alloc (json_arena * arena, size_t size)
+{
+   json_arena_block * block;
+
+   /* never zero: distinct allocations must not share an address */
+   size = size ? (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1) :
+                 ARENA_ALIGN;
+
+   if (size > (size_t) (arena->end - arena->next))
+   {
+      if (size > arena->block_size / 4)
+      {
+         /* a block of its own, kept behind the one being carved up */
+         if (! (block = (json_arena_block *) malloc (sizeof (*block) + size)))
+            return NULL;
+
+         if (arena->blocks)
+         {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+         }
+         else
+         {
+            block->next = NULL;
+            arena->blocks = block;
+         }
+
+         arena->last = NULL;
+         return block + 1;
+      }
+
+      if (! (block = (json_arena_block *) malloc (sizeof (*block) + arena->block_size)))
+         return NULL;
+
+      block->next = arena->blocks;
+      arena->blocks = block;
+      arena->next = (char *) (block + 1);
+      arena->end = arena->next + arena->block_size;
+   }
+
+   arena->last = arena->next;
+   arena->next += size;
+
+   return arena->last;
+}
+
+/* Grows the most recent allocation in place when possible */
+static void * arena_realloc (json_arena * arena, void * ptr,
+                             size_t old_size, size_t new_size)
+{
+   void * new_ptr;
+   size_t size = (new_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+   if (ptr && (ptr == arena->last) &&
+       (size <= (size_t) (arena->end - arena->last)))
+   {
+      arena->next = arena->last + size;
+      return ptr;
+   }
+
+   if (! (new_ptr = arena_alloc (arena, new_size)))
+      return NULL;
+
+   if (ptr && old_size)
+      memcpy (new_ptr, ptr, old_size < new_size ? old_size : new_size);
+
+   return new_ptr;
+}
+
+static int arena_names_grow (json_arena * arena)
+{
+   unsigned int i, j, size;
+   json_arena_name * names;
+
+   size = arena->names ? (arena->names_mask + 1) * 2 : ARENA_MIN_NAMES;
+
+   if (! (names = (json_arena_name *) calloc (size, sizeof (*names))))
+      return 0;
+
+   for (i = 0; arena->names && i <= arena->names_mask; ++ i)
+   {
+      if (!arena->names [i].name)
+         continue;
+
+      for (j = arena->names [i].hash & (size - 1); names [j].name; j = (j + 1) & (size - 1))
+         ;
+
+      names [j] = arena->names [i];
+   }
+
+   free (arena->names);
+   arena->names = names;
+   arena->names_mask = size - 1;
+
+   return 1;
+}
+
+/* Returns a copy of name held in the arena, the same copy each time */
+static json_char * arena_intern (json_arena * arena, unsigned int length,
+                                 const json_char * name)
+{
+   unsigned int i, hash = 2166136261u;  /* FNV-1a */
+   json_char * copy;
+
+   for (i = 0; i < length; ++ i)
+      hash = (hash ^ (unsigned char) name [i]) * 16777619u;
+
+   if ((arena->names_count + 1) * 2 > (arena->names ? arena->names_mask + 1 : 0))
+   {
+      if (!arena_names_grow (arena))
+         return NULL;
+   }
+
+   for (i = hash & arena->names_mask; arena->names [i].name; i = (i + 1) & arena->names_mask)
+   {
+      if (arena->names [i].hash == hash && arena->names [i].length == length &&
+          memcmp (arena->names [i].name, name, length * sizeof (json_char)) == 0)
+      {
+         return arena->names [i].name;
+      }
+   }
+
+   if (! (copy = (json_char *) arena_alloc (arena, (length + 1) * sizeof (json_char))))
+      return NULL;
+
+   memcpy (copy, name, length * sizeof (json_char));
+   copy [length] = 0;
+
+   arena->names [i].name = copy;
+   arena->names [i].length = length;
+   arena->names [i].hash = hash;
+   ++ arena->names_count;
+
+   return copy;
+}
+
+/* Allocation for values and their parts goes through these three */
+static void * mem_alloc (json_arena * arena, size_t size, int zero)
+{
+   void * ptr;
+
+   if (!arena)
+      return zero ? calloc (1, size) : malloc (size);
+
+   if ((ptr = arena_alloc (arena, size)) && zero)
+      memset (ptr, 0, size);
+
+   return ptr;
+}
+
+static void * mem_realloc (json_arena * arena, void * ptr,
+                           size_t old_size, size_t new_size)
+{
+   return arena ? arena_realloc (arena, ptr, old_size, new_size) :
+                  realloc (ptr, new_size);
+}
+
+static void mem_free (json_arena * arena, void * ptr)
+{
+   if (!arena)
+      free (ptr);
+}
+
+static json_value * value_new (json_arena * arena, json_type type)
+{
+   json_value * value = (json_value *) mem_alloc (arena, jbv_sz, 1);
+
+   if (!value)
+      return NULL;
+
+   ((json_builder_value *) value)->is_builder_value = 1;
+   ((json_builder_value *) value)->arena = arena;
+
+   value->type = type;
+
+   return value;
+}
+
+/* Note a heap (or other arena's) value going into an arena container */
+static void note_push (json_value * container, json_value * value)
+{
+   json_arena * arena = ARENA_OF (container);
+
+   if (arena && ARENA_OF (value) != arena)
+      arena->mixed = 1;
+}
+
 
 static int builderize (json_value * value)
 {
@@ -136,20 +401,21 @@ static int get_serialize_flags (json_serialize_opts opts)
 }
 
 json_value * json_array_new (size_t length)
+{
+    return json_array_new_in (NULL, length);
+}
+
+json_value * json_array_new_in (json_arena * arena, size_t length)
 {
     /* 'value' will be pointer to an instance of the base class json_value */
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+    json_value * value = value_new (arena, json_array);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
-    value->type = json_array;
-
-    if (! (value->u.array.values = (json_value **) malloc (length * sizeof (json_value *))))
+    if (! (value->u.array.values = (json_value **) mem_alloc (arena, length * sizeof (json_value *), 0)))
     {
-       free (value);
+       mem_free (arena, value);
        return NULL;
     }
 
@@ -171,15 +437,23 @@ json_value * json_array_push (json_value * array, json_value * value)
    }
    else
    {
-      json_value ** values_new = (json_value **) realloc
-            (array->u.array.values, sizeof (json_value *) * (array->u.array.length + 1));
+      /* grow geometrically so pushing n values costs O(n) */
+      unsigned int length = array->u.array.length;
+      unsigned int alloc = length ? length * 2 : 4;
+
+      json_value ** values_new = (json_value **) mem_realloc
+            (ARENA_OF (array), array->u.array.values,
+             sizeof (json_value *) * length, sizeof (json_value *) * alloc);
 
       if (!values_new)
          return NULL;
 
       array->u.array.values = values_new;
+      ((json_builder_value *) array)->additional_length_allocated = alloc - length - 1;
    }
 
+   note_push (array, value);
+
    array->u.array.values [array->u.array.length] = value;
    ++ array->u.array.length;
 
@@ -190,19 +464,20 @@ json_value * json_array_push (json_value * array, json_value * value)
 
 json_value * json_object_new (size_t length)
 {
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+    return json_object_new_in (NULL, length);
+}
+
+json_value * json_object_new_in (json_arena * arena, size_t length)
+{
+    json_value * value = value_new (arena, json_object);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
-    value->type = json_object;
-
-    if (! (value->u.object.values = (json_object_entry *) calloc
-           (length, sizeof (*value->u.object.values))))
+    if (! (value->u.object.values = (json_object_entry *) mem_alloc
+           (arena, length * sizeof (*value->u.object.values), 1)))
     {
-       free (value);
+       mem_free (arena, value);
        return NULL;
     }
 
@@ -223,9 +498,19 @@ json_value * json_object_push_length (json_value * object,
                                       json_value * value)
 {
    json_char * name_copy;
+   json_arena * arena = ARENA_OF (object);
 
    assert (object->type == json_object);
 
+   if (arena)
+   {
+      /* the same few names appear over and over, keep one copy of each */
+      if (! (name_copy = arena_intern (arena, name_length, name)))
+         return NULL;
+
+      return json_object_push_nocopy (object, name_length, name_copy, value);
+   }
+
    if (! (name_copy = (json_char *) malloc ((name_length + 1) * sizeof (json_char))))
       return NULL;
    
@@ -258,16 +543,23 @@ json_value * json_object_push_nocopy (json_value * object,
    }
    else
    {
+      unsigned int length = object->u.object.length;
+      unsigned int alloc = length ? length * 2 : 4;
+
       json_object_entry * values_new = (json_object_entry *)
-            realloc (object->u.object.values, sizeof (*object->u.object.values)
-                            * (object->u.object.length + 1));
+            mem_realloc (ARENA_OF (object), object->u.object.values,
+                         sizeof (*object->u.object.values) * length,
+                         sizeof (*object->u.object.values) * alloc);
 
       if (!values_new)
          return NULL;
 
       object->u.object.values = values_new;
+      ((json_builder_value *) object)->additional_length_allocated = alloc - length - 1;
    }
 
+   note_push (object, value);
+
    entry = object->u.object.values + object->u.object.length;
 
    entry->name_length = name_length;
@@ -283,13 +575,24 @@ json_value * json_object_push_nocopy (json_value * object,
 
 json_value * json_string_new (const json_char * buf)
 {
-   return json_string_new_length (strlen (buf), buf);
+   return json_string_new_length_in (NULL, strlen (buf), buf);
+}
+
+json_value * json_string_new_in (json_arena * arena, const json_char * buf)
+{
+   return json_string_new_length_in (arena, strlen (buf), buf);
 }
 
 json_value * json_string_new_length (unsigned int length, const json_char * buf)
+{
+   return json_string_new_length_in (NULL, length, buf);
+}
+
+json_value * json_string_new_length_in (json_arena * arena, unsigned int length,
+                                        const json_char * buf)
 {
    json_value * value;
-   json_char * copy = (json_char *) malloc ((length + 1) * sizeof (json_char));
+   json_char * copy = (json_char *) mem_alloc (arena, (length + 1) * sizeof (json_char), 0);
 
    if (!copy)
       return NULL;
@@ -297,25 +600,25 @@ json_value * json_string_new_length (unsigned int length, const json_char * buf)
    memcpy (copy, buf, length * sizeof (json_char));
    copy [length] = 0;
 
-   if (! (value = json_string_new_nocopy (length, copy)))
+   if (! (value = value_new (arena, json_string)))
    {
-      free (copy);
+      mem_free (arena, copy);
       return NULL;
    }
 
+   value->u.string.length = length;
+   value->u.string.ptr = copy;
+
    return value;
 }
 
 json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = value_new (NULL, json_string);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_string;
    value->u.string.length = length;
    value->u.string.ptr = buf;
 
@@ -324,14 +627,16 @@ json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 
 json_value * json_integer_new (json_int_t integer)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_integer_new_in (NULL, integer);
+}
+
+json_value * json_integer_new_in (json_arena * arena, json_int_t integer)
+{
+   json_value * value = value_new (arena, json_integer);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_integer;
    value->u.integer = integer;
 
    return value;
@@ -339,14 +644,16 @@ json_value * json_integer_new (json_int_t integer)
 
 json_value * json_double_new (double dbl)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_double_new_in (NULL, dbl);
+}
+
+json_value * json_double_new_in (json_arena * arena, double dbl)
+{
+   json_value * value = value_new (arena, json_double);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_double;
    value->u.dbl = dbl;
 
    return value;
@@ -354,14 +661,16 @@ json_value * json_double_new (double dbl)
 
 json_value * json_boolean_new (int b)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_boolean_new_in (NULL, b);
+}
+
+json_value * json_boolean_new_in (json_arena * arena, int b)
+{
+   json_value * value = value_new (arena, json_boolean);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_boolean;
    value->u.boolean = b;
 
    return value;
@@ -369,16 +678,12 @@ json_value * json_boolean_new (int b)
 
 json_value * json_null_new (void)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
-   
-   if (!value)
-      return NULL;
-
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_null;
+   return json_null_new_in (NULL);
+}
 
-   return value;
+json_value * json_null_new_in (json_arena * arena)
+{
+   return value_new (arena, json_null);
 }
 
 void json_object_sort (json_value * object, json_value * proto)
@@ -441,7 +746,9 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
               + objectB->u.object.length;
 
       if (! (values_new = (json_object_entry *)
-            realloc (objectA->u.object.values, sizeof (json_object_entry) * alloc)))
+            mem_realloc (ARENA_OF (objectA), objectA->u.object.values,
+                         sizeof (json_object_entry) * objectA->u.object.length,
+                         sizeof (json_object_entry) * alloc)))
       {
           return NULL;
       }
@@ -455,12 +762,29 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
 
       *entry = objectB->u.object.values[i];
       entry->value->parent = objectA;
+      note_push (objectA, entry->value);
+
+      if (!ARENA_OF (objectA) && ARENA_OF (objectB))
+      {
+         /* heap objectA must own its names */
+         json_char * name_copy = (json_char *) malloc ((entry->name_length + 1) * sizeof (json_char));
+
+         if (!name_copy)
+            return NULL;
+
+         memcpy (name_copy, entry->name, (entry->name_length + 1) * sizeof (json_char));
+         entry->name = name_copy;
+      }
    }
 
+   /* names of a heap objectB are now owned by objectA */
+   if (ARENA_OF (objectA) && !ARENA_OF (objectB) && objectB->u.object.length)
+      ARENA_OF (objectA)->mixed = 1;
+
    objectA->u.object.length += objectB->u.object.length;
 
-   free (objectB->u.object.values);
-   free (objectB);
+   mem_free (ARENA_OF (objectB), objectB->u.object.values);
+   mem_free (ARENA_OF (objectB), objectB);
 
    return objectA;
 }
@@ -544,11 +868,15 @@ size_t json_measure (json_value * value)
    indents += depth;                               \
 } while(0);                                        \
 
-size_t json_measure_ex (json_value * value, json_serialize_opts opts)
+/* Measures 'value' (and its children) as if it was found 'depth' levels
+ * down from the root. Stops when 'value' is done rather than following
+ * its parent so any sub-tree can be measured. */
+static size_t measure_value (json_value * value, json_serialize_opts opts,
+                             size_t depth)
 {
+   json_value * top = value;
    size_t total = 1;  /* null terminator */
    size_t newlines = 0;
-   size_t depth = 0;
    size_t indents = 0;
    int flags;
    int bracket_size, comma_size, colon_size;
@@ -700,6 +1028,8 @@ size_t json_measure_ex (json_value * value, json_serialize_opts opts)
             break;
       };
 
+      if (value == top)
+         break;
       value = value->parent;
    }
 
@@ -712,6 +1042,11 @@ size_t json_measure_ex (json_value * value, json_serialize_opts opts)
    return total;
 }
 
+size_t json_measure_ex (json_value * value, json_serialize_opts opts)
+{
+   return measure_value (value, opts, 0);
+}
+
 void json_serialize (json_char * buf, json_value * value)
 {
    json_serialize_ex (buf, value, default_opts);
@@ -739,12 +1074,15 @@ void json_serialize (json_char * buf, json_value * value)
    *buf ++ = (c);                                     \
 } while(0);                                           \
 
-void json_serialize_ex (json_char * buf, json_value * value, json_serialize_opts opts)
+/* Serializes 'value' with 'indent' characters of indentation already in
+ * force. Like measure_value() it stops when 'value' is done. */
+static void serialize_value (json_char * buf, json_value * value,
+                             json_serialize_opts opts, int indent)
 {
+   json_value * top = value;
    json_int_t integer, orig_integer;
    json_object_entry * entry;
    json_char * ptr, * dot;
-   int indent = 0;
    char indent_char;
    int i;
    int flags;
@@ -931,12 +1269,19 @@ void json_serialize_ex (json_char * buf, json_value * value, json_serialize_opts
             break;
       };
 
+      if (value == top)
+         break;
       value = value->parent;
    }
 
    *buf = 0;
 }
 
+void json_serialize_ex (json_char * buf, json_value * value, json_serialize_opts opts)
+{
+   serialize_value (buf, value, opts, 0);
+}
+
 void json_builder_free (json_value * value)
 {
    json_value * cur_value;
@@ -954,7 +1299,7 @@ void json_builder_free (json_value * value)
 
             if (!value->u.array.length)
             {
-               free (value->u.array.values);
+               mem_free (ARENA_OF (value), value->u.array.values);
                break;
             }
 
@@ -965,13 +1310,13 @@ void json_builder_free (json_value * value)
 
             if (!value->u.object.length)
             {
-               free (value->u.object.values);
+               mem_free (ARENA_OF (value), value->u.object.values);
                break;
             }
 
             -- value->u.object.length;
 
-            if (((json_builder_value *) value)->is_builder_value)
+            if (((json_builder_value *) value)->is_builder_value && !ARENA_OF (value))
             {
                /* Names are allocated separately for builder values.  In parser
                 * values, they are part of the same allocation as the values array
@@ -985,7 +1330,7 @@ void json_builder_free (json_value * value)
 
          case json_string:
 
-            free (value->u.string.ptr);
+            mem_free (ARENA_OF (value), value->u.string.ptr);
             break;
 
          default:
@@ -994,12 +1339,521 @@ void json_builder_free (json_value * value)
 
       cur_value = value;
       value = value->parent;
-      free (cur_value);
+      mem_free (ARENA_OF (cur_value), cur_value);
+   }
+}
+
+
+
+
+
+
+
+/*** Streaming (sg3_utils addition)
+ ***
+ * The stream keeps a stack of the containers that have been opened (i.e.
+ * their opening bracket written) but not yet closed. Frame 0 is the root.
+ */
+
+typedef struct
+{
+   json_value * value;
+   unsigned int next;   /* index of next child to be written */
+   unsigned int n_out;  /* number of children written so far */
+
+} json_stream_frame;
+
+struct _json_stream
+{
+   json_value * root;
+   json_serialize_opts opts;
+   FILE * fp;
+   int flags;
+   int err;
+
+   json_stream_frame * stack;
+   int depth;
+   int max_depth;
+
+   json_value ** path;
+   int max_path;
+
+   json_char * buf;     /* scratch for serializing one child */
+   size_t buf_len;
+};
+
+static unsigned int child_count (json_value * value)
+{
+   return value->type == json_array ? value->u.array.length :
+                                      value->u.object.length;
+}
+
+static int stream_reserve (json_stream * strm, size_t len)
+{
+   json_char * buf;
+
+   if (len <= strm->buf_len)
+      return 1;
+
+   if (len < 1024)
+      len = 1024;
+
+   if (! (buf = (json_char *) realloc (strm->buf, len)))
+   {
+      strm->err = 1;
+      return 0;
+   }
+
+   strm->buf = buf;
+   strm->buf_len = len;
+
+   return 1;
+}
+
+static void stream_newline (json_stream * strm, int level)
+{
+   int i, n;
+   char indent_char = strm->flags & f_tabs ? '\t' : ' ';
+
+   if (strm->opts.mode != json_serialize_mode_multiline)
+      return;
+
+   if (strm->opts.opts & json_serialize_opt_CRLF)
+      putc ('\r', strm->fp);
+
+   putc ('\n', strm->fp);
+
+   n = level * strm->opts.indent_size;
+
+   for (i = 0; i < n; ++ i)
+      putc (indent_char, strm->fp);
+}
+
+/* Writes a complete value whose container is 'level - 1' deep */
+static void stream_value (json_stream * strm, json_value * value, int level)
+{
+   if (!stream_reserve (strm, measure_value (value, strm->opts, level)))
+      return;
+
+   serialize_value (strm->buf, value, strm->opts,
+                    level * strm->opts.indent_size);
+
+   fputs (strm->buf, strm->fp);
+}
+
+/* Writes what precedes child 'k' of the frame at 'level': a comma if it is
+ * not the first child and, for objects, the member's name. Returns the
+ * child.
+ */
+static json_value * stream_entry (json_stream * strm, int level, unsigned int k)
+{
+   json_stream_frame * frame = strm->stack + level;
+   json_object_entry * entry;
+   size_t len;
+
+   if (frame->n_out ++ > 0)
+   {
+      putc (',', strm->fp);
+
+      if (strm->flags & f_spaces_after_commas)
+         putc (' ', strm->fp);
+
+      stream_newline (strm, level + 1);
+   }
+
+   if (frame->value->type == json_array)
+      return frame->value->u.array.values [k];
+
+   entry = frame->value->u.object.values + k;
+
+   if (stream_reserve (strm, measure_string (entry->name_length, entry->name)))
+   {
+      len = serialize_string (strm->buf, entry->name_length, entry->name);
+
+      putc ('\"', strm->fp);
+      fwrite (strm->buf, 1, len, strm->fp);
+      putc ('\"', strm->fp);
+      putc (':', strm->fp);
+
+      if (strm->flags & f_spaces_after_colons)
+         putc (' ', strm->fp);
+   }
+
+   return entry->value;
+}
+
+static void stream_open (json_stream * strm, json_value * value)
+{
+   json_stream_frame * stack;
+   int level = strm->depth;
+
+   if (strm->depth == strm->max_depth)
+   {
+      if (! (stack = (json_stream_frame *) realloc
+               (strm->stack, sizeof (*stack) * (strm->max_depth + 8))))
+      {
+         strm->err = 1;
+         return;
+      }
+
+      strm->stack = stack;
+      strm->max_depth += 8;
+   }
+
+   putc (value->type == json_array ? '[' : '{', strm->fp);
+
+   if (strm->flags & f_spaces_around_brackets)
+      putc (' ', strm->fp);
+
+   stream_newline (strm, level + 1);
+
+   strm->stack [level].value = value;
+   strm->stack [level].next = 0;
+   strm->stack [level].n_out = 0;
+   ++ strm->depth;
+}
+
+/* Writes the children of the innermost open container that have not been
+ * written yet, then its closing bracket.
+ */
+static void stream_close (json_stream * strm)
+{
+   int level = strm->depth - 1;
+   json_stream_frame * frame = strm->stack + level;
+   json_value * child;
+
+   while (frame->next < child_count (frame->value))
+   {
+      child = stream_entry (strm, level, frame->next ++);
+      stream_value (strm, child, level + 1);
    }
+
+   stream_newline (strm, level);
+
+   if (strm->flags & f_spaces_around_brackets)
+      putc (' ', strm->fp);
+
+   putc (frame->value->type == json_array ? ']' : '}', strm->fp);
+   -- strm->depth;
+}
+
+json_stream * json_stream_new (json_value * root, json_serialize_opts opts,
+                               FILE * fp)
+{
+   json_stream * strm;
+
+   if (!root || !fp)
+      return NULL;
+
+   if (! (strm = (json_stream *) calloc (1, sizeof (json_stream))))
+      return NULL;
+
+   strm->root = root;
+   strm->opts = opts;
+   strm->fp = fp;
+   strm->flags = get_serialize_flags (opts);
+
+   return strm;
 }
 
+int json_stream_flush (json_stream * strm, json_value * array)
+{
+   json_stream_frame * frame;
+   json_value * value;
+   unsigned int j, k, len;
+   int n, c, level;
+
+   if (!strm || !array || array->type != json_array || strm->err)
+      return -1;
+
+   if ((len = array->u.array.length) == 0)
+      return 0;
+
+   /* path from the root down to 'array' */
+   for (n = 0, value = array; value; value = value->parent)
+      ++ n;
+
+   if (n > strm->max_path)
+   {
+      json_value ** path = (json_value **) realloc
+            (strm->path, sizeof (*path) * (n + 8));
+
+      if (!path)
+      {
+         strm->err = 1;
+         return -1;
+      }
+
+      strm->path = path;
+      strm->max_path = n + 8;
+   }
 
+   for (c = n, value = array; value; value = value->parent)
+      strm->path [-- c] = value;
 
+   if (strm->path [0] != strm->root)
+      return -1;   /* not in this stream's tree */
 
+   if (strm->depth == 0)
+      stream_open (strm, strm->root);
 
+   for (c = 0; c < strm->depth && c < n; ++ c)
+   {
+      if (strm->stack [c].value != strm->path [c])
+         break;
+   }
 
+   /* close containers that are not on the path to 'array' */
+   while (strm->depth > c)
+      stream_close (strm);
+
+   /* open containers down to 'array', writing their earlier siblings */
+   for ( ; c < n && !strm->err; ++ c)
+   {
+      level = c - 1;
+      frame = strm->stack + level;
+
+      for (j = frame->next; j < child_count (frame->value); ++ j)
+      {
+         value = frame->value->type == json_array ?
+                     frame->value->u.array.values [j] :
+                     frame->value->u.object.values [j].value;
+
+         if (value == strm->path [c])
+            break;
+      }
+
+      if (j >= child_count (frame->value))
+      {
+         strm->err = 1;   /* already written */
+         return -1;
+      }
+
+      while (frame->next < j)
+      {
+         value = stream_entry (strm, level, frame->next ++);
+         stream_value (strm, value, c);
+      }
+
+      stream_entry (strm, level, frame->next ++);
+      stream_open (strm, strm->path [c]);
+   }
+
+   if (strm->err)
+      return -1;
+
+   level = strm->depth - 1;
+   frame = strm->stack + level;
+
+   for (k = frame->next; k < len; ++ k)
+   {
+      value = stream_entry (strm, level, k);
+      stream_value (strm, value, level + 1);
+   }
+
+   for (k = 0; k < len; ++ k)
+      json_builder_free (array->u.array.values [k]);
+
+   array->u.array.length = 0;
+   ((json_builder_value *) array)->additional_length_allocated += len;
+   frame->next = 0;
+
+   return (strm->err || ferror (strm->fp)) ? -1 : 0;
+}
+
+int json_stream_finish (json_stream * strm)
+{
+   int res;
+
+   if (!strm)
+      return -1;
+
+   if (strm->depth == 0)
+      stream_value (strm, strm->root, 0);
+   else
+   {
+      while (strm->depth > 0 && !strm->err)
+         stream_close (strm);
+   }
+
+   res = (strm->err || ferror (strm->fp)) ? -1 : 0;
+   json_stream_free (strm);
+
+   return res;
+}
+
+void json_stream_free (json_stream * strm)
+{
+   if (!strm)
+      return;
+
+   free (strm->buf);
+   free (strm->path);
+   free (strm->stack);
+   free (strm);
+}
+
+FILE * json_stream_fp (json_stream * strm)
+{
+   return strm ? strm->fp : NULL;
+}
+
+
+
+/*** CBOR (sg3_utils addition)
+ ***
+ * RFC 8949 encoding: each head is the major type in the top 3 bits of the
+ * first byte followed by the argument (a count, length or integer) in the
+ * fewest bytes that hold it. Objects are maps with text string keys.
+ */
+
+#define CBOR_UINT    0
+#define CBOR_NEGINT  1
+#define CBOR_TEXT    3
+#define CBOR_ARRAY   4
+#define CBOR_MAP     5
+#define CBOR_SIMPLE  7
+
+#define CBOR_FALSE   0xf4
+#define CBOR_TRUE    0xf5
+#define CBOR_NULL    0xf6
+#define CBOR_FLOAT64 0xfb
+
+/* Writes a head to buf (if non-NULL), returns its length */
+static size_t cbor_head (unsigned char * buf, int major, uint64_t arg)
+{
+   int k, n;
+
+   if (arg < 24)
+      n = 0;
+   else if (arg <= 0xff)
+      n = 1;
+   else if (arg <= 0xffff)
+      n = 2;
+   else if (arg <= 0xffffffff)
+      n = 4;
+   else
+      n = 8;
+
+   if (buf)
+   {
+      /* additional information 24 to 27: 1, 2, 4 or 8 bytes follow */
+      buf [0] = (unsigned char) ((major << 5) |
+                  (n == 0 ? arg : n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27));
+
+      for (k = n; k > 0; -- k, arg >>= 8)
+         buf [k] = (unsigned char) arg;
+   }
+
+   return 1 + n;
+}
+
+/* Encodes 'value' (and its children) to buf, or only measures it if buf is
+ * NULL. Returns the number of bytes.
+ */
+static size_t cbor_value (unsigned char * buf, json_value * value)
+{
+   unsigned int i;
+   size_t len = 0;
+   uint64_t u;
+
+#define CBOR_PTR (buf ? buf + len : NULL)
+
+   switch (value->type)
+   {
+      case json_array:
+
+         len += cbor_head (CBOR_PTR, CBOR_ARRAY, value->u.array.length);
+
+         for (i = 0; i < value->u.array.length; ++ i)
+            len += cbor_value (CBOR_PTR, value->u.array.values [i]);
+
+         break;
+
+      case json_object:
+
+         len += cbor_head (CBOR_PTR, CBOR_MAP, value->u.object.length);
+
+         for (i = 0; i < value->u.object.length; ++ i)
+         {
+            json_object_entry * entry = value->u.object.values + i;
+
+            len += cbor_head (CBOR_PTR, CBOR_TEXT, entry->name_length);
+
+            if (buf)
+               memcpy (buf + len, entry->name, entry->name_length);
+
+            len += entry->name_length;
+            len += cbor_value (CBOR_PTR, entry->value);
+         }
+
+         break;
+
+      case json_string:
+
+         len += cbor_head (CBOR_PTR, CBOR_TEXT, value->u.string.length);
+
+         if (buf)
+            memcpy (buf + len, value->u.string.ptr, value->u.string.length);
+
+         len += value->u.string.length;
+         break;
+
+      case json_integer:
+
+         if (value->u.integer < 0)
+         {
+            /* -1 - n without overflow at the most negative value */
+            u = (uint64_t) (-(value->u.integer + 1));
+            len += cbor_head (CBOR_PTR, CBOR_NEGINT, u);
+         }
+         else
+            len += cbor_head (CBOR_PTR, CBOR_UINT, (uint64_t) value->u.integer);
+
+         break;
+
+      case json_double:
+
+         if (buf)
+         {
+            memcpy (&u, &value->u.dbl, sizeof (u));
+            buf [0] = CBOR_FLOAT64;
+
+            for (i = 8; i > 0; -- i, u >>= 8)
+               buf [i] = (unsigned char) u;
+         }
+
+         len += 9;
+         break;
+
+      case json_boolean:
+
+         if (buf)
+            buf [0] = value->u.boolean ? CBOR_TRUE : CBOR_FALSE;
+
+         len += 1;
+         break;
+
+      default:
+
+         if (buf)
+            buf [0] = CBOR_NULL;
+
+         len += 1;
+         break;
+   }
+
+#undef CBOR_PTR
+
+   return len;
+}
+
+size_t json_cbor_measure (json_value * value)
+{
+   return cbor_value (NULL, value);
+}
+
+size_t json_cbor_serialize (unsigned char * buf, json_value * value)
+{
+   return cbor_value (buf, value);
+}
@@ -69,6 +69,7 @@
 #endif
 
 #include <stddef.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 
@@ -229,18 +230,39 @@ void json_value_free_ex (json_settings * settings,
 extern const size_t json_builder_extra;
 
 
+/*** Arenas (sg3_utils addition)
+ ***
+ * Values made by the *_in() variants below with a non-NULL arena are
+ * carved out of large blocks owned by that arena, as is the backing storage
+ * of such arrays and objects. Names pushed into such objects are interned:
+ * each distinct name is stored once per arena. json_builder_free() does not
+ * release arena memory; json_arena_free() releases all of it at once. If
+ * heap values have been pushed into arena arrays or objects then
+ * json_arena_mixed() returns true and json_builder_free() should be called
+ * on the tree before json_arena_free() to release those heap values. With
+ * a NULL arena the *_in() variants act like those without the suffix.
+ */
+typedef struct _json_arena json_arena;
+
+json_arena * json_arena_new (size_t block_size);  /* < 1024: default */
+void json_arena_free (json_arena *);
+int json_arena_mixed (json_arena *);
+
+
 /*** Arrays
  ***
  * Note that all of these length arguments are just a hint to allow for
  * pre-allocation - passing 0 is fine.
  */
 json_value * json_array_new (size_t length);
+json_value * json_array_new_in (json_arena *, size_t length);
 json_value * json_array_push (json_value * array, json_value *);
 
 
 /*** Objects
  ***/
 json_value * json_object_new (size_t length);
+json_value * json_object_new_in (json_arena *, size_t length);
 
 json_value * json_object_push (json_value * object,
                                const json_char * name,
@@ -273,7 +295,10 @@ void json_object_sort (json_value * object, json_value * proto);
 /*** Strings
  ***/
 json_value * json_string_new (const json_char *);
+json_value * json_string_new_in (json_arena *, const json_char *);
 json_value * json_string_new_length (unsigned int length, const json_char *);
+json_value * json_string_new_length_in (json_arena *, unsigned int length,
+                                        const json_char *);
 json_value * json_string_new_nocopy (unsigned int length, json_char *);
 
 
@@ -284,6 +309,11 @@ json_value * json_double_new (double);
 json_value * json_boolean_new (int);
 json_value * json_null_new (void);
 
+json_value * json_integer_new_in (json_arena *, json_int_t);
+json_value * json_double_new_in (json_arena *, double);
+json_value * json_boolean_new_in (json_arena *, int);
+json_value * json_null_new_in (json_arena *);
+
 
 /*** Serializing
  ***/
@@ -324,6 +354,42 @@ void json_serialize_ex (json_char * buf, json_value *, json_serialize_opts);
  ***/
 void json_builder_free (json_value *);
 
+
+/*** Streaming (sg3_utils addition)
+ ***
+ * Writes the tree rooted at 'root' to 'fp' a piece at a time; the result is
+ * identical to json_serialize_ex() with the same options. Each call to
+ * json_stream_flush() writes the elements currently in 'array' (which must
+ * be in the tree below 'root'), frees them and empties 'array'. Everything
+ * before 'array' in document order is written at the same time, so after
+ * a flush only the flushed array, its ancestors and their later members
+ * may be added to. json_stream_finish() writes the remainder and frees
+ * the stream but not the tree. json_stream_free() abandons a stream.
+ * json_stream_fp() returns the 'fp' given to json_stream_new().
+ * Functions returning int yield 0 on success, else -1.
+ */
+typedef struct _json_stream json_stream;
+
+json_stream * json_stream_new (json_value * root, json_serialize_opts,
+                               FILE * fp);
+int json_stream_flush (json_stream *, json_value * array);
+int json_stream_finish (json_stream *);
+void json_stream_free (json_stream *);
+FILE * json_stream_fp (json_stream *);
+
+
+/*** CBOR (sg3_utils addition)
+ ***
+ * Binary alternative to serializing: encodes the tree as CBOR (RFC 8949).
+ * Arrays and objects become definite length arrays and maps (with text
+ * string keys), integers use the shortest head that holds them and doubles
+ * are 64 bit floats. json_cbor_measure() returns the exact number of bytes
+ * that json_cbor_serialize() will write to 'buf' (and return); no null
+ * terminator is added.
+ */
+size_t json_cbor_measure (json_value *);
+size_t json_cbor_serialize (unsigned char * buf, json_value *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,7 @@
 
 #include "sg_lib.h"
 #include "sg_lib_data.h"
+#include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_json_builder.h"
 
@@ -841,3 +842,77 @@ sgj_js2file(sgj_state * jsp, sgj_opaque_p jop, int exit_status, FILE * fp)
     }
     sgj_js2file_estr(jsp, jop, exit_status, estr, fp);
 }
+
+static const char * const pt_res_cat_arr[] = {
+    "good", "status", "sense", "transport error", "os error",
+};
+
+void
+sgj_haj_pt_stats(sgj_state * jsp, sgj_opaque_p jop)
+{
+    bool as_json = jsp && jsp->pr_as_json;
+    int k, num;
+    const char * ccp;
+    struct sg_pt_stats_ent * arr;
+    struct sg_pt_stats_ent * ep;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    char b[80];
+    char d[32];
+    static const int blen = sizeof(b);
+
+    num = sg_pt_stats_get(NULL, 0);
+    if (num <= 0)
+        return;
+    arr = (struct sg_pt_stats_ent *)calloc(num, sizeof(*arr));
+    if (NULL == arr)
+        return;
+    num = sg_pt_stats_get(arr, num);
+    if (as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "pt_latency_statistics");
+    else
+        sgj_pr_hr(jsp, "Pass-through command latency (microseconds):\n");
+    for (k = 0, ep = arr; k < num; ++k, ++ep) {
+        if (SG_PT_STATS_KIND_SCSI == ep->kind)
+            sg_get_opcode_sa_name(ep->opcode, (ep->serv_act < 0) ? 0 :
+                                  ep->serv_act, -1, blen, b);
+        else
+            sg_get_nvme_opcode_name(ep->opcode,
+                                    SG_PT_STATS_KIND_NVME_ADMIN == ep->kind,
+                                    blen, b);
+        ccp = ((ep->category >= 0) && (ep->category < 5)) ?
+              pt_res_cat_arr[ep->category] : "unknown";
+        if (as_json) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "command_name", b);
+            sgj_js_nv_b(jsp, jo2p, "nvme",
+                        SG_PT_STATS_KIND_SCSI != ep->kind);
+            sgj_js_nv_ihex(jsp, jo2p, "opcode", ep->opcode);
+            if (ep->serv_act >= 0)
+                sgj_js_nv_ihex(jsp, jo2p, "service_action", ep->serv_act);
+            sgj_js_nv_s(jsp, jo2p, "result_category", ccp);
+            sgj_js_nv_i(jsp, jo2p, "count", ep->count);
+            sgj_js_nv_i(jsp, jo2p, "min_ns", ep->min_ns);
+            sgj_js_nv_i(jsp, jo2p, "mean_ns", ep->sum_ns / ep->count);
+            sgj_js_nv_i(jsp, jo2p, "p50_ns", ep->p50_ns);
+            sgj_js_nv_i(jsp, jo2p, "p99_ns", ep->p99_ns);
+            sgj_js_nv_i(jsp, jo2p, "p99_9_ns", ep->p999_ns);
+            sgj_js_nv_i(jsp, jo2p, "max_ns", ep->max_ns);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        } else {
+            if (ep->serv_act >= 0)
+                snprintf(d, sizeof(d), "0x%x,0x%x", ep->opcode,
+                         ep->serv_act);
+            else
+                snprintf(d, sizeof(d), "0x%x", ep->opcode);
+            sgj_pr_hr(jsp, "  %s [%s], %s: count=%" PRIu64 "\n", b, d, ccp,
+                      ep->count);
+            sgj_pr_hr(jsp, "    min=%.1f mean=%.1f p50=%.1f p99=%.1f "
+                      "p99.9=%.1f max=%.1f\n", ep->min_ns / 1000.0,
+                      (ep->sum_ns / (double)ep->count) / 1000.0,
+                      ep->p50_ns / 1000.0, ep->p99_ns / 1000.0,
+                      ep->p999_ns / 1000.0, ep->max_ns / 1000.0);
+        }
+    }
+    free(arr);
+}
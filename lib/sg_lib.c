@@ -36,6 +36,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
 #include <ctype.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -49,6 +50,15 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H) && (! defined(SG_LIB_WIN32))
+#include <pthread.h>
+#define SG_LIB_HAVE_PTHREAD 1
+#endif
+
 #include "sg_lib.h"
 #include "sg_lib_data.h"
 #include "sg_unaligned.h"
@@ -141,6 +151,23 @@ get_value_name(const struct sg_lib_value_name_t * arr, int value,
     return NULL;
 }
 
+/* Same result as get_value_name(sg_lib_normal_opcodes, opcode, peri_type)
+ * but, for simple PDTs, taken from tables indexed by PDT class and opcode
+ * rather than a scan. Compound PDTs (e.g. PDT_DISK_ZBC) still scan. */
+static const struct sg_lib_value_name_t *
+get_opcode_value_name(uint8_t opcode, int peri_type)
+{
+    int n;
+
+    if (peri_type < 0)
+        peri_type = 0;
+    if (peri_type > PDT_MAX)
+        return get_value_name(sg_lib_normal_opcodes, opcode, peri_type);
+    n = sg_lib_normal_opcodes_idx[sg_lib_normal_opcodes_pdt_class[peri_type]]
+                                 [opcode];
+    return n ? (sg_lib_normal_opcodes + n - 1) : NULL;
+}
+
 /* If this function is not called, sg_warnings_strm will be NULL and all users
  * (mainly fprintf() ) need to check and substitute stderr as required */
 void
@@ -356,42 +383,56 @@ char *
 sg_get_additional_sense_str(int asc, int ascq, bool add_sense_leadin,
                             int buff_len, char * buff)
 {
-    int k, num, rlen;
+    int k, num, rlen, lo, hi, mid;
     bool found = false;
 
     if (1 == buff_len) {
         buff[0] = '\0';
         return buff;
     }
-    for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
-        const struct sg_lib_asc_ascq_range_t * ei2p =
-                                        &sg_lib_asc_ascq_range[k];
-
-        if ((ei2p->asc == asc) && (ascq >= ei2p->ascq_min)  &&
-            (ascq <= ei2p->ascq_max)) {
-            found = true;
-            if (add_sense_leadin)
-                num = sg_scnpr(buff, buff_len, "Additional sense: ");
-            else
-                num = 0;
-            rlen = buff_len - num;
-            sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text, ascq);
+    if ((asc < 0) || (asc > 0xff) || (ascq < 0) || (ascq > 0xff))
+        goto not_found;
+    /* ranges are few, only look when the bitmap says this ASC has one */
+    if (sg_lib_asc_ascq_range_map[asc >> 3] & (1 << (asc & 0x7))) {
+        for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
+            const struct sg_lib_asc_ascq_range_t * ei2p =
+                                            &sg_lib_asc_ascq_range[k];
+
+            if ((ei2p->asc == asc) && (ascq >= ei2p->ascq_min)  &&
+                (ascq <= ei2p->ascq_max)) {
+                if (add_sense_leadin)
+                    num = sg_scnpr(buff, buff_len, "Additional sense: ");
+                else
+                    num = 0;
+                rlen = buff_len - num;
+                sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text,
+                         ascq);
+                return buff;
+            }
         }
     }
-    if (found)
-        return buff;
-
-    for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
-        const struct sg_lib_asc_ascq_t * eip = &sg_lib_asc_ascq[k];
-
-        if (eip->asc == asc && eip->ascq == ascq) {
+    /* binary search over the entries for this ASC, sorted by ASCQ */
+    lo = sg_lib_asc_ascq_idx[asc];
+    hi = sg_lib_asc_ascq_idx[asc + 1];
+    while (lo < hi) {
+        const struct sg_lib_asc_ascq_t * eip;
+
+        mid = lo + ((hi - lo) / 2);
+        eip = &sg_lib_asc_ascq[mid];
+        if (eip->ascq < ascq)
+            lo = mid + 1;
+        else if (eip->ascq > ascq)
+            hi = mid;
+        else {
             found = true;
             if (add_sense_leadin)
                 sg_scnpr(buff, buff_len, "Additional sense: %s", eip->text);
             else
                 sg_scnpr(buff, buff_len, "%s", eip->text);
+            break;
         }
     }
+not_found:
     if (! found) {
         if (asc >= 0x80)
             sg_scnpr(buff, buff_len, "vendor specific ASC=%02x, ASCQ=%02x "
@@ -610,6 +651,188 @@ sg_get_sense_progress_fld(const uint8_t * sbp, int sb_len,
     }
 }
 
+/* Walks the descriptors of descriptor format sense data, recording where
+ * each is found in sdp->desc[] and gathering the fields of those that
+ * sg_sense_decode() exposes. Does not check the response code. The walk
+ * (i.e. clipping of the last descriptor) matches what
+ * sg_get_sense_descriptors_str() has always output. */
+static void
+sense_desc_walk(const uint8_t * sbp, int sb_len,
+                struct sg_sense_decoded * sdp)
+{
+    bool another_pr = false;
+    int add_sb_len, add_d_len, desc_len, k;
+    uint16_t another_progress = 0;
+    const uint8_t * descp;
+    struct sg_sense_desc * dp;
+
+    sdp->num_desc = 0;
+    if ((sb_len < 8) || (0 == (add_sb_len = sbp[7])))
+        return;
+    add_sb_len = (add_sb_len < (sb_len - 8)) ? add_sb_len : (sb_len - 8);
+    for (descp = (sbp + 8), k = 0;
+         (k < add_sb_len) && (sdp->num_desc < SG_SENSE_MAX_DESC);
+         k += desc_len, descp += desc_len) {
+        add_d_len = (k < (add_sb_len - 1)) ? descp[1] : -1;
+        if ((k + add_d_len + 2) > add_sb_len)
+            add_d_len = add_sb_len - k - 2;
+        desc_len = add_d_len + 2;
+        dp = sdp->desc + sdp->num_desc++;
+        dp->type = descp[0];
+        dp->add_len = add_d_len;
+        dp->off = 8 + k;
+        switch (descp[0]) {
+        case 0:         /* Information */
+            if ((add_d_len >= 10) && (! sdp->info_present)) {
+                sdp->info_present = true;
+                sdp->info_valid = !!(0x80 & descp[2]);
+                sdp->info = sg_get_unaligned_be64(descp + 4);
+            }
+            break;
+        case 1:         /* Command specific */
+            if ((add_d_len >= 10) && (! sdp->cmd_spec_present)) {
+                sdp->cmd_spec_present = true;
+                sdp->cmd_spec = sg_get_unaligned_be64(descp + 4);
+            }
+            break;
+        case 2:         /* Sense key specific */
+            if ((add_d_len >= 6) && (0x80 & descp[4]) && (! sdp->sks_valid)) {
+                sdp->sks_valid = true;
+                memcpy(sdp->sks, descp + 4, 3);
+            }
+            break;
+        case 3:         /* Field replaceable unit code */
+            if ((add_d_len >= 2) && (0 == sdp->fru))
+                sdp->fru = descp[3];
+            break;
+        case 4:         /* Stream commands */
+            if (add_d_len >= 2) {
+                sdp->filemark |= !!(0x80 & descp[3]);
+                sdp->eom |= !!(0x40 & descp[3]);
+                sdp->ili |= !!(0x20 & descp[3]);
+            }
+            break;
+        case 5:         /* Block commands */
+            if (add_d_len >= 2)
+                sdp->ili |= !!(0x20 & descp[3]);
+            break;
+        case 0xa:       /* Another progress indication */
+            if ((add_d_len >= 6) && (! another_pr)) {
+                another_pr = true;
+                another_progress = sg_get_unaligned_be16(descp + 6);
+            }
+            break;
+        case 0xd:       /* Direct-access block device: 0, 1, 2 and 3 */
+            if (add_d_len < 28)
+                break;
+            sdp->ili |= !!(0x20 & descp[2]);
+            if ((0x80 & descp[4]) && (! sdp->sks_valid)) {
+                sdp->sks_valid = true;
+                memcpy(sdp->sks, descp + 4, 3);
+            }
+            if (0 == sdp->fru)
+                sdp->fru = descp[7];
+            if (! sdp->info_present) {
+                sdp->info_present = true;
+                sdp->info_valid = !!(0x80 & descp[2]);
+                sdp->info = sg_get_unaligned_be64(descp + 8);
+            }
+            if (! sdp->cmd_spec_present) {
+                sdp->cmd_spec_present = true;
+                sdp->cmd_spec = sg_get_unaligned_be64(descp + 16);
+            }
+            break;
+        case 0xde:      /* NVMe Status; vendor (sg3_utils) specific */
+            if ((add_d_len >= 6) && (! sdp->nvme_present)) {
+                sdp->nvme_present = true;
+                sdp->nvme_dnr = !!(0x80 & descp[5]);
+                sdp->nvme_more = !!(0x40 & descp[5]);
+                sdp->nvme_sct_sc = sg_get_unaligned_be16(descp + 6);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    /* same precedence as sg_get_sense_progress_fld() */
+    if (sdp->sks_valid && ((SPC_SK_NO_SENSE == sdp->sense_key) ||
+                           (SPC_SK_NOT_READY == sdp->sense_key))) {
+        sdp->progress_present = true;
+        sdp->progress = sg_get_unaligned_be16(sdp->sks + 1);
+    } else if (another_pr) {
+        sdp->progress_present = true;
+        sdp->progress = another_progress;
+    }
+}
+
+/* See description in sg_lib.h header file */
+bool
+sg_sense_decode(const uint8_t * sbp, int sb_len,
+                struct sg_sense_decoded * sdp)
+{
+    int len;
+    uint8_t resp_code;
+
+    memset(sdp, 0, offsetof(struct sg_sense_decoded, desc));
+    if ((NULL == sbp) || (sb_len < 1))
+        return false;
+    resp_code = 0x7f & sbp[0];
+    sdp->response_code = resp_code;
+    sdp->len = sb_len;
+    if ((resp_code < 0x70) || (resp_code > 0x73))
+        return false;
+    sdp->deferred = !!(0x1 & resp_code);
+    if (resp_code >= 0x72) {    /* descriptor format */
+        sdp->descriptor_format = true;
+        if (sb_len > 1)
+            sdp->sense_key = (0xf & sbp[1]);
+        if (sb_len > 2)
+            sdp->asc = sbp[2];
+        if (sb_len > 3)
+            sdp->ascq = sbp[3];
+        if (sb_len > 4)
+            sdp->sdat_ovfl = !!(0x80 & sbp[4]);
+        sense_desc_walk(sbp, sb_len, sdp);
+        return true;
+    }
+    /* fixed format */
+    len = (sb_len > 7) ? (sbp[7] + 8) : sb_len;
+    len = (len > sb_len) ? sb_len : len;
+    sdp->len = len;
+    if (len > 2) {
+        sdp->sense_key = (0xf & sbp[2]);
+        sdp->sdat_ovfl = !!(0x10 & sbp[2]);
+        sdp->filemark = !!(0x80 & sbp[2]);
+        sdp->eom = !!(0x40 & sbp[2]);
+        sdp->ili = !!(0x20 & sbp[2]);
+    }
+    if (len > 6) {
+        sdp->info_present = true;
+        sdp->info_valid = !!(0x80 & sbp[0]);
+        sdp->info = sg_get_unaligned_be32(sbp + 3);
+    }
+    if (len > 11) {
+        sdp->cmd_spec_present = true;
+        sdp->cmd_spec = sg_get_unaligned_be32(sbp + 8);
+    }
+    if (len > 12)
+        sdp->asc = sbp[12];
+    if (len > 13)
+        sdp->ascq = sbp[13];
+    if (len > 14)
+        sdp->fru = sbp[14];
+    if ((len > 17) && (0x80 & sbp[15])) {
+        sdp->sks_valid = true;
+        memcpy(sdp->sks, sbp + 15, 3);
+        if ((SPC_SK_NO_SENSE == sdp->sense_key) ||
+            (SPC_SK_NOT_READY == sdp->sense_key)) {
+            sdp->progress_present = true;
+            sdp->progress = sg_get_unaligned_be16(sbp + 16);
+        }
+    }
+    return true;
+}
+
 char *
 sg_get_pdt_str(int pdt, int buff_len, char * buff)
 {
@@ -1514,15 +1737,13 @@ static const char * dd_usage_reason_str_arr[] = {
     "administrative lu associated with a preferred binding:",
    };
 
-/* Decode descriptor format sense descriptors (assumes sense buffer is
- * in descriptor format). 'leadin' is string prepended to each line written
- * to 'b', NULL treated as "". Returns the number of bytes written to 'b'
- * excluding the trailing '\0'. If problem, returns 0. */
-int
-sg_get_sense_descriptors_str(const char * lip, const uint8_t * sbp,
-                             int sb_len, int blen, char * b)
+/* Formats the descriptors found by sense_desc_walk() in 'sdp'. The
+ * descriptor contents are taken from the sense buffer 'sbp'. */
+static int
+sense_descs_str(const char * lip, const uint8_t * sbp,
+                const struct sg_sense_decoded * sdp, int blen, char * b)
 {
-    int add_sb_len, desc_len, k, j, sense_key;
+    int k, j, sense_key;
     int n, progress, pr, rem;
     uint16_t sct_sc;
     bool processed;
@@ -1534,19 +1755,12 @@ sg_get_sense_descriptors_str(const char * lip, const uint8_t * sbp,
     if ((NULL == b) || (blen <= 0))
         return 0;
     b[0] = '\0';
-    if ((sb_len < 8) || (0 == (add_sb_len = sbp[7])))
-        return 0;
-    add_sb_len = (add_sb_len < (sb_len - 8)) ? add_sb_len : (sb_len - 8);
-    sense_key = (sbp[1] & 0xf);
+    sense_key = sdp->sense_key;
 
-    for (descp = (sbp + 8), k = 0, n = 0;
-         (k < add_sb_len) && (n < blen);
-         k += desc_len, descp += desc_len) {
-        int add_d_len = (k < (add_sb_len - 1)) ? descp[1] : -1;
+    for (k = 0, n = 0; (k < sdp->num_desc) && (n < blen); ++k) {
+        int add_d_len = sdp->desc[k].add_len;
 
-        if ((k + add_d_len + 2) > add_sb_len)
-            add_d_len = add_sb_len - k - 2;
-        desc_len = add_d_len + 2;
+        descp = sbp + sdp->desc[k].off;
         n += sg_scn3pr(b, blen, n, "%s  Descriptor type: ", lip);
         processed = true;
         switch (descp[0]) {
@@ -1835,6 +2049,27 @@ sg_get_sense_descriptors_str(const char * lip, const uint8_t * sbp,
     return n;
 }
 
+/* Decode descriptor format sense descriptors (assumes sense buffer is
+ * in descriptor format). 'leadin' is string prepended to each line written
+ * to 'b', NULL treated as "". Returns the number of bytes written to 'b'
+ * excluding the trailing '\0'. If problem, returns 0. */
+int
+sg_get_sense_descriptors_str(const char * lip, const uint8_t * sbp,
+                             int sb_len, int blen, char * b)
+{
+    struct sg_sense_decoded sd;
+
+    if ((NULL == b) || (blen <= 0))
+        return 0;
+    b[0] = '\0';
+    memset(&sd, 0, offsetof(struct sg_sense_decoded, desc));
+    if ((NULL == sbp) || (sb_len < 8))
+        return 0;
+    sd.sense_key = (sbp[1] & 0xf);
+    sense_desc_walk(sbp, sb_len, &sd);
+    return sense_descs_str(lip, sbp, &sd, blen, b);
+}
+
 /* Decode SAT ATA PASS-THROUGH fixed format sense. Shows "+" after 'count'
  * and/or 'lba' values to indicate that not all data in those fields is shown.
  * That extra field information may be available in the ATA pass-through
@@ -1874,16 +2109,24 @@ int
 sg_get_sense_str(const char * lip, const uint8_t * sbp, int sb_len,
                  bool raw_sinfo, int cblen, char * cbp)
 {
-    bool descriptor_format = false;
-    bool sdat_ovfl = false;
+    return sg_get_sense_decoded_str(lip, sbp, sb_len, NULL, raw_sinfo,
+                                    cblen, cbp);
+}
+
+/* Format sense information already decoded by sg_sense_decode() */
+int
+sg_get_sense_decoded_str(const char * lip, const uint8_t * sbp, int sb_len,
+                         const struct sg_sense_decoded * sdp, bool raw_sinfo,
+                         int cblen, char * cbp)
+{
     bool valid_info_fld;
-    int len, progress, n, r, pr, rem;
+    int n, r, pr, rem;
     unsigned int info;
     uint8_t resp_code;
     const char * ebp = NULL;
     char ebuff[64];
     char b[256];
-    struct sg_scsi_sense_hdr ssh;
+    struct sg_sense_decoded sd;
     static const int blen = sizeof(b);
 
     if ((NULL == cbp) || (cblen <= 0))
@@ -1897,114 +2140,103 @@ sg_get_sense_str(const char * lip, const uint8_t * sbp, int sb_len,
     if ((NULL == sbp) || (sb_len < 1))
         return sg_scnpr(cbp, cblen, "%s >>> sense buffer empty\n", lip);
 
+    if (NULL == sdp) {
+        sg_sense_decode(sbp, sb_len, &sd);
+        sdp = &sd;
+    }
     n = 0;
-    resp_code = 0x7f & sbp[0];
+    resp_code = sdp->response_code;
     valid_info_fld = !!(sbp[0] & 0x80);
-    len = sb_len;
-    if (sg_scsi_normalize_sense(sbp, sb_len, &ssh)) {
-        switch (ssh.response_code) {
+    if ((resp_code >= 0x70) && (resp_code <= 0x73)) {
+        switch (resp_code) {
         case 0x70:      /* fixed, current */
             ebp = "Fixed format, current";
-            len = (sb_len > 7) ? (sbp[7] + 8) : sb_len;
-            len = (len > sb_len) ? sb_len : len;
-            sdat_ovfl = (len > 2) ? !!(sbp[2] & 0x10) : false;
             break;
         case 0x71:      /* fixed, deferred */
             /* error related to a previous command */
             ebp = "Fixed format, <<<deferred>>>";
-            len = (sb_len > 7) ? (sbp[7] + 8) : sb_len;
-            len = (len > sb_len) ? sb_len : len;
-            sdat_ovfl = (len > 2) ? !!(sbp[2] & 0x10) : false;
             break;
         case 0x72:      /* descriptor, current */
-            descriptor_format = true;
             ebp = "Descriptor format, current";
-            sdat_ovfl = (sb_len > 4) ? !!(sbp[4] & 0x80) : false;
             break;
         case 0x73:      /* descriptor, deferred */
-            descriptor_format = true;
             ebp = "Descriptor format, <<<deferred>>>";
-            sdat_ovfl = (sb_len > 4) ? !!(sbp[4] & 0x80) : false;
-            break;
-        case 0x0:
-            ebp = "Response code: 0x0 (?)";
             break;
         default:
             sg_scnpr(ebuff, sizeof(ebuff), "Unknown response code: 0x%x",
-                     ssh.response_code);
+                     resp_code);
             ebp = ebuff;
             break;
         }
         n += sg_scn3pr(cbp, cblen, n, "%s%s; Sense key: %s\n", lip, ebp,
-                       sg_lib_sense_key_desc[ssh.sense_key]);
-        if (sdat_ovfl)
+                       sg_lib_sense_key_desc[sdp->sense_key]);
+        if (sdp->sdat_ovfl)
             n += sg_scn3pr(cbp, cblen, n, "%s<<<Sense data overflow "
                            "(SDAT_OVFL)>>>\n", lip);
-        if (descriptor_format) {
+        if (sdp->descriptor_format) {
             n += sg_scn3pr(cbp, cblen, n, "%s%s\n", lip,
-                           sg_get_asc_ascq_str(ssh.asc, ssh.ascq, blen, b));
-            n += sg_get_sense_descriptors_str(lip, sbp, len,
-                                              cblen - n, cbp + n);
-        } else if ((len > 12) && (0 == ssh.asc) &&
-                   (ASCQ_ATA_PT_INFO_AVAILABLE == ssh.ascq)) {
+                           sg_get_asc_ascq_str(sdp->asc, sdp->ascq, blen, b));
+            n += sense_descs_str(lip, sbp, sdp, cblen - n, cbp + n);
+        } else if ((sdp->len > 12) && (0 == sdp->asc) &&
+                   (ASCQ_ATA_PT_INFO_AVAILABLE == sdp->ascq)) {
             /* SAT ATA PASS-THROUGH fixed format */
             n += sg_scn3pr(cbp, cblen, n, "%s%s\n", lip,
-                           sg_get_asc_ascq_str(ssh.asc, ssh.ascq, blen, b));
-            n += sg_get_sense_sat_pt_fixed_str(lip, sbp, len,
+                           sg_get_asc_ascq_str(sdp->asc, sdp->ascq, blen, b));
+            n += sg_get_sense_sat_pt_fixed_str(lip, sbp, sdp->len,
                                                cblen - n, cbp + n);
-        } else if (len > 2) {   /* fixed format */
-            if (len > 12)
+        } else if (sdp->len > 2) {      /* fixed format */
+            const uint8_t * sksp = sdp->sks;
+
+            if (sdp->len > 12)
                 n += sg_scn3pr(cbp, cblen, n, "%s%s\n", lip,
-                         sg_get_asc_ascq_str(ssh.asc, ssh.ascq, blen, b));
+                         sg_get_asc_ascq_str(sdp->asc, sdp->ascq, blen, b));
             r = 0;
             if (strlen(lip) > 0)
                 r += sg_scn3pr(b, blen, r, "%s", lip);
-            if (len > 6) {
-                info = sg_get_unaligned_be32(sbp + 3);
-                if (valid_info_fld)
+            info = (unsigned int)sdp->info;
+            if (sdp->info_present) {
+                if (sdp->info_valid)
                     r += sg_scn3pr(b, blen, r, "  Info fld=0x%x [%u] ",
                                    info, info);
                 else if (info > 0)
                     r += sg_scn3pr(b, blen, r, "  Valid=0, Info fld=0x%x "
                                    "[%u] ", info, info);
-            } else
-                info = 0;
-            if (sbp[2] & 0xe0) {
-                if (sbp[2] & 0x80)
+            }
+            if (sdp->filemark || sdp->eom || sdp->ili) {
+                if (sdp->filemark)
                    r += sg_scn3pr(b, blen, r, " FMK");
                             /* current command has read a filemark */
-                if (sbp[2] & 0x40)
+                if (sdp->eom)
                    r += sg_scn3pr(b, blen, r, " EOM");
                             /* end-of-medium condition exists */
-                if (sbp[2] & 0x20)
+                if (sdp->ili)
                    r += sg_scn3pr(b, blen, r, " ILI");
                             /* incorrect block length requested */
                 r += sg_scn3pr(b, blen, r, "\n");
             } else if (valid_info_fld || (info > 0))
                 r += sg_scn3pr(b, blen, r, "\n");
-            if ((len >= 14) && sbp[14])
+            if (sdp->fru)
                 r += sg_scn3pr(b, blen, r, "%s  Field replaceable unit "
-                               "code: %d\n", lip, sbp[14]);
-            if ((len >= 18) && (sbp[15] & 0x80)) {
+                               "code: %d\n", lip, sdp->fru);
+            if (sdp->sks_valid) {
                 /* sense key specific decoding */
-                switch (ssh.sense_key) {
+                switch (sdp->sense_key) {
                 case SPC_SK_ILLEGAL_REQUEST:
                     r += sg_scn3pr(b, blen, r, "%s  Sense Key Specific: "
                                    "Error in %s: byte %d", lip,
-                                   ((sbp[15] & 0x40) ?
+                                   ((sksp[0] & 0x40) ?
                                          "Command" : "Data parameters"),
-                                   sg_get_unaligned_be16(sbp + 16));
-                    if (sbp[15] & 0x08)
+                                   sg_get_unaligned_be16(sksp + 1));
+                    if (sksp[0] & 0x08)
                         r += sg_scn3pr(b, blen, r, " bit %d\n",
-                                       sbp[15] & 0x07);
+                                       sksp[0] & 0x07);
                     else
                         r += sg_scn3pr(b, blen, r, "\n");
                     break;
                 case SPC_SK_NO_SENSE:
                 case SPC_SK_NOT_READY:
-                    progress = sg_get_unaligned_be16(sbp + 16);
-                    pr = (progress * 100) / 65536;
-                    rem = ((progress * 100) % 65536) / 656;
+                    pr = (sdp->progress * 100) / 65536;
+                    rem = ((sdp->progress * 100) % 65536) / 656;
                     r += sg_scn3pr(b, blen, r, "%s  Progress indication: "
                                    "%d.%02d%%\n", lip, pr, rem);
                     break;
@@ -2012,17 +2244,17 @@ sg_get_sense_str(const char * lip, const uint8_t * sbp, int sb_len,
                 case SPC_SK_MEDIUM_ERROR:
                 case SPC_SK_RECOVERED_ERROR:
                     r += sg_scn3pr(b, blen, r, "%s  Actual retry count: "
-                                   "0x%02x%02x\n", lip, sbp[16], sbp[17]);
+                                   "0x%02x%02x\n", lip, sksp[1], sksp[2]);
                     break;
                 case SPC_SK_COPY_ABORTED:
                     r += sg_scn3pr(b, blen, r, "%s  Segment pointer: ", lip);
                     r += sg_scn3pr(b, blen, r, "Relative to start of %s, "
-                                   "byte %d", ((sbp[15] & 0x20) ?
+                                   "byte %d", ((sksp[0] & 0x20) ?
                                      "segment descriptor" : "parameter list"),
-                                   sg_get_unaligned_be16(sbp + 16));
-                    if (sbp[15] & 0x08)
+                                   sg_get_unaligned_be16(sksp + 1));
+                    if (sksp[0] & 0x08)
                         r += sg_scn3pr(b, blen, r, " bit %d\n",
-                                       sbp[15] & 0x07);
+                                       sksp[0] & 0x07);
                     else
                         r += sg_scn3pr(b, blen, r, "\n");
                     break;
@@ -2030,11 +2262,11 @@ sg_get_sense_str(const char * lip, const uint8_t * sbp, int sb_len,
                     r += sg_scn3pr(b, blen, r, "%s  Unit attention "
                                    "condition queue: ", lip);
                     r += sg_scn3pr(b, blen, r, "overflow flag is %d\n",
-                                   !!(sbp[15] & 0x1));
+                                   !!(sksp[0] & 0x1));
                     break;
                 default:
                     r += sg_scn3pr(b, blen, r, "%s  Sense_key: 0x%x "
-                                   "unexpected\n", lip, ssh.sense_key);
+                                   "unexpected\n", lip, sdp->sense_key);
                     break;
                 }
             }
@@ -2042,7 +2274,7 @@ sg_get_sense_str(const char * lip, const uint8_t * sbp, int sb_len,
                 n += sg_scn3pr(cbp, cblen, n, "%s", b);
         } else
             n += sg_scn3pr(cbp, cblen, n, "%s fixed descriptor length "
-                           "too short, len=%d\n", lip, len);
+                           "too short, len=%d\n", lip, sdp->len);
     } else {    /* unable to normalise sense buffer, something irregular */
         if (sb_len < 4) {       /* Too short */
             n += sg_scn3pr(cbp, cblen, n, "%ssense buffer too short (4 "
@@ -2398,36 +2630,35 @@ sg_get_command_name(const uint8_t * cdbp, int peri_type, int buff_len,
 }
 
 struct op_code2sa_t {
-    int op_code;
     int pdt_s;
     const struct sg_lib_value_name_t * arr;
     const char * prefix;
 };
 
-static const struct op_code2sa_t op_code2sa_arr[] = {
-    {SG_VARIABLE_LENGTH_CMD, PDT_ALL, sg_lib_variable_length_arr, NULL},
-    {SG_MAINTENANCE_IN, PDT_ALL, sg_lib_maint_in_arr, NULL},
-    {SG_MAINTENANCE_OUT, PDT_ALL, sg_lib_maint_out_arr, NULL},
-    {SG_SERVICE_ACTION_IN_12, PDT_ALL, sg_lib_serv_in12_arr, NULL},
-    {SG_SERVICE_ACTION_OUT_12, PDT_ALL, sg_lib_serv_out12_arr, NULL},
-    {SG_SERVICE_ACTION_IN_16, PDT_ALL, sg_lib_serv_in16_arr, NULL},
-    {SG_SERVICE_ACTION_OUT_16, PDT_ALL, sg_lib_serv_out16_arr, NULL},
-    {SG_SERVICE_ACTION_BIDI, PDT_ALL, sg_lib_serv_bidi_arr, NULL},
-    {SG_PERSISTENT_RESERVE_IN, PDT_ALL, sg_lib_pr_in_arr,
-     "Persistent reserve in"},
-    {SG_PERSISTENT_RESERVE_OUT, PDT_ALL, sg_lib_pr_out_arr,
-     "Persistent reserve out"},
-    {SG_3PARTY_COPY_OUT, PDT_ALL, sg_lib_xcopy_sa_arr, NULL},
-    {SG_3PARTY_COPY_IN, PDT_ALL, sg_lib_rec_copy_sa_arr, NULL},
-    {SG_READ_BUFFER, PDT_ALL, sg_lib_read_buff_arr, "Read buffer(10)"},
-    {SG_READ_BUFFER_16, PDT_ALL, sg_lib_read_buff_arr, "Read buffer(16)"},
-    {SG_READ_ATTRIBUTE, PDT_ALL, sg_lib_read_attr_arr, "Read attribute"},
-    {SG_READ_POSITION, PDT_TAPE, sg_lib_read_pos_arr, "Read position"},
-    {SG_SANITIZE, PDT_DISK_ZBC, sg_lib_sanitize_sa_arr, "Sanitize"},
-    {SG_WRITE_BUFFER, PDT_ALL, sg_lib_write_buff_arr, "Write buffer"},
-    {SG_ZONING_IN, PDT_DISK_ZBC, sg_lib_zoning_in_arr, NULL},
-    {SG_ZONING_OUT, PDT_DISK_ZBC, sg_lib_zoning_out_arr, NULL},
-    {0xffff, -1, NULL, NULL},
+/* Indexed by opcode; opcodes without service actions have a NULL arr */
+static const struct op_code2sa_t op_code2sa_arr[256] = {
+    [SG_VARIABLE_LENGTH_CMD] = {PDT_ALL, sg_lib_variable_length_arr, NULL},
+    [SG_MAINTENANCE_IN] = {PDT_ALL, sg_lib_maint_in_arr, NULL},
+    [SG_MAINTENANCE_OUT] = {PDT_ALL, sg_lib_maint_out_arr, NULL},
+    [SG_SERVICE_ACTION_IN_12] = {PDT_ALL, sg_lib_serv_in12_arr, NULL},
+    [SG_SERVICE_ACTION_OUT_12] = {PDT_ALL, sg_lib_serv_out12_arr, NULL},
+    [SG_SERVICE_ACTION_IN_16] = {PDT_ALL, sg_lib_serv_in16_arr, NULL},
+    [SG_SERVICE_ACTION_OUT_16] = {PDT_ALL, sg_lib_serv_out16_arr, NULL},
+    [SG_SERVICE_ACTION_BIDI] = {PDT_ALL, sg_lib_serv_bidi_arr, NULL},
+    [SG_PERSISTENT_RESERVE_IN] = {PDT_ALL, sg_lib_pr_in_arr,
+                                  "Persistent reserve in"},
+    [SG_PERSISTENT_RESERVE_OUT] = {PDT_ALL, sg_lib_pr_out_arr,
+                                   "Persistent reserve out"},
+    [SG_3PARTY_COPY_OUT] = {PDT_ALL, sg_lib_xcopy_sa_arr, NULL},
+    [SG_3PARTY_COPY_IN] = {PDT_ALL, sg_lib_rec_copy_sa_arr, NULL},
+    [SG_READ_BUFFER] = {PDT_ALL, sg_lib_read_buff_arr, "Read buffer(10)"},
+    [SG_READ_BUFFER_16] = {PDT_ALL, sg_lib_read_buff_arr, "Read buffer(16)"},
+    [SG_READ_ATTRIBUTE] = {PDT_ALL, sg_lib_read_attr_arr, "Read attribute"},
+    [SG_READ_POSITION] = {PDT_TAPE, sg_lib_read_pos_arr, "Read position"},
+    [SG_SANITIZE] = {PDT_DISK_ZBC, sg_lib_sanitize_sa_arr, "Sanitize"},
+    [SG_WRITE_BUFFER] = {PDT_ALL, sg_lib_write_buff_arr, "Write buffer"},
+    [SG_ZONING_IN] = {PDT_DISK_ZBC, sg_lib_zoning_in_arr, NULL},
+    [SG_ZONING_OUT] = {PDT_DISK_ZBC, sg_lib_zoning_out_arr, NULL},
 };
 
 void
@@ -2436,7 +2667,7 @@ sg_get_opcode_sa_name(uint8_t cmd_byte0, int service_action,
 {
     int d_pdt;
     const struct sg_lib_value_name_t * vnp;
-    const struct op_code2sa_t * osp;
+    const struct op_code2sa_t * osp = op_code2sa_arr + cmd_byte0;
     char b[80];
 
     if ((NULL == buff) || (buff_len < 1))
@@ -2449,27 +2680,20 @@ sg_get_opcode_sa_name(uint8_t cmd_byte0, int service_action,
     if (peri_type < 0)
         peri_type = 0;
     d_pdt = sg_lib_pdt_decay(peri_type);
-    for (osp = op_code2sa_arr; osp->arr; ++osp) {
-        if ((int)cmd_byte0 == osp->op_code) {
-            if (sg_pdt_s_eq(osp->pdt_s, d_pdt)) {
-                vnp = get_value_name(osp->arr, service_action, peri_type);
-                if (vnp) {
-                    if (osp->prefix)
-                        sg_scnpr(buff, buff_len, "%s, %s", osp->prefix,
-                                 vnp->name);
-                    else
-                        sg_scnpr(buff, buff_len, "%s", vnp->name);
-                } else {
-                    sg_get_opcode_name(cmd_byte0, peri_type, sizeof(b), b);
-                    sg_scnpr(buff, buff_len, "%s service action=0x%x", b,
-                             service_action);
-                }
-            } else
-                sg_get_opcode_name(cmd_byte0, peri_type, buff_len, buff);
-            return;
+    if (osp->arr && sg_pdt_s_eq(osp->pdt_s, d_pdt)) {
+        vnp = get_value_name(osp->arr, service_action, peri_type);
+        if (vnp) {
+            if (osp->prefix)
+                sg_scnpr(buff, buff_len, "%s, %s", osp->prefix, vnp->name);
+            else
+                sg_scnpr(buff, buff_len, "%s", vnp->name);
+        } else {
+            sg_get_opcode_name(cmd_byte0, peri_type, sizeof(b), b);
+            sg_scnpr(buff, buff_len, "%s service action=0x%x", b,
+                     service_action);
         }
-    }
-    sg_get_opcode_name(cmd_byte0, peri_type, buff_len, buff);
+    } else
+        sg_get_opcode_name(cmd_byte0, peri_type, buff_len, buff);
 }
 
 void
@@ -2496,7 +2720,7 @@ sg_get_opcode_name(uint8_t cmd_byte0, int peri_type, int buff_len,
     case 2:
     case 4:
     case 5:
-        vnp = get_value_name(sg_lib_normal_opcodes, cmd_byte0, peri_type);
+        vnp = get_opcode_value_name(cmd_byte0, peri_type);
         if (vnp)
             sg_scnpr(buff, buff_len, "%s", vnp->name);
         else
@@ -2913,6 +3137,72 @@ trimTrailingSpaces(char * b)
     return n;
 }
 
+/* Two lower case ASCII hex digits for each byte value, indexed by twice
+ * the byte value. Used by the hex dump functions below which build whole
+ * lines (and many lines) before writing them out. */
+static const char hex_pairs[] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+#define HEX_OUT_BLEN 8192       /* hex dumps buffered this much per write */
+
+static inline void
+put_hex_pair(char * cp, uint8_t c)
+{
+    memcpy(cp, hex_pairs + (2 * c), 2);
+}
+
+/* Formats one line of dStrHexFp() output, holding 'num' (1 to 16) bytes
+ * from 'bp' at address 'addr', into 'lp' (which must have room for 82
+ * chars). Returns the line length including its trailing LF. */
+static int
+dshf_line(const uint8_t * bp, int num, int addr, int no_ascii, char * lp)
+{
+    int j, k, n;
+
+    memset(lp, ' ', 80);
+    if (no_ascii < 0) {
+        for (j = 0; j < num; ++j)
+            put_hex_pair(lp + (3 * j) + ((j < 8) ? 0 : 1), bp[j]);
+        n = (3 * (num - 1)) + ((num > 8) ? 1 : 0) + 2;
+        lp[n++] = '\n';
+        return n;
+    }
+    /* address (at least 2 hex digits) from column 1; bytes overwrite it
+     * when it is 7 or more digits long */
+    for (k = 28; (k > 4) && (0 == ((addr >> k) & 0xf)); k -= 4)
+        ;
+    for (n = 1; k >= 0; k -= 4)
+        lp[n++] = bin2hexascii[(addr >> k) & 0xf];
+    for (j = 0; j < num; ++j) {
+        put_hex_pair(lp + 8 + (3 * j) + ((j < 8) ? 0 : 1), bp[j]);
+        if (0 == no_ascii)
+            lp[60 + j] = my_isprint(bp[j]) ? bp[j] : '.';
+    }
+    if (0 == no_ascii)
+        n = (num < 16) ? (60 + num) : 76;
+    else {
+        for (n = 60 + num; (n > 0) && (' ' == lp[n - 1]); --n)
+            ;
+    }
+    lp[n++] = '\n';
+    return n;
+}
+
 /* Read binary starting at 'str' for 'len' bytes and output as ASCII
  * hexadecinal into file pointer (fp). 16 bytes per line are output with an
  * additional space between 8th and 9th byte on each line (for readability).
@@ -2923,86 +3213,21 @@ trimTrailingSpaces(char * b)
 void
 dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
 {
-    const char * p = str;
-    const char * formatstr;
-    uint8_t c;
-    char buff[82];
-    int a = 0;
-    int bpstart = 5;
-    const int cpstart = 60;
-    int cpos = cpstart;
-    int bpos = bpstart;
-    int i, k, blen;
-
-    if (len <= 0)
-        return;
-    blen = (int)sizeof(buff);
-    if (0 == no_ascii)  /* address at left and ASCII at right */
-        formatstr = "%.76s\n";
-    else                        /* previously when > 0 str was "%.58s\n" */
-        formatstr = "%s\n";     /* when < 0 str was: "%.48s\n" */
-    memset(buff, ' ', 80);
-    buff[80] = '\0';
-    if (no_ascii < 0) {
-        bpstart = 0;
-        bpos = bpstart;
-        for (k = 0; k < len; k++) {
-            c = *p++;
-            if (bpos == (bpstart + (8 * 3)))
-                bpos++;
-            sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-            buff[bpos + 2] = ' ';
-            if ((k > 0) && (0 == ((k + 1) % 16))) {
-                trimTrailingSpaces(buff);
-                fprintf(fp, formatstr, buff);
-                bpos = bpstart;
-                memset(buff, ' ', 80);
-            } else
-                bpos += 3;
-        }
-        if (bpos > bpstart) {
-            buff[bpos + 2] = '\0';
-            trimTrailingSpaces(buff);
-            fprintf(fp, "%s\n", buff);
-        }
-        return;
-    }
-    /* no_ascii>=0, start each line with address (offset) */
-    k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
-    buff[k + 1] = ' ';
-
-    for (i = 0; i < len; i++) {
-        c = *p++;
-        bpos += 3;
-        if (bpos == (bpstart + (9 * 3)))
-            bpos++;
-        sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
-        if (no_ascii)
-            buff[cpos++] = ' ';
-        else {
-            if (! my_isprint(c))
-                c = '.';
-            buff[cpos++] = c;
-        }
-        if (cpos > (cpstart + 15)) {
-            if (no_ascii)
-                trimTrailingSpaces(buff);
-            fprintf(fp, formatstr, buff);
-            bpos = bpstart;
-            cpos = cpstart;
-            a += 16;
-            memset(buff, ' ', 80);
-            k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
-            buff[k + 1] = ' ';
+    const uint8_t * bp = (const uint8_t *)str;
+    int k, num;
+    int n = 0;
+    char b[HEX_OUT_BLEN];
+
+    for (k = 0; k < len; k += 16) {
+        num = ((k + 16) < len) ? 16 : (len - k);
+        n += dshf_line(bp + k, num, k, no_ascii, b + n);
+        if (n > (HEX_OUT_BLEN - 82)) {
+            fwrite(b, 1, n, fp);
+            n = 0;
         }
     }
-    if (cpos > cpstart) {
-        buff[cpos] = '\0';
-        if (no_ascii)
-            trimTrailingSpaces(buff);
-        fprintf(fp, "%s\n", buff);
-    }
+    if (n > 0)
+        fwrite(b, 1, n, fp);
 }
 
 void
@@ -3021,6 +3246,75 @@ dStrHexErr(const char* str, int len, int no_ascii)
 #define DSHS_LINE_BLEN 160      /* maximum characters per line */
 #define DSHS_BPL 16             /* bytes per line */
 
+/* Formats one line of dStrHexStr() output, holding 'num' (1 to DSHS_BPL)
+ * bytes from 'bp', into 'lp' (which must have room for DSHS_LINE_BLEN
+ * chars). The line starts with the first 'bpstart' chars of 'leadin'.
+ * Returns the line length, which includes its trailing LF (or two spaces
+ * when 'oformat' > 1). */
+static int
+dshs_line(const uint8_t * bp, int num, const char * leadin, int bpstart,
+          int oformat, char * lp)
+{
+    int j, n, end;
+
+    if (bpstart > 0)
+        memcpy(lp, leadin, bpstart);
+    for (j = 0, n = bpstart; j < num; ++j) {
+        if ((DSHS_BPL / 2) == j)
+            lp[n++] = ' ';  /* for extra space in middle of each line's hex */
+        put_hex_pair(lp + n, bp[j]);
+        lp[n + 2] = ' ';
+        n += 3;
+    }
+    --n;                        /* no space after the last byte */
+    if (0 == oformat) {
+        /* pad hex to a full line, then 3 spaces, then a printable ASCII
+         * (or '.') column that is always DSHS_BPL chars wide */
+        end = bpstart + (DSHS_BPL * 3) + 1 + 3;
+        memset(lp + n, ' ', end - n);
+        for (j = 0, n = end; j < DSHS_BPL; ++j, ++n)
+            lp[n] = (j < num) ? (my_isprint(bp[j]) ? bp[j] : '.') : ' ';
+        lp[n++] = '\n';
+    } else if (oformat > 1) {
+        lp[n++] = ' ';
+        lp[n++] = ' ';
+    } else
+        lp[n++] = '\n';
+    return n;
+}
+
+/* Appends 'slen' chars from 's' to 'b' at offset 'n', truncating as
+ * sg_scn3pr() does. Returns the number of chars appended. */
+static int
+dshs_append(char * b, int b_len, int n, const char * s, int slen)
+{
+    int rem = b_len - n;
+
+    if (rem < 2)
+        return 0;
+    if (slen > (rem - 1))
+        slen = rem - 1;
+    memcpy(b + n, s, slen);
+    b[n + slen] = '\0';
+    return slen;
+}
+
+/* Returns the number of leadin chars that start each line of dStrHexStr()
+ * output for 'oformat' 0 and 1; leadin is only output once, at the start,
+ * when 'oformat' > 1 */
+static int
+dshs_bpstart(const char * leadin, int oformat)
+{
+    int bpstart;
+
+    if ((NULL == leadin) || (oformat > 1))
+        return 0;
+    bpstart = strlen(leadin);
+    /* Cap leadin at (DSHS_LINE_BLEN - 70) characters */
+    return (bpstart > (DSHS_LINE_BLEN - 70)) ? (DSHS_LINE_BLEN - 70) :
+                                               bpstart;
+}
+
 /* Read 'len' bytes from 'str' and output as ASCII-Hex bytes (space separated)
  * to 'b' not to exceed 'b_len' characters. Each line starts with 'leadin'
  * (NULL for no leadin) and there are 16 bytes per line with an extra space
@@ -3035,13 +3329,9 @@ int
 dStrHexStr(const char * str, int len, const char * leadin, int oformat,
            int b_len, char * b)
 {
-    bool want_ascii = (0 == oformat);
-    int bpstart, bpos, k, n, prior_ascii_len;
-    char buff[DSHS_LINE_BLEN + 2];      /* allow for trailing null */
-    char a[DSHS_BPL + 1];               /* printable ASCII bytes or '.' */
-    const char * p = str;
-    const char * lf_or = (oformat > 1) ? "  " : "\n";
-    static const int bufflen = sizeof(buff);
+    int bpstart, k, n, num;
+    const uint8_t * bp = (const uint8_t *)str;
+    char lb[DSHS_LINE_BLEN];
 
     if (len <= 0) {
         if (b_len > 0)
@@ -3050,63 +3340,19 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
     }
     if (b_len <= 0)
         return 0;
-    if (want_ascii) {
-        memset(a, ' ', DSHS_BPL);
-        a[DSHS_BPL] = '\0';
-    }
+    b[0] = '\0';
     n = 0;
-    bpstart = 0;
-    if (leadin) {
-        if (oformat > 1)
-            n += sg_scn3pr(b, b_len, n, "%s", leadin);
-        else {
-            bpstart = strlen(leadin);
-            /* Cap leadin at (DSHS_LINE_BLEN - 70) characters */
-            if (bpstart > (DSHS_LINE_BLEN - 70))
-                bpstart = DSHS_LINE_BLEN - 70;
-        }
-    }
-    bpos = bpstart;
-    prior_ascii_len = bpstart + (DSHS_BPL * 3) + 1;
-    memset(buff, ' ', DSHS_LINE_BLEN);
-    buff[DSHS_LINE_BLEN] = '\0';
-    if (bpstart > 0)
-        memcpy(buff, leadin, bpstart);
-    for (k = 0; k < len; k++) {
-        uint8_t c = *p++;
-
-        if (bpos == (bpstart + ((DSHS_BPL / 2) * 3)))
-            bpos++;     /* for extra space in middle of each line's hex */
-        sg_scn3pr(buff, bufflen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
-        if (want_ascii)
-            a[k % DSHS_BPL] = my_isprint(c) ? c : '.';
-        if ((k > 0) && (0 == ((k + 1) % DSHS_BPL))) {
-            trimTrailingSpaces(buff);
-            if (want_ascii) {
-                n += sg_scn3pr(b, b_len, n, "%-*s   %s\n", prior_ascii_len,
-                               buff, a);
-                memset(a, ' ', DSHS_BPL);
-            } else
-                n += sg_scn3pr(b, b_len, n, "%s%s", buff, lf_or);
-            if (n >= (b_len - 1))
-                goto fini;
-            memset(buff, ' ', DSHS_LINE_BLEN);
-            bpos = bpstart;
-            if (bpstart > 0)
-                memcpy(buff, leadin, bpstart);
-        } else
-            bpos += 3;
-    }
-    if (bpos > bpstart) {
-        trimTrailingSpaces(buff);
-        if (want_ascii)
-            n += sg_scn3pr(b, b_len, n, "%-*s   %s\n", prior_ascii_len, buff,
-                           a);
-        else
-            n += sg_scn3pr(b, b_len, n, "%s%s", buff, lf_or);
+    bpstart = dshs_bpstart(leadin, oformat);
+    if (leadin && (oformat > 1))
+        n += dshs_append(b, b_len, n, leadin, strlen(leadin));
+    for (k = 0; k < len; k += DSHS_BPL) {
+        num = ((k + DSHS_BPL) < len) ? DSHS_BPL : (len - k);
+        n += dshs_append(b, b_len, n, lb,
+                         dshs_line(bp + k, num, leadin, bpstart, oformat,
+                                   lb));
+        if (n >= (b_len - 1))
+            break;
     }
-fini:
     if (oformat > 1)
         n = trimTrailingSpaces(b);
     return n;
@@ -3131,22 +3377,43 @@ hex2str(const uint8_t * b_str, int len, const char * leadin, int oformat,
     return dStrHexStr((const char *)b_str, len, leadin, oformat, b_len, b);
 }
 
+/* Output is the same as calling hex2str() on each successive 64 bytes and
+ * writing the result to 'fp'. So when 'oformat' > 1 'leadin' starts, and
+ * trailing spaces are trimmed from, each group of 64 bytes. */
 void
 hex2fp(const uint8_t * b_str, int len, const char * leadin, int oformat,
        FILE * fp)
 {
-    int k, num;
-    char b[800];        /* allow for 4 lines of 16 bytes (in hex) each */
+    int k, j, num, bpstart, ld_len;
+    int n = 0;
+    char b[HEX_OUT_BLEN];
 
     if (leadin && (strlen(leadin) > 118)) {
         fprintf(fp, ">>> leadin parameter is too large\n");
         return;
     }
-    for (k = 0; k < len; k += num) {
-        num = ((k + 64) < len) ? 64 : (len - k);
-        hex2str(b_str + k, num, leadin, oformat, sizeof(b), b);
-        fprintf(fp, "%s", b);
+    bpstart = dshs_bpstart(leadin, oformat);
+    ld_len = (leadin && (oformat > 1)) ? (int)strlen(leadin) : 0;
+    for (k = 0; k < len; k += 64) {
+        if (n > (HEX_OUT_BLEN - (4 * DSHS_LINE_BLEN) - 128)) {
+            fwrite(b, 1, n, fp);
+            n = 0;
+        }
+        if (ld_len > 0) {
+            memcpy(b + n, leadin, ld_len);
+            n += ld_len;
+        }
+        for (j = k; (j < (k + 64)) && (j < len); j += DSHS_BPL) {
+            num = ((j + DSHS_BPL) < len) ? DSHS_BPL : (len - j);
+            n += dshs_line(b_str + j, num, leadin, bpstart, oformat, b + n);
+        }
+        if (oformat > 1) {
+            while ((n > 0) && (' ' == b[n - 1]))
+                --n;
+        }
     }
+    if (n > 0)
+        fwrite(b, 1, n, fp);
 }
 
 /* Returns true when executed on big endian machine; else returns false.
@@ -3165,16 +3432,268 @@ sg_is_big_endian()
                                     the most significant byte */
 }
 
+/* Block scanning used by the dd variants: for sparse writes (all zeros)
+ * and to check data written with iflag=00,ff (each 4 byte word holds the
+ * low 32 bits of the block's address, big endian). Both reduce to asking
+ * whether a byte range consists of a repeated 4 byte pattern. There are
+ * scalar, SSE2, AVX2 and NEON versions; the fastest one the CPU supports
+ * is chosen at run time. The pattern 'pat4' is in memory (byte) order. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define SG_LIB_HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__clang__) || (__GNUC__ > 4) || \
+    ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#define SG_LIB_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define SG_LIB_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef bool (*sg_pat4_fn_t)(const uint8_t * bp, int len, uint32_t pat4);
+
+static bool
+pat4_tail(const uint8_t * bp, int off, int len, uint32_t pat4)
+{
+    uint8_t pb[4];
+
+    memcpy(pb, &pat4, 4);
+    for ( ; off < len; ++off) {
+        if (bp[off] != pb[off & 3])
+            return false;
+    }
+    return true;
+}
+
+static bool
+pat4_scalar(const uint8_t * bp, int len, uint32_t pat4)
+{
+    int k;
+    uint64_t pat8, acc, w;
+
+    pat8 = pat4;
+    pat8 = (pat8 << 32) | pat8;        /* same byte order either endian */
+    for (k = 0; (k + 32) <= len; k += 32) {
+        memcpy(&w, bp + k, 8);
+        acc = w ^ pat8;
+        memcpy(&w, bp + k + 8, 8);
+        acc |= w ^ pat8;
+        memcpy(&w, bp + k + 16, 8);
+        acc |= w ^ pat8;
+        memcpy(&w, bp + k + 24, 8);
+        acc |= w ^ pat8;
+        if (acc)
+            return false;
+    }
+    for ( ; (k + 8) <= len; k += 8) {
+        memcpy(&w, bp + k, 8);
+        if (w != pat8)
+            return false;
+    }
+    return pat4_tail(bp, k, len, pat4);
+}
+
+#ifdef SG_LIB_HAVE_SSE2
+static bool
+pat4_sse2(const uint8_t * bp, int len, uint32_t pat4)
+{
+    int k;
+    const __m128i pv = _mm_set1_epi32((int)pat4);
+    const __m128i zv = _mm_setzero_si128();
+    __m128i acc;
+
+    for (k = 0; (k + 64) <= len; k += 64) {
+        acc = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(bp + k)), pv);
+        acc = _mm_or_si128(acc, _mm_xor_si128(
+                _mm_loadu_si128((const __m128i *)(bp + k + 16)), pv));
+        acc = _mm_or_si128(acc, _mm_xor_si128(
+                _mm_loadu_si128((const __m128i *)(bp + k + 32)), pv));
+        acc = _mm_or_si128(acc, _mm_xor_si128(
+                _mm_loadu_si128((const __m128i *)(bp + k + 48)), pv));
+        if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(acc, zv)))
+            return false;
+    }
+    for ( ; (k + 16) <= len; k += 16) {
+        acc = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(bp + k)), pv);
+        if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(acc, zv)))
+            return false;
+    }
+    return pat4_tail(bp, k, len, pat4);
+}
+#endif
+
+#ifdef SG_LIB_HAVE_AVX2
+__attribute__((target("avx2")))
+static bool
+pat4_avx2(const uint8_t * bp, int len, uint32_t pat4)
+{
+    int k;
+    const __m256i pv = _mm256_set1_epi32((int)pat4);
+    __m256i acc;
+
+    for (k = 0; (k + 128) <= len; k += 128) {
+        acc = _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *)(bp + k)), pv);
+        acc = _mm256_or_si256(acc, _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *)(bp + k + 32)), pv));
+        acc = _mm256_or_si256(acc, _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *)(bp + k + 64)), pv));
+        acc = _mm256_or_si256(acc, _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *)(bp + k + 96)), pv));
+        if (! _mm256_testz_si256(acc, acc))
+            return false;
+    }
+    for ( ; (k + 32) <= len; k += 32) {
+        acc = _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *)(bp + k)), pv);
+        if (! _mm256_testz_si256(acc, acc))
+            return false;
+    }
+    return pat4_tail(bp, k, len, pat4);
+}
+#endif
+
+#ifdef SG_LIB_HAVE_NEON
+static bool
+pat4_neon(const uint8_t * bp, int len, uint32_t pat4)
+{
+    int k;
+    const uint8x16_t pv = vreinterpretq_u8_u32(vdupq_n_u32(pat4));
+    uint8x16_t acc;
+
+    for (k = 0; (k + 64) <= len; k += 64) {
+        acc = veorq_u8(vld1q_u8(bp + k), pv);
+        acc = vorrq_u8(acc, veorq_u8(vld1q_u8(bp + k + 16), pv));
+        acc = vorrq_u8(acc, veorq_u8(vld1q_u8(bp + k + 32), pv));
+        acc = vorrq_u8(acc, veorq_u8(vld1q_u8(bp + k + 48), pv));
+        if (vmaxvq_u8(acc))
+            return false;
+    }
+    for ( ; (k + 16) <= len; k += 16) {
+        acc = veorq_u8(vld1q_u8(bp + k), pv);
+        if (vmaxvq_u8(acc))
+            return false;
+    }
+    return pat4_tail(bp, k, len, pat4);
+}
+#endif
+
+static sg_pat4_fn_t sg_pat4_fnp = pat4_scalar; /* chosen on first use */
+#ifdef SG_LIB_HAVE_PTHREAD
+static pthread_once_t sg_pat4_once = PTHREAD_ONCE_INIT;
+#else
+static bool sg_pat4_chosen;     /* without threads there is no race */
+#endif
+
+static void
+choose_pat4_fn(void)
+{
+#ifdef SG_LIB_HAVE_SSE2
+    sg_pat4_fnp = pat4_sse2;
+#ifdef SG_LIB_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        sg_pat4_fnp = pat4_avx2;
+#endif
+#elif defined(SG_LIB_HAVE_NEON)
+    sg_pat4_fnp = pat4_neon;
+#endif
+}
+
+static sg_pat4_fn_t
+get_pat4_fn(void)
+{
+#ifdef SG_LIB_HAVE_PTHREAD
+    pthread_once(&sg_pat4_once, choose_pat4_fn);
+#else
+    if (! sg_pat4_chosen) {
+        choose_pat4_fn();
+        sg_pat4_chosen = true;
+    }
+#endif
+    return sg_pat4_fnp;
+}
+
+const char *
+sg_blk_scan_impl_str(void)
+{
+    sg_pat4_fn_t fnp = get_pat4_fn();
+
+#ifdef SG_LIB_HAVE_AVX2
+    if (pat4_avx2 == fnp)
+        return "avx2";
+#endif
+#ifdef SG_LIB_HAVE_SSE2
+    if (pat4_sse2 == fnp)
+        return "sse2";
+#endif
+#ifdef SG_LIB_HAVE_NEON
+    if (pat4_neon == fnp)
+        return "neon";
+#endif
+    return (pat4_scalar == fnp) ? "scalar" : "unknown";
+}
+
+int
+sg_blks_zero_bitmap(const uint8_t * bp, int blk_sz, int num_blks,
+                    uint8_t * bitmap)
+{
+    int k, num = 0;
+    sg_pat4_fn_t fnp;
+
+    if ((NULL == bp) || (blk_sz <= 0) || (num_blks <= 0))
+        return 0;
+    fnp = get_pat4_fn();
+    if (bitmap)
+        memset(bitmap, 0, (num_blks + 7) / 8);
+    for (k = 0; k < num_blks; ++k, bp += blk_sz) {
+        if (fnp(bp, blk_sz, 0)) {
+            ++num;
+            if (bitmap)
+                bitmap[k / 8] |= (1 << (k % 8));
+        }
+    }
+    return num;
+}
+
+int
+sg_blks_addr_bitmap(const uint8_t * bp, int blk_sz, int num_blks,
+                    uint32_t first_addr, bool first_only, uint8_t * bitmap)
+{
+    int k, len;
+    int num = 0;
+    uint32_t pat4;
+    uint32_t addr = first_addr;
+    uint8_t pb[4];
+    sg_pat4_fn_t fnp;
+
+    if ((NULL == bp) || (blk_sz < 4) || (num_blks <= 0))
+        return 0;
+    fnp = get_pat4_fn();
+    len = first_only ? 4 : (blk_sz & ~3);
+    if (bitmap)
+        memset(bitmap, 0, (num_blks + 7) / 8);
+    for (k = 0; k < num_blks; ++k, ++addr, bp += blk_sz) {
+        sg_put_unaligned_be32(addr, pb);
+        memcpy(&pat4, pb, 4);
+        if (fnp(bp, len, pat4)) {
+            ++num;
+            if (bitmap)
+                bitmap[k / 8] |= (1 << (k % 8));
+        }
+    }
+    return num;
+}
+
 bool
 sg_all_zeros(const uint8_t * bp, int b_len)
 {
     if ((NULL == bp) || (b_len <= 0))
         return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0x0 != bp[b_len])
-            return false;
-    }
-    return true;
+    return get_pat4_fn()(bp, b_len, 0);
 }
 
 bool
@@ -3182,11 +3701,7 @@ sg_all_ffs(const uint8_t * bp, int b_len)
 {
     if ((NULL == bp) || (b_len <= 0))
         return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0xff != bp[b_len])
-            return false;
-    }
-    return true;
+    return get_pat4_fn()(bp, b_len, 0xffffffff);
 }
 
 /* If its all printable then return value equals b_len */
@@ -3656,7 +4171,403 @@ sg_get_llnum_nomult(const char * buf)
     return (1 == res) ? num : -1;
 }
 
-#define MAX_NUM_ASCII_LINES 1048576
+/* Chunked decoding of ASCII hex or binary input. A regular file is mapped
+ * into memory (when mmap() is available) and decoded in place; stdin, pipes
+ * and other files are read through a window of HEX_STRM_WIN_LEN bytes.
+ * ASCII hex is decoded by a byte state machine (with fast paths for the
+ * common layouts) so neither the input nor its lines have a length limit
+ * and the decoded bytes can be delivered in chunks of any size. */
+
+#define HEX_STRM_WIN_LEN (64 * 1024)
+
+/* Classes of input characters: 0 to 15 are hex digits (their value) */
+#define HXC_SEP 0x10    /* space, tab, comma or hyphen */
+#define HXC_EOL 0x20    /* newline */
+#define HXC_CMT 0x40    /* '#' or carriage return, ignore rest of line */
+#define HXC_BAD 0x80
+
+static const uint8_t hex_cls[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x0 */
+    0x80, 0x10, 0x20, 0x80, 0x80, 0x40, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x10 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x10, 0x80, 0x80, 0x40, 0x80, 0x80, 0x80, 0x80,     /* 0x20 */
+    0x80, 0x80, 0x80, 0x80, 0x10, 0x10, 0x80, 0x80,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,     /* 0x30 */
+    0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80,     /* 0x40 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x50 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80,     /* 0x60 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x70 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x80 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0x90 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xa0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xb0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xc0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xd0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xe0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,     /* 0xf0 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+struct sg_hex_strm {
+    bool as_binary;
+    bool no_space;
+    bool skip_first;
+    bool eof;           /* nothing more to read() from fd */
+    bool in_cmt;        /* skipping to end of line */
+    bool in_num;        /* within a (space separated) hex number */
+    bool have_nib;      /* no_space: holding high nibble of next byte */
+    uint8_t nib;
+    int fd;             /* -1 when closed or mapped */
+    bool own_fd;        /* fd should be closed by sg_hex_strm_close() */
+    int line;           /* line number (origin 1) of next character */
+    int num_on_line;    /* hex numbers seen so far on this line */
+    unsigned int num;   /* value of hex number being decoded */
+    const uint8_t * in_bp;      /* mapped file or win */
+    size_t in_len;
+    size_t in_off;      /* offset of next character in in_bp */
+    size_t map_len;     /* > 0 when in_bp is mmap()-ed */
+    uint64_t in_base;   /* input offset of in_bp[0] */
+    uint64_t line_start;        /* input offset of start of line */
+    uint8_t * win;
+};
+
+#ifdef SG_LIB_HAVE_SSE2
+
+/* Converts 16 ASCII hex digits at sp to 8 bytes at dp. Returns false
+ * (without writing to dp) if any of the characters is not a hex digit. */
+static inline bool
+hex16_to_bytes_sse2(const uint8_t * sp, uint8_t * dp)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)sp);
+    __m128i lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i dig = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i alp = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+    __m128i nib, w;
+
+    if (0xffff != _mm_movemask_epi8(_mm_or_si128(dig, alp)))
+        return false;
+    nib = _mm_or_si128(_mm_and_si128(dig, _mm_sub_epi8(v,
+                                                _mm_set1_epi8('0'))),
+                       _mm_andnot_si128(dig, _mm_sub_epi8(lc,
+                                                _mm_set1_epi8('a' - 10))));
+    /* each 16 bit lane: high nibble in low byte, low nibble in high byte */
+    w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib,
+                                                  _mm_set1_epi16(0xff)), 4),
+                     _mm_srli_epi16(nib, 8));
+    _mm_storel_epi64((__m128i *)dp, _mm_packus_epi16(w, w));
+    return true;
+}
+
+#endif
+
+static int
+hex_strm_syntax_err(struct sg_hex_strm * hsp, const uint8_t * p,
+                    const char * what)
+{
+    uint64_t pos = hsp->in_base + (p - hsp->in_bp);
+
+    pr2ws("sg_hex_strm_read: %s at line %d, pos %d\n", what, hsp->line,
+          (int)(pos - hsp->line_start + 1));
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+/* Decodes ASCII hex from in_bp[in_off] to in_bp[in_len] into up to max_len
+ * bytes at dp. Writes number decoded to *np. Returns 0 or
+ * SG_LIB_SYNTAX_ERROR . */
+static int
+hex_strm_decode(struct sg_hex_strm * hsp, uint8_t * dp, int max_len, int * np)
+{
+    int k = 0;
+    int ret = 0;
+    uint8_t cl, a, b;
+    const uint8_t * p = hsp->in_bp + hsp->in_off;
+    const uint8_t * q;
+    const uint8_t * endp = hsp->in_bp + hsp->in_len;
+
+    while ((k < max_len) && (p < endp)) {
+        if (hsp->in_cmt) {
+            q = (const uint8_t *)memchr(p, '\n', endp - p);
+            if (NULL == q) {
+                p = endp;
+                break;
+            }
+            p = q;
+            hsp->in_cmt = false;
+        }
+        cl = hex_cls[*p];
+        if (cl < 16) {
+            if (hsp->no_space) {
+                if (hsp->have_nib) {
+                    dp[k++] = (hsp->nib << 4) | cl;
+                    hsp->have_nib = false;
+                    ++p;
+                    continue;
+                }
+                q = p;
+#ifdef SG_LIB_HAVE_SSE2
+                while (((endp - p) >= 16) && ((max_len - k) >= 8) &&
+                       hex16_to_bytes_sse2(p, dp + k)) {
+                    p += 16;
+                    k += 8;
+                }
+#endif
+                for ( ; ((endp - p) >= 2) && (k < max_len); p += 2) {
+                    a = hex_cls[p[0]];
+                    b = hex_cls[p[1]];
+                    if ((a | b) >= 16)
+                        break;
+                    dp[k++] = (a << 4) | b;
+                }
+                if (p == q) {   /* lone digit, maybe end of window */
+                    hsp->nib = cl;
+                    hsp->have_nib = true;
+                    ++p;
+                }
+                continue;
+            }
+            if ((! hsp->in_num) &&
+                ((hsp->num_on_line > 0) || (! hsp->skip_first))) {
+                /* fast path for "hh hh hh ..." */
+                q = p;
+                for ( ; ((endp - p) >= 3) && (k < max_len); p += 3) {
+                    a = hex_cls[p[0]];
+                    b = hex_cls[p[1]];
+                    if (((a | b) >= 16) || (HXC_SEP != hex_cls[p[2]]))
+                        break;
+                    dp[k++] = (a << 4) | b;
+                }
+                if (p > q) {
+                    hsp->num_on_line += (p - q) / 3;
+                    continue;
+                }
+            }
+            /* a skipped value (e.g. an address) may exceed 0xff */
+            if (hsp->skip_first && (0 == hsp->num_on_line))
+                ;
+            else if ((hsp->num = (hsp->num << 4) | cl) > 0xff) {
+                ret = hex_strm_syntax_err(hsp, p, "hex number larger than "
+                                          "0xff");
+                break;
+            }
+            hsp->in_num = true;
+            ++p;
+            continue;
+        }
+        if (hsp->in_num) {      /* non-digit ends a hex number */
+            if ((0 == hsp->num_on_line) && hsp->skip_first)
+                ;
+            else
+                dp[k++] = (uint8_t)hsp->num;
+            ++hsp->num_on_line;
+            hsp->in_num = false;
+            hsp->num = 0;
+            continue;
+        }
+        if (HXC_SEP == cl)
+            ++p;
+        else if (HXC_EOL == cl) {
+            ++p;
+            ++hsp->line;
+            hsp->num_on_line = 0;
+            hsp->line_start = hsp->in_base + (p - hsp->in_bp);
+        } else if (HXC_CMT == cl) {
+            hsp->in_cmt = true;
+            ++p;
+        } else {
+            ret = hex_strm_syntax_err(hsp, p, "syntax error");
+            break;
+        }
+    }
+    hsp->in_off = p - hsp->in_bp;
+    *np = k;
+    return ret;
+}
+
+/* Reads next window of input. Returns 0 or error code. */
+static int
+hex_strm_fill(struct sg_hex_strm * hsp)
+{
+    int err;
+    ssize_t n;
+
+    do {
+        n = read(hsp->fd, hsp->win, HEX_STRM_WIN_LEN);
+    } while ((n < 0) && (EINTR == errno));
+    if (n < 0) {
+        err = errno;
+        pr2ws("%s: read failed: %s\n", __func__, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    hsp->in_base += hsp->in_len;
+    hsp->in_bp = hsp->win;
+    hsp->in_len = n;
+    hsp->in_off = 0;
+    if (0 == n)
+        hsp->eof = true;
+    return 0;
+}
+
+int
+sg_hex_strm_open(const char * fname, bool as_binary, bool no_space,
+                 bool skip_first, struct sg_hex_strm ** hspp)
+{
+    int fd, err;
+    struct sg_hex_strm * hsp;
+    struct stat a_stat;
+
+    if ((NULL == fname) || (NULL == hspp)) {
+        pr2ws("%s: bad arguments\n", __func__);
+        return SG_LIB_LOGIC_ERROR;
+    }
+    *hspp = NULL;
+    if ('\0' == fname[0])
+        return SG_LIB_SYNTAX_ERROR;
+    if (0 == strcmp(fname, "-"))       /* read from stdin */
+        fd = STDIN_FILENO;
+    else {
+        fd = open(fname, O_RDONLY);
+        if (fd < 0) {
+            err = errno;
+            pr2ws("Unable to open %s for reading: %s\n", fname,
+                  safe_strerror(err));
+            return sg_convert_errno(err);
+        }
+    }
+    hsp = (struct sg_hex_strm *)calloc(1, sizeof(*hsp));
+    if (NULL == hsp) {
+        if (STDIN_FILENO != fd)
+            close(fd);
+        return sg_convert_errno(ENOMEM);
+    }
+    hsp->as_binary = as_binary;
+    hsp->no_space = no_space;
+    hsp->skip_first = skip_first && (! as_binary) && (! no_space);
+    hsp->fd = fd;
+    hsp->own_fd = (STDIN_FILENO != fd);
+    hsp->line = 1;
+    if (hsp->own_fd && (0 == fstat(fd, &a_stat)) &&
+        S_ISREG(a_stat.st_mode)) {
+        if (0 == a_stat.st_size) {
+            hsp->eof = true;
+            goto fini;
+        }
+#ifdef HAVE_MMAP
+        if ((uint64_t)a_stat.st_size <= (size_t)-1) {
+            void * vp = mmap(NULL, a_stat.st_size, PROT_READ, MAP_PRIVATE,
+                             fd, 0);
+
+            if (MAP_FAILED != vp) {
+#ifdef POSIX_MADV_SEQUENTIAL
+                posix_madvise(vp, a_stat.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+                hsp->in_bp = (const uint8_t *)vp;
+                hsp->in_len = a_stat.st_size;
+                hsp->map_len = a_stat.st_size;
+                hsp->eof = true;
+                close(fd);
+                hsp->fd = -1;
+                goto fini;
+            }
+        }
+#endif
+    }
+    if (as_binary)      /* read() straight into caller's buffer */
+        goto fini;
+    hsp->win = (uint8_t *)malloc(HEX_STRM_WIN_LEN);
+    if (NULL == hsp->win) {
+        sg_hex_strm_close(hsp);
+        return sg_convert_errno(ENOMEM);
+    }
+fini:
+    *hspp = hsp;
+    return 0;
+}
+
+int
+sg_hex_strm_read(struct sg_hex_strm * hsp, uint8_t * bp, int max_len,
+                 int * lenp)
+{
+    int k, n, ret;
+    ssize_t r;
+
+    if ((NULL == hsp) || (NULL == bp) || (NULL == lenp) || (max_len < 0)) {
+        pr2ws("%s: bad arguments\n", __func__);
+        return SG_LIB_LOGIC_ERROR;
+    }
+    for (k = 0, ret = 0; k < max_len; k += n) {
+        if (hsp->in_off >= hsp->in_len) {
+            if (hsp->eof)
+                break;
+            if (hsp->as_binary) {       /* bypass window */
+                do {
+                    r = read(hsp->fd, bp + k, max_len - k);
+                } while ((r < 0) && (EINTR == errno));
+                if (r < 0) {
+                    ret = sg_convert_errno(errno);
+                    pr2ws("%s: read failed: %s\n", __func__,
+                          safe_strerror(errno));
+                    break;
+                }
+                if (0 == r)
+                    hsp->eof = true;
+                n = r;
+                continue;
+            }
+            if ((ret = hex_strm_fill(hsp)))
+                break;
+            n = 0;
+            continue;
+        }
+        if (hsp->as_binary) {
+            n = hsp->in_len - hsp->in_off;
+            if (n > (max_len - k))
+                n = max_len - k;
+            memcpy(bp + k, hsp->in_bp + hsp->in_off, n);
+            hsp->in_off += n;
+        } else if ((ret = hex_strm_decode(hsp, bp + k, max_len - k, &n))) {
+            k += n;
+            break;
+        }
+    }
+    if ((0 == ret) && (k < max_len) && hsp->in_num) {
+        /* hex number at end of input without trailing newline */
+        if ((hsp->num_on_line > 0) || (! hsp->skip_first))
+            bp[k++] = (uint8_t)hsp->num;
+        hsp->in_num = false;
+    }
+    *lenp = k;
+    return ret;
+}
+
+void
+sg_hex_strm_close(struct sg_hex_strm * hsp)
+{
+    if (NULL == hsp)
+        return;
+#ifdef HAVE_MMAP
+    if (hsp->map_len > 0)
+        munmap((void *)hsp->in_bp, hsp->map_len);
+#endif
+    if (hsp->own_fd && (hsp->fd >= 0))
+        close(hsp->fd);
+    free(hsp->win);
+    free(hsp);
+}
 
 /* Read ASCII hex bytes or binary from fname (a file named '-' taken as
  * stdin). If reading ASCII hex then there should be either one entry per
@@ -3675,17 +4586,11 @@ int
 sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
              uint8_t * mp_arr, int * mp_arr_len, int max_arr_len_and)
 {
-    bool has_stdin, split_line, skip_first, redo_first;
-    int fn_len, in_len, k, m, fd, err, max_arr_len;
-    int j = 0;
-    int off = 0;
+    bool skip_first;
+    int k, m, max_arr_len;
     int ret = 0;
-    unsigned int h;
-    const char * lcp;
-    FILE * fp = NULL;
-    struct stat a_stat;
-    char line[512];
-    char carry_over[4];
+    uint8_t extra;
+    struct sg_hex_strm * hsp = NULL;
 
     if ((NULL == fname) || (NULL == mp_arr) || (NULL == mp_arr_len)) {
         pr2ws("%s: bad arguments\n", __func__);
@@ -3698,203 +4603,28 @@ sg_f2hex_arr(const char * fname, bool as_binary, bool no_space,
         skip_first = false;
         max_arr_len = max_arr_len_and;
     }
-    fn_len = strlen(fname);
-    if (0 == fn_len)
-        return SG_LIB_SYNTAX_ERROR;
-    has_stdin = ((1 == fn_len) && ('-' == fname[0]));   /* read from stdin */
-    if (as_binary) {
-        if (has_stdin)
-            fd = STDIN_FILENO;
-        else {
-            fd = open(fname, O_RDONLY);
-            if (fd < 0) {
-                err = errno;
-                pr2ws("unable to open binary file %s: %s\n", fname,
-                         safe_strerror(err));
-                return sg_convert_errno(err);
-            }
-        }
-        k = read(fd, mp_arr, max_arr_len);
-        if (k <= 0) {
-            if (0 == k) {
-                ret = SG_LIB_FILE_ERROR;
-                pr2ws("read 0 bytes from binary file %s\n", fname);
-            } else {
-                ret = sg_convert_errno(errno);
-                pr2ws("read from binary file %s: %s\n", fname,
-                        safe_strerror(errno));
-            }
-        } else if ((k < max_arr_len) && (0 == fstat(fd, &a_stat)) &&
-                   S_ISFIFO(a_stat.st_mode)) {
-            /* pipe; keep reading till error or 0 read */
-            while (k < max_arr_len) {
-                m = read(fd, mp_arr + k, max_arr_len - k);
-                if (0 == m)
-                   break;
-                if (m < 0) {
-                    err = errno;
-                    pr2ws("read from binary pipe %s: %s\n", fname,
-                            safe_strerror(err));
-                    ret = sg_convert_errno(err);
-                    break;
-                }
-                k += m;
-            }
-        }
-        if (k >= 0)
-            *mp_arr_len = k;
-        if ((fd >= 0) && (! has_stdin))
-            close(fd);
+    ret = sg_hex_strm_open(fname, as_binary, no_space, skip_first, &hsp);
+    if (ret)
         return ret;
-    }
-
-    /* So read the file as ASCII hex */
-    if (has_stdin)
-        fp = stdin;
-    else {
-        fp = fopen(fname, "r");
-        if (NULL == fp) {
-            err = errno;
-            pr2ws("Unable to open %s for reading: %s\n", fname,
-                    safe_strerror(err));
-            ret = sg_convert_errno(err);
-            goto fini;
-        }
-    }
-
-    carry_over[0] = 0;
-    for (j = 0; j < MAX_NUM_ASCII_LINES; ++j) {
-        if (NULL == fgets(line, sizeof(line), fp))
-            break;
-        in_len = strlen(line);
-        if (in_len > 0) {
-            if ('\n' == line[in_len - 1]) {
-                --in_len;
-                line[in_len] = '\0';
-                split_line = false;
-            } else
-                split_line = true;
-        }
-        if (in_len < 1) {
-            carry_over[0] = 0;
-            continue;
-        }
-        if (carry_over[0]) {
-            if (isxdigit(line[0])) {
-                carry_over[1] = line[0];
-                carry_over[2] = '\0';
-                if (1 == sscanf(carry_over, "%4x", &h)) {
-                    if (off > 0) {
-                        if (off > max_arr_len)
-                            goto fini_exceed;
-                        else
-                            mp_arr[off - 1] = h; /* back up and overwrite */
-                    }
-                } else {
-                    pr2ws("%s: carry_over error ['%s'] around line %d\n",
-                            __func__, carry_over, j + 1);
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-                lcp = line + 1;
-                --in_len;
-            } else
-                lcp = line;
-            carry_over[0] = 0;
-        } else
-            lcp = line;
-
-        m = strspn(lcp, " \t");
-        if (m == in_len)
-            continue;
-        lcp += m;
-        in_len -= m;
-        if ('#' == *lcp)
-            continue;
-        k = strspn(lcp, "0123456789aAbBcCdDeEfF ,-\t");
-        if ((k < in_len) && ('#' != lcp[k]) && ('\r' != lcp[k])) {
-            pr2ws("%s: syntax error at line %d, pos %d\n", __func__,
-                    j + 1, m + k + 1);
-            ret = SG_LIB_SYNTAX_ERROR;
-            goto fini;
+    ret = sg_hex_strm_read(hsp, mp_arr, max_arr_len, &k);
+    if (ret)
+        goto fini;
+    if (as_binary) {
+        if (0 == k) {
+            pr2ws("read 0 bytes from binary file %s\n", fname);
+            ret = SG_LIB_FILE_ERROR;
         }
-        if (no_space) {
-            for (k = 0; isxdigit(*lcp) && isxdigit(*(lcp + 1));
-                 ++k, lcp += 2) {
-                if (1 != sscanf(lcp, "%2x", &h)) {
-                    pr2ws("%s: bad hex number in line %d, pos %d\n",
-                            __func__, j + 1, (int)(lcp - line + 1));
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-                if ((off + k) >= max_arr_len)
-                    goto fini_exceed;
-                else
-                    mp_arr[off + k] = h;
-            }
-            if (isxdigit(*lcp) && (! isxdigit(*(lcp + 1))))
-                carry_over[0] = *lcp;
-            off += k;
-        } else {        /* (white)space separated ASCII hexadecimal bytes */
-            for (redo_first = false, k = 0; k < 1024;
-                 k = (redo_first ? k : k + 1)) {
-                if (1 == sscanf(lcp, "%10x", &h)) {
-                    if (h > 0xff) {
-                        pr2ws("%s: hex number larger than 0xff in line "
-                                "%d, pos %d\n", __func__, j + 1,
-                                (int)(lcp - line + 1));
-                        ret = SG_LIB_SYNTAX_ERROR;
-                        goto fini;
-                    }
-                    if (split_line && (1 == strlen(lcp))) {
-                        /* single trailing hex digit might be a split pair */
-                        carry_over[0] = *lcp;
-                    }
-                    if ((off + k) >= max_arr_len)
-                        goto fini_exceed;
-                    else if ((0 == k) && skip_first && (! redo_first))
-                        redo_first = true;
-                    else {
-                        redo_first = false;
-                        mp_arr[off + k] = h;
-                    }
-                    lcp = strpbrk(lcp, " ,-\t");
-                    if (NULL == lcp)
-                        break;
-                    lcp += strspn(lcp, " ,-\t");
-                    if ('\0' == *lcp)
-                        break;
-                } else {
-                    if (('#' == *lcp) || ('\r' == *lcp)) {
-                        --k;
-                        break;
-                    }
-                    pr2ws("%s: error in line %d, at pos %d\n", __func__,
-                            j + 1, (int)(lcp - line + 1));
-                    ret = SG_LIB_SYNTAX_ERROR;
-                    goto fini;
-                }
-            }
-            off += (k + 1);
+    } else if (k >= max_arr_len) {
+        /* is there more? */
+        if ((0 == sg_hex_strm_read(hsp, &extra, 1, &m)) && (m > 0)) {
+            pr2ws("%s: array length [%d] exceeded on line %d of input\n",
+                  __func__, max_arr_len, hsp->line);
+            ret = SG_LIB_LBA_OUT_OF_RANGE;
         }
-    }           /* end of per line loop */
-    if (j >= MAX_NUM_ASCII_LINES) {
-        pr2ws("%s: wow, more than %d lines of ASCII, give up\n", __func__,
-              SG_LIB_LBA_OUT_OF_RANGE);
-        return SG_LIB_LBA_OUT_OF_RANGE;
     }
-    *mp_arr_len = off;
-    if (fp && (! has_stdin))
-        fclose(fp);
-    return 0;
-fini_exceed:
-    pr2ws("%s: array length [%d] exceeded on line %d of input\n", __func__,
-          max_arr_len, j + 1);
-    ret = SG_LIB_LBA_OUT_OF_RANGE;
-    *mp_arr_len = max_arr_len;
+    *mp_arr_len = k;
 fini:
-    if (fp && (! has_stdin))
-        fclose(fp);
+    sg_hex_strm_close(hsp);
     return ret;
 }
 
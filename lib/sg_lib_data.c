@@ -636,6 +636,263 @@ const struct sg_lib_value_name_t sg_lib_read_attr_arr[] = {
     {0xffff, 0, NULL},
 };
 
+/* Direct index into sg_lib_normal_opcodes[] by peripheral device type (PDT)
+ * class then opcode: for PDT p, opcode n names
+ * sg_lib_normal_opcodes[sg_lib_normal_opcodes_idx[c][n] - 1] where c is
+ * sg_lib_normal_opcodes_pdt_class[p]; a zero entry means there is no name.
+ * PDTs that map every opcode to the same entry share a class. Both are
+ * generated (and checked) by 'tst_sg_lib --opcode=gen' in the testing
+ * directory; regenerate them after changing sg_lib_normal_opcodes[]. */
+const uint8_t sg_lib_normal_opcodes_pdt_class[32] =
+{
+    0, 1, 2, 3, 0, 4, 0, 0,
+    5, 0, 0, 0, 0, 0, 0, 6,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+
+const uint16_t sg_lib_normal_opcodes_idx[7][256] =
+{
+    {   /* class 0: disk */
+        /* 0x00 */ 1, 2, 0, 4, 5, 8, 0, 9,
+        /* 0x08 */ 11, 0, 13, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 1: tape */
+        /* 0x00 */ 1, 2, 0, 4, 6, 8, 0, 9,
+        /* 0x08 */ 11, 0, 13, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 110, 112, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 131, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 2: printer */
+        /* 0x00 */ 1, 2, 0, 4, 7, 8, 0, 9,
+        /* 0x08 */ 11, 0, 14, 16, 0, 0, 0, 19,
+        /* 0x10 */ 21, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 3: processor */
+        /* 0x00 */ 1, 2, 0, 4, 5, 8, 0, 9,
+        /* 0x08 */ 12, 0, 15, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 4: cd/dvd */
+        /* 0x00 */ 1, 2, 0, 4, 5, 8, 0, 9,
+        /* 0x08 */ 11, 0, 13, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 77, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 91, 93, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 153, 155,
+        /* 0xa8 */ 156, 157, 158, 159, 161, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 174, 175,
+        /* 0xb8 */ 176, 177, 178, 180, 182, 183, 185, 187,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 5: medium changer */
+        /* 0x00 */ 1, 2, 0, 4, 5, 8, 0, 10,
+        /* 0x08 */ 11, 0, 13, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 63,
+        /* 0x38 */ 65, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 167, 168, 169, 170, 171, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {   /* class 6: optical card reader/writer device */
+        /* 0x00 */ 1, 2, 0, 4, 5, 8, 0, 9,
+        /* 0x08 */ 11, 0, 13, 16, 0, 0, 0, 19,
+        /* 0x10 */ 20, 22, 23, 24, 25, 26, 27, 29,
+        /* 0x18 */ 31, 32, 33, 34, 38, 39, 40, 0,
+        /* 0x20 */ 0, 0, 0, 41, 42, 43, 0, 0,
+        /* 0x28 */ 45, 46, 47, 48, 51, 52, 53, 54,
+        /* 0x30 */ 55, 56, 57, 58, 59, 61, 62, 64,
+        /* 0x38 */ 66, 67, 68, 69, 70, 71, 72, 73,
+        /* 0x40 */ 74, 75, 76, 78, 79, 80, 81, 82,
+        /* 0x48 */ 83, 0, 84, 85, 86, 87, 88, 0,
+        /* 0x50 */ 89, 90, 92, 94, 95, 96, 97, 99,
+        /* 0x58 */ 101, 0, 102, 103, 104, 105, 106, 107,
+        /* 0x60 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x70 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0x78 */ 0, 0, 0, 0, 0, 0, 108, 0,
+        /* 0x80 */ 109, 111, 113, 114, 115, 116, 117, 118,
+        /* 0x88 */ 119, 120, 121, 122, 123, 124, 125, 126,
+        /* 0x90 */ 127, 128, 130, 132, 134, 135, 0, 0,
+        /* 0x98 */ 0, 0, 136, 137, 138, 139, 140, 141,
+        /* 0xa0 */ 142, 143, 145, 146, 148, 150, 152, 154,
+        /* 0xa8 */ 156, 157, 158, 159, 160, 162, 163, 164,
+        /* 0xb0 */ 165, 166, 168, 169, 170, 172, 173, 175,
+        /* 0xb8 */ 176, 177, 179, 180, 182, 183, 186, 188,
+        /* 0xc0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xc8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xd8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xe8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf0 */ 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 0xf8 */ 0, 0, 0, 0, 0, 0, 0, 0
+    }
+};
+
 #else   /* SG_SCSI_STRINGS */
 
 const struct sg_lib_value_name_t sg_lib_normal_opcodes[] = {
@@ -724,6 +981,10 @@ const char * const sg_lib_tapealert_strs[] = {
     NULL,
 };
 
+const uint8_t sg_lib_normal_opcodes_pdt_class[32] = {0};
+
+const uint16_t sg_lib_normal_opcodes_idx[1][256] = {{0}};
+
 #endif  /* SG_SCSI_STRINGS */
 
 /* A conveniently formatted list of SCSI ASC/ASCQ codes and their
@@ -1068,14 +1329,14 @@ const struct sg_lib_asc_ascq_t sg_lib_asc_ascq[] =
     {0x2A,0x07,"Implicit asymmetric access state transition failed"},
     {0x2A,0x08,"Priority changed"},
     {0x2A,0x09,"Capacity data has changed"},
+    {0x2A,0x0a,"Error history i_t nexus cleared"},
+    {0x2A,0x0b,"Error history snapshot released"},
     {0x2A,0x0c, "Error recovery attributes have changed"},
     {0x2A,0x0d, "Data encryption capabilities changed"},
     {0x2A,0x10,"Timestamp changed"},
     {0x2A,0x11,"Data encryption parameters changed by another i_t nexus"},
     {0x2A,0x12,"Data encryption parameters changed by vendor specific event"},
     {0x2A,0x13,"Data encryption key instance counter has changed"},
-    {0x2A,0x0a,"Error history i_t nexus cleared"},
-    {0x2A,0x0b,"Error history snapshot released"},
     {0x2A,0x14,"SA creation capabilities data has changed"},
     {0x2A,0x15,"Medium removal prevention preempted"},
     {0x2A,0x16,"Zone reset write pointer recommended"},
@@ -1538,6 +1799,58 @@ const struct sg_lib_asc_ascq_t sg_lib_asc_ascq[] =
     {0, 0, NULL}
 };
 
+/* Dense index into sg_lib_asc_ascq[] (which must be sorted by ASC then
+ * ASCQ): the entries with ASC n are sg_lib_asc_ascq[sg_lib_asc_ascq_idx[n]]
+ * up to, but not including, sg_lib_asc_ascq[sg_lib_asc_ascq_idx[n + 1]].
+ * Bit n of sg_lib_asc_ascq_range_map[] is set when ASC n has an entry in
+ * sg_lib_asc_ascq_range[]. Both are generated (and checked) by
+ * 'tst_sg_lib --asc=gen' in the testing directory; regenerate them after
+ * changing either table. */
+const uint16_t sg_lib_asc_ascq_idx[257] =
+{
+    /* 0x00 */ 0, 27, 28, 29, 32, 69, 70, 71,
+    /* 0x08 */ 72, 77, 83, 84, 105, 124, 130, 134,
+    /* 0x10 */ 134, 140, 162, 163, 164, 172, 175, 180,
+    /* 0x18 */ 190, 199, 203, 204, 205, 208, 210, 211,
+    /* 0x20 */ 212, 228, 238, 239, 250, 260, 261, 284,
+    /* 0x28 */ 293, 297, 305, 326, 327, 347, 348, 352,
+    /* 0x30 */ 356, 374, 380, 382, 383, 384, 390, 391,
+    /* 0x38 */ 392, 398, 399, 404, 433, 433, 434, 439,
+    /* 0x40 */ 466, 467, 468, 469, 470, 473, 474, 475,
+    /* 0x48 */ 483, 484, 485, 486, 508, 509, 509, 510,
+    /* 0x50 */ 510, 513, 515, 516, 530, 531, 549, 549,
+    /* 0x58 */ 550, 551, 552, 556, 560, 563, 648, 664,
+    /* 0x60 */ 664, 665, 668, 669, 671, 673, 674, 678,
+    /* 0x68 */ 692, 694, 697, 698, 701, 702, 703, 704,
+    /* 0x70 */ 715, 715, 716, 724, 734, 762, 762, 762,
+    /* 0x78 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0x80 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0x88 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0x90 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0x98 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xa0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xa8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xb0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xb8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xc0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xc8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xd0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xd8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xe0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xe8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xf0 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* 0xf8 */ 762, 762, 762, 762, 762, 762, 762, 762,
+    /* end */  762
+};
+
+const uint8_t sg_lib_asc_ascq_range_map[32] =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x07, 0x20, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
 #else   /* SG_SCSI_STRINGS */
 
 const struct sg_lib_asc_ascq_range_t sg_lib_asc_ascq_range[] =
@@ -1549,6 +1862,10 @@ const struct sg_lib_asc_ascq_t sg_lib_asc_ascq[] =
 {
     {0, 0, NULL}
 };
+
+const uint16_t sg_lib_asc_ascq_idx[257] = {0};
+
+const uint8_t sg_lib_asc_ascq_range_map[32] = {0};
 #endif /* SG_SCSI_STRINGS */
 
 const char * const sg_lib_sense_key_desc[] = {
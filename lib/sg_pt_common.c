@@ -13,25 +13,65 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#if defined(HAVE_PTHREAD_H) && (! defined(SG_LIB_WIN32))
+#include <pthread.h>
+#define SG_PT_HAVE_PTHREAD 1
+#endif
+
+#ifndef SG_LIB_WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#include <time.h>
+#include <sys/time.h>
+
 #include "sg_lib.h"
 #include "sg_pt.h"
+#include "sg_pt_emul.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
-#include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
 #if (HAVE_NVME && (! IGNORE_NVME))
 #include "sg_nvme.h"
 #endif
 
-static const char * scsi_pt_version_str = "3.21 20231123";
+static const char * scsi_pt_version_str = "3.22 20261016";
+
+/* Locks for the state shared by all threads (the object pool, latency
+ * statistics, trace and recording) and a run once helper for reading the
+ * environment variables that turn the latter on. Without POSIX threads the
+ * library is used by a single thread, so a flag is enough. */
+#ifdef SG_PT_HAVE_PTHREAD
+typedef pthread_mutex_t sg_pt_lock_t;
+#define SG_PT_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define sg_pt_lock_init(lp) pthread_mutex_init((lp), NULL)
+#define sg_pt_lock(lp) pthread_mutex_lock(lp)
+#define sg_pt_unlock(lp) pthread_mutex_unlock(lp)
+typedef pthread_once_t sg_pt_once_t;
+#define SG_PT_ONCE_INIT PTHREAD_ONCE_INIT
+#define sg_pt_once(op, fn) pthread_once((op), (fn))
+#else
+typedef int sg_pt_lock_t;
+#define SG_PT_LOCK_INITIALIZER 0
+#define sg_pt_lock_init(lp) (*(lp) = 0)
+#define sg_pt_lock(lp) ((void)(lp))
+#define sg_pt_unlock(lp) ((void)(lp))
+typedef int sg_pt_once_t;
+#define SG_PT_ONCE_INIT 0
+#define sg_pt_once(op, fn) do { if (0 == *(op)) { *(op) = 1; (fn)(); } \
+                           } while (0)
+#endif
 
 /* List of external functions that need to be defined for each OS are
  * listed at the top of sg_pt_dummy.c   */
@@ -47,3 +87,1349 @@ sg_pt_version()
 {
     return scsi_pt_version_str;
 }
+
+
+/* Emulation of the asynchronous submit/reap interface for OS interfaces
+ * that lack a native one. Each device file descriptor gets a ring of
+ * completed objects, found on a list protected by sg_pt_emul_lock. Where
+ * available a pipe holds one byte per object in the ring so that its read
+ * side is pollable. The identity of the open file is noted so that state
+ * left behind by a file descriptor closed without sg_pt_emul_release()
+ * is not handed to a later open() that gets the same number. */
+
+#define SG_PT_EMUL_QLEN 256
+
+struct sg_pt_emul_ent {
+    struct sg_pt_base * objp;
+    int res;
+};
+
+struct sg_pt_emul_q {
+    int dev_fd;
+    int num;                    /* number of completions in ring */
+    int num_busy;               /* submitted, executing (not in ring) */
+    int rd_idx;
+    int pipe_fds[2];            /* [0] is read side, -1 when not open */
+    bool have_id;               /* false if fd could not be fstat()-ed */
+    uint64_t st_dev;
+    uint64_t st_ino;
+    struct sg_pt_emul_q * next;
+    struct sg_pt_emul_ent ring[SG_PT_EMUL_QLEN];
+};
+
+static struct sg_pt_emul_q * sg_pt_emul_head;
+static sg_pt_lock_t sg_pt_emul_lock = SG_PT_LOCK_INITIALIZER;
+
+static void
+sg_pt_emul_free(struct sg_pt_emul_q * qp)
+{
+#ifndef SG_LIB_WIN32
+    if (qp->pipe_fds[0] >= 0)
+        close(qp->pipe_fds[0]);
+    if (qp->pipe_fds[1] >= 0)
+        close(qp->pipe_fds[1]);
+#endif
+    free(qp);
+}
+
+/* Sets the identity of the file open on fd into qp. Returns true if it
+ * differs from the one already held. */
+static bool
+sg_pt_emul_id_changed(struct sg_pt_emul_q * qp, int fd)
+{
+#ifndef SG_LIB_WIN32
+    struct stat a_stat;
+
+    if (fstat(fd, &a_stat) < 0) {
+        qp->have_id = false;
+        return false;   /* e.g. sg_pt_dummy.c accepts any value as fd */
+    }
+    if (qp->have_id && (((uint64_t)a_stat.st_dev != qp->st_dev) ||
+                        ((uint64_t)a_stat.st_ino != qp->st_ino)))
+        return true;
+    qp->have_id = true;
+    qp->st_dev = (uint64_t)a_stat.st_dev;
+    qp->st_ino = (uint64_t)a_stat.st_ino;
+#else
+    if (qp && fd) { ; }         /* unused, suppress warning */
+#endif
+    return false;
+}
+
+/* Call with sg_pt_emul_lock held. If 'create' is true and fd has no
+ * state, or only stale state, new state is made. */
+static struct sg_pt_emul_q *
+sg_pt_emul_find(int fd, bool create)
+{
+    struct sg_pt_emul_q * qp;
+    struct sg_pt_emul_q ** prevpp;
+
+    for (prevpp = &sg_pt_emul_head; *prevpp; prevpp = &(*prevpp)->next) {
+        if (fd == (*prevpp)->dev_fd)
+            break;
+    }
+    qp = *prevpp;
+    if (qp && create && (0 == qp->num_busy) &&
+        sg_pt_emul_id_changed(qp, fd)) {
+        *prevpp = qp->next;     /* fd was reused, drop stale state */
+        sg_pt_emul_free(qp);
+        qp = NULL;
+    }
+    if (qp || (! create))
+        return qp;
+    qp = (struct sg_pt_emul_q *)calloc(1, sizeof(*qp));
+    if (NULL == qp)
+        return NULL;
+    qp->dev_fd = fd;
+    qp->pipe_fds[0] = -1;
+    qp->pipe_fds[1] = -1;
+    sg_pt_emul_id_changed(qp, fd);
+#ifndef SG_LIB_WIN32
+    if (0 == pipe(qp->pipe_fds)) {
+        fcntl(qp->pipe_fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(qp->pipe_fds[1], F_SETFD, FD_CLOEXEC);
+    } else {
+        qp->pipe_fds[0] = -1;
+        qp->pipe_fds[1] = -1;
+    }
+#endif
+    qp->next = sg_pt_emul_head;
+    sg_pt_emul_head = qp;
+    return qp;
+}
+
+int
+sg_pt_emul_submit(struct sg_pt_base * vp, int fd, int timeout_secs,
+                  int verbose)
+{
+    int res, fd2;
+    struct sg_pt_emul_q * qp;
+
+    if (NULL == vp)
+        return SCSI_PT_DO_BAD_PARAMS;
+    fd2 = (fd >= 0) ? fd : get_pt_file_handle(vp);
+    sg_pt_lock(&sg_pt_emul_lock);
+    qp = sg_pt_emul_find(fd2, true);
+    if (NULL == qp) {
+        sg_pt_unlock(&sg_pt_emul_lock);
+        if (verbose)
+            pr2ws("%s: out of memory\n", __func__);
+        return -ENOMEM;
+    }
+    if ((qp->num + qp->num_busy) >= SG_PT_EMUL_QLEN) {
+        res = qp->num + qp->num_busy;
+        sg_pt_unlock(&sg_pt_emul_lock);
+        if (verbose > 1)
+            pr2ws("%s: %d commands outstanding, reap some\n", __func__,
+                  res);
+        return -EAGAIN;
+    }
+    ++qp->num_busy;     /* so qp is not dropped while the lock is off */
+    sg_pt_unlock(&sg_pt_emul_lock);
+    res = do_scsi_pt(vp, fd, timeout_secs, verbose);
+    if (res && (verbose > 2))
+        pr2ws("%s: do_scsi_pt() result=%d queued for reap\n", __func__,
+              res);
+    sg_pt_lock(&sg_pt_emul_lock);
+    --qp->num_busy;
+    qp->ring[(qp->rd_idx + qp->num) % SG_PT_EMUL_QLEN].objp = vp;
+    qp->ring[(qp->rd_idx + qp->num) % SG_PT_EMUL_QLEN].res = res;
+    ++qp->num;
+#ifndef SG_LIB_WIN32
+    if (qp->pipe_fds[1] >= 0) {
+        const uint8_t b = 0;
+
+        if (write(qp->pipe_fds[1], &b, 1) < 0) {
+            if (verbose)
+                pr2ws("%s: pipe write failed: %s\n", __func__,
+                      safe_strerror(errno));
+        }
+    }
+#endif
+    sg_pt_unlock(&sg_pt_emul_lock);
+    return 0;
+}
+
+int
+sg_pt_emul_reap(int fd, bool wait, struct sg_pt_base ** objpp, int verbose)
+{
+    int res;
+    struct sg_pt_emul_q * qp;
+    struct sg_pt_emul_ent * ep;
+
+    if (objpp)
+        *objpp = NULL;
+    if (wait) { }       /* submit completes each command so no waiting */
+    sg_pt_lock(&sg_pt_emul_lock);
+    qp = sg_pt_emul_find(fd, false);
+    if ((NULL == qp) || (qp->num <= 0)) {
+        sg_pt_unlock(&sg_pt_emul_lock);
+        return -EAGAIN;
+    }
+#ifndef SG_LIB_WIN32
+    if (qp->pipe_fds[0] >= 0) {
+        uint8_t b;
+
+        if (read(qp->pipe_fds[0], &b, 1) < 0) {
+            if (verbose)
+                pr2ws("%s: pipe read failed: %s\n", __func__,
+                      safe_strerror(errno));
+        }
+    }
+#else
+    if (verbose) { ; }          /* unused, suppress warning */
+#endif
+    ep = qp->ring + qp->rd_idx;
+    qp->rd_idx = (qp->rd_idx + 1) % SG_PT_EMUL_QLEN;
+    --qp->num;
+    if (objpp)
+        *objpp = ep->objp;
+    res = ep->res;
+    sg_pt_unlock(&sg_pt_emul_lock);
+    return res;
+}
+
+int
+sg_pt_emul_poll_fd(int fd, int verbose)
+{
+    int res;
+    struct sg_pt_emul_q * qp;
+
+    sg_pt_lock(&sg_pt_emul_lock);
+    qp = sg_pt_emul_find(fd, true);
+    res = qp ? ((qp->pipe_fds[0] >= 0) ? qp->pipe_fds[0] : -ENOSYS) :
+               -ENOMEM;
+    sg_pt_unlock(&sg_pt_emul_lock);
+    if ((-ENOMEM == res) && verbose)
+        pr2ws("%s: out of memory\n", __func__);
+    return res;
+}
+
+int
+sg_pt_emul_num_pending(int fd)
+{
+    int num;
+    struct sg_pt_emul_q * qp;
+
+    sg_pt_lock(&sg_pt_emul_lock);
+    qp = sg_pt_emul_find(fd, false);
+    num = qp ? (qp->num + qp->num_busy) : 0;
+    sg_pt_unlock(&sg_pt_emul_lock);
+    return num;
+}
+
+/* Forgets any completions not yet reaped on fd. Called when fd is closed. */
+void
+sg_pt_emul_release(int fd)
+{
+    struct sg_pt_emul_q * qp;
+    struct sg_pt_emul_q ** prevpp;
+
+    sg_pt_lock(&sg_pt_emul_lock);
+    for (prevpp = &sg_pt_emul_head; *prevpp; prevpp = &(*prevpp)->next) {
+        if (fd == (*prevpp)->dev_fd)
+            break;
+    }
+    qp = *prevpp;
+    if (qp)
+        *prevpp = qp->next;
+    sg_pt_unlock(&sg_pt_emul_lock);
+    if (qp)
+        sg_pt_emul_free(qp);
+}
+
+
+/* Emulation of multiple requests (MRQ). Without IMMED each command is
+ * executed in turn with do_scsi_pt(); with IMMED each is given to
+ * do_scsi_pt_submit() and do_scsi_pt_mrq_reap() collects them with
+ * do_scsi_pt_reap(). */
+int
+sg_pt_emul_mrq(struct sg_pt_base ** objpp, int num, int fd,
+               int timeout_secs, int mrq_flags, int * num_donep,
+               int verbose)
+{
+    bool immed = !! (SCSI_PT_MRQ_IMMED & mrq_flags);
+    int k, res;
+
+    if (num_donep)
+        *num_donep = 0;
+    if ((NULL == objpp) || (num < 0))
+        return SCSI_PT_DO_BAD_PARAMS;
+    for (k = 0, res = 0; k < num; ++k) {
+        if (immed)
+            res = do_scsi_pt_submit(objpp[k], fd, timeout_secs, verbose);
+        else
+            res = do_scsi_pt(objpp[k], fd, timeout_secs, verbose);
+        if (res) {
+            if (verbose > 1)
+                pr2ws("%s: request %d of %d gave res=%d\n", __func__, k,
+                      num, res);
+            break;
+        }
+        if (num_donep)
+            ++*num_donep;
+        if ((! immed) && (SCSI_PT_MRQ_STOP_IF & mrq_flags) &&
+            (SCSI_PT_RESULT_GOOD !=
+             get_scsi_pt_result_category(objpp[k])))
+            break;
+    }
+    return res;
+}
+
+int
+sg_pt_emul_mrq_reap(int fd, bool wait, struct sg_pt_base ** objpp, int max,
+                    int verbose)
+{
+    int k, res;
+
+    if ((NULL == objpp) || (max < 0))
+        return -EINVAL;
+    for (k = 0; k < max; ++k) {
+        res = do_scsi_pt_reap(fd, (wait && (0 == k)), objpp + k, verbose);
+        if (NULL == objpp[k]) {
+            if ((-EAGAIN == res) || (k > 0))
+                break;
+            return res;
+        }
+    }
+    return k;
+}
+
+
+/* Per device file descriptor pool of pass-through objects. Objects are
+ * cleared (see clear_scsi_pt_obj()) as they are returned so the dev_fd and
+ * its classification (e.g. sg, bsg or NVMe) survive. Up to
+ * SG_PT_POOL_MAX_SPARE idle objects are kept per file descriptor, enough
+ * for a few threads issuing commands to the same device concurrently. */
+#define SG_PT_POOL_MAX_SPARE 8
+
+struct sg_pt_pool_ent {
+    int dev_fd;
+    int num_spare;
+    struct sg_pt_base * spare[SG_PT_POOL_MAX_SPARE];
+    struct sg_pt_pool_ent * next;
+};
+
+static struct sg_pt_pool_ent * sg_pt_pool_head;
+static sg_pt_lock_t sg_pt_pool_lock = SG_PT_LOCK_INITIALIZER;
+
+/* Call with sg_pt_pool_lock held */
+static struct sg_pt_pool_ent *
+sg_pt_pool_find(int dev_fd)
+{
+    struct sg_pt_pool_ent * ep;
+
+    for (ep = sg_pt_pool_head; ep; ep = ep->next) {
+        if (dev_fd == ep->dev_fd)
+            break;
+    }
+    return ep;
+}
+
+/* Returns 0 if dev_fd is (now) pooled, else a negated errno. */
+int
+scsi_pt_pool_enable(int dev_fd, int verbose)
+{
+    struct sg_pt_pool_ent * ep;
+
+    if (dev_fd < 0)
+        return -EINVAL;
+    sg_pt_lock(&sg_pt_pool_lock);
+    ep = sg_pt_pool_find(dev_fd);
+    if (NULL == ep) {
+        ep = (struct sg_pt_pool_ent *)calloc(1, sizeof(*ep));
+        if (ep) {
+            ep->dev_fd = dev_fd;
+            ep->next = sg_pt_pool_head;
+            sg_pt_pool_head = ep;
+        }
+    }
+    sg_pt_unlock(&sg_pt_pool_lock);
+    if (NULL == ep) {
+        if (verbose)
+            pr2ws("%s: calloc() failed, out of memory?\n", __func__);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+struct sg_pt_base *
+scsi_pt_pool_get(int dev_fd, int verbose)
+{
+    struct sg_pt_pool_ent * ep;
+    struct sg_pt_base * vp = NULL;
+
+    if (dev_fd >= 0) {
+        sg_pt_lock(&sg_pt_pool_lock);
+        ep = sg_pt_pool_find(dev_fd);
+        if (ep && (ep->num_spare > 0))
+            vp = ep->spare[--ep->num_spare];
+        sg_pt_unlock(&sg_pt_pool_lock);
+    }
+    if (vp)
+        return vp;
+    /* callers may give -1 as the fd to do_scsi_pt(), so always install
+     * dev_fd even when the object will not be kept */
+    if (dev_fd >= 0)
+        return construct_scsi_pt_obj_with_fd(dev_fd, verbose);
+    return construct_scsi_pt_obj();
+}
+
+void
+scsi_pt_pool_put(struct sg_pt_base * vp)
+{
+    int dev_fd;
+    struct sg_pt_pool_ent * ep;
+
+    if (NULL == vp)
+        return;
+    dev_fd = get_pt_file_handle(vp);
+    if (dev_fd >= 0) {
+        clear_scsi_pt_obj(vp);
+        sg_pt_lock(&sg_pt_pool_lock);
+        ep = sg_pt_pool_find(dev_fd);
+        if (ep && (ep->num_spare < SG_PT_POOL_MAX_SPARE)) {
+            ep->spare[ep->num_spare++] = vp;
+            vp = NULL;
+        }
+        sg_pt_unlock(&sg_pt_pool_lock);
+    }
+    if (vp)
+        destruct_scsi_pt_obj(vp);
+}
+
+void
+scsi_pt_pool_flush(int dev_fd)
+{
+    int k;
+    struct sg_pt_pool_ent * ep;
+    struct sg_pt_pool_ent * prev_ep = NULL;
+    struct sg_pt_pool_ent * free_list = NULL;
+
+    sg_pt_lock(&sg_pt_pool_lock);
+    for (ep = sg_pt_pool_head; ep; ) {
+        struct sg_pt_pool_ent * next_ep = ep->next;
+
+        if ((dev_fd < 0) || (dev_fd == ep->dev_fd)) {
+            if (prev_ep)
+                prev_ep->next = next_ep;
+            else
+                sg_pt_pool_head = next_ep;
+            ep->next = free_list;
+            free_list = ep;
+        } else
+            prev_ep = ep;
+        ep = next_ep;
+    }
+    sg_pt_unlock(&sg_pt_pool_lock);
+    while (free_list) {
+        ep = free_list;
+        free_list = ep->next;
+        for (k = 0; k < ep->num_spare; ++k)
+            destruct_scsi_pt_obj(ep->spare[k]);
+        free(ep);
+    }
+}
+
+
+/* Command latency statistics. Each thread that records gets its own table
+ * of SG_PT_STATS_MAX_KEYS slots, linked into sg_pt_stats_thr_head the
+ * first time; only that thread writes to it so recording needs no lock.
+ * Readers (sg_pt_stats_get() and friends) merge the tables and may see a
+ * command that is half recorded, which only matters in the last digit.
+ * Latencies in nanoseconds go into log-linear buckets: values below 32 get
+ * their own bucket, above that each power of 2 is split into
+ * 2**SG_PT_STATS_SUB_BITS buckets. */
+#define SG_PT_STATS_MAX_KEYS 64         /* per thread, power of 2 */
+#define SG_PT_STATS_MAX_MERGED 256
+#define SG_PT_STATS_SUB_BITS 4
+#define SG_PT_STATS_SUB_CNT (1 << SG_PT_STATS_SUB_BITS)
+#define SG_PT_STATS_NUM_BUCKETS ((64 - SG_PT_STATS_SUB_BITS + 1) * \
+                                 SG_PT_STATS_SUB_CNT)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SG_PT_TLS __thread
+#define SG_PT_LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SG_PT_STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define SG_PT_TLS               /* not lock free: all threads share */
+#define SG_PT_LOAD_ACQ(p) (*(p))
+#define SG_PT_STORE_REL(p, v) (*(p) = (v))
+#endif
+
+struct sg_pt_stats_slot {
+    int used;
+    uint64_t key;
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t * hist;            /* SG_PT_STATS_NUM_BUCKETS counters */
+};
+
+struct sg_pt_stats_thr {
+    struct sg_pt_stats_slot slot[SG_PT_STATS_MAX_KEYS];
+    struct sg_pt_stats_thr * next;
+};
+
+static int sg_pt_stats_state = -1;      /* -1: check environment */
+static sg_pt_once_t sg_pt_stats_once = SG_PT_ONCE_INIT;
+static struct sg_pt_stats_thr * sg_pt_stats_thr_head;
+static sg_pt_lock_t sg_pt_stats_lock = SG_PT_LOCK_INITIALIZER;
+static SG_PT_TLS struct sg_pt_stats_thr * sg_pt_stats_tls;
+
+static void sg_pt_stats_atexit(void);
+
+void
+sg_pt_stats_enable(bool enable)
+{
+    sg_pt_stats_state = enable ? 1 : 0;
+}
+
+/* Called once, unless sg_pt_stats_enable() has already decided */
+static void
+sg_pt_stats_env(void)
+{
+    if (sg_pt_stats_state < 0) {
+        if (getenv(SG_PT_STATS_ENV)) {
+            sg_pt_stats_state = 1;
+            atexit(sg_pt_stats_atexit);
+        } else
+            sg_pt_stats_state = 0;
+    }
+}
+
+bool
+sg_pt_stats_on(void)
+{
+    sg_pt_once(&sg_pt_stats_once, sg_pt_stats_env);
+    return sg_pt_stats_state > 0;
+}
+
+uint64_t
+sg_pt_stats_now_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#elif defined(HAVE_GETTIMEOFDAY)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000000) +
+           ((uint64_t)tv.tv_usec * 1000);
+#else
+    return 0;
+#endif
+}
+
+static int
+sg_pt_stats_bucket(uint64_t v)
+{
+    int e;
+
+    if (v < (2 * SG_PT_STATS_SUB_CNT))
+        return (int)v;
+    for (e = 63; 0 == (v & ((uint64_t)1 << e)); --e)
+        ;
+    return ((e - SG_PT_STATS_SUB_BITS + 1) << SG_PT_STATS_SUB_BITS) |
+           (int)((v >> (e - SG_PT_STATS_SUB_BITS)) & (SG_PT_STATS_SUB_CNT - 1));
+}
+
+/* Highest value that falls in bucket b */
+static uint64_t
+sg_pt_stats_bucket_max(int b)
+{
+    int e;
+
+    if (b < (2 * SG_PT_STATS_SUB_CNT))
+        return b;
+    e = (b >> SG_PT_STATS_SUB_BITS) + SG_PT_STATS_SUB_BITS - 1;
+    return (((uint64_t)(SG_PT_STATS_SUB_CNT | (b & (SG_PT_STATS_SUB_CNT - 1)))
+             << (e - SG_PT_STATS_SUB_BITS)) +
+            ((uint64_t)1 << (e - SG_PT_STATS_SUB_BITS))) - 1;
+}
+
+/* SCSI opcodes whose service action is part of the command's identity */
+static bool
+sg_pt_stats_has_sa(uint8_t opcode)
+{
+    switch (opcode) {
+    case 0x3c:          /* READ BUFFER(10) */
+    case 0x5e:          /* PERSISTENT RESERVE IN */
+    case 0x5f:          /* PERSISTENT RESERVE OUT */
+    case 0x7f:          /* variable length */
+    case 0x83:          /* third party copy out */
+    case 0x84:          /* third party copy in */
+    case 0x8c:          /* READ ATTRIBUTE */
+    case 0x94:          /* zoning out */
+    case 0x95:          /* zoning in */
+    case 0x9b:          /* READ BUFFER(16) */
+    case 0x9d:          /* SERVICE ACTION BIDIRECTIONAL */
+    case 0x9e:          /* SERVICE ACTION IN(16) */
+    case 0x9f:          /* SERVICE ACTION OUT(16) */
+    case 0xa3:          /* MAINTENANCE IN */
+    case 0xa4:          /* MAINTENANCE OUT */
+    case 0xa9:          /* SERVICE ACTION OUT(12) */
+    case 0xab:          /* SERVICE ACTION IN(12) */
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* key: kind (8 bits) | category (8) | opcode (8) | has_sa (1) | sa (16) */
+static uint64_t
+sg_pt_stats_key(int kind, const uint8_t * cmdp, int category)
+{
+    uint64_t key = ((uint64_t)(kind & 0xff) << 33) |
+                   ((uint64_t)(category & 0xff) << 25) |
+                   ((uint64_t)cmdp[0] << 17);
+
+    if ((SG_PT_STATS_KIND_SCSI == kind) && sg_pt_stats_has_sa(cmdp[0])) {
+        key |= 0x10000;
+        key |= (0x7f == cmdp[0]) ? sg_get_unaligned_be16(cmdp + 8) :
+                                   (cmdp[1] & 0x1f);
+    }
+    return key;
+}
+
+static void
+sg_pt_stats_key2ent(uint64_t key, struct sg_pt_stats_ent * ep)
+{
+    ep->kind = (int)((key >> 33) & 0xff);
+    ep->category = (int)((key >> 25) & 0xff);
+    ep->opcode = (int)((key >> 17) & 0xff);
+    ep->serv_act = (key & 0x10000) ? (int)(key & 0xffff) : -1;
+}
+
+void
+sg_pt_stats_record(int kind, const uint8_t * cmdp, int category,
+                   uint64_t dur_ns)
+{
+    int k, h;
+    uint64_t key;
+    struct sg_pt_stats_thr * tp = sg_pt_stats_tls;
+    struct sg_pt_stats_slot * sp;
+
+    if (NULL == cmdp)
+        return;
+    if (NULL == tp) {
+        tp = (struct sg_pt_stats_thr *)calloc(1, sizeof(*tp));
+        if (NULL == tp)
+            return;
+        sg_pt_lock(&sg_pt_stats_lock);
+        tp->next = sg_pt_stats_thr_head;
+        sg_pt_stats_thr_head = tp;
+        sg_pt_unlock(&sg_pt_stats_lock);
+        sg_pt_stats_tls = tp;
+    }
+    key = sg_pt_stats_key(kind, cmdp, category);
+    h = (int)((key ^ (key >> 17) ^ (key >> 25)) & (SG_PT_STATS_MAX_KEYS - 1));
+    for (k = 0; k < SG_PT_STATS_MAX_KEYS; ++k) {
+        sp = tp->slot + h;
+        if (sp->used) {
+            if (key == sp->key)
+                break;
+        } else {        /* first use of this key by this thread */
+            sp->hist = (uint64_t *)calloc(SG_PT_STATS_NUM_BUCKETS,
+                                          sizeof(uint64_t));
+            if (NULL == sp->hist)
+                return;
+            sp->key = key;
+            sp->min_ns = UINT64_MAX;
+            SG_PT_STORE_REL(&sp->used, 1);
+            break;
+        }
+        h = (h + 1) & (SG_PT_STATS_MAX_KEYS - 1);
+    }
+    if (k >= SG_PT_STATS_MAX_KEYS)
+        return;         /* table full, drop */
+    ++sp->count;
+    sp->sum_ns += dur_ns;
+    if (dur_ns < sp->min_ns)
+        sp->min_ns = dur_ns;
+    if (dur_ns > sp->max_ns)
+        sp->max_ns = dur_ns;
+    ++sp->hist[sg_pt_stats_bucket(dur_ns)];
+}
+
+void
+sg_pt_stats_reset(void)
+{
+    int k;
+    struct sg_pt_stats_thr * tp;
+    struct sg_pt_stats_slot * sp;
+
+    sg_pt_lock(&sg_pt_stats_lock);
+    for (tp = sg_pt_stats_thr_head; tp; tp = tp->next) {
+        for (k = 0; k < SG_PT_STATS_MAX_KEYS; ++k) {
+            sp = tp->slot + k;
+            if (! SG_PT_LOAD_ACQ(&sp->used))
+                continue;
+            sp->count = 0;
+            sp->sum_ns = 0;
+            sp->min_ns = UINT64_MAX;
+            sp->max_ns = 0;
+            memset(sp->hist, 0, SG_PT_STATS_NUM_BUCKETS * sizeof(uint64_t));
+        }
+    }
+    sg_pt_unlock(&sg_pt_stats_lock);
+}
+
+/* Adds slot sp into ep and hist (the merged histogram) */
+static void
+sg_pt_stats_merge(const struct sg_pt_stats_slot * sp,
+                  struct sg_pt_stats_ent * ep, uint64_t * hist)
+{
+    int b;
+
+    if (0 == sp->count)
+        return;
+    if ((0 == ep->count) || (sp->min_ns < ep->min_ns))
+        ep->min_ns = sp->min_ns;
+    if (sp->max_ns > ep->max_ns)
+        ep->max_ns = sp->max_ns;
+    ep->count += sp->count;
+    ep->sum_ns += sp->sum_ns;
+    for (b = 0; b < SG_PT_STATS_NUM_BUCKETS; ++b)
+        hist[b] += sp->hist[b];
+}
+
+/* Value at or below which 'permille' thousandths of the samples fall */
+static uint64_t
+sg_pt_stats_pctl(const uint64_t * hist, const struct sg_pt_stats_ent * ep,
+                 int permille)
+{
+    int b;
+    uint64_t v, cum = 0;
+    uint64_t want = (ep->count * (uint64_t)permille + 999) / 1000;
+
+    if (0 == want)
+        want = 1;
+    for (b = 0; b < SG_PT_STATS_NUM_BUCKETS; ++b) {
+        cum += hist[b];
+        if (cum >= want)
+            break;
+    }
+    v = sg_pt_stats_bucket_max(b);
+    if (v > ep->max_ns)
+        v = ep->max_ns;
+    if (v < ep->min_ns)
+        v = ep->min_ns;
+    return v;
+}
+
+static void
+sg_pt_stats_fini_ent(const uint64_t * hist, struct sg_pt_stats_ent * ep)
+{
+    ep->p50_ns = sg_pt_stats_pctl(hist, ep, 500);
+    ep->p99_ns = sg_pt_stats_pctl(hist, ep, 990);
+    ep->p999_ns = sg_pt_stats_pctl(hist, ep, 999);
+}
+
+int
+sg_pt_stats_get(struct sg_pt_stats_ent * arr, int max_num)
+{
+    int j, k, num = 0;
+    uint64_t keys[SG_PT_STATS_MAX_MERGED];
+    struct sg_pt_stats_thr * tp;
+    struct sg_pt_stats_slot * sp;
+    uint64_t * hist;
+
+    /* first gather the distinct keys */
+    sg_pt_lock(&sg_pt_stats_lock);
+    for (tp = sg_pt_stats_thr_head; tp; tp = tp->next) {
+        for (k = 0; k < SG_PT_STATS_MAX_KEYS; ++k) {
+            sp = tp->slot + k;
+            if ((! SG_PT_LOAD_ACQ(&sp->used)) || (0 == sp->count))
+                continue;
+            for (j = 0; j < num; ++j) {
+                if (sp->key == keys[j])
+                    break;
+            }
+            if ((j == num) && (num < SG_PT_STATS_MAX_MERGED))
+                keys[num++] = sp->key;
+        }
+    }
+    sg_pt_unlock(&sg_pt_stats_lock);
+    if ((NULL == arr) || (max_num <= 0))
+        return num;
+    hist = (uint64_t *)malloc(SG_PT_STATS_NUM_BUCKETS * sizeof(uint64_t));
+    if (NULL == hist)
+        return 0;
+    for (j = 0; (j < num) && (j < max_num); ++j) {
+        struct sg_pt_stats_ent * ep = arr + j;
+
+        memset(ep, 0, sizeof(*ep));
+        memset(hist, 0, SG_PT_STATS_NUM_BUCKETS * sizeof(uint64_t));
+        sg_pt_stats_key2ent(keys[j], ep);
+        sg_pt_lock(&sg_pt_stats_lock);
+        for (tp = sg_pt_stats_thr_head; tp; tp = tp->next) {
+            for (k = 0; k < SG_PT_STATS_MAX_KEYS; ++k) {
+                sp = tp->slot + k;
+                if (SG_PT_LOAD_ACQ(&sp->used) && (keys[j] == sp->key))
+                    sg_pt_stats_merge(sp, ep, hist);
+            }
+        }
+        sg_pt_unlock(&sg_pt_stats_lock);
+        sg_pt_stats_fini_ent(hist, ep);
+    }
+    free(hist);
+    return num;
+}
+
+bool
+sg_pt_stats_summary(int opcode, struct sg_pt_stats_ent * sump)
+{
+    int k;
+    struct sg_pt_stats_thr * tp;
+    struct sg_pt_stats_slot * sp;
+    uint64_t * hist;
+
+    if (NULL == sump)
+        return false;
+    memset(sump, 0, sizeof(*sump));
+    sump->kind = -1;
+    sump->opcode = opcode;
+    sump->serv_act = -1;
+    sump->category = -1;
+    hist = (uint64_t *)calloc(SG_PT_STATS_NUM_BUCKETS, sizeof(uint64_t));
+    if (NULL == hist)
+        return false;
+    sg_pt_lock(&sg_pt_stats_lock);
+    for (tp = sg_pt_stats_thr_head; tp; tp = tp->next) {
+        for (k = 0; k < SG_PT_STATS_MAX_KEYS; ++k) {
+            sp = tp->slot + k;
+            if (! SG_PT_LOAD_ACQ(&sp->used))
+                continue;
+            if ((opcode < 0) || (opcode == (int)((sp->key >> 17) & 0xff)))
+                sg_pt_stats_merge(sp, sump, hist);
+        }
+    }
+    sg_pt_unlock(&sg_pt_stats_lock);
+    if (sump->count > 0)
+        sg_pt_stats_fini_ent(hist, sump);
+    free(hist);
+    return sump->count > 0;
+}
+
+static void
+sg_pt_stats_atexit(void)
+{
+    const char * cp = getenv(SG_PT_STATS_ENV);
+    FILE * fp = stderr;
+    sgj_state js;
+
+    if (sg_pt_stats_state <= 0)
+        return;
+    if (cp && (strlen(cp) > 0) && strcmp(cp, "1") && strcmp(cp, "-")) {
+        fp = fopen(cp, "a");
+        if (NULL == fp) {
+            pr2ws("%s: unable to open %s\n", __func__, cp);
+            return;
+        }
+    }
+    sgj_init_state(&js, NULL);
+    js.pr_as_json = true;
+    js.pr_leadin = false;
+    js.pr_exit_status = false;
+    if (sgj_start_r(NULL, NULL, 0, NULL, &js)) {
+        sgj_haj_pt_stats(&js, NULL);
+        sgj_js2file(&js, NULL, 0, fp);
+        sgj_finish(&js);
+    }
+    if (fp != stderr)
+        fclose(fp);
+}
+
+
+/* A binary output file shared by the command trace and the recording. It
+ * starts with a 16 byte header: an 8 byte magic string (7 characters and a
+ * NUL), then 16 bit version and header length fields and 4 reserved bytes,
+ * all little endian. The file is named by an environment variable (read
+ * once, at the first sg_pt_sink_on() ) or given to sg_pt_sink_start(); it
+ * is closed by stop_fn() at exit. */
+#define SG_PT_SINK_HDR_LEN 16
+
+struct sg_pt_sink {
+    const char * env_name;
+    const char * magic;         /* 8 bytes, including trailing NUL */
+    int version;
+    void (*stop_fn)(void);      /* registered with atexit() */
+    void (*env_fn)(void);       /* calls sg_pt_sink_env() on this sink */
+    sg_pt_once_t env_once;
+    int state;                  /* -1: check environment, 0: off, 1: on */
+    bool atexit_done;
+    FILE * fp;
+    sg_pt_lock_t lock;          /* protects fp */
+};
+
+/* Creates fname, writes the header and makes it the sink's output.
+ * Returns 0 or a negated errno. The caller stops any previous output. */
+static int
+sg_pt_sink_start(struct sg_pt_sink * skp, const char * fname)
+{
+    int err;
+    uint8_t hdr[SG_PT_SINK_HDR_LEN];
+    FILE * fp;
+
+    fp = fopen(fname, "wb");
+    if (NULL == fp) {
+        err = errno;
+        pr2ws("%s: unable to create %s: %s\n", __func__, fname,
+              safe_strerror(err));
+        return -err;
+    }
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, skp->magic, 8);
+    sg_put_unaligned_le16(skp->version, hdr + 8);
+    sg_put_unaligned_le16(SG_PT_SINK_HDR_LEN, hdr + 10);
+    fwrite(hdr, 1, sizeof(hdr), fp);
+    sg_pt_lock(&skp->lock);
+    skp->fp = fp;
+    if (! skp->atexit_done) {
+        skp->atexit_done = true;
+        atexit(skp->stop_fn);
+    }
+    skp->state = 1;
+    sg_pt_unlock(&skp->lock);
+    return 0;
+}
+
+/* Run once via skp->env_fn, unless the sink has already been started */
+static void
+sg_pt_sink_env(struct sg_pt_sink * skp)
+{
+    if (skp->state < 0) {
+        const char * cp = getenv(skp->env_name);
+
+        if (cp && (strlen(cp) > 0))
+            sg_pt_sink_start(skp, cp);
+        if (skp->state < 0)
+            skp->state = 0;
+    }
+}
+
+static bool
+sg_pt_sink_on(struct sg_pt_sink * skp)
+{
+    sg_pt_once(&skp->env_once, skp->env_fn);
+    return skp->state > 0;
+}
+
+/* Turns the sink off and closes its file */
+static void
+sg_pt_sink_stop(struct sg_pt_sink * skp)
+{
+    FILE * fp;
+
+    sg_pt_lock(&skp->lock);
+    if (skp->state > 0)
+        skp->state = 0;
+    fp = skp->fp;
+    skp->fp = NULL;
+    sg_pt_unlock(&skp->lock);
+    if (fp)
+        fclose(fp);
+}
+
+/* Returns the header length of a file written by a sink with 'magic' and
+ * 'version' whose first blen bytes are at bp, or -1 if it is not such a
+ * file. */
+static int
+sg_pt_sink_hdr_check(const char * magic, int version, const uint8_t * bp,
+                     int blen)
+{
+    int hdr_len;
+
+    if ((blen < SG_PT_SINK_HDR_LEN) || memcmp(bp, magic, 8) ||
+        (version != sg_get_unaligned_le16(bp + 8)))
+        return -1;
+    hdr_len = sg_get_unaligned_le16(bp + 10);
+    return (hdr_len < SG_PT_SINK_HDR_LEN) ? -1 : hdr_len;
+}
+
+
+/* Command trace file layout, all integers little endian. A sink header
+ * with magic "SGPTTRC". Records follow, each a 48 byte fixed part:
+ *     0  u16  record length (multiple of 8)
+ *     2  u8   kind     3  u8 category     4  u8 command length
+ *     5  u8   sense length     6  u16 status
+ *     8  u32  thread id     12  s32 do_scsi_pt() result
+ *    16  u64  start_ns     24  u64 duration_ns
+ *    32  u32  din_len  36 u32 dout_len  40 u32 din_act  44 u32 dout_act
+ * then the command and sense bytes, zero padded. */
+#define SG_PT_TRACE_VERSION 1
+#define SG_PT_TRACE_FIXED_LEN 48
+#define SG_PT_TRACE_BUF_SZ (64 * 1024)  /* per thread */
+
+static const char sg_pt_trace_magic[8] = "SGPTTRC";
+
+static void sg_pt_trace_env(void);
+
+static struct sg_pt_sink sg_pt_trace_sink = {
+    SG_PT_TRACE_ENV, sg_pt_trace_magic, SG_PT_TRACE_VERSION,
+    sg_pt_trace_stop, sg_pt_trace_env, SG_PT_ONCE_INIT, -1, false, NULL,
+    SG_PT_LOCK_INITIALIZER,
+};
+
+static void
+sg_pt_trace_env(void)
+{
+    sg_pt_sink_env(&sg_pt_trace_sink);
+}
+
+struct sg_pt_trace_buf {
+    int thr_id;
+    int len;
+    sg_pt_lock_t lock;          /* owner vs flushing thread */
+    struct sg_pt_trace_buf * next;
+    uint8_t b[SG_PT_TRACE_BUF_SZ];
+};
+
+static int sg_pt_trace_num_thr;
+static struct sg_pt_trace_buf * sg_pt_trace_buf_head;
+static sg_pt_lock_t sg_pt_trace_lock = SG_PT_LOCK_INITIALIZER;
+static SG_PT_TLS struct sg_pt_trace_buf * sg_pt_trace_tls;
+
+/* Call with bp->lock held */
+static void
+sg_pt_trace_write_buf(struct sg_pt_trace_buf * bp)
+{
+    if (bp->len > 0) {
+        sg_pt_lock(&sg_pt_trace_sink.lock);
+        if (sg_pt_trace_sink.fp)
+            fwrite(bp->b, 1, bp->len, sg_pt_trace_sink.fp);
+        sg_pt_unlock(&sg_pt_trace_sink.lock);
+        bp->len = 0;
+    }
+}
+
+int
+sg_pt_trace_start(const char * fname)
+{
+    sg_pt_trace_stop();
+    return sg_pt_sink_start(&sg_pt_trace_sink, fname);
+}
+
+bool
+sg_pt_trace_on(void)
+{
+    return sg_pt_sink_on(&sg_pt_trace_sink);
+}
+
+void
+sg_pt_trace_flush(void)
+{
+    struct sg_pt_trace_buf * bp;
+
+    sg_pt_lock(&sg_pt_trace_lock);
+    bp = sg_pt_trace_buf_head;
+    sg_pt_unlock(&sg_pt_trace_lock);
+    /* buffers are never freed and new ones are added at the head */
+    for ( ; bp; bp = bp->next) {
+        sg_pt_lock(&bp->lock);
+        sg_pt_trace_write_buf(bp);
+        sg_pt_unlock(&bp->lock);
+    }
+    sg_pt_lock(&sg_pt_trace_sink.lock);
+    if (sg_pt_trace_sink.fp)
+        fflush(sg_pt_trace_sink.fp);
+    sg_pt_unlock(&sg_pt_trace_sink.lock);
+}
+
+void
+sg_pt_trace_stop(void)
+{
+    if (sg_pt_trace_sink.state <= 0)
+        return;
+    sg_pt_trace_sink.state = 0;         /* stop adding records */
+    sg_pt_trace_flush();
+    sg_pt_sink_stop(&sg_pt_trace_sink);
+}
+
+static void
+sg_pt_trace_record(const struct sg_pt_base * vp, int kind, int category,
+                   int res, uint64_t start_ns, uint64_t dur_ns)
+{
+    int cmd_len, sense_len, rec_len;
+    int din_len = 0, dout_len = 0, din_act = 0, dout_act = 0;
+    const uint8_t * cmdp = get_scsi_pt_cdb_buf(vp);
+    const uint8_t * sbp = get_scsi_pt_sense_buf(vp);
+    struct sg_pt_trace_buf * bp = sg_pt_trace_tls;
+    uint8_t * rp;
+
+    if (NULL == bp) {
+        bp = (struct sg_pt_trace_buf *)calloc(1, sizeof(*bp));
+        if (NULL == bp)
+            return;
+        sg_pt_lock_init(&bp->lock);
+        sg_pt_lock(&sg_pt_trace_lock);
+        bp->thr_id = ++sg_pt_trace_num_thr;
+        bp->next = sg_pt_trace_buf_head;
+        sg_pt_trace_buf_head = bp;
+        sg_pt_unlock(&sg_pt_trace_lock);
+        sg_pt_trace_tls = bp;
+    }
+    cmd_len = cmdp ? get_scsi_pt_cdb_len(vp) : 0;
+    if (cmd_len > SG_PT_TRACE_MAX_CMD_LEN)
+        cmd_len = SG_PT_TRACE_MAX_CMD_LEN;
+    else if (cmd_len < 0)
+        cmd_len = 0;
+    sense_len = sbp ? get_scsi_pt_sense_len(vp) : 0;
+    if (sense_len > SG_PT_TRACE_MAX_SENSE_LEN)
+        sense_len = SG_PT_TRACE_MAX_SENSE_LEN;
+    else if (sense_len < 0)
+        sense_len = 0;
+    get_pt_req_lengths(vp, &din_len, &dout_len);
+    get_pt_actual_lengths(vp, &din_act, &dout_act);
+    rec_len = (SG_PT_TRACE_FIXED_LEN + cmd_len + sense_len + 7) & ~7;
+
+    sg_pt_lock(&bp->lock);
+    if ((bp->len + rec_len) > SG_PT_TRACE_BUF_SZ)
+        sg_pt_trace_write_buf(bp);
+    rp = bp->b + bp->len;
+    memset(rp, 0, rec_len);
+    sg_put_unaligned_le16(rec_len, rp + 0);
+    rp[2] = (uint8_t)kind;
+    rp[3] = (uint8_t)category;
+    rp[4] = (uint8_t)cmd_len;
+    rp[5] = (uint8_t)sense_len;
+    sg_put_unaligned_le16(get_scsi_pt_status_response(vp), rp + 6);
+    sg_put_unaligned_le32(bp->thr_id, rp + 8);
+    sg_put_unaligned_le32((uint32_t)res, rp + 12);
+    sg_put_unaligned_le64(start_ns, rp + 16);
+    sg_put_unaligned_le64(dur_ns, rp + 24);
+    sg_put_unaligned_le32(din_len, rp + 32);
+    sg_put_unaligned_le32(dout_len, rp + 36);
+    sg_put_unaligned_le32(din_act, rp + 40);
+    sg_put_unaligned_le32(dout_act, rp + 44);
+    if (cmd_len > 0)
+        memcpy(rp + SG_PT_TRACE_FIXED_LEN, cmdp, cmd_len);
+    if (sense_len > 0)
+        memcpy(rp + SG_PT_TRACE_FIXED_LEN + cmd_len, sbp, sense_len);
+    bp->len += rec_len;
+    sg_pt_unlock(&bp->lock);
+}
+
+int
+sg_pt_trace_hdr_check(const uint8_t * bp, int blen)
+{
+    return sg_pt_sink_hdr_check(sg_pt_trace_magic, SG_PT_TRACE_VERSION, bp,
+                                blen);
+}
+
+int
+sg_pt_trace_decode(const uint8_t * bp, int blen, struct sg_pt_trace_rec * rp)
+{
+    int rec_len;
+
+    if (blen < 2)
+        return 0;
+    rec_len = sg_get_unaligned_le16(bp + 0);
+    if ((rec_len < SG_PT_TRACE_FIXED_LEN) || (rec_len & 7))
+        return -1;
+    if (rec_len > blen)
+        return 0;
+    memset(rp, 0, sizeof(*rp));
+    rp->kind = bp[2];
+    rp->category = bp[3];
+    rp->cmd_len = bp[4];
+    rp->sense_len = bp[5];
+    if ((rp->cmd_len > SG_PT_TRACE_MAX_CMD_LEN) ||
+        (rp->sense_len > SG_PT_TRACE_MAX_SENSE_LEN) ||
+        ((SG_PT_TRACE_FIXED_LEN + rp->cmd_len + rp->sense_len) > rec_len))
+        return -1;
+    rp->status = sg_get_unaligned_le16(bp + 6);
+    rp->thr_id = (int)sg_get_unaligned_le32(bp + 8);
+    rp->res = (int)sg_get_unaligned_le32(bp + 12);
+    rp->start_ns = sg_get_unaligned_le64(bp + 16);
+    rp->dur_ns = sg_get_unaligned_le64(bp + 24);
+    rp->din_len = sg_get_unaligned_le32(bp + 32);
+    rp->dout_len = sg_get_unaligned_le32(bp + 36);
+    rp->din_act = sg_get_unaligned_le32(bp + 40);
+    rp->dout_act = sg_get_unaligned_le32(bp + 44);
+    memcpy(rp->cmd, bp + SG_PT_TRACE_FIXED_LEN, rp->cmd_len);
+    memcpy(rp->sense, bp + SG_PT_TRACE_FIXED_LEN + rp->cmd_len,
+           rp->sense_len);
+    return rec_len;
+}
+
+
+/* Command recording file layout, all integers little endian. A sink
+ * header with magic "SGPTREC". Records follow, each a 40 byte fixed part:
+ *     0  u32  record length (multiple of 8)
+ *     4  u8   kind     5  u8 category     6  u8 command length
+ *     7  u8   sense length     8  u16 status    10  u16 reserved
+ *    12  s32  do_scsi_pt() result     16  u64 duration_ns
+ *    24  u32  din_len  28 u32 din bytes recorded  32 u32 dout_len
+ *    36  u32  NVMe completion result (DW0)
+ * then the command, sense and data-in bytes, zero padded. Unlike the
+ * trace, records are written as each command completes. */
+#define SG_PT_RECORD_VERSION 1
+#define SG_PT_RECORD_FIXED_LEN 40
+
+static const char sg_pt_record_magic[8] = "SGPTREC";
+
+static void sg_pt_record_env(void);
+
+static struct sg_pt_sink sg_pt_record_sink = {
+    SG_PT_RECORD_ENV, sg_pt_record_magic, SG_PT_RECORD_VERSION,
+    sg_pt_record_stop, sg_pt_record_env, SG_PT_ONCE_INIT, -1, false, NULL,
+    SG_PT_LOCK_INITIALIZER,
+};
+
+static void
+sg_pt_record_env(void)
+{
+    sg_pt_sink_env(&sg_pt_record_sink);
+}
+
+int
+sg_pt_record_start(const char * fname)
+{
+    sg_pt_record_stop();
+    return sg_pt_sink_start(&sg_pt_record_sink, fname);
+}
+
+bool
+sg_pt_record_on(void)
+{
+    return sg_pt_sink_on(&sg_pt_record_sink);
+}
+
+void
+sg_pt_record_stop(void)
+{
+    sg_pt_sink_stop(&sg_pt_record_sink);
+}
+
+static void
+sg_pt_record_add(const struct sg_pt_base * vp, int kind, int category,
+                 int res, uint64_t dur_ns, const uint8_t * dinp)
+{
+    int cmd_len, sense_len, pad_len;
+    int din_len = 0, dout_len = 0, din_act = 0, dout_act = 0;
+    const uint8_t * cmdp = get_scsi_pt_cdb_buf(vp);
+    const uint8_t * sbp = get_scsi_pt_sense_buf(vp);
+    uint8_t fixed[SG_PT_RECORD_FIXED_LEN];
+    static const uint8_t zeros[8];
+    FILE * fp;
+
+    cmd_len = cmdp ? get_scsi_pt_cdb_len(vp) : 0;
+    if (cmd_len > 255)
+        cmd_len = 255;
+    else if (cmd_len < 0)
+        cmd_len = 0;
+    sense_len = sbp ? get_scsi_pt_sense_len(vp) : 0;
+    if (sense_len > 255)
+        sense_len = 255;
+    else if (sense_len < 0)
+        sense_len = 0;
+    get_pt_req_lengths(vp, &din_len, &dout_len);
+    get_pt_actual_lengths(vp, &din_act, &dout_act);
+    if ((NULL == dinp) || (din_act < 0))
+        din_act = 0;
+    else if (din_act > din_len)
+        din_act = din_len;
+    pad_len = (8 - ((cmd_len + sense_len + din_act) & 7)) & 7;
+
+    memset(fixed, 0, sizeof(fixed));
+    sg_put_unaligned_le32(SG_PT_RECORD_FIXED_LEN + cmd_len + sense_len +
+                          din_act + pad_len, fixed + 0);
+    fixed[4] = (uint8_t)kind;
+    fixed[5] = (uint8_t)category;
+    fixed[6] = (uint8_t)cmd_len;
+    fixed[7] = (uint8_t)sense_len;
+    sg_put_unaligned_le16(get_scsi_pt_status_response(vp), fixed + 8);
+    sg_put_unaligned_le32((uint32_t)res, fixed + 12);
+    sg_put_unaligned_le64(dur_ns, fixed + 16);
+    sg_put_unaligned_le32(din_len, fixed + 24);
+    sg_put_unaligned_le32(din_act, fixed + 28);
+    sg_put_unaligned_le32(dout_len, fixed + 32);
+    sg_put_unaligned_le32(get_pt_result(vp), fixed + 36);
+
+    sg_pt_lock(&sg_pt_record_sink.lock);
+    fp = sg_pt_record_sink.fp;
+    if (fp) {
+        fwrite(fixed, 1, sizeof(fixed), fp);
+        if (cmd_len > 0)
+            fwrite(cmdp, 1, cmd_len, fp);
+        if (sense_len > 0)
+            fwrite(sbp, 1, sense_len, fp);
+        if (din_act > 0)
+            fwrite(dinp, 1, din_act, fp);
+        if (pad_len > 0)
+            fwrite(zeros, 1, pad_len, fp);
+    }
+    sg_pt_unlock(&sg_pt_record_sink.lock);
+}
+
+int
+sg_pt_record_hdr_check(const uint8_t * bp, int blen)
+{
+    return sg_pt_sink_hdr_check(sg_pt_record_magic, SG_PT_RECORD_VERSION,
+                                bp, blen);
+}
+
+int
+sg_pt_record_decode(const uint8_t * bp, int blen,
+                    struct sg_pt_record_rec * rp)
+{
+    uint32_t rec_len;
+
+    if (blen < 4)
+        return 0;
+    rec_len = sg_get_unaligned_le32(bp + 0);
+    if ((rec_len < SG_PT_RECORD_FIXED_LEN) || (rec_len & 7) ||
+        (rec_len > INT32_MAX))
+        return -1;
+    if (rec_len > (uint32_t)blen)
+        return 0;
+    rp->kind = bp[4];
+    rp->category = bp[5];
+    rp->cmd_len = bp[6];
+    rp->sense_len = bp[7];
+    rp->status = sg_get_unaligned_le16(bp + 8);
+    rp->res = (int)sg_get_unaligned_le32(bp + 12);
+    rp->dur_ns = sg_get_unaligned_le64(bp + 16);
+    rp->din_len = sg_get_unaligned_le32(bp + 24);
+    rp->din_act = sg_get_unaligned_le32(bp + 28);
+    rp->dout_len = sg_get_unaligned_le32(bp + 32);
+    rp->result = sg_get_unaligned_le32(bp + 36);
+    if (((uint64_t)SG_PT_RECORD_FIXED_LEN + rp->cmd_len + rp->sense_len +
+         rp->din_act) > rec_len)
+        return -1;
+    rp->cmdp = bp + SG_PT_RECORD_FIXED_LEN;
+    rp->sensep = rp->cmdp + rp->cmd_len;
+    rp->dinp = rp->sensep + rp->sense_len;
+    return (int)rec_len;
+}
+
+bool
+sg_pt_observe_on(void)
+{
+    bool stats = sg_pt_stats_on();
+    bool trace = sg_pt_trace_on();
+
+    return sg_pt_record_on() || trace || stats;
+}
+
+void
+sg_pt_observe_done(const struct sg_pt_base * vp, int kind, int res,
+                   uint64_t start_ns, const uint8_t * dinp)
+{
+    int cat = (0 == res) ? get_scsi_pt_result_category(vp) :
+                           SCSI_PT_RESULT_OS_ERR;
+    uint64_t dur_ns = sg_pt_stats_now_ns() - start_ns;
+
+    if (sg_pt_stats_state > 0)
+        sg_pt_stats_record(kind, get_scsi_pt_cdb_buf(vp), cat, dur_ns);
+    if (sg_pt_trace_sink.state > 0)
+        sg_pt_trace_record(vp, kind, cat, res, start_ns, dur_ns);
+    if (sg_pt_record_sink.state > 0)
+        sg_pt_record_add(vp, kind, cat, res, dur_ns, dinp);
+}
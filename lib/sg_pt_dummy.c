@@ -19,10 +19,11 @@
 #include <errno.h>
 
 #include "sg_pt.h"
+#include "sg_pt_emul.h"
 #include "sg_lib.h"
 #include "sg_pr2serr.h"
 
-/* Version 1.02 20210618 */
+/* Version 1.03 20261016 */
 
 /* List of function names with external linkage that need to be defined
  *
@@ -32,11 +33,17 @@
  *   construct_scsi_pt_obj_with_fd
  *   destruct_scsi_pt_obj
  *   do_scsi_pt
+ *   do_scsi_pt_mrq
+ *   do_scsi_pt_mrq_reap
+ *   do_scsi_pt_reap
+ *   do_scsi_pt_submit
  *   do_nvm_pt
  *   get_pt_actual_lengths
  *   get_pt_duration_ns
  *   get_pt_file_handle
+ *   get_pt_num_pending
  *   get_pt_nvme_nsid
+ *   get_pt_poll_fd
  *   get_pt_req_lengths
  *   get_pt_result
  *   get_scsi_pt_cdb_buf
@@ -53,6 +60,7 @@
  *   get_scsi_pt_transport_err_str
  *   partial_clear_scsi_pt_obj
  *   pt_device_is_nvme
+ *   scsi_pt_async_release
  *   scsi_pt_close_device
  *   scsi_pt_open_device
  *   scsi_pt_open_flags
@@ -110,6 +118,8 @@ scsi_pt_open_flags(const char * device_name, int flags, int verbose)
 int
 scsi_pt_close_device(int device_fd)
 {
+    sg_pt_emul_release(device_fd);
+    scsi_pt_pool_flush(device_fd);
     if (device_fd) {}
     return 0;
 }
@@ -261,6 +271,59 @@ do_scsi_pt(struct sg_pt_base * vp, int device_fd, int time_secs, int verbose)
     return 0;
 }
 
+/* Loopback version of the asynchronous interface: each submitted command
+ * completes at once (doing nothing, like do_scsi_pt() above) and is handed
+ * back by do_scsi_pt_reap(). Any value may be used as the file descriptor.
+ * This allows callers of the asynchronous interface to be tested without
+ * a device. */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int dev_fd, int time_secs,
+                  int verbose)
+{
+    return sg_pt_emul_submit(vp, dev_fd, time_secs, verbose);
+}
+
+int
+do_scsi_pt_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                int verbose)
+{
+    return sg_pt_emul_reap(dev_fd, wait, objpp, verbose);
+}
+
+int
+get_pt_poll_fd(int dev_fd, int verbose)
+{
+    return sg_pt_emul_poll_fd(dev_fd, verbose);
+}
+
+int
+get_pt_num_pending(int dev_fd)
+{
+    return sg_pt_emul_num_pending(dev_fd);
+}
+
+void
+scsi_pt_async_release(int dev_fd)
+{
+    sg_pt_emul_release(dev_fd);
+}
+
+/* Multiple requests are emulated too (see sg_pt_common.c) */
+int
+do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int dev_fd,
+               int time_secs, int mrq_flags, int * num_donep, int verbose)
+{
+    return sg_pt_emul_mrq(objpp, num, dev_fd, time_secs, mrq_flags,
+                          num_donep, verbose);
+}
+
+int
+do_scsi_pt_mrq_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                    int max, int verbose)
+{
+    return sg_pt_emul_mrq_reap(dev_fd, wait, objpp, max, verbose);
+}
+
 int
 get_scsi_pt_result_category(const struct sg_pt_base * vp)
 {
@@ -0,0 +1,55 @@
+#ifndef SG_PT_EMUL_H
+#define SG_PT_EMUL_H
+
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* This header is private to the library (it is not installed). It is for
+ * OS interfaces (i.e. sg_pt_<os>.c files) that have no native asynchronous
+ * or multiple requests pass-through. The functions are defined in
+ * sg_pt_common.c . Applications call do_scsi_pt_submit(), do_scsi_pt_mrq()
+ * and friends declared in sg_pt.h instead. */
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sg_pt_base;
+
+/* Emulate do_scsi_pt_submit() and friends by calling do_scsi_pt() at
+ * submit time and queuing the completed object for do_scsi_pt_reap().
+ * The queues are per file descriptor and protected by a lock. The state
+ * of a file descriptor is freed by sg_pt_emul_release(), which
+ * scsi_pt_close_device() and scsi_pt_async_release() call. If fd now
+ * refers to another file than when its state was created, that (stale)
+ * state is dropped at the next submit. */
+int sg_pt_emul_submit(struct sg_pt_base * objp, int fd, int timeout_secs,
+                      int verbose);
+int sg_pt_emul_reap(int fd, bool wait, struct sg_pt_base ** objpp,
+                    int verbose);
+int sg_pt_emul_poll_fd(int fd, int verbose);
+int sg_pt_emul_num_pending(int fd);
+void sg_pt_emul_release(int fd);
+
+/* MRQ emulation built on do_scsi_pt() and do_scsi_pt_submit(). For OS
+ * interfaces (or device types) without a native multiple requests
+ * mechanism. */
+int sg_pt_emul_mrq(struct sg_pt_base ** objpp, int num, int fd,
+                   int timeout_secs, int mrq_flags, int * num_donep,
+                   int verbose);
+int sg_pt_emul_mrq_reap(int fd, bool wait, struct sg_pt_base ** objpp,
+                        int max, int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* SG_PT_EMUL_H */
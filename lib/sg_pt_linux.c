@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_linux version 1.56 20230412 */
+/* sg_pt_linux version 1.57 20261016 */
 
 
 #include <stdio.h>
@@ -19,6 +19,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>      /* to define 'major' */
@@ -36,9 +38,11 @@
 #endif
 
 #include "sg_pt.h"
+#include "sg_pt_emul.h"
 #include "sg_lib.h"
 #include "sg_linux_inc.h"
 #include "sg_pt_linux.h"
+#include "sg_blkemu.h"
 #include "sg_pr2serr.h"
 
 
@@ -124,6 +128,9 @@ bool sg_duration_set_nano = false;
 
 long sg_lin_page_size = 4096;   /* default, overridden with correct value */
 
+static void pt_async_release(int dev_fd);
+static void pt_poll_release(int dev_fd);
+
 
 /* This function only needs to be called once (unless a NVMe controller
  * can be hot-plugged into system in which case it should be called
@@ -375,6 +382,8 @@ scsi_pt_open_flags(const char * device_name, int flags, int verbose)
     if (verbose > 1) {
         pr2ws("open %s with flags=0x%x\n", device_name, flags);
     }
+    if (sg_blkemu_is_name(device_name))
+        return sg_blkemu_open(device_name, flags, verbose);
     fd = open(device_name, flags);
     if (fd < 0) {
         fd = -errno;
@@ -401,6 +410,11 @@ scsi_pt_close_device(int device_fd)
 {
     int res;
 
+    pt_async_release(device_fd);
+    pt_poll_release(device_fd);
+    scsi_pt_pool_flush(device_fd);
+    if (sg_blkemu_is_fd(device_fd))
+        return sg_blkemu_close(device_fd);
     res = close(device_fd);
     if (res < 0)
         res = -errno;
@@ -480,16 +494,19 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
     struct sg_pt_linux_scsi * ptp = &vp->impl;
 
     if (ptp) {
-        bool is_sg, is_bsg, is_nvme;
-        int fd;
-        uint32_t nvme_nsid;
+        bool is_sg, is_bsg, is_nvme, is_blkemu;
+        int fd, sg_version;
+        uint32_t nvme_nsid, nvme_lb_sz;
         struct sg_snt_dev_state_t dev_stat;
 
         fd = ptp->dev_fd;
         is_sg = ptp->is_sg;
         is_bsg = ptp->is_bsg;
         is_nvme = ptp->is_nvme;
+        is_blkemu = ptp->is_blkemu;
+        sg_version = ptp->sg_version;
         nvme_nsid = ptp->nvme_nsid;
+        nvme_lb_sz = ptp->nvme_lb_sz;
         dev_stat = ptp->dev_stat;
         if (ptp->free_nvme_id_ctlp)
             free(ptp->free_nvme_id_ctlp);
@@ -505,8 +522,11 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
         ptp->is_sg = is_sg;
         ptp->is_bsg = is_bsg;
         ptp->is_nvme = is_nvme;
+        ptp->is_blkemu = is_blkemu;
+        ptp->sg_version = sg_version;
         ptp->nvme_our_snt = false;
         ptp->nvme_nsid = nvme_nsid;
+        ptp->nvme_lb_sz = nvme_lb_sz;
         ptp->dev_stat = dev_stat;
     }
 }
@@ -571,7 +591,14 @@ set_pt_file_handle(struct sg_pt_base * vp, int dev_fd, int verbose)
     struct stat a_stat;
 
     ptp->dev_fd = dev_fd;
-    if (dev_fd >= 0) {
+    ptp->nvme_lb_sz = 0;
+    ptp->is_blkemu = sg_blkemu_is_fd(dev_fd);
+    if (ptp->is_blkemu) {
+        ptp->is_sg = false;
+        ptp->is_bsg = false;
+        ptp->is_nvme = false;
+        ptp->os_err = 0;
+    } else if (dev_fd >= 0) {
         ptp->is_sg = check_file_type(dev_fd, &a_stat, &ptp->is_bsg,
                                      &ptp->is_nvme, &ptp->nvme_nsid,
                                      &ptp->os_err, verbose);
@@ -798,6 +825,9 @@ set_scsi_pt_task_attr(struct sg_pt_base * vp, int attribute, int priority)
 #ifndef SG_FLAG_Q_AT_HEAD
 #define SG_FLAG_Q_AT_HEAD 0x20
 #endif
+#ifndef SGV4_FLAG_HIPRI
+#define SGV4_FLAG_HIPRI 0x800   /* sg driver polls for completion */
+#endif
 
 void
 set_scsi_pt_flags(struct sg_pt_base * vp, int flags)
@@ -813,6 +843,8 @@ set_scsi_pt_flags(struct sg_pt_base * vp, int flags)
         ptp->io_hdr.flags |= BSG_FLAG_Q_AT_TAIL;
         ptp->io_hdr.flags &= ~BSG_FLAG_Q_AT_HEAD;
     }
+    ptp->async_more = !! (SCSI_PT_FLAGS_MORE & flags);
+    ptp->hipri = !! (SCSI_PT_FLAGS_HIPRI & flags);
 }
 
 /* If supported it is the number of bytes requested to transfer less the
@@ -1058,50 +1090,76 @@ get_pt_nvme_nsid(const struct sg_pt_base * vp)
     return ptp->nvme_nsid;
 }
 
-/* Executes SCSI command using sg v3 interface */
+/* Builds a sg v3 header in *hp from the v4 header held in ptp. Returns 0
+ * or SCSI_PT_DO_BAD_PARAMS. */
 static int
-do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
-              int verbose)
+v4_to_v3_hdr(const struct sg_pt_linux_scsi * ptp, struct sg_io_hdr * hp,
+             int time_secs, int verbose)
 {
-    struct sg_io_hdr v3_hdr;
-
-    memset(&v3_hdr, 0, sizeof(v3_hdr));
-    /* convert v4 to v3 header */
-    v3_hdr.interface_id = 'S';
-    v3_hdr.dxfer_direction = SG_DXFER_NONE;
-    v3_hdr.cmdp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
-    v3_hdr.cmd_len = (uint8_t)ptp->io_hdr.request_len;
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->dxfer_direction = SG_DXFER_NONE;
+    hp->cmdp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+    hp->cmd_len = (uint8_t)ptp->io_hdr.request_len;
     if (ptp->io_hdr.din_xfer_len > 0) {
         if (ptp->io_hdr.dout_xfer_len > 0) {
             if (verbose)
                 pr2ws("sgv3 doesn't support bidi\n");
             return SCSI_PT_DO_BAD_PARAMS;
         }
-        v3_hdr.dxferp = (void *)(long)ptp->io_hdr.din_xferp;
-        v3_hdr.dxfer_len = (unsigned int)ptp->io_hdr.din_xfer_len;
-        v3_hdr.dxfer_direction =  SG_DXFER_FROM_DEV;
+        hp->dxferp = (void *)(long)ptp->io_hdr.din_xferp;
+        hp->dxfer_len = (unsigned int)ptp->io_hdr.din_xfer_len;
+        hp->dxfer_direction =  SG_DXFER_FROM_DEV;
     } else if (ptp->io_hdr.dout_xfer_len > 0) {
-        v3_hdr.dxferp = (void *)(long)ptp->io_hdr.dout_xferp;
-        v3_hdr.dxfer_len = (unsigned int)ptp->io_hdr.dout_xfer_len;
-        v3_hdr.dxfer_direction =  SG_DXFER_TO_DEV;
+        hp->dxferp = (void *)(long)ptp->io_hdr.dout_xferp;
+        hp->dxfer_len = (unsigned int)ptp->io_hdr.dout_xfer_len;
+        hp->dxfer_direction =  SG_DXFER_TO_DEV;
     }
     if (ptp->io_hdr.response && (ptp->io_hdr.max_response_len > 0)) {
-        v3_hdr.sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
-        v3_hdr.mx_sb_len = (uint8_t)ptp->io_hdr.max_response_len;
+        hp->sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
+        hp->mx_sb_len = (uint8_t)ptp->io_hdr.max_response_len;
     }
-    v3_hdr.pack_id = (int)ptp->io_hdr.request_extra;
+    hp->pack_id = (int)ptp->io_hdr.request_extra;
     if (BSG_FLAG_Q_AT_HEAD & ptp->io_hdr.flags)
-        v3_hdr.flags |= SG_FLAG_Q_AT_HEAD;      /* favour AT_HEAD */
+        hp->flags |= SG_FLAG_Q_AT_HEAD;      /* favour AT_HEAD */
     else if (BSG_FLAG_Q_AT_TAIL & ptp->io_hdr.flags)
-        v3_hdr.flags |= SG_FLAG_Q_AT_TAIL;
+        hp->flags |= SG_FLAG_Q_AT_TAIL;
 
-    if (NULL == v3_hdr.cmdp) {
+    if (NULL == hp->cmdp) {
         if (verbose)
             pr2ws("No SCSI command (cdb) given [v3]\n");
         return SCSI_PT_DO_BAD_PARAMS;
     }
     /* io_hdr.timeout is in milliseconds, if greater than zero */
-    v3_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
+    hp->timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
+    return 0;
+}
+
+/* Copies the response fields of a completed sg v3 header into the v4
+ * header held in ptp */
+static void
+v3_resp_to_v4(struct sg_pt_linux_scsi * ptp, const struct sg_io_hdr * hp)
+{
+    ptp->io_hdr.device_status = (__u32)hp->status;
+    ptp->io_hdr.driver_status = (__u32)hp->driver_status;
+    ptp->io_hdr.transport_status = (__u32)hp->host_status;
+    ptp->io_hdr.response_len = (__u32)hp->sb_len_wr;
+    ptp->io_hdr.duration = (__u32)hp->duration;
+    ptp->io_hdr.din_resid = (__s32)hp->resid;
+    /* hp->info not passed back since no mapping defined (yet) */
+}
+
+/* Executes SCSI command using sg v3 interface */
+static int
+do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
+              int verbose)
+{
+    int res;
+    struct sg_io_hdr v3_hdr;
+
+    res = v4_to_v3_hdr(ptp, &v3_hdr, time_secs, verbose);
+    if (res)
+        return res;
     /* Finally do the v3 SG_IO ioctl */
     if (ioctl(fd, SG_IO, &v3_hdr) < 0) {
         ptp->os_err = errno;
@@ -1110,16 +1168,20 @@ do_scsi_pt_v3(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
                   safe_strerror(ptp->os_err), ptp->os_err);
         return -ptp->os_err;
     }
-    ptp->io_hdr.device_status = (__u32)v3_hdr.status;
-    ptp->io_hdr.driver_status = (__u32)v3_hdr.driver_status;
-    ptp->io_hdr.transport_status = (__u32)v3_hdr.host_status;
-    ptp->io_hdr.response_len = (__u32)v3_hdr.sb_len_wr;
-    ptp->io_hdr.duration = (__u32)v3_hdr.duration;
-    ptp->io_hdr.din_resid = (__s32)v3_hdr.resid;
-    /* v3_hdr.info not passed back since no mapping defined (yet) */
+    v3_resp_to_v4(ptp, &v3_hdr);
     return 0;
 }
 
+/* Only the sg driver knows SGV4_FLAG_HIPRI, bsg would reject it */
+static inline void
+pt_set_v4_hipri(struct sg_pt_linux_scsi * ptp)
+{
+    if (ptp->hipri && ptp->is_sg)
+        ptp->io_hdr.flags |= SGV4_FLAG_HIPRI;
+    else
+        ptp->io_hdr.flags &= ~SGV4_FLAG_HIPRI;
+}
+
 /* Executes SCSI command using sg v4 interface */
 static int
 do_scsi_pt_v4(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
@@ -1130,6 +1192,7 @@ do_scsi_pt_v4(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
             pr2ws("No SCSI command (cdb) given [v4]\n");
         return SCSI_PT_DO_BAD_PARAMS;
     }
+    pt_set_v4_hipri(ptp);
     /* io_hdr.timeout is in milliseconds, if greater than zero */
     ptp->io_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) : DEF_TIMEOUT);
     if (ioctl(fd, SG_IO, &ptp->io_hdr) < 0) {
@@ -1142,14 +1205,15 @@ do_scsi_pt_v4(struct sg_pt_linux_scsi * ptp, int fd, int time_secs,
     return 0;
 }
 
-/* Executes SCSI command (or at least forwards it to lower layers).
- * Returns 0 for success, negative numbers are negated 'errno' values from
- * OS system calls. Positive return values are errors from this package. */
-int
-do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+/* Checks fd against the one (if any) already associated with vp and, if
+ * not done already, finds the file type. Returns 0 and the file descriptor
+ * to use in *fdp, or the same error values as do_scsi_pt(). */
+static int
+pt_check_fd(struct sg_pt_base * vp, int * fdp, int verbose)
 {
     struct sg_pt_linux_scsi * ptp = &vp->impl;
     bool have_checked_for_type = (ptp->dev_fd >= 0);
+    int fd = *fdp;
 
     if (ptp->in_err) {
         if (verbose)
@@ -1178,11 +1242,162 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
     }
     if (ptp->os_err)
         return -ptp->os_err;
+    *fdp = fd;
+    return 0;
+}
+
+/* Executes the SCSI command on an emulated block device (see sg_blkemu.h)
+ * in the calling thread */
+static int
+do_scsi_pt_blkemu(struct sg_pt_linux_scsi * ptp, int fd, int verbose)
+{
+    int res;
+    uint64_t t0 = sg_pt_stats_now_ns();
+    struct sg_blkemu_io bio;
+
+    memset(&bio, 0, sizeof(bio));
+    bio.cdbp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+    bio.cdb_len = ptp->io_hdr.request_len;
+    bio.dinp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+    bio.din_len = ptp->io_hdr.din_xfer_len;
+    bio.doutp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+    bio.dout_len = ptp->io_hdr.dout_xfer_len;
+    bio.sbp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.response;
+    bio.mx_sb_len = ptp->io_hdr.max_response_len;
+    res = sg_blkemu_do(fd, &bio, verbose);
+    if (res) {
+        ptp->os_err = -res;
+        return res;
+    }
+    ptp->io_hdr.device_status = bio.status;
+    ptp->io_hdr.response_len = bio.sb_len_wr;
+    ptp->io_hdr.din_resid = bio.din_resid;
+    ptp->io_hdr.dout_resid = bio.dout_resid;
+    t0 = sg_pt_stats_now_ns() - t0;
+    ptp->io_hdr.duration = sg_duration_set_nano ? t0 : (t0 / 1000000);
+    return 0;
+}
+
+/* Synchronous commands flagged SCSI_PT_FLAGS_HIPRI to a NVMe generic char
+ * device are sent through an io_uring set up with IORING_SETUP_IOPOLL, one
+ * per file descriptor. Its lock is held from submission to completion so
+ * polled commands on the same file descriptor are serialized. If dev_fd
+ * is some other device (or the kernel lacks support) urp is NULL and the
+ * command is sent normally. */
+struct pt_poll_ring {
+    int dev_fd;
+    struct sg_nvme_uring * urp;
+    pthread_mutex_t lock;
+    struct pt_poll_ring * next;
+};
+
+static pthread_mutex_t pt_poll_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pt_poll_ring * pt_poll_list;
+
+static struct pt_poll_ring *
+pt_poll_find(int dev_fd, int verbose)
+{
+    bool is_bsg, is_nvme;
+    int os_err = 0;
+    uint32_t nsid;
+    struct pt_poll_ring * prp;
+    struct stat a_stat;
+
+    pthread_mutex_lock(&pt_poll_list_lock);
+    for (prp = pt_poll_list; prp; prp = prp->next) {
+        if (dev_fd == prp->dev_fd)
+            goto fini;
+    }
+    prp = (struct pt_poll_ring *)calloc(1, sizeof(*prp));
+    if (NULL == prp)
+        goto fini;
+    prp->dev_fd = dev_fd;
+    check_file_type(dev_fd, &a_stat, &is_bsg, &is_nvme, &nsid, &os_err,
+                    verbose);
+    if ((0 == os_err) && is_nvme && S_ISCHR(a_stat.st_mode) &&
+        (sg_nvme_gen_char_major == (int)SG_DEV_MAJOR(a_stat.st_rdev)))
+        sg_nvme_uring_new(dev_fd, true, &prp->urp, verbose);
+    if (verbose > 3)
+        pr2ws("%s: dev_fd=%d, %s\n", __func__, dev_fd,
+              prp->urp ? "polled io_uring" : "not polled");
+    pthread_mutex_init(&prp->lock, NULL);
+    prp->next = pt_poll_list;
+    pt_poll_list = prp;
+fini:
+    pthread_mutex_unlock(&pt_poll_list_lock);
+    return prp;
+}
+
+/* Called when dev_fd is closed */
+static void
+pt_poll_release(int dev_fd)
+{
+    struct pt_poll_ring * prp;
+    struct pt_poll_ring ** prevpp;
+
+    pthread_mutex_lock(&pt_poll_list_lock);
+    for (prevpp = &pt_poll_list; *prevpp; prevpp = &(*prevpp)->next) {
+        if (dev_fd == (*prevpp)->dev_fd)
+            break;
+    }
+    prp = *prevpp;
+    if (prp)
+        *prevpp = prp->next;
+    pthread_mutex_unlock(&pt_poll_list_lock);
+    if (NULL == prp)
+        return;
+    sg_nvme_uring_free(prp->urp);
+    pthread_mutex_destroy(&prp->lock);
+    free(prp);
+}
+
+/* Returns -EOPNOTSUPP if the command should be sent normally, otherwise
+ * what do_scsi_pt() should return */
+static int
+do_scsi_pt_polled(struct sg_pt_base * vp, int fd, int time_secs,
+                  int verbose)
+{
+    int res;
+    struct pt_poll_ring * prp = pt_poll_find(fd, verbose);
+    struct sg_pt_base * got_vp = NULL;
+
+    if ((NULL == prp) || (NULL == prp->urp))
+        return -EOPNOTSUPP;
+    pthread_mutex_lock(&prp->lock);
+    res = sg_nvme_uring_prep(prp->urp, vp, time_secs, verbose);
+    if (0 == res)
+        res = sg_nvme_uring_reap(prp->urp, true, &got_vp, verbose);
+    pthread_mutex_unlock(&prp->lock);
+    if ((0 == res) && (got_vp != vp)) {
+        if (verbose)
+            pr2ws("%s: reaped unexpected object\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    return res;
+}
+
+/* Does the work of do_scsi_pt() */
+static int
+do_scsi_pt_low(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    int res = pt_check_fd(vp, &fd, verbose);
+
+    if (res)
+        return res;
     if (verbose > 5)
         pr2ws("%s:  is_nvme=%d, is_sg=%d, is_bsg=%d\n", __func__,
               (int)ptp->is_nvme, (int)ptp->is_sg, (int)ptp->is_bsg);
-    if (ptp->is_nvme)
+    if (ptp->is_blkemu)
+        return do_scsi_pt_blkemu(ptp, fd, verbose);
+    if (ptp->is_nvme) {
+        if (ptp->hipri) {
+            res = do_scsi_pt_polled(vp, fd, time_secs, verbose);
+            if (-EOPNOTSUPP != res)
+                return res;
+        }
         return sg_do_nvme_pt(vp, -1, time_secs, verbose);
+    }
     else if (ptp->is_sg) {
 #ifdef IGNORE_LINUX_SGV4
         return do_scsi_pt_v3(ptp, fd, time_secs, verbose);
@@ -1202,3 +1417,825 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
     pr2ws("%s: Should never reach this point\n", __func__);
     return 0;
 }
+
+/* Passes a completed command, started at start_ns, to the latency
+ * statistics and command trace. res is what do_scsi_pt() returned (or
+ * would have). */
+static void
+pt_observe_done(struct sg_pt_base * vp, int res, uint64_t start_ns)
+{
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    sg_pt_observe_done(vp, (ptp->is_nvme && (! ptp->nvme_our_snt)) ?
+                           SG_PT_STATS_KIND_NVME_ADMIN :
+                           SG_PT_STATS_KIND_SCSI, res, start_ns,
+                       (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp);
+}
+
+/* Executes SCSI command (or at least forwards it to lower layers).
+ * Returns 0 for success, negative numbers are negated 'errno' values from
+ * OS system calls. Positive return values are errors from this package.
+ * When sg_pt_observe_on() each command is timed for the latency
+ * statistics, command trace and recording. */
+int
+do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
+{
+    int res;
+    uint64_t t0;
+
+    if (! sg_pt_observe_on())
+        return do_scsi_pt_low(vp, fd, time_secs, verbose);
+    t0 = sg_pt_stats_now_ns();
+    res = do_scsi_pt_low(vp, fd, time_secs, verbose);
+    pt_observe_done(vp, res, t0);
+    return res;
+}
+
+/*
+ * Asynchronous submit/reap interface.
+ *
+ * The sg driver is natively asynchronous: with its v4 interface (sg driver
+ * 4.0.x and later) ioctl(SG_IOSUBMIT) and ioctl(SG_IORECEIVE) are used,
+ * otherwise write(2) and read(2) of a sg v3 header. In both cases usr_ptr
+ * carries the address of the pass-through object and the sg file descriptor
+ * itself is pollable. NVMe generic char devices (e.g. /dev/ng0n1) are
+ * driven through an io_uring (see sg_nvme_uring_new()) when the kernel
+ * supports IORING_OP_URING_CMD; submissions flagged SCSI_PT_FLAGS_MORE are
+ * batched into one io_uring_enter(2). If the first submission on such a
+ * device is flagged SCSI_PT_FLAGS_HIPRI, that io_uring is polled. Other
+ * devices (e.g. bsg, NVMe and block devices with SG_IO) only have a
+ * blocking interface, so a small pool of worker threads per file
+ * descriptor call do_scsi_pt() and a pipe, written once per completion, is
+ * the pollable file descriptor.
+ */
+
+#ifndef SG_IOCTL_MAGIC_NUM
+#define SG_IOCTL_MAGIC_NUM 0x22
+#endif
+#ifndef SG_IOSUBMIT
+#define SG_IOSUBMIT _IOWR(SG_IOCTL_MAGIC_NUM, 0x41, struct sg_io_v4)
+#endif
+#ifndef SG_IORECEIVE
+#define SG_IORECEIVE _IOWR(SG_IOCTL_MAGIC_NUM, 0x42, struct sg_io_v4)
+#endif
+
+#define PT_ASYNC_MAX_THR 8      /* worker threads per file descriptor */
+#define PT_ASYNC_MAX_PENDING 4096
+
+enum pt_async_mode {
+    PT_ASYNC_SG_V3 = 0,         /* write() and read() on sg device */
+    PT_ASYNC_SG_V4,             /* SG_IOSUBMIT and SG_IORECEIVE ioctls */
+    PT_ASYNC_THR,               /* worker threads calling do_scsi_pt() */
+    PT_ASYNC_URING,             /* io_uring on NVMe generic char device */
+};
+
+struct pt_async_fd {
+    int dev_fd;
+    enum pt_async_mode mode;
+    uint64_t st_dev;            /* identify the file open on dev_fd ... */
+    uint64_t st_ino;            /* ... so that a reused fd is noticed */
+    int num_pending;            /* submitted, not yet reaped */
+    int num_mrq;                /* do_scsi_pt_mrq(IMMED) not yet reaped */
+    struct sg_nvme_uring * urp; /* only when mode is PT_ASYNC_URING */
+    /* remaining fields only used when mode is PT_ASYNC_THR */
+    bool stop;
+    int num_thr;
+    int num_idle;
+    int num_queued;             /* in submission queue */
+    int verbose;
+    int pipe_fds[2];            /* [0] is the pollable read side */
+    pthread_t thr[PT_ASYNC_MAX_THR];
+    pthread_mutex_t lock;       /* protects the queues and counters */
+    pthread_cond_t sq_cv;
+    struct sg_pt_base * sq_head;        /* submission queue */
+    struct sg_pt_base * sq_tail;
+    struct sg_pt_base * cq_head;        /* completion queue */
+    struct sg_pt_base * cq_tail;
+    struct pt_async_fd * next;
+};
+
+static pthread_mutex_t pt_async_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pt_async_fd * pt_async_list;
+
+
+static void *
+pt_async_worker(void * arg)
+{
+    struct pt_async_fd * afp = (struct pt_async_fd *)arg;
+    struct sg_pt_base * vp;
+    struct sg_pt_linux_scsi * ptp;
+    const uint8_t b = 0;
+
+    pthread_mutex_lock(&afp->lock);
+    while (true) {
+        while ((! afp->stop) && (NULL == afp->sq_head)) {
+            ++afp->num_idle;
+            pthread_cond_wait(&afp->sq_cv, &afp->lock);
+            --afp->num_idle;
+        }
+        if (afp->stop)
+            break;
+        vp = afp->sq_head;
+        ptp = &vp->impl;
+        afp->sq_head = ptp->async_next;
+        if (NULL == afp->sq_head)
+            afp->sq_tail = NULL;
+        --afp->num_queued;
+        pthread_mutex_unlock(&afp->lock);
+
+        ptp->async_next = NULL;
+        ptp->async_res = do_scsi_pt(vp, afp->dev_fd, ptp->async_tmo,
+                                    afp->verbose);
+
+        pthread_mutex_lock(&afp->lock);
+        if (afp->cq_tail)
+            afp->cq_tail->impl.async_next = vp;
+        else
+            afp->cq_head = vp;
+        afp->cq_tail = vp;
+        pthread_mutex_unlock(&afp->lock);
+        /* one byte per completion queue entry, written after it is added */
+        if (write(afp->pipe_fds[1], &b, 1) < 0) {
+            if (afp->verbose)
+                pr2ws("%s: pipe write failed: %s\n", __func__,
+                      safe_strerror(errno));
+        }
+        pthread_mutex_lock(&afp->lock);
+    }
+    pthread_mutex_unlock(&afp->lock);
+    return NULL;
+}
+
+static void pt_async_free(struct pt_async_fd * afp);
+
+/* Call with pt_async_list_lock held. Returns true if afp has nothing
+ * outstanding and its dev_fd now refers to a different file than when afp
+ * was created: the fd was closed without scsi_pt_async_release() and its
+ * number reused. */
+static bool
+pt_async_is_stale(struct pt_async_fd * afp)
+{
+    int num;
+    struct stat a_stat;
+
+    if (PT_ASYNC_THR == afp->mode) {
+        pthread_mutex_lock(&afp->lock);
+        num = afp->num_pending;
+        pthread_mutex_unlock(&afp->lock);
+    } else
+        num = afp->num_pending;
+    if ((num > 0) || (afp->num_mrq > 0))
+        return false;
+    if (fstat(afp->dev_fd, &a_stat) < 0)
+        return true;
+    return ((uint64_t)a_stat.st_dev != afp->st_dev) ||
+           ((uint64_t)a_stat.st_ino != afp->st_ino);
+}
+
+/* Returns the async state of dev_fd, creating it (and deciding how dev_fd
+ * will be driven) if 'create' is true. When created for a NVMe generic char
+ * device and 'hipri' is true, its io_uring polls for completions. Returns
+ * NULL if not found or, when creating, if an error occurs in which case
+ * *errp is set to a negated errno value. */
+static struct pt_async_fd *
+pt_async_find(int dev_fd, bool create, bool hipri, int * errp, int verbose)
+{
+    bool is_sg, is_bsg, is_nvme;
+    int os_err = 0;
+    int sg_ver = 0;
+    uint32_t nsid;
+    struct pt_async_fd * afp;
+    struct pt_async_fd * stale_afp = NULL;
+    struct pt_async_fd ** prevpp;
+    struct stat a_stat;
+
+    pthread_mutex_lock(&pt_async_list_lock);
+    for (prevpp = &pt_async_list; *prevpp; prevpp = &(*prevpp)->next) {
+        if (dev_fd == (*prevpp)->dev_fd)
+            break;
+    }
+    afp = *prevpp;
+    if (afp && create && pt_async_is_stale(afp)) {
+        if (verbose > 3)
+            pr2ws("%s: dev_fd=%d reused, dropping its old async state\n",
+                  __func__, dev_fd);
+        *prevpp = afp->next;
+        stale_afp = afp;
+        afp = NULL;
+    }
+    if (afp || (! create))
+        goto fini;
+    if (dev_fd < 0) {
+        *errp = -EBADF;
+        goto fini;
+    }
+    is_sg = check_file_type(dev_fd, &a_stat, &is_bsg, &is_nvme, &nsid,
+                            &os_err, verbose);
+    if (os_err) {
+        *errp = -os_err;
+        goto fini;
+    }
+    if (is_sg) {
+        if (sg_checked_version_num)
+            sg_ver = sg_driver_version_num;
+        else if (ioctl(dev_fd, SG_GET_VERSION_NUM, &sg_ver) < 0)
+            sg_ver = 0;
+    }
+    afp = (struct pt_async_fd *)calloc(1, sizeof(*afp));
+    if (NULL == afp) {
+        *errp = -ENOMEM;
+        goto fini;
+    }
+    afp->dev_fd = dev_fd;
+    afp->st_dev = (uint64_t)a_stat.st_dev;
+    afp->st_ino = (uint64_t)a_stat.st_ino;
+    afp->verbose = verbose;
+    afp->pipe_fds[0] = -1;
+    afp->pipe_fds[1] = -1;
+    if (is_sg) {
+#ifdef IGNORE_LINUX_SGV4
+        afp->mode = PT_ASYNC_SG_V3;
+#else
+        afp->mode = (sg_ver >= SG_LINUX_SG_VER_V4_BASE) ? PT_ASYNC_SG_V4 :
+                                                          PT_ASYNC_SG_V3;
+#endif
+    } else if (is_nvme && S_ISCHR(a_stat.st_mode) &&
+               (sg_nvme_gen_char_major ==
+                (int)SG_DEV_MAJOR(a_stat.st_rdev)) &&
+               (0 == sg_nvme_uring_new(dev_fd, hipri, &afp->urp, verbose)))
+        afp->mode = PT_ASYNC_URING;
+    else {
+        afp->mode = PT_ASYNC_THR;
+        if (pipe(afp->pipe_fds) < 0) {
+            *errp = -errno;
+            free(afp);
+            afp = NULL;
+            goto fini;
+        }
+        fcntl(afp->pipe_fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(afp->pipe_fds[1], F_SETFD, FD_CLOEXEC);
+        pthread_mutex_init(&afp->lock, NULL);
+        pthread_cond_init(&afp->sq_cv, NULL);
+    }
+    if (verbose > 3)
+        pr2ws("%s: dev_fd=%d, async via %s\n", __func__, dev_fd,
+              (PT_ASYNC_SG_V4 == afp->mode) ? "sg v4 ioctls" :
+              ((PT_ASYNC_SG_V3 == afp->mode) ? "sg v3 write/read" :
+               ((PT_ASYNC_URING == afp->mode) ? "io_uring" :
+                                                "worker threads")));
+    afp->next = pt_async_list;
+    pt_async_list = afp;
+fini:
+    pthread_mutex_unlock(&pt_async_list_lock);
+    if (stale_afp)
+        pt_async_free(stale_afp);
+    return afp;
+}
+
+/* Called when dev_fd is closed. Stops any worker threads; commands still
+ * in the submission queue are dropped. */
+static void
+pt_async_release(int dev_fd)
+{
+    struct pt_async_fd * afp;
+    struct pt_async_fd ** prevpp;
+
+    pthread_mutex_lock(&pt_async_list_lock);
+    for (prevpp = &pt_async_list; *prevpp; prevpp = &(*prevpp)->next) {
+        if (dev_fd == (*prevpp)->dev_fd)
+            break;
+    }
+    afp = *prevpp;
+    if (afp)
+        *prevpp = afp->next;
+    pthread_mutex_unlock(&pt_async_list_lock);
+    if (afp)
+        pt_async_free(afp);
+}
+
+/* afp must already be removed from pt_async_list */
+static void
+pt_async_free(struct pt_async_fd * afp)
+{
+    int k;
+
+    if (PT_ASYNC_THR == afp->mode) {
+        pthread_mutex_lock(&afp->lock);
+        afp->stop = true;
+        pthread_cond_broadcast(&afp->sq_cv);
+        pthread_mutex_unlock(&afp->lock);
+        for (k = 0; k < afp->num_thr; ++k)
+            pthread_join(afp->thr[k], NULL);
+        close(afp->pipe_fds[0]);
+        close(afp->pipe_fds[1]);
+        pthread_cond_destroy(&afp->sq_cv);
+        pthread_mutex_destroy(&afp->lock);
+    } else if (PT_ASYNC_URING == afp->mode)
+        sg_nvme_uring_free(afp->urp);
+    free(afp);
+}
+
+static int
+pt_async_thr_submit(struct pt_async_fd * afp, struct sg_pt_base * vp,
+                    int time_secs, int verbose)
+{
+    int res = 0;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+
+    ptp->async_tmo = time_secs;
+    ptp->async_res = 0;
+    ptp->async_next = NULL;
+    pthread_mutex_lock(&afp->lock);
+    if (afp->num_pending >= PT_ASYNC_MAX_PENDING) {
+        res = -EAGAIN;
+        goto fini;
+    }
+    /* start another worker if all existing ones are busy */
+    if ((afp->num_idle <= afp->num_queued) &&
+        (afp->num_thr < PT_ASYNC_MAX_THR)) {
+        int err = pthread_create(afp->thr + afp->num_thr, NULL,
+                                 pt_async_worker, afp);
+
+        if (err) {
+            if (0 == afp->num_thr) {
+                if (verbose)
+                    pr2ws("%s: pthread_create: %s\n", __func__,
+                          safe_strerror(err));
+                res = -err;
+                goto fini;
+            }
+        } else
+            ++afp->num_thr;
+    }
+    if (afp->sq_tail)
+        afp->sq_tail->impl.async_next = vp;
+    else
+        afp->sq_head = vp;
+    afp->sq_tail = vp;
+    ++afp->num_queued;
+    ++afp->num_pending;
+    pthread_cond_signal(&afp->sq_cv);
+fini:
+    pthread_mutex_unlock(&afp->lock);
+    return res;
+}
+
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int fd, int time_secs,
+                  int verbose)
+{
+    int res;
+    int err = 0;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct pt_async_fd * afp;
+    struct sg_io_hdr v3_hdr;
+
+    res = pt_check_fd(vp, &fd, verbose);
+    if (res)
+        return res;
+    afp = pt_async_find(fd, true, ptp->hipri, &err, verbose);
+    if (NULL == afp)
+        return err;
+    /* worker threads call do_scsi_pt() which does its own timing */
+    ptp->stats_start_ns = ((PT_ASYNC_THR != afp->mode) &&
+                           sg_pt_observe_on()) ? sg_pt_stats_now_ns() : 0;
+    switch (afp->mode) {
+    case PT_ASYNC_SG_V3:
+        res = v4_to_v3_hdr(ptp, &v3_hdr, time_secs, verbose);
+        if (res)
+            return res;
+        v3_hdr.usr_ptr = vp;
+        if (write(fd, &v3_hdr, sizeof(v3_hdr)) < 0) {
+            ptp->os_err = errno;
+            if (verbose > 1)
+                pr2ws("%s: write(sg v3) failed: %s\n", __func__,
+                      safe_strerror(ptp->os_err));
+            return -ptp->os_err;
+        }
+        break;
+    case PT_ASYNC_SG_V4:
+        if (0 == ptp->io_hdr.request) {
+            if (verbose)
+                pr2ws("No SCSI command (cdb) given [v4]\n");
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+        ptp->io_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) :
+                                                 DEF_TIMEOUT);
+        ptp->io_hdr.usr_ptr = (__u64)(sg_uintptr_t)vp;
+        pt_set_v4_hipri(ptp);
+        if (ioctl(fd, SG_IOSUBMIT, &ptp->io_hdr) < 0) {
+            ptp->os_err = errno;
+            if (verbose > 1)
+                pr2ws("%s: ioctl(SG_IOSUBMIT) failed: %s\n", __func__,
+                      safe_strerror(ptp->os_err));
+            return -ptp->os_err;
+        }
+        break;
+    case PT_ASYNC_URING:
+        res = sg_nvme_uring_prep(afp->urp, vp, time_secs, verbose);
+        if (res)
+            return res;
+        if (! ptp->async_more) {
+            /* the command is queued, a failure here is seen at reap */
+            sg_nvme_uring_enter(afp->urp, verbose);
+        }
+        break;
+    case PT_ASYNC_THR:
+    default:
+        return pt_async_thr_submit(afp, vp, time_secs, verbose);
+    }
+    pthread_mutex_lock(&pt_async_list_lock);
+    ++afp->num_pending;
+    pthread_mutex_unlock(&pt_async_list_lock);
+    return 0;
+}
+
+/* Copies the response fields of a completed sg v4 header (e.g. from
+ * SG_IORECEIVE or a multiple requests array) into the one held in ptp */
+static void
+v4_resp_copy(struct sg_pt_linux_scsi * ptp, const struct sg_io_v4 * h4p)
+{
+    ptp->io_hdr.driver_status = h4p->driver_status;
+    ptp->io_hdr.transport_status = h4p->transport_status;
+    ptp->io_hdr.device_status = h4p->device_status;
+    ptp->io_hdr.retry_delay = h4p->retry_delay;
+    ptp->io_hdr.info = h4p->info;
+    ptp->io_hdr.duration = h4p->duration;
+    ptp->io_hdr.response_len = h4p->response_len;
+    ptp->io_hdr.din_resid = h4p->din_resid;
+    ptp->io_hdr.dout_resid = h4p->dout_resid;
+    ptp->io_hdr.generated_tag = h4p->generated_tag;
+    ptp->io_hdr.request_tag = h4p->request_tag;
+}
+
+int
+do_scsi_pt_reap(int fd, bool wait, struct sg_pt_base ** objpp, int verbose)
+{
+    int res, num;
+    uint8_t b;
+    struct pt_async_fd * afp = pt_async_find(fd, false, false, NULL, verbose);
+    struct sg_pt_base * vp = NULL;
+    struct pollfd a_poll;
+    struct sg_io_hdr v3_hdr;
+    struct sg_io_v4 v4_hdr;
+
+    if (objpp)
+        *objpp = NULL;
+    if (NULL == afp)
+        return -EAGAIN;
+    pthread_mutex_lock((PT_ASYNC_THR == afp->mode) ? &afp->lock :
+                                                     &pt_async_list_lock);
+    num = afp->num_pending;
+    pthread_mutex_unlock((PT_ASYNC_THR == afp->mode) ? &afp->lock :
+                                                       &pt_async_list_lock);
+    if (num <= 0)
+        return -EAGAIN;
+    if (PT_ASYNC_URING == afp->mode) {
+        res = sg_nvme_uring_reap(afp->urp, wait, &vp, verbose);
+        if (vp) {
+            pthread_mutex_lock(&pt_async_list_lock);
+            --afp->num_pending;
+            pthread_mutex_unlock(&pt_async_list_lock);
+            if (vp->impl.stats_start_ns)
+                pt_observe_done(vp, res, vp->impl.stats_start_ns);
+            if (objpp)
+                *objpp = vp;
+        }
+        return res;
+    }
+    a_poll.fd = (PT_ASYNC_THR == afp->mode) ? afp->pipe_fds[0] : fd;
+    a_poll.events = POLLIN;
+    a_poll.revents = 0;
+    res = poll(&a_poll, 1, wait ? -1 : 0);
+    if (res < 0)
+        return -errno;
+    else if (0 == res)
+        return -EAGAIN;
+
+    switch (afp->mode) {
+    case PT_ASYNC_SG_V3:
+        memset(&v3_hdr, 0, sizeof(v3_hdr));
+        v3_hdr.interface_id = 'S';
+        if (read(fd, &v3_hdr, sizeof(v3_hdr)) < 0) {
+            res = -errno;
+            if (verbose > 1)
+                pr2ws("%s: read(sg v3) failed: %s\n", __func__,
+                      safe_strerror(-res));
+            return res;
+        }
+        vp = (struct sg_pt_base *)v3_hdr.usr_ptr;
+        if (NULL == vp)
+            return SCSI_PT_DO_BAD_PARAMS;
+        v3_resp_to_v4(&vp->impl, &v3_hdr);
+        res = 0;
+        break;
+    case PT_ASYNC_SG_V4:
+        memset(&v4_hdr, 0, sizeof(v4_hdr));
+        v4_hdr.guard = 'Q';
+        if (ioctl(fd, SG_IORECEIVE, &v4_hdr) < 0) {
+            res = -errno;
+            if (verbose > 1)
+                pr2ws("%s: ioctl(SG_IORECEIVE) failed: %s\n", __func__,
+                      safe_strerror(-res));
+            return res;
+        }
+        vp = (struct sg_pt_base *)(sg_uintptr_t)v4_hdr.usr_ptr;
+        if (NULL == vp)
+            return SCSI_PT_DO_BAD_PARAMS;
+        v4_resp_copy(&vp->impl, &v4_hdr);
+        res = 0;
+        break;
+    case PT_ASYNC_THR:
+    default:
+        if (read(afp->pipe_fds[0], &b, 1) < 0)
+            return -errno;
+        pthread_mutex_lock(&afp->lock);
+        vp = afp->cq_head;
+        if (vp) {
+            afp->cq_head = vp->impl.async_next;
+            if (NULL == afp->cq_head)
+                afp->cq_tail = NULL;
+            --afp->num_pending;
+        }
+        pthread_mutex_unlock(&afp->lock);
+        if (NULL == vp)
+            return -EAGAIN;
+        vp->impl.async_next = NULL;
+        res = vp->impl.async_res;
+        break;
+    }
+    if (PT_ASYNC_THR != afp->mode) {
+        pthread_mutex_lock(&pt_async_list_lock);
+        --afp->num_pending;
+        pthread_mutex_unlock(&pt_async_list_lock);
+        if (vp->impl.stats_start_ns)
+            pt_observe_done(vp, res, vp->impl.stats_start_ns);
+    }
+    if (objpp)
+        *objpp = vp;
+    return res;
+}
+
+int
+get_pt_poll_fd(int fd, int verbose)
+{
+    int err = 0;
+    struct pt_async_fd * afp = pt_async_find(fd, true, false, &err, verbose);
+
+    if (NULL == afp)
+        return err;
+    if (PT_ASYNC_URING == afp->mode)
+        return sg_nvme_uring_poll_fd(afp->urp);
+    return (PT_ASYNC_THR == afp->mode) ? afp->pipe_fds[0] : fd;
+}
+
+void
+scsi_pt_async_release(int fd)
+{
+    pt_async_release(fd);
+    pt_poll_release(fd);
+}
+
+int
+get_pt_num_pending(int fd)
+{
+    int num;
+    struct pt_async_fd * afp = pt_async_find(fd, false, false, NULL, 0);
+
+    if (NULL == afp)
+        return 0;
+    pthread_mutex_lock((PT_ASYNC_THR == afp->mode) ? &afp->lock :
+                                                     &pt_async_list_lock);
+    num = afp->num_pending;
+    pthread_mutex_unlock((PT_ASYNC_THR == afp->mode) ? &afp->lock :
+                                                       &pt_async_list_lock);
+    return num;
+}
+
+/*
+ * Multiple requests (MRQ) interface.
+ *
+ * The sg driver (version 4.0.30 and later) accepts an array of sg_io_v4
+ * objects in one ioctl(SG_IOSUBMIT) when the controlling object has the
+ * SGV4_FLAG_MULTIPLE_REQS flag. That array is built here from the v4
+ * headers held in the pass-through objects, with usr_ptr carrying the
+ * address of each object so responses can be handed back to it whatever
+ * their order. Other devices, and older sg drivers, use the emulation in
+ * sg_pt_common.c .
+ */
+
+#ifndef SGV4_FLAG_IMMED
+#define SGV4_FLAG_IMMED 0x400
+#endif
+#ifndef SGV4_FLAG_STOP_IF
+#define SGV4_FLAG_STOP_IF 0x1000
+#endif
+#ifndef SGV4_FLAG_MULTIPLE_REQS
+#define SGV4_FLAG_MULTIPLE_REQS 0x40000
+#endif
+#ifndef SG_INFO_MRQ_FINI
+#define SG_INFO_MRQ_FINI 0x20
+#endif
+
+#define PT_MRQ_MAX_REQS 512     /* per do_scsi_pt_mrq() call */
+
+/* Hands the response elements in a_v4p[0..num-1] (those that have
+ * finished) back to their pass-through objects, placing the objects in
+ * objpp[] if that is given. Returns the number of finished elements. */
+static int
+pt_mrq_demux(struct sg_io_v4 * a_v4p, int num, struct sg_pt_base ** objpp,
+             int verbose)
+{
+    int k;
+    int n = 0;
+    struct sg_pt_base * vp;
+
+    for (k = 0; k < num; ++k, ++a_v4p) {
+        if (! (SG_INFO_MRQ_FINI & a_v4p->info))
+            continue;   /* a "hole": not submitted or not finished */
+        vp = (struct sg_pt_base *)(sg_uintptr_t)a_v4p->usr_ptr;
+        if (NULL == vp) {
+            if (verbose)
+                pr2ws("%s: response element %d lacks usr_ptr\n", __func__,
+                      k);
+            continue;
+        }
+        v4_resp_copy(&vp->impl, a_v4p);
+        if (objpp)
+            objpp[n] = vp;
+        ++n;
+    }
+    return n;
+}
+
+int
+do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int fd,
+               int time_secs, int mrq_flags, int * num_donep, int verbose)
+{
+    bool immed = !! (SCSI_PT_MRQ_IMMED & mrq_flags);
+    int k, res, err, n_done;
+    struct sg_pt_linux_scsi * ptp;
+    struct pt_async_fd * afp = NULL;
+    struct sg_io_v4 * a_v4p;
+    struct sg_io_v4 ctl_v4;
+
+    if (num_donep)
+        *num_donep = 0;
+    if ((NULL == objpp) || (num < 0) || (num > PT_MRQ_MAX_REQS))
+        return SCSI_PT_DO_BAD_PARAMS;
+    if (0 == num)
+        return 0;
+    for (k = 0; k < num; ++k) {
+        int a_fd = fd;
+
+        res = pt_check_fd(objpp[k], &a_fd, verbose);
+        if (res)
+            return res;
+        if (0 == k)
+            fd = a_fd;
+        else if (a_fd != fd) {
+            if (verbose)
+                pr2ws("%s: all objects must share one device\n", __func__);
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+    }
+    ptp = &objpp[0]->impl;
+#ifdef IGNORE_LINUX_SGV4
+    if (true)
+#else
+    if ((! ptp->is_sg) || (ptp->sg_version < SG_LINUX_SG_VER_V4_FULL))
+#endif
+        return sg_pt_emul_mrq(objpp, num, fd, time_secs, mrq_flags,
+                              num_donep, verbose);
+    if (immed) {        /* do_scsi_pt_mrq_reap() needs to find these */
+        afp = pt_async_find(fd, true, false, &err, verbose);
+        if (NULL == afp)
+            return err;
+    }
+
+    a_v4p = (struct sg_io_v4 *)calloc(num, sizeof(struct sg_io_v4));
+    if (NULL == a_v4p)
+        return -ENOMEM;
+    for (k = 0; k < num; ++k) {
+        ptp = &objpp[k]->impl;
+        if (0 == ptp->io_hdr.request) {
+            if (verbose)
+                pr2ws("%s: no SCSI command (cdb) in request %d\n", __func__,
+                      k);
+            free(a_v4p);
+            return SCSI_PT_DO_BAD_PARAMS;
+        }
+        ptp->io_hdr.timeout = ((time_secs > 0) ? (time_secs * 1000) :
+                                                 DEF_TIMEOUT);
+        ptp->io_hdr.usr_ptr = (__u64)(sg_uintptr_t)objpp[k];
+        a_v4p[k] = ptp->io_hdr;
+        a_v4p[k].info = 0;
+    }
+    memset(&ctl_v4, 0, sizeof(ctl_v4));
+    ctl_v4.guard = 'Q';
+    ctl_v4.flags = SGV4_FLAG_MULTIPLE_REQS;
+    if (immed)
+        ctl_v4.flags |= SGV4_FLAG_IMMED;
+    else if (SCSI_PT_MRQ_STOP_IF & mrq_flags)
+        ctl_v4.flags |= SGV4_FLAG_STOP_IF;
+    ctl_v4.dout_xferp = (__u64)(sg_uintptr_t)a_v4p;     /* request array */
+    ctl_v4.dout_xfer_len = num * sizeof(struct sg_io_v4);
+    if (! immed) {
+        ctl_v4.din_xferp = (__u64)(sg_uintptr_t)a_v4p;  /* response array */
+        ctl_v4.din_xfer_len = num * sizeof(struct sg_io_v4);
+    }
+    while (((res = ioctl(fd, SG_IOSUBMIT, &ctl_v4)) < 0) &&
+           ((EINTR == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0) {
+        err = errno;
+        if (verbose > 1)
+            pr2ws("%s: ioctl(SG_IOSUBMIT, mrq) failed: %s\n", __func__,
+                  safe_strerror(err));
+        free(a_v4p);
+        return -err;
+    }
+    /* dout_resid is the number of requests not submitted */
+    n_done = num - ctl_v4.dout_resid;
+    if ((n_done < 0) || (n_done > num))
+        n_done = 0;
+    if (immed) {
+        pthread_mutex_lock(&pt_async_list_lock);
+        afp->num_mrq += n_done;
+        pthread_mutex_unlock(&pt_async_list_lock);
+    } else
+        n_done = pt_mrq_demux(a_v4p, num, NULL, verbose);
+    if ((verbose > 2) || (ctl_v4.spare_out && verbose))
+        pr2ws("%s: num=%d, %s=%d, secondary error=%u\n", __func__, num,
+              (immed ? "submitted" : "completed"), n_done,
+              ctl_v4.spare_out);
+    if (num_donep)
+        *num_donep = n_done;
+    free(a_v4p);
+    return 0;
+}
+
+int
+do_scsi_pt_mrq_reap(int fd, bool wait, struct sg_pt_base ** objpp, int max,
+                    int verbose)
+{
+    int res, err, n, num_mrq;
+    struct pt_async_fd * afp;
+    struct sg_io_v4 * a_v4p;
+    struct sg_io_v4 ctl_v4;
+    struct pollfd a_poll;
+
+    if ((NULL == objpp) || (max < 0))
+        return -EINVAL;
+    if (0 == max)
+        return 0;
+    afp = pt_async_find(fd, false, false, NULL, verbose);
+    num_mrq = 0;
+    if (afp) {
+        pthread_mutex_lock(&pt_async_list_lock);
+        num_mrq = afp->num_mrq;
+        pthread_mutex_unlock(&pt_async_list_lock);
+    }
+    if (num_mrq <= 0)   /* nothing natively submitted, try emulation */
+        return sg_pt_emul_mrq_reap(fd, wait, objpp, max, verbose);
+    if (max > PT_MRQ_MAX_REQS)
+        max = PT_MRQ_MAX_REQS;
+    if (wait) {
+        a_poll.fd = fd;
+        a_poll.events = POLLIN;
+        a_poll.revents = 0;
+        if (poll(&a_poll, 1, -1) < 0)
+            return -errno;
+    }
+    a_v4p = (struct sg_io_v4 *)calloc(max, sizeof(struct sg_io_v4));
+    if (NULL == a_v4p)
+        return -ENOMEM;
+    memset(&ctl_v4, 0, sizeof(ctl_v4));
+    ctl_v4.guard = 'Q';
+    ctl_v4.flags = SGV4_FLAG_MULTIPLE_REQS | SGV4_FLAG_IMMED;
+    ctl_v4.din_xferp = (__u64)(sg_uintptr_t)a_v4p;
+    ctl_v4.din_xfer_len = max * sizeof(struct sg_io_v4);
+    ctl_v4.dout_xferp = ctl_v4.din_xferp;
+    ctl_v4.dout_xfer_len = ctl_v4.din_xfer_len;
+    while (((res = ioctl(fd, SG_IORECEIVE, &ctl_v4)) < 0) &&
+           (EINTR == errno))
+        ;
+    if (res < 0) {
+        err = errno;
+        free(a_v4p);
+        if ((ENODATA == err) || (EAGAIN == err))
+            return 0;
+        if (verbose > 1)
+            pr2ws("%s: ioctl(SG_IORECEIVE, mrq) failed: %s\n", __func__,
+                  safe_strerror(err));
+        return -err;
+    }
+    /* info is the number of responses placed in the array */
+    n = ((int)ctl_v4.info < max) ? (int)ctl_v4.info : max;
+    n = pt_mrq_demux(a_v4p, n, objpp, verbose);
+    free(a_v4p);
+    pthread_mutex_lock(&pt_async_list_lock);
+    afp->num_mrq -= n;
+    pthread_mutex_unlock(&pt_async_list_lock);
+    return n;
+}
@@ -41,7 +41,7 @@
  *                   MA 02110-1301, USA.
  */
 
-/* sg_pt_linux_nvme version 1.21 20231123 */
+/* sg_pt_linux_nvme version 1.22 20261016 */
 
 /* This file contains a small "SPC-only" SNTL to support the SES pass-through
  * of SEND DIAGNOSTIC and RECEIVE DIAGNOSTIC RESULTS through NVME-MI
@@ -52,6 +52,9 @@
  * be used as the basis T10's forthcoming SNT standard which as yet does
  * not have any drafts. When those drafts appear, they will be followed. */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1           /* for syscall() and MAP_POPULATE */
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -80,6 +83,14 @@
 #include <linux/major.h>
 #endif
 
+#ifdef HAVE_LINUX_IO_URING_H
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
 #include "sg_pt.h"
 #include "sg_lib.h"
 #include "sg_snt.h"
@@ -164,6 +175,14 @@
 
 #define SG_NVME_RW_CONTROL_FUA (1 << 14) /* Force Unit Access bit */
 
+/* IORING_OP_URING_CMD arrived in Linux 5.19 together with the big (128 byte)
+ * submission and (32 byte) completion queue entries it needs */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && \
+    defined(__NR_io_uring_enter) && defined(IORING_SETUP_SQE128) && \
+    defined(IORING_SETUP_CQE32)
+#define SG_NVME_HAVE_URING 1
+#endif
+
 
 #if (HAVE_NVME && (! IGNORE_NVME))
 
@@ -1180,41 +1199,24 @@ fini:
     return res;
 }
 
+/* Processes the completion of the NVMe NVM command with 'opcode' which was
+ * issued via ioctl(NVME_IOCTL_IO_CMD) or io_uring. 'res' is a negated errno
+ * or the NVMe status (i.e. what that ioctl returns) and 'result' is
+ * DWord(0) of the completion queue entry. Returns 0, a negated errno or
+ * SG_LIB_NVME_STATUS. */
 static int
-do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
-              struct sg_nvme_passthru_cmd *cmdp, void * dp, int dlen,
-              bool is_read, int time_secs, int vb)
+nvm_pt_done(struct sg_pt_linux_scsi * ptp, uint8_t opcode, int res,
+            uint32_t result, void * dp, int dlen, bool is_read, int vb)
 {
-    const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
-    int res;
     uint32_t n;
     uint16_t sct_sc;
-    const uint8_t * up = ((const uint8_t *)cmdp) + SG_NVME_OPCODE;
+    const uint8_t * up = &opcode;
     char nam[64];
 
     if (vb)
         sg_get_nvme_opcode_name(*up, false /* NVM */ , sizeof(nam), nam);
     else
         nam[0] = '\0';
-    cmdp->timeout_ms = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
-    ptp->os_err = 0;
-    if (vb > 2) {
-        pr2ws("NVMe NVM command: %s\n", nam);
-        hex2stderr((const uint8_t *)cmdp, cmd_len, 1);
-        if ((vb > 4) && (! is_read) && dp) {
-            if (dlen > 0) {
-                n = dlen;
-                if ((dlen < 512) || (vb > 5))
-                    pr2ws("\nData-out buffer (%u bytes):\n", n);
-                else {
-                    pr2ws("\nData-out buffer (first 512 of %u bytes):\n", n);
-                    n = 512;
-                }
-                hex2stderr((const uint8_t *)dp, n, 0);
-            }
-        }
-    }
-    res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
     if (res < 0) {  /* OS error (errno negated) */
         ptp->os_err = -res;
         if (vb > 1) {
@@ -1225,7 +1227,7 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
     }
 
     /* Now res contains NVMe completion queue CDW3 31:17 (15 bits) */
-    ptp->nvme_result = cmdp->result;
+    ptp->nvme_result = result;
     if ((! ptp->nvme_our_snt) && ptp->io_hdr.response &&
         (ptp->io_hdr.max_response_len > 3)) {
         /* build 32 byte "sense" buffer */
@@ -1236,7 +1238,7 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
         n = (n < 32) ? n : 32;
         memset(sbp, 0 , n);
         ptp->io_hdr.response_len = n;
-        sg_put_unaligned_le32(cmdp->result, sbp + SG_NVME_CQ_RESULT);
+        sg_put_unaligned_le32(result, sbp + SG_NVME_CQ_RESULT);
         if (n > 15) /* LSBit will be 0 (Phase bit) after (st << 1) */
             sg_put_unaligned_le16(st << 1, sbp + SG_NVME_CQ_STATUS_P);
     }
@@ -1270,6 +1272,51 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
     return 0;
 }
 
+/* Sets the timeout in *cmdp and, if vb is high enough, dumps the command
+ * (and the start of its data-out buffer). */
+static void
+nvm_pt_pre(struct sg_pt_linux_scsi * ptp, struct sg_nvme_passthru_cmd *cmdp,
+           const void * dp, int dlen, bool is_read, int time_secs, int vb)
+{
+    const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
+    uint32_t n;
+    char nam[64];
+
+    cmdp->timeout_ms = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
+    ptp->os_err = 0;
+    if (vb > 2) {
+        sg_get_nvme_opcode_name(cmdp->opcode, false /* NVM */ , sizeof(nam),
+                                nam);
+        pr2ws("NVMe NVM command: %s\n", nam);
+        hex2stderr((const uint8_t *)cmdp, cmd_len, 1);
+        if ((vb > 4) && (! is_read) && dp) {
+            if (dlen > 0) {
+                n = dlen;
+                if ((dlen < 512) || (vb > 5))
+                    pr2ws("\nData-out buffer (%u bytes):\n", n);
+                else {
+                    pr2ws("\nData-out buffer (first 512 of %u bytes):\n", n);
+                    n = 512;
+                }
+                hex2stderr((const uint8_t *)dp, n, 0);
+            }
+        }
+    }
+}
+
+static int
+do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
+              struct sg_nvme_passthru_cmd *cmdp, void * dp, int dlen,
+              bool is_read, int time_secs, int vb)
+{
+    int res;
+
+    nvm_pt_pre(ptp, cmdp, dp, dlen, is_read, time_secs, vb);
+    res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
+    return nvm_pt_done(ptp, cmdp->opcode, res, cmdp->result, dp, dlen,
+                       is_read, vb);
+}
+
 /* Since ptp can be a char device (e.g. /dev/nvme0) or a blocks device
  * (e.g. /dev/nvme0n1 or /dev/nvme0n1p3) use NVME_IOCTL_IO_CMD which is
  * common to both (and takes a timeout). The difficult is that
@@ -1291,11 +1338,56 @@ sg_do_nvm_cmd(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
     cmdp->data_len = dlen;
     cmdp->cdw10 = iop->slba & 0xffffffff;
     cmdp->cdw11 = (iop->slba >> 32) & 0xffffffff;
-    cmdp->cdw12 = iop->nblocks; /* lower 16 bits already "0's based" count */
+    /* lower 16 bits already "0's based" count, FUA and friends above */
+    cmdp->cdw12 = iop->nblocks | ((uint32_t)iop->control << 16);
 
     return do_nvm_pt_low(ptp, cmdp, dp, dlen, is_read, time_secs, vb);
 }
 
+/* Checks that a data buffer of dlen bytes holds exactly nblks logical
+ * blocks of the namespace, so the device does not transfer past its end.
+ * The logical block size is fetched with Identify namespace the first
+ * time and cached in ptp. If that fails the check is skipped (returns
+ * true). */
+static bool
+sg_snt_xfer_len_ok(struct sg_pt_linux_scsi * ptp, uint32_t nblks,
+                   uint32_t dlen, int time_secs, int vb)
+{
+    int res;
+    uint8_t flbas, lbads;
+    uint32_t pg_sz;
+    uint8_t * up;
+    uint8_t * free_up = NULL;
+
+    if (0 == ptp->nvme_lb_sz) {
+        pg_sz = sg_get_page_size();
+        up = sg_memalign(pg_sz, pg_sz, &free_up, false);
+        if (NULL == up)
+            return true;
+        res = sg_nvme_do_identify(ptp, 0x0 /* CNS */, ptp->nvme_nsid,
+                                  time_secs, pg_sz, up, vb);
+        if (0 == res) {
+            flbas = up[26];     /* NVME FLBAS field from Identify */
+            lbads = up[128 + (4 * (flbas & 0xf)) + 2];  /* LBAF[flbas] */
+            if ((lbads >= 9) && (lbads < 32))
+                ptp->nvme_lb_sz = (uint32_t)1 << lbads;
+        }
+        free(free_up);
+        if (0 == ptp->nvme_lb_sz) {
+            if (vb > 2)
+                pr2ws("%s: logical block size unknown, not checked\n",
+                      __func__);
+            return true;
+        }
+    }
+    if ((uint64_t)nblks * ptp->nvme_lb_sz == dlen)
+        return true;
+    if (vb)
+        pr2ws("%s: %u blocks of %u bytes but data length is %u bytes\n",
+              __func__, nblks, ptp->nvme_lb_sz, dlen);
+    return false;
+}
+
 static int
 sg_snt_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
              int time_secs, int vb)
@@ -1329,6 +1421,11 @@ sg_snt_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
                   __func__);
         return 0;
     }
+    if (! sg_snt_xfer_len_ok(ptp, nblks_t10, ptp->io_hdr.din_xfer_len,
+                             time_secs, vb)) {
+        mk_sense_invalid_fld(ptp, true, (is_read10 ? 7 : 10), -1, vb);
+        return 0;
+    }
     iop->nblocks = nblks_t10 - 1;       /* crazy "0's based" */
     if (have_fua)
         iop->control |= SG_NVME_RW_CONTROL_FUA;
@@ -1375,6 +1472,11 @@ sg_snt_write(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
                   __func__);
         return 0;
     }
+    if (! sg_snt_xfer_len_ok(ptp, nblks_t10, ptp->io_hdr.dout_xfer_len,
+                             time_secs, vb)) {
+        mk_sense_invalid_fld(ptp, true, (is_write10 ? 7 : 10), -1, vb);
+        return 0;
+    }
     iop->nblocks = nblks_t10 - 1;
     if (have_fua)
         iop->control |= SG_NVME_RW_CONTROL_FUA;
@@ -1754,6 +1856,15 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
         if (dlen > 0)
             dp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
     }
+    if (sg_pt_observe_on()) {
+        int res;
+        uint64_t t0 = sg_pt_stats_now_ns();
+
+        res = do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, timeout_secs, vb);
+        sg_pt_observe_done(vp, SG_PT_STATS_KIND_NVME_NVM, res, t0,
+                           is_read ? (const uint8_t *)dp : NULL);
+        return res;
+    }
     return do_nvm_pt_low(ptp, &cmd, dp, dlen, is_read, timeout_secs, vb);
 }
 
@@ -1783,3 +1894,454 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
 }
 
 #endif          /* (HAVE_NVME && (! IGNORE_NVME)) */
+
+#if (HAVE_NVME && (! IGNORE_NVME)) && defined(SG_NVME_HAVE_URING)
+
+#define SG_NVME_URING_ENTRIES 128
+#define SG_NVME_URING_SQE_SZ 128        /* IORING_SETUP_SQE128 */
+#define SG_NVME_URING_CQE_SZ 32         /* IORING_SETUP_CQE32 */
+/* user_data of a NOP carrying the result of a command that has already
+ * been executed synchronously has this bit set (objects are aligned) */
+#define SG_NVME_URING_DONE_TAG 0x1
+
+/* Minimal io_uring wrapper using the raw system calls, so there is no
+ * dependency on liburing. One instance per open NVMe generic char device
+ * that has had do_scsi_pt_submit() called on it. */
+struct sg_nvme_uring {
+    int ring_fd;
+    int dev_fd;
+    bool iopoll;                /* IORING_SETUP_IOPOLL */
+    unsigned int sq_entries;
+    unsigned int sq_tail;       /* local copy, published by enter */
+    unsigned int to_submit;
+    unsigned int in_flight;     /* prepared but not yet reaped */
+    unsigned int * sq_headp;
+    unsigned int * sq_tailp;
+    unsigned int * sq_maskp;
+    unsigned int * sq_arrayp;
+    unsigned int * cq_headp;
+    unsigned int * cq_tailp;
+    unsigned int * cq_maskp;
+    uint8_t * sqes;             /* SG_NVME_URING_SQE_SZ byte elements */
+    uint8_t * cqes;             /* SG_NVME_URING_CQE_SZ byte elements */
+    void * sq_ptr;
+    void * cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+    pthread_mutex_t lock;
+};
+
+int
+sg_nvme_uring_new(int dev_fd, bool iopoll, struct sg_nvme_uring ** urpp,
+                  int vb)
+{
+    int err;
+    struct io_uring_params p;
+    struct sg_nvme_uring * urp;
+
+    *urpp = NULL;
+    urp = (struct sg_nvme_uring *)calloc(1, sizeof(*urp));
+    if (NULL == urp)
+        return -ENOMEM;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+    if (iopoll)
+        p.flags |= IORING_SETUP_IOPOLL;
+    urp->ring_fd = (int)syscall(__NR_io_uring_setup, SG_NVME_URING_ENTRIES,
+                                &p);
+    if (urp->ring_fd < 0) {
+        err = errno;
+        if (vb > 2)
+            pr2ws("%s: io_uring_setup: %s\n", __func__, strerror(err));
+        free(urp);
+        /* EINVAL: kernel predates big SQEs and CQEs */
+        return (EINVAL == err) ? -EOPNOTSUPP : -err;
+    }
+    urp->dev_fd = dev_fd;
+    urp->iopoll = iopoll;
+    urp->sq_entries = p.sq_entries;
+    urp->sq_sz = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+    urp->cq_sz = p.cq_off.cqes + (p.cq_entries * SG_NVME_URING_CQE_SZ);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (urp->cq_sz > urp->sq_sz)
+            urp->sq_sz = urp->cq_sz;
+        urp->cq_sz = urp->sq_sz;
+    }
+    urp->sq_ptr = mmap(NULL, urp->sq_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, urp->ring_fd,
+                       IORING_OFF_SQ_RING);
+    if (MAP_FAILED == urp->sq_ptr)
+        goto err_out;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        urp->cq_ptr = urp->sq_ptr;
+    else {
+        urp->cq_ptr = mmap(NULL, urp->cq_sz, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, urp->ring_fd,
+                           IORING_OFF_CQ_RING);
+        if (MAP_FAILED == urp->cq_ptr)
+            goto err_out;
+    }
+    urp->sqes_sz = p.sq_entries * SG_NVME_URING_SQE_SZ;
+    urp->sqes = (uint8_t *)mmap(NULL, urp->sqes_sz, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, urp->ring_fd,
+                                IORING_OFF_SQES);
+    if (MAP_FAILED == urp->sqes)
+        goto err_out;
+    urp->sq_headp = (unsigned int *)((uint8_t *)urp->sq_ptr + p.sq_off.head);
+    urp->sq_tailp = (unsigned int *)((uint8_t *)urp->sq_ptr + p.sq_off.tail);
+    urp->sq_maskp = (unsigned int *)((uint8_t *)urp->sq_ptr +
+                                     p.sq_off.ring_mask);
+    urp->sq_arrayp = (unsigned int *)((uint8_t *)urp->sq_ptr +
+                                      p.sq_off.array);
+    urp->cq_headp = (unsigned int *)((uint8_t *)urp->cq_ptr + p.cq_off.head);
+    urp->cq_tailp = (unsigned int *)((uint8_t *)urp->cq_ptr + p.cq_off.tail);
+    urp->cq_maskp = (unsigned int *)((uint8_t *)urp->cq_ptr +
+                                     p.cq_off.ring_mask);
+    urp->cqes = (uint8_t *)urp->cq_ptr + p.cq_off.cqes;
+    urp->sq_tail = *urp->sq_tailp;
+    pthread_mutex_init(&urp->lock, NULL);
+    if (vb > 3)
+        pr2ws("%s: dev_fd=%d, ring_fd=%d, entries=%u%s\n", __func__, dev_fd,
+              urp->ring_fd, urp->sq_entries, (iopoll ? ", iopoll" : ""));
+    *urpp = urp;
+    return 0;
+err_out:
+    err = errno;
+    if (urp->sq_ptr && (MAP_FAILED != urp->sq_ptr))
+        munmap(urp->sq_ptr, urp->sq_sz);
+    if (urp->cq_ptr && (MAP_FAILED != urp->cq_ptr) &&
+        (urp->cq_ptr != urp->sq_ptr))
+        munmap(urp->cq_ptr, urp->cq_sz);
+    close(urp->ring_fd);
+    free(urp);
+    return -err;
+}
+
+void
+sg_nvme_uring_free(struct sg_nvme_uring * urp)
+{
+    if (NULL == urp)
+        return;
+    munmap(urp->sqes, urp->sqes_sz);
+    if (urp->cq_ptr != urp->sq_ptr)
+        munmap(urp->cq_ptr, urp->cq_sz);
+    munmap(urp->sq_ptr, urp->sq_sz);
+    close(urp->ring_fd);
+    pthread_mutex_destroy(&urp->lock);
+    free(urp);
+}
+
+/* Builds a NVMe Read or Write command in *cmdp from the SCSI READ(10/16) or
+ * WRITE(10/16) held in ptp. Returns false for other commands and for those
+ * that need more than a straight translation (e.g. a transfer length of
+ * zero, a NOP, or a data length that does not match it, which yields
+ * sense data), those are left to sg_do_nvme_pt(). */
+static bool
+sg_snt_rw2nvm(struct sg_pt_linux_scsi * ptp,
+              struct sg_nvme_passthru_cmd * cmdp, void ** dpp, int * dlenp,
+              bool * is_readp, int time_secs, int vb)
+{
+    bool is_read, is_16;
+    uint32_t nblks_t10, dlen;
+    uint64_t lba;
+    const uint8_t * cdbp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.request;
+
+    if ((NULL == cdbp) || (0 == ptp->nvme_nsid) ||
+        (! sg_is_scsi_cdb(cdbp, ptp->io_hdr.request_len)))
+        return false;
+    switch (cdbp[0]) {
+    case SCSI_READ10_OPC:
+    case SCSI_READ16_OPC:
+        is_read = true;
+        break;
+    case SCSI_WRITE10_OPC:
+    case SCSI_WRITE16_OPC:
+        is_read = false;
+        break;
+    default:
+        return false;
+    }
+    is_16 = ((SCSI_READ16_OPC == cdbp[0]) || (SCSI_WRITE16_OPC == cdbp[0]));
+    if (is_16) {
+        lba = sg_get_unaligned_be64(cdbp + 2);
+        nblks_t10 = sg_get_unaligned_be32(cdbp + 10);
+    } else {
+        lba = sg_get_unaligned_be32(cdbp + 2);
+        nblks_t10 = sg_get_unaligned_be16(cdbp + 7);
+    }
+    if ((0 == nblks_t10) || (nblks_t10 > (UINT16_MAX + 1)))
+        return false;
+    dlen = is_read ? ptp->io_hdr.din_xfer_len : ptp->io_hdr.dout_xfer_len;
+    ptp->nvme_our_snt = true;   /* keep Identify's status out of sense */
+    if (! sg_snt_xfer_len_ok(ptp, nblks_t10, dlen, time_secs, vb))
+        return false;
+    memset(cmdp, 0, sizeof(*cmdp));
+    cmdp->opcode = is_read ? SG_NVME_NVM_READ : SG_NVME_NVM_WRITE;
+    cmdp->nsid = ptp->nvme_nsid;
+    cmdp->cdw10 = lba & 0xffffffff;
+    cmdp->cdw11 = (lba >> 32) & 0xffffffff;
+    cmdp->cdw12 = nblks_t10 - 1;        /* "0's based" */
+    if (cdbp[1] & 0x8)
+        cmdp->cdw12 |= ((uint32_t)SG_NVME_RW_CONTROL_FUA << 16);
+    if (is_read) {
+        *dpp = (void *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+        *dlenp = ptp->io_hdr.din_xfer_len;
+    } else {
+        *dpp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+        *dlenp = ptp->io_hdr.dout_xfer_len;
+    }
+    cmdp->addr = (uint64_t)(sg_uintptr_t)*dpp;
+    cmdp->data_len = *dlenp;
+    *is_readp = is_read;
+    return true;
+}
+
+/* Places the command held in vp on the submission queue. SNTL READs and
+ * WRITEs become IORING_OP_URING_CMDs; anything else is executed now (by
+ * sg_do_nvme_pt()) and an IORING_OP_NOP carries its result. Nothing is
+ * sent to the kernel until sg_nvme_uring_enter() or sg_nvme_uring_reap()
+ * is called. Returns 0 or -EAGAIN if the ring is full. */
+int
+sg_nvme_uring_prep(struct sg_nvme_uring * urp, struct sg_pt_base * vp,
+                   int time_secs, int vb)
+{
+    bool is_read = false;
+    bool full, translated;
+    int dlen = 0;
+    unsigned int idx;
+    struct sg_pt_linux_scsi * ptp = &vp->impl;
+    struct io_uring_sqe * sqep;
+    void * dp = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    /* reserve a slot so neither queue can overflow */
+    pthread_mutex_lock(&urp->lock);
+    full = (urp->in_flight >= urp->sq_entries);
+    if (! full)
+        ++urp->in_flight;
+    pthread_mutex_unlock(&urp->lock);
+    if (full)
+        return -EAGAIN;
+
+    translated = sg_snt_rw2nvm(ptp, &cmd, &dp, &dlen, &is_read, time_secs,
+                               vb);
+    if (translated) {
+        nvm_pt_pre(ptp, &cmd, dp, dlen, is_read, time_secs, vb);
+        cmd.result = 0;         /* rsvd2 in struct nvme_uring_cmd */
+    } else
+        ptp->async_res = sg_do_nvme_pt(vp, -1, time_secs, vb);
+
+    pthread_mutex_lock(&urp->lock);
+    idx = urp->sq_tail & *urp->sq_maskp;
+    sqep = (struct io_uring_sqe *)(urp->sqes + (idx * SG_NVME_URING_SQE_SZ));
+    memset(sqep, 0, SG_NVME_URING_SQE_SZ);
+    if (translated) {
+        sqep->opcode = IORING_OP_URING_CMD;
+        sqep->fd = urp->dev_fd;
+        sqep->cmd_op = NVME_URING_CMD_IO;
+        memcpy((uint8_t *)sqep + offsetof(struct io_uring_sqe, cmd), &cmd,
+               sizeof(cmd));
+        sqep->user_data = (uint64_t)(sg_uintptr_t)vp;
+    } else {
+        sqep->opcode = IORING_OP_NOP;
+        sqep->user_data = (uint64_t)(sg_uintptr_t)vp |
+                          SG_NVME_URING_DONE_TAG;
+    }
+    urp->sq_arrayp[idx] = idx;
+    ++urp->sq_tail;
+    ++urp->to_submit;
+    pthread_mutex_unlock(&urp->lock);
+    return 0;
+}
+
+/* Sends all prepared commands to the kernel with one system call. If
+ * 'min_complete' is greater than zero, that system call also waits for
+ * that many completions (or, with IOPOLL, polls for them). The ring lock
+ * is not held during the system call. */
+static int
+uring_enter(struct sg_nvme_uring * urp, unsigned int min_complete, int vb)
+{
+    int res;
+    unsigned int n;
+    unsigned int flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+    pthread_mutex_lock(&urp->lock);
+    n = urp->to_submit;
+    if (n > 0) {
+        __atomic_store_n(urp->sq_tailp, urp->sq_tail, __ATOMIC_RELEASE);
+        urp->to_submit = 0;
+    }
+    pthread_mutex_unlock(&urp->lock);
+    if ((0 == n) && (0 == flags))
+        return 0;
+    while (((res = (int)syscall(__NR_io_uring_enter, urp->ring_fd, n,
+                                min_complete, flags, NULL, 0)) < 0) &&
+           (EINTR == errno))
+        ;
+    if (res < 0) {
+        res = -errno;
+        if (vb)
+            pr2ws("%s: io_uring_enter: %s\n", __func__, strerror(-res));
+    } else
+        res = ((unsigned int)res > n) ? 0 : (int)(n - res);
+    if (res != 0) {     /* give back what the kernel did not consume */
+        pthread_mutex_lock(&urp->lock);
+        urp->to_submit += (res < 0) ? n : (unsigned int)res;
+        pthread_mutex_unlock(&urp->lock);
+    }
+    return (res < 0) ? res : 0;
+}
+
+int
+sg_nvme_uring_enter(struct sg_nvme_uring * urp, int vb)
+{
+    return uring_enter(urp, 0, vb);
+}
+
+/* Pops one completion queue entry into *user_datap, *cqe_resp and
+ * *resultp. Returns true if there was one, false if the queue is empty.
+ * Set *emptyp to true if there is nothing in flight. */
+static bool
+sg_nvme_uring_pop(struct sg_nvme_uring * urp, uint64_t * user_datap,
+                  int * cqe_resp, uint32_t * resultp, bool * emptyp)
+{
+    bool got = false;
+    unsigned int head, tail;
+    const struct io_uring_cqe * cqep;
+
+    pthread_mutex_lock(&urp->lock);
+    head = *urp->cq_headp;
+    tail = __atomic_load_n(urp->cq_tailp, __ATOMIC_ACQUIRE);
+    if (head != tail) {
+        cqep = (const struct io_uring_cqe *)(urp->cqes +
+                        ((head & *urp->cq_maskp) * SG_NVME_URING_CQE_SZ));
+        *user_datap = cqep->user_data;
+        *cqe_resp = cqep->res;
+        /* big_cqe[0] holds DWord(0) of the NVMe completion queue entry */
+        *resultp = (uint32_t)sg_get_unaligned_le64((const uint8_t *)cqep +
+                                                   sizeof(*cqep));
+        __atomic_store_n(urp->cq_headp, head + 1, __ATOMIC_RELEASE);
+        --urp->in_flight;
+        got = true;
+    }
+    *emptyp = (0 == urp->in_flight);
+    pthread_mutex_unlock(&urp->lock);
+    return got;
+}
+
+int
+sg_nvme_uring_reap(struct sg_nvme_uring * urp, bool wait,
+                   struct sg_pt_base ** vpp, int vb)
+{
+    bool is_read, empty, got;
+    bool polled = false;
+    int res, cqe_res, dlen;
+    uint32_t result;
+    uint64_t user_data;
+    struct sg_pt_linux_scsi * ptp;
+    void * dp;
+
+    *vpp = NULL;
+    while (! (got = sg_nvme_uring_pop(urp, &user_data, &cqe_res, &result,
+                                      &empty))) {
+        if (empty || ((! wait) && ((! urp->iopoll) || polled)))
+            break;
+        /* flushes deferred submissions too; with IOPOLL this polls the
+         * device even when min_complete is 0 */
+        res = uring_enter(urp, (wait ? 1 : 0), vb);
+        if (res < 0)
+            return res;
+        polled = true;
+    }
+    if (! got) {
+        if (! polled)   /* send deferred commands before saying "none" */
+            uring_enter(urp, 0, vb);
+        return -EAGAIN;
+    }
+    if (user_data & SG_NVME_URING_DONE_TAG) {
+        *vpp = (struct sg_pt_base *)(sg_uintptr_t)(user_data &
+                                                   ~(uint64_t)
+                                                   SG_NVME_URING_DONE_TAG);
+        return (*vpp)->impl.async_res;
+    }
+    *vpp = (struct sg_pt_base *)(sg_uintptr_t)user_data;
+    ptp = &(*vpp)->impl;
+    is_read = (ptp->io_hdr.din_xfer_len > 0);
+    if (is_read) {
+        dp = (void *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+        dlen = ptp->io_hdr.din_xfer_len;
+    } else {
+        dp = (void *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+        dlen = ptp->io_hdr.dout_xfer_len;
+    }
+    if (-EAGAIN == cqe_res)     /* keep -EAGAIN for "nothing ready" */
+        cqe_res = -EBUSY;
+    res = nvm_pt_done(ptp, (is_read ? SG_NVME_NVM_READ : SG_NVME_NVM_WRITE),
+                      cqe_res, result, dp, dlen, is_read, vb);
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        return 0;
+    }
+    return res;
+}
+
+int
+sg_nvme_uring_poll_fd(const struct sg_nvme_uring * urp)
+{
+    /* completions on an IOPOLL ring are only found by io_uring_enter() */
+    return urp->iopoll ? -EOPNOTSUPP : urp->ring_fd;
+}
+
+#else   /* (HAVE_NVME && (! IGNORE_NVME)) && defined(SG_NVME_HAVE_URING) */
+
+int
+sg_nvme_uring_new(int dev_fd, bool iopoll, struct sg_nvme_uring ** urpp,
+                  int vb)
+{
+    if (dev_fd) { ; }           /* suppress warning */
+    if (iopoll) { ; }           /* suppress warning */
+    if (vb > 2)
+        pr2ws("%s: not supported in this build\n", __func__);
+    *urpp = NULL;
+    return -EOPNOTSUPP;
+}
+
+void
+sg_nvme_uring_free(struct sg_nvme_uring * urp)
+{
+    if (urp) { ; }              /* suppress warning */
+}
+
+int
+sg_nvme_uring_prep(struct sg_nvme_uring * urp, struct sg_pt_base * vp,
+                   int time_secs, int vb)
+{
+    if (urp || vp || time_secs || vb) { ; }     /* suppress warning */
+    return -EOPNOTSUPP;
+}
+
+int
+sg_nvme_uring_enter(struct sg_nvme_uring * urp, int vb)
+{
+    if (urp || vb) { ; }        /* suppress warning */
+    return -EOPNOTSUPP;
+}
+
+int
+sg_nvme_uring_reap(struct sg_nvme_uring * urp, bool wait,
+                   struct sg_pt_base ** vpp, int vb)
+{
+    if (urp || wait || vb) { ; }        /* suppress warning */
+    *vpp = NULL;
+    return -EOPNOTSUPP;
+}
+
+int
+sg_nvme_uring_poll_fd(const struct sg_nvme_uring * urp)
+{
+    if (urp) { ; }              /* suppress warning */
+    return -EOPNOTSUPP;
+}
+
+#endif  /* (HAVE_NVME && (! IGNORE_NVME)) && defined(SG_NVME_HAVE_URING) */
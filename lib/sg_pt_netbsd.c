@@ -26,6 +26,7 @@
 #include <sys/scsiio.h>
 
 #include "sg_pt.h"
+#include "sg_pt_emul.h"
 #include "sg_lib.h"
 #include "sg_pr2serr.h"
 
@@ -137,6 +138,8 @@ scsi_pt_open_flags(const char * device_name, int flags, int verbose)
 int
 scsi_pt_close_device(int device_fd)
 {
+    sg_pt_emul_release(device_fd);
+    scsi_pt_pool_flush(device_fd);
     if (device_fd >= 0)
         close(device_fd);
     return 0;
@@ -410,6 +413,57 @@ do_scsi_pt(struct sg_pt_base * vp, int device_fd, int time_secs, int verbose)
     return ret;
 }
 
+/* There is no native asynchronous pass-through in this NetBSD interface, so
+ * it is emulated (see sg_pt_common.c): each command is executed when it
+ * is submitted and then queued for do_scsi_pt_reap(). */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int dev_fd, int time_secs,
+                  int verbose)
+{
+    return sg_pt_emul_submit(vp, dev_fd, time_secs, verbose);
+}
+
+int
+do_scsi_pt_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                int verbose)
+{
+    return sg_pt_emul_reap(dev_fd, wait, objpp, verbose);
+}
+
+int
+get_pt_poll_fd(int dev_fd, int verbose)
+{
+    return sg_pt_emul_poll_fd(dev_fd, verbose);
+}
+
+int
+get_pt_num_pending(int dev_fd)
+{
+    return sg_pt_emul_num_pending(dev_fd);
+}
+
+void
+scsi_pt_async_release(int dev_fd)
+{
+    sg_pt_emul_release(dev_fd);
+}
+
+/* Multiple requests are emulated too (see sg_pt_common.c) */
+int
+do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int dev_fd,
+               int time_secs, int mrq_flags, int * num_donep, int verbose)
+{
+    return sg_pt_emul_mrq(objpp, num, dev_fd, time_secs, mrq_flags,
+                          num_donep, verbose);
+}
+
+int
+do_scsi_pt_mrq_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                    int max, int verbose)
+{
+    return sg_pt_emul_mrq_reap(dev_fd, wait, objpp, max, verbose);
+}
+
 int
 get_scsi_pt_result_category(const struct sg_pt_base * vp)
 {
@@ -0,0 +1,956 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_pt.h"
+#include "sg_pt_emul.h"
+#include "sg_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Version 1.00 20261016 */
+
+/* Recorded device pass-through backend, selected at build time with
+ * './configure --enable-pt_replay' in place of the OS specific one. It
+ * defines the same functions as sg_pt_dummy.c (see the list there).
+ *
+ * Opening a "device" loads a command recording, as written when the
+ * SG3_UTILS_PT_RECORD environment variable is set (see sg_pt.h). The
+ * recording file is named by the SG3_UTILS_PT_REPLAY environment variable
+ * or, if that is not set, is the device name itself. Each command given to
+ * do_scsi_pt() or do_nvm_pt() is then looked up by its exact bytes (e.g.
+ * the whole cdb) and the recorded response (status, sense data, data-in
+ * and NVMe completion result) is returned. When a command was recorded more
+ * than once its responses are served in recorded order, wrapping around.
+ * Unknown SCSI commands yield a CHECK CONDITION with ILLEGAL REQUEST sense
+ * data: INVALID COMMAND OPERATION CODE, or INVALID FIELD IN CDB when the
+ * opcode was recorded with some other cdb.
+ *
+ * The SG3_UTILS_PT_REPLAY_LAT environment variable adds synthetic latency
+ * to each command: either a number of microseconds or "rec" for the
+ * recorded duration of that command. The default is no added latency.
+ * This allows the decoding utilities (e.g. sg_inq, sg_vpd, sg_logs,
+ * sg_ses and sg_rep_zones) to be benchmarked and profiled without the
+ * hardware. */
+
+#define SG_PT_REPLAY_ENV "SG3_UTILS_PT_REPLAY"
+#define SG_PT_REPLAY_LAT_ENV "SG3_UTILS_PT_REPLAY_LAT"
+
+#define REPLAY_MAX_CMD_LEN 64
+#define REPLAY_SPIN_NS 100000   /* spin rather than sleep below this */
+
+struct replay_ent {
+    int next;                   /* index of next with same command, or -1 */
+    struct sg_pt_record_rec rec;
+};
+
+struct replay_slot {
+    uint32_t hash;
+    int head;                   /* -1 when slot empty */
+    int cur;                    /* next to serve for this command */
+};
+
+struct replay_dev {
+    int fd;
+    bool is_nvme;
+    int num_ent;
+    uint32_t slot_mask;         /* number of slots less 1 */
+    struct replay_ent * ents;
+    struct replay_slot * slots;
+    uint8_t * file_buf;         /* ents[].rec pointers refer to this */
+    uint8_t opcode_seen[256 / 8];
+    pthread_mutex_t lock;       /* for slots[].cur */
+    struct replay_dev * next;
+};
+
+struct sg_pt_replay {
+    bool is_nvme_cmd;           /* cmd is a 64 byte NVMe command */
+    int dev_fd;
+    int in_err;
+    int os_err;
+    int transport_err;
+    int cmd_len;
+    int sense_max;
+    int sense_len;
+    int status;
+    int category;
+    int din_len;
+    int dout_len;
+    int din_act;
+    uint32_t result;
+    uint64_t dur_ns;
+    uint8_t * sensep;
+    uint8_t * dinp;
+    uint8_t * mdxferp;          /* metadata is accepted but not replayed */
+    const uint8_t * cmdp;       /* like other backends, not copied */
+    struct replay_dev * devp;   /* cached lookup of dev_fd */
+};
+
+struct sg_pt_base {
+    struct sg_pt_replay impl;
+};
+
+static struct replay_dev * replay_dev_head;
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static int replay_lat_state = -1;       /* -1: check environment, 0: none,
+                                         * 1: recorded, 2: fixed */
+static uint64_t replay_lat_ns;
+
+
+/* FNV-1a over the kind and command bytes */
+static uint32_t
+replay_hash(int kind, const uint8_t * cmdp, int cmd_len)
+{
+    int k;
+    uint32_t h = 2166136261U;
+
+    h = (h ^ (uint8_t)kind) * 16777619U;
+    for (k = 0; k < cmd_len; ++k)
+        h = (h ^ cmdp[k]) * 16777619U;
+    return h;
+}
+
+/* Returns slot for the given command: either the one holding it or the
+ * empty slot where it belongs */
+static struct replay_slot *
+replay_find_slot(const struct replay_dev * rdp, int kind,
+                 const uint8_t * cmdp, int cmd_len)
+{
+    uint32_t h = replay_hash(kind, cmdp, cmd_len);
+    uint32_t k;
+    struct replay_slot * sp;
+    const struct sg_pt_record_rec * rp;
+
+    for (k = h & rdp->slot_mask; ; k = (k + 1) & rdp->slot_mask) {
+        sp = rdp->slots + k;
+        if (sp->head < 0)
+            return sp;
+        if (sp->hash != h)
+            continue;
+        rp = &rdp->ents[sp->head].rec;
+        if ((rp->kind == kind) && (rp->cmd_len == cmd_len) &&
+            (0 == memcmp(rp->cmdp, cmdp, cmd_len)))
+            return sp;
+    }
+}
+
+static void
+replay_dev_free(struct replay_dev * rdp)
+{
+    if (rdp) {
+        pthread_mutex_destroy(&rdp->lock);
+        free(rdp->ents);
+        free(rdp->slots);
+        free(rdp->file_buf);
+        free(rdp);
+    }
+}
+
+/* Loads recording from fd (left open) into a new replay_dev. Returns
+ * 0 or a negated errno */
+static int
+replay_dev_load(int fd, const char * fname, struct replay_dev ** rdpp,
+                int vb)
+{
+    int k, n, off, len, max_num, num_nvme = 0;
+    uint32_t num_slots;
+    struct stat st;
+    struct replay_dev * rdp;
+    struct replay_ent * ep;
+    struct replay_slot * sp;
+
+    if (fstat(fd, &st) < 0)
+        return -errno;
+    if ((st.st_size < 1) || (st.st_size > INT32_MAX))
+        goto not_rec;
+    rdp = (struct replay_dev *)calloc(1, sizeof(*rdp));
+    if (NULL == rdp)
+        return -ENOMEM;
+    len = (int)st.st_size;
+    rdp->file_buf = (uint8_t *)malloc(len);
+    if (NULL == rdp->file_buf)
+        goto nomem;
+    for (off = 0; off < len; off += n) {
+        n = read(fd, rdp->file_buf + off, len - off);
+        if (n <= 0) {
+            n = (n < 0) ? -errno : -EIO;
+            replay_dev_free(rdp);
+            return n;
+        }
+    }
+    off = sg_pt_record_hdr_check(rdp->file_buf, len);
+    if (off < 0) {
+        replay_dev_free(rdp);
+        goto not_rec;
+    }
+    /* fixed part of a record is 40 bytes */
+    max_num = (len - off) / 40 + 1;
+    rdp->ents = (struct replay_ent *)calloc(max_num, sizeof(*rdp->ents));
+    if (NULL == rdp->ents)
+        goto nomem;
+    for (k = 0; (off < len) && (k < max_num); ++k, off += n) {
+        ep = rdp->ents + k;
+        n = sg_pt_record_decode(rdp->file_buf + off, len - off, &ep->rec);
+        if (n <= 0) {
+            if (vb)
+                pr2ws("%s: %s record at offset %d, ignore rest of %s\n",
+                      __func__, (0 == n) ? "truncated" : "malformed", off,
+                      fname);
+            break;
+        }
+        if ((ep->rec.cmd_len < 1) ||
+            (ep->rec.cmd_len > REPLAY_MAX_CMD_LEN)) {
+            --k;
+            continue;
+        }
+    }
+    rdp->num_ent = k;
+    for (num_slots = 16; num_slots < (2 * (uint32_t)k); num_slots <<= 1)
+        ;
+    rdp->slot_mask = num_slots - 1;
+    rdp->slots = (struct replay_slot *)malloc(num_slots *
+                                              sizeof(*rdp->slots));
+    if (NULL == rdp->slots)
+        goto nomem;
+    for (k = 0; k < (int)num_slots; ++k) {
+        rdp->slots[k].head = -1;
+        rdp->slots[k].cur = -1;
+    }
+    /* link in reverse so each chain ends up in recorded order */
+    for (k = rdp->num_ent - 1; k >= 0; --k) {
+        ep = rdp->ents + k;
+        sp = replay_find_slot(rdp, ep->rec.kind, ep->rec.cmdp,
+                              ep->rec.cmd_len);
+        if (sp->head < 0)
+            sp->hash = replay_hash(ep->rec.kind, ep->rec.cmdp,
+                                   ep->rec.cmd_len);
+        ep->next = sp->head;
+        sp->head = k;
+        sp->cur = k;
+        if (SG_PT_STATS_KIND_SCSI == ep->rec.kind)
+            rdp->opcode_seen[ep->rec.cmdp[0] >> 3] |=
+                                        (1 << (ep->rec.cmdp[0] & 7));
+        else
+            ++num_nvme;
+    }
+    rdp->is_nvme = (num_nvme > 0);
+    pthread_mutex_init(&rdp->lock, NULL);
+    rdp->fd = fd;
+    if (vb > 1)
+        pr2ws("%s: %d recorded commands loaded from %s\n", __func__,
+              rdp->num_ent, fname);
+    *rdpp = rdp;
+    return 0;
+nomem:
+    replay_dev_free(rdp);
+    return -ENOMEM;
+not_rec:
+    if (vb)
+        pr2ws("%s: %s is not a sg3_utils command recording\n", __func__,
+              fname);
+    return -EINVAL;
+}
+
+static struct replay_dev *
+replay_dev_get(int fd)
+{
+    struct replay_dev * rdp;
+
+    pthread_mutex_lock(&replay_lock);
+    for (rdp = replay_dev_head; rdp; rdp = rdp->next) {
+        if (fd == rdp->fd)
+            break;
+    }
+    pthread_mutex_unlock(&replay_lock);
+    return rdp;
+}
+
+static void
+replay_lat_init(void)
+{
+    const char * cp = getenv(SG_PT_REPLAY_LAT_ENV);
+    int64_t ll;
+
+    replay_lat_state = 0;
+    if ((NULL == cp) || ('\0' == *cp))
+        return;
+    if (0 == strcmp(cp, "rec"))
+        replay_lat_state = 1;
+    else {
+        ll = sg_get_llnum(cp);
+        if (ll > 0) {
+            replay_lat_ns = (uint64_t)ll * 1000;
+            replay_lat_state = 2;
+        } else if (ll < 0)
+            pr2ws("%s: bad value: %s, ignored\n", SG_PT_REPLAY_LAT_ENV, cp);
+    }
+}
+
+/* Waits until 'delay_ns' after 'start_ns' */
+static void
+replay_delay(uint64_t start_ns, uint64_t delay_ns)
+{
+    uint64_t now_ns = sg_pt_stats_now_ns();
+    uint64_t end_ns = start_ns + delay_ns;
+    struct timespec ts;
+
+    if (now_ns >= end_ns)
+        return;
+    if ((end_ns - now_ns) >= REPLAY_SPIN_NS) {
+        ts.tv_sec = (end_ns - now_ns) / 1000000000;
+        ts.tv_nsec = (end_ns - now_ns) % 1000000000;
+        while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+            ;
+        return;
+    }
+    while (sg_pt_stats_now_ns() < end_ns)
+        ;
+}
+
+/* Returns >= 0 if successful. If error in Unix returns negated errno. */
+int
+scsi_pt_open_device(const char * device_name, bool read_only, int verbose)
+{
+    int oflags = 0 /* O_NONBLOCK*/ ;
+
+    oflags |= (read_only ? O_RDONLY : O_RDWR);
+    return scsi_pt_open_flags(device_name, oflags, verbose);
+}
+
+/* Similar to scsi_pt_open_device() but takes Unix style open flags OR-ed
+ * together. The flags are ignored as the recording is opened read-only.
+ * Returns >= 0 if successful, otherwise returns negated errno. */
+int
+scsi_pt_open_flags(const char * device_name, int flags, int verbose)
+{
+    int fd, res;
+    const char * fname = getenv(SG_PT_REPLAY_ENV);
+    struct replay_dev * rdp = NULL;
+
+    if (flags) {}
+    if ((NULL == fname) || ('\0' == *fname))
+        fname = device_name;
+    if (NULL == fname)
+        return -EINVAL;
+    if (replay_lat_state < 0)
+        replay_lat_init();
+    fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        res = -errno;
+        if (verbose > 1)
+            pr2ws("%s: open(%s) failed: %s\n", __func__, fname,
+                  safe_strerror(-res));
+        return res;
+    }
+    res = replay_dev_load(fd, fname, &rdp, verbose);
+    if (res < 0) {
+        close(fd);
+        return res;
+    }
+    pthread_mutex_lock(&replay_lock);
+    rdp->next = replay_dev_head;
+    replay_dev_head = rdp;
+    pthread_mutex_unlock(&replay_lock);
+    return fd;
+}
+
+/* Returns 0 if successful. If error in Unix returns negated errno. */
+int
+scsi_pt_close_device(int device_fd)
+{
+    struct replay_dev * rdp;
+    struct replay_dev * prev = NULL;
+
+    sg_pt_emul_release(device_fd);
+    scsi_pt_pool_flush(device_fd);
+    pthread_mutex_lock(&replay_lock);
+    for (rdp = replay_dev_head; rdp; prev = rdp, rdp = rdp->next) {
+        if (device_fd == rdp->fd) {
+            if (prev)
+                prev->next = rdp->next;
+            else
+                replay_dev_head = rdp->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&replay_lock);
+    replay_dev_free(rdp);
+    if (close(device_fd) < 0)
+        return -errno;
+    return 0;
+}
+
+struct sg_pt_base *
+construct_scsi_pt_obj_with_fd(int device_fd, int verbose)
+{
+    struct sg_pt_replay * ptp;
+
+    ptp = (struct sg_pt_replay *)calloc(1, sizeof(struct sg_pt_replay));
+    if (ptp) {
+        ptp->dev_fd = (device_fd < 0) ? -1 : device_fd;
+        if (device_fd >= 0)
+            ptp->devp = replay_dev_get(device_fd);
+    } else if (verbose)
+        pr2ws("%s: calloc() out of memory\n", __func__);
+    return (struct sg_pt_base *)ptp;
+}
+
+struct sg_pt_base *
+construct_scsi_pt_obj(void)
+{
+    return construct_scsi_pt_obj_with_fd(-1, 0);
+}
+
+void
+destruct_scsi_pt_obj(struct sg_pt_base * vp)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (ptp)
+        free(ptp);
+}
+
+/* Keeps the file handle */
+void
+clear_scsi_pt_obj(struct sg_pt_base * vp)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (ptp) {
+        int fd = ptp->dev_fd;
+        struct replay_dev * rdp = ptp->devp;
+
+        memset(ptp, 0, sizeof(*ptp));
+        ptp->dev_fd = fd;
+        ptp->devp = rdp;
+    }
+}
+
+static void
+replay_clear_resp(struct sg_pt_replay * ptp)
+{
+    ptp->os_err = 0;
+    ptp->transport_err = 0;
+    ptp->sense_len = 0;
+    ptp->status = 0;
+    ptp->category = 0;
+    ptp->din_act = 0;
+    ptp->result = 0;
+    ptp->dur_ns = 0;
+}
+
+/* Keeps the command and sense buffer, clears the data buffers and the
+ * response */
+void
+partial_clear_scsi_pt_obj(struct sg_pt_base * vp)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (NULL == ptp)
+        return;
+    replay_clear_resp(ptp);
+    ptp->in_err = 0;
+    ptp->dinp = NULL;
+    ptp->din_len = 0;
+    ptp->dout_len = 0;
+}
+
+void
+set_scsi_pt_cdb(struct sg_pt_base * vp, const uint8_t * cdb,
+                int cdb_len)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if ((NULL == cdb) || (cdb_len < 1) || (cdb_len > REPLAY_MAX_CMD_LEN)) {
+        ++ptp->in_err;
+        return;
+    }
+    ptp->cmdp = cdb;
+    ptp->cmd_len = cdb_len;
+}
+
+int
+get_scsi_pt_cdb_len(const struct sg_pt_base * vp)
+{
+    return vp->impl.cmd_len;
+}
+
+uint8_t *
+get_scsi_pt_cdb_buf(const struct sg_pt_base * vp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+
+    return (uint8_t *)ptp->cmdp;
+}
+
+void
+set_scsi_pt_sense(struct sg_pt_base * vp, uint8_t * sense,
+                  int max_sense_len)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (sense && (max_sense_len > 0))
+        memset(sense, 0, max_sense_len);
+    ptp->sensep = sense;
+    ptp->sense_max = (max_sense_len > 0) ? max_sense_len : 0;
+}
+
+/* from device */
+void
+set_scsi_pt_data_in(struct sg_pt_base * vp, uint8_t * dxferp,
+                    int dxfer_len)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (ptp->dout_len > 0)
+        ++ptp->in_err;
+    ptp->dinp = dxferp;
+    ptp->din_len = (dxfer_len > 0) ? dxfer_len : 0;
+}
+
+/* to device, the data itself is ignored */
+void
+set_scsi_pt_data_out(struct sg_pt_base * vp, const uint8_t * dxferp,
+                     int dxfer_len)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (ptp->din_len > 0)
+        ++ptp->in_err;
+    if (dxferp) {}
+    ptp->dout_len = (dxfer_len > 0) ? dxfer_len : 0;
+}
+
+void
+set_scsi_pt_packet_id(struct sg_pt_base * vp, int pack_id)
+{
+    if (vp) {}
+    if (pack_id) {}
+}
+
+void
+set_scsi_pt_tag(struct sg_pt_base * vp, uint64_t tag)
+{
+    if (vp) {}
+    if (tag) {}
+}
+
+void
+set_scsi_pt_task_management(struct sg_pt_base * vp, int tmf_code)
+{
+    if (tmf_code) {}
+    ++vp->impl.in_err;
+}
+
+void
+set_scsi_pt_task_attr(struct sg_pt_base * vp, int attrib, int priority)
+{
+    if (vp) {}
+    if (attrib) {}
+    if (priority) {}
+}
+
+void
+set_scsi_pt_flags(struct sg_pt_base * vp, int flags)
+{
+    if (vp) {}
+    if (flags) {}
+}
+
+/* Serves the response for the command in ptp from its device's recording.
+ * Returns what do_scsi_pt() should. */
+static int
+replay_cmd(struct sg_pt_replay * ptp, int kind, int vb)
+{
+    int n, cur;
+    struct replay_dev * rdp = ptp->devp;
+    struct replay_slot * sp;
+    const struct sg_pt_record_rec * rp;
+
+    if ((NULL == rdp) || (rdp->fd != ptp->dev_fd)) {
+        rdp = replay_dev_get(ptp->dev_fd);
+        ptp->devp = rdp;
+        if (NULL == rdp) {
+            if (vb)
+                pr2ws("%s: fd=%d is not a recording\n", __func__,
+                      ptp->dev_fd);
+            ptp->os_err = ENODEV;
+            return -ENODEV;
+        }
+    }
+    replay_clear_resp(ptp);
+    if (NULL == ptp->cmdp) {
+        if (vb)
+            pr2ws("No command given\n");
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    pthread_mutex_lock(&rdp->lock);
+    sp = replay_find_slot(rdp, kind, ptp->cmdp, ptp->cmd_len);
+    cur = sp->cur;
+    if (cur >= 0) {
+        sp->cur = rdp->ents[cur].next;
+        if (sp->cur < 0)
+            sp->cur = sp->head;         /* wrap around */
+    }
+    pthread_mutex_unlock(&rdp->lock);
+
+    if (cur < 0) {      /* not recorded */
+        if (vb > 1)
+            pr2ws("%s: command not found in recording\n", __func__);
+        if (SG_PT_STATS_KIND_SCSI != kind)
+            return SCSI_PT_DO_NOT_SUPPORTED;
+        ptp->status = SAM_STAT_CHECK_CONDITION;
+        ptp->category = SCSI_PT_RESULT_SENSE;
+        if (ptp->sensep && (ptp->sense_max >= 18)) {
+            bool seen = !! (rdp->opcode_seen[ptp->cmdp[0] >> 3] &
+                            (1 << (ptp->cmdp[0] & 7)));
+
+            sg_build_sense_buffer(false, ptp->sensep,
+                                  SPC_SK_ILLEGAL_REQUEST,
+                                  seen ? 0x24 : 0x20, 0);
+            ptp->sense_len = 18;
+        }
+        return 0;
+    }
+    rp = &rdp->ents[cur].rec;
+    ptp->status = rp->status;
+    ptp->category = rp->category;
+    ptp->result = rp->result;
+    ptp->dur_ns = rp->dur_ns;
+    if (ptp->sensep && (rp->sense_len > 0)) {
+        n = (rp->sense_len < ptp->sense_max) ? rp->sense_len :
+                                               ptp->sense_max;
+        memcpy(ptp->sensep, rp->sensep, n);
+        ptp->sense_len = n;
+    }
+    if (ptp->dinp && (ptp->din_len > 0)) {
+        n = ((int)rp->din_act < ptp->din_len) ? (int)rp->din_act :
+                                                ptp->din_len;
+        if (n > 0)
+            memcpy(ptp->dinp, rp->dinp, n);
+        ptp->din_act = n;
+    }
+    if (rp->res < 0)
+        ptp->os_err = -rp->res;
+    else if (SCSI_PT_RESULT_TRANSPORT_ERR == rp->category)
+        ptp->transport_err = 1;
+    return rp->res;
+}
+
+static int
+replay_do(struct sg_pt_base * vp, int kind, int verbose)
+{
+    int res;
+    uint64_t t0 = 0;
+    struct sg_pt_replay * ptp = &vp->impl;
+    bool observe = sg_pt_observe_on();
+
+    if (ptp->in_err) {
+        if (verbose)
+            pr2ws("Replicated or unused set_scsi_pt... functions\n");
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    if (observe || (replay_lat_state > 0))
+        t0 = sg_pt_stats_now_ns();
+    res = replay_cmd(ptp, kind, verbose);
+    if (1 == replay_lat_state)
+        replay_delay(t0, ptp->dur_ns);
+    else if (2 == replay_lat_state)
+        replay_delay(t0, replay_lat_ns);
+    if (observe)
+        sg_pt_observe_done(vp, kind, res, t0, ptp->dinp);
+    return res;
+}
+
+/* Executes SCSI command (or a NVMe Admin command when a 64 byte command is
+ * given on a recording of a NVMe device) by serving the recorded response.
+ * Returns 0 for success, negative numbers are negated 'errno' values
+ * (as recorded). Positive return values are errors from this package. */
+int
+do_scsi_pt(struct sg_pt_base * vp, int device_fd, int time_secs, int verbose)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (time_secs) {}
+    if (device_fd >= 0)
+        ptp->dev_fd = device_fd;
+    if ((NULL == ptp->devp) || (ptp->devp->fd != ptp->dev_fd))
+        ptp->devp = replay_dev_get(ptp->dev_fd);
+    ptp->is_nvme_cmd = ptp->devp && ptp->devp->is_nvme &&
+                       (64 == ptp->cmd_len);
+    return replay_do(vp, ptp->is_nvme_cmd ? SG_PT_STATS_KIND_NVME_ADMIN :
+                                            SG_PT_STATS_KIND_SCSI, verbose);
+}
+
+/* The asynchronous interface is emulated (see sg_pt_common.c) */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int dev_fd, int time_secs,
+                  int verbose)
+{
+    return sg_pt_emul_submit(vp, dev_fd, time_secs, verbose);
+}
+
+int
+do_scsi_pt_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                int verbose)
+{
+    return sg_pt_emul_reap(dev_fd, wait, objpp, verbose);
+}
+
+int
+get_pt_poll_fd(int dev_fd, int verbose)
+{
+    return sg_pt_emul_poll_fd(dev_fd, verbose);
+}
+
+int
+get_pt_num_pending(int dev_fd)
+{
+    return sg_pt_emul_num_pending(dev_fd);
+}
+
+void
+scsi_pt_async_release(int dev_fd)
+{
+    sg_pt_emul_release(dev_fd);
+}
+
+/* Multiple requests are emulated too */
+int
+do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int dev_fd,
+               int time_secs, int mrq_flags, int * num_donep, int verbose)
+{
+    return sg_pt_emul_mrq(objpp, num, dev_fd, time_secs, mrq_flags,
+                          num_donep, verbose);
+}
+
+int
+do_scsi_pt_mrq_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                    int max, int verbose)
+{
+    return sg_pt_emul_mrq_reap(dev_fd, wait, objpp, max, verbose);
+}
+
+int
+get_scsi_pt_result_category(const struct sg_pt_base * vp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+
+    if (ptp->os_err)
+        return SCSI_PT_RESULT_OS_ERR;
+    return ptp->category;
+}
+
+int
+get_scsi_pt_resid(const struct sg_pt_base * vp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+
+    return (ptp->din_len > 0) ? (ptp->din_len - ptp->din_act) : 0;
+}
+
+void
+get_pt_req_lengths(const struct sg_pt_base * vp, int * req_dinp,
+                   int * req_doutp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+
+    if (req_dinp)
+        *req_dinp = ptp->din_len;
+    if (req_doutp)
+        *req_doutp = ptp->dout_len;
+}
+
+void
+get_pt_actual_lengths(const struct sg_pt_base * vp, int * act_dinp,
+                      int * act_doutp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+
+    if (act_dinp)
+        *act_dinp = ptp->din_act;
+    if (act_doutp)
+        *act_doutp = ptp->dout_len;
+}
+
+int
+get_scsi_pt_status_response(const struct sg_pt_base * vp)
+{
+    return vp->impl.status;
+}
+
+int
+get_scsi_pt_sense_len(const struct sg_pt_base * vp)
+{
+    return vp->impl.sense_len;
+}
+
+uint8_t *
+get_scsi_pt_sense_buf(const struct sg_pt_base * vp)
+{
+    return vp->impl.sensep;
+}
+
+int
+get_scsi_pt_duration_ms(const struct sg_pt_base * vp)
+{
+    return (int)(vp->impl.dur_ns / 1000000);
+}
+
+/* Returns the recorded duration of the command just served, in
+ * nanoseconds */
+uint64_t
+get_pt_duration_ns(const struct sg_pt_base * vp)
+{
+    return vp->impl.dur_ns;
+}
+
+int
+get_scsi_pt_transport_err(const struct sg_pt_base * vp)
+{
+    return vp->impl.transport_err;
+}
+
+int
+get_scsi_pt_os_err(const struct sg_pt_base * vp)
+{
+    return vp->impl.os_err;
+}
+
+bool
+pt_device_is_nvme(const struct sg_pt_base * vp)
+{
+    const struct sg_pt_replay * ptp = &vp->impl;
+    const struct replay_dev * rdp = ptp->devp;
+
+    if ((NULL == rdp) || (rdp->fd != ptp->dev_fd))
+        rdp = replay_dev_get(ptp->dev_fd);
+    return rdp ? rdp->is_nvme : false;
+}
+
+char *
+get_scsi_pt_transport_err_str(const struct sg_pt_base * vp, int max_b_len,
+                              char * b)
+{
+    if ((NULL == b) || (max_b_len < 1))
+        return b;
+    if (vp->impl.transport_err)
+        snprintf(b, max_b_len, "recorded transport error\n");
+    else
+        b[0] = '\0';
+    return b;
+}
+
+char *
+get_scsi_pt_os_err_str(const struct sg_pt_base * vp, int max_b_len, char * b)
+{
+    const char * cp = safe_strerror(vp->impl.os_err);
+
+    if ((NULL == b) || (max_b_len < 1))
+        return b;
+    snprintf(b, max_b_len, "%s", cp);
+    return b;
+}
+
+/* Serves a NVMe (non-Admin) command from the recording. Only recordings of
+ * NVMe devices hold such commands. */
+int
+do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int verbose)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (submq) { }
+    if (timeout_secs) { }
+    if ((NULL == ptp->cmdp) || (64 != ptp->cmd_len)) {
+        if (verbose > 1)
+            pr2ws("%s: no NVMe 64 byte command present\n", __func__);
+        return SCSI_PT_DO_BAD_PARAMS;
+    }
+    ptp->is_nvme_cmd = true;
+    return replay_do(vp, SG_PT_STATS_KIND_NVME_NVM, verbose);
+}
+
+int
+check_pt_file_handle(int device_fd, const char * device_name, int vb)
+{
+    if (device_fd) {}
+    if (device_name) {}
+    if (vb) {}
+    return 0;
+}
+
+/* Valid file handles (which is the return value) are >= 0 . Returns -1
+ * if there is no valid file handle. */
+int
+get_pt_file_handle(const struct sg_pt_base * vp)
+{
+    return vp->impl.dev_fd;
+}
+
+/* Recordings do not hold the namespace identifier of a NVMe device, so
+ * the first one (1) is assumed. Returns 0 if not a NVMe recording. */
+uint32_t
+get_pt_nvme_nsid(const struct sg_pt_base * vp)
+{
+    return pt_device_is_nvme(vp) ? 1 : 0;
+}
+
+uint32_t
+get_pt_result(const struct sg_pt_base * vp)
+{
+    return vp->impl.result;
+}
+
+int
+set_pt_file_handle(struct sg_pt_base * vp, int dev_han, int vb)
+{
+    struct sg_pt_replay * ptp = &vp->impl;
+
+    if (vb) { }
+    ptp->dev_fd = (dev_han < 0) ? -1 : dev_han;
+    ptp->devp = (dev_han < 0) ? NULL : replay_dev_get(dev_han);
+    ptp->in_err = 0;
+    ptp->os_err = 0;
+    return 0;
+}
+
+void
+set_pt_metadata_xfer(struct sg_pt_base * vp, uint8_t * mdxferp,
+                     uint32_t mdxfer_len, bool out_true)
+{
+    if (mdxfer_len) { }
+    if (out_true) { }
+    vp->impl.mdxferp = mdxferp;
+}
+
+void
+set_scsi_pt_transport_err(struct sg_pt_base * vp, int err)
+{
+    vp->impl.transport_err = err;
+}
@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_win32 version 1.36 20231124 */
+/* sg_pt_win32 version 1.37 20261016 */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +27,7 @@
 #include "sg_lib.h"
 #include "sg_unaligned.h"
 #include "sg_pt.h"
+#include "sg_pt_emul.h"
 #include "sg_pt_win32.h"
 #include "sg_nvme.h"
 #include "sg_snt.h"
@@ -492,6 +493,8 @@ scsi_pt_close_device(int device_fd)
 
     if (NULL == shp)
         return -ENODEV;
+    sg_pt_emul_release(device_fd);
+    scsi_pt_pool_flush(device_fd);
     if ((! CloseHandle(shp->fh)) && shp->verbose)
         pr2ws("Windows CloseHandle error=%u\n", (unsigned int)GetLastError());
     shp->bus = 0;
@@ -1291,6 +1294,57 @@ do_scsi_pt(struct sg_pt_base * vp, int dev_fd, int time_secs, int vb)
         return scsi_pt_indirect(vp, shp, time_secs, vb);
 }
 
+/* There is no native asynchronous pass-through in this Windows interface, so
+ * it is emulated (see sg_pt_common.c): each command is executed when it
+ * is submitted and then queued for do_scsi_pt_reap(). */
+int
+do_scsi_pt_submit(struct sg_pt_base * vp, int dev_fd, int time_secs,
+                  int verbose)
+{
+    return sg_pt_emul_submit(vp, dev_fd, time_secs, verbose);
+}
+
+int
+do_scsi_pt_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                int verbose)
+{
+    return sg_pt_emul_reap(dev_fd, wait, objpp, verbose);
+}
+
+int
+get_pt_poll_fd(int dev_fd, int verbose)
+{
+    return sg_pt_emul_poll_fd(dev_fd, verbose);
+}
+
+int
+get_pt_num_pending(int dev_fd)
+{
+    return sg_pt_emul_num_pending(dev_fd);
+}
+
+void
+scsi_pt_async_release(int dev_fd)
+{
+    sg_pt_emul_release(dev_fd);
+}
+
+/* Multiple requests are emulated too (see sg_pt_common.c) */
+int
+do_scsi_pt_mrq(struct sg_pt_base ** objpp, int num, int dev_fd,
+               int time_secs, int mrq_flags, int * num_donep, int verbose)
+{
+    return sg_pt_emul_mrq(objpp, num, dev_fd, time_secs, mrq_flags,
+                          num_donep, verbose);
+}
+
+int
+do_scsi_pt_mrq_reap(int dev_fd, bool wait, struct sg_pt_base ** objpp,
+                    int max, int verbose)
+{
+    return sg_pt_emul_mrq_reap(dev_fd, wait, objpp, max, verbose);
+}
+
 int
 get_scsi_pt_result_category(const struct sg_pt_base * vp)
 {
@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Fast path for SCSI READ and WRITE commands (SBC). A cdb template is
+ * built once and for each command only the LBA and TRANSFER LENGTH fields
+ * are patched. The pass-through object and sense buffer are re-used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#               /* nop */
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <sys/time.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
+#include "sg_rw.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+
+#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+
+#define READ6_CMD 0x8
+#define WRITE6_CMD 0xa
+#define READ10_CMD 0x28
+#define WRITE10_CMD 0x2a
+#define READ12_CMD 0xa8
+#define WRITE12_CMD 0xaa
+#define READ16_CMD 0x88
+#define WRITE16_CMD 0x8a
+#define VARIABLE_LEN_OP 0x7f
+#define READ32_SA 0x9
+#define WRITE32_SA 0xb
+
+struct sg_rw_ctx {
+    struct sg_rw_tmpl tmpl;
+    struct sg_pt_base * ptp;
+    int sg_fd;
+    int blk_sz;
+    int timeout_secs;
+    int verbose;
+    int sense_len;      /* of last command, 0 if none */
+    uint8_t sense_b[SENSE_BUFF_LEN];
+};
+
+
+int
+sg_rw_tmpl_init(struct sg_rw_tmpl * tp, int cdb_len, bool is_write,
+                int protect, int flags, int group_num)
+{
+    uint8_t b1;
+    uint8_t * cdbp;
+
+    if ((NULL == tp) || (protect < 0) || (protect > 7) || (group_num < 0) ||
+        (group_num > 0x3f))
+        return SG_LIB_SYNTAX_ERROR;
+    memset(tp, 0, sizeof(*tp));
+    cdbp = tp->cdb;
+    b1 = (uint8_t)(protect << 5);
+    if (flags & SG_RW_FL_DPO)
+        b1 |= 0x10;
+    if (flags & SG_RW_FL_FUA)
+        b1 |= 0x8;
+    switch (cdb_len) {
+    case 6:
+        if (b1 || group_num)
+            return SG_LIB_SYNTAX_ERROR;
+        cdbp[0] = is_write ? WRITE6_CMD : READ6_CMD;
+        tp->lba_off = 1;
+        tp->num_off = 4;
+        break;
+    case 10:
+        cdbp[0] = is_write ? WRITE10_CMD : READ10_CMD;
+        cdbp[1] = b1;
+        cdbp[6] = (uint8_t)group_num;
+        tp->lba_off = 2;
+        tp->num_off = 7;
+        break;
+    case 12:
+        cdbp[0] = is_write ? WRITE12_CMD : READ12_CMD;
+        cdbp[1] = b1;
+        cdbp[10] = (uint8_t)group_num;
+        tp->lba_off = 2;
+        tp->num_off = 6;
+        break;
+    case 16:
+        cdbp[0] = is_write ? WRITE16_CMD : READ16_CMD;
+        cdbp[1] = b1;
+        cdbp[14] = (uint8_t)group_num;
+        tp->lba_off = 2;
+        tp->num_off = 10;
+        break;
+    case 32:
+        cdbp[0] = VARIABLE_LEN_OP;
+        cdbp[6] = (uint8_t)group_num;
+        cdbp[7] = 0x18;         /* additional cdb length */
+        sg_put_unaligned_be16(is_write ? WRITE32_SA : READ32_SA, cdbp + 8);
+        cdbp[10] = b1;
+        tp->lba_off = 12;
+        tp->num_off = 28;
+        tp->patch_ref_tag = (protect > 0);
+        break;
+    default:
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    tp->cdb_len = (uint8_t)cdb_len;
+    tp->is_write = is_write;
+    return 0;
+}
+
+int
+sg_rw_tmpl_patch(struct sg_rw_tmpl * tp, uint64_t lba, uint32_t num_blks)
+{
+    uint8_t * cdbp = tp->cdb;
+    /* last block in the range, num_blks of 0 transfers nothing */
+    uint64_t last = num_blks ? (lba + num_blks - 1) : lba;
+
+    if (last < lba)             /* wrapped */
+        return SG_LIB_LBA_OUT_OF_RANGE;
+    switch (tp->cdb_len) {
+    case 6:
+        if ((0 == num_blks) || (num_blks > 256))
+            return SG_LIB_SYNTAX_ERROR;
+        if (last > 0x1fffff)
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        sg_put_unaligned_be24((uint32_t)lba, cdbp + 1);
+        cdbp[4] = (uint8_t)num_blks;    /* 256 becomes 0 */
+        return 0;
+    case 10:
+        if (num_blks > 0xffff)
+            return SG_LIB_SYNTAX_ERROR;
+        if (last > 0xffffffff)
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+        sg_put_unaligned_be16((uint16_t)num_blks, cdbp + 7);
+        return 0;
+    case 12:
+        if (last > 0xffffffff)
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+        sg_put_unaligned_be32(num_blks, cdbp + 6);
+        return 0;
+    case 16:
+    case 32:
+        sg_put_unaligned_be64(lba, cdbp + tp->lba_off);
+        sg_put_unaligned_be32(num_blks, cdbp + tp->num_off);
+        if (tp->patch_ref_tag)
+            sg_put_unaligned_be32((uint32_t)lba, cdbp + 20);
+        return 0;
+    default:
+        return SG_LIB_SYNTAX_ERROR;     /* template not initialized */
+    }
+}
+
+struct sg_rw_ctx *
+sg_rw_ctx_new(int sg_fd, const struct sg_rw_tmpl * tp, int blk_sz,
+              int timeout_secs, int verbose)
+{
+    int err;
+    struct sg_rw_ctx * cp;
+
+    if ((NULL == tp) || (0 == tp->cdb_len) || (blk_sz <= 0)) {
+        if (verbose)
+            pr2ws("%s: bad template or block size\n", __func__);
+        return NULL;
+    }
+    cp = (struct sg_rw_ctx *)calloc(1, sizeof(*cp));
+    if (NULL == cp) {
+        pr2ws("%s: out of memory\n", __func__);
+        return NULL;
+    }
+    cp->ptp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    if (NULL == cp->ptp) {
+        pr2ws("%s: out of memory\n", __func__);
+        free(cp);
+        return NULL;
+    }
+    err = get_scsi_pt_os_err(cp->ptp);
+    if (err) {
+        if (verbose)
+            pr2ws("%s: unable to associate fd=%d: %s\n", __func__, sg_fd,
+                  safe_strerror(err));
+        destruct_scsi_pt_obj(cp->ptp);
+        free(cp);
+        return NULL;
+    }
+    cp->tmpl = *tp;
+    cp->sg_fd = sg_fd;
+    cp->blk_sz = blk_sz;
+    cp->timeout_secs = (timeout_secs > 0) ? timeout_secs : DEF_PT_TIMEOUT;
+    cp->verbose = verbose;
+    set_scsi_pt_sense(cp->ptp, cp->sense_b, sizeof(cp->sense_b));
+    return cp;
+}
+
+void
+sg_rw_ctx_free(struct sg_rw_ctx * cp)
+{
+    if (cp) {
+        if (cp->ptp)
+            destruct_scsi_pt_obj(cp->ptp);
+        free(cp);
+    }
+}
+
+int
+sg_rw_do(struct sg_rw_ctx * cp, uint64_t lba, uint32_t num_blks,
+         uint8_t * buff, int * residp, bool noisy)
+{
+    int res, ret, s_cat, dlen;
+    const char * leadin = cp->tmpl.is_write ? "write" : "read";
+    struct sg_rw_tmpl * tp = &cp->tmpl;
+    struct sg_pt_base * ptp = cp->ptp;
+
+    ret = sg_rw_tmpl_patch(tp, lba, num_blks);
+    if (ret) {
+        if (cp->verbose)
+            pr2ws("%s: lba=0x%" PRIx64 ", num_blks=%u out of range for "
+                  "%d byte cdb\n", leadin, lba, num_blks, tp->cdb_len);
+        return ret;
+    }
+    dlen = (int)num_blks * cp->blk_sz;
+    if (cp->verbose > 1) {
+        char b[128];
+
+        pr2ws("    %s cdb: %s\n", leadin,
+              sg_get_command_str(tp->cdb, tp->cdb_len, false, sizeof(b),
+                                 b));
+    }
+    partial_clear_scsi_pt_obj(ptp);
+    /* cdb and sense pointers only need setting after the last command
+     * yielded sense data or after caller used the pt object directly */
+    if ((cp->sense_len > 0) || (get_scsi_pt_cdb_buf(ptp) != tp->cdb)) {
+        set_scsi_pt_cdb(ptp, tp->cdb, tp->cdb_len);
+        set_scsi_pt_sense(ptp, cp->sense_b, sizeof(cp->sense_b));
+        cp->sense_len = 0;
+    }
+    if (dlen > 0) {
+        if (tp->is_write)
+            set_scsi_pt_data_out(ptp, buff, dlen);
+        else
+            set_scsi_pt_data_in(ptp, buff, dlen);
+    }
+    res = do_scsi_pt(ptp, cp->sg_fd, cp->timeout_secs, cp->verbose);
+    ret = sg_cmds_process_resp(ptp, leadin, res, noisy, cp->verbose,
+                               &s_cat);
+    cp->sense_len = get_scsi_pt_sense_len(ptp);
+    if (residp)
+        *residp = get_scsi_pt_resid(ptp);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptp));
+    } else if (-2 == ret) {
+        switch (s_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = s_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    return ret;
+}
+
+const uint8_t *
+sg_rw_get_sense(const struct sg_rw_ctx * cp, int * slenp)
+{
+    if (slenp)
+        *slenp = cp->sense_len;
+    return cp->sense_b;
+}
+
+struct sg_pt_base *
+sg_rw_get_pt(struct sg_rw_ctx * cp)
+{
+    return cp->ptp;
+}
+
+
+/* bpt=auto support follows */
+
+#define VPD_BLOCK_LIMITS 0xb0
+#define VPD_BLOCK_LIMITS_LEN 64
+#define RAMP_MIN_CMDS 4
+#define RAMP_MAX_CMDS 64
+#define RAMP_STEP_NS (40 * 1000 * 1000)         /* 40 ms per step */
+#define RAMP_MAX_LAT_US (100 * 1000)    /* don't grow past 100 ms per cmd */
+
+static uint64_t
+rw_now_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#elif defined(HAVE_GETTIMEOFDAY)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000000) +
+           ((uint64_t)tv.tv_usec * 1000);
+#else
+    return 0;
+#endif
+}
+
+/* Issues READs of bpt blocks for about RAMP_STEP_NS. Returns 0 or the
+ * error from sg_rw_do(). */
+static int
+rw_ramp_step(struct sg_rw_ctx * ctxp, uint64_t lba, uint64_t num_blks,
+             uint8_t * bp, struct sg_rw_ramp_step * sp)
+{
+    int k, res;
+    uint64_t off = 0;
+    uint64_t t, sum_ns = 0;
+
+    for (k = 0; k < RAMP_MAX_CMDS; ++k) {
+        if ((num_blks > 0) && ((off + sp->bpt) > num_blks))
+            off = 0;
+        t = rw_now_ns();
+        res = sg_rw_do(ctxp, lba + off, sp->bpt, bp, NULL, false);
+        if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+            (SG_LIB_CAT_ABORTED_COMMAND == res))
+            res = sg_rw_do(ctxp, lba + off, sp->bpt, bp, NULL, false);
+        if (res)
+            return res;
+        sum_ns += rw_now_ns() - t;
+        off += sp->bpt;
+        if ((sum_ns >= RAMP_STEP_NS) && (k >= (RAMP_MIN_CMDS - 1))) {
+            ++k;
+            break;
+        }
+    }
+    if (0 == sum_ns)
+        sum_ns = 1;     /* no usable clock, all steps will look equal */
+    sp->num_cmds = k;
+    sp->avg_lat_us = (uint32_t)(sum_ns / k / 1000);
+    sp->bytes_per_sec = (uint64_t)k * sp->bpt * ctxp->blk_sz *
+                        1000000000ULL / sum_ns;
+    return 0;
+}
+
+/* Returns the number of logical blocks from READ CAPACITY(16), falling
+ * back to READ CAPACITY(10). Returns 0 if neither works. */
+static uint64_t
+rw_num_lbs(int sg_fd, int verbose)
+{
+    uint8_t rc_buff[32];
+
+    if (0 == sg_ll_readcap_16(sg_fd, false, 0, rc_buff, sizeof(rc_buff),
+                              false, verbose))
+        return sg_get_unaligned_be64(rc_buff + 0) + 1;
+    if (0 == sg_ll_readcap_10(sg_fd, false, 0, rc_buff, 8, false, verbose))
+        return (uint64_t)sg_get_unaligned_be32(rc_buff + 0) + 1;
+    return 0;
+}
+
+int
+sg_rw_bpt_auto(int sg_fd, int blk_sz, int cdb_len, uint64_t lba,
+               uint64_t num_blks, int def_bpt, int max_bpt, bool do_ramp,
+               struct sg_rw_bpt_auto * bap, int verbose)
+{
+    int k, res, cap, gran, cand, n, best, stalls;
+    uint64_t best_bps;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+    struct sg_rw_ctx * ctxp;
+    struct sg_rw_tmpl tmpl;
+    uint8_t vpd[VPD_BLOCK_LIMITS_LEN];
+
+    if ((NULL == bap) || (blk_sz <= 0) || (def_bpt <= 0))
+        return SG_LIB_SYNTAX_ERROR;
+    memset(bap, 0, sizeof(*bap));
+    if (sg_rw_tmpl_init(&tmpl, cdb_len, false, 0, 0, 0))
+        return SG_LIB_SYNTAX_ERROR;
+    cap = (max_bpt > 0) ? max_bpt : (SG_RW_AUTO_MAX_BYTES / blk_sz);
+    if (cap < 1)
+        cap = 1;
+    if ((6 == cdb_len) && (cap > 256))
+        cap = 256;
+    else if ((10 == cdb_len) && (cap > 0xffff))
+        cap = 0xffff;
+
+    res = sg_ll_inquiry_v2(sg_fd, true, VPD_BLOCK_LIMITS, vpd, sizeof(vpd),
+                           0, NULL, false, (verbose > 1) ? verbose - 1 : 0);
+    if ((0 == res) && (VPD_BLOCK_LIMITS == vpd[1]) &&
+        (sg_get_unaligned_be16(vpd + 2) >= 12)) {
+        bap->vpd_valid = true;
+        bap->opt_xfer_gran = sg_get_unaligned_be16(vpd + 6);
+        bap->max_xfer_len = sg_get_unaligned_be32(vpd + 8);
+        bap->opt_xfer_len = sg_get_unaligned_be32(vpd + 12);
+        if ((bap->max_xfer_len > 0) && ((uint32_t)cap > bap->max_xfer_len))
+            cap = (int)bap->max_xfer_len;
+    } else if (verbose)
+        pr2ws("%s: Block Limits VPD page not available\n", __func__);
+    gran = bap->opt_xfer_gran;
+    if ((gran < 1) || (gran > cap))
+        gran = 1;
+
+    if (bap->opt_xfer_len > (uint32_t)cap)
+        cand = cap;     /* still the closest to what the device wants */
+    else if (bap->opt_xfer_len > 0)
+        cand = (int)bap->opt_xfer_len;
+    else
+        cand = (def_bpt < cap) ? def_bpt : cap;
+    cand = (cand < gran) ? gran : (cand / gran) * gran;
+    bap->vpd_bpt = cand;
+    bap->bpt = cand;
+    if (! do_ramp)
+        return 0;
+    if (0 == num_blks) {
+        /* caller does not know how much can be read, keep the ramp's
+         * READs within the medium */
+        uint64_t num_lbs = rw_num_lbs(sg_fd, (verbose > 1) ? verbose - 1 :
+                                                             0);
+
+        if (num_lbs > lba)
+            num_blks = num_lbs - lba;
+    }
+
+    /* ramp: double from about vpd_bpt/8 (a multiple of gran) up to cap */
+    cand = bap->vpd_bpt / 8;
+    cand = (cand <= gran) ? gran : (cand / gran) * gran;
+    for (n = 0; (cand <= cap) && (n < SG_RW_RAMP_MAX_STEPS); cand *= 2) {
+        if ((num_blks > 0) && ((uint64_t)cand > num_blks))
+            break;
+        bap->step[n++].bpt = cand;
+        if (cand > (cap / 2))
+            break;
+    }
+    if (0 == n)
+        return 0;
+    bp = sg_memalign(bap->step[n - 1].bpt * blk_sz, 0, &free_bp, false);
+    if (NULL == bp)
+        return sg_convert_errno(ENOMEM);
+    ctxp = sg_rw_ctx_new(sg_fd, &tmpl, blk_sz, 0,
+                         (verbose > 2) ? verbose - 2 : 0);
+    if (NULL == ctxp) {
+        free(free_bp);
+        return sg_convert_errno(ENOMEM);
+    }
+    best = -1;
+    best_bps = 0;
+    stalls = 0;
+    for (k = 0; k < n; ++k) {
+        struct sg_rw_ramp_step * sp = bap->step + k;
+
+        res = rw_ramp_step(ctxp, lba, num_blks, bp, sp);
+        if (res) {
+            if (verbose)
+                pr2ws("%s: READ of %d blocks failed, stop ramp\n", __func__,
+                      sp->bpt);
+            bap->ramp_err = true;
+            break;
+        }
+        bap->num_steps = k + 1;
+        if (verbose)
+            pr2ws("  ramp: bpt=%d, %d cmds, %" PRIu64 " KB/s, %u us per "
+                  "cmd\n", sp->bpt, sp->num_cmds, sp->bytes_per_sec / 1000,
+                  sp->avg_lat_us);
+        /* stop when 2 steps in a row gain less than 5% */
+        if ((sp->bytes_per_sec * 100) < (best_bps * 105))
+            ++stalls;
+        else
+            stalls = 0;
+        if (sp->bytes_per_sec > best_bps) {
+            best = k;
+            best_bps = sp->bytes_per_sec;
+        }
+        if (stalls >= 2)
+            break;
+        if (sp->avg_lat_us > RAMP_MAX_LAT_US)
+            break;
+    }
+    sg_rw_ctx_free(ctxp);
+    free(free_bp);
+    if (best < 0)
+        return 0;       /* ramp failed, keep VPD based choice */
+    for (k = 0; k <= best; ++k) {
+        if ((bap->step[k].bytes_per_sec * 100) >= (best_bps * 95)) {
+            bap->bpt = bap->step[k].bpt;
+            break;
+        }
+    }
+    return 0;
+}
+
+char *
+sg_rw_bpt_auto_str(const struct sg_rw_bpt_auto * bap, int blk_sz, int blen,
+                   char * b)
+{
+    int k, n;
+
+    if ((NULL == b) || (blen < 1))
+        return b;
+    n = sg_scn3pr(b, blen, 0, "bpt=%d", bap->bpt);
+    if (bap->vpd_valid)
+        n += sg_scn3pr(b, blen, n, " [Block Limits: max=%u, opt=%u, "
+                       "gran=%u blocks", bap->max_xfer_len,
+                       bap->opt_xfer_len, bap->opt_xfer_gran);
+    else
+        n += sg_scn3pr(b, blen, n, " [no Block Limits VPD");
+    if (bap->num_steps > 0) {
+        const struct sg_rw_ramp_step * sp = bap->step;
+
+        for (k = 0; k < bap->num_steps; ++k) {
+            if (bap->step[k].bpt == bap->bpt) {
+                sp = bap->step + k;
+                break;
+            }
+        }
+        n += sg_scn3pr(b, blen, n, "; ramp %d step%s, %" PRIu64 " KB/s, "
+                       "%u us per cmd%s", bap->num_steps,
+                       (1 == bap->num_steps) ? "" : "s",
+                       sp->bytes_per_sec / 1000, sp->avg_lat_us,
+                       bap->ramp_err ? ", stopped by error" : "");
+    } else if (bap->ramp_err)
+        n += sg_scn3pr(b, blen, n, "; ramp failed");
+    sg_scn3pr(b, blen, n, "] %d KiB per cmd", (bap->bpt * blk_sz) / 1024);
+    return b;
+}
@@ -54,12 +54,32 @@
 #ifndef major
 #include <sys/types.h>
 #endif
+#include <pthread.h>
 
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef __STDC_VERSION__
+#if __STDC_VERSION__ >= 201112L && defined(HAVE_STDATOMIC_H)
+#ifndef __STDC_NO_ATOMICS__
+
+#define HAVE_C11_ATOMICS
+#include <stdatomic.h>
+
+#endif
+#endif
+#endif
+
+/* Counters that both stages of the nbuf=NBUF pipeline may update. The
+ * pipeline is only available when C11 atomics are. */
+#ifdef HAVE_C11_ATOMICS
+#define SGD_ATOMIC _Atomic
+#else
+#define SGD_ATOMIC
+#endif
+
 #ifdef HAVE_LINUX_MAJOR_H
 #include <linux/major.h>
 #include <linux/fs.h>           /* for BLKSSZGET and friends */
@@ -74,11 +94,13 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_io_linux.h"
+#include "sg_rw.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "sg_pt.h"              /* used to get to SNTL for NVMe devices */
+#include "sg_blkemu.h"
 
-static const char * version_str = "6.50 20231206";
+static const char * version_str = "6.53 20261016";
 
 static const char * my_name = "sg_dd: ";
 
@@ -100,6 +122,7 @@ static const char * my_name = "sg_dd: ";
 #define MAX_SCSI_CDBSZ 16
 #define MAX_BPT_VALUE (1 << 24)         /* used for maximum bs as well */
 #define MAX_COUNT_SKIP_SEEK (1LL << 48) /* coverity wants upper bound */
+#define MAX_NBUF 64             /* maximum buffers in copy pipeline */
 
 #define DEF_MODE_CDB_SZ 10
 #define DEF_MODE_RESP_LEN 252
@@ -139,6 +162,10 @@ static const char * my_name = "sg_dd: ";
 #define FT_RANDOM_0_FF 256      /* iflag=00, iflag=ff and iflag=random
                                    overriding if=IFILE */
 #define FT_ERROR 512           /* couldn't "stat" file */
+#define FT_NVME_GEN 1024        /* NVMe generic char device (e.g. /dev/ng0n1),
+                                   also has FT_SG and FT_NVME set */
+#define FT_EMU 2048             /* emulated block device (e.g. "blkemu:"),
+                                   also has FT_SG set */
 
 #define DEV_NULL_MINOR_NUM 3
 
@@ -151,6 +178,10 @@ static const char * my_name = "sg_dd: ";
 
 #define MIN_RESERVED_SIZE 8192
 
+/* READs and WRITEs to a NVMe generic char device are split into (at most)
+ * this many commands which are submitted together */
+#define SNTL_MAX_SPLIT 8
+
 #define MAX_UNIT_ATTENTIONS 10
 #define MAX_ABORTED_CMDS 256
 
@@ -161,25 +192,26 @@ static const char * my_name = "sg_dd: ";
 // static int sum_of_resids = 0;
 
 // static int64_t dd_count = -1;   /* number of block given to count=COUNT */
-static int64_t in_full = 0;     /* count so far of full blocks read */
-static int in_partial = 0;      /* count so far of partial blocks read */
+static SGD_ATOMIC int64_t in_full = 0; /* count of full blocks read */
+static SGD_ATOMIC int in_partial = 0;   /* count of partial blocks read */
 static int64_t out_full = 0;    /* count so far of full blocks written */
 static int out_partial = 0;     /* count so far of partial blocks written */
 static int64_t out_sparse_num = 0;
-static int recovered_errs = 0;
-static int unrecovered_errs = 0;
+static SGD_ATOMIC int recovered_errs = 0;
+static SGD_ATOMIC int unrecovered_errs = 0;
 static int miscompare_errs = 0;
 static int read_longs = 0;
-static int num_retries = 0;
+static SGD_ATOMIC int num_retries = 0;
 
 static bool start_tm_valid = false;
-static int max_uas = MAX_UNIT_ATTENTIONS;
-static int max_aborted = MAX_ABORTED_CMDS;
-static uint32_t glob_pack_id = 0;       /* pre-increment */
+static SGD_ATOMIC int max_uas = MAX_UNIT_ATTENTIONS;
+static SGD_ATOMIC int max_aborted = MAX_ABORTED_CMDS;
+static SGD_ATOMIC uint32_t glob_pack_id = 0;    /* pre-increment */
 static struct timeval start_tm;
 
 static uint8_t * zeros_buff = NULL;
 static uint8_t * free_zeros_buff = NULL;
+static uint8_t * sparse_bitmap = NULL;  /* oflag=sparse: a bit per block */
 static int read_long_blk_inc = READ_LONG_DEF_BLK_INC;
 
 static long seed;
@@ -215,6 +247,7 @@ struct flags_t {
 
 struct opts_t
 {
+    bool bpt_auto;           /* bpt=auto, cleared once tuned */
     bool bpt_given;
     bool cdbsz_given;
     bool cdl_given;
@@ -241,13 +274,16 @@ struct opts_t
     int out2_type;
     int blk_sz;                 /* _logical_ block size (e.g. 512 or 4096) */
     int bpt;
-    int dio_incomplete_count;
-    int sum_of_resids;
+    int nbuf;                   /* nbuf=NBUF, >1 pipelines read and write */
+    SGD_ATOMIC int dio_incomplete_count;
+    SGD_ATOMIC int sum_of_resids;
     int progress;       /* --progress or -p, checked in sig_listen_thread */
     int verbose;
     int dry_run;
     struct sg_pt_base *in_ptp;    /* these two pointers only used if NVMe */
     struct sg_pt_base *out_ptp;   /* ... devices are detected */
+    struct sg_pt_base *in_sptp[SNTL_MAX_SPLIT];  /* NVMe generic: split */
+    struct sg_pt_base *out_sptp[SNTL_MAX_SPLIT]; /* ... commands */
     char in_fname[INOUTF_SZ];
     char out_fname[INOUTF_SZ];
     char out2_fname[INOUTF_SZ];
@@ -399,6 +435,8 @@ dd_filetype(const char * filename, const struct opts_t * op)
 
     if ((1 == len) && ('.' == filename[0]))
         return FT_DEV_NULL;
+    if (sg_blkemu_is_name(filename))
+        return FT_SG | FT_EMU;
     if (stat(filename, &st) < 0)
         return FT_ERROR;
     if (S_ISCHR(st.st_mode)) {
@@ -421,7 +459,7 @@ dd_filetype(const char * filename, const struct opts_t * op)
         if (nvme_major == (int)major(st.st_rdev))       /* e.g. /dev/nvme0 */
             return FT_SG | FT_NVME;     /* treat as sg device */
         if (nvme_gen_major == (int)major(st.st_rdev))   /* e.g. /dev/ng0n1 */
-            return FT_SG | FT_NVME;     /* treat as sg device */
+            return FT_SG | FT_NVME | FT_NVME_GEN;
     } else if (S_ISBLK(st.st_mode)) {
         if (BLOCK_EXT_MAJOR == (int)major(st.st_rdev))
             return FT_BLOCK | FT_NVME;
@@ -433,6 +471,24 @@ dd_filetype(const char * filename, const struct opts_t * op)
 }
 
 
+/* Emulated block devices (see sg_blkemu.h) are opened via the pass-through,
+ * everything else with open(2). Returns file descriptor or -1 with errno
+ * set. */
+static int
+dd_open(const char * fn, int flags, int ft)
+{
+    int fd;
+
+    if (! (FT_EMU & ft))
+        return open(fn, flags);
+    fd = scsi_pt_open_flags(fn, flags, 0);
+    if (fd < 0) {
+        errno = -fd;
+        return -1;
+    }
+    return fd;
+}
+
 static char *
 dd_filetype_str(int ft, char * b, bool sgio_pt)
 {
@@ -442,7 +498,9 @@ dd_filetype_str(int ft, char * b, bool sgio_pt)
 
     if (FT_DEV_NULL & ft)
         off += sg_scn3pr(b, blen, off, "null device");
-    if (FT_NVME & ft) {
+    if (FT_EMU & ft)
+        off += sg_scn3pr(b, blen, off, "emulated block device, %s", abpt_s);
+    else if (FT_NVME & ft) {
         if (FT_BLOCK & ft) {
             off += sg_scn3pr(b, blen, off, "NVMe block device");
             if (sgio_pt)
@@ -480,12 +538,13 @@ usage()
             "[seek=SEEK]\n"
             "              [skip=SKIP] [--dry-run] [--help] [--verbose] "
             "[--version]\n\n"
-            "              [blk_sgio=0|1] [bpt=BPT] [cdbsz=6|10|12|16] "
+            "              [blk_sgio=0|1] [bpt=BPT|auto] [cdbsz=6|10|12|16] "
             "[cdl=CDL]\n"
             "              [coe=0|1|2|3] [coe_limit=CL] [dio=0|1] "
             "[grpnum=GN]\n"
-            "              [odir=0|1] [of2=OFILE2] [retries=RETR] "
-            "[sync=0|1]\n"
+            "              [nbuf=NBUF] [odir=0|1] [of2=OFILE2] "
+            "[retries=RETR]\n"
+            "              [sync=0|1]\n"
             "              [time=0|1[,TO]] [verbose=VERB] [--compare] "
             "[--progress]\n"
             "              [--verify]\n"
@@ -494,6 +553,8 @@ usage()
             "SG_IO\n"
             "    bpt         is blocks_per_transfer (default is 128 or 32 "
             "when BS>=2048)\n"
+            "                'auto' uses Block Limits VPD then a READ "
+            "ramp\n"
             "    bs          logical block size (default is 512)\n");
     pr2serr("    cdbsz       size of SCSI READ or WRITE cdb (default is "
             "10)\n"
@@ -520,6 +581,8 @@ usage()
             "    iflag       comma separated list from: [00,coe,dio,direct,"
             "dpo,dsync,\n"
             "                excl,ff,flock,fua,nocache,null,pt,random,sgio]\n"
+            "    nbuf        number of buffers (def: 1); when > 1 reads "
+            "overlap writes\n"
             "    obs         output logical block size (if given must be "
             "same as 'bs=')\n"
             "    odir        1->use O_DIRECT when opening block dev, "
@@ -752,17 +815,15 @@ sg_build_scsi_cdb(uint8_t * cdbp, unsigned int blocks, int64_t start_block,
     return 0;
 }
 
+/* Prepares *ptvpp (constructing it if NULL) to send scsiCdb via the SNTL
+ * to the device associated with sg_fd. Returns 0 or -ENOMEM. */
 static int
-use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
-         int64_t start_block, bool write_true, uint64_t * io_addrp,
-         struct opts_t * op)
+sntl_prep(struct sg_pt_base ** ptvpp, int sg_fd, const uint8_t * scsiCdb,
+          uint8_t * buff, int blocks, uint8_t * sense_b, bool write_true,
+          const struct opts_t * op)
 {
-    int to, res, ret, vb, slen, sense_cat, info_valid;
-    int sg_fd = write_true ? op->outfd : op->infd;
-    struct sg_pt_base * ptvp = write_true ? op->out_ptp : op->in_ptp;
-    struct flags_t * flagp = write_true ? &op->oflag : &op->iflag;
-    const char * cmd_s = write_true ? "write" : "read";
-    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp = *ptvpp;
+    const struct flags_t * flagp = write_true ? &op->oflag : &op->iflag;
 
     if (ptvp)
         clear_scsi_pt_obj(ptvp);
@@ -770,10 +831,7 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
         ptvp = construct_scsi_pt_obj_with_fd(sg_fd, op->verbose);
         if (NULL == ptvp)
             return -ENOMEM;
-        if (write_true)
-            op->out_ptp = ptvp;
-        else
-            op->in_ptp = ptvp;
+        *ptvpp = ptvp;
     }
     set_scsi_pt_cdb(ptvp, scsiCdb, flagp->cdbsz);
     if (write_true)
@@ -781,14 +839,21 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
     else
         set_scsi_pt_data_in(ptvp, buff, blocks * op->blk_sz);
     set_scsi_pt_sense(ptvp, sense_b, SENSE_BUFF_LEN);
-    to = op->cmd_timeout / 1000;
-    if (to < 1)
-        to = 1;
+    return 0;
+}
+
+/* Processes the outcome ('res' from do_scsi_pt() or do_scsi_pt_reap()) of
+ * a command sent via the SNTL. Returns 0 or a SG_LIB_CAT_* value. */
+static int
+sntl_resp(struct sg_pt_base * ptvp, int res, const uint8_t * scsiCdb,
+          const uint8_t * sense_b, int blocks, int64_t start_block,
+          bool write_true, uint64_t * io_addrp, struct opts_t * op)
+{
+    int ret, vb, slen, sense_cat, info_valid;
+    const struct flags_t * flagp = write_true ? &op->oflag : &op->iflag;
+    const char * cmd_s = write_true ? "write" : "read";
+
     vb = ((op->verbose > 1) ? (op->verbose - 1) : op->verbose);
-    while (((res = do_scsi_pt(ptvp, -1, to, vb)) < 0) &&
-           ((-EINTR == res) || (-EAGAIN == res) || (-EBUSY == res))) {
-        ;
-    }
     ret = sg_cmds_process_resp(ptvp, cmd_s, res, false /* noisy */, vb,
                                &sense_cat);
     if (-1 == ret) {
@@ -862,6 +927,128 @@ use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
     return ret;
 }
 
+static int
+use_sntl(const uint8_t * scsiCdb, uint8_t * buff, int blocks,
+         int64_t start_block, bool write_true, uint64_t * io_addrp,
+         struct opts_t * op)
+{
+    int to, res, vb;
+    int sg_fd = write_true ? op->outfd : op->infd;
+    struct sg_pt_base ** ptvpp = write_true ? &op->out_ptp : &op->in_ptp;
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+
+    res = sntl_prep(ptvpp, sg_fd, scsiCdb, buff, blocks, sense_b, write_true,
+                    op);
+    if (res)
+        return res;
+    to = op->cmd_timeout / 1000;
+    if (to < 1)
+        to = 1;
+    vb = ((op->verbose > 1) ? (op->verbose - 1) : op->verbose);
+    while (((res = do_scsi_pt(*ptvpp, -1, to, vb)) < 0) &&
+           ((-EINTR == res) || (-EAGAIN == res) || (-EBUSY == res))) {
+        ;
+    }
+    return sntl_resp(*ptvpp, res, scsiCdb, sense_b, blocks, start_block,
+                     write_true, io_addrp, op);
+}
+
+/* Used for READs and WRITEs to NVMe generic char devices (e.g.
+ * /dev/ng0n1). Splits the transfer into up to SNTL_MAX_SPLIT commands and
+ * gives them to do_scsi_pt_submit() together, so the library can batch
+ * them into a single io_uring_enter(2), then reaps them. A command that
+ * completes with EINTR, EAGAIN or EBUSY is re-sent with use_sntl().
+ * Returns the same values as use_sntl(), the error of the lowest split
+ * taking precedence. */
+static int
+use_sntl_split(uint8_t * buff, int blocks, int64_t start_block,
+               bool write_true, uint64_t * io_addrp, struct opts_t * op)
+{
+    int k, j, n, per, to, vb, res, r;
+    int num_subm = 0;
+    int ret = 0;
+    int sg_fd = write_true ? op->outfd : op->infd;
+    struct sg_pt_base ** sptpp = write_true ? op->out_sptp : op->in_sptp;
+    struct sg_pt_base * rptp;
+    int nblks[SNTL_MAX_SPLIT];
+    int resa[SNTL_MAX_SPLIT];
+    uint8_t cdbs[SNTL_MAX_SPLIT][MAX_SCSI_CDBSZ];
+    uint8_t sense_bs[SNTL_MAX_SPLIT][SENSE_BUFF_LEN];
+
+    if (blocks <= 0)
+        return 0;       /* nothing to transfer, like a SCSI NOP */
+    n = (blocks < SNTL_MAX_SPLIT) ? blocks : SNTL_MAX_SPLIT;
+    per = (blocks + n - 1) / n;
+    n = (blocks + per - 1) / per;
+    to = op->cmd_timeout / 1000;
+    if (to < 1)
+        to = 1;
+    vb = ((op->verbose > 1) ? (op->verbose - 1) : op->verbose);
+    for (k = 0; k < n; ++k) {
+        nblks[k] = ((k + 1) < n) ? per : (blocks - (k * per));
+        resa[k] = 0;
+        if (sg_build_scsi_cdb(cdbs[k], nblks[k], start_block + (k * per),
+                              write_true, op)) {
+            pr2serr("%sbad %s cdb build, block=%" PRId64 ", blocks=%d\n",
+                    my_name, (write_true ? "wr" : "rd"),
+                    start_block + (k * per), nblks[k]);
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        memset(sense_bs[k], 0, SENSE_BUFF_LEN);
+        res = sntl_prep(sptpp + k, sg_fd, cdbs[k],
+                        buff + ((int64_t)k * per * op->blk_sz), nblks[k],
+                        sense_bs[k], write_true, op);
+        if (res) {
+            ret = sg_convert_errno(-res);
+            break;
+        }
+        set_scsi_pt_flags(sptpp[k], ((k + 1) < n) ? SCSI_PT_FLAGS_MORE : 0);
+        while (-EINTR == (res = do_scsi_pt_submit(sptpp[k], sg_fd, to, vb)))
+            ;
+        if (res) {
+            ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+            if (op->verbose)
+                pr2serr("%sdo_scsi_pt_submit: %s\n", my_name,
+                        (res < 0) ? safe_strerror(-res) : "bad parameters");
+            break;
+        }
+        ++num_subm;
+    }
+    /* reap everything submitted, even after an error */
+    for (j = 0; j < num_subm; ++j) {
+        while (-EINTR == (res = do_scsi_pt_reap(sg_fd, true, &rptp, vb)))
+            ;
+        if (NULL == rptp) {
+            if (op->verbose)
+                pr2serr("%sdo_scsi_pt_reap: %s\n", my_name,
+                        safe_strerror(-res));
+            return sg_convert_errno(-res);
+        }
+        for (k = 0; k < num_subm; ++k) {
+            if (rptp == sptpp[k])
+                break;
+        }
+        if (k < num_subm)
+            resa[k] = res;
+    }
+    if (ret)
+        return ret;
+    for (k = 0; k < n; ++k) {
+        res = resa[k];
+        if ((-EINTR == res) || (-EAGAIN == res) || (-EBUSY == res))
+            r = use_sntl(cdbs[k], buff + ((int64_t)k * per * op->blk_sz),
+                         nblks[k], start_block + (k * per), write_true,
+                         io_addrp, op);
+        else
+            r = sntl_resp(sptpp[k], res, cdbs[k], sense_bs[k], nblks[k],
+                          start_block + (k * per), write_true, io_addrp, op);
+        if (r && (0 == ret))
+            ret = r;
+    }
+    return ret;
+}
+
 /* Does SCSI READ on IFILE. Returns 0 -> successful,
  * SG_LIB_SYNTAX_ERROR -> unable to build cdb,
  * SG_LIB_CAT_UNIT_ATTENTION -> try again,
@@ -887,7 +1074,9 @@ sg_read_low(uint8_t * buff, int blocks, int64_t from_block,
                 my_name, from_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (FT_NVME & ifp->file_type)
+    if ((FT_NVME_GEN & ifp->file_type) && (! op->do_verify))
+        return use_sntl_split(buff, blocks, from_block, false, io_addrp, op);
+    if ((FT_NVME | FT_EMU) & ifp->file_type)
         return use_sntl(rdCmd, buff, blocks, from_block, false, io_addrp, op);
 
     memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
@@ -1305,7 +1494,9 @@ sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
                 my_name, to_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (FT_NVME & ofp->file_type)
+    if ((FT_NVME_GEN & ofp->file_type) && (! op->do_verify))
+        return use_sntl_split(buff, blocks, to_block, true, &io_addr, op);
+    if ((FT_NVME | FT_EMU) & ofp->file_type)
         return use_sntl(wrCmd, buff, blocks, to_block, true, &io_addr, op);
 
     memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
@@ -1606,6 +1797,29 @@ process_conv(const char * arg, struct flags_t * ifp, struct flags_t * ofp)
     return 0;
 }
 
+/* For bpt=auto: picks op->bpt for the sg device open on fd, using reads
+ * starting at start_blk. Only the first sg device (input preferred) is
+ * tuned. */
+static void
+dd_bpt_auto(int fd, int64_t start_blk, int cdbsz, struct opts_t * op)
+{
+    int res;
+    struct sg_rw_bpt_auto ba;
+    char b[224];
+
+    res = sg_rw_bpt_auto(fd, op->blk_sz, cdbsz, start_blk,
+                         (op->dd_count > 0) ? op->dd_count : 0, op->bpt, 0,
+                         (0 == op->dry_run), &ba, op->verbose);
+    op->bpt_auto = false;
+    if (res) {
+        pr2serr("%sbpt=auto failed, keep bpt=%d\n", my_name, op->bpt);
+        return;
+    }
+    op->bpt = ba.bpt;
+    pr2serr("%sbpt=auto: %s\n", my_name,
+            sg_rw_bpt_auto_str(&ba, op->blk_sz, sizeof(b), b));
+}
+
 /* Returns open input file descriptor (>= 0) or a negative value
  * (-SG_LIB_FILE_ERROR or -SG_LIB_CAT_OTHER) if error.
  */
@@ -1643,9 +1857,9 @@ open_if(struct opts_t * op)
         if (ifp->dsync)
             flags |= O_SYNC;
         fl = O_RDWR;
-        if ((infd = open(inf, fl | flags)) < 0) {
+        if ((infd = dd_open(inf, fl | flags, ft)) < 0) {
             fl = O_RDONLY;
-            if ((infd = open(inf, fl | flags)) < 0) {
+            if ((infd = dd_open(inf, fl | flags, ft)) < 0) {
                 snprintf(ebuff, EBUFF_SZ,
                          "%scould not open %s for sg reading", my_name, inf);
                 perror(ebuff);
@@ -1662,7 +1876,9 @@ open_if(struct opts_t * op)
         if (vb)
             pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", inf, sir.vendor,
                     sir.product, sir.revision, ifp->pdt);
-        if (! ((FT_BLOCK & ft) || (FT_NVME & ft))) {
+        if (op->bpt_auto)
+            dd_bpt_auto(infd, op->skip, ifp->cdbsz, op);
+        if (! ((FT_BLOCK | FT_NVME | FT_EMU) & ft)) {
             t = op->blk_sz * op->bpt;
             res = ioctl(infd, SG_SET_RESERVED_SIZE, &t);
             if (res < 0) {
@@ -1804,7 +2020,7 @@ open_of(struct opts_t * op)
             flags |= O_EXCL;
         if (ofp->dsync)
             flags |= O_SYNC;
-        if ((outfd = open(outf, flags)) < 0) {
+        if ((outfd = dd_open(outf, flags, ft)) < 0) {
             snprintf(ebuff, EBUFF_SZ,
                      "%scould not open %s for sg writing", my_name, outf);
             perror(ebuff);
@@ -1820,7 +2036,9 @@ open_of(struct opts_t * op)
         if (vb)
             pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", outf, sir.vendor,
                     sir.product, sir.revision, ofp->pdt);
-        if (! ((FT_BLOCK & ft) || (FT_NVME & ft))) {
+        if (op->bpt_auto)
+            dd_bpt_auto(outfd, op->seek, ofp->cdbsz, op);
+        if (! ((FT_BLOCK | FT_NVME | FT_EMU) & ft)) {
             t = op->blk_sz * op->bpt;
             res = ioctl(outfd, SG_SET_RESERVED_SIZE, &t);
             if (res < 0) {
@@ -2095,12 +2313,16 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
             ifp->sgio = !! sg_get_num(buf);
             ofp->sgio = ifp->sgio;
         } else if (0 == strcmp(key, "bpt")) {
-            op->bpt = sg_get_num(buf);
-            if (-1 == op->bpt) {
-                pr2serr("%sbad argument to 'bpt='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (0 == strcmp(buf, "auto"))
+                op->bpt_auto = true;    /* starts from default bpt */
+            else {
+                op->bpt = sg_get_num(buf);
+                if (-1 == op->bpt) {
+                    pr2serr("%sbad argument to 'bpt='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->bpt_given = true;
             }
-            op->bpt_given = true;
         } else if (0 == strcmp(key, "bs")) {
             op->blk_sz = sg_get_num(buf);
             if ((op->blk_sz < 0) || (op->blk_sz > MAX_BPT_VALUE)) {
@@ -2202,6 +2424,13 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
                 pr2serr("%sbad argument to 'iflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key, "nbuf")) {
+            op->nbuf = sg_get_num(buf);
+            if ((op->nbuf < 1) || (op->nbuf > MAX_NBUF)) {
+                pr2serr("%sbad argument to 'nbuf=', expect 1 to %d\n",
+                        my_name, MAX_NBUF);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key, "obs")) {
             obs = sg_get_num(buf);
             if ((obs < 0) || (obs > MAX_BPT_VALUE)) {
@@ -2349,15 +2578,642 @@ parse_cmd_line(int argc, char * argv[], struct opts_t * op)
 }
 
 
+/* Read stage of the copy loop: reads up to *blocksp blocks starting at
+ * block 'skip' of IFILE into bp. After a short read (e.g. end of input)
+ * *eofp is set and *blocksp is reduced. *blocks_perp may be reduced if
+ * the sg driver lacks buffer space. Returns 0 if okay, else the value
+ * main() should return. */
+static int
+dd_read_stage(struct opts_t * op, uint8_t * bp, int64_t skip, int * blocksp,
+              int * blocks_perp, int * bytes_readp, bool * eofp)
+{
+    bool dio_tmp;
+    int k, res, buf_sz, blks_read;
+    int blocks = *blocksp;
+    int bs = op->blk_sz;
+    struct flags_t * ifp = &op->iflag;
+    char ebuff[EBUFF_SZ];
+
+    *bytes_readp = 0;
+    *eofp = false;
+    if (FT_SG & ifp->file_type) {
+        dio_tmp = ifp->dio;
+        res = sg_read(bp, blocks, skip, &dio_tmp, &blks_read, op);
+        if (-2 == res) {     /* ENOMEM, find what's available+try that */
+            if (ioctl(op->infd, SG_GET_RESERVED_SIZE, &buf_sz) < 0) {
+                perror("RESERVED_SIZE ioctls failed");
+                return res;
+            }
+            if (buf_sz < MIN_RESERVED_SIZE)
+                buf_sz = MIN_RESERVED_SIZE;
+            *blocks_perp = (buf_sz + bs - 1) / bs;
+            if (*blocks_perp < blocks) {
+                blocks = *blocks_perp;
+                pr2serr("Reducing read to %d blocks per loop\n",
+                        *blocks_perp);
+                res = sg_read(bp, blocks, skip, &dio_tmp, &blks_read, op);
+            }
+        }
+        if (res) {
+            pr2serr("sg_read failed,%s at or after lba=%" PRId64 " [0x%"
+                    PRIx64 "]\n", ((-2 == res) ?  " try reducing bpt," :
+                                               ""), skip, skip);
+            return res;
+        }
+        if (blks_read < blocks) {
+            *eofp = true;       /* force exit after write */
+            blocks = blks_read;
+        }
+        in_full += blocks;
+        if (ifp->dio && (! dio_tmp))
+            op->dio_incomplete_count++;
+    } else if (FT_RANDOM_0_FF & ifp->file_type) {
+        int j;
+
+        res = blocks * bs;
+        if (ifp->zero && ifp->ff && (bs >= 4)) {
+            uint32_t pos = (uint32_t)skip;
+            uint32_t off;
+
+            for (k = 0, off = 0; k < blocks; ++k, off += bs, ++pos) {
+                for (j = 0; j < (bs - 3); j += 4)
+                    sg_put_unaligned_be32(pos, bp + off + j);
+            }
+        } else if (ifp->zero)
+            memset(bp, 0, res);
+        else if (ifp->ff)
+            memset(bp, 0xff, res);
+        else {
+            int kk, jj;
+            const int jbump = sizeof(uint32_t);
+            long rn;
+            uint8_t * rbp;
+
+            rbp = bp;
+            for (kk = 0; kk < blocks; ++kk, rbp += bs) {
+                for (jj = 0; jj < bs; jj += jbump) {
+                   /* mrand48 takes uniformly from [-2^31, 2^31) */
+#ifdef HAVE_SRAND48_R
+                    mrand48_r(&drand, &rn);
+#else
+                    rn = mrand48();
+#endif
+                    *((uint32_t *)(rbp + jj)) = (uint32_t)rn;
+                }
+            }
+        }
+        *bytes_readp = res;
+        in_full += blocks;
+    } else {
+        while (((res = read(op->infd, bp, blocks * bs)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno) ||
+                (EBUSY == errno)))
+            ;
+        if (op->verbose > 2)
+            pr2serr("read(unix): count=%d, res=%d\n", blocks * bs, res);
+        if (res < 0) {
+            snprintf(ebuff, EBUFF_SZ, "%sreading, skip=%" PRId64 " ",
+                     my_name, skip);
+            perror(ebuff);
+            return -1;
+        } else if (res < blocks * bs) {
+            *eofp = true;
+            blocks = res / bs;
+            if ((res % bs) > 0) {
+                blocks++;
+                in_partial++;
+            }
+        }
+        *bytes_readp = res;
+        in_full += blocks;
+    }
+    *blocksp = blocks;
+    return 0;
+}
+
+/* Bypasses writing 'blocks' (all zero) blocks to OFILE at block 'seek'
+ * due to oflag=sparse. Returns 0 if okay, else the value main() should
+ * return. */
+static int
+dd_sparse_skip(struct opts_t * op, int blocks, int64_t seek)
+{
+    int bs = op->blk_sz;
+    struct flags_t * ofp = &op->oflag;
+
+    if (FT_SG & ofp->file_type) {
+        out_sparse_num += blocks;
+        if (op->verbose > 2)
+            pr2serr("sparse bypassing sg_write: seek blk=%" PRId64
+                    ", offset blks=%d\n", seek, blocks);
+    } else if (FT_DEV_NULL & ofp->file_type)
+        ;
+    else {
+        off64_t offset = (off64_t)blocks * bs;
+        off64_t off_res;
+
+        if (op->verbose > 2)
+            pr2serr("sparse bypassing write: seek=%" PRId64 ", rel "
+                    "offset=%" PRId64 "\n", (seek * bs), (int64_t)offset);
+        off_res = lseek64(op->outfd, offset, SEEK_CUR);
+        if (off_res < 0) {
+            pr2serr("sparse tried to bypass write: seek=%" PRId64
+                    ", rel offset=%" PRId64 " but ...\n", (seek * bs),
+                    (int64_t)offset);
+            perror("lseek64 on output");
+            return SG_LIB_FILE_ERROR;
+        } else if (op->verbose > 4)
+            pr2serr("oflag=sparse lseek64 result=%" PRId64 "\n",
+                    (int64_t)off_res);
+        out_sparse_num += blocks;
+    }
+    return 0;
+}
+
+/* Writes (or verifies) *blocksp blocks from bp to the sg device OFILE at
+ * block 'seek', with retries. If the sg driver lacks buffer space fewer
+ * blocks may be written, in which case *blocksp is reduced. Returns 0 if
+ * okay, else the value main() should return. */
+static int
+dd_sg_write(struct opts_t * op, uint8_t * bp, int * blocksp,
+            int * blocks_perp, int64_t seek)
+{
+    bool dio_tmp, first;
+    int buf_sz, retries_tmp;
+    int ret = 0;
+    int blocks = *blocksp;
+    int bs = op->blk_sz;
+    struct flags_t * ofp = &op->oflag;
+
+    dio_tmp = ofp->dio;
+    retries_tmp = ofp->retries;
+    first = true;
+    while (1) {
+        ret = sg_write(op->outfd, bp, blocks, seek, &dio_tmp, op);
+        if ((0 == ret) || (SG_DD_BYPASS == ret))
+            break;
+        if ((SG_LIB_CAT_NOT_READY == ret) ||
+            (SG_LIB_PROGRESS_NOT_READY == ret) ||
+            (SG_LIB_SYNTAX_ERROR == ret))
+            break;
+        else if ((-2 == ret) && first) {
+            /* ENOMEM: find what's available and try that */
+            if (ioctl(op->outfd, SG_GET_RESERVED_SIZE, &buf_sz) < 0) {
+                perror("RESERVED_SIZE ioctls failed");
+                break;
+            }
+            if (buf_sz < MIN_RESERVED_SIZE)
+                buf_sz = MIN_RESERVED_SIZE;
+            *blocks_perp = (buf_sz + bs - 1) / bs;
+            if (*blocks_perp < blocks) {
+                blocks = *blocks_perp;
+                pr2serr("Reducing %s to %d blocks per loop\n",
+                        (op->do_verify ? "verify" : "write"), blocks);
+            } else
+                break;
+        } else if ((SG_LIB_CAT_UNIT_ATTENTION == ret) && first) {
+            if (--max_uas > 0)
+                pr2serr("Unit attention, continuing (w)\n");
+            else {
+                pr2serr("Unit attention, too many (w)\n");
+                break;
+            }
+        } else if ((SG_LIB_CAT_ABORTED_COMMAND == ret) && first) {
+            if (--max_aborted > 0)
+                pr2serr("Aborted command, continuing (w)\n");
+            else {
+                pr2serr("Aborted command, too many (w)\n");
+                break;
+            }
+        } else if (ret < 0)
+            break;
+        else if (retries_tmp > 0) {
+            pr2serr(">>> retrying a sgio %s, lba=0x%" PRIx64 "\n",
+                    (op->do_verify ? "verify" : "write"), (uint64_t)seek);
+            --retries_tmp;
+            ++num_retries;
+            if (unrecovered_errs > 0)
+                --unrecovered_errs;
+        } else
+            break;
+        first = false;
+    }
+    if (SG_DD_BYPASS == ret)
+        ret = 0;        /* not bumping out_full */
+    else if (0 != ret) {
+        pr2serr("sg_write failed,%s seek=%" PRId64 "\n",
+                ((-2 == ret) ? " try reducing bpt," : ""), seek);
+        return ret;
+    } else {
+        out_full += blocks;
+        if (ofp->dio && (! dio_tmp))
+            op->dio_incomplete_count++;
+    }
+    *blocksp = blocks;
+    return 0;
+}
+
+/* Writes 'blocks' blocks from bp to the (non-sg) OFILE at its current
+ * file position. Returns 0 if okay, else -1 . */
+static int
+dd_normal_write(struct opts_t * op, uint8_t * bp, int blocks,
+                int * bytes_ofp)
+{
+    int res;
+    int bs = op->blk_sz;
+    char ebuff[EBUFF_SZ];
+
+    while (((res = write(op->outfd, bp, blocks * bs)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (op->verbose > 2)
+        pr2serr("write(unix): count=%d, res=%d\n", blocks * bs, res);
+    if (res < 0) {
+        snprintf(ebuff, EBUFF_SZ, "%swriting, seek=%" PRId64 " ",
+                 my_name, op->seek);
+        perror(ebuff);
+        return -1;
+    } else if (res < blocks * bs) {
+        pr2serr("output file probably full, seek=%" PRId64 " ", op->seek);
+        blocks = res / bs;
+        out_full += blocks;
+        if ((res % bs) > 0)
+            out_partial++;
+        return -1;
+    }
+    out_full += blocks;
+    *bytes_ofp = res;
+    return 0;
+}
+
+/* With oflag=sparse, for a chunk of 'blocks' blocks at bp in which
+ * sparse_bitmap marks some (but not all) blocks as all zeros. Runs of zero
+ * blocks are bypassed, apart from a trailing run when OFILE is not a sg
+ * device: that is written so the length of OFILE only falls behind when a
+ * whole chunk is bypassed (see penult_sparse_skip in main()). Returns 0 if
+ * okay, else the value main() should return. */
+static int
+dd_write_sparse_runs(struct opts_t * op, uint8_t * bp, int blocks,
+                     int * blocks_perp, int * bytes_ofp)
+{
+    bool zero;
+    bool is_sg = !! (FT_SG & op->oflag.file_type);
+    int k, j, n, run, res;
+    int bs = op->blk_sz;
+
+    *bytes_ofp = 0;
+    for (k = 0; k < blocks; k += run) {
+        zero = !! (sparse_bitmap[k / 8] & (1 << (k % 8)));
+        for (run = 1; (k + run) < blocks; ++run) {
+            if (zero != !! (sparse_bitmap[(k + run) / 8] &
+                            (1 << ((k + run) % 8))))
+                break;
+        }
+        if (zero && (is_sg || ((k + run) < blocks))) {
+            res = dd_sparse_skip(op, run, op->seek + k);
+            if (res)
+                return res;
+        } else if (is_sg) {
+            for (j = 0; j < run; j += n) {
+                n = run - j;    /* may be reduced by dd_sg_write() */
+                res = dd_sg_write(op, bp + ((k + j) * bs), &n, blocks_perp,
+                                  op->seek + k + j);
+                if (res)
+                    return res;
+            }
+        } else {
+            res = dd_normal_write(op, bp + (k * bs), run, &n);
+            if (res)
+                return res;
+            *bytes_ofp += n;
+        }
+    }
+    return 0;
+}
+
+/* Write stage of the copy loop: writes (or verifies) *blocksp blocks from
+ * bp to OFILE at block op->seek, and to OFILE2 if given. If the sg driver
+ * lacks buffer space fewer blocks may be written, in which case *blocksp
+ * is reduced. *sparse_skipp is set when oflag=sparse bypassed the write
+ * of the whole chunk. Returns 0 if okay, else the value main() should
+ * return. */
+static int
+dd_write_stage(struct opts_t * op, uint8_t * bp, int * blocksp,
+               int * blocks_perp, bool * sparse_skipp, int * bytes_ofp,
+               int * bytes_of2p)
+{
+    int res, num_zero;
+    int ret = 0;
+    int blocks = *blocksp;
+    int bs = op->blk_sz;
+    struct flags_t * ofp = &op->oflag;
+    char ebuff[EBUFF_SZ];
+
+    *bytes_ofp = 0;
+    *bytes_of2p = 0;
+    *sparse_skipp = false;
+    if (op->out2fd >= 0) {
+        while (((res = write(op->out2fd, bp, blocks * bs)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno) ||
+                (EBUSY == errno)))
+            ;
+        if (op->verbose > 2)
+            pr2serr("write to of2: count=%d, res=%d\n", blocks * bs, res);
+        if (res < 0) {
+            snprintf(ebuff, EBUFF_SZ, "%swriting to of2, seek=%" PRId64 " ",
+                     my_name, op->seek);
+            perror(ebuff);
+            return -1;
+        }
+        *bytes_of2p = res;
+    }
+
+    if (ofp->sparse && (op->dd_count > blocks) &&
+        (! (FT_DEV_NULL & ofp->file_type))) {
+        if (NULL == zeros_buff) {
+            zeros_buff = sg_memalign(op->bpt * bs, 0, &free_zeros_buff,
+                                     false);
+            sparse_bitmap = (uint8_t *)calloc((op->bpt + 7) / 8, 1);
+            if ((NULL == zeros_buff) || (NULL == sparse_bitmap)) {
+                pr2serr("zeros_buff sg_memalign failed\n");
+                return -1;
+            }
+        }
+        num_zero = sg_blks_zero_bitmap(bp, bs, blocks, sparse_bitmap);
+        if (num_zero == blocks) {
+            ret = dd_sparse_skip(op, blocks, op->seek);
+            if (0 == ret)
+                *sparse_skipp = true;
+            return ret;
+        } else if (num_zero > 0)
+            return dd_write_sparse_runs(op, bp, blocks, blocks_perp,
+                                        bytes_ofp);
+    }
+    if (FT_SG & ofp->file_type) {
+        ret = dd_sg_write(op, bp, &blocks, blocks_perp, op->seek);
+        if (ret)
+            return ret;
+    } else if (FT_DEV_NULL & ofp->file_type) {
+        ; /* previosuly did: out_full += blocks; */
+    } else {
+        ret = dd_normal_write(op, bp, blocks, bytes_ofp);
+        if (ret)
+            return ret;
+    }
+    *blocksp = blocks;
+    return 0;
+}
+
+#ifdef HAVE_POSIX_FADVISE
+static void
+dd_fadvise(const struct opts_t * op, int bytes_read, int bytes_of,
+           int bytes_of2)
+{
+    bool in_valid, out2_valid, out_valid;
+    int rt;
+    const struct flags_t * ifp = &op->iflag;
+    const struct flags_t * ofp = &op->oflag;
+
+    in_valid = !! ((FT_OTHER | FT_BLOCK) & ifp->file_type);
+    out_valid = !! ((FT_OTHER | FT_BLOCK) & ofp->file_type);
+    out2_valid = !! ((FT_OTHER | FT_BLOCK) & op->out2_type);
+    if (ifp->nocache && (bytes_read > 0) && in_valid) {
+        rt = posix_fadvise(op->infd, 0, (op->skip * op->blk_sz) + bytes_read,
+                           POSIX_FADV_DONTNEED);
+        // rt = posix_fadvise(op->infd, (op->skip * bs), bytes_read,
+                           // POSIX_FADV_DONTNEED);
+        // rt = posix_fadvise(op->infd, 0, 0, POSIX_FADV_DONTNEED);
+        if (rt)         /* returns error as result */
+            pr2serr("posix_fadvise on read, skip=%" PRId64 " ,err=%d\n",
+                    op->skip, rt);
+    }
+    if ((ofp->nocache & 2) && (bytes_of2 > 0) && out2_valid) {
+        rt = posix_fadvise(op->out2fd, 0, 0, POSIX_FADV_DONTNEED);
+        if (rt)
+            pr2serr("posix_fadvise on of2, seek=%" PRId64 " ,err=%d\n",
+                    op->seek, rt);
+    }
+    if ((ofp->nocache & 1) && (bytes_of > 0) && out_valid) {
+        rt = posix_fadvise(op->outfd, 0, 0, POSIX_FADV_DONTNEED);
+        if (rt)
+            pr2serr("posix_fadvise on output, seek=%" PRId64 " ,err=%d\n",
+                    op->seek, rt);
+    }
+}
+#endif
+
+/* Called after 'blocks' have been copied: moves the copy position on and
+ * outputs a progress report if one is due. */
+static void
+dd_advance(struct opts_t * op, int blocks)
+{
+    if (op->dd_count > 0)
+        op->dd_count -= blocks;
+    op->skip += blocks;
+    op->seek += blocks;
+    if (op->progress > 0) {
+        if (check_progress(op)) {
+            calc_duration_throughput(true);
+            print_stats("");
+        }
+    }
+}
+
+#ifdef HAVE_C11_ATOMICS
+
+/* One buffer of the nbuf=NBUF pipeline */
+struct dd_chunk
+{
+    uint8_t * bp;
+    uint8_t * alloc_bp;
+    int blocks;                 /* blocks read into bp */
+    int bytes_read;
+    int res;                    /* 0 or error from dd_read_stage() */
+    bool eof;                   /* short read */
+    bool last;                  /* reader stops after this chunk */
+};
+
+struct dd_pipe
+{
+    int nbuf;
+    int head;                   /* next chunk the reader fills */
+    int tail;                   /* next chunk the writer empties */
+    int filled;                 /* number of chunks ready to be written */
+    bool stop;                  /* set by writer to stop the reader */
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full_cv;
+    pthread_cond_t not_empty_cv;
+    struct dd_chunk * chunks;
+    struct opts_t * op;
+};
+
+/* Reader stage of the pipeline, it runs in its own thread. It starts at
+ * the copy position held in op when the thread was created and thereafter
+ * does not touch op->skip, op->seek nor op->dd_count (the main thread
+ * advances those as chunks are written). */
+static void *
+dd_pipe_reader(void * v_pp)
+{
+    struct dd_pipe * pp = (struct dd_pipe *)v_pp;
+    struct opts_t * op = pp->op;
+    struct dd_chunk * cp;
+    int blocks;
+    int blocks_per = op->bpt;
+    int64_t skip = op->skip;
+    int64_t count = op->dd_count;
+
+    while (true) {
+        pthread_mutex_lock(&pp->mutex);
+        while ((pp->filled >= pp->nbuf) && (! pp->stop))
+            pthread_cond_wait(&pp->not_full_cv, &pp->mutex);
+        if (pp->stop) {
+            pthread_mutex_unlock(&pp->mutex);
+            break;
+        }
+        cp = pp->chunks + pp->head;
+        pthread_mutex_unlock(&pp->mutex);
+
+        blocks = (count > blocks_per) ? blocks_per : count;
+        cp->res = dd_read_stage(op, cp->bp, skip, &blocks, &blocks_per,
+                                &cp->bytes_read, &cp->eof);
+        cp->blocks = cp->res ? 0 : blocks;
+        skip += cp->blocks;
+        count -= cp->blocks;
+        cp->last = (cp->res || cp->eof || (0 == cp->blocks) ||
+                    (count <= 0));
+
+        pthread_mutex_lock(&pp->mutex);
+        pp->head = (pp->head + 1) % pp->nbuf;
+        ++pp->filled;
+        pthread_cond_signal(&pp->not_empty_cv);
+        pthread_mutex_unlock(&pp->mutex);
+        if (cp->last)
+            break;
+    }
+    return NULL;
+}
+
+/* Copy loop used when nbuf=NBUF is greater than 1. A reader thread fills
+ * up to NBUF buffers ahead of this (the main) thread which writes them,
+ * in order, so IFILE and OFILE are busy at the same time. The sparse,
+ * coe, progress and statistics handling is the same as the single buffer
+ * copy loop in main(). Returns 0 if okay, else the value main() should
+ * return. */
+static int
+dd_pipelined_copy(struct opts_t * op, bool * penult_sparse_skipp,
+                  int * penult_blocksp)
+{
+    bool last;
+    bool sparse_skip = false;
+    int k, status, done, bytes_of, bytes_of2;
+    int ret = 0;
+    int blocks = 0;
+    int blocks_per = op->bpt;
+    int bs = op->blk_sz;
+    struct dd_chunk * cp;
+    struct dd_pipe pipe_s;
+    struct dd_pipe * pp = &pipe_s;
+    pthread_t reader_id;
+
+    memset(pp, 0, sizeof(*pp));
+    pp->nbuf = op->nbuf;
+    pp->op = op;
+    pp->chunks = (struct dd_chunk *)calloc(pp->nbuf,
+                                           sizeof(struct dd_chunk));
+    if (NULL == pp->chunks) {
+        pr2serr("%sout of memory for pipeline\n", my_name);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < pp->nbuf; ++k) {
+        cp = pp->chunks + k;
+        cp->bp = sg_memalign(bs * op->bpt, 0, &cp->alloc_bp, false);
+        if (NULL == cp->bp) {
+            pr2serr("%sout of memory for pipeline buffers, try a smaller "
+                    "nbuf=\n", my_name);
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    pthread_mutex_init(&pp->mutex, NULL);
+    pthread_cond_init(&pp->not_full_cv, NULL);
+    pthread_cond_init(&pp->not_empty_cv, NULL);
+    status = pthread_create(&reader_id, NULL, dd_pipe_reader, pp);
+    if (status) {
+        pr2serr("%spthread_create: %s\n", my_name, safe_strerror(status));
+        ret = sg_convert_errno(status);
+        goto fini;
+    }
+
+    while (true) {
+        pthread_mutex_lock(&pp->mutex);
+        while (0 == pp->filled)
+            pthread_cond_wait(&pp->not_empty_cv, &pp->mutex);
+        cp = pp->chunks + pp->tail;
+        pthread_mutex_unlock(&pp->mutex);
+
+        *penult_sparse_skipp = sparse_skip;
+        *penult_blocksp = sparse_skip ? blocks : 0;
+        sparse_skip = false;
+        if (cp->res)
+            ret = cp->res;
+        else {
+            if (cp->eof)
+                op->dd_count = 0;   /* force exit after write */
+            /* the sg driver may write fewer blocks than were read */
+            for (done = 0; done < cp->blocks; done += blocks) {
+                if (done > 0) {
+                    *penult_sparse_skipp = sparse_skip;
+                    *penult_blocksp = sparse_skip ? blocks : 0;
+                }
+                blocks = cp->blocks - done;
+                ret = dd_write_stage(op, cp->bp + (done * bs), &blocks,
+                                     &blocks_per, &sparse_skip, &bytes_of,
+                                     &bytes_of2);
+                if (ret)
+                    break;
+#ifdef HAVE_POSIX_FADVISE
+                dd_fadvise(op, (done ? 0 : cp->bytes_read), bytes_of,
+                           bytes_of2);
+#endif
+                dd_advance(op, blocks);
+            }
+        }
+
+        last = cp->last;    /* cp may be refilled once it is released */
+        pthread_mutex_lock(&pp->mutex);
+        pp->tail = (pp->tail + 1) % pp->nbuf;
+        --pp->filled;
+        pthread_cond_signal(&pp->not_full_cv);
+        pthread_mutex_unlock(&pp->mutex);
+        if (ret || last)
+            break;
+    }
+
+    pthread_mutex_lock(&pp->mutex);
+    pp->stop = true;
+    pthread_cond_broadcast(&pp->not_full_cv);
+    pthread_mutex_unlock(&pp->mutex);
+    pthread_join(reader_id, NULL);
+fini:
+    for (k = 0; k < pp->nbuf; ++k) {
+        if (pp->chunks[k].alloc_bp)
+            free(pp->chunks[k].alloc_bp);
+    }
+    free(pp->chunks);
+    return ret;
+}
+
+#endif  /* HAVE_C11_ATOMICS */
+
+
 int
 main(int argc, char * argv[])
 {
-    bool dio_tmp, first;
+    bool eof;
     bool do_sync = false;
     bool penult_sparse_skip = false;
     bool sparse_skip = false;
-    int k, res, buf_sz, blocks_per, bs;
-    int retries_tmp, blks_read, bytes_read, bytes_of2, bytes_of;
+    int k, res, blocks_per, bs;
+    int bytes_read, bytes_of2, bytes_of;
     int in_sect_sz, out_sect_sz;
     int blocks = 0;
     int penult_blocks = 0;
@@ -2377,6 +3233,7 @@ main(int argc, char * argv[])
     op = &opts;
     fscope_op = op;
     op->bpt = DEF_BLOCKS_PER_TRANSFER;
+    op->nbuf = 1;
     op->cmd_timeout = DEF_TIMEOUT;   /* in milliseconds */
     op->dd_count = -1;
     op->out2fd = -1;
@@ -2514,6 +3371,11 @@ main(int argc, char * argv[])
         ret = SG_LIB_CONTRADICT;
         goto bypass_copy;
     }
+    if (op->bpt_auto) {
+        pr2serr("%sbpt=auto needs a sg device (or blk_sgio=1), using "
+                "bpt=%d\n", my_name, op->bpt);
+        op->bpt_auto = false;
+    }
     if (op->do_verify) {
         if (! (FT_SG & ofp->file_type)) {
             pr2serr("--verify only supported when OFILE is a sg device or "
@@ -2709,6 +3571,16 @@ main(int argc, char * argv[])
     }
 
     blocks_per = op->bpt;
+#ifndef HAVE_C11_ATOMICS
+    if (op->nbuf > 1) {
+        pr2serr("nbuf=%d ignored, this build lacks C11 atomics so only "
+                "nbuf=1 is available\n", op->nbuf);
+        op->nbuf = 1;
+    }
+#endif
+    if ((op->nbuf > 1) && (op->verbose > 1))
+        pr2serr("%spipelined copy with %d buffers of %d bytes\n", my_name,
+                op->nbuf, op->bpt * bs);
 #ifdef DEBUG
     pr2serr("Start of loop, count=%" PRId64 ", blocks_per=%d\n",
             op->dd_count, blocks_per);
@@ -2726,316 +3598,37 @@ main(int argc, char * argv[])
     }
 
     /* <<< main loop that does the copy >>> */
+#ifdef HAVE_C11_ATOMICS
+    if (op->nbuf > 1) {
+        ret = dd_pipelined_copy(op, &penult_sparse_skip, &penult_blocks);
+        goto copy_done;
+    }
+#endif
     while (op->dd_count > 0) {
-        bytes_read = 0;
-        bytes_of = 0;
-        bytes_of2 = 0;
         penult_sparse_skip = sparse_skip;
         penult_blocks = penult_sparse_skip ? blocks : 0;
         sparse_skip = false;
         blocks = (op->dd_count > blocks_per) ? blocks_per : op->dd_count;
-        if (FT_SG & ifp->file_type) {
-            dio_tmp = ifp->dio;
-            res = sg_read(wrkPos, blocks, op->skip, &dio_tmp, &blks_read, op);
-            if (-2 == res) {     /* ENOMEM, find what's available+try that */
-                if (ioctl(op->infd, SG_GET_RESERVED_SIZE, &buf_sz) < 0) {
-                    perror("RESERVED_SIZE ioctls failed");
-                    ret = res;
-                    break;
-                }
-                if (buf_sz < MIN_RESERVED_SIZE)
-                    buf_sz = MIN_RESERVED_SIZE;
-                blocks_per = (buf_sz + bs - 1) / bs;
-                if (blocks_per < blocks) {
-                    blocks = blocks_per;
-                    pr2serr("Reducing read to %d blocks per loop\n",
-                            blocks_per);
-                    res = sg_read(wrkPos, blocks, op->skip, &dio_tmp,
-                                  &blks_read, op);
-                }
-            }
-            if (res) {
-                pr2serr("sg_read failed,%s at or after lba=%" PRId64 " [0x%"
-                        PRIx64 "]\n", ((-2 == res) ?  " try reducing bpt," :
-                                                   ""), op->skip, op->skip);
-                ret = res;
-                break;
-            } else {
-                if (blks_read < blocks) {
-                    op->dd_count = 0;   /* force exit after write */
-                    blocks = blks_read;
-                }
-                in_full += blocks;
-                if (ifp->dio && (! dio_tmp))
-                    op->dio_incomplete_count++;
-            }
-        } else if (FT_RANDOM_0_FF & ifp->file_type) {
-            int j;
-
-            res = blocks * bs;
-            if (ifp->zero && ifp->ff && (bs >= 4)) {
-                uint32_t pos = (uint32_t)op->skip;
-                uint32_t off;
-
-                for (k = 0, off = 0; k < blocks; ++k, off += bs, ++pos) {
-                    for (j = 0; j < (bs - 3); j += 4)
-                        sg_put_unaligned_be32(pos, wrkPos + off + j);
-                }
-            } else if (ifp->zero)
-                memset(wrkPos, 0, res);
-            else if (ifp->ff)
-                memset(wrkPos, 0xff, res);
-            else {
-                int kk, jj;
-                const int jbump = sizeof(uint32_t);
-                long rn;
-                uint8_t * bp;
-
-                bp = wrkPos;
-                for (kk = 0; kk < blocks; ++kk, bp += bs) {
-                    for (jj = 0; jj < bs; jj += jbump) {
-                       /* mrand48 takes uniformly from [-2^31, 2^31) */
-#ifdef HAVE_SRAND48_R
-                        mrand48_r(&drand, &rn);
-#else
-                        rn = mrand48();
-#endif
-                        *((uint32_t *)(bp + jj)) = (uint32_t)rn;
-                    }
-                }
-            }
-            bytes_read = res;
-            in_full += blocks;
-        } else {
-            while (((res = read(op->infd, wrkPos, blocks * bs)) < 0) &&
-                   ((EINTR == errno) || (EAGAIN == errno) ||
-                    (EBUSY == errno)))
-                ;
-            if (op->verbose > 2)
-                pr2serr("read(unix): count=%d, res=%d\n", blocks * bs,
-                        res);
-            if (res < 0) {
-                snprintf(ebuff, EBUFF_SZ, "%sreading, skip=%" PRId64 " ",
-                         my_name, op->skip);
-                perror(ebuff);
-                ret = -1;
-                break;
-            } else if (res < blocks * bs) {
-                op->dd_count = 0;
-                blocks = res / bs;
-                if ((res % bs) > 0) {
-                    blocks++;
-                    in_partial++;
-                }
-            }
-            bytes_read = res;
-            in_full += blocks;
-        }
-
+        ret = dd_read_stage(op, wrkPos, op->skip, &blocks, &blocks_per,
+                            &bytes_read, &eof);
+        if (ret)
+            break;
+        if (eof)
+            op->dd_count = 0;   /* force exit after write */
         if (0 == blocks)
             break;      /* nothing read so leave loop */
-
-        if (op->out2fd >= 0) {
-            while (((res = write(op->out2fd, wrkPos, blocks * bs)) < 0) &&
-                   ((EINTR == errno) || (EAGAIN == errno) ||
-                    (EBUSY == errno)))
-                ;
-            if (op->verbose > 2)
-                pr2serr("write to of2: count=%d, res=%d\n", blocks * bs,
-                        res);
-            if (res < 0) {
-                snprintf(ebuff, EBUFF_SZ, "%swriting to of2, seek=%"
-                         PRId64 " ", my_name, op->seek);
-                perror(ebuff);
-                ret = -1;
-                break;
-            }
-            bytes_of2 = res;
-        }
-
-        if (ofp->sparse && (op->dd_count > blocks) &&
-            (! (FT_DEV_NULL & ofp->file_type))) {
-            if (NULL == zeros_buff) {
-                zeros_buff = sg_memalign(blocks * bs, 0, &free_zeros_buff,
-                                         false);
-                if (NULL == zeros_buff) {
-                    pr2serr("zeros_buff sg_memalign failed\n");
-                    ret = -1;
-                    break;
-                }
-            }
-            if (0 == memcmp(wrkPos, zeros_buff, blocks * bs))
-                sparse_skip = true;
-        }
-        if (sparse_skip) {
-            if (FT_SG & ofp->file_type) {
-                out_sparse_num += blocks;
-                if (op->verbose > 2)
-                    pr2serr("sparse bypassing sg_write: seek blk=%" PRId64
-                            ", offset blks=%d\n", op->seek, blocks);
-            } else if (FT_DEV_NULL & ofp->file_type)
-                ;
-            else {
-                off64_t offset = (off64_t)blocks * bs;
-                off64_t off_res;
-
-                if (op->verbose > 2)
-                    pr2serr("sparse bypassing write: seek=%" PRId64 ", rel "
-                            "offset=%" PRId64 "\n", (op->seek * bs),
-                            (int64_t)offset);
-                off_res = lseek64(op->outfd, offset, SEEK_CUR);
-                if (off_res < 0) {
-                    pr2serr("sparse tried to bypass write: seek=%" PRId64
-                            ", rel offset=%" PRId64 " but ...\n",
-                            (op->seek * bs), (int64_t)offset);
-                    perror("lseek64 on output");
-                    ret = SG_LIB_FILE_ERROR;
-                    break;
-                } else if (op->verbose > 4)
-                    pr2serr("oflag=sparse lseek64 result=%" PRId64 "\n",
-                            (int64_t)off_res);
-                out_sparse_num += blocks;
-            }
-        } else if (FT_SG & ofp->file_type) {
-            dio_tmp = ofp->dio;
-            retries_tmp = ofp->retries;
-            first = true;
-            while (1) {
-                ret = sg_write(op->outfd, wrkPos, blocks, op->seek,
-                               &dio_tmp, op);
-                if ((0 == ret) || (SG_DD_BYPASS == ret))
-                    break;
-                if ((SG_LIB_CAT_NOT_READY == ret) ||
-                    (SG_LIB_PROGRESS_NOT_READY == ret) ||
-                    (SG_LIB_SYNTAX_ERROR == ret))
-                    break;
-                else if ((-2 == ret) && first) {
-                    /* ENOMEM: find what's available and try that */
-                    if (ioctl(op->outfd, SG_GET_RESERVED_SIZE, &buf_sz) < 0) {
-                        perror("RESERVED_SIZE ioctls failed");
-                        break;
-                    }
-                    if (buf_sz < MIN_RESERVED_SIZE)
-                        buf_sz = MIN_RESERVED_SIZE;
-                    blocks_per = (buf_sz + bs - 1) / bs;
-                    if (blocks_per < blocks) {
-                        blocks = blocks_per;
-                        pr2serr("Reducing %s to %d blocks per loop\n",
-                                (op->do_verify ? "verify" : "write"), blocks);
-                    } else
-                        break;
-                } else if ((SG_LIB_CAT_UNIT_ATTENTION == ret) && first) {
-                    if (--max_uas > 0)
-                        pr2serr("Unit attention, continuing (w)\n");
-                    else {
-                        pr2serr("Unit attention, too many (w)\n");
-                        break;
-                    }
-                } else if ((SG_LIB_CAT_ABORTED_COMMAND == ret) && first) {
-                    if (--max_aborted > 0)
-                        pr2serr("Aborted command, continuing (w)\n");
-                    else {
-                        pr2serr("Aborted command, too many (w)\n");
-                        break;
-                    }
-                } else if (ret < 0)
-                    break;
-                else if (retries_tmp > 0) {
-                    pr2serr(">>> retrying a sgio %s, lba=0x%" PRIx64 "\n",
-                            (op->do_verify ? "verify" : "write"),
-                            (uint64_t)op->seek);
-                    --retries_tmp;
-                    ++num_retries;
-                    if (unrecovered_errs > 0)
-                        --unrecovered_errs;
-                } else
-                    break;
-                first = false;
-            }
-            if (SG_DD_BYPASS == ret)
-                ret = 0;        /* not bumping out_full */
-            else if (0 != ret) {
-                pr2serr("sg_write failed,%s seek=%" PRId64 "\n",
-                        ((-2 == ret) ? " try reducing bpt," : ""), op->seek);
-                break;
-            } else {
-                out_full += blocks;
-                if (ofp->dio && (! dio_tmp))
-                    op->dio_incomplete_count++;
-            }
-        } else if (FT_DEV_NULL & ofp->file_type) {
-            ; /* previosuly did: out_full += blocks; */
-        } else {
-            while (((res = write(op->outfd, wrkPos, blocks * bs)) < 0) &&
-                   ((EINTR == errno) || (EAGAIN == errno) ||
-                    (EBUSY == errno)))
-                ;
-            if (op->verbose > 2)
-                pr2serr("write(unix): count=%d, res=%d\n", blocks * bs,
-                        res);
-            if (res < 0) {
-                snprintf(ebuff, EBUFF_SZ, "%swriting, seek=%" PRId64 " ",
-                         my_name, op->seek);
-                perror(ebuff);
-                ret = -1;
-                break;
-            } else if (res < blocks * bs) {
-                pr2serr("output file probably full, seek=%" PRId64 " ",
-                        op->seek);
-                blocks = res / bs;
-                out_full += blocks;
-                if ((res % bs) > 0)
-                    out_partial++;
-                ret = -1;
-                break;
-            } else {
-                out_full += blocks;
-                bytes_of = res;
-            }
-        }
+        ret = dd_write_stage(op, wrkPos, &blocks, &blocks_per, &sparse_skip,
+                             &bytes_of, &bytes_of2);
+        if (ret)
+            break;
 #ifdef HAVE_POSIX_FADVISE
-        {
-            bool in_valid, out2_valid, out_valid;
-            int rt;
-
-            in_valid = !! ((FT_OTHER | FT_BLOCK) & ifp->file_type);
-            out_valid = !! ((FT_OTHER | FT_BLOCK) & ofp->file_type);
-            out2_valid = !! ((FT_OTHER | FT_BLOCK) & op->out2_type);
-            if (ifp->nocache && (bytes_read > 0) && in_valid) {
-                rt = posix_fadvise(op->infd, 0, (op->skip * bs) + bytes_read,
-                                   POSIX_FADV_DONTNEED);
-                // rt = posix_fadvise(op->infd, (op->skip * bs), bytes_read,
-                                   // POSIX_FADV_DONTNEED);
-                // rt = posix_fadvise(op->infd, 0, 0, POSIX_FADV_DONTNEED);
-                if (rt)         /* returns error as result */
-                    pr2serr("posix_fadvise on read, skip=%" PRId64
-                            " ,err=%d\n", op->skip, rt);
-            }
-            if ((ofp->nocache & 2) && (bytes_of2 > 0) && out2_valid) {
-                rt = posix_fadvise(op->out2fd, 0, 0, POSIX_FADV_DONTNEED);
-                if (rt)
-                    pr2serr("posix_fadvise on of2, seek=%" PRId64
-                            " ,err=%d\n", op->seek, rt);
-            }
-            if ((ofp->nocache & 1) && (bytes_of > 0) && out_valid) {
-                rt = posix_fadvise(op->outfd, 0, 0, POSIX_FADV_DONTNEED);
-                if (rt)
-                    pr2serr("posix_fadvise on output, seek=%" PRId64
-                            " ,err=%d\n", op->seek, rt);
-            }
-        }
+        dd_fadvise(op, bytes_read, bytes_of, bytes_of2);
 #endif
-        if (op->dd_count > 0)
-            op->dd_count -= blocks;
-        op->skip += blocks;
-        op->seek += blocks;
-        if (op->progress > 0) {
-            if (check_progress(op)) {
-                calc_duration_throughput(true);
-                print_stats("");
-            }
-        }
+        dd_advance(op, blocks);
     } /* end of main loop that does the copy ... */
+#ifdef HAVE_C11_ATOMICS
+copy_done:
+#endif
 
     if (ret && penult_sparse_skip && (penult_blocks > 0)) {
         /* if error and skipped last output due to sparse ... */
@@ -3083,14 +3676,28 @@ bypass_copy:
         free(wrkBuff);
     if (free_zeros_buff)
         free(free_zeros_buff);
+    if (sparse_bitmap)
+        free(sparse_bitmap);
     if (op->in_ptp)
         destruct_scsi_pt_obj(op->in_ptp);
     if (op->out_ptp)
         destruct_scsi_pt_obj(op->out_ptp);
-    if ((STDIN_FILENO != op->infd) && (op->infd >= 0))
-        close(op->infd);
+    for (k = 0; k < SNTL_MAX_SPLIT; ++k) {
+        if (op->in_sptp[k])
+            destruct_scsi_pt_obj(op->in_sptp[k]);
+        if (op->out_sptp[k])
+            destruct_scsi_pt_obj(op->out_sptp[k]);
+    }
+    if ((STDIN_FILENO != op->infd) && (op->infd >= 0)) {
+        if ((FT_NVME_GEN | FT_EMU) & ifp->file_type)
+            scsi_pt_close_device(op->infd);     /* also drops async state */
+        else
+            close(op->infd);
+    }
     if (! ((STDOUT_FILENO == op->outfd) || (FT_DEV_NULL & ofp->file_type))) {
-        if (op->outfd >= 0)
+        if ((FT_NVME_GEN | FT_EMU) & ofp->file_type)
+            scsi_pt_close_device(op->outfd);
+        else if (op->outfd >= 0)
             close(op->outfd);
     }
     if (op->dry_run > 0)
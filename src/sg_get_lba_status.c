@@ -36,7 +36,7 @@
  * device.
  */
 
-static const char * version_str = "1.43 20230619";      /* sbc5r04 */
+static const char * version_str = "1.45 20261016";      /* sbc5r04 */
 
 #define MY_NAME "sg_get_lba_status"
 
@@ -47,9 +47,14 @@ static const char * version_str = "1.43 20230619";      /* sbc5r04 */
 #define MAX_GLBAS_BUFF_LEN (1024 * 1024)
 #define DEF_GLBAS_BUFF_LEN 1024
 #define MIN_MAXLEN 16
+#define JS_FLUSH_DESCS 64       /* stream JSON after this many descriptors */
 
 static uint8_t glbasFixedBuff[DEF_GLBAS_BUFF_LEN];
 
+static const char * prov_stat_sn = "provisoning_status";
+static const char * add_stat_sn = "additional_status";
+static const char * lba_access_sn = "lba_accessibility";
+
 struct opts_t {
     bool do_16;
     bool do_32;
@@ -323,10 +328,128 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
 }
 
 
+/* Prints num LBA status descriptors starting at bp, the first one being
+ * descriptor number k0 (origin 0) in the response. */
+static void
+prt_lba_status_descs(const uint8_t * bp, int k0, int num, struct opts_t * op,
+                     sgj_opaque_p jap)
+{
+    int k, n, res;
+    uint8_t add_status = 0;     /* keep gcc quiet */
+    uint8_t lba_access = 0;     /* keep gcc quiet */
+    uint64_t d_lba = 0;
+    uint32_t d_blocks = 0;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo3p = NULL;
+    char b[196];
+    static const size_t blen = sizeof(b);
+
+    for (k = k0; k < (k0 + num); bp += 16, ++k) {
+        res = decode_lba_status_desc(bp, &d_lba, &d_blocks, &lba_access,
+                                     &add_status);
+        if ((res < 0) || (res > 15))
+            pr2serr("descriptor %d: bad LBA status descriptor returned "
+                    "%d\n", k + 1, res);
+        if (jsp->pr_as_json)
+            jo3p = sgj_new_unattached_object_r(jsp);
+        if (op->do_brief) { /* no LBA accessibility field */
+            n = sg_scnpr(b, blen, "0x%" PRIx64, d_lba);
+            if ((0 == op->blockhex) || (1 == (op->blockhex % 2)))
+                sg_scn3pr(b, blen, n, "  0x%x  %d  %d",
+                          (unsigned int)d_blocks, res, add_status);
+            else
+                sg_scn3pr(b, blen, n, "  %u  %d  %d",
+                          (unsigned int)d_blocks, res, add_status);
+            sgj_pr_hr(jsp, "%s\n", b);
+            sgj_js_nv_ihex(jsp, jo3p, "lba", d_lba);
+            sgj_js_nv_ihex(jsp, jo3p, "blocks", d_blocks);
+            sgj_js_nv_i(jsp, jo3p, prov_stat_sn, res);
+            sgj_js_nv_i(jsp, jo3p, add_stat_sn, add_status);
+        } else {
+            if (jsp->pr_as_json) {
+                sgj_js_nv_ihex(jsp, jo3p, "lba", d_lba);
+                sgj_js_nv_ihex(jsp, jo3p, "blocks", d_blocks);
+                sgj_js_nv_istr(jsp, jo3p, lba_access_sn, lba_access, NULL,
+                       get_lba_access_str(lba_access, b, blen, false));
+                sgj_js_nv_istr(jsp, jo3p, prov_stat_sn, res, NULL,
+                               get_prov_status_str(res, b, blen));
+                sgj_js_nv_istr(jsp, jo3p, add_stat_sn, add_status, NULL,
+                               get_pr_status_str(add_status, b, blen));
+            } else {
+                char d[64];
+
+                n = sg_scnpr(b, blen, "[%d] LBA: 0x%" PRIx64, k + 1, d_lba);
+                if (n < 24)     /* add some padding spaces */
+                    n += sg_scn3pr(b, blen, n,  "%*c", 24 - n, ' ');
+                if (1 == (op->blockhex % 2)) {
+
+                    snprintf(d, sizeof(d), "0x%x", d_blocks);
+                    n += sg_scn3pr(b, blen, n, " blocks: %10s", d);
+                } else
+                    n += sg_scn3pr(b, blen, n, " blocks: %10u", d_blocks);
+                get_prov_status_str(res, d, sizeof(d));
+                n += sg_scn3pr(b, blen, n, "  %s;", d);
+                get_lba_access_str(lba_access, d, sizeof(d), true);
+                n += sg_scn3pr(b, blen, n, "  %s", d);
+                get_pr_status_str(add_status, d, sizeof(d));
+                if (strlen(d) > 0)
+                    sg_scn3pr(b, blen, n, "  [%s]", d);
+                sgj_pr_hr(jsp, "%s\n", b);
+            }
+        }
+        if (jsp->pr_as_json) {
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+            if (0 == ((k + 1) % JS_FLUSH_DESCS))
+                sgj_stream_flush(jsp, jap);
+        }
+    }
+    sgj_stream_flush(jsp, jap);
+}
+
+/* Used with --inhex=FN when the LBA status descriptors do not fit in the
+ * buffer at bp0 (op->maxlen bytes long, already full). Decodes those in the
+ * buffer, then refills it from hsp and repeats so memory use is bounded
+ * however large FN is. */
+static int
+decode_lba_status_strm(struct sg_hex_strm * hsp, uint8_t * bp0,
+                       int num_descs, struct opts_t * op, sgj_opaque_p jap)
+{
+    int k, n, num, rem, res;
+    const uint8_t * bp = bp0 + 8;
+
+    n = op->maxlen - 8;
+    for (k = 0; k < num_descs; ) {
+        num = n / 16;
+        if (num > (num_descs - k))
+            num = num_descs - k;
+        prt_lba_status_descs(bp, k, num, op, jap);
+        k += num;
+        if (k >= num_descs)
+            break;
+        /* move partial descriptor to start of buffer then refill */
+        rem = n - (num * 16);
+        memmove(bp0, bp + (num * 16), rem);
+        res = sg_hex_strm_read(hsp, bp0 + rem, op->maxlen - rem, &n);
+        if (res)
+            return res;
+        if (0 == n) {
+            pr2serr("perhaps %s has been truncated\n", op->in_fn);
+            break;
+        }
+        n += rem;
+        bp = bp0;
+    }
+    if (op->verbose > 2)
+        pr2serr("Decoded %d LBA status descriptors\n", k);
+    return 0;
+}
+
 int
 main(int argc, char * argv[])
 {
     bool no_final_msg = false;
+    bool strm = false;
+    FILE * js_fp = NULL;
     int k, res, c, n, rlen, num_descs, completion_cond, in_len;
     int sg_fd = -1;
     int ret = 0;
@@ -336,22 +459,18 @@ main(int argc, char * argv[])
     uint32_t d_blocks = 0;
     int64_t ll;
     const char * device_name = NULL;
-    const uint8_t * bp;
     uint8_t * glbasBuffp = glbasFixedBuff;
     uint8_t * free_glbasBuffp = NULL;
+    struct sg_hex_strm * hsp = NULL;
     struct opts_t * op;
     sgj_opaque_p jop = NULL;
     sgj_opaque_p jo2p = NULL;
-    sgj_opaque_p jo3p = NULL;
     sgj_opaque_p jap = NULL;
     sgj_state * jsp;
     struct opts_t opts SG_C_CPP_ZERO_INIT;
     char b[196];
     static const size_t blen = sizeof(b);
     static const char * gls_pd_sn = "get_lba_status_parameter_data";
-    static const char * prov_stat_sn = "provisoning_status";
-    static const char * add_stat_sn = "additional_status";
-    static const char * lba_access_sn = "lba_accessibility";
     static const char * compl_cond_s = "Completion condition";
     static const char * compl_cond_sn = "completion_condition";
 
@@ -550,14 +669,21 @@ main(int argc, char * argv[])
     }
     if (NULL == device_name) {
         if (op->in_fn) {
-            if ((ret = sg_f2hex_arr(op->in_fn, op->do_raw, false, glbasBuffp,
-                                    &in_len, op->maxlen))) {
-                if (SG_LIB_LBA_OUT_OF_RANGE == ret) {
-                    no_final_msg = true;
-                    pr2serr("... decode what we have, --maxlen=%d needs to "
-                            "be increased\n", op->maxlen);
-                } else
-                    goto fini;
+            if ((ret = sg_hex_strm_open(op->in_fn, op->do_raw, false, false,
+                                        &hsp)))
+                goto fini;
+            if ((ret = sg_hex_strm_read(hsp, glbasBuffp, op->maxlen,
+                                        &in_len)))
+                goto fini;
+            /* LBA status descriptors can be decoded as FN is read */
+            if ((op->do_hex || (op->do_brief > 1)) &&
+                (in_len == op->maxlen) &&
+                (0 == sg_hex_strm_read(hsp, (uint8_t *)b, 1, &k)) &&
+                (k > 0)) {
+                ret = SG_LIB_LBA_OUT_OF_RANGE;
+                no_final_msg = true;
+                pr2serr("... decode what we have, --maxlen=%d needs to "
+                        "be increased\n", op->maxlen);
             }
             if (op->verbose > 2)
                 pr2serr("Read %d [0x%x] bytes of user supplied data\n",
@@ -646,13 +772,18 @@ start_response:
         goto fini;
     }
     jo2p = sgj_named_subobject_r(jsp, jop, gls_pd_sn);
+    strm = hsp && (in_len == op->maxlen) && (rlen > op->maxlen) &&
+           (op->do_brief < 2);
     if ((op->verbose > 1) || (op->verbose && (rlen > op->maxlen))) {
         pr2serr("response length %d bytes\n", rlen);
-        if (rlen > op->maxlen)
+        if (strm)
+            pr2serr("  ... which is greater than maxlen (%d), decode %s "
+                    "in chunks\n", op->maxlen, op->in_fn);
+        else if (rlen > op->maxlen)
             pr2serr("  ... which is greater than maxlen (allocation "
                     "length %d), truncation\n", op->maxlen);
     }
-    if (rlen > op->maxlen)
+    if ((rlen > op->maxlen) && (! strm))
         rlen = op->maxlen;
 
     if (op->do_brief > 1) {
@@ -726,65 +857,16 @@ start_response:
                *(glbasBuffp + 7) & 0x1, true);    /* added sbc4r12 */
     if (op->verbose)
         pr2serr("%d complete LBA status descriptors found\n", num_descs);
-    if (jsp->pr_as_json)
+    if (jsp->pr_as_json) {
         jap = sgj_named_subarray_r(jsp, jo2p, "lba_status_descriptor");
-
-    for (bp = glbasBuffp + 8, k = 0; k < num_descs; bp += 16, ++k) {
-        res = decode_lba_status_desc(bp, &d_lba, &d_blocks, &lba_access,
-                                     &add_status);
-        if ((res < 0) || (res > 15))
-            pr2serr("descriptor %d: bad LBA status descriptor returned "
-                    "%d\n", k + 1, res);
-        if (jsp->pr_as_json)
-            jo3p = sgj_new_unattached_object_r(jsp);
-        if (op->do_brief) { /* no LBA accessibility field */
-            n = sg_scnpr(b, blen, "0x%" PRIx64, d_lba);
-            if ((0 == op->blockhex) || (1 == (op->blockhex % 2)))
-                sg_scn3pr(b, blen, n, "  0x%x  %d  %d",
-                          (unsigned int)d_blocks, res, add_status);
-            else
-                sg_scn3pr(b, blen, n, "  %u  %d  %d",
-                          (unsigned int)d_blocks, res, add_status);
-            sgj_pr_hr(jsp, "%s\n", b);
-            sgj_js_nv_ihex(jsp, jo3p, "lba", d_lba);
-            sgj_js_nv_ihex(jsp, jo3p, "blocks", d_blocks);
-            sgj_js_nv_i(jsp, jo3p, prov_stat_sn, res);
-            sgj_js_nv_i(jsp, jo3p, add_stat_sn, add_status);
-        } else {
-            if (jsp->pr_as_json) {
-                sgj_js_nv_ihex(jsp, jo3p, "lba", d_lba);
-                sgj_js_nv_ihex(jsp, jo3p, "blocks", d_blocks);
-                sgj_js_nv_istr(jsp, jo3p, lba_access_sn, lba_access, NULL,
-                       get_lba_access_str(lba_access, b, blen, false));
-                sgj_js_nv_istr(jsp, jo3p, prov_stat_sn, res, NULL,
-                               get_prov_status_str(res, b, blen));
-                sgj_js_nv_istr(jsp, jo3p, add_stat_sn, add_status, NULL,
-                               get_pr_status_str(add_status, b, blen));
-            } else {
-                char d[64];
-
-                n = sg_scnpr(b, blen, "[%d] LBA: 0x%" PRIx64, k + 1, d_lba);
-                if (n < 24)     /* add some padding spaces */
-                    n += sg_scn3pr(b, blen, n,  "%*c", 24 - n, ' ');
-                if (1 == (op->blockhex % 2)) {
-
-                    snprintf(d, sizeof(d), "0x%x", d_blocks);
-                    n += sg_scn3pr(b, blen, n, " blocks: %10s", d);
-                } else
-                    n += sg_scn3pr(b, blen, n, " blocks: %10u", d_blocks);
-                get_prov_status_str(res, d, sizeof(d));
-                n += sg_scn3pr(b, blen, n, "  %s;", d);
-                get_lba_access_str(lba_access, d, sizeof(d), true);
-                n += sg_scn3pr(b, blen, n, "  %s", d);
-                get_pr_status_str(add_status, d, sizeof(d));
-                if (strlen(d) > 0)
-                    sg_scn3pr(b, blen, n, "  [%s]", d);
-                sgj_pr_hr(jsp, "%s\n", b);
-            }
-        }
-        if (jsp->pr_as_json)
-            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        /* write out (and free) descriptors as they are decoded */
+        js_fp = sgj_stream_start_file(jsp, op->js_file);
     }
+
+    if (strm)
+        ret = decode_lba_status_strm(hsp, glbasBuffp, num_descs, op, jap);
+    else
+        prt_lba_status_descs(glbasBuffp + 8, 0, num_descs, op, jap);
     if ((num_descs * 16) + 8 < rlen)
         pr2serr("incomplete trailing LBA status descriptors found\n");
     goto fini;
@@ -800,6 +882,7 @@ error:
     }
 
 fini:
+    sg_hex_strm_close(hsp);
     if (sg_fd >= 0) {
         res = sg_cmds_close_device(sg_fd);
         if (res < 0) {
@@ -819,7 +902,9 @@ fini:
     if (jsp->pr_as_json) {
         FILE * fp = stdout;
 
-        if (op->js_file) {
+        if (js_fp)
+            fp = js_fp;         /* already streaming to it */
+        else if (op->js_file) {
             if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
                 fp = fopen(op->js_file, "w");   /* truncate if exists */
                 if (NULL == fp) {
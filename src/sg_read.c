@@ -46,6 +46,7 @@
 #endif
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -59,16 +60,16 @@
 
 #include "sg_lib.h"
 #include "sg_io_linux.h"
+#include "sg_rw.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "1.41 20231015";
+static const char * version_str = "1.43 20261016";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
 #define DEF_SCSI_CDBSZ 10
-#define MAX_SCSI_CDBSZ 16
 #define MAX_BPT_VALUE (1 << 24)         /* used for maximum bs as well */
 #define MAX_COUNT_SKIP_SEEK (1LL << 48) /* coverity wants upper bound */
 
@@ -77,6 +78,9 @@ static const char * version_str = "1.41 20231015";
 #ifndef SG_FLAG_MMAP_IO
 #define SG_FLAG_MMAP_IO 4
 #endif
+#ifndef SGV4_FLAG_HIPRI
+#define SGV4_FLAG_HIPRI 0x800   /* sg driver 4.0.x polls for completion */
+#endif
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_TIMEOUT 40000       /* 40,000 millisecs == 40 seconds */
@@ -101,6 +105,7 @@ static int64_t in_full = 0;
 static int in_partial = 0;
 
 static int pack_id_count = 0;
+static struct sg_rw_tmpl rd_tmpl;      /* READ cdb template, built once */
 static int verbose = 0;
 
 static const char * sg_allow_dio = "/sys/module/sg/parameters/allow_dio";
@@ -179,10 +184,10 @@ static void
 usage()
 {
     pr2serr("Usage: sg_read  [blk_sgio=0|1] [bpt=BPT] [bs=BS] "
-            "[cdbsz=6|10|12|16]\n"
+            "[cdbsz=6|10|12|16|32]\n"
             "                count=COUNT [dio=0|1] [dpo=0|1] [fua=0|1] "
-            "if=IFILE\n"
-            "                [mmap=0|1] [no_dfxer=0|1] [odir=0|1] "
+            "[hipri=0|1]\n"
+            "                if=IFILE [mmap=0|1] [no_dfxer=0|1] [odir=0|1] "
             "[skip=SKIP]\n"
             "                [time=TI] [verbose=VERB] [--help] "
             "[--verbose]\n"
@@ -205,6 +210,9 @@ usage()
             "(def)\n");
     pr2serr("    dpo      1-> set disable page out (DPO) in SCSI READs\n"
             "    fua      1-> set force unit access (FUA) in SCSI READs\n"
+            "    hipri    1-> poll for completion (sg v4 driver, or "
+            "odir=1 on a\n"
+            "             block device), 0->wait for an interrupt (def)\n"
             "    if       an sg, block or raw device, or a seekable file (not "
             "stdin)\n"
             "    mmap     1->perform mmap-ed IO on sg device, 0->indirect IO "
@@ -224,90 +232,19 @@ usage()
             "block address\n");
 }
 
-static int
-sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, bool write_true, bool fua, bool dpo)
-{
-    int sz_ind;
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr(ME "for 6 byte commands, maximum number of blocks is "
-                    "256\n");
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr(ME "for 6 byte commands, can't address blocks beyond "
-                    "%d\n", 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr(ME "for 6 byte commands, neither dpo nor fua bits "
-                    "supported\n");
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr(ME "for 10 byte commands, maximum number of blocks is "
-                    "%d\n", 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64(start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr(ME "expected cdb size of 6, 10, 12, or 16 but got %d\n",
-                cdb_sz);
-        return 1;
-    }
-    return 0;
-}
-
 /* -3 medium/hardware error, -2 -> not ready, 0 -> successful,
    1 -> recoverable (ENOMEM), 2 -> try again (e.g. unit attention),
    3 -> try again (e.g. aborted command), -1 -> other unrecoverable error */
 static int
 sg_bread(int sg_fd, uint8_t * buff, int blocks, int64_t from_block, int bs,
-         int cdbsz, bool fua, bool dpo, bool * diop, bool do_mmap,
-         bool no_dxfer)
+         bool * diop, bool do_mmap, bool no_dxfer, bool hipri)
 {
-    uint8_t rdCmd[MAX_SCSI_CDBSZ];
+    uint8_t * rdCmd = rd_tmpl.cdb;
+    int cdbsz = rd_tmpl.cdb_len;
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr;
 
-    if (sg_build_scsi_cdb(rdCmd, cdbsz, blocks, from_block, false, fua,
-                          dpo)) {
+    if (sg_rw_tmpl_patch(&rd_tmpl, from_block, blocks)) {
         pr2serr(ME "bad cdb build, from_block=%" PRId64 ", blocks=%d\n",
                 from_block, blocks);
         return -1;
@@ -330,6 +267,8 @@ sg_bread(int sg_fd, uint8_t * buff, int blocks, int64_t from_block, int bs,
             io_hdr.flags |= SG_FLAG_NO_DXFER;
     } else
         io_hdr.dxfer_direction = SG_DXFER_NONE;
+    if (hipri)
+        io_hdr.flags |= SGV4_FLAG_HIPRI;
     io_hdr.mx_sb_len = SENSE_BUFF_LEN;
     io_hdr.sbp = senseBuff;
     io_hdr.timeout = DEF_TIMEOUT;
@@ -417,7 +356,9 @@ main(int argc, char * argv[])
     bool do_odir = false;
     bool dpo = false;
     bool fua = false;
+    bool hipri = false;
     bool no_dxfer = false;
+    bool sg_hipri = false;
     bool verbose_given = false;
     bool version_given = false;
     int bs = 0;
@@ -503,6 +444,8 @@ main(int argc, char * argv[])
             dpo = !! sg_get_num(buf);
         else if (0 == strcmp(key,"fua"))
             fua = !! sg_get_num(buf);
+        else if (0 == strcmp(key,"hipri"))
+            hipri = !! sg_get_num(buf);
         else if (strcmp(key,"if") == 0) {
             memcpy(inf, buf, INF_SZ - 1);
             inf[INF_SZ - 1] = '\0';
@@ -642,6 +585,13 @@ main(int argc, char * argv[])
             pr2serr(ME "SCSI READ (6) can't do zero block reads\n");
             return SG_LIB_SYNTAX_ERROR;
         }
+        if (sg_rw_tmpl_init(&rd_tmpl, scsi_cdbsz, false, 0,
+                            (dpo ? SG_RW_FL_DPO : 0) |
+                            (fua ? SG_RW_FL_FUA : 0), 0)) {
+            pr2serr(ME "bad cdbsz=%d (6 byte cdbs don't support dpo or "
+                    "fua)\n", scsi_cdbsz);
+            return SG_LIB_SYNTAX_ERROR;
+        }
         flags = O_RDWR;
         if (do_odir)
             flags |= O_DIRECT;
@@ -680,6 +630,14 @@ main(int argc, char * argv[])
                 return SG_LIB_CAT_OTHER;
             }
         }
+        if (hipri) {
+            if ((FT_BLOCK & in_type) ||
+                (ioctl(infd, SG_GET_VERSION_NUM, &t) < 0) || (t < 40000))
+                pr2serr(ME "hipri needs a sg device with driver version >= "
+                        "4.0.0, ignored\n");
+            else
+                sg_hipri = true;
+        }
     } else {
         if (do_mmap) {
             pr2serr(ME "mmap-ed IO only support on sg devices\n");
@@ -701,6 +659,10 @@ main(int argc, char * argv[])
         }
         if (verbose)
             pr2serr("Opened %s for Unix reads with flags=0x%x\n", inf, flags);
+#if ! (defined(HAVE_PREADV2) && defined(RWF_HIPRI))
+        if (hipri)
+            pr2serr(ME "hipri not supported for Unix reads, ignored\n");
+#endif
         if (skip > 0) {
             off64_t offset = skip;
 
@@ -764,8 +726,8 @@ main(int argc, char * argv[])
             blocks = (dd_count > blocks_per) ? blocks_per : dd_count;
         if (FT_SG & in_type) {
             dio_tmp = do_dio;
-            res = sg_bread(infd, wrkPos, blocks, skip, bs, scsi_cdbsz,
-                           fua, dpo, &dio_tmp, do_mmap, no_dxfer);
+            res = sg_bread(infd, wrkPos, blocks, skip, bs, &dio_tmp,
+                           do_mmap, no_dxfer, sg_hipri);
             if (1 == res) {     /* ENOMEM, find what's available+try that */
                 if (ioctl(infd, SG_GET_RESERVED_SIZE, &buf_sz) < 0) {
                     perror("RESERVED_SIZE ioctls failed");
@@ -776,12 +738,12 @@ main(int argc, char * argv[])
                 blocks_per = (buf_sz + bs - 1) / bs;
                 blocks = blocks_per;
                 pr2serr("Reducing read to %d blocks per loop\n", blocks_per);
-                res = sg_bread(infd, wrkPos, blocks, skip, bs, scsi_cdbsz,
-                               fua, dpo, &dio_tmp, do_mmap, no_dxfer);
+                res = sg_bread(infd, wrkPos, blocks, skip, bs, &dio_tmp,
+                               do_mmap, no_dxfer, sg_hipri);
             } else if (2 == res) {
                 pr2serr("Unit attention, try again (r)\n");
-                res = sg_bread(infd, wrkPos, blocks, skip, bs, scsi_cdbsz,
-                               fua, dpo, &dio_tmp, do_mmap, no_dxfer);
+                res = sg_bread(infd, wrkPos, blocks, skip, bs, &dio_tmp,
+                               do_mmap, no_dxfer, sg_hipri);
             }
             if (0 != res) {
                 switch (res) {
@@ -822,6 +784,18 @@ main(int argc, char * argv[])
                     break;
                 }
             }
+#if defined(HAVE_PREADV2) && defined(RWF_HIPRI)
+            if (hipri) {
+                struct iovec iov;
+
+                iov.iov_base = wrkPos;
+                iov.iov_len = blocks * bs;
+                /* offset -1: use and advance the file position */
+                while (((res = preadv2(infd, &iov, 1, -1, RWF_HIPRI)) < 0) &&
+                       (EINTR == errno))
+                    ;
+            } else
+#endif
             while (((res = read(infd, wrkPos, blocks * bs)) < 0) &&
                    (EINTR == errno))
                 ;
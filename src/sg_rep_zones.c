@@ -18,6 +18,10 @@
 #include <errno.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -25,6 +29,10 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_lib_data.h"
 #include "sg_pt.h"
@@ -41,7 +49,7 @@
  * Based on zbc2r12.pdf
  */
 
-static const char * version_str = "1.51 20230622";
+static const char * version_str = "1.54 20261016";
 
 #define MY_NAME "sg_rep_zones"
 
@@ -52,9 +60,20 @@ static const char * version_str = "1.51 20230622";
 
 #define SG_ZONING_IN_CMDLEN 16
 #define REPORT_ZONES_DESC_LEN 64
+#define JS_FLUSH_DESCS 64       /* stream JSON after this many zone descs */
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 
+#define ZMAP_VERSION 1          /* of the --cache=CFN zone map file */
+#define ZMAP_HDR_LEN 64
+#define ZMAP_REC_LEN 32
+#define DEF_SCAN_THREADS 4
+#define MAX_SCAN_THREADS 64
+#define REFRESH_GAP 8   /* --refresh rereads up to this many FULL zones
+                         * rather than start another run */
+#define ZSCAN_MIN_LEN (64 + REPORT_ZONES_DESC_LEN) /* scans ignore smaller
+                                                 * --maxlen values */
+
 /* Three zone service actions supported by this utility */
 enum zone_report_sa_e {
     REPORT_ZONES_SA = 0x0,
@@ -69,6 +88,7 @@ struct opts_t {
     bool do_partial;
     bool do_raw;
     bool do_realms;
+    bool do_refresh;
     bool do_zdomains;
     bool maxlen_given;
     bool o_readonly;
@@ -83,8 +103,11 @@ struct opts_t {
     int find_zt;        /* negative values: find first not equal to */
     int maxlen;
     int reporting_opt;
+    int scan_threads;
     int vb;
+    uint32_t cache_lbs; /* logical block size held in zone map, 0: unknown */
     uint64_t st_lba;
+    const char * cache_fn;
     const char * in_fn;
     const char * json_arg;
     const char * js_file;
@@ -98,6 +121,7 @@ struct zt_num2abbrev_t {
 
 static const struct option long_options[] = {
     {"brief", no_argument, 0, 'b'}, /* only header and last descriptor */
+    {"cache", required_argument, 0, 'c'},
     {"domain", no_argument, 0, 'd'},
     {"domains", no_argument, 0, 'd'},
     {"force", no_argument, 0, 'f'},
@@ -117,10 +141,12 @@ static const struct option long_options[] = {
     {"readonly", no_argument, 0, 'R'},
     {"realm", no_argument, 0, 'e'},
     {"realms", no_argument, 0, 'e'},
+    {"refresh", no_argument, 0, 'u'},
     {"report", required_argument, 0, 'o'},
     {"start", required_argument, 0, 's'},
     {"statistics", no_argument, 0, 'S'},
     {"stats", no_argument, 0, 'S'},
+    {"threads", required_argument, 0, 't'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"wp", no_argument, 0, 'w'},
@@ -166,19 +192,24 @@ usage(int h)
 {
     if (h > 1) goto h_twoormore;
     pr2serr("Usage: "
-            "sg_rep_zones  [--domain] [--find=ZT] [--force] [--help] "
-            "[--hex]\n"
-            "                     [--inhex=FN] [--json[=JO]] "
+            "sg_rep_zones  [--cache=CFN] [--domain] [--find=ZT] [--force] "
+            "[--help]\n"
+            "                     [--hex] [--inhex=FN] [--json[=JO]] "
             "[--js_file=JFN]\n"
             "                     [--locator=LBA] [--maxlen=LEN] "
             "[--num=NUM]\n"
             "                     [--partial] [--raw] [--readonly]"
             "[--realm]\n"
-            "                     [--report=OPT] [--start=LBA] "
+            "                     [--refresh] [--report=OPT] [--start=LBA] "
             "[--statistics]\n"
-            "                     [--verbose] [--version] [--wp] "
-            "DEVICE\n");
+            "                     [--threads=NT] [--verbose] [--version] "
+            "[--wp] DEVICE\n");
     pr2serr("  where:\n"
+            "    --cache=CFN|-c CFN    scan all zones of DEVICE into zone map "
+            "file CFN\n"
+            "                          then answer from it; without DEVICE "
+            "answer\n"
+            "                          from existing CFN\n"
             "    --domain|-d        sends a REPORT ZONE DOMAINS command\n"
             "    --find=ZT|-F ZT    find first zone with ZT zone type, "
             "starting at LBA\n"
@@ -213,11 +244,18 @@ usage(int h)
             "    --raw|-r           output response in binary\n"
             "    --readonly|-R      open DEVICE read-only (def: read-write)\n"
             "    --realm|-e         sends a REPORT REALMS command\n"
+            "    --refresh|-u       with --cache= only reread zones in CFN "
+            "that are\n"
+            "                       not FULL (nor conventional)\n"
             "    --report=OPT|-o OP    reporting options (def: 0: all "
             "zones)\n"
             "    --start=LBA|-s LBA    report zones from the LBA (def: 0)\n"
             "                          need not be a zone starting LBA\n"
             "    --statistics|-S    gather statistics by reviewing zones\n"
+            "    --threads=NT|-t NT    number of threads scanning for "
+            "--cache=\n"
+            "                          (def: 4; 0 or 1 -> no extra "
+            "threads)\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n"
             "    --wp|-w            output write pointer only\n\n"
@@ -432,31 +470,15 @@ prt_a_zn_desc(const uint8_t *bp, struct opts_t * op, sgj_opaque_p jop)
     return lba + len;
 }
 
-static int
-decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
-                 struct opts_t * op,  sgj_opaque_p jop)
+/* Prints the 64 byte header of a REPORT ZONES response */
+static void
+prt_rep_zones_hdr(const uint8_t * rzBuff, struct opts_t * op,
+                  sgj_opaque_p jop)
 {
-    bool as_json;
-    int k, same, num_zd;
-    uint64_t wp, ul, mx_lba;
+    int same;
+    uint64_t mx_lba;
     sgj_state * jsp = &op->json_st;
-    sgj_opaque_p jap = NULL;
-    const uint8_t * bp;
 
-    as_json = jsp ? jsp->pr_as_json : false;
-    if ((uint32_t)act_len < decod_len) {
-        num_zd = (act_len >= 64) ? ((act_len - 64) / REPORT_ZONES_DESC_LEN)
-                                 : 0;
-        if (act_len == op->maxlen) {
-            if (op->maxlen_given)
-                pr2serr("decode length [%u bytes] may be constrained by "
-                        "given --maxlen value, try increasing\n", decod_len);
-            else
-                pr2serr("perhaps --maxlen=%u needs to be used\n", decod_len);
-        } else if (op->in_fn)
-            pr2serr("perhaps %s has been truncated\n", op->in_fn);
-    } else
-        num_zd = (decod_len - 64) / REPORT_ZONES_DESC_LEN;
     same = rzBuff[4] & 0xf;
     mx_lba = sg_get_unaligned_be64(rzBuff + 8);
     if (op->wp_only) {
@@ -479,6 +501,78 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
         sgj_js_nv_ihex(jsp, jop, sgj_convert2snake(rzslbag_s, b, sizeof(b)),
                        rzslbag);
     }
+}
+
+/* Prints num zone descriptors starting at bp, the first one being zone
+ * descriptor number k0 in the response. */
+static void
+prt_zn_descs(const uint8_t * bp, int k0, int num, struct opts_t * op,
+             sgj_opaque_p jap)
+{
+    int k;
+    uint64_t wp;
+    sgj_state * jsp = &op->json_st;
+
+    for (k = k0; k < (k0 + num); ++k, bp += REPORT_ZONES_DESC_LEN) {
+        sgj_opaque_p jo2p;
+
+        if (! op->wp_only)
+             sgj_pr_hr(jsp, " %s%d\n", zn_dnum_s, k);
+        if (op->do_hex) {
+            hex2stdout(bp, 64, -1);
+            continue;
+        }
+        if (op->wp_only) {
+            if (op->do_hex)
+                hex2stdout(bp + 24, 8, -1);
+            else {
+                wp = sg_get_unaligned_be64(bp + 24);
+                if (sg_all_ffs((const uint8_t *)&wp, sizeof(wp)))
+                    sgj_pr_hr(jsp, "-1\n");
+                else
+                    sgj_pr_hr(jsp, "0x%" PRIx64 "\n", wp);
+                jo2p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba", (int64_t)wp);
+                sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+            }
+            continue;
+        }
+        jo2p = sgj_new_unattached_object_r(jsp);
+        prt_a_zn_desc(bp, op, jo2p);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        if (0 == ((k + 1) % JS_FLUSH_DESCS))
+            sgj_stream_flush(jsp, jap);
+    }
+    sgj_stream_flush(jsp, jap);
+}
+
+static int
+decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
+                 struct opts_t * op,  sgj_opaque_p jop)
+{
+    bool as_json;
+    int num_zd;
+    uint64_t ul, mx_lba;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    const uint8_t * bp;
+
+    as_json = jsp ? jsp->pr_as_json : false;
+    if ((uint32_t)act_len < decod_len) {
+        num_zd = (act_len >= 64) ? ((act_len - 64) / REPORT_ZONES_DESC_LEN)
+                                 : 0;
+        if (act_len == op->maxlen) {
+            if (op->maxlen_given)
+                pr2serr("decode length [%u bytes] may be constrained by "
+                        "given --maxlen value, try increasing\n", decod_len);
+            else
+                pr2serr("perhaps --maxlen=%u needs to be used\n", decod_len);
+        } else if (op->in_fn)
+            pr2serr("perhaps %s has been truncated\n", op->in_fn);
+    } else
+        num_zd = (decod_len - 64) / REPORT_ZONES_DESC_LEN;
+    mx_lba = sg_get_unaligned_be64(rzBuff + 8);
+    prt_rep_zones_hdr(rzBuff, op, jop);
     if (op->do_num > 0)
             num_zd = (num_zd > op->do_num) ? op->do_num : num_zd;
     if (((uint32_t)act_len < decod_len) &&
@@ -509,35 +603,7 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
     }
     if (as_json)
         jap = sgj_named_subarray_r(jsp, NULL, "zone_descriptors_list");
-    for (k = 0, bp = rzBuff + 64; k < num_zd;
-         ++k, bp += REPORT_ZONES_DESC_LEN) {
-        sgj_opaque_p jo2p;
-
-        if (! op->wp_only)
-             sgj_pr_hr(jsp, " %s%d\n", zn_dnum_s, k);
-        if (op->do_hex) {
-            hex2stdout(bp, 64, -1);
-            continue;
-        }
-        if (op->wp_only) {
-            if (op->do_hex)
-                hex2stdout(bp + 24, 8, -1);
-            else {
-                wp = sg_get_unaligned_be64(bp + 24);
-                if (sg_all_ffs((const uint8_t *)&wp, sizeof(wp)))
-                    sgj_pr_hr(jsp, "-1\n");
-                else
-                    sgj_pr_hr(jsp, "0x%" PRIx64 "\n", wp);
-                jo2p = sgj_new_unattached_object_r(jsp);
-                sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba", (int64_t)wp);
-                sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
-            }
-            continue;
-        }
-        jo2p = sgj_new_unattached_object_r(jsp);
-        prt_a_zn_desc(bp, op, jo2p);
-        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
-    }
+    prt_zn_descs(rzBuff + 64, 0, num_zd, op, jap);
     if ((op->do_num == 0) && (! op->wp_only) && (! op->do_hex)) {
         if ((64 + (REPORT_ZONES_DESC_LEN * (uint32_t)num_zd)) < decod_len)
             sgj_pr_hr(jsp, "\n>>> Beware: Zone list truncated, may need "
@@ -546,6 +612,58 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
     return 0;
 }
 
+/* Used with --inhex=FN when the zone descriptors do not fit in rzBuff
+ * (op->maxlen bytes long, first in_len bytes already read). Decodes the
+ * descriptors in rzBuff, then refills it from hsp and repeats so memory
+ * use is bounded however large FN is. */
+static int
+decode_rep_zones_strm(struct sg_hex_strm * hsp, uint8_t * rzBuff, int in_len,
+                      uint32_t decod_len, struct opts_t * op,
+                      sgj_opaque_p jop)
+{
+    int k, n, num, num_zd, rem, res;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    const uint8_t * bp;
+
+    num_zd = (decod_len - 64) / REPORT_ZONES_DESC_LEN;
+    if ((op->do_num > 0) && (op->do_num < num_zd))
+        num_zd = op->do_num;
+    prt_rep_zones_hdr(rzBuff, op, jop);
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, NULL, "zone_descriptors_list");
+    bp = rzBuff + 64;
+    n = in_len - 64;
+    for (k = 0; k < num_zd; ) {
+        num = n / REPORT_ZONES_DESC_LEN;
+        if (num > (num_zd - k))
+            num = num_zd - k;
+        prt_zn_descs(bp, k, num, op, jap);
+        k += num;
+        if (k >= num_zd)
+            break;
+        /* move partial descriptor to start of buffer then refill */
+        rem = n - (num * REPORT_ZONES_DESC_LEN);
+        memmove(rzBuff, bp + (num * REPORT_ZONES_DESC_LEN), rem);
+        res = sg_hex_strm_read(hsp, rzBuff + rem, op->maxlen - rem, &n);
+        if (res)
+            return res;
+        if (0 == n) {
+            pr2serr("perhaps %s has been truncated\n", op->in_fn);
+            break;
+        }
+        n += rem;
+        bp = rzBuff;
+    }
+    if (op->vb > 2)
+        pr2serr("Decoded %d zone descriptors\n", k);
+    if ((op->do_num == 0) && (! op->wp_only) && (! op->do_hex) &&
+        (k < num_zd))
+        sgj_pr_hr(jsp, "\n>>> Beware: Zone list truncated, may need "
+                  "another call\n");
+    return 0;
+}
+
 static int
 decode_rep_realms(const uint8_t * rzBuff, int act_len, struct opts_t * op,
                   sgj_opaque_p jop)
@@ -1089,14 +1207,17 @@ gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
     printf("Number of used blocks in write pointer zones: 0x%" PRIx64 "\n",
            st.wp_blk_num);
 
-    if ((sg_fd >= 0) && (op->maxlen >= RCAP16_REPLY_LEN) &&
+    if (((sg_fd >= 0) || op->cache_lbs) &&
+        (op->maxlen >= RCAP16_REPLY_LEN) &&
         ((st.wp_blk_num > 0) || (st.conv_blk_num > 0))) {
-        uint32_t block_size = 0;
+        uint32_t block_size = op->cache_lbs;
         uint64_t total_sz;
         double sz_mb, sz_gb;
 
-        res = sg_ll_readcap_16(sg_fd, false, 0, rzBuff,
-                               RCAP16_REPLY_LEN, true, op->vb);
+        /* without DEVICE the block size comes from the zone map */
+        res = (sg_fd < 0) ? 0 : sg_ll_readcap_16(sg_fd, false, 0, rzBuff,
+                                                 RCAP16_REPLY_LEN, true,
+                                                 op->vb);
         if (SG_LIB_CAT_INVALID_OP == res) {
             pr2serr("READ CAPACITY (16) cdb not supported\n");
         } else if (SG_LIB_CAT_ILLEGAL_REQ == res)
@@ -1105,7 +1226,7 @@ gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
         else if (res) {
             sg_get_category_sense_str(res, sizeof(b), b, op->vb);
             pr2serr("READ CAPACITY (16) failed: %s\n", b);
-        } else
+        } else if (sg_fd >= 0)
             block_size = sg_get_unaligned_be32(rzBuff + 8);
 
         if (st.wp_blk_num) {
@@ -1153,6 +1274,635 @@ gather_statistics(int sg_fd, uint8_t * rzBuff, const char * cmd_name,
     return res;
 }
 
+/* The zone map (cache) file written and read by --cache=CFN is a 64 byte
+ * header followed by one 32 byte record per zone, in ascending zone start
+ * LBA order. All integers are little endian. It is laid out to be mmap()-ed
+ * and indexed directly.
+ *   header: 0: magic "SGZONMAP", 8: version, 12: record length (32),
+ *           16: number of zones, 24: maximum LBA, 32: reported zone start
+ *           LBA granularity, 40: SAME, 44: logical block size (0 if not
+ *           known), 48: time of last scan or refresh (seconds since epoch)
+ *   record: 0: zone start LBA, 8: zone length, 16: write pointer LBA,
+ *           24: zone type, 25: zone condition, 26: PUEP, NON_SEQ and RESET
+ *           bits as in byte 1 of a zone descriptor */
+static const char * zmap_magic = "SGZONMAP";
+
+struct zmap_t {
+    uint64_t num_zones;
+    uint8_t * hdrp;             /* ZMAP_HDR_LEN bytes */
+    uint8_t * recsp;            /* num_zones * ZMAP_REC_LEN bytes */
+    void * map_p;               /* non-NULL when file mmap()-ed */
+    size_t map_len;
+    uint8_t * free_p;           /* non-NULL when file copied to heap */
+};
+
+/* One range of the LBA space given to a scanning thread. Zones whose start
+ * LBA is in [lo_lba, hi_lba) are placed in recsp (heap). */
+struct zscan_job_t {
+    uint64_t lo_lba;
+    uint64_t hi_lba;
+    uint64_t first_zn;          /* --refresh: index of zone at lo_lba */
+    uint64_t num_hint;          /* number of zones expected, 0: unknown */
+    uint64_t num;
+    uint64_t max_num;
+    uint8_t * recsp;
+    int res;
+};
+
+struct zscan_t {
+    int sg_fd;
+    int maxlen;
+    int vb;
+    int num_jobs;
+    int next_job;               /* protected by 'mutex' */
+    pthread_mutex_t mutex;
+    struct zscan_job_t * jobs;
+};
+
+static void
+zmap_free(struct zmap_t * zmp)
+{
+#ifdef HAVE_MMAP
+    if (zmp->map_p)
+        munmap(zmp->map_p, zmp->map_len);
+#endif
+    free(zmp->free_p);
+    memset(zmp, 0, sizeof(*zmp));
+}
+
+/* Reads zone map file 'fn' into *zmp, mapping it read-only when possible
+ * unless 'writable' is true, in which case it is copied to the heap.
+ * Returns 0 on success. */
+static int
+zmap_load(const char * fn, bool writable, struct zmap_t * zmp, int vb)
+{
+    int fd, res, n;
+    int ret = 0;
+    uint64_t num;
+    size_t len, k;
+    uint8_t * bp = NULL;
+    struct stat a_stat;
+
+    memset(zmp, 0, sizeof(*zmp));
+    fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        ret = errno;
+        pr2serr("unable to open zone map %s: %s\n", fn, safe_strerror(ret));
+        return sg_convert_errno(ret);
+    }
+    if ((fstat(fd, &a_stat) < 0) || (a_stat.st_size < ZMAP_HDR_LEN)) {
+        pr2serr("zone map %s is too short\n", fn);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    len = (size_t)a_stat.st_size;
+#ifdef HAVE_MMAP
+    if (! writable) {
+        void * vp = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED != vp) {
+            zmp->map_p = vp;
+            zmp->map_len = len;
+            bp = (uint8_t *)vp;
+        } else if (vb > 2)
+            pr2serr("mmap() of %s failed, read instead\n", fn);
+    }
+#endif
+    if (NULL == bp) {
+        zmp->free_p = (uint8_t *)malloc(len);
+        if (NULL == zmp->free_p) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        bp = zmp->free_p;
+        for (k = 0; k < len; k += n) {
+            n = ((len - k) > INT_MAX) ? INT_MAX : (int)(len - k);
+            res = read(fd, bp + k, n);
+            if (res <= 0) {
+                pr2serr("unable to read zone map %s\n", fn);
+                ret = SG_LIB_FILE_ERROR;
+                goto fini;
+            }
+            n = res;
+        }
+    }
+    num = sg_get_unaligned_le64(bp + 16);
+    if (memcmp(bp, zmap_magic, 8) || (ZMAP_VERSION !=
+                                      sg_get_unaligned_le32(bp + 8)) ||
+        (ZMAP_REC_LEN != sg_get_unaligned_le32(bp + 12)) ||
+        (num > ((len - ZMAP_HDR_LEN) / ZMAP_REC_LEN))) {
+        pr2serr("%s is not a zone map of this version or is truncated\n",
+                fn);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    zmp->num_zones = num;
+    zmp->hdrp = bp;
+    zmp->recsp = bp + ZMAP_HDR_LEN;
+    if (vb > 1)
+        pr2serr("zone map %s: %" PRIu64 " zones%s\n", fn, num,
+                zmp->map_p ? ", mmap()-ed" : "");
+fini:
+    close(fd);
+    if (ret)
+        zmap_free(zmp);
+    return ret;
+}
+
+/* Writes the zone map to a temporary file then renames it to 'fn' so
+ * readers never see a partial map. Returns 0 on success. */
+static int
+zmap_save(const char * fn, const struct zmap_t * zmp)
+{
+    int fd, res, n;
+    int ret = 0;
+    size_t k, len;
+    const uint8_t * bp;
+    char * b;
+
+    len = strlen(fn) + 8;
+    b = (char *)malloc(len);
+    if (NULL == b)
+        return sg_convert_errno(ENOMEM);
+    snprintf(b, len, "%s.tmp", fn);
+    fd = open(b, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ret = errno;
+        pr2serr("unable to create %s: %s\n", b, safe_strerror(ret));
+        free(b);
+        return sg_convert_errno(ret);
+    }
+    for (n = 0; (n < 2) && (0 == ret); ++n) {
+        bp = n ? zmp->recsp : zmp->hdrp;
+        len = n ? (size_t)zmp->num_zones * ZMAP_REC_LEN : ZMAP_HDR_LEN;
+        for (k = 0; k < len; k += res) {
+            res = write(fd, bp + k, ((len - k) > INT_MAX) ? INT_MAX :
+                                                            (int)(len - k));
+            if (res <= 0) {
+                /* write() returning 0 leaves errno unset */
+                ret = ((res < 0) && errno) ? errno : EIO;
+                break;
+            }
+        }
+    }
+    if (close(fd) < 0 && (0 == ret))
+        ret = errno;
+    if ((0 == ret) && (rename(b, fn) < 0))
+        ret = errno;
+    if (ret) {
+        pr2serr("unable to write zone map %s: %s\n", fn, safe_strerror(ret));
+        unlink(b);
+    }
+    free(b);
+    return ret ? sg_convert_errno(ret) : 0;
+}
+
+static void
+zmap_put_rec(const uint8_t * zdp, uint8_t * rp)
+{
+    memset(rp, 0, ZMAP_REC_LEN);
+    sg_put_unaligned_le64(sg_get_unaligned_be64(zdp + 16), rp + 0);
+    sg_put_unaligned_le64(sg_get_unaligned_be64(zdp + 8), rp + 8);
+    sg_put_unaligned_le64(sg_get_unaligned_be64(zdp + 24), rp + 16);
+    rp[24] = zdp[0] & 0xf;
+    rp[25] = (zdp[1] >> 4) & 0xf;
+    rp[26] = zdp[1] & 0x7;
+}
+
+/* Does a REPORT ZONES (reporting option 0) reply include the zone in
+ * record 'rp' for reporting option 'ro'? */
+static bool
+zmap_rep_opt_match(const uint8_t * rp, int ro)
+{
+    int zc = rp[25];
+
+    switch (ro) {
+    case 0x0:
+        return true;
+    case 0x1: case 0x2: case 0x3: case 0x4:
+        return ro == zc;
+    case 0x5:
+        return 0xe == zc;       /* FULL */
+    case 0x6:
+        return 0xd == zc;       /* READ ONLY */
+    case 0x7:
+        return 0xf == zc;       /* OFFLINE */
+    case 0x8:
+        return 0x5 == zc;       /* INACTIVE */
+    case 0x10:
+        return !! (rp[26] & 0x1);       /* RESET (RWP recommended) */
+    case 0x11:
+        return !! (rp[26] & 0x2);       /* NON_SEQ */
+    case 0x3e:
+        return 0x5 != rp[24];   /* not GAP zone type */
+    case 0x3f:
+        return 0x0 == zc;       /* NOT WRITE POINTER */
+    default:
+        return false;
+    }
+}
+
+/* Forms a REPORT ZONES response from the zone map as a device would to a
+ * command with the ZONE START LBA, REPORTING OPTIONS, PARTIAL and
+ * ALLOCATION LENGTH taken from 'op'. An 'alloc_len' of 0 means as long as
+ * needed. Returns a heap buffer (placing its length, which is no more than
+ * a non-zero 'alloc_len', in *lenp) or NULL with *resp set. */
+static uint8_t *
+zmap_to_resp(const struct zmap_t * zmp, const struct opts_t * op,
+             int alloc_len, int * lenp, int * resp)
+{
+    int pos, buf_len;
+    uint64_t lo, hi, mid, k, num_match, full_len;
+    const uint8_t * rp;
+    uint8_t * bp;
+
+    *resp = 0;
+    if ((0 == zmp->num_zones) ||
+        (op->st_lba > sg_get_unaligned_le64(zmp->hdrp + 24))) {
+        pr2serr("Report zones: start LBA 0x%" PRIx64 " beyond the zone "
+                "map\n", op->st_lba);
+        *resp = SG_LIB_LBA_OUT_OF_RANGE;
+        return NULL;
+    }
+    /* find last zone starting at or before st_lba */
+    for (lo = 0, hi = zmp->num_zones; (hi - lo) > 1; ) {
+        mid = lo + (hi - lo) / 2;
+        if (sg_get_unaligned_le64(zmp->recsp + mid * ZMAP_REC_LEN) <=
+            op->st_lba)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    for (num_match = 0, k = lo; k < zmp->num_zones; ++k) {
+        if (zmap_rep_opt_match(zmp->recsp + k * ZMAP_REC_LEN,
+                               op->reporting_opt))
+            ++num_match;
+    }
+    full_len = 64 + num_match * 64;
+    if ((full_len > UINT32_MAX) ||
+        ((0 == alloc_len) && (full_len > INT_MAX))) {
+        pr2serr("zone map too large for a REPORT ZONES response\n");
+        *resp = SG_LIB_CAT_OTHER;
+        return NULL;
+    }
+    if ((0 == alloc_len) || ((uint64_t)alloc_len > full_len))
+        alloc_len = (int)full_len;
+    /* the 64 byte header is always built, then cut to alloc_len */
+    buf_len = (alloc_len < 64) ? 64 : alloc_len;
+    bp = (uint8_t *)calloc(1, buf_len);
+    if (NULL == bp) {
+        *resp = sg_convert_errno(ENOMEM);
+        return NULL;
+    }
+    for (pos = 64, k = lo; (k < zmp->num_zones) && ((pos + 64) <= buf_len);
+         ++k) {
+        rp = zmp->recsp + k * ZMAP_REC_LEN;
+        if (! zmap_rep_opt_match(rp, op->reporting_opt))
+            continue;
+        bp[pos + 0] = rp[24];
+        bp[pos + 1] = (rp[25] << 4) | rp[26];
+        sg_put_unaligned_be64(sg_get_unaligned_le64(rp + 8), bp + pos + 8);
+        sg_put_unaligned_be64(sg_get_unaligned_le64(rp + 0), bp + pos + 16);
+        sg_put_unaligned_be64(sg_get_unaligned_le64(rp + 16), bp + pos + 24);
+        pos += 64;
+    }
+    sg_put_unaligned_be32(op->do_partial ? (uint32_t)(pos - 64) :
+                                           (uint32_t)(num_match * 64), bp);
+    bp[4] = zmp->hdrp[40] & 0xf;
+    sg_put_unaligned_be64(sg_get_unaligned_le64(zmp->hdrp + 24), bp + 8);
+    sg_put_unaligned_be64(sg_get_unaligned_le64(zmp->hdrp + 32), bp + 16);
+    *lenp = (pos < alloc_len) ? pos : alloc_len;
+    return bp;
+}
+
+/* Scans one job's range with as many REPORT ZONES commands as needed */
+static void
+zscan_job(struct zscan_t * zsp, struct zscan_job_t * jp, uint8_t * rzBuff)
+{
+    int k, resid, rlen, num_zd, alloc_len;
+    uint64_t zs_lba, z_len, mx_lba;
+    uint64_t slba = jp->lo_lba;
+    const uint8_t * bp;
+    uint8_t * rp;
+
+    while (slba < jp->hi_lba) {
+        alloc_len = zsp->maxlen;
+        if (jp->num_hint && ((64 + 64 * (jp->num_hint - jp->num)) <
+                             (uint64_t)alloc_len))
+            alloc_len = 64 + 64 * (jp->num_hint - jp->num);
+        resid = 0;
+        jp->res = sg_ll_report_zzz(zsp->sg_fd, REPORT_ZONES_SA, slba,
+                                   true /* set partial */, 0, rzBuff,
+                                   alloc_len, &resid, true, zsp->vb);
+        if (jp->res && zsp->vb)
+            pr2serr("%s: REPORT ZONES at LBA 0x%" PRIx64 " failed\n",
+                    __func__, slba);
+        if (jp->res)
+            return;
+        rlen = alloc_len - resid;
+        if (rlen <= 64)
+            return;
+        mx_lba = sg_get_unaligned_be64(rzBuff + 8);
+        num_zd = (rlen - 64) / REPORT_ZONES_DESC_LEN;
+        for (k = 0, bp = rzBuff + 64; k < num_zd;
+             ++k, bp += REPORT_ZONES_DESC_LEN) {
+            zs_lba = sg_get_unaligned_be64(bp + 16);
+            z_len = sg_get_unaligned_be64(bp + 8);
+            if (zs_lba >= jp->hi_lba)
+                return;
+            if ((0 == z_len) || ((zs_lba + z_len) <= slba)) {
+                pr2serr("%s: bad zone descriptor at LBA 0x%" PRIx64 "\n",
+                        __func__, zs_lba);
+                jp->res = SG_LIB_CAT_MALFORMED;
+                return;
+            }
+            slba = zs_lba + z_len;
+            if (zs_lba < jp->lo_lba)
+                continue;       /* belongs to the previous range */
+            if (jp->num >= jp->max_num) {
+                uint64_t n = jp->max_num ? 2 * jp->max_num : 256;
+
+                rp = (uint8_t *)realloc(jp->recsp, n * ZMAP_REC_LEN);
+                if (NULL == rp) {
+                    jp->res = sg_convert_errno(ENOMEM);
+                    return;
+                }
+                jp->recsp = rp;
+                jp->max_num = n;
+            }
+            zmap_put_rec(bp, jp->recsp + jp->num * ZMAP_REC_LEN);
+            ++jp->num;
+        }
+        if (slba > mx_lba)
+            return;
+    }
+}
+
+static void *
+zscan_thread(void * v_zsp)
+{
+    int j;
+    uint8_t * rzBuff;
+    uint8_t * free_rzbp = NULL;
+    struct zscan_t * zsp = (struct zscan_t *)v_zsp;
+
+    rzBuff = (uint8_t *)sg_memalign(zsp->maxlen, 0, &free_rzbp, false);
+    while (1) {
+        pthread_mutex_lock(&zsp->mutex);
+        j = zsp->next_job++;
+        pthread_mutex_unlock(&zsp->mutex);
+        if (j >= zsp->num_jobs)
+            break;
+        if (rzBuff)
+            zscan_job(zsp, zsp->jobs + j, rzBuff);
+        else
+            zsp->jobs[j].res = sg_convert_errno(ENOMEM);
+    }
+    free(free_rzbp);
+    return NULL;
+}
+
+/* Runs the jobs in zsp on up to 'num_threads' threads (the calling thread
+ * when 1). Returns 0 if they all succeed, else the first error. */
+static int
+zscan_run(struct zscan_t * zsp, int num_threads)
+{
+    int k, n;
+    pthread_t tids[MAX_SCAN_THREADS];
+
+    zsp->next_job = 0;
+    if (num_threads > zsp->num_jobs)
+        num_threads = zsp->num_jobs;
+    if (num_threads <= 1)
+        zscan_thread(zsp);
+    else {
+        pthread_mutex_init(&zsp->mutex, NULL);
+        for (n = 0; n < num_threads; ++n) {
+            if (pthread_create(tids + n, NULL, zscan_thread, zsp))
+                break;
+        }
+        if (0 == n)
+            zscan_thread(zsp);  /* could not start any, so do it here */
+        for (k = 0; k < n; ++k)
+            pthread_join(tids[k], NULL);
+        pthread_mutex_destroy(&zsp->mutex);
+    }
+    for (k = 0; k < zsp->num_jobs; ++k) {
+        if (zsp->jobs[k].res)
+            return zsp->jobs[k].res;
+    }
+    return 0;
+}
+
+static void
+zscan_free(struct zscan_t * zsp)
+{
+    int k;
+
+    for (k = 0; k < zsp->num_jobs; ++k)
+        free(zsp->jobs[k].recsp);
+    free(zsp->jobs);
+    zsp->jobs = NULL;
+    zsp->num_jobs = 0;
+}
+
+/* Scans all zones of the device, splitting the LBA space into ranges that
+ * are reported concurrently by op->scan_threads threads. The results are
+ * concatenated, in LBA order, into a new zone map in *zmp. Returns 0 on
+ * success. Threads are used rather than do_scsi_pt_submit() and friends
+ * because each range is a chain of REPORT ZONES commands, each starting
+ * where the previous response ended; a thread keeps that a simple loop.
+ * Also outside Linux the async calls are emulated and complete at submit
+ * time, so they would not overlap commands there. */
+static int
+zmap_scan(int sg_fd, struct opts_t * op, struct zmap_t * zmp)
+{
+    int k, res, resid, num_jobs;
+    uint32_t lbs = 0;
+    uint64_t mx_lba, num, span;
+    uint8_t * bp;
+    uint8_t hdr[64 + REPORT_ZONES_DESC_LEN] SG_C_CPP_ZERO_INIT;
+    uint8_t rc16[RCAP16_REPLY_LEN];
+    struct zscan_t zs SG_C_CPP_ZERO_INIT;
+
+    memset(zmp, 0, sizeof(*zmp));
+    /* one zone descriptor: for the header and a count of all zones */
+    res = sg_ll_report_zzz(sg_fd, REPORT_ZONES_SA, 0, false, 0, hdr,
+                           sizeof(hdr), &resid, true, op->vb);
+    if (res)
+        return res;
+    if (((int)sizeof(hdr) - resid) < 64) {
+        pr2serr("REPORT ZONES response too short\n");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    mx_lba = sg_get_unaligned_be64(hdr + 8);
+    if (0 == sg_ll_readcap_16(sg_fd, false, 0, rc16, sizeof(rc16), false,
+                              op->vb))
+        lbs = sg_get_unaligned_be32(rc16 + 8);
+
+    num_jobs = op->scan_threads * 4;    /* smaller pieces balance better */
+    span = mx_lba / num_jobs + 1;
+    zs.jobs = (struct zscan_job_t *)calloc(num_jobs, sizeof(*zs.jobs));
+    if (NULL == zs.jobs)
+        return sg_convert_errno(ENOMEM);
+    zs.num_jobs = num_jobs;
+    zs.sg_fd = sg_fd;
+    zs.maxlen = (op->maxlen < ZSCAN_MIN_LEN) ? ZSCAN_MIN_LEN : op->maxlen;
+    zs.vb = op->vb;
+    for (k = 0; k < num_jobs; ++k) {
+        zs.jobs[k].lo_lba = k * span;
+        zs.jobs[k].hi_lba = (k == (num_jobs - 1)) ? UINT64_MAX :
+                                                    (k + 1) * span;
+        if (zs.jobs[k].lo_lba > mx_lba)         /* few LBAs, many jobs */
+            zs.jobs[k].lo_lba = zs.jobs[k].hi_lba = 0;
+    }
+    res = zscan_run(&zs, op->scan_threads);
+    if (res)
+        goto fini;
+
+    for (num = 0, k = 0; k < num_jobs; ++k)
+        num += zs.jobs[k].num;
+    if ((sg_get_unaligned_be32(hdr + 0) / 64) != num) {
+        /* an incomplete map must not replace a good cached one */
+        pr2serr("device reports %u zones but %" PRIu64 " were found\n",
+                sg_get_unaligned_be32(hdr + 0) / 64, num);
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    zmp->free_p = (uint8_t *)calloc(1, ZMAP_HDR_LEN + num * ZMAP_REC_LEN);
+    if (NULL == zmp->free_p) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    zmp->hdrp = zmp->free_p;
+    zmp->recsp = zmp->free_p + ZMAP_HDR_LEN;
+    zmp->num_zones = num;
+    for (bp = zmp->recsp, k = 0; k < num_jobs; ++k) {
+        if (zs.jobs[k].num) {
+            memcpy(bp, zs.jobs[k].recsp, zs.jobs[k].num * ZMAP_REC_LEN);
+            bp += zs.jobs[k].num * ZMAP_REC_LEN;
+        }
+    }
+    memcpy(zmp->hdrp, zmap_magic, 8);
+    sg_put_unaligned_le32(ZMAP_VERSION, zmp->hdrp + 8);
+    sg_put_unaligned_le32(ZMAP_REC_LEN, zmp->hdrp + 12);
+    sg_put_unaligned_le64(num, zmp->hdrp + 16);
+    sg_put_unaligned_le64(mx_lba, zmp->hdrp + 24);
+    sg_put_unaligned_le64(sg_get_unaligned_be64(hdr + 16), zmp->hdrp + 32);
+    zmp->hdrp[40] = hdr[4] & 0xf;
+    sg_put_unaligned_le32(lbs, zmp->hdrp + 44);
+    sg_put_unaligned_le64((uint64_t)time(NULL), zmp->hdrp + 48);
+fini:
+    zscan_free(&zs);
+    if (res)
+        zmap_free(zmp);
+    return res;
+}
+
+/* Rereads the zones in the zone map that are not FULL (nor conventional,
+ * whose condition never changes), in runs of adjacent zones that are
+ * reported concurrently. Returns 0 on success, including when the zone
+ * layout is unchanged; a changed layout needs a full rescan. */
+static int
+zmap_refresh(int sg_fd, struct opts_t * op, struct zmap_t * zmp)
+{
+    bool in_run;
+    int k, res;
+    uint64_t j, n, last, skipped;
+    const uint8_t * rp;
+    struct zscan_job_t * jp = NULL;
+    struct zscan_t zs SG_C_CPP_ZERO_INIT;
+
+    zs.sg_fd = sg_fd;
+    zs.maxlen = (op->maxlen < ZSCAN_MIN_LEN) ? ZSCAN_MIN_LEN : op->maxlen;
+    zs.vb = op->vb;
+    for (n = 0; n < 2; ++n) {   /* first pass counts runs, second forms */
+        k = 0;
+        in_run = false;
+        skipped = 0;
+        for (j = 0; j < zmp->num_zones; ++j) {
+            rp = zmp->recsp + j * ZMAP_REC_LEN;
+            if ((0xe == rp[25]) || (0x0 == rp[25])) {
+                ++skipped;      /* FULL or NOT WRITE POINTER */
+                continue;
+            }
+            if ((! in_run) || (skipped > REFRESH_GAP)) {
+                in_run = true;
+                jp = n ? (zs.jobs + k) : NULL;
+                ++k;
+                if (jp) {
+                    jp->lo_lba = sg_get_unaligned_le64(rp + 0);
+                    jp->first_zn = j;
+                }
+            }
+            if (jp) {
+                jp->hi_lba = sg_get_unaligned_le64(rp + 0) +
+                             sg_get_unaligned_le64(rp + 8);
+                jp->num_hint = j + 1 - jp->first_zn;
+            }
+            skipped = 0;
+        }
+        if (0 == n) {
+            if (0 == k)
+                return 0;       /* nothing to reread */
+            zs.jobs = (struct zscan_job_t *)calloc(k, sizeof(*zs.jobs));
+            if (NULL == zs.jobs)
+                return sg_convert_errno(ENOMEM);
+            zs.num_jobs = k;
+        }
+    }
+    if (op->vb)
+        pr2serr("refresh: %d runs of zones to reread\n", zs.num_jobs);
+    res = zscan_run(&zs, op->scan_threads);
+    for (k = 0; (0 == res) && (k < zs.num_jobs); ++k) {
+        jp = zs.jobs + k;
+        last = jp->first_zn + jp->num_hint;
+        if (jp->num != jp->num_hint)
+            res = SG_LIB_CAT_OTHER;
+        for (j = jp->first_zn; (0 == res) && (j < last); ++j) {
+            if (memcmp(zmp->recsp + j * ZMAP_REC_LEN,
+                       jp->recsp + (j - jp->first_zn) * ZMAP_REC_LEN, 16))
+                res = SG_LIB_CAT_OTHER; /* start LBA or length changed */
+        }
+        if (res)
+            pr2serr("zone layout differs from zone map near LBA 0x%" PRIx64
+                    ", rescan without --refresh\n", jp->lo_lba);
+        else
+            memcpy(zmp->recsp + jp->first_zn * ZMAP_REC_LEN, jp->recsp,
+                   jp->num * ZMAP_REC_LEN);
+    }
+    if (0 == res)
+        sg_put_unaligned_le64((uint64_t)time(NULL), zmp->hdrp + 48);
+    zscan_free(&zs);
+    return res;
+}
+
+/* With a DEVICE (sg_fd >= 0) either scans all zones or refreshes the zone
+ * map in op->cache_fn, then writes it back to that file. Without a DEVICE
+ * the zone map is loaded from that file. Returns 0 on success. */
+static int
+zmap_obtain(int sg_fd, struct opts_t * op, struct zmap_t * zmp)
+{
+    int res;
+
+    if (sg_fd < 0)
+        return zmap_load(op->cache_fn, false, zmp, op->vb);
+    if (op->do_refresh) {
+        res = zmap_load(op->cache_fn, true, zmp, op->vb);
+        if (0 == res)
+            res = zmap_refresh(sg_fd, op, zmp);
+    } else
+        res = zmap_scan(sg_fd, op, zmp);
+    if (0 == res)
+        res = zmap_save(op->cache_fn, zmp);
+    if (res)
+        zmap_free(zmp);
+    else if (op->vb)
+        pr2serr("zone map with %" PRIu64 " zones written to %s\n",
+                zmp->num_zones, op->cache_fn);
+    return res;
+}
+
 /* Handles short options after '-j' including a sequence of short options
  * that include one 'j' (for JSON). Want optional argument to '-j' to be
  * prefixed by '='. Return 0 for good, SG_LIB_SYNTAX_ERROR for syntax error
@@ -1197,6 +1947,9 @@ chk_short_opts(const char sopt_ch, struct opts_t * op)
     case 'S':
         op->statistics = true;
         break;
+    case 'u':
+        op->do_refresh = true;
+        break;
     case 'v':
         op->verbose_given = true;
         ++op->vb;
@@ -1220,6 +1973,8 @@ main(int argc, char * argv[])
 {
     bool no_final_msg = false;
     bool as_json = false;
+    bool strm_ok = false;
+    FILE * js_fp = NULL;
     int res, c, act_len, rlen, in_len, off;
     int sg_fd = -1;
     int resid = 0;
@@ -1229,6 +1984,9 @@ main(int argc, char * argv[])
     const char * device_name = NULL;
     uint8_t * rzBuff = NULL;
     uint8_t * free_rzbp = NULL;
+    uint8_t * zrp;
+    struct sg_hex_strm * hsp = NULL;
+    struct zmap_t zm;
     const char * cmd_name = "Report zones";
     sgj_state * jsp;
     sgj_opaque_p jop = NULL;
@@ -1242,7 +2000,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "^bdefF:hHi:j::J:l:m:n:o:prRs:SvVw",
+        c = getopt_long(argc, argv, "^bc:defF:hHi:j::J:l:m:n:o:prRs:St:uvVw",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -1251,6 +2009,9 @@ main(int argc, char * argv[])
         case 'b':
             op->do_brief = true;
             break;
+        case 'c':
+            op->cache_fn = optarg;
+            break;
         case 'd':
             op->do_zdomains = true;
             op->serv_act = REPORT_ZONE_DOMAINS_SA;
@@ -1376,6 +2137,20 @@ main(int argc, char * argv[])
         case 'S':
             op->statistics = true;
             break;
+        case 't':
+            op->scan_threads = sg_get_num(optarg);
+            if ((op->scan_threads < 0) ||
+                (op->scan_threads > MAX_SCAN_THREADS)) {
+                pr2serr("argument to '--threads' should be from 0 to %d\n",
+                        MAX_SCAN_THREADS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (0 == op->scan_threads)
+                op->scan_threads = 1;   /* scan in this thread */
+            break;
+        case 'u':
+            op->do_refresh = true;
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->vb;
@@ -1461,6 +2236,25 @@ main(int argc, char * argv[])
         pr2serr("Can only use --partial with REPORT ZONES\n");
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (op->cache_fn) {
+        if (op->in_fn) {
+            pr2serr("Can't have both --cache=CFN and --inhex=FN\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->serv_act != REPORT_ZONES_SA) {
+            pr2serr("Can only use --cache=CFN with REPORT ZONES\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->do_refresh && (NULL == device_name)) {
+            pr2serr("--refresh needs a DEVICE to reread zones from\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (0 == op->scan_threads)
+            op->scan_threads = DEF_SCAN_THREADS;
+    } else if (op->do_refresh) {
+        pr2serr("--refresh only applies to the zone map of --cache=CFN\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
     if (device_name && op->in_fn) {
         pr2serr("ignoring DEVICE, best to give DEVICE or --inhex=FN, but "
                 "not both\n");
@@ -1476,14 +2270,24 @@ main(int argc, char * argv[])
 
     if (NULL == device_name) {
         if (op->in_fn) {
-            if ((ret = sg_f2hex_arr(op->in_fn, op->do_raw, false, rzBuff,
-                                    &in_len, op->maxlen))) {
-                if (SG_LIB_LBA_OUT_OF_RANGE == ret) {
-                    no_final_msg = true;
-                    pr2serr("... decode what we have, --maxlen=%d needs to "
-                            "be increased\n", op->maxlen);
-                } else
-                    goto the_end;
+            /* REPORT ZONES descriptors can be decoded as FN is read */
+            strm_ok = (REPORT_ZONES_SA == op->serv_act) &&
+                      (! op->find_zt) && (! op->statistics) &&
+                      (! op->do_brief) &&
+                      ((0 == op->do_hex) || (2 == op->do_hex)) &&
+                      (op->maxlen >= (64 + REPORT_ZONES_DESC_LEN));
+            if ((ret = sg_hex_strm_open(op->in_fn, op->do_raw, false, false,
+                                        &hsp)))
+                goto the_end;
+            if ((ret = sg_hex_strm_read(hsp, rzBuff, op->maxlen, &in_len)))
+                goto the_end;
+            if ((! strm_ok) && (in_len == op->maxlen) &&
+                (0 == sg_hex_strm_read(hsp, (uint8_t *)b, 1, &off)) &&
+                (off > 0)) {
+                ret = SG_LIB_LBA_OUT_OF_RANGE;
+                no_final_msg = true;
+                pr2serr("... decode what we have, --maxlen=%d needs to "
+                        "be increased\n", op->maxlen);
             }
             if (op->vb > 2)
                 pr2serr("Read %d [0x%x] bytes of user supplied data\n",
@@ -1507,7 +2311,9 @@ main(int argc, char * argv[])
                 goto the_end;
             }
             goto start_response;
-        } else {
+        } else if (op->cache_fn)
+            goto from_cache;
+        else {
             pr2serr("missing device name!\n\n");
             usage(1);
             ret = SG_LIB_FILE_ERROR;
@@ -1533,6 +2339,38 @@ main(int argc, char * argv[])
         goto the_end;
     }
 
+    if (op->cache_fn) {
+from_cache:
+        /* scan (or refresh) the DEVICE or load the map, then answer from
+         * a REPORT ZONES response formed from that map */
+        if ((ret = zmap_obtain(sg_fd, op, &zm)))
+            goto the_end;
+        op->cache_lbs = sg_get_unaligned_le32(zm.hdrp + 44);
+        if (op->find_zt || op->statistics)
+            act_len = 0;        /* whole map from --start=LBA */
+        else if (op->do_num && (! op->maxlen_given) &&
+                 (op->do_num < (MAX_RZONES_BUFF_LEN / 64)))
+            act_len = 64 + op->do_num * REPORT_ZONES_DESC_LEN;
+        else
+            act_len = op->maxlen;
+        zrp = zmap_to_resp(&zm, op, act_len, &in_len, &ret);
+        zmap_free(&zm);
+        if (NULL == zrp)
+            goto the_end;
+        free(free_rzbp);
+        free_rzbp = zrp;
+        rzBuff = zrp;
+        op->maxlen = in_len;
+        res = 0;
+        if (op->find_zt) {
+            ret = find_report_zones(-1, rzBuff, cmd_name, op, jop);
+            goto the_end;
+        } else if (op->statistics) {
+            ret = gather_statistics(-1, rzBuff, cmd_name, op);
+            goto the_end;
+        }
+        goto start_response;
+    }
     if (op->find_zt) {  /* so '-F none' will drop through */
         ret = find_report_zones(sg_fd, rzBuff, cmd_name, op, jop);
         goto the_end;
@@ -1546,7 +2384,7 @@ main(int argc, char * argv[])
     ret = res;
 start_response:
     if (0 == res) {
-        rlen = op->in_fn ? in_len : (op->maxlen - resid);
+        rlen = (op->in_fn || op->cache_fn) ? in_len : (op->maxlen - resid);
         if (rlen < 4) {
             pr2serr("Decoded response length (%d) too short\n", rlen);
             ret = SG_LIB_CAT_MALFORMED;
@@ -1561,6 +2399,16 @@ start_response:
                 goto the_end;
             }
         }
+        if (hsp && strm_ok && (rlen == op->maxlen) &&
+            (decod_len > (uint32_t)rlen)) {
+            if (! op->wp_only && (! op->do_hex))
+                sgj_pr_hr(jsp, "%s response:\n", cmd_name);
+            if ((! op->do_hex) && (! op->do_brief))
+                js_fp = sgj_stream_start_file(jsp, op->js_file);
+            ret = decode_rep_zones_strm(hsp, rzBuff, rlen, decod_len, op,
+                                        jop);
+            goto the_end;
+        }
         if (decod_len > (uint32_t)rlen) {
             if ((REPORT_ZONES_SA == op->serv_act) && (! op->do_partial)) {
                 pr2serr("%u zones starting from LBA 0x%" PRIx64 " available "
@@ -1599,8 +2447,12 @@ start_response:
             ret = SG_LIB_CAT_MALFORMED;
             goto the_end;
         }
-        if (REPORT_ZONES_SA == op->serv_act)
+        if (REPORT_ZONES_SA == op->serv_act) {
+            /* write out (and free) zone descriptors as they are decoded */
+            if ((! op->do_hex) && (! op->do_brief))
+                js_fp = sgj_stream_start_file(jsp, op->js_file);
             ret = decode_rep_zones(rzBuff, act_len, decod_len, op, jop);
+        }
         else if (op->do_realms)
             ret = decode_rep_realms(rzBuff, act_len, op, jop);
         else if (op->do_zdomains)
@@ -1613,6 +2465,7 @@ start_response:
     }
 
 the_end:
+    sg_hex_strm_close(hsp);
     if (free_rzbp)
         free(free_rzbp);
     if (sg_fd >= 0) {
@@ -1632,7 +2485,9 @@ the_end:
     if (as_json) {
         FILE * fp = stdout;
 
-        if (op->js_file) {
+        if (js_fp)
+            fp = js_fp;         /* already streaming to it */
+        else if (op->js_file) {
             if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
                 fp = fopen(op->js_file, "w");   /* truncate if exists */
                 if (NULL == fp) {
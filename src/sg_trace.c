@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
+#include "sg_json_sg_lib.h"
+#include "sg_pr2serr.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program decodes, summarizes and replays the binary command traces
+ * written by the sg3_utils library when the SG3_UTILS_PT_TRACE environment
+ * variable is set (or sg_pt_trace_start() is called).
+ */
+
+static const char * version_str = "1.00 20261016";
+
+#define MY_NAME "sg_trace"
+
+#define SENSE_BUFF_LEN 252
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+
+
+static const struct option long_options[] = {
+    {"help", no_argument, 0, 'h'},
+    {"json", optional_argument, 0, '^'},
+    {"num", required_argument, 0, 'n'},
+    {"replay", required_argument, 0, 'r'},
+    {"summary", no_argument, 0, 's'},
+    {"timing", no_argument, 0, 't'},
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {"write", no_argument, 0, 'w'},
+    {0, 0, 0, 0},
+};
+
+struct opts_t {
+    bool do_json;
+    bool do_summary;
+    bool do_timing;
+    bool do_write;
+    int num;            /* 0 -> all records */
+    int verbose;
+    const char * json_arg;
+    const char * replay_dev;
+    sgj_state json_st;
+};
+
+
+static void
+usage()
+{
+    pr2serr("Usage: sg_trace [--help] [--json[=JO]] [--num=NUM] "
+            "[--replay=DEV] [--summary]\n"
+            "                [--timing] [--verbose] [--version] [--write] "
+            "TRACE_FILE\n"
+            "  where:\n"
+            "    --help|-h          print out usage message\n"
+            "    --json[=JO]|-j     summary output in JSON instead of plain "
+            "text\n"
+            "    --num=NUM|-n NUM    only process the first NUM records "
+            "(def: 0 -> all)\n"
+            "    --replay=DEV|-r DEV    send the traced commands to DEV\n"
+            "    --summary|-s       per command latency summary instead of "
+            "a listing\n"
+            "    --timing|-t        replay with the traced inter-command "
+            "gaps\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n"
+            "    --write|-w         replay commands with a data-out buffer "
+            "(filled\n"
+            "                       with zeros). Default: skip them\n\n"
+            "Decodes the binary command trace in TRACE_FILE (written when "
+            "the\nSG3_UTILS_PT_TRACE environment variable is set), gives a "
+            "latency summary\nof it or replays it against DEV.\n");
+}
+
+static int
+rec_cmp(const void * a, const void * b)
+{
+    const struct sg_pt_trace_rec * ap = (const struct sg_pt_trace_rec *)a;
+    const struct sg_pt_trace_rec * bp = (const struct sg_pt_trace_rec *)b;
+
+    if (ap->start_ns < bp->start_ns)
+        return -1;
+    return (ap->start_ns > bp->start_ns) ? 1 : 0;
+}
+
+/* Reads and decodes all records in fname into *arrp, sorted by start
+ * time. Returns the number of records or -1 */
+static int
+read_trace(const char * fname, struct sg_pt_trace_rec ** arrp, int vb)
+{
+    int n, off, num, max_num, len;
+    long flen;
+    uint8_t * bp;
+    struct sg_pt_trace_rec * arr = NULL;
+    FILE * fp = fopen(fname, "rb");
+
+    if (NULL == fp) {
+        pr2serr("unable to open %s: %s\n", fname, safe_strerror(errno));
+        return -1;
+    }
+    if ((0 != fseek(fp, 0, SEEK_END)) || ((flen = ftell(fp)) < 0) ||
+        (0 != fseek(fp, 0, SEEK_SET))) {
+        pr2serr("unable to size %s\n", fname);
+        fclose(fp);
+        return -1;
+    }
+    bp = (uint8_t *)malloc(flen + 1);
+    if (NULL == bp) {
+        pr2serr("out of memory\n");
+        fclose(fp);
+        return -1;
+    }
+    len = (int)fread(bp, 1, flen, fp);
+    fclose(fp);
+    off = sg_pt_trace_hdr_check(bp, len);
+    if (off < 0) {
+        pr2serr("%s is not a sg3_utils command trace\n", fname);
+        free(bp);
+        return -1;
+    }
+    /* fixed part of a record is 48 bytes */
+    max_num = (len - off) / 48 + 1;
+    arr = (struct sg_pt_trace_rec *)calloc(max_num, sizeof(*arr));
+    if (NULL == arr) {
+        pr2serr("out of memory\n");
+        free(bp);
+        return -1;
+    }
+    for (num = 0; (off < len) && (num < max_num); ++num, off += n) {
+        n = sg_pt_trace_decode(bp + off, len - off, arr + num);
+        if (n <= 0) {
+            pr2serr("%s record at offset %d, ignore rest of file\n",
+                    (0 == n) ? "truncated" : "malformed", off);
+            break;
+        }
+    }
+    free(bp);
+    if (vb)
+        pr2serr("%d records decoded from %s\n", num, fname);
+    qsort(arr, num, sizeof(*arr), rec_cmp);
+    *arrp = arr;
+    return num;
+}
+
+static const char *
+cat_str(int cat)
+{
+    static const char * const cat_arr[] = {
+        "good", "status", "sense", "transport error", "os error",
+    };
+
+    return ((cat >= 0) && (cat < 5)) ? cat_arr[cat] : "unknown";
+}
+
+static void
+list_rec(int k, const struct sg_pt_trace_rec * rp, uint64_t t0_ns, int vb)
+{
+    char b[512];
+    static const int blen = sizeof(b);
+
+    if (SG_PT_STATS_KIND_SCSI == rp->kind)
+        sg_get_command_str(rp->cmd, rp->cmd_len, true, blen, b);
+    else
+        sg_get_nvme_opcode_name(rp->cmd[0],
+                                SG_PT_STATS_KIND_NVME_ADMIN == rp->kind,
+                                blen, b);
+    printf("%d: thr=%d +%.3f ms dur=%.1f us %s%s\n", k, rp->thr_id,
+           (rp->start_ns - t0_ns) / 1000000.0, rp->dur_ns / 1000.0,
+           (SG_PT_STATS_KIND_SCSI == rp->kind) ? "" : "NVMe ", b);
+    if ((SG_PT_STATS_KIND_SCSI != rp->kind) && (vb > 0)) {
+        hex2str(rp->cmd, rp->cmd_len, "    ", 0, blen, b);
+        printf("%s", b);
+    }
+    if (rp->din_len || rp->dout_len || (SCSI_PT_RESULT_GOOD != rp->category))
+        printf("    din=%u/%u dout=%u/%u %s, status=0x%x, res=%d\n",
+               rp->din_act, rp->din_len, rp->dout_act, rp->dout_len,
+               cat_str(rp->category), rp->status, rp->res);
+    if (rp->sense_len > 0) {
+        sg_get_sense_str("    ", rp->sense, rp->sense_len, vb > 0, blen, b);
+        printf("%s", b);
+    }
+}
+
+static void
+sleep_until(uint64_t when_ns)
+{
+    uint64_t now_ns = sg_pt_stats_now_ns();
+
+    if (when_ns > now_ns) {
+        struct timespec ts;
+        uint64_t d = when_ns - now_ns;
+
+        ts.tv_sec = d / 1000000000;
+        ts.tv_nsec = d % 1000000000;
+        while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+            ;
+    }
+}
+
+/* Sends each traced command to sg_fd. Returns 0 or a SG_LIB_* error */
+static int
+replay(int sg_fd, const struct sg_pt_trace_rec * arr, int num,
+       const struct opts_t * op)
+{
+    bool is_nvme;
+    int k, res, cat;
+    int num_skip = 0;
+    int num_diff = 0;
+    int ret = 0;
+    uint32_t buf_len = 0;
+    uint64_t t0_ns = 0;
+    uint64_t first_ns = num ? arr[0].start_ns : 0;
+    uint8_t * bp = NULL;
+    uint8_t * free_bp = NULL;
+    struct sg_pt_base * ptvp;
+    const struct sg_pt_trace_rec * rp;
+    uint8_t sense_b[SENSE_BUFF_LEN];
+
+    ptvp = scsi_pt_pool_get(sg_fd, op->verbose);
+    if (NULL == ptvp) {
+        pr2serr("out of memory\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    is_nvme = pt_device_is_nvme(ptvp);
+    sg_pt_stats_enable(true);
+    for (k = 0, rp = arr; k < num; ++k, ++rp) {
+        if ((is_nvme && (SG_PT_STATS_KIND_NVME_NVM != rp->kind) &&
+             (SG_PT_STATS_KIND_NVME_ADMIN != rp->kind)) ||
+            ((! is_nvme) && (SG_PT_STATS_KIND_SCSI != rp->kind)) ||
+            ((rp->dout_len > 0) && (! op->do_write)) || (0 == rp->cmd_len)) {
+            ++num_skip;
+            continue;
+        }
+        if ((rp->din_len > buf_len) || (rp->dout_len > buf_len)) {
+            if (free_bp)
+                free(free_bp);
+            buf_len = (rp->din_len > rp->dout_len) ? rp->din_len :
+                                                     rp->dout_len;
+            bp = sg_memalign(buf_len, 0, &free_bp, false);
+            if (NULL == bp) {
+                pr2serr("out of memory\n");
+                ret = sg_convert_errno(ENOMEM);
+                break;
+            }
+        } else if (rp->dout_len > 0)
+            memset(bp, 0, rp->dout_len);
+        if (op->do_timing) {
+            if (0 == t0_ns)
+                t0_ns = sg_pt_stats_now_ns();
+            sleep_until(t0_ns + (rp->start_ns - first_ns));
+        }
+        clear_scsi_pt_obj(ptvp);
+        set_scsi_pt_cdb(ptvp, rp->cmd, rp->cmd_len);
+        set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+        if (rp->din_len > 0)
+            set_scsi_pt_data_in(ptvp, bp, rp->din_len);
+        else if (rp->dout_len > 0)
+            set_scsi_pt_data_out(ptvp, bp, rp->dout_len);
+        if (SG_PT_STATS_KIND_NVME_NVM == rp->kind)
+            res = do_nvm_pt(ptvp, 0, DEF_PT_TIMEOUT, op->verbose);
+        else
+            res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, op->verbose);
+        cat = (0 == res) ? get_scsi_pt_result_category(ptvp) :
+                           SCSI_PT_RESULT_OS_ERR;
+        if (cat != rp->category) {
+            ++num_diff;
+            if (op->verbose)
+                pr2serr("record %d: traced %s, replay %s\n", k,
+                        cat_str(rp->category), cat_str(cat));
+        }
+    }
+    scsi_pt_pool_put(ptvp);
+    if (free_bp)
+        free(free_bp);
+    pr2serr("Replayed %d of %d commands, %d skipped, %d with a different "
+            "outcome\n", num - num_skip, num, num_skip, num_diff);
+    return ret;
+}
+
+int
+main(int argc, char * argv[])
+{
+    bool as_json;
+    int c, k, num, res;
+    int sg_fd = -1;
+    int ret = 0;
+    const char * fname = NULL;
+    struct sg_pt_trace_rec * arr = NULL;
+    struct opts_t opts;
+    struct opts_t * op = &opts;
+    sgj_state * jsp;
+    sgj_opaque_p jop = NULL;
+
+    memset(op, 0, sizeof(opts));
+    if (getenv("SG3_UTILS_INVOCATION"))
+        sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hjn:r:stvVw", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'j':
+        case '^':
+            op->do_json = true;
+            op->json_arg = optarg;
+            break;
+        case 'n':
+            op->num = sg_get_num(optarg);
+            if (op->num < 0) {
+                pr2serr("bad argument to '--num'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            op->replay_dev = optarg;
+            break;
+        case 's':
+            op->do_summary = true;
+            break;
+        case 't':
+            op->do_timing = true;
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        case 'w':
+            op->do_write = true;
+            break;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        fname = argv[optind];
+        ++optind;
+        if (optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (NULL == fname) {
+        pr2serr("Missing TRACE_FILE\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    jsp = &op->json_st;
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            char e[1500];
+
+            pr2serr("bad argument to --json= option, unrecognized "
+                    "character '%c'\n\n", jsp->first_bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+    as_json = jsp->pr_as_json;
+
+    num = read_trace(fname, &arr, op->verbose);
+    if (num < 0) {
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if ((op->num > 0) && (op->num < num))
+        num = op->num;
+
+    if (op->replay_dev) {
+        sg_fd = sg_cmds_open_device(op->replay_dev, ! op->do_write,
+                                    op->verbose);
+        if (sg_fd < 0) {
+            pr2serr("open error: %s: %s\n", op->replay_dev,
+                    safe_strerror(-sg_fd));
+            ret = sg_convert_errno(-sg_fd);
+            goto fini;
+        }
+        ret = replay(sg_fd, arr, num, op);
+        /* latencies seen by the replay */
+        sgj_haj_pt_stats(jsp, jop);
+    } else if (op->do_summary || as_json) {
+        for (k = 0; k < num; ++k)
+            sg_pt_stats_record(arr[k].kind, arr[k].cmd, arr[k].category,
+                               arr[k].dur_ns);
+        sgj_haj_pt_stats(jsp, jop);
+    } else {
+        for (k = 0; k < num; ++k)
+            list_rec(k, arr + k, arr[0].start_ns, op->verbose);
+    }
+
+fini:
+    if (arr)
+        free(arr);
+    if (sg_fd >= 0) {
+        res = sg_cmds_close_device(sg_fd);
+        if (res < 0) {
+            pr2serr("close error: %s\n", safe_strerror(-res));
+            if (0 == ret)
+                ret = sg_convert_errno(-res);
+        }
+    }
+    if (as_json) {
+        sgj_js2file(jsp, NULL, ret, stdout);
+        sgj_finish(jsp);
+    }
+    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+}
@@ -45,7 +45,7 @@
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "3.57 20231015";
+static const char * version_str = "3.58 20261016";
 
 static const char * my_name = "sg_turs: ";
 
@@ -58,6 +58,7 @@ static const struct option long_options[] = {
     {"ascq", required_argument, 0, 'a'},
     {"delay", required_argument, 0, 'd'},
     {"help", no_argument, 0, 'h'},
+    {"hipri", no_argument, 0, 'H'},
     {"low", no_argument, 0, 'l'},   /* use sg_pt, minimize open()s */
     {"new", no_argument, 0, 'N'},
     {"number", required_argument, 0, 'n'},
@@ -75,6 +76,7 @@ static const struct option long_options[] = {
 
 struct opts_t {
     bool delay_given;
+    bool do_hipri;
     bool do_low;
     bool do_progress;
     bool do_time;
@@ -102,8 +104,9 @@ static void
 usage()
 {
     printf("Usage: sg_turs [--ascq=ASC[,ASQ]] [--delay=MS] [--help] "
-           "[--low]\n"
-           "               [--number=NUM] [--num=NUM] [--progress] "
+           "[--hipri]\n"
+           "               [--low] "
+           "[--number=NUM] [--num=NUM] [--progress] "
            "[--time]\n"
            "               [--timeout=SE] [--verbose] [--version] "
            "DEVICE\n"
@@ -114,6 +117,8 @@ usage()
            "    --delay=MS|-d MS    delay MS miiliseconds before sending "
            "each tur\n"
            "    --help|-h        print usage message then exit\n"
+           "    --hipri|-H       poll for completion rather than wait for "
+           "an interrupt\n"
            "    --low|-l         use low level (sg_pt) interface for "
            "speed\n"
            "    --number=NUM|-n NUM    number of test_unit_ready commands "
@@ -174,7 +179,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:d:hln:NOptT:vV", long_options,
+        c = getopt_long(argc, argv, "a:d:hHln:NOptT:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -216,6 +221,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case '?':
             ++op->do_help;
             break;
+        case 'H':
+            op->do_hipri = true;
+            break;
         case 'l':
             op->do_low = true;
             break;
@@ -705,6 +713,8 @@ main(int argc, char * argv[])
         ret = sg_convert_errno(err ? err : ENOMEM);
         goto fini;
     }
+    if (op->do_hipri)
+        set_scsi_pt_flags(ptvp, SCSI_PT_FLAGS_HIPRI);
     if (op->do_progress) {
         uint8_t cdb[6] SG_C_CPP_ZERO_INIT;
 
@@ -784,7 +794,8 @@ main(int argc, char * argv[])
                        (unsigned)(elapsed_usecs / 1000000),
                        (unsigned)(elapsed_usecs % 1000000));
                 nom *= 1000000; /* scale for integer division */
-                printf("; %d operations/sec\n", (int)(nom / elapsed_usecs));
+                printf("; %d operations/sec%s\n", (int)(nom / elapsed_usecs),
+                       (op->do_hipri ? " [hipri]" : ""));
             } else
                 printf("Recorded 0 or less elapsed microseconds ??\n");
         }
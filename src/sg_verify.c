@@ -23,8 +23,10 @@
 #include "config.h"
 #endif
 #include "sg_lib.h"
+#include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
 /* A utility program for the Linux OS SCSI subsystem.
@@ -39,12 +41,16 @@
  * the possibility of protection data (DIF).
  */
 
-static const char * version_str = "1.30 20230623";    /* sbc5r04 */
+static const char * version_str = "1.31 20261016";    /* sbc5r04 */
 
 #define ME "sg_verify: "
 
 #define EBUFF_SZ 256
 
+#define SENSE_BUFF_LEN 64
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define MAX_MRQ 256
+
 
 static const struct option long_options[] = {
     {"0", no_argument, 0, '0'},
@@ -58,6 +64,7 @@ static const struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"in", required_argument, 0, 'i'},
     {"lba", required_argument, 0, 'l'},
+    {"mrq", required_argument, 0, 'm'},
     {"nbo", required_argument, 0, 'n'},     /* misspelling, legacy */
     {"ndo", required_argument, 0, 'n'},
     {"quiet", no_argument, 0, 'q'},
@@ -75,7 +82,7 @@ usage()
             "[--dpo]\n"
             "                 [--ebytchk=BCH] [--ff] [--group=GN] [--help] "
             "[--in=IF]\n"
-            "                 [--lba=LBA] [--ndo=NDO] [--quiet] "
+            "                 [--lba=LBA] [--mrq=NRQ] [--ndo=NDO] [--quiet] "
             "[--readonly]\n"
             "                 [--verbose] [--version] [--vrprotect=VRP] "
             "DEVICE\n"
@@ -107,6 +114,10 @@ usage()
             "                        only active if --ebytchk=BCH given\n"
             "    --lba=LBA|-l LBA    logical block address to start "
             "verify (def: 0)\n"
+            "    --mrq=NRQ|-m NRQ    send up to NRQ VERIFY commands in one "
+            "batch\n"
+            "                        (multiple requests). Ignored with "
+            "--ndo=NDO\n"
             "    --ndo=NDO|-n NDO    NDO is number of bytes placed in "
             "data-out buffer.\n"
             "                        These are fetched from IF (or "
@@ -129,6 +140,106 @@ usage()
             "(it was a single bit).\n");
 }
 
+/* Sends up to 'nrq' VERIFY commands (without data-out) covering at most
+ * 'count' blocks starting at 'lba' as one multiple requests batch. Sets
+ * *blocksp to the number of blocks covered. Returns 0 or the same values
+ * as sg_ll_verify16(); on error *lbap is set to the starting LBA of the
+ * failing command and *infop may be set to the sense data INFO field. */
+static int
+verify_mrq(int sg_fd, bool verify16, int vrprotect, bool dpo, int group,
+           uint64_t * lbap, int64_t count, int bpc, int nrq,
+           int64_t * blocksp, uint64_t * infop, bool noisy, int vb)
+{
+    int k, n, num, res, ret, s_cat, slen, n_done;
+    uint64_t lba = *lbap;
+    int64_t blks = 0;
+    const char * cdb_s = verify16 ? "verify(16)" : "verify(10)";
+    struct sg_pt_base * ptvp_arr[MAX_MRQ];
+    uint8_t cdb_arr[MAX_MRQ][16];
+    uint8_t sense_arr[MAX_MRQ][SENSE_BUFF_LEN];
+
+    memset(ptvp_arr, 0, sizeof(ptvp_arr));
+    ret = 0;
+    for (n = 0; (n < nrq) && (blks < count); ++n) {
+        num = ((count - blks) > bpc) ? bpc : (int)(count - blks);
+        memset(cdb_arr[n], 0, 16);
+        cdb_arr[n][0] = verify16 ? 0x8f : 0x2f;
+        cdb_arr[n][1] = ((vrprotect & 0x7) << 5);
+        if (dpo)
+            cdb_arr[n][1] |= 0x10;
+        if (verify16) {
+            sg_put_unaligned_be64(lba + blks, cdb_arr[n] + 2);
+            sg_put_unaligned_be32((uint32_t)num, cdb_arr[n] + 10);
+            cdb_arr[n][14] = group & 0x3f;
+        } else {
+            sg_put_unaligned_be32((uint32_t)(lba + blks), cdb_arr[n] + 2);
+            sg_put_unaligned_be16((uint16_t)num, cdb_arr[n] + 7);
+        }
+        ptvp_arr[n] = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+        if (NULL == ptvp_arr[n]) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        memset(sense_arr[n], 0, SENSE_BUFF_LEN);
+        set_scsi_pt_cdb(ptvp_arr[n], cdb_arr[n], verify16 ? 16 : 10);
+        set_scsi_pt_sense(ptvp_arr[n], sense_arr[n], SENSE_BUFF_LEN);
+        blks += num;
+    }
+    if (vb > 1)
+        pr2serr("    %d %s commands as multiple requests\n", n, cdb_s);
+    res = do_scsi_pt_mrq(ptvp_arr, n, sg_fd, DEF_PT_TIMEOUT,
+                         SCSI_PT_MRQ_STOP_IF, &n_done, vb);
+    if (res) {
+        ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    /* same response processing as sg_ll_verify16() for each command */
+    for (k = 0, blks = 0; k < n; ++k) {
+        if (k >= n_done) {      /* stopped early without an error seen */
+            ret = SG_LIB_CAT_OTHER;
+            break;
+        }
+        ret = sg_cmds_process_resp(ptvp_arr[k], cdb_s, 0, noisy, vb, &s_cat);
+        if (-1 == ret) {
+            if (get_scsi_pt_transport_err(ptvp_arr[k]))
+                ret = SG_LIB_TRANSPORT_ERROR;
+            else
+                ret = sg_convert_errno(get_scsi_pt_os_err(ptvp_arr[k]));
+        } else if (-2 == ret) {
+            switch (s_cat) {
+            case SG_LIB_CAT_RECOVERED:
+            case SG_LIB_CAT_NO_SENSE:
+                ret = 0;
+                break;
+            case SG_LIB_CAT_MEDIUM_HARD:
+                slen = get_scsi_pt_sense_len(ptvp_arr[k]);
+                if (sg_get_sense_info_fld(sense_arr[k], slen, infop))
+                    ret = SG_LIB_CAT_MEDIUM_HARD_WITH_INFO;
+                else
+                    ret = SG_LIB_CAT_MEDIUM_HARD;
+                break;
+            default:
+                ret = s_cat;
+                break;
+            }
+        } else
+            ret = 0;
+        if (ret) {
+            *lbap = lba + blks;
+            break;
+        }
+        blks += verify16 ? sg_get_unaligned_be32(cdb_arr[k] + 10) :
+                           sg_get_unaligned_be16(cdb_arr[k] + 7);
+    }
+fini:
+    for (k = 0; k < n; ++k) {
+        if (ptvp_arr[k])
+            destruct_scsi_pt_obj(ptvp_arr[k]);
+    }
+    *blocksp = blks;
+    return ret;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -146,6 +257,7 @@ main(int argc, char * argv[])
     int sg_fd = -1;
     int bpc = 128;
     int group = 0;
+    int mrq = 0;
     int bytchk = 0;
     int ndo = 0;        /* number of bytes in data-out buffer */
     int verbose = 0;
@@ -155,6 +267,7 @@ main(int argc, char * argv[])
     int64_t count = 1;
     int64_t ll;
     int64_t orig_count;
+    int64_t blks;
     uint64_t info64 = 0;
     uint64_t lba = 0;
     uint64_t orig_lba;
@@ -168,7 +281,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "0b:B:c:dE:fg:hi:l:n:P:qrSvV",
+        c = getopt_long(argc, argv, "0b:B:c:dE:fg:hi:l:m:n:P:qrSvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -227,6 +340,14 @@ main(int argc, char * argv[])
             }
             lba = (uint64_t)ll;
             break;
+        case 'm':
+            mrq = sg_get_num(optarg);
+            if ((mrq < 0) || (mrq > MAX_MRQ)) {
+                pr2serr("bad argument to '--mrq', expect 0 to %d\n",
+                        MAX_MRQ);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'n':       /* number of bytes in data-out buffer */
         case 'B':       /* undocumented, old --bytchk=NDO option */
             ndo = sg_get_num(optarg);
@@ -396,9 +517,21 @@ skip:
     }
 
     vc = verify16 ? "VERIFY(16)" : "VERIFY(10)";
+    if (ndo > 0)
+        mrq = 0;
     for (; count > 0; count -= bpc, lba += bpc) {
         num = (count > bpc) ? bpc : count;
-        if (verify16)
+        if (mrq > 1) {
+            res = verify_mrq(sg_fd, verify16, vrprotect, dpo, group, &lba,
+                             count, bpc, mrq, &blks, &info64, !quiet,
+                             verbose);
+            info = (unsigned int)info64;
+            if (0 == res) {
+                /* loop expression subtracts (and adds) the last bpc */
+                count -= (blks - bpc);
+                lba += (blks - bpc);
+            }
+        } else if (verify16)
             res = sg_ll_verify16(sg_fd, vrprotect, dpo, bytchk,
                                  lba, num, group, ref_data,
                                  ndo, &info64, !quiet , verbose);
@@ -72,11 +72,12 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_io_linux.h"
+#include "sg_rw.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "1.28 20231203";
+static const char * version_str = "1.30 20261016";
 
 static const char * my_name = "sgm_dd: ";
 
@@ -134,6 +135,8 @@ static bool nocopy = false;
 static struct timeval start_tm;
 static int blk_sz = 0;
 static uint32_t glob_pack_id = 0;       /* pre-increment */
+static struct sg_rw_tmpl rd_tmpl;       /* cdb templates, built once */
+static struct sg_rw_tmpl wr_tmpl;
 
 static const char * sg_allow_dio = "/sys/module/sg/parameters/allow_dio";
 
@@ -372,13 +375,15 @@ usage()
             "               [obs=BS] [of=OFILE] [oflag=FLAGS] "
             "[seek=SEEK] [skip=SKIP]\n"
             "               [--help] [--version]\n\n");
-    pr2serr("               [bpt=BPT] [cdbsz=6|10|12|16] [dio=0|1] "
-            "[fua=0|1|2|3]\n"
+    pr2serr("               [bpt=BPT|auto] [cdbsz=6|10|12|16|32] "
+            "[dio=0|1] [fua=0|1|2|3]\n"
             "               [sync=0|1] [time=0|1] [verbose=VERB] "
             "[--dry-run]\n"
             "               [--nocopy] [--progress] [--verbose]\n\n"
             "  where:\n"
-            "    bpt         is blocks_per_transfer (default is 128)\n"
+            "    bpt         is blocks_per_transfer (default is 128), "
+            "'auto' uses\n"
+            "                Block Limits VPD then a READ ramp\n"
             "    bs          must be device logical block size (default "
             "512)\n"
             "    cdbsz       size of SCSI READ or WRITE cdb (default is 10)\n"
@@ -499,90 +504,20 @@ read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
 #endif
 }
 
-static int
-sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, bool write_true, bool fua, bool dpo)
-{
-    int sz_ind;
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr("%sfor 6 byte commands, maximum number of blocks is "
-                    "256\n", my_name);
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr("%sfor 6 byte commands, can't address blocks beyond "
-                    "%d\n", my_name, 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
-                    "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr("%sfor 10 byte commands, maximum number of blocks is "
-                    "%d\n", my_name, 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                my_name, cdb_sz);
-        return 1;
-    }
-    return 0;
-}
-
 /* Returns 0 -> successful, various SG_LIB_CAT_* positive values,
  * -2 -> recoverable (ENOMEM), -1 -> unrecoverable error */
 static int
 sg_read(int sg_fd, uint8_t * buff, int blocks, int64_t from_block,
-        int bs, int cdbsz, bool fua, bool dpo, bool do_mmap)
+        int bs, bool do_mmap)
 {
     bool print_cdb_after = false;
     int res;
-    uint8_t rdCmd[MAX_SCSI_CDBSZ];
+    uint8_t * rdCmd = rd_tmpl.cdb;
+    int cdbsz = rd_tmpl.cdb_len;
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr;
 
-    if (sg_build_scsi_cdb(rdCmd, cdbsz, blocks, from_block, false, fua,
-                          dpo)) {
+    if (sg_rw_tmpl_patch(&rd_tmpl, from_block, blocks)) {
         pr2serr("%sbad rd cdb build, from_block=%" PRId64 ", blocks=%d\n",
                 my_name, from_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -674,15 +609,16 @@ sg_read(int sg_fd, uint8_t * buff, int blocks, int64_t from_block,
  * -2 -> recoverable (ENOMEM), -1 -> unrecoverable error */
 static int
 sg_write(int sg_fd, uint8_t * buff, int blocks, int64_t to_block,
-         int bs, int cdbsz, bool fua, bool dpo, bool do_mmap, bool * diop)
+         int bs, bool do_mmap, bool * diop)
 {
     bool print_cdb_after = false;
     int res;
-    uint8_t wrCmd[MAX_SCSI_CDBSZ];
+    uint8_t * wrCmd = wr_tmpl.cdb;
+    int cdbsz = wr_tmpl.cdb_len;
     uint8_t senseBuff[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     struct sg_io_hdr io_hdr SG_C_CPP_ZERO_INIT;
 
-    if (sg_build_scsi_cdb(wrCmd, cdbsz, blocks, to_block, true, fua, dpo)) {
+    if (sg_rw_tmpl_patch(&wr_tmpl, to_block, blocks)) {
         pr2serr("%sbad wr cdb build, to_block=%" PRId64 ", blocks=%d\n",
                 my_name, to_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -958,6 +894,27 @@ check_progress()
 #endif
 }
 
+/* For bpt=auto: returns the bpt to use for the sg device open on fd. The
+ * tuning READs start at start_blk. */
+static int
+sgm_bpt_auto(int fd, int64_t start_blk, int cdbsz, int bpt)
+{
+    int res;
+    struct sg_rw_bpt_auto ba;
+    char b[224];
+
+    res = sg_rw_bpt_auto(fd, blk_sz, cdbsz, start_blk,
+                         (dd_count > 0) ? dd_count : 0, bpt, 0,
+                         (0 == dry_run), &ba, verbose);
+    if (res) {
+        pr2serr("%sbpt=auto failed, keep bpt=%d\n", my_name, bpt);
+        return bpt;
+    }
+    pr2serr("%sbpt=auto: %s\n", my_name,
+            sg_rw_bpt_auto_str(&ba, blk_sz, sizeof(b), b));
+    return ba.bpt;
+}
+
 
 #define STR_SZ 1024
 #define INOUTF_SZ 512
@@ -966,6 +923,7 @@ check_progress()
 int
 main(int argc, char * argv[])
 {
+    bool bpt_auto = false;
     bool bpt_given = false;
     bool cdbsz_given = false;
     bool do_coe = false;     /* dummy, just accept + ignore */
@@ -1029,12 +987,16 @@ main(int argc, char * argv[])
             *buf++ = '\0';
         keylen = strlen(key);
         if (0 == strcmp(key,"bpt")) {
-            bpt = sg_get_num(buf);
-            if (-1 == bpt) {
-                pr2serr("%s%s 'bpt'\n", my_name, bat_s);
-                return SG_LIB_SYNTAX_ERROR;
+            if (0 == strcmp(buf, "auto"))
+                bpt_auto = true;        /* starts from default bpt */
+            else {
+                bpt = sg_get_num(buf);
+                if (-1 == bpt) {
+                    pr2serr("%s%s 'bpt'\n", my_name, bat_s);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                bpt_given = true;
             }
-            bpt_given = true;
         } else if (0 == strcmp(key,"bs")) {
             blk_sz = sg_get_num(buf);
             if (-1 == blk_sz) {
@@ -1269,6 +1231,10 @@ main(int argc, char * argv[])
                 pr2serr("%ssg driver prior to 3.1.22\n", my_name);
                 return SG_LIB_FILE_ERROR;
             }
+            if (bpt_auto) {
+                bpt = sgm_bpt_auto(infd, skip, scsi_cdbsz_in, bpt);
+                bpt_auto = false;
+            }
             in_res_sz = blk_sz * bpt;
             if (0 != (in_res_sz % psz)) /* round up to next page */
                 in_res_sz = ((in_res_sz / psz) + 1) * psz;
@@ -1376,6 +1342,10 @@ main(int argc, char * argv[])
             }
            if (t < MIN_RESERVED_SIZE)
                 t = MIN_RESERVED_SIZE;
+            if (bpt_auto) {
+                bpt = sgm_bpt_auto(outfd, seek, scsi_cdbsz_out, bpt);
+                bpt_auto = false;
+            }
             out_res_sz = blk_sz * bpt;
             if (out_res_sz > t) {
                 if (ioctl(outfd, SG_SET_RESERVED_SIZE, &out_res_sz) < 0) {
@@ -1534,6 +1504,9 @@ main(int argc, char * argv[])
         pr2serr("Couldn't calculate count, please give one\n");
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (bpt_auto)
+        pr2serr("%sbpt=auto needs a sg device, using bpt=%d\n", my_name,
+                bpt);
     if (! cdbsz_given) {
         if ((FT_SG == in_type) && (MAX_SCSI_CDBSZ != scsi_cdbsz_in) &&
             (((dd_count + skip) > UINT_MAX) || (bpt > USHRT_MAX))) {
@@ -1548,6 +1521,22 @@ main(int argc, char * argv[])
             scsi_cdbsz_out = MAX_SCSI_CDBSZ;
         }
     }
+    if ((FT_SG == in_type) &&
+        sg_rw_tmpl_init(&rd_tmpl, scsi_cdbsz_in, false, 0,
+                        (in_flags.dpo ? SG_RW_FL_DPO : 0) |
+                        (in_flags.fua ? SG_RW_FL_FUA : 0), 0)) {
+        pr2serr("%sbad read cdb: size %d (6 byte cdbs don't support dpo "
+                "or fua)\n", my_name, scsi_cdbsz_in);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((FT_SG == out_type) &&
+        sg_rw_tmpl_init(&wr_tmpl, scsi_cdbsz_out, true, 0,
+                        (out_flags.dpo ? SG_RW_FL_DPO : 0) |
+                        (out_flags.fua ? SG_RW_FL_FUA : 0), 0)) {
+        pr2serr("%sbad write cdb: size %d (6 byte cdbs don't support dpo "
+                "or fua)\n", my_name, scsi_cdbsz_out);
+        return SG_LIB_SYNTAX_ERROR;
+    }
 
     if (out_flags.dio && (FT_SG != in_type)) {
         out_flags.dio = false;
@@ -1603,15 +1592,12 @@ main(int argc, char * argv[])
     while (dd_count > 0) {      /* start of main copy loop */
         blocks = (dd_count > blocks_per) ? blocks_per : dd_count;
         if (FT_SG == in_type) {
-            ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, scsi_cdbsz_in,
-                          in_flags.fua, in_flags.dpo, true);
+            ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, true);
             if ((SG_LIB_CAT_UNIT_ATTENTION == ret) ||
                 (SG_LIB_CAT_ABORTED_COMMAND == ret)) {
                 pr2serr("Unit attention or aborted command, continuing "
                         "(r)\n");
-                ret = sg_read(infd, wrkPos, blocks, skip, blk_sz,
-                              scsi_cdbsz_in, in_flags.fua, in_flags.dpo,
-                              true);
+                ret = sg_read(infd, wrkPos, blocks, skip, blk_sz, true);
             }
             if (0 != ret) {
                 pr2serr("sg_read failed, skip=%" PRId64 "\n", skip);
@@ -1653,15 +1639,14 @@ main(int argc, char * argv[])
             bool dio_res = out_flags.dio;
             bool do_mmap = (FT_SG != in_type);
 
-            ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, scsi_cdbsz_out,
-                           out_flags.fua, out_flags.dpo, do_mmap, &dio_res);
+            ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, do_mmap,
+                           &dio_res);
             if ((SG_LIB_CAT_UNIT_ATTENTION == ret) ||
                 (SG_LIB_CAT_ABORTED_COMMAND == ret)) {
                 pr2serr("Unit attention or aborted command, continuing (w)\n");
                 dio_res = out_flags.dio;
-                ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz,
-                               scsi_cdbsz_out, out_flags.fua, out_flags.dpo,
-                               do_mmap, &dio_res);
+                ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz, do_mmap,
+                               &dio_res);
             }
             if (0 != ret) {
                 pr2serr("sg_write failed, seek=%" PRId64 "\n", seek);
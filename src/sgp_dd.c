@@ -57,11 +57,21 @@
 #include <sys/types.h>
 #endif
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+    defined(__NR_io_uring_register)
+#define SGP_HAVE_URING 1
+#endif
+#endif
+
 #ifdef HAVE_LINUX_MAJOR_H
 #include <linux/major.h>
 #include <linux/fs.h>           /* for BLKSSZGET and friends */
@@ -87,14 +97,25 @@
 #endif
 #endif
 
+/* Counters shared by worker threads are atomic when C11 atomics are
+ * available, otherwise they are protected by inout_mutex. */
+#ifdef HAVE_C11_ATOMICS
+#define SGP_ATOMIC _Atomic
+#else
+#define SGP_ATOMIC
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_io_linux.h"
+#include "sg_pt.h"
+#include "sg_blkemu.h"
+#include "sg_rw.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 
 
-static const char * version_str = "5.95 20231203";
+static const char * version_str = "6.01 20261016";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
@@ -115,6 +136,11 @@ static const char * version_str = "5.95 20231203";
 #define SGP_WRITE10 0x2a
 #define DEF_NUM_THREADS 4
 #define MAX_NUM_THREADS 1024  /* was SG_MAX_QUEUE (16) but no longer applies */
+#define REORDER_PER_THREAD 2  /* reorder ring slots per worker thread */
+#define DEF_URING_QD 8        /* io_uring submission depth per thread */
+#define MAX_URING_QD 256
+#define ZBC_CMDLEN 16         /* ZBC IN and ZBC OUT cdb length */
+#define ZONED_RZ_LEN (64 * 1024)      /* oflag=zoned REPORT ZONES length */
 
 #ifndef RAW_MAJOR
 #define RAW_MAJOR 255   /*unlikely value */
@@ -147,9 +173,35 @@ struct flags_t {
     bool direct;
     bool dpo;
     bool dsync;
+    bool emu;           /* emulated block device (e.g. "blkemu:") */
     bool excl;
+    bool finish;        /* oflag=finish: FINISH ZONE when partially written */
     bool fua;
     bool mmap;
+    bool uring;
+    bool zoned;         /* oflag=zoned: one in order writer per zone */
+};
+
+struct reorder_buf
+{       /* spare buffer that can be swapped into a worker's Rq_elem */
+    uint8_t * buffp;
+    uint8_t * alloc_bp;
+};
+
+struct reorder_slot
+{       /* read data parked until it is its turn to be written */
+    bool valid;
+    int num_blks;
+    int64_t blk;                    /* output block address */
+    struct reorder_buf rb;
+};
+
+struct zone_strm
+{       /* oflag=zoned: blocks to be written in one zone */
+    bool finish;                    /* FINISH ZONE after writing */
+    int64_t out_blk;                /* first block to write */
+    int64_t num_blks;
+    int64_t zone_lba;               /* zone start LBA */
 };
 
 struct opts_t
@@ -159,26 +211,59 @@ struct opts_t
     int in_type;
     int cdbsz_in;
     struct flags_t in_flags;
+    struct sg_rw_tmpl rd_tmpl;      /* READ cdb template, built once */
     int64_t in_blk;                 /* next block address to read */
     int64_t in_count;               /* blocks remaining for next read */
-    int64_t in_rem_count;           /* count of remaining in blocks */
-    int in_partial;
+    SGP_ATOMIC int64_t in_claimed;  /* blocks handed out (atomic claim) */
+    SGP_ATOMIC int64_t in_limit;    /* lowered when input reaches EOF */
+    SGP_ATOMIC int64_t in_rem_count;        /* count of remaining in blocks */
+    SGP_ATOMIC int in_partial;
+    bool in_seekable;               /* use pread() at block address */
+    bool out_pos_io;                /* use pwrite() at block address */
+    bool uring_active;              /* iflag=uring and/or oflag=uring */
+    int uring_qd;                   /* commands in flight per thread */
     pthread_mutex_t inout_mutex;
     int outfd;
     int64_t seek;
     int out_type;
     int cdbsz_out;
     struct flags_t out_flags;
+    struct sg_rw_tmpl wr_tmpl;      /* WRITE cdb template, built once */
     int64_t out_blk;                /* next block address to write */
-    int64_t out_count;              /* blocks remaining for next write */
-    int64_t out_rem_count;          /* count of remaining out blocks */
-    int out_partial;
+    SGP_ATOMIC int64_t out_count;   /* blocks remaining for next write */
+    SGP_ATOMIC int64_t out_rem_count;       /* count of remaining out blocks */
+    SGP_ATOMIC int out_partial;
     pthread_cond_t out_sync_cv;
+    bool shake_down_done;           /* first worker has made progress */
+    /* reorder ring: out of sequence reads are parked here rather than
+     * having their worker wait on out_sync_cv. Protected by reorder_mutex */
+    int reorder_sz;                 /* 0 -> ring not in use */
+    bool writer_active;             /* a worker is draining the ring */
+    int64_t out_next_chunk;         /* index of next bpt chunk to write */
+    int num_spare;
+    struct reorder_slot * reorder_ring;
+    struct reorder_buf * spare_bufs;
+    pthread_mutex_t reorder_mutex;
+    pthread_cond_t reorder_cv;
+    /* contention counters, reported by print_stats() */
+    SGP_ATOMIC unsigned int num_lock_waits; /* inout_mutex already held */
+    SGP_ATOMIC bool count_lock_waits;   /* main done with inout_mutex */
+    SGP_ATOMIC unsigned int num_order_waits;        /* out_sync_cv waits */
+    unsigned int num_handoffs;      /* reads parked in reorder ring */
+    unsigned int num_ring_full;     /* waits because reorder ring full */
+    /* oflag=zoned: write streams, zs_next protected by inout_mutex */
+    int num_zs;
+    int zs_next;
+    SGP_ATOMIC int num_zs_started;  /* zones with at least one write */
+    SGP_ATOMIC int num_zs_done;     /* zones completely written */
+    SGP_ATOMIC int num_zs_finished; /* ... of which FINISH ZONE-ed */
+    SGP_ATOMIC int num_zs_streams;  /* workers that wrote to a zone */
+    struct zone_strm * zs_arr;
     int bs;
     int bpt;
     int num_threads;
-    int dio_incomplete_count;
-    int sum_of_resids;
+    SGP_ATOMIC int dio_incomplete_count;
+    SGP_ATOMIC int sum_of_resids;
     bool mmap_active;
     int chkaddr;        /* check read data contains 4 byte, big endian block
                          * addresses, once: check only 4 bytes per block */
@@ -208,7 +293,8 @@ typedef struct request_element
     uint8_t * buffp;
     uint8_t * alloc_bp;
     struct sg_io_hdr io_hdr;
-    uint8_t cdb[MAX_SCSI_CDBSZ];
+    struct sg_rw_tmpl rd_tmpl;      /* copies of the templates in opts_t, */
+    struct sg_rw_tmpl wr_tmpl;      /*   patched for each command */
     uint8_t sb[SENSE_BUFF_LEN];
     int bs;
     int dio_incomplete_count;
@@ -219,6 +305,7 @@ typedef struct request_element
     struct flags_t out_flags;
     int verbose;
     uint32_t pack_id;
+    uint64_t start_ns;      /* non-zero when latency statistics are on */
 } Rq_elem;
 
 static sigset_t signal_set;
@@ -235,6 +322,11 @@ static void normal_in_operation(struct opts_t * clp, Rq_elem * rep,
                                 int blocks);
 static void normal_out_operation(struct opts_t * clp, Rq_elem * rep,
                                  int blocks, bool bump_out_blk);
+static void normal_in_complete(struct opts_t * clp, Rq_elem * rep,
+                               int blocks, int got, int err);
+static void normal_out_complete(struct opts_t * clp, Rq_elem * rep,
+                                int blocks, int res, int err,
+                                bool bump_out_blk);
 static int sg_start_io(Rq_elem * rep);
 static int sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp);
 static bool check_progress(struct opts_t * clp);
@@ -410,6 +502,20 @@ calc_duration_throughput(bool contin)
 }
 #endif
 
+/* Latency percentiles of all commands, if statistics are enabled with
+ * the SG3_UTILS_PT_STATS environment variable */
+static void
+print_latency(void)
+{
+    struct sg_pt_stats_ent se;
+
+    if (sg_pt_stats_summary(-1, &se))
+        pr2serr("command latency: p50=%.1f p99=%.1f p99.9=%.1f max=%.1f "
+                "usecs over %" PRIu64 " commands\n", se.p50_ns / 1000.0,
+                se.p99_ns / 1000.0, se.p999_ns / 1000.0,
+                se.max_ns / 1000.0, se.count);
+}
+
 static void
 print_stats(const char * str)
 {
@@ -429,6 +535,20 @@ print_stats(const char * str)
         pr2serr("%s%" PRId64 "+%d records out\n", str,
                 outfull - my_opts.out_partial, my_opts.out_partial);
     }
+    if (my_opts.num_lock_waits || my_opts.num_order_waits)
+        pr2serr("%scontention: inout_mutex busy %u, write order waits %u\n",
+                str, (unsigned int)my_opts.num_lock_waits,
+                (unsigned int)my_opts.num_order_waits);
+    if (my_opts.num_handoffs || my_opts.num_ring_full)
+        pr2serr("%sreorder ring[%d]: hand-offs %u, waits when full %u\n",
+                str, my_opts.reorder_sz, my_opts.num_handoffs,
+                my_opts.num_ring_full);
+    if (my_opts.num_zs)
+        pr2serr("%szoned: %d of %d zones written (%d started) by %d "
+                "streams, %d with FINISH ZONE\n", str,
+                (int)my_opts.num_zs_done, my_opts.num_zs,
+                (int)my_opts.num_zs_started, (int)my_opts.num_zs_streams,
+                (int)my_opts.num_zs_finished);
 }
 
 static void
@@ -516,6 +636,8 @@ dd_filetype(const char * filename)
 
     if ((1 == len) && ('.' == filename[0]))
         return FT_DEV_NULL;
+    if (sg_blkemu_is_name(filename))
+        return FT_SG;   /* commands are executed by sg_blkemu_sg_io() */
     if (stat(filename, &st) < 0)
         return FT_ERROR;
     if (S_ISCHR(st.st_mode)) {
@@ -541,14 +663,17 @@ usage()
             "               [obs=BS] [of=OFILE] [oflag=FLAGS] "
             "[seek=SEEK] [skip=SKIP]\n"
             "               [--help] [--version]\n\n");
-    pr2serr("               [bpt=BPT] [cdbsz=6|10|12|16] [coe=0|1] "
-            "[deb=VERB] [dio=0|1]\n"
-            "               [fua=0|1|2|3] [sync=0|1] [thr=THR] "
-            "[time=0|1] [verbose=VERB]\n"
+    pr2serr("               [bpt=BPT|auto] [cdbsz=6|10|12|16|32] [coe=0|1] "
+            "[deb=VERB]\n"
+            "               [dio=0|1] [fua=0|1|2|3] [qd=QD] [sync=0|1] "
+            "[thr=THR]\n"
+            "               [time=0|1] [verbose=VERB]\n"
             "               [--dry-run] [--nocopy] [--progress] "
             "[--verbose]\n"
             "  where:\n"
-            "    bpt         is blocks_per_transfer (default is 128)\n"
+            "    bpt         is blocks_per_transfer (default is 128), "
+            "'auto' uses\n"
+            "                Block Limits VPD then a READ ramp\n"
             "    bs          must be device logical block size (default "
             "512)\n"
             "    cdbsz       size of SCSI READ or WRITE cdb (default is 10)\n"
@@ -564,13 +689,15 @@ usage()
             "    if          file or device to read from (def: stdin)\n"
             "    iflag       comma separated list from: [coe,dio,direct,dpo,"
             "dsync,excl,\n"
-            "                fua,mmap,null]\n"
+            "                fua,mmap,null,uring]\n"
             "    of          file or device to write to (def: stdout), "
             "OFILE of '.'\n"
             "                treated as /dev/null\n"
             "    oflag       comma separated list from: [append,coe,dio,"
             "direct,dpo,\n"
-            "                dsync,excl,fua,mmap,null]\n"
+            "                dsync,excl,finish,fua,mmap,null,uring,zoned]\n"
+            "    qd          io_uring queue depth per thread (def: 8), "
+            "only with uring\n"
             "    seek        block position to start writing to OFILE\n"
             "    skip        block position to start reading from IFILE\n"
             "    sync        0->no sync(def), 1->SYNCHRONIZE CACHE on OFILE "
@@ -714,6 +841,7 @@ sig_listen_thread(void * v_clp)
             exit_threads = true;
 #endif
             pthread_cond_broadcast(&clp->out_sync_cv);
+            pthread_cond_broadcast(&clp->reorder_cv);
         }
     }
     return NULL;
@@ -760,6 +888,28 @@ sg_prepare(int fd, int bs, int bpt)
     return 0;
 }
 
+/* Emulated block devices are opened via the pass-through and have no sg
+ * reserved buffer to mmap(). Returns file descriptor or negated
+ * SG_LIB_* error. */
+static int
+sg_emu_open(const char * fnp, struct flags_t * flagp, int flags)
+{
+    int fd;
+
+    if (flagp->mmap) {
+        pr2serr("%smmap flag not supported on emulated device %s\n",
+                my_name, fnp);
+        return -SG_LIB_CONTRADICT;
+    }
+    fd = scsi_pt_open_flags(fnp, flags, 0);
+    if (fd < 0) {
+        pr2serr("%scould not open %s: %s\n", my_name, fnp,
+                safe_strerror(-fd));
+        return -sg_convert_errno(-fd);
+    }
+    return fd;
+}
+
 static int
 sg_in_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
 {
@@ -774,6 +924,8 @@ sg_in_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
     if (flagp->dsync)
         flags |= O_SYNC;
 
+    if (flagp->emu)
+        return sg_emu_open(fnp, flagp, flags);
     if ((fd = open(fnp, flags)) < 0) {
         err = errno;
         snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
@@ -802,6 +954,8 @@ sg_out_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
     if (flagp->dsync)
         flags |= O_SYNC;
 
+    if (flagp->emu)
+        return sg_emu_open(fnp, flagp, flags);
     if ((fd = open(fnp, flags)) < 0) {
         err = errno;
         snprintf(ebuff, EBUFF_SZ, "%scould not open %s for sg "
@@ -816,6 +970,289 @@ sg_out_open(const char * fnp, struct flags_t * flagp, int bs, int bpt)
     return fd;
 }
 
+/* Returns true (after reporting) if the data read into rep does not
+ * contain the expected 4 byte, big endian block addresses. */
+static bool
+chkaddr_fail(int c_addr, const Rq_elem * rep, int blocks)
+{
+    bool first_only = (1 == c_addr);
+    int k;
+    uint32_t addr = (uint32_t)rep->blk;
+
+    if (rep->bs < 4)
+        return false;
+    if (blocks == sg_blks_addr_bitmap(rep->buffp, rep->bs, blocks, addr,
+                                      first_only, NULL))
+        return false;
+    for (k = 0; k < blocks; ++k, ++addr) {  /* find first bad block */
+        if (0 == sg_blks_addr_bitmap(rep->buffp + (k * rep->bs), rep->bs,
+                                     1, addr, first_only, NULL))
+            break;
+    }
+    pr2serr("%s: chkaddr failure at addr=0x%x\n", __func__, addr);
+    return true;
+}
+
+static bool
+is_exit_threads(void)
+{
+#ifdef HAVE_C11_ATOMICS
+    return atomic_load(&exit_threads);
+#else
+    return exit_threads;
+#endif
+}
+
+/* Takes inout_mutex, counting the occasions that another worker thread
+ * held it. While the first worker is shaken down the main thread holds
+ * inout_mutex, so waits before that is over are not counted. */
+static void
+lock_inout(struct opts_t * clp)
+{
+    bool counting = clp->count_lock_waits;
+    int status = pthread_mutex_trylock(&clp->inout_mutex);
+
+    if (EBUSY == status) {
+        status = pthread_mutex_lock(&clp->inout_mutex);
+        if (0 != status) err_exit(status, "lock inout_mutex");
+        if (counting)
+            ++clp->num_lock_waits;
+    } else if (0 != status)
+        err_exit(status, "trylock inout_mutex");
+}
+
+static void
+unlock_inout(struct opts_t * clp)
+{
+    int status = pthread_mutex_unlock(&clp->inout_mutex);
+
+    if (0 != status) err_exit(status, "unlock inout_mutex");
+}
+
+/* Shared counters only need inout_mutex when C11 atomics are absent */
+static void
+stats_lock(struct opts_t * clp)
+{
+#ifdef HAVE_C11_ATOMICS
+    if (clp) { ; }      /* unused, dummy to suppress warning */
+#else
+    lock_inout(clp);
+#endif
+}
+
+static void
+stats_unlock(struct opts_t * clp)
+{
+#ifdef HAVE_C11_ATOMICS
+    if (clp) { ; }      /* unused, dummy to suppress warning */
+#else
+    unlock_inout(clp);
+#endif
+}
+
+/* Lets main() know that a worker thread has made progress (or finished)
+ * so the remaining worker threads can be started. */
+static void
+signal_shake_down(struct opts_t * clp)
+{
+    lock_inout(clp);
+    clp->shake_down_done = true;
+    pthread_cond_broadcast(&clp->out_sync_cv);
+    unlock_inout(clp);
+}
+
+/* Claims the next run of (up to bpt) blocks to read. With C11 atomics this
+ * is a single fetch-add so workers do not serialize on inout_mutex. Returns
+ * the number of blocks claimed, 0 when there is nothing left to read. The
+ * starting (input) block address is written to *blkp and the count of
+ * blocks that remained to be written, prior to this claim, to *out_cntp. */
+static int
+claim_in_blocks(struct opts_t * clp, int64_t * blkp, int64_t * out_cntp)
+{
+    int blocks;
+#ifdef HAVE_C11_ATOMICS
+    int64_t off, lim;
+
+    off = atomic_fetch_add(&clp->in_claimed, (int64_t)clp->bpt);
+    lim = atomic_load(&clp->in_limit);
+    if (off >= lim)
+        return 0;
+    blocks = ((lim - off) > clp->bpt) ? clp->bpt : (int)(lim - off);
+    *blkp = clp->skip + off;
+    *out_cntp = atomic_fetch_sub(&clp->out_count, (int64_t)blocks);
+#else
+    lock_inout(clp);
+    if (clp->in_count <= 0) {
+        unlock_inout(clp);
+        return 0;
+    }
+    blocks = (clp->in_count > clp->bpt) ? clp->bpt : clp->in_count;
+    *blkp = clp->in_blk;
+    clp->in_blk += blocks;
+    clp->in_count -= blocks;
+    *out_cntp = clp->out_count;
+    clp->out_count -= blocks;
+    unlock_inout(clp);
+#endif
+    return blocks;
+}
+
+/* Input ended early (EOF) after 'blocks' blocks of the run starting at
+ * 'blk'; stop other workers from claiming blocks past that point. */
+static void
+trim_in_blocks(struct opts_t * clp, int64_t blk, int claimed, int blocks)
+{
+#ifdef HAVE_C11_ATOMICS
+    int64_t new_lim = blk - clp->skip + blocks;
+    int64_t lim = atomic_load(&clp->in_limit);
+
+    if (claimed) { ; }  /* unused, dummy to suppress warning */
+    while ((new_lim < lim) &&
+           (! atomic_compare_exchange_weak(&clp->in_limit, &lim, new_lim)))
+        ;
+#else
+    /* Reverse out + re-apply blocks on clp, inout_mutex held by caller */
+    if (blk) { ; }      /* unused, dummy to suppress warning */
+    clp->in_blk -= claimed;
+    clp->in_count += claimed;
+    clp->in_blk += blocks;
+    clp->in_count -= blocks;
+#endif
+}
+
+/* The reorder ring is used when writes must be in order (i.e. the output
+ * is a regular file or a block device) and each worker owns its buffer
+ * (i.e. not mmap-ed IO). Each slot holds one bpt chunk. Spare buffers are
+ * swapped into a worker when it parks its read data in the ring. */
+static int
+reorder_ring_init(struct opts_t * clp)
+{
+    int k, sz;
+
+    clp->reorder_sz = REORDER_PER_THREAD * clp->num_threads;
+    clp->reorder_ring = (struct reorder_slot *)
+                calloc(clp->reorder_sz, sizeof(struct reorder_slot));
+    clp->spare_bufs = (struct reorder_buf *)
+                calloc(clp->reorder_sz, sizeof(struct reorder_buf));
+    if ((NULL == clp->reorder_ring) || (NULL == clp->spare_bufs))
+        return sg_convert_errno(ENOMEM);
+    sz = clp->bpt * clp->bs;
+    for (k = 0; k < clp->reorder_sz; ++k) {
+        clp->spare_bufs[k].buffp = sg_memalign(sz, 0 /* page align */,
+                                        &clp->spare_bufs[k].alloc_bp, false);
+        if (NULL == clp->spare_bufs[k].buffp)
+            return sg_convert_errno(ENOMEM);
+        ++clp->num_spare;
+    }
+    return 0;
+}
+
+static void
+reorder_ring_free(struct opts_t * clp)
+{
+    int k;
+
+    if (clp->reorder_ring) {
+        for (k = 0; k < clp->reorder_sz; ++k) {
+            if (clp->reorder_ring[k].valid)
+                free(clp->reorder_ring[k].rb.alloc_bp);
+        }
+        free(clp->reorder_ring);
+        clp->reorder_ring = NULL;
+    }
+    if (clp->spare_bufs) {
+        for (k = 0; k < clp->num_spare; ++k)
+            free(clp->spare_bufs[k].alloc_bp);
+        free(clp->spare_bufs);
+        clp->spare_bufs = NULL;
+    }
+    clp->num_spare = 0;
+}
+
+/* Called when rep holds read data for bpt chunk number 'chunk' (relative to
+ * skip/seek) which is to be written at 'out_blk'. If it is that chunk's turn
+ * then this worker writes it, followed by any parked chunks that are next
+ * in sequence. Otherwise the data is parked in the reorder ring and rep is
+ * given a spare buffer so this worker can go on reading. Only waits when
+ * the ring is full. Returns false if this worker should stop. */
+static bool
+reorder_write(struct opts_t * clp, Rq_elem * rep, int64_t chunk,
+              int64_t out_blk)
+{
+    bool waited = false;
+    int status;
+    struct reorder_slot * rsp;
+    struct reorder_buf own;
+
+    status = pthread_mutex_lock(&clp->reorder_mutex);
+    if (0 != status) err_exit(status, "lock reorder_mutex");
+    while ((chunk - clp->out_next_chunk) >= clp->reorder_sz) {
+        if (is_exit_threads()) {
+            status = pthread_mutex_unlock(&clp->reorder_mutex);
+            if (0 != status) err_exit(status, "unlock reorder_mutex");
+            return false;
+        }
+        if (! waited) {
+            ++clp->num_ring_full;
+            waited = true;
+        }
+        status = pthread_cond_wait(&clp->reorder_cv, &clp->reorder_mutex);
+        if (0 != status) err_exit(status, "cond reorder_cv");
+    }
+    if (clp->writer_active || (chunk != clp->out_next_chunk)) {
+        rsp = clp->reorder_ring + (chunk % clp->reorder_sz);
+        rsp->valid = true;
+        rsp->blk = out_blk;
+        rsp->num_blks = rep->num_blks;
+        rsp->rb.buffp = rep->buffp;
+        rsp->rb.alloc_bp = rep->alloc_bp;
+        --clp->num_spare;
+        rep->buffp = clp->spare_bufs[clp->num_spare].buffp;
+        rep->alloc_bp = clp->spare_bufs[clp->num_spare].alloc_bp;
+        ++clp->num_handoffs;
+        status = pthread_mutex_unlock(&clp->reorder_mutex);
+        if (0 != status) err_exit(status, "unlock reorder_mutex");
+        return true;
+    }
+    clp->writer_active = true;
+    status = pthread_mutex_unlock(&clp->reorder_mutex);
+    if (0 != status) err_exit(status, "unlock reorder_mutex");
+
+    own.buffp = rep->buffp;
+    own.alloc_bp = rep->alloc_bp;
+    rep->wr = true;
+    rep->blk = out_blk;
+    while (true) {
+        normal_out_operation(clp, rep, rep->num_blks, false);
+        status = pthread_mutex_lock(&clp->reorder_mutex);
+        if (0 != status) err_exit(status, "lock reorder_mutex");
+        if (rep->buffp != own.buffp) {  /* give parked buffer back */
+            clp->spare_bufs[clp->num_spare].buffp = rep->buffp;
+            clp->spare_bufs[clp->num_spare].alloc_bp = rep->alloc_bp;
+            ++clp->num_spare;
+            rep->buffp = own.buffp;
+            rep->alloc_bp = own.alloc_bp;
+        }
+        ++clp->out_next_chunk;
+        pthread_cond_broadcast(&clp->reorder_cv);
+        rsp = clp->reorder_ring + (clp->out_next_chunk % clp->reorder_sz);
+        if (rep->out_err || is_exit_threads() || (! rsp->valid)) {
+            clp->writer_active = false;
+            status = pthread_mutex_unlock(&clp->reorder_mutex);
+            if (0 != status) err_exit(status, "unlock reorder_mutex");
+            break;
+        }
+        rsp->valid = false;
+        rep->blk = rsp->blk;
+        rep->num_blks = rsp->num_blks;
+        rep->buffp = rsp->rb.buffp;
+        rep->alloc_bp = rsp->rb.alloc_bp;
+        status = pthread_mutex_unlock(&clp->reorder_mutex);
+        if (0 != status) err_exit(status, "unlock reorder_mutex");
+    }
+    return ! rep->out_err;
+}
+
 static void *
 read_write_thread(void * v_tap)
 {
@@ -823,16 +1260,18 @@ read_write_thread(void * v_tap)
     struct opts_t * clp = &my_opts;
     Rq_elem rel;
     Rq_elem * rep = &rel;
-    volatile bool stop_after_write, bb;
-    bool enforce_write_ordering;
+    volatile bool stop_after_write, bb, shake_down_signalled;
+    bool enforce_write_ordering, use_ring;
     int sz, c_addr;
-    int64_t out_blk, out_count;
+    int64_t out_blk, out_count, chunk;
     int64_t seek_skip = tap->seek_skip;
     int blocks, status;
 
     stop_after_write = false;
+    shake_down_signalled = false;
     enforce_write_ordering = (FT_DEV_NULL != clp->out_type) &&
                              (FT_SG != clp->out_type);
+    use_ring = enforce_write_ordering && (clp->reorder_sz > 0);
     c_addr = clp->chkaddr;
     memset(rep, 0, sizeof(*rep));
     /* Following clp members are constant during lifetime of thread */
@@ -859,6 +1298,8 @@ read_write_thread(void * v_tap)
     rep->verbose = clp->verbose;
     rep->cdbsz_in = clp->cdbsz_in;
     rep->cdbsz_out = clp->cdbsz_out;
+    rep->rd_tmpl = clp->rd_tmpl;
+    rep->wr_tmpl = clp->wr_tmpl;
     rep->in_flags = clp->in_flags;
     rep->out_flags = clp->out_flags;
     rep->use_no_dxfer = (FT_DEV_NULL == clp->out_type);
@@ -877,95 +1318,62 @@ read_write_thread(void * v_tap)
     while(1) {
         if ((rep->in_stop) || (rep->in_err) || (rep->out_err))
             break;
-        status = pthread_mutex_lock(&clp->inout_mutex);
-        if (0 != status) err_exit(status, "lock inout_mutex");
-#ifdef HAVE_C11_ATOMICS
-        bb = atomic_load(&exit_threads);
-#else
-        bb = exit_threads;
-#endif
-        if (bb || (clp->in_count <= 0)) {
-            /* no more to do, exit loop then thread */
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+        if (is_exit_threads())
             break;
-        }
-        blocks = (clp->in_count > clp->bpt) ? clp->bpt : clp->in_count;
+        blocks = claim_in_blocks(clp, &rep->blk, &out_count);
+        if (blocks <= 0)
+            break;      /* no more to do, exit loop then thread */
         rep->wr = false;
-        rep->blk = clp->in_blk;
         rep->num_blks = blocks;
-        clp->in_blk += blocks;
-        clp->in_count -= blocks;
-        /* while we have this lock, find corresponding out_blk */
+        chunk = (rep->blk - clp->skip) / clp->bpt;
         out_blk = rep->blk + seek_skip;
-        out_count = clp->out_count;
-        if (! enforce_write_ordering)
-            clp->out_blk += blocks;
-        clp->out_count -= blocks;
-        status = pthread_mutex_unlock(&clp->inout_mutex);
-        if (0 != status) err_exit(status, "unlock inout_mutex");
 
         pthread_cleanup_push(cleanup_in, (void *)clp);
         if (FT_SG == clp->in_type)
             sg_in_operation(clp, rep);
         else
             normal_in_operation(clp, rep, blocks);
-        if (c_addr && (rep->bs > 3)) {
-            int k, j, off, num;
-            uint32_t addr = (uint32_t)rep->blk;
-
-            num = (1 == c_addr) ? 4 : (rep->bs - 3);
-            for (k = 0, off = 0; k < blocks; ++k, ++addr, off += rep->bs) {
-                for (j = 0; j < num; j += 4) {
-                    if (addr != sg_get_unaligned_be32(rep->buffp + off + j))
-                        break;
-                }
-                if (j < num)
-                    break;
-            }
-            if (k < blocks) {
-                pr2serr("%s: chkaddr failure at addr=0x%x\n", __func__, addr);
-                rep->in_err = true;
-            }
-        }
+        if (c_addr && chkaddr_fail(c_addr, rep, blocks))
+            rep->in_err = true;
         pthread_cleanup_pop(0);
         if (rep->in_err) {
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-            /* write-side not done, so undo changes to out_blk + out_count */
-            if (! enforce_write_ordering)
-                clp->out_blk -= blocks;
+            /* write-side not done, so undo change to out_count */
+            stats_lock(clp);
             clp->out_count += blocks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+            stats_unlock(clp);
             break;
         }
 
+        if (use_ring) {
+            if (is_exit_threads() || (out_count <= 0) ||
+                (0 == rep->num_blks))
+                break;
+            if (! reorder_write(clp, rep, chunk, out_blk))
+                break;
+            if (! shake_down_signalled) {
+                signal_shake_down(clp);
+                shake_down_signalled = true;
+            }
+            continue;
+        }
+
         if (enforce_write_ordering) {
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
-#ifdef HAVE_C11_ATOMICS
-            bb = atomic_load(&exit_threads);
-#else
-            bb = exit_threads;
-#endif
+            lock_inout(clp);
+            bb = is_exit_threads();
             while ((! bb) && (out_blk != clp->out_blk)) {
                 /* if write would be out of sequence then wait */
+                ++clp->num_order_waits;
                 pthread_cleanup_push(cleanup_out, (void *)clp);
                 status = pthread_cond_wait(&clp->out_sync_cv,
                                            &clp->inout_mutex);
                 if (0 != status) err_exit(status, "cond out_sync_cv");
                 pthread_cleanup_pop(0);
+                bb = is_exit_threads();
             }
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+            unlock_inout(clp);
         }
 
-#ifdef HAVE_C11_ATOMICS
-        bb = atomic_load(&exit_threads);
-#else
-        bb = exit_threads;
-#endif
+        bb = is_exit_threads();
         if (bb || (out_count <= 0))
             break;
 
@@ -981,13 +1389,19 @@ read_write_thread(void * v_tap)
             sg_out_operation(clp, rep, enforce_write_ordering);
         else if (FT_DEV_NULL == clp->out_type) {
             /* skip actual write operation */
+            stats_lock(clp);
             clp->out_rem_count -= blocks;
+            stats_unlock(clp);
         }
         else
             normal_out_operation(clp, rep, blocks, enforce_write_ordering);
         pthread_cleanup_pop(0);
         if (enforce_write_ordering)
             pthread_cond_broadcast(&clp->out_sync_cv);
+        if (! shake_down_signalled) {
+            signal_shake_down(clp);
+            shake_down_signalled = true;
+        }
     } /* end of while loop */
 
     if (rep->alloc_bp)
@@ -1002,85 +1416,840 @@ read_write_thread(void * v_tap)
             exit_threads = true;
 #endif
     }
-    pthread_cond_broadcast(&clp->out_sync_cv);
+    if (use_ring)
+        pthread_cond_broadcast(&clp->reorder_cv);
+    signal_shake_down(clp);
     return (stop_after_write || rep->in_stop) ? NULL : clp;
 }
 
+/* oflag=zoned: sends a ZBC IN or ZBC OUT command (16 byte cdb) to the
+ * (sg) output device. Returns 0 or an SG_LIB_* error. */
+static int
+sgp_zbc_cmd(int fd, const uint8_t * cdbp, uint8_t * dinp, int din_len,
+            int * residp, int vb)
+{
+    int ret, res, sense_cat;
+    uint8_t sense_b[SENSE_BUFF_LEN];
+    struct sg_pt_base * ptvp;
+
+    if (vb > 1) {
+        char b[128];
+
+        pr2serr("    %s\n", sg_get_command_str(cdbp, ZBC_CMDLEN, true,
+                                               sizeof(b), b));
+    }
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp)
+        return sg_convert_errno(ENOMEM);
+    memset(sense_b, 0, sizeof(sense_b));
+    set_scsi_pt_cdb(ptvp, cdbp, ZBC_CMDLEN);
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    if (dinp)
+        set_scsi_pt_data_in(ptvp, dinp, din_len);
+    res = do_scsi_pt(ptvp, fd, DEF_TIMEOUT / 1000, vb);
+    ret = sg_cmds_process_resp(ptvp, (0x95 == cdbp[0]) ? "report zones" :
+                               "zbc out", res, true, vb, &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    if (residp)
+        *residp = get_scsi_pt_resid(ptvp);
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Splits the blocks to be written, [seek, seek + count), into one write
+ * stream per zone using REPORT ZONES on OFILE. Each stream in a sequential
+ * zone must start at that zone's write pointer. Returns 0 or an SG_LIB_*
+ * error. */
+static int
+zoned_init(struct opts_t * clp, int64_t count)
+{
+    int k, res, resid, num_zd;
+    int max_zs = 0;
+    int vb = clp->verbose;
+    uint8_t zt, zc;
+    int64_t lba = clp->seek;
+    int64_t end = clp->seek + count;
+    int64_t zs_lba, z_len, wp;
+    const uint8_t * bp;
+    uint8_t * rzbp;
+    uint8_t * free_rzbp = NULL;
+    struct zone_strm * zsp;
+    uint8_t cdb[ZBC_CMDLEN];
+
+    rzbp = sg_memalign(ZONED_RZ_LEN, 0, &free_rzbp, false);
+    if (NULL == rzbp)
+        return sg_convert_errno(ENOMEM);
+    res = 0;
+    while (lba < end) {
+        memset(cdb, 0, sizeof(cdb));
+        cdb[0] = 0x95;          /* ZBC IN */
+        cdb[1] = 0x0;           /* REPORT ZONES */
+        sg_put_unaligned_be64((uint64_t)lba, cdb + 2);
+        sg_put_unaligned_be32(ZONED_RZ_LEN, cdb + 10);
+        cdb[14] = 0x80;         /* PARTIAL, all zones */
+        res = sgp_zbc_cmd(clp->outfd, cdb, rzbp, ZONED_RZ_LEN, &resid, vb);
+        if (res) {
+            pr2serr("%sREPORT ZONES on %s failed, oflag=zoned needs a "
+                    "zoned OFILE\n", my_name, outfn);
+            break;
+        }
+        num_zd = (ZONED_RZ_LEN - resid - 64) / 64;
+        if (num_zd <= 0) {
+            pr2serr("%sno zones reported at LBA 0x%" PRIx64 "\n", my_name,
+                    lba);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        for (k = 0, bp = rzbp + 64; (k < num_zd) && (lba < end);
+             ++k, bp += 64) {
+            zt = bp[0] & 0xf;
+            zc = (bp[1] >> 4) & 0xf;
+            z_len = (int64_t)sg_get_unaligned_be64(bp + 8);
+            zs_lba = (int64_t)sg_get_unaligned_be64(bp + 16);
+            wp = (int64_t)sg_get_unaligned_be64(bp + 24);
+            if ((z_len <= 0) || (zs_lba > lba) || ((zs_lba + z_len) <= lba)) {
+                pr2serr("%sunexpected zone descriptor at LBA 0x%" PRIx64
+                        "\n", my_name, lba);
+                res = SG_LIB_CAT_MALFORMED;
+                goto fini;
+            }
+            if (clp->num_zs >= max_zs) {
+                max_zs = max_zs ? (2 * max_zs) : 64;
+                zsp = (struct zone_strm *)realloc(clp->zs_arr,
+                                        max_zs * sizeof(struct zone_strm));
+                if (NULL == zsp) {
+                    res = sg_convert_errno(ENOMEM);
+                    goto fini;
+                }
+                clp->zs_arr = zsp;
+            }
+            zsp = clp->zs_arr + clp->num_zs;
+            zsp->out_blk = lba;
+            zsp->num_blks = ((zs_lba + z_len) < end) ?
+                                        (zs_lba + z_len - lba) : (end - lba);
+            zsp->zone_lba = zs_lba;
+            zsp->finish = false;
+            if (0x1 != zt) {    /* not conventional */
+                if (0x5 == zt) {
+                    pr2serr("%sgap zone at LBA 0x%" PRIx64 " can't be "
+                            "written\n", my_name, zs_lba);
+                    res = SG_LIB_LBA_OUT_OF_RANGE;
+                    goto fini;
+                }
+                if ((zc < 0x1) || (zc > 0x4) || (wp != lba)) {
+                    pr2serr("%szone at LBA 0x%" PRIx64 " (condition 0x%x) "
+                            "has write pointer 0x%" PRIx64 " but writing "
+                            "would start at 0x%" PRIx64 "\n", my_name,
+                            zs_lba, zc, wp, lba);
+                    pr2serr("    reset the write pointer (e.g. with "
+                            "sg_reset_wp) or change seek=\n");
+                    res = SG_LIB_CAT_OTHER;
+                    goto fini;
+                }
+                zsp->finish = clp->out_flags.finish &&
+                              ((lba + zsp->num_blks) < (zs_lba + z_len));
+            }
+            lba += zsp->num_blks;
+            ++clp->num_zs;
+        }
+    }
+fini:
+    free(free_rzbp);
+    return res;
+}
+
+/* Returns the maximum number of open sequential write required zones from
+ * the Zoned block device characteristics VPD page of OFILE, or 0 if that
+ * is not available or not limited. */
+static uint32_t
+zoned_max_open(struct opts_t * clp)
+{
+    uint32_t n;
+    uint8_t b[64];
+
+    if (sg_ll_inquiry(clp->outfd, false, true, 0xb6, b, sizeof(b), false,
+                      clp->verbose > 1 ? clp->verbose - 1 : 0) ||
+        (0xb6 != b[1]))
+        return 0;
+    n = sg_get_unaligned_be32(b + 16);
+    return (UINT32_MAX == n) ? 0 : n;
+}
+
+/* oflag=zoned worker thread. Each claims the next zone (write stream) and
+ * copies it in bpt chunks, in order, before claiming another. So writes in
+ * a sequential zone always land on its write pointer while up to 'thr'
+ * zones are written concurrently. With oflag=finish a zone left partially
+ * written is then made FULL with a FINISH ZONE command. */
+static void *
+zoned_rw_thread(void * v_tap)
+{
+    struct thread_arg * tap = (struct thread_arg *)v_tap;
+    struct opts_t * clp = &my_opts;
+    Rq_elem rel;
+    Rq_elem * rep = &rel;
+    volatile bool shake_down_signalled = false;
+    bool streamed = false;
+    bool done;
+    int c_addr, blocks, res, zi;
+    int64_t out_blk, end_blk;
+    int64_t seek_skip = tap->seek_skip;
+    const struct zone_strm * zsp;
+    uint8_t cdb[ZBC_CMDLEN];
+
+    c_addr = clp->chkaddr;
+    memset(rep, 0, sizeof(*rep));
+    rep->bs = clp->bs;
+    rep->infd = clp->infd;
+    rep->outfd = clp->outfd;
+    rep->verbose = clp->verbose;
+    rep->cdbsz_in = clp->cdbsz_in;
+    rep->cdbsz_out = clp->cdbsz_out;
+    rep->rd_tmpl = clp->rd_tmpl;
+    rep->wr_tmpl = clp->wr_tmpl;
+    rep->in_flags = clp->in_flags;
+    rep->out_flags = clp->out_flags;
+    rep->buffp = sg_memalign(clp->bpt * rep->bs, 0 /* page align */,
+                             &rep->alloc_bp, false);
+    if (NULL == rep->buffp)
+        err_exit(ENOMEM, "out of memory creating user buffers\n");
+
+    while ((! rep->in_stop) && (! rep->in_err) && (! rep->out_err) &&
+           (! is_exit_threads())) {
+        lock_inout(clp);
+        zi = clp->zs_next++;
+        unlock_inout(clp);
+        if (zi >= clp->num_zs)
+            break;
+        zsp = clp->zs_arr + zi;
+        end_blk = zsp->out_blk + zsp->num_blks;
+        for (out_blk = zsp->out_blk; out_blk < end_blk; out_blk += blocks) {
+            if (is_exit_threads())
+                break;
+            blocks = ((end_blk - out_blk) > clp->bpt) ? clp->bpt :
+                                                (int)(end_blk - out_blk);
+            stats_lock(clp);
+            clp->out_count -= blocks;
+            stats_unlock(clp);
+            rep->wr = false;
+            rep->blk = out_blk - seek_skip;
+            rep->num_blks = blocks;
+            if (FT_SG == clp->in_type)
+                sg_in_operation(clp, rep);
+            else
+                normal_in_operation(clp, rep, blocks);
+            if (c_addr && chkaddr_fail(c_addr, rep, blocks))
+                rep->in_err = true;
+            if (rep->in_err) {
+                stats_lock(clp);
+                clp->out_count += blocks;
+                stats_unlock(clp);
+                break;
+            }
+            if (0 == rep->num_blks)
+                break;  /* read nothing (EOF) */
+            rep->wr = true;
+            rep->blk = out_blk;
+            sg_out_operation(clp, rep, false);
+            if (! shake_down_signalled) {
+                signal_shake_down(clp);
+                shake_down_signalled = true;
+            }
+            if ((! rep->out_err) && (out_blk == zsp->out_blk)) {
+                stats_lock(clp);
+                ++clp->num_zs_started;
+                if (! streamed)
+                    ++clp->num_zs_streams;
+                stats_unlock(clp);
+                streamed = true;
+            }
+            if (rep->out_err || rep->in_stop)
+                break;
+        }
+        done = (out_blk >= end_blk);
+        if (zsp->finish && (! rep->in_err) && (! rep->out_err) &&
+            (! is_exit_threads())) {
+            memset(cdb, 0, sizeof(cdb));
+            cdb[0] = 0x94;      /* ZBC OUT */
+            cdb[1] = 0x2;       /* FINISH ZONE */
+            sg_put_unaligned_be64((uint64_t)zsp->zone_lba, cdb + 2);
+            res = sgp_zbc_cmd(rep->outfd, cdb, NULL, 0, NULL, rep->verbose);
+            if (res) {
+                pr2serr("%sFINISH ZONE at LBA 0x%" PRIx64 " failed\n",
+                        my_name, zsp->zone_lba);
+                if (exit_status <= 0)
+                    exit_status = res;
+                rep->out_err = true;
+                done = false;
+            } else {
+                stats_lock(clp);
+                ++clp->num_zs_finished;
+                stats_unlock(clp);
+            }
+        }
+        if (done) {
+            stats_lock(clp);
+            ++clp->num_zs_done;
+            stats_unlock(clp);
+        }
+    }
+
+    if (rep->alloc_bp)
+        free(rep->alloc_bp);
+    if (rep->in_err || rep->out_err) {
+#ifdef HAVE_C11_ATOMICS
+        atomic_store(&exit_threads, true);
+#else
+        exit_threads = true;
+#endif
+    }
+    signal_shake_down(clp);
+    return (rep->in_err || rep->out_err || rep->in_stop) ? NULL : clp;
+}
+
+#ifdef SGP_HAVE_URING
+
+/* Minimal io_uring wrapper using the raw system calls, so there is no
+ * dependency on liburing. One instance per uring worker thread. */
+struct sgp_uring
+{
+    int fd;
+    bool fixed_bufs;                /* buffers registered with kernel */
+    unsigned int sq_entries;
+    unsigned int sq_tail;           /* local copy, published on submit */
+    unsigned int to_submit;
+    unsigned int * sq_headp;
+    unsigned int * sq_tailp;
+    unsigned int * sq_maskp;
+    unsigned int * sq_arrayp;
+    unsigned int * cq_headp;
+    unsigned int * cq_tailp;
+    unsigned int * cq_maskp;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * sq_ptr;
+    void * cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+};
+
+#define URQ_FREE 0
+#define URQ_READING 1
+#define URQ_WRITING 2
+
+struct uring_rq
+{       /* one per chunk in flight in a uring worker thread */
+    int state;                      /* URQ_FREE, URQ_READING or URQ_WRITING */
+    int index;                      /* also index of registered buffer */
+    int done;                       /* bytes already transferred */
+    int64_t out_blk;
+    struct iovec iov;
+    Rq_elem rq;
+};
+
+/* Returns 0 on success, else a negated errno value */
+static int
+sgp_uring_init(struct sgp_uring * urp, unsigned int entries)
+{
+    int err;
+    struct io_uring_params p;
+
+    memset(urp, 0, sizeof(*urp));
+    memset(&p, 0, sizeof(p));
+    urp->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (urp->fd < 0)
+        return -errno;
+    urp->sq_entries = p.sq_entries;
+    urp->sq_sz = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+    urp->cq_sz = p.cq_off.cqes +
+                 (p.cq_entries * sizeof(struct io_uring_cqe));
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (urp->cq_sz > urp->sq_sz)
+            urp->sq_sz = urp->cq_sz;
+        urp->cq_sz = urp->sq_sz;
+    }
+#endif
+    urp->sq_ptr = mmap(NULL, urp->sq_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, urp->fd,
+                       IORING_OFF_SQ_RING);
+    if (MAP_FAILED == urp->sq_ptr)
+        goto err_out;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        urp->cq_ptr = urp->sq_ptr;
+    else
+#endif
+    {
+        urp->cq_ptr = mmap(NULL, urp->cq_sz, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, urp->fd,
+                           IORING_OFF_CQ_RING);
+        if (MAP_FAILED == urp->cq_ptr)
+            goto err_out;
+    }
+    urp->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    urp->sqes = (struct io_uring_sqe *)mmap(NULL, urp->sqes_sz,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        urp->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == urp->sqes)
+        goto err_out;
+    urp->sq_headp = (unsigned int *)((uint8_t *)urp->sq_ptr + p.sq_off.head);
+    urp->sq_tailp = (unsigned int *)((uint8_t *)urp->sq_ptr + p.sq_off.tail);
+    urp->sq_maskp = (unsigned int *)((uint8_t *)urp->sq_ptr +
+                                     p.sq_off.ring_mask);
+    urp->sq_arrayp = (unsigned int *)((uint8_t *)urp->sq_ptr +
+                                      p.sq_off.array);
+    urp->cq_headp = (unsigned int *)((uint8_t *)urp->cq_ptr + p.cq_off.head);
+    urp->cq_tailp = (unsigned int *)((uint8_t *)urp->cq_ptr + p.cq_off.tail);
+    urp->cq_maskp = (unsigned int *)((uint8_t *)urp->cq_ptr +
+                                     p.cq_off.ring_mask);
+    urp->cqes = (struct io_uring_cqe *)((uint8_t *)urp->cq_ptr +
+                                        p.cq_off.cqes);
+    urp->sq_tail = *urp->sq_tailp;
+    return 0;
+err_out:
+    err = errno;
+    if (urp->sq_ptr && (MAP_FAILED != urp->sq_ptr))
+        munmap(urp->sq_ptr, urp->sq_sz);
+    if (urp->cq_ptr && (MAP_FAILED != urp->cq_ptr) &&
+        (urp->cq_ptr != urp->sq_ptr))
+        munmap(urp->cq_ptr, urp->cq_sz);
+    close(urp->fd);
+    urp->fd = -1;
+    return -err;
+}
+
 static void
-normal_in_operation(struct opts_t * clp, Rq_elem * rep, int blocks)
+sgp_uring_exit(struct sgp_uring * urp)
 {
-    int res, status;
-    char strerr_buff[STRERR_BUFF_LEN + 1];
+    if (urp->fd < 0)
+        return;
+    munmap(urp->sqes, urp->sqes_sz);
+    if (urp->cq_ptr != urp->sq_ptr)
+        munmap(urp->cq_ptr, urp->cq_sz);
+    munmap(urp->sq_ptr, urp->sq_sz);
+    close(urp->fd);
+    urp->fd = -1;
+}
 
-    while (((res = read(rep->infd, rep->buffp, blocks * rep->bs)) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno)))
+/* Registers the buffers of all uring_rq objects so READ_FIXED and
+ * WRITE_FIXED can be used. Returns 0 on success else a negated errno. */
+static int
+sgp_uring_reg_bufs(struct sgp_uring * urp, struct uring_rq * urqs, int num)
+{
+    int k, res;
+    struct iovec * iovp;
+
+    iovp = (struct iovec *)calloc(num, sizeof(struct iovec));
+    if (NULL == iovp)
+        return -ENOMEM;
+    for (k = 0; k < num; ++k)
+        iovp[k] = urqs[k].iov;
+    res = (int)syscall(__NR_io_uring_register, urp->fd,
+                       IORING_REGISTER_BUFFERS, iovp, num);
+    free(iovp);
+    if (res < 0)
+        return -errno;
+    urp->fixed_bufs = true;
+    return 0;
+}
+
+/* Queues a read or write of the part of the buffer in urqp not yet
+ * transferred (see urqp->done), returns false if the submission queue is
+ * full (should not happen). */
+static bool
+sgp_uring_prep_rw(struct sgp_uring * urp, struct uring_rq * urqp, int fd,
+                  bool wr, int64_t blk)
+{
+    unsigned int head, idx;
+    struct io_uring_sqe * sqep;
+    Rq_elem * rep = &urqp->rq;
+
+    head = __atomic_load_n(urp->sq_headp, __ATOMIC_ACQUIRE);
+    if ((urp->sq_tail - head) >= urp->sq_entries)
+        return false;
+    idx = urp->sq_tail & *urp->sq_maskp;
+    sqep = urp->sqes + idx;
+    memset(sqep, 0, sizeof(*sqep));
+    sqep->fd = fd;
+    sqep->off = ((uint64_t)blk * rep->bs) + urqp->done;
+    if (urp->fixed_bufs) {
+        sqep->opcode = wr ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqep->addr = (uint64_t)(uintptr_t)(rep->buffp + urqp->done);
+        sqep->len = (rep->num_blks * rep->bs) - urqp->done;
+        sqep->buf_index = (uint16_t)urqp->index;
+    } else {
+        sqep->opcode = wr ? IORING_OP_WRITEV : IORING_OP_READV;
+        urqp->iov.iov_base = rep->buffp + urqp->done;
+        urqp->iov.iov_len = (rep->num_blks * rep->bs) - urqp->done;
+        sqep->addr = (uint64_t)(uintptr_t)&urqp->iov;
+        sqep->len = 1;
+    }
+    sqep->user_data = (uint64_t)(uintptr_t)urqp;
+    urp->sq_arrayp[idx] = idx;
+    ++urp->sq_tail;
+    ++urp->to_submit;
+    urqp->state = wr ? URQ_WRITING : URQ_READING;
+    return true;
+}
+
+/* Submits queued requests and, if wait_nr > 0, waits for at least that
+ * many completions. Returns 0 on success else a negated errno value. */
+static int
+sgp_uring_submit(struct sgp_uring * urp, unsigned int wait_nr)
+{
+    int res;
+    unsigned int flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+
+    __atomic_store_n(urp->sq_tailp, urp->sq_tail, __ATOMIC_RELEASE);
+    while (((res = (int)syscall(__NR_io_uring_enter, urp->fd,
+                                urp->to_submit, wait_nr, flags, NULL,
+                                0)) < 0) && (EINTR == errno))
         ;
-    if (res < 0) {
+    if (res < 0)
+        return -errno;
+    urp->to_submit -= ((unsigned int)res > urp->to_submit) ?
+                      urp->to_submit : (unsigned int)res;
+    return 0;
+}
+
+/* Write the data a uring worker has read; via io_uring when oflag=uring,
+ * otherwise synchronously. Returns false if the worker should stop. */
+static bool
+uring_write_stage(struct opts_t * clp, struct sgp_uring * urp,
+                  struct uring_rq * urqp)
+{
+    int blocks;
+    Rq_elem * rep = &urqp->rq;
+
+    blocks = rep->num_blks;
+    if (clp->chkaddr && chkaddr_fail(clp->chkaddr, rep, blocks))
+        rep->in_err = true;
+    if (rep->in_err) {
+        /* write-side not done, so undo change to out_count */
+        stats_lock(clp);
+        clp->out_count += blocks;
+        stats_unlock(clp);
+        urqp->state = URQ_FREE;
+        return false;
+    }
+    urqp->state = URQ_FREE;
+    if ((0 == blocks) || is_exit_threads())
+        return ! rep->in_stop;
+    rep->wr = true;
+    rep->blk = urqp->out_blk;
+    if (FT_DEV_NULL == clp->out_type) {
+        stats_lock(clp);
+        clp->out_rem_count -= blocks;
+        stats_unlock(clp);
+    } else if (clp->out_flags.uring) {
+        urqp->done = 0;
+        if (! sgp_uring_prep_rw(urp, urqp, rep->outfd, true, rep->blk))
+            err_exit(EBUSY, "io_uring submission queue full");
+    } else if (FT_SG == clp->out_type)
+        sg_out_operation(clp, rep, false);
+    else
+        normal_out_operation(clp, rep, blocks, false);
+    return ! rep->out_err;
+}
+
+/* Alternative to read_write_thread() when iflag=uring and/or oflag=uring
+ * is given. Each worker keeps up to uring_qd chunks in flight using its
+ * own io_uring with registered buffers. Reads and writes are positioned
+ * so there is no need to order the writes. */
+static void *
+uring_rw_thread(void * v_tap)
+{
+    struct thread_arg * tap = (struct thread_arg *)v_tap;
+    struct opts_t * clp = &my_opts;
+    volatile bool shake_down_signalled = false;
+    bool stop = false;
+    bool failed = false;
+    int k, res, blocks, sz, qd;
+    int in_flight = 0;
+    unsigned int head, tail;
+    int64_t out_count;
+    int64_t seek_skip = tap->seek_skip;
+    struct uring_rq * urqs;
+    struct uring_rq * urqp;
+    Rq_elem * rep;
+    struct io_uring_cqe * cqep;
+    struct sgp_uring ur;
+    char b[STRERR_BUFF_LEN + 1];
+
+    qd = clp->uring_qd;
+    res = sgp_uring_init(&ur, qd);
+    if (res)
+        err_exit(-res, "io_uring_setup failed");
+    urqs = (struct uring_rq *)calloc(qd, sizeof(struct uring_rq));
+    if (NULL == urqs)
+        err_exit(ENOMEM, "out of memory creating uring requests\n");
+    sz = clp->bpt * clp->bs;
+    for (k = 0; k < qd; ++k) {
+        urqp = urqs + k;
+        urqp->index = k;
+        rep = &urqp->rq;
+        rep->bs = clp->bs;
+        rep->infd = clp->infd;
+        rep->outfd = clp->outfd;
+        rep->verbose = clp->verbose;
+        rep->cdbsz_in = clp->cdbsz_in;
+        rep->cdbsz_out = clp->cdbsz_out;
+        rep->rd_tmpl = clp->rd_tmpl;
+        rep->wr_tmpl = clp->wr_tmpl;
+        rep->in_flags = clp->in_flags;
+        rep->out_flags = clp->out_flags;
+        rep->use_no_dxfer = (FT_DEV_NULL == clp->out_type);
+        rep->buffp = sg_memalign(sz, 0 /* page align */, &rep->alloc_bp,
+                                 false);
+        if (NULL == rep->buffp)
+            err_exit(ENOMEM, "out of memory creating user buffers\n");
+        urqp->iov.iov_base = rep->buffp;
+        urqp->iov.iov_len = sz;
+    }
+    res = sgp_uring_reg_bufs(&ur, urqs, qd);
+    if (res && (clp->verbose > 1) && (0 == tap->id))
+        pr2serr("%sunable to register buffers with io_uring (%s), use "
+                "READV/WRITEV instead\n", my_name, tsafe_strerror(-res, b));
+
+    while (true) {
+        /* claim work for each free request slot, then start its read */
+        for (k = 0; (k < qd) && (! stop); ++k) {
+            urqp = urqs + k;
+            if (URQ_FREE != urqp->state)
+                continue;
+            rep = &urqp->rq;
+            if (rep->in_stop || rep->in_err || rep->out_err ||
+                is_exit_threads()) {
+                stop = true;
+                break;
+            }
+            blocks = claim_in_blocks(clp, &rep->blk, &out_count);
+            if ((blocks <= 0) || (out_count <= 0)) {
+                stop = true;
+                break;
+            }
+            rep->wr = false;
+            rep->num_blks = blocks;
+            urqp->out_blk = rep->blk + seek_skip;
+            if (clp->in_flags.uring) {
+                urqp->done = 0;
+                if (! sgp_uring_prep_rw(&ur, urqp, rep->infd, false,
+                                        rep->blk))
+                    err_exit(EBUSY, "io_uring submission queue full");
+            } else {
+                if (FT_SG == clp->in_type)
+                    sg_in_operation(clp, rep);
+                else
+                    normal_in_operation(clp, rep, blocks);
+                if (! uring_write_stage(clp, &ur, urqp))
+                    stop = true;
+            }
+        }
+        in_flight = 0;
+        for (k = 0; k < qd; ++k) {
+            if (URQ_FREE != urqs[k].state)
+                ++in_flight;
+        }
+        if (0 == in_flight) {
+            if (stop)
+                break;
+            continue;
+        }
+        res = sgp_uring_submit(&ur, 1);
+        if (res) {
+            pr2serr("%sio_uring_enter: %s\n", my_name,
+                    tsafe_strerror(-res, b));
+            failed = true;
+            break;
+        }
+        head = *ur.cq_headp;
+        tail = __atomic_load_n(ur.cq_tailp, __ATOMIC_ACQUIRE);
+        for ( ; head != tail; ++head) {
+            cqep = ur.cqes + (head & *ur.cq_maskp);
+            urqp = (struct uring_rq *)(uintptr_t)cqep->user_data;
+            rep = &urqp->rq;
+            res = cqep->res;
+            if (URQ_READING == urqp->state) {
+                /* like normal_in_operation(): retry on EINTR and EAGAIN,
+                 * continue after a short read, 0 means EOF */
+                if (res > 0)
+                    urqp->done += res;
+                if (((-EINTR == res) || (-EAGAIN == res) || (res > 0)) &&
+                    (urqp->done < rep->num_blks * rep->bs)) {
+                    if (! sgp_uring_prep_rw(&ur, urqp, rep->infd, false,
+                                            rep->blk))
+                        err_exit(EBUSY, "io_uring submission queue full");
+                    continue;
+                }
+                normal_in_complete(clp, rep, rep->num_blks, urqp->done,
+                                   (res < 0) ? -res : 0);
+                if (! uring_write_stage(clp, &ur, urqp))
+                    stop = true;
+            } else {
+                if ((-EINTR == res) || (-EAGAIN == res)) {
+                    if (! sgp_uring_prep_rw(&ur, urqp, rep->outfd, true,
+                                            rep->blk))
+                        err_exit(EBUSY, "io_uring submission queue full");
+                    continue;
+                }
+                urqp->state = URQ_FREE;
+                normal_out_complete(clp, rep, rep->num_blks,
+                                    (res < 0) ? 0 : res,
+                                    (res < 0) ? -res : 0, false);
+                if (rep->out_err)
+                    stop = true;
+            }
+        }
+        __atomic_store_n(ur.cq_headp, head, __ATOMIC_RELEASE);
+        if (! shake_down_signalled) {
+            signal_shake_down(clp);
+            shake_down_signalled = true;
+        }
+    }
+
+    for (k = 0; k < qd; ++k) {
+        rep = &urqs[k].rq;
+        if (rep->in_err || rep->out_err)
+            failed = true;
+    }
+    sgp_uring_exit(&ur);
+    if (0 == in_flight) {
+        for (k = 0; k < qd; ++k) {
+            if (urqs[k].rq.alloc_bp)
+                free(urqs[k].rq.alloc_bp);
+        }
+        free(urqs);
+    }   /* else the kernel may still be using those buffers, leak them */
+    if (failed) {
+#ifdef HAVE_C11_ATOMICS
+        if (! atomic_load(&exit_threads))
+            atomic_store(&exit_threads, true);
+#else
+        if (! exit_threads)
+            exit_threads = true;
+#endif
+    }
+    signal_shake_down(clp);
+    return failed ? NULL : clp;
+}
+
+#endif  /* SGP_HAVE_URING */
+
+/* Accounting once a read from a normal (non-sg) file has finished. 'got'
+ * is the number of bytes read, 'err' is an errno value if the read
+ * failed, else 0. */
+static void
+normal_in_complete(struct opts_t * clp, Rq_elem * rep, int blocks, int got,
+                   int err)
+{
+    int want = blocks * rep->bs;
+    char strerr_buff[STRERR_BUFF_LEN + 1];
+
+    if (err) {
         if (rep->in_flags.coe) {
             memset(rep->buffp, 0, rep->num_blks * rep->bs);
             pr2serr(">> substituted zeros for in blk=%" PRId64 " for %d "
                     "bytes, %s\n", rep->blk,
                     rep->num_blks * rep->bs,
-                    tsafe_strerror(errno, strerr_buff));
-            res = rep->num_blks * rep->bs;
+                    tsafe_strerror(err, strerr_buff));
+            got = rep->num_blks * rep->bs;
         }
         else {
             pr2serr("error in normal read, %s\n",
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             rep->in_stop = true;
             rep->in_err = true;
             return;
         }
     }
-    status = pthread_mutex_lock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
-    if (res < blocks * rep->bs) {
+    stats_lock(clp);
+    if (got < want) {
         int o_blocks = blocks;
 
         rep->in_stop = true;
-        blocks = res / rep->bs;
-        if ((res % rep->bs) > 0) {
+        blocks = got / rep->bs;
+        if ((got % rep->bs) > 0) {
             blocks++;
             clp->in_partial++;
         }
-        /* Reverse out + re-apply blocks on clp */
-        clp->in_blk -= o_blocks;
-        clp->in_count += o_blocks;
+        trim_in_blocks(clp, rep->blk, o_blocks, blocks);
         rep->num_blks = blocks;
-        clp->in_blk += blocks;
-        clp->in_count -= blocks;
     }
     clp->in_rem_count -= blocks;
-    status = pthread_mutex_unlock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
+    stats_unlock(clp);
 }
 
 static void
-normal_out_operation(struct opts_t * clp, Rq_elem * rep, int blocks,
-                     bool bump_out_blk)
+normal_in_operation(struct opts_t * clp, Rq_elem * rep, int blocks)
+{
+    int res;
+    int got = 0;
+    int want = blocks * rep->bs;
+
+    /* continue after short reads (e.g. from a pipe), 0 means EOF. Workers
+     * may complete their claims out of order so position each read when
+     * the input is seekable. */
+    do {
+        if (clp->in_seekable)
+            while (((res = pread(rep->infd, rep->buffp + got, want - got,
+                                 (off_t)rep->blk * rep->bs + got)) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno)))
+                ;
+        else
+            while (((res = read(rep->infd, rep->buffp + got,
+                                want - got)) < 0) &&
+                   ((EINTR == errno) || (EAGAIN == errno)))
+                ;
+        if (res > 0)
+            got += res;
+    } while ((res > 0) && (got < want));
+    normal_in_complete(clp, rep, blocks, got, (res < 0) ? errno : 0);
+}
+
+/* Accounting once a write to a normal (non-sg) file has finished. 'res' is
+ * the number of bytes written, 'err' is an errno value if the write
+ * failed, else 0. */
+static void
+normal_out_complete(struct opts_t * clp, Rq_elem * rep, int blocks, int res,
+                    int err, bool bump_out_blk)
 {
-    int res, status;
     char strerr_buff[STRERR_BUFF_LEN + 1];
 
-    while (((res = write(rep->outfd, rep->buffp, rep->num_blks * rep->bs))
-            < 0) && ((EINTR == errno) || (EAGAIN == errno)))
-        ;
-    if (res < 0) {
+    if (err) {
         if (rep->out_flags.coe) {
             pr2serr(">> ignored error for out blk=%" PRId64 " for %d bytes, "
                     "%s\n", rep->blk, rep->num_blks * rep->bs,
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             res = rep->num_blks * rep->bs;
         }
         else {
             pr2serr("error normal write, %s\n",
-                    tsafe_strerror(errno, strerr_buff));
+                    tsafe_strerror(err, strerr_buff));
             rep->out_err = true;
             return;
         }
     }
-    status = pthread_mutex_lock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
+    if (bump_out_blk)
+        lock_inout(clp);
+    else
+        stats_lock(clp);
     if (res < blocks * rep->bs) {
         blocks = res / rep->bs;
         if ((res % rep->bs) > 0) {
@@ -1090,87 +2259,37 @@ normal_out_operation(struct opts_t * clp, Rq_elem * rep, int blocks,
         rep->num_blks = blocks;
     }
     clp->out_rem_count -= blocks;
-    if (bump_out_blk)
+    if (bump_out_blk) {
         clp->out_blk += blocks;
-    status = pthread_mutex_unlock(&clp->inout_mutex);
-    if (0 != status) err_exit(status, "lock inout_mutex");
+        unlock_inout(clp);
+    } else
+        stats_unlock(clp);
 }
 
-static int
-sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, bool write_true, bool fua, bool dpo)
+static void
+normal_out_operation(struct opts_t * clp, Rq_elem * rep, int blocks,
+                     bool bump_out_blk)
 {
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-    int sz_ind;
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr("%sfor 6 byte commands, maximum number of blocks is "
-                    "256\n", my_name);
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr("%sfor 6 byte commands, can't address blocks beyond "
-                    "%d\n", my_name, 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr("%sfor 6 byte commands, neither dpo nor fua bits "
-                    "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr("%sfor 10 byte commands, maximum number of blocks is "
-                    "%d\n", my_name, 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        break;
-    default:
-        pr2serr("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                my_name, cdb_sz);
-        return 1;
-    }
-    return 0;
+    int res;
+    int n = rep->num_blks * rep->bs;
+
+    if (clp->out_pos_io)
+        while (((res = pwrite(rep->outfd, rep->buffp, n,
+                              (off_t)rep->blk * rep->bs)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            ;
+    else
+        while (((res = write(rep->outfd, rep->buffp, n)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            ;
+    normal_out_complete(clp, rep, blocks, res, (res < 0) ? errno : 0,
+                        bump_out_blk);
 }
 
 static void
 sg_in_operation(struct opts_t * clp, Rq_elem * rep)
 {
     int res;
-    int status;
 
     while (1) {
         res = sg_start_io(rep);
@@ -1211,19 +2330,17 @@ sg_in_operation(struct opts_t * clp, Rq_elem * rep)
 #endif
 #endif
         case 0:
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
+            stats_lock(clp);
             if (rep->dio_incomplete_count || rep->resid) {
                 clp->dio_incomplete_count += rep->dio_incomplete_count;
                 clp->sum_of_resids += rep->resid;
             }
             clp->in_rem_count -= rep->num_blks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+            stats_unlock(clp);
             return;
         case SG_LIB_CAT_ILLEGAL_REQ:
             if (clp->verbose)
-                sg_print_command_len(rep->cdb, rep->cdbsz_in);
+                sg_print_command_len(rep->rd_tmpl.cdb, rep->cdbsz_in);
             /* FALL THROUGH */
         default:
             pr2serr("error finishing sg in command (%d)\n", res);
@@ -1240,7 +2357,6 @@ static void
 sg_out_operation(struct opts_t * clp, Rq_elem * rep, bool bump_out_blk)
 {
     int res;
-    int status;
 
     while (1) {
         res = sg_start_io(rep);
@@ -1277,21 +2393,24 @@ sg_out_operation(struct opts_t * clp, Rq_elem * rep, bool bump_out_blk)
 #endif
 #endif
         case 0:
-            status = pthread_mutex_lock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "lock inout_mutex");
+            if (bump_out_blk)
+                lock_inout(clp);
+            else
+                stats_lock(clp);
             if (rep->dio_incomplete_count || rep->resid) {
                 clp->dio_incomplete_count += rep->dio_incomplete_count;
                 clp->sum_of_resids += rep->resid;
             }
             clp->out_rem_count -= rep->num_blks;
-            if (bump_out_blk)
+            if (bump_out_blk) {
                 clp->out_blk += rep->num_blks;
-            status = pthread_mutex_unlock(&clp->inout_mutex);
-            if (0 != status) err_exit(status, "unlock inout_mutex");
+                unlock_inout(clp);
+            } else
+                stats_unlock(clp);
             return;
         case SG_LIB_CAT_ILLEGAL_REQ:
             if (clp->verbose)
-                sg_print_command_len(rep->cdb, rep->cdbsz_out);
+                sg_print_command_len(rep->wr_tmpl.cdb, rep->cdbsz_out);
             /* FALL THROUGH */
         default:
             rep->out_err = true;
@@ -1307,24 +2426,21 @@ static int
 sg_start_io(Rq_elem * rep)
 {
     struct sg_io_hdr * hp = &rep->io_hdr;
-    bool fua = rep->wr ? rep->out_flags.fua : rep->in_flags.fua;
-    bool dpo = rep->wr ? rep->out_flags.dpo : rep->in_flags.dpo;
+    struct sg_rw_tmpl * tp = rep->wr ? &rep->wr_tmpl : &rep->rd_tmpl;
     bool dio = rep->wr ? rep->out_flags.dio : rep->in_flags.dio;
     bool mmap = rep->wr ? rep->out_flags.mmap : rep->in_flags.mmap;
     bool no_dxfer = rep->wr ? false : rep->use_no_dxfer;
-    int cdbsz = rep->wr ? rep->cdbsz_out : rep->cdbsz_in;
     int res;
 
-    if (sg_build_scsi_cdb(rep->cdb, cdbsz, rep->num_blks, rep->blk,
-                          rep->wr, fua, dpo)) {
+    if (sg_rw_tmpl_patch(tp, rep->blk, rep->num_blks)) {
         pr2serr("%sbad cdb build, start_blk=%" PRId64 ", blocks=%d\n",
                 my_name, rep->blk, rep->num_blks);
         return -1;
     }
     memset(hp, 0, sizeof(struct sg_io_hdr));
     hp->interface_id = 'S';
-    hp->cmd_len = cdbsz;
-    hp->cmdp = rep->cdb;
+    hp->cmd_len = tp->cdb_len;
+    hp->cmdp = tp->cdb;
     hp->dxfer_direction = rep->wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
     hp->dxfer_len = rep->bs * rep->num_blks;
     hp->dxferp = mmap ? NULL : rep->buffp;
@@ -1343,9 +2459,21 @@ sg_start_io(Rq_elem * rep)
     if (rep->verbose > 8) {
         pr2serr("%s: SCSI %s, blk=%" PRId64 " num_blks=%d\n", __func__,
                 rep->wr ? "WRITE" : "READ", rep->blk, rep->num_blks);
-        sg_print_command(hp->cmdp);
+        sg_print_command_len(hp->cmdp, hp->cmd_len);
     }
 
+    rep->start_ns = sg_pt_stats_on() ? sg_pt_stats_now_ns() : 0;
+    if (rep->wr ? rep->out_flags.emu : rep->in_flags.emu) {
+        /* executed now, sg_finish_io() only collects the result */
+        res = sg_blkemu_sg_io(rep->wr ? rep->outfd : rep->infd, hp,
+                              rep->verbose > 1 ? rep->verbose - 1 : 0);
+        if (res < 0) {
+            pr2serr("starting io on emulated device, error: %s\n",
+                    safe_strerror(-res));
+            return -1;
+        }
+        return 0;
+    }
     while (((res = write(rep->wr ? rep->outfd : rep->infd, hp,
                          sizeof(struct sg_io_hdr))) < 0) &&
            ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))) {
@@ -1380,24 +2508,40 @@ sg_finish_io(bool wr, Rq_elem * rep, pthread_mutex_t * a_mutp)
     static int testing = 0;     /* thread dubious! */
 #endif
 
-    memset(&io_hdr, 0 , sizeof(struct sg_io_hdr));
-    /* FORCE_PACK_ID active set only read packet with matching pack_id */
-    io_hdr.interface_id = 'S';
-    io_hdr.dxfer_direction = wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
-    io_hdr.pack_id = (int)rep->pack_id;
+    if (! (wr ? rep->out_flags.emu : rep->in_flags.emu)) {
+        memset(&io_hdr, 0 , sizeof(struct sg_io_hdr));
+        /* FORCE_PACK_ID active set only read packet with matching pack_id */
+        io_hdr.interface_id = 'S';
+        io_hdr.dxfer_direction = wr ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+        io_hdr.pack_id = (int)rep->pack_id;
 
-    while (((res = read(wr ? rep->outfd : rep->infd, &io_hdr,
-                        sizeof(struct sg_io_hdr))) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
-        ;
-    if (res < 0) {
-        perror("finishing io on sg device, error");
-        return -1;
-    }
-    if (rep != (Rq_elem *)io_hdr.usr_ptr)
-        err_exit(0, "sg_finish_io: bad usr_ptr, request-response mismatch\n");
-    memcpy(&rep->io_hdr, &io_hdr, sizeof(struct sg_io_hdr));
+        while (((res = read(wr ? rep->outfd : rep->infd, &io_hdr,
+                            sizeof(struct sg_io_hdr))) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+            ;
+        if (res < 0) {
+            perror("finishing io on sg device, error");
+            return -1;
+        }
+        if (rep != (Rq_elem *)io_hdr.usr_ptr)
+            err_exit(0, "sg_finish_io: bad usr_ptr, request-response "
+                     "mismatch\n");
+        memcpy(&rep->io_hdr, &io_hdr, sizeof(struct sg_io_hdr));
+    }   /* else sg_start_io() completed rep->io_hdr */
     hp = &rep->io_hdr;
+    if (rep->start_ns) {
+        /* same categories as get_scsi_pt_result_category() */
+        if (hp->host_status || (hp->driver_status & 0x7))
+            status = SCSI_PT_RESULT_TRANSPORT_ERR;
+        else if (hp->sb_len_wr > 0)
+            status = SCSI_PT_RESULT_SENSE;
+        else if (hp->status)
+            status = SCSI_PT_RESULT_STATUS;
+        else
+            status = SCSI_PT_RESULT_GOOD;
+        sg_pt_stats_record(SG_PT_STATS_KIND_SCSI, hp->cmdp, status,
+                           sg_pt_stats_now_ns() - rep->start_ns);
+    }
 
     res = sg_err_category3(hp);
     switch (res) {
@@ -1475,12 +2619,18 @@ process_flags(const char * arg, struct flags_t * fp)
             fp->dsync = true;
         else if (0 == strcmp(cp, "excl"))
             fp->excl = true;
+        else if (0 == strcmp(cp, "finish"))
+            fp->zoned = fp->finish = true;
         else if (0 == strcmp(cp, "fua"))
             fp->fua = true;
         else if (0 == strcmp(cp, "mmap"))
             fp->mmap = true;
         else if (0 == strcmp(cp, "null"))
             ;
+        else if (0 == strcmp(cp, "uring"))
+            fp->uring = true;
+        else if (0 == strcmp(cp, "zoned"))
+            fp->zoned = true;
         else {
             pr2serr("unrecognised flag: %s\n", cp);
             return 1;
@@ -1634,10 +2784,33 @@ check_progress(struct opts_t * clp)
 #endif
 }
 
+/* For bpt=auto: sets clp->bpt for the sg device open on fd, then re-sizes
+ * that device's reserved buffer. The tuning READs start at start_blk. */
+static void
+sgp_bpt_auto(int fd, int64_t start_blk, int cdbsz, struct opts_t * clp)
+{
+    int res;
+    struct sg_rw_bpt_auto ba;
+    char b[224];
+
+    res = sg_rw_bpt_auto(fd, clp->bs, cdbsz, start_blk,
+                         (dd_count > 0) ? dd_count : 0, clp->bpt, 0,
+                         (0 == clp->dry_run), &ba, clp->verbose);
+    if (res) {
+        pr2serr("%sbpt=auto failed, keep bpt=%d\n", my_name, clp->bpt);
+        return;
+    }
+    clp->bpt = ba.bpt;
+    pr2serr("%sbpt=auto: %s\n", my_name,
+            sg_rw_bpt_auto_str(&ba, clp->bs, sizeof(b), b));
+    sg_prepare(fd, clp->bs, clp->bpt);
+}
+
 
 int
 main(int argc, char * argv[])
 {
+    bool bpt_auto = false;
     bool verbose_given = false;
     bool version_given = false;
     int64_t skip = 0;
@@ -1656,6 +2829,7 @@ main(int argc, char * argv[])
     int in_sect_sz = 0;
     int out_sect_sz = 0;
     void * vp;
+    void * (* volatile rw_thread_fn)(void *) = read_write_thread;
     struct opts_t * clp = &my_opts;
     char ebuff[EBUFF_SZ];
 #if SG_LIB_ANDROID
@@ -1692,12 +2866,16 @@ main(int argc, char * argv[])
             *buf++ = '\0';
         keylen = strlen(key);
         if (0 == strcmp(key,"bpt")) {
-            clp->bpt = sg_get_num(buf);
-            if ((clp->bpt < 0) || (clp->bpt > MAX_BPT_VALUE)) {
-                pr2serr("%sbad argument to 'bpt='\n", my_name);
-                return SG_LIB_SYNTAX_ERROR;
+            if (0 == strcmp(buf, "auto"))
+                bpt_auto = true;        /* starts from default bpt */
+            else {
+                clp->bpt = sg_get_num(buf);
+                if ((clp->bpt < 0) || (clp->bpt > MAX_BPT_VALUE)) {
+                    pr2serr("%sbad argument to 'bpt='\n", my_name);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                bpt_given = 1;
             }
-            bpt_given = 1;
         } else if (0 == strcmp(key,"bs")) {
             clp->bs = sg_get_num(buf);
             if ((clp->bs < 0) || (clp->bs > MAX_BPT_VALUE)) {
@@ -1773,6 +2951,13 @@ main(int argc, char * argv[])
                 pr2serr("%sbad argument to 'oflag='\n", my_name);
                 return SG_LIB_SYNTAX_ERROR;
             }
+        } else if (0 == strcmp(key,"qd")) {
+            clp->uring_qd = sg_get_num(buf);
+            if ((clp->uring_qd < 1) || (clp->uring_qd > MAX_URING_QD)) {
+                pr2serr("%sbad argument to 'qd=', expect 1 to %d\n",
+                        my_name, MAX_URING_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
         } else if (0 == strcmp(key,"seek")) {
             seek = sg_get_llnum(buf);
             if ((seek < 0) || (seek > MAX_COUNT_SKIP_SEEK)) {
@@ -1902,6 +3087,34 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     } else if (clp->in_flags.mmap || clp->out_flags.mmap)
         clp->mmap_active = true;
+    if (clp->in_flags.uring || clp->out_flags.uring) {
+#ifdef SGP_HAVE_URING
+        if (clp->mmap_active) {
+            pr2serr("can't use uring flag together with mmap flag\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (clp->out_flags.uring && clp->out_flags.append) {
+            pr2serr("can't use oflag=uring together with oflag=append\n");
+            return SG_LIB_CONTRADICT;
+        }
+        clp->uring_active = true;
+        if (0 == clp->uring_qd)
+            clp->uring_qd = DEF_URING_QD;
+#else
+        pr2serr("uring flag given but this build lacks io_uring support\n");
+        return SG_LIB_SYNTAX_ERROR;
+#endif
+    }
+    if (clp->in_flags.zoned) {
+        pr2serr("zoned and finish flags only apply to oflag=\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (clp->out_flags.zoned && (clp->mmap_active || clp->uring_active ||
+                                 clp->out_flags.append)) {
+        pr2serr("can't use oflag=zoned together with mmap, uring or "
+                "append flags\n");
+        return SG_LIB_CONTRADICT;
+    }
     /* defaulting transfer size to 128*2048 for CD/DVDs is too large
        for the block layer in lk 2.6 and results in an EIO on the
        SG_IO ioctl. So reduce it in that case. */
@@ -1925,6 +3138,7 @@ main(int argc, char * argv[])
     clp->outfd = STDOUT_FILENO;
     if (infn[0] && ('-' != infn[0])) {
         clp->in_type = dd_filetype(infn);
+        clp->in_flags.emu = sg_blkemu_is_name(infn);
 
         if (FT_ERROR == clp->in_type) {
             pr2serr("%sunable to access %s\n", my_name, infn);
@@ -1936,6 +3150,10 @@ main(int argc, char * argv[])
             clp->infd = sg_in_open(infn, &clp->in_flags, clp->bs, clp->bpt);
             if (clp->infd < 0)
                 return -clp->infd;
+            if (bpt_auto) {
+                sgp_bpt_auto(clp->infd, skip, clp->cdbsz_in, clp);
+                bpt_auto = false;
+            }
         }
         else {
             flags = O_RDONLY;
@@ -1965,10 +3183,12 @@ main(int argc, char * argv[])
                     return sg_convert_errno(err);
                 }
             }
+            clp->in_seekable = (lseek64(clp->infd, 0, SEEK_CUR) >= 0);
         }
     }
     if (outfn[0] && ('-' != outfn[0])) {
         clp->out_type = dd_filetype(outfn);
+        clp->out_flags.emu = sg_blkemu_is_name(outfn);
         if (clp->nocopy && (! (FT_DEV_NULL & clp->out_type))) {
             pr2serr("%swants to write to %s but --nocopy given, exit\n",
                     my_name, outfn);
@@ -1982,6 +3202,10 @@ main(int argc, char * argv[])
                                      clp->bpt);
             if (clp->outfd < 0)
                 return -clp->outfd;
+            if (bpt_auto) {
+                sgp_bpt_auto(clp->outfd, seek, clp->cdbsz_out, clp);
+                bpt_auto = false;
+            }
         } else if (FT_DEV_NULL == clp->out_type) {
             clp->outfd = -1; /* don't bother opening */
             out_is_dev_null = true;
@@ -2033,6 +3257,37 @@ main(int argc, char * argv[])
     }
     if ((clp->verbose > 0) && (STDIN_FILENO == clp->infd))
         pr2serr("%sinput expected from stdin\n", my_name);
+    if (clp->uring_active) {
+        /* uring workers complete chunks out of order so both sides need
+         * positioned IO (or to be sg devices or /dev/null) */
+        if ((FT_SG != clp->out_type) && (FT_DEV_NULL != clp->out_type) &&
+            (! clp->out_flags.append))
+            clp->out_pos_io = (lseek64(clp->outfd, 0, SEEK_CUR) >= 0);
+        if ((clp->in_flags.uring && (FT_SG == clp->in_type)) ||
+            ((FT_SG != clp->in_type) && (! clp->in_seekable))) {
+            pr2serr("with uring flag IFILE must be seekable; and not sg "
+                    "if iflag=uring\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if ((clp->out_flags.uring && (FT_SG == clp->out_type)) ||
+            ((FT_SG != clp->out_type) && (FT_DEV_NULL != clp->out_type) &&
+             (! clp->out_pos_io))) {
+            pr2serr("with uring flag OFILE must be seekable; and not sg "
+                    "if oflag=uring\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    if (clp->out_flags.zoned) {
+        /* zones are copied concurrently so reads are out of order */
+        if (FT_SG != clp->out_type) {
+            pr2serr("with oflag=zoned OFILE must be a sg device\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if ((FT_SG != clp->in_type) && (! clp->in_seekable)) {
+            pr2serr("with oflag=zoned IFILE must be seekable\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
     if ((STDIN_FILENO == clp->infd) && (STDOUT_FILENO == clp->outfd)) {
         pr2serr("Won't default both IFILE to stdin _and_ OFILE to stdout\n");
         pr2serr("For more information use '--help'\n");
@@ -2068,6 +3323,13 @@ main(int argc, char * argv[])
                         "device=%d\n", infn, clp->bs, in_sect_sz);
                 in_num_sect = -1;
             }
+        } else if ((FT_OTHER == clp->in_type) && clp->in_seekable) {
+            struct stat st;
+
+            /* a regular file: copy up to its end, not to the end of OFILE
+             * (a partial last block is counted as a partial record) */
+            if ((0 == fstat(clp->infd, &st)) && S_ISREG(st.st_mode))
+                in_num_sect = (st.st_size + clp->bs - 1) / clp->bs;
         }
         if (in_num_sect > skip)
             in_num_sect -= skip;
@@ -2123,6 +3385,9 @@ main(int argc, char * argv[])
         pr2serr("Couldn't calculate count, please give one\n");
         return SG_LIB_CAT_OTHER;
     }
+    if (bpt_auto)
+        pr2serr("%sbpt=auto needs a sg device, using bpt=%d\n", my_name,
+                clp->bpt);
     if (! cdbsz_given) {
         if ((FT_SG == clp->in_type) && (MAX_SCSI_CDBSZ != clp->cdbsz_in) &&
             (((dd_count + skip) > UINT_MAX) || (clp->bpt > USHRT_MAX))) {
@@ -2138,7 +3403,25 @@ main(int argc, char * argv[])
         }
     }
 
+    if ((FT_SG == clp->in_type) &&
+        sg_rw_tmpl_init(&clp->rd_tmpl, clp->cdbsz_in, false, 0,
+                        (clp->in_flags.dpo ? SG_RW_FL_DPO : 0) |
+                        (clp->in_flags.fua ? SG_RW_FL_FUA : 0), 0)) {
+        pr2serr("%sbad read cdb: size %d (6 byte cdbs don't support dpo "
+                "or fua)\n", my_name, clp->cdbsz_in);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((FT_SG == clp->out_type) &&
+        sg_rw_tmpl_init(&clp->wr_tmpl, clp->cdbsz_out, true, 0,
+                        (clp->out_flags.dpo ? SG_RW_FL_DPO : 0) |
+                        (clp->out_flags.fua ? SG_RW_FL_FUA : 0), 0)) {
+        pr2serr("%sbad write cdb: size %d (6 byte cdbs don't support dpo "
+                "or fua)\n", my_name, clp->cdbsz_out);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
     clp->in_count = dd_count;
+    clp->in_limit = dd_count;
     clp->in_rem_count = dd_count;
     clp->skip = skip;
     clp->in_blk = skip;
@@ -2155,6 +3438,43 @@ main(int argc, char * argv[])
 
     status = pthread_cond_init(&clp->out_sync_cv, NULL);
     if (0 != status) err_exit(status, "init out_sync_cv");
+    status = pthread_mutex_init(&clp->reorder_mutex, NULL);
+    if (0 != status) err_exit(status, "init reorder_mutex");
+    status = pthread_cond_init(&clp->reorder_cv, NULL);
+    if (0 != status) err_exit(status, "init reorder_cv");
+    if ((clp->num_threads > 1) && (! clp->mmap_active) &&
+        (! clp->uring_active) && (FT_DEV_NULL != clp->out_type) &&
+        (FT_SG != clp->out_type) && (0 == clp->dry_run)) {
+        res = reorder_ring_init(clp);
+        if (res) {
+            pr2serr("%sunable to allocate reorder ring\n", my_name);
+            reorder_ring_free(clp);
+            return res;
+        }
+        if (clp->verbose > 1)
+            pr2serr("%sreorder ring of %d slots for in order writes\n",
+                    my_name, clp->reorder_sz);
+    }
+    if (clp->out_flags.zoned) {
+        uint32_t max_open;
+
+        res = zoned_init(clp, dd_count);
+        if (res) {
+            free(clp->zs_arr);
+            return res;
+        }
+        max_open = zoned_max_open(clp);
+        if ((max_open > 0) && ((uint32_t)clp->num_threads > max_open)) {
+            pr2serr("Note: thr= reduced to %u, the maximum number of open "
+                    "zones on %s\n", max_open, outfn);
+            clp->num_threads = (int)max_open;
+        }
+        if (clp->verbose)
+            pr2serr("%soflag=zoned: %d zones to write, up to %d at a "
+                    "time\n", my_name, clp->num_zs,
+                    (clp->num_zs < clp->num_threads) ? clp->num_zs :
+                                                       clp->num_threads);
+    }
 
     if (clp->dry_run > 0) {
         pr2serr("Due to --dry-run option, bypass copy/read\n");
@@ -2176,6 +3496,12 @@ main(int argc, char * argv[])
     }
     if (FT_DEV_NULL == clp->in_type)
         goto degen;     /* corner case: if=/dev/null */
+#ifdef SGP_HAVE_URING
+    if (clp->uring_active)
+        rw_thread_fn = uring_rw_thread;
+#endif
+    if (clp->out_flags.zoned)
+        rw_thread_fn = zoned_rw_thread;
 
 /* vvvvvvvvvvv  Start worker threads  vvvvvvvvvvvvvvvvvvvvvvvv */
     if ((clp->out_rem_count > 0) && (clp->num_threads > 0)) {
@@ -2185,26 +3511,30 @@ main(int argc, char * argv[])
         seek_skip = clp->seek - clp->skip;
         thr_arg_a[0].id = 0;
         thr_arg_a[0].seek_skip = seek_skip;
-        status = pthread_create(&threads[0], NULL, read_write_thread,
+        status = pthread_create(&threads[0], NULL, rw_thread_fn,
                                 (void *)(thr_arg_a + 0));
         if (0 != status) err_exit(status, "pthread_create");
         if (clp->verbose)
             pr2serr("Starting worker thread k=0\n");
 
-        /* wait for any broadcast */
+        /* wait till first thread makes progress (or exits) */
         pthread_cleanup_push(cleanup_out, (void *)clp);
-        status = pthread_cond_wait(&clp->out_sync_cv, &clp->inout_mutex);
-        if (0 != status) err_exit(status, "cond out_sync_cv");
+        while (! clp->shake_down_done) {
+            status = pthread_cond_wait(&clp->out_sync_cv,
+                                       &clp->inout_mutex);
+            if (0 != status) err_exit(status, "cond out_sync_cv");
+        }
         pthread_cleanup_pop(0);
         status = pthread_mutex_unlock(&clp->inout_mutex);
         if (0 != status) err_exit(status, "unlock out_mutex");
+        clp->count_lock_waits = true;
 
         /* now start the rest of the threads */
         for (k = 1; k < clp->num_threads; ++k) {
 
             thr_arg_a[k].id = k;
             thr_arg_a[k].seek_skip = seek_skip;
-            status = pthread_create(&threads[k], NULL, read_write_thread,
+            status = pthread_create(&threads[k], NULL, rw_thread_fn,
                                     (void *)(thr_arg_a + k));
             if (0 != status) err_exit(status, "pthread_create");
             if (clp->verbose > 2)
@@ -2221,8 +3551,11 @@ main(int argc, char * argv[])
     }   /* started worker threads and here after they have all exited */
 
 degen:
-    if (do_time && (start_tm.tv_sec || start_tm.tv_usec))
+    if (do_time && (start_tm.tv_sec || start_tm.tv_usec)) {
         calc_duration_throughput(false);
+        if (sg_pt_stats_on())
+            print_latency();
+    }
 
     if (do_sync) {
         if (FT_SG == clp->out_type) {
@@ -2257,10 +3590,18 @@ degen:
      * _join() to clear heap taken by associated _create() */
 
 fini:
-    if ((STDIN_FILENO != clp->infd) && (clp->infd >= 0))
-        close(clp->infd);
+    reorder_ring_free(clp);
+    free(clp->zs_arr);
+    if ((STDIN_FILENO != clp->infd) && (clp->infd >= 0)) {
+        if (clp->in_flags.emu)
+            scsi_pt_close_device(clp->infd);
+        else
+            close(clp->infd);
+    }
     if ((STDOUT_FILENO != clp->outfd) && (FT_DEV_NULL != clp->out_type)) {
-        if (clp->outfd >= 0)
+        if (clp->out_flags.emu)
+            scsi_pt_close_device(clp->outfd);
+        else if (clp->outfd >= 0)
             close(clp->outfd);
     }
     res = exit_status;
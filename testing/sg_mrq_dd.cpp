@@ -30,7 +30,7 @@
  *
  */
 
-static const char * version_str = "1.46 20231016";
+static const char * version_str = "1.47 20261016";
 
 #define _XOPEN_SOURCE 600
 #ifndef _GNU_SOURCE
@@ -111,6 +111,7 @@ static const char * version_str = "1.46 20231016";
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_rw.h"
 
 
 using namespace std;
@@ -2075,89 +2076,59 @@ sg_build_scsi_cdb(uint8_t * cdbp, int cdb_sz, unsigned int blocks,
                   int64_t start_block, bool ver_true, bool write_true,
                   bool fua, bool dpo, int cdl)
 {
-    bool normal_rw = true;
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int ve_opcode[] = {0xff /* no VER(6) */, 0x2f, 0xaf, 0x8f};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-    int sz_ind;
+    int res;
+    struct sg_rw_tmpl tmpl;
 
-    memset(cdbp, 0, cdb_sz);
+    if ((6 != cdb_sz) && (10 != cdb_sz) && (12 != cdb_sz) && (16 != cdb_sz)) {
+        pr2serr_lk("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
+                   my_name, cdb_sz);
+        return 1;
+    }
     if (ver_true) {     /* only support VERIFY(10) */
         if (cdb_sz < 10) {
-            pr2serr_lk("%s only support VERIFY(10)\n", my_name);
+            pr2serr_lk("%sonly support VERIFY(10)\n", my_name);
             return 1;
         }
-        cdb_sz = 10;
-        fua = false;
-        cdbp[1] |= 0x2; /* BYTCHK=1 --> sending dout for comparison */
-        cdbp[0] = ve_opcode[1];
-        normal_rw = false;
-    }
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                         rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(0x1fffff & start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (uint8_t)blocks;
-        if (blocks > 256) {
-            pr2serr_lk("%sfor 6 byte commands, maximum number of blocks is "
-                       "256\n", my_name);
+        if ((blocks & (~0xffff)) ||
+            ((uint64_t)start_block + (blocks ? blocks - 1 : 0) >
+             0xffffffff)) {
+            pr2serr_lk("%sVERIFY(10) can't reach start_blk=%" PRId64
+                       ", blocks=%u\n", my_name, start_block, blocks);
             return 1;
         }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            pr2serr_lk("%sfor 6 byte commands, can't address blocks beyond "
-                       "%d\n", my_name, 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            pr2serr_lk("%sfor 6 byte commands, neither dpo nor fua bits "
-                       "supported\n", my_name);
-            return 1;
-        }
-        break;
-    case 10:
-        if (! ver_true) {
-            sz_ind = 1;
-            cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                             rd_opcode[sz_ind]);
-        }
+        memset(cdbp, 0, cdb_sz);
+        cdbp[0] = 0x2f;
+        cdbp[1] = 0x2;  /* BYTCHK=1 --> sending dout for comparison */
+        if (dpo)
+            cdbp[1] |= 0x10;
         sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
         sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            pr2serr_lk("%sfor 10 byte commands, maximum number of blocks is "
-                       "%d\n", my_name, 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                         rd_opcode[sz_ind]);
-        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (uint8_t)(write_true ? wr_opcode[sz_ind] :
-                                         rd_opcode[sz_ind]);
-        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
-        sg_put_unaligned_be32((uint32_t)blocks, cdbp + 10);
-        if (normal_rw && (cdl > 0)) {
-            if (cdl & 0x4)
-                cdbp[1] |= 0x1;
-            if (cdl & 0x3)
-                cdbp[14] |= ((cdl & 0x3) << 6);
-        }
-        break;
-    default:
-        pr2serr_lk("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
-                   my_name, cdb_sz);
+        return 0;
+    }
+    if (sg_rw_tmpl_init(&tmpl, cdb_sz, write_true, 0,
+                        (dpo ? SG_RW_FL_DPO : 0) | (fua ? SG_RW_FL_FUA : 0),
+                        0)) {
+        pr2serr_lk("%sfor 6 byte commands, neither dpo nor fua bits "
+                   "supported\n", my_name);
+        return 1;
+    }
+    res = sg_rw_tmpl_patch(&tmpl, (uint64_t)start_block, blocks);
+    if (SG_LIB_SYNTAX_ERROR == res) {
+        pr2serr_lk("%sfor %d byte commands, %u blocks is out of range\n",
+                   my_name, cdb_sz, blocks);
         return 1;
+    } else if (res) {
+        pr2serr_lk("%sfor %d byte commands, can't address blocks %" PRId64
+                   " to %" PRId64 "\n", my_name, cdb_sz, start_block,
+                   start_block + blocks - 1);
+        return 1;
+    }
+    memcpy(cdbp, tmpl.cdb, cdb_sz);
+    if ((16 == cdb_sz) && (cdl > 0)) {
+        if (cdl & 0x4)
+            cdbp[1] |= 0x1;
+        if (cdl & 0x3)
+            cdbp[14] |= ((cdl & 0x3) << 6);
     }
     return 0;
 }
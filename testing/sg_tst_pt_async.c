@@ -0,0 +1,315 @@
+/* A test program for the asynchronous pass-through interface.
+ *  Copyright (C) 2026 D. Gilbert
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This program keeps up to QD commands outstanding on DEVICE using
+ * do_scsi_pt_submit(), waits on the file descriptor returned by
+ * get_pt_poll_fd() with poll(2) and collects completions with
+ * do_scsi_pt_reap(). It uses a single thread whatever the queue depth.
+ * TEST UNIT READY is sent by default, READ(10)s of one block (sequential
+ * from LBA 0) when --read is given.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+#include <getopt.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_pt.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+
+#define ME "sg_tst_pt_async: "
+
+static const char * version_str = "1.00 20261016";
+
+#define DEF_NUM_CMDS 1000
+#define DEF_QD 8
+#define MAX_QD 1024
+#define READ_BLK_SZ 4096        /* big enough for 512 and 4096 byte blocks */
+#define SENSE_BUFF_LEN 64
+
+struct cmd_elem {
+    struct sg_pt_base * ptp;
+    uint8_t cdb[10];
+    uint8_t sense[SENSE_BUFF_LEN];
+    uint8_t * buff;
+};
+
+static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"num", required_argument, 0, 'n'},
+        {"qd", required_argument, 0, 'q'},
+        {"read", no_argument, 0, 'r'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: sg_tst_pt_async [--help] [--num=NUM] [--qd=QD] [--read] "
+            "[--verbose]\n"
+            "                       [--version] DEVICE\n"
+            "  where:\n"
+            "    --help|-h       print usage information then exit\n"
+            "    --num=NUM|-n NUM    number of commands to issue (def: "
+            "%d)\n"
+            "    --qd=QD|-q QD    queue depth: maximum commands "
+            "outstanding (def: %d)\n"
+            "    --read|-r       send READ(10) of one block rather than "
+            "TEST UNIT READY\n"
+            "    --verbose|-v    increase verbosity\n"
+            "    --version|-V    print version string then exit\n\n"
+            "Test do_scsi_pt_submit(), do_scsi_pt_reap() and "
+            "get_pt_poll_fd(). A single\nthread keeps up to QD commands "
+            "outstanding on DEVICE.\n", DEF_NUM_CMDS, DEF_QD);
+}
+
+static void
+prep_cmd(struct cmd_elem * cep, bool do_read, uint32_t lba)
+{
+    struct sg_pt_base * ptp = cep->ptp;
+
+    partial_clear_scsi_pt_obj(ptp);
+    memset(cep->cdb, 0, sizeof(cep->cdb));
+    if (do_read) {
+        cep->cdb[0] = 0x28;     /* READ(10) */
+        sg_put_unaligned_be32(lba, cep->cdb + 2);
+        sg_put_unaligned_be16(1, cep->cdb + 7);
+        set_scsi_pt_cdb(ptp, cep->cdb, 10);
+        set_scsi_pt_data_in(ptp, cep->buff, READ_BLK_SZ);
+    } else      /* TEST UNIT READY is all zeros */
+        set_scsi_pt_cdb(ptp, cep->cdb, 6);
+    set_scsi_pt_sense(ptp, cep->sense, sizeof(cep->sense));
+}
+
+int
+main(int argc, char * argv[])
+{
+    bool do_read = false;
+    int c, k, res, cat, pfd;
+    int sg_fd = -1;
+    int num = DEF_NUM_CMDS;
+    int qd = DEF_QD;
+    int submitted = 0;
+    int completed = 0;
+    int errs = 0;
+    int max_pending = 0;
+    int ret = 0;
+    int verbose = 0;
+    const char * dev_name = NULL;
+    struct cmd_elem * arr = NULL;
+    struct sg_pt_base * ptp;
+    struct pollfd a_poll;
+    struct timespec start_tm, end_tm;
+    double secs;
+    char b[128];
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hn:q:rvV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'n':
+            num = sg_get_num(optarg);
+            if (num < 0) {
+                pr2serr("bad argument to '--num='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'q':
+            qd = sg_get_num(optarg);
+            if ((qd < 1) || (qd > MAX_QD)) {
+                pr2serr("'--qd=' expects 1 to %d\n", MAX_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            do_read = true;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            pr2serr(ME "version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        dev_name = argv[optind];
+        if (++optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (NULL == dev_name) {
+        pr2serr("missing device name!\n\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    sg_fd = scsi_pt_open_device(dev_name, true /* ro */, verbose);
+    if (sg_fd < 0) {
+        pr2serr(ME "open error: %s: %s\n", dev_name,
+                safe_strerror(-sg_fd));
+        return sg_convert_errno(-sg_fd);
+    }
+    pfd = get_pt_poll_fd(sg_fd, verbose);
+    if (pfd < 0) {
+        pr2serr(ME "get_pt_poll_fd: %s, will use blocking reaps\n",
+                safe_strerror(-pfd));
+    }
+    arr = (struct cmd_elem *)calloc(qd, sizeof(*arr));
+    if (NULL == arr) {
+        pr2serr(ME "out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < qd; ++k) {
+        arr[k].ptp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        if (NULL == arr[k].ptp) {
+            pr2serr(ME "out of memory\n");
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        if (do_read) {
+            arr[k].buff = (uint8_t *)calloc(1, READ_BLK_SZ);
+            if (NULL == arr[k].buff) {
+                pr2serr(ME "out of memory\n");
+                ret = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    /* fill the queue then submit one for each reaped */
+    for (k = 0; (k < qd) && (submitted < num); ++k, ++submitted) {
+        prep_cmd(arr + k, do_read, (uint32_t)submitted);
+        res = do_scsi_pt_submit(arr[k].ptp, sg_fd, 20, verbose);
+        if (res) {
+            pr2serr(ME "do_scsi_pt_submit: res=%d\n", res);
+            ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+            goto fini;
+        }
+    }
+    while (completed < submitted) {
+        k = get_pt_num_pending(sg_fd);
+        if (k > max_pending)
+            max_pending = k;
+        if (pfd >= 0) {
+            a_poll.fd = pfd;
+            a_poll.events = POLLIN;
+            a_poll.revents = 0;
+            res = poll(&a_poll, 1, 30 * 1000);
+            if (res < 0) {
+                pr2serr(ME "poll: %s\n", safe_strerror(errno));
+                ret = sg_convert_errno(errno);
+                goto fini;
+            } else if (0 == res) {
+                pr2serr(ME "timed out waiting, %d commands pending\n",
+                        get_pt_num_pending(sg_fd));
+                ret = SG_LIB_CAT_TIMEOUT;
+                goto fini;
+            }
+        }
+        res = do_scsi_pt_reap(sg_fd, (pfd < 0), &ptp, verbose);
+        if (-EAGAIN == res)
+            continue;
+        if (NULL == ptp) {
+            pr2serr(ME "do_scsi_pt_reap: res=%d\n", res);
+            ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+            goto fini;
+        }
+        ++completed;
+        cat = res ? -1 : get_scsi_pt_result_category(ptp);
+        if (SCSI_PT_RESULT_GOOD != cat) {
+            ++errs;
+            if (verbose) {
+                if (res)
+                    pr2serr(ME "completion: res=%d\n", res);
+                else {
+                    sg_get_scsi_status_str(get_scsi_pt_status_response(ptp),
+                                           sizeof(b), b);
+                    pr2serr(ME "completion: %s\n", b);
+                }
+            }
+        }
+        if (submitted < num) {
+            for (k = 0; k < qd; ++k) {
+                if (ptp == arr[k].ptp)
+                    break;
+            }
+            prep_cmd(arr + k, do_read, (uint32_t)submitted);
+            res = do_scsi_pt_submit(ptp, sg_fd, 20, verbose);
+            if (res) {
+                pr2serr(ME "do_scsi_pt_submit: res=%d\n", res);
+                ret = (res < 0) ? sg_convert_errno(-res) : SG_LIB_CAT_OTHER;
+                goto fini;
+            }
+            ++submitted;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_tm);
+    secs = (end_tm.tv_sec - start_tm.tv_sec) +
+           (end_tm.tv_nsec - start_tm.tv_nsec) / 1e9;
+    printf("%d commands completed, %d not good, max pending=%d\n",
+           completed, errs, max_pending);
+    if (secs > 0.0)
+        printf("elapsed time: %.3f secs, %.1f commands per second\n", secs,
+               completed / secs);
+    if (errs)
+        ret = SG_LIB_CAT_OTHER;
+fini:
+    /* reap anything still in flight before freeing its object */
+    while (get_pt_num_pending(sg_fd) > 0) {
+        if (do_scsi_pt_reap(sg_fd, true, &ptp, verbose) && (NULL == ptp))
+            break;
+    }
+    if (arr) {
+        for (k = 0; k < qd; ++k) {
+            if (arr[k].ptp)
+                destruct_scsi_pt_obj(arr[k].ptp);
+            free(arr[k].buff);
+        }
+        free(arr);
+    }
+    scsi_pt_close_device(sg_fd);
+    return ret;
+}
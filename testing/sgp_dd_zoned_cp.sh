@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Copies a regular file to an emulated zoned block device (blkemu:) with
+# 'sgp_dd oflag=zoned' and checks that the copy succeeds (exit status 0)
+# and that the data written matches. No hardware or root access needed.
+
+verbose=0
+my_name="sgp_dd_zoned_cp.sh"
+sgp_dd="../src/sgp_dd"
+bs=512
+# 32 MiB device: 32 zones of 2048 blocks, the first 2 are conventional
+emu_opts="size=32m,zone=2048,conv=2"
+
+usage()
+{
+  echo "Usage: sgp_dd_zoned_cp [-d SGP_DD] [-h] [-v]"
+  echo "  where:"
+  echo "    -d, --dd SGP_DD      sgp_dd binary to test (def: ${sgp_dd})"
+  echo "    -h, --help           print usage message"
+  echo "    -v, --verbose        more verbose output"
+  echo ""
+  echo "Copies random data to an emulated zoned device with oflag=zoned"
+  echo "and checks for exit status 0 and for identical data."
+}
+
+opt="$1"
+while test ! -z "$opt" -a -z "${opt##-*}"; do
+  opt=${opt#-}
+  case "$opt" in
+    d|-dd) shift ; sgp_dd="$1" ;;
+    h|-help) usage ; exit 0 ;;
+    v|-verbose) verbose=$((${verbose} + 1)) ;;
+    *) echo "Unknown option: -$opt " ; echo "" ; usage ;exit 1 ;;
+  esac
+  shift
+  opt="$1"
+done
+
+if [ ! -x ${sgp_dd} ]; then
+	echo "${my_name}: can't execute ${sgp_dd}, use '--dd'"
+	exit 1
+fi
+tdir=$(mktemp -d)
+trap 'rm -rf ${tdir}' EXIT
+fails=0
+
+# run_copy <source_blocks> <expect_blocks> <extra sgp_dd operands>
+run_copy()
+{
+	local src_blks=${1}
+	local exp_blks=${2}
+	shift 2
+
+	rm -f ${tdir}/dst.img
+	dd if=/dev/urandom of=${tdir}/src.bin bs=${bs} count=${src_blks} \
+	   2>/dev/null
+	if [ ${verbose} -gt 0 ]; then
+		echo ${sgp_dd} if=${tdir}/src.bin \
+		     of=blkemu:${emu_opts},file=${tdir}/dst.img bs=${bs} "$@"
+	fi
+	${sgp_dd} if=${tdir}/src.bin of=blkemu:${emu_opts},file=${tdir}/dst.img \
+		  bs=${bs} "$@" > ${tdir}/out.txt 2>&1
+	res=${?}
+	if [ ${verbose} -gt 0 ]; then
+		cat ${tdir}/out.txt
+	fi
+	if [ ${res} -ne 0 ]; then
+		echo "FAIL: exit status ${res} from: $*"
+		cat ${tdir}/out.txt
+		fails=$((${fails} + 1))
+		return
+	fi
+	if ! cmp -s -n $((${exp_blks} * ${bs})) ${tdir}/src.bin \
+	     ${tdir}/dst.img; then
+		echo "FAIL: data miscompare after: $*"
+		fails=$((${fails} + 1))
+		return
+	fi
+	echo "pass: ${src_blks} blocks, $*"
+}
+
+# source smaller than the device, ends on a zone boundary
+run_copy 32768 32768 thr=4 oflag=zoned
+# whole device
+run_copy 65536 65536 thr=4 oflag=zoned
+# ends part way through a zone, which is then finished
+run_copy 65536 30000 thr=4 count=30000 oflag=zoned,finish
+# more threads than zones to write
+run_copy 6000 6000 thr=8 bpt=100 oflag=zoned
+
+if [ ${fails} -ne 0 ]; then
+	echo "${my_name}: ${fails} failure(s)"
+	exit 1
+fi
+exit 0
@@ -20,6 +20,8 @@
 #include <inttypes.h>
 
 #include <time.h>
+#include <dirent.h>
+#include <sys/resource.h>
 
 #if defined(__GNUC__) && ! defined(SG_LIB_FREEBSD)
 #include <byteswap.h>
@@ -30,6 +32,9 @@
 #endif
 
 #include "sg_lib.h"
+#include "sg_lib_data.h"
+#include "sg_pt.h"
+#include "sg_rw.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
 
@@ -45,7 +50,7 @@
  * related to snprintf().
  */
 
-static const char * version_str = "1.21 20231119";
+static const char * version_str = "1.30 20261016";
 
 
 #define MY_NAME "tst_sg_lib"
@@ -54,15 +59,23 @@ static const char * version_str = "1.21 20231119";
 
 
 static struct option long_options[] = {
+        {"arena",  optional_argument, 0, 'A'},
+        {"asc",  optional_argument, 0, 'a'},
         {"byteswap",  required_argument, 0, 'b'},
+        {"cbor",  optional_argument, 0, 'C'},
         {"blank",  required_argument, 0, 'B'},
         {"exit", no_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
         {"hex2",  no_argument, 0, 'H'},
+        {"inhex",  optional_argument, 0, 'i'},
         {"json", optional_argument, 0, 'j'},
+        {"jstream", no_argument, 0, 'J'},
         {"leadin",  required_argument, 0, 'l'},
         {"num",  required_argument, 0, 'n'},
+        {"opcode",  optional_argument, 0, 'o'},
         {"printf", no_argument, 0, 'p'},
+        {"rw", no_argument, 0, 'r'},
+        {"scan",  required_argument, 0, 'S'},
         {"sense", no_argument, 0, 's'},
         {"unaligned", no_argument, 0, 'u'},
         {"verbose", no_argument, 0, 'v'},
@@ -156,6 +169,15 @@ static const uint8_t desc_sense_data6[] = {
     0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x1,
     };
 
+static const uint8_t fixed_sense_data1[] = {
+   /* valid, medium err, info=0x123456, additional_len=10 */
+    0xf0, 0x0, 0x3, 0x0, 0x12, 0x34, 0x56, 10,
+   /* command specific, unrecovered read error, fru=0x12 */
+    0x0, 0x0, 0x0, 0x0, 0x11, 0x0, 0x12,
+   /* sense key specific: SKSV=1, actual_count=5 */
+    0x80, 0x0, 0x5,
+    };
+
 static const char * leadin = NULL;
 
 static const char * test_str = "doe a deer, a female deer, ray, a drop of";
@@ -165,12 +187,28 @@ static void
 usage()
 {
     fprintf(stderr,
-            "Usage: tst_sg_lib [--blank=N] [--byteswap=B] [--exit] [--help] "
-            "[--hex2]\n"
-            "                  [--leadin=STR] [--printf] [--sense] "
-            "[--unaligned]\n"
-            "                  [--verbose] [--version]\n"
+            "Usage: tst_sg_lib [--arena[=DIR]] [--asc[=gen]] [--blank=N] "
+            "[--byteswap=B]\n"
+            "                  [--cbor[=DIR]] [--exit] [--help] [--hex2] "
+            "[--inhex[=FN]]\n"
+            "                  [--jstream] [--leadin=STR] [--opcode[=gen]] "
+            "[--printf]\n"
+            "                  [--rw] [--scan=BS] [--sense] [--unaligned] "
+            "[--verbose]\n"
+            "                  [--version]\n"
             "  where:\n"
+            "    --arena[=DIR]|-A[DIR]    check JSON built in an arena is "
+            "the same\n"
+            "                       as built on the heap, then time NUM "
+            "passes of\n"
+            "                       both over the *.hex files in DIR "
+            "(def: inhex)\n"
+            "    --asc|-a           check ASC/ASCQ string lookup against a "
+            "linear\n"
+            "                       scan, then time NUM passes over all "
+            "codes\n"
+            "    --asc=gen|-a gen    output the ASC/ASCQ index tables for "
+            "sg_lib_data.c\n"
 #if defined(__GNUC__) && ! defined(SG_LIB_FREEBSD)
             "    --blank=N|-B N    where N non-blank characters taken "
             "from\n"
@@ -179,18 +217,58 @@ usage()
             "byteswaps\n"
             "                         compared to sg_unaligned "
             "equivalent\n"
+            "    --cbor[=DIR]|-C[DIR]    check CBOR output (JO 'B') against "
+            "packed\n"
+            "                       JSON, then compare sizes and time NUM "
+            "passes\n"
+            "                       of each output form over the *.hex "
+            "files in DIR\n"
             "    --exit|-e          test exit status strings\n"
 #else
+            "    --cbor[=DIR]|-C[DIR]    check CBOR output (JO 'B') against "
+            "packed\n"
+            "                       JSON, then compare sizes and time NUM "
+            "passes\n"
+            "                       of each output form over the *.hex "
+            "files in DIR\n"
             "    --exit|-e          test exit status strings\n"
 #endif
             "    --help|-h          print out usage message\n"
-            "    --hex2|-H          test hex2* variants\n"
+            "    --hex2|-H          test hex2* variants, twice: also time "
+            "NUM\n"
+            "                       passes of hex dumping 1 MiB\n"
+            "    --inhex|-i         check chunked decoding of generated "
+            "ASCII\n"
+            "                       hex files, then time NUM passes\n"
+            "    --inhex=FN|-iFN    as above but decode FN (up to 4 "
+            "MiB)\n"
+            "    --jstream|-J       check streamed JSON output is the "
+            "same as\n"
+            "                       tree output, then time NUM passes of "
+            "both\n"
             "    --leadin=STR|-l STR    every line output by --sense "
             "should\n"
             "                           be prefixed by STR\n"
             "    --num=NUM|-n NUM    number of iterations (def=1)\n"
+            "    --opcode|-o        check opcode and service action name "
+            "lookup\n"
+            "                       against a linear scan, then time NUM "
+            "passes\n"
+            "    --opcode=gen|-o gen    output the opcode index tables for "
+            "sg_lib_data.c\n"
             "    --printf|-p        test library printf variants\n"
-            "    --sense|-s         test sense data handling\n"
+            "    --rw|-r            check READ/WRITE cdb templates, then "
+            "time NUM\n"
+            "                       passes of 1000 READs of an emulated "
+            "device\n"
+            "    --scan=BS|-S BS    check zero and address pattern block "
+            "scans\n"
+            "                       with block size BS, then time NUM "
+            "passes\n"
+            "    --sense|-s         test sense data handling, time NUM "
+            "passes of\n"
+            "                       sg_sense_decode() and "
+            "sg_get_sense_str()\n"
             "    --unaligned|-u     test unaligned data handling\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n\n"
@@ -223,6 +301,1797 @@ get_exit_status_str(int exit_status, bool longer, int b_len, char * b)
 static uint8_t arr[64];
 #endif
 
+#define SCAN_BLKS 128
+
+static bool
+ref_blk_is_zero(const uint8_t * bp, int blk_sz)
+{
+    int k;
+
+    for (k = 0; k < blk_sz; ++k) {
+        if (bp[k])
+            return false;
+    }
+    return true;
+}
+
+static bool
+ref_blk_has_addr(const uint8_t * bp, int blk_sz, uint32_t addr,
+                 bool first_only)
+{
+    int j;
+    int num = first_only ? 4 : (blk_sz - 3);
+
+    for (j = 0; j < num; j += 4) {
+        if (addr != sg_get_unaligned_be32(bp + j))
+            return false;
+    }
+    return true;
+}
+
+static uint32_t
+elapsed_ms(const struct timespec * start_tmp)
+{
+    struct timespec end_tm;
+
+    clock_gettime(CLOCK_MONOTONIC, &end_tm);
+    return ((end_tm.tv_sec - start_tmp->tv_sec) * 1000) +
+           ((end_tm.tv_nsec - start_tmp->tv_nsec) / 1000000);
+}
+
+/* Checks sg_blks_zero_bitmap() and sg_blks_addr_bitmap() against simple
+ * byte loops on blocks of blk_sz bytes holding a mix of zeros, address
+ * patterns and random data, then times num_passes over all zero blocks.
+ * Returns 0 if all agree, else 1 . */
+static int
+test_blk_scan(int blk_sz, int num_passes, int vb)
+{
+    bool fo, exp;
+    int k, j, pass, n, num_bad;
+    int ret = 0;
+    uint32_t addr, ms, ms_ref;
+    uint8_t * bp;
+    uint8_t * free_bp;
+    uint8_t * ubp;
+    struct timespec start_tm;
+    uint8_t bitmap[(SCAN_BLKS + 7) / 8];
+
+    printf("Test block scanning, implementation: %s, block size: %d\n",
+           sg_blk_scan_impl_str(), blk_sz);
+    free_bp = (uint8_t *)malloc((SCAN_BLKS * blk_sz) + 1);
+    if (NULL == free_bp) {
+        pr2serr("%s: out of memory\n", __func__);
+        return 1;
+    }
+    srand(blk_sz);
+    for (pass = 0; pass < 2; ++pass) {
+        ubp = free_bp + pass;   /* second pass is unaligned */
+        addr = 0x12345678;
+        for (k = 0; k < SCAN_BLKS; ++k) {
+            bp = ubp + (k * blk_sz);
+            switch (k % 5) {
+            case 0:
+                memset(bp, 0, blk_sz);
+                break;
+            case 1:
+                memset(bp, 0, blk_sz);
+                bp[rand() % blk_sz] = 1 + (rand() % 255);
+                break;
+            case 2:
+            case 3:
+                for (j = 0; j < (blk_sz - 3); j += 4)
+                    sg_put_unaligned_be32(addr + k, bp + j);
+                if (3 == (k % 5))
+                    bp[rand() % (blk_sz & ~3)] ^= (1 << (rand() % 8));
+                break;
+            default:
+                for (j = 0; j < blk_sz; ++j)
+                    bp[j] = rand();
+                break;
+            }
+        }
+        n = sg_blks_zero_bitmap(ubp, blk_sz, SCAN_BLKS, bitmap);
+        for (k = 0, num_bad = 0; k < SCAN_BLKS; ++k) {
+            exp = ref_blk_is_zero(ubp + (k * blk_sz), blk_sz);
+            if (exp != !! (bitmap[k / 8] & (1 << (k % 8))))
+                ++num_bad;
+            if (exp)
+                --n;
+        }
+        if (num_bad || n) {
+            printf("  zero bitmap: %d mismatches, count off by %d\n",
+                   num_bad, n);
+            ret = 1;
+        } else if (vb)
+            printf("  zero bitmap agrees%s\n", pass ? " (unaligned)" : "");
+        for (fo = false; ; fo = true) {
+            n = sg_blks_addr_bitmap(ubp, blk_sz, SCAN_BLKS, addr, fo,
+                                    bitmap);
+            for (k = 0, num_bad = 0; k < SCAN_BLKS; ++k) {
+                exp = ref_blk_has_addr(ubp + (k * blk_sz), blk_sz,
+                                       addr + k, fo);
+                if (exp != !! (bitmap[k / 8] & (1 << (k % 8))))
+                    ++num_bad;
+                if (exp)
+                    --n;
+            }
+            if (num_bad || n) {
+                printf("  addr bitmap%s: %d mismatches, count off by %d\n",
+                       (fo ? " (first only)" : ""), num_bad, n);
+                ret = 1;
+            } else if (vb)
+                printf("  addr bitmap%s agrees%s\n",
+                       (fo ? " (first only)" : ""),
+                       (pass ? " (unaligned)" : ""));
+            if (fo)
+                break;
+        }
+    }
+    if (0 == ret)
+        printf("  bitmaps agree with byte loops\n");
+
+    /* all zeros is the worst case: every byte must be examined */
+    memset(free_bp, 0, (SCAN_BLKS * blk_sz) + 1);
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0, n = 0; pass < num_passes; ++pass)
+        n += sg_blks_zero_bitmap(free_bp, blk_sz, SCAN_BLKS, bitmap);
+    ms = elapsed_ms(&start_tm);
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0; pass < num_passes; ++pass) {
+        for (k = 0; k < SCAN_BLKS; ++k)
+            n += ref_blk_is_zero(free_bp + (k * blk_sz), blk_sz);
+    }
+    ms_ref = elapsed_ms(&start_tm);
+    printf("  %d passes over %d zero blocks: %u ms, byte loop: %u ms "
+           "[%d]\n", num_passes, SCAN_BLKS, ms, ms_ref, n);
+    free(free_bp);
+    return ret;
+}
+
+struct rw_tmpl_case {
+    int cdb_len;
+    bool is_write;
+    int protect;
+    int flags;
+    int group_num;
+    uint64_t lba;
+    uint32_t num_blks;
+    int exp_res;        /* of sg_rw_tmpl_init(), else sg_rw_tmpl_patch() */
+    const uint8_t * exp_cdb;    /* NULL: only check exp_res */
+};
+
+static const uint8_t rw_cdb6[] = {0x8, 0x1, 0x23, 0x45, 0x0, 0x0};
+static const uint8_t rw_cdb10[] = {0x2a, 0x18, 0x12, 0x34, 0x56, 0x78, 0x5,
+                                   0x1, 0x0, 0x0};
+static const uint8_t rw_cdb12[] = {0xa8, 0x20, 0x0, 0x0, 0x10, 0x0, 0x0, 0x0,
+                                   0x0, 0x8, 0x0, 0x0};
+static const uint8_t rw_cdb16[] = {0x8a, 0x0, 0x0, 0x0, 0x0, 0x12, 0x34,
+                                   0x56, 0x78, 0x9a, 0x0, 0x1, 0x0, 0x0,
+                                   0x3f, 0x0};
+static const uint8_t rw_cdb32[] = {0x7f, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x18,
+                                   0x0, 0x9, 0x60, 0x0, 0x11, 0x22, 0x33,
+                                   0x44, 0x55, 0x66, 0x77, 0x88, 0x55, 0x66,
+                                   0x77, 0x88, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+                                   0x0, 0x4};
+
+static const struct rw_tmpl_case rw_tmpl_cases[] = {
+    {6, false, 0, 0, 0, 0x12345, 256, 0, rw_cdb6},
+    {10, true, 0, SG_RW_FL_DPO | SG_RW_FL_FUA, 5, 0x12345678, 0x100, 0,
+     rw_cdb10},
+    {12, false, 1, 0, 0, 0x1000, 8, 0, rw_cdb12},
+    {16, true, 0, 0, 0x3f, 0x123456789aULL, 0x10000, 0, rw_cdb16},
+    {32, false, 3, 0, 0, 0x1122334455667788ULL, 4, 0, rw_cdb32},
+    /* arguments sg_rw_tmpl_init() rejects */
+    {6, false, 0, SG_RW_FL_FUA, 0, 0, 1, SG_LIB_SYNTAX_ERROR, NULL},
+    {8, false, 0, 0, 0, 0, 1, SG_LIB_SYNTAX_ERROR, NULL},
+    {10, false, 8, 0, 0, 0, 1, SG_LIB_SYNTAX_ERROR, NULL},
+    {10, false, 0, 0, 64, 0, 1, SG_LIB_SYNTAX_ERROR, NULL},
+    /* edges of the LBA and TRANSFER LENGTH fields */
+    {6, false, 0, 0, 0, 0x1fffff, 1, 0, NULL},
+    {6, false, 0, 0, 0, 0x1fffff, 2, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+    {6, false, 0, 0, 0, 0, 0, SG_LIB_SYNTAX_ERROR, NULL},
+    {6, false, 0, 0, 0, 0, 257, SG_LIB_SYNTAX_ERROR, NULL},
+    {10, false, 0, 0, 0, 0xffffffff, 1, 0, NULL},
+    {10, false, 0, 0, 0, 0xfffffff0, 0x11, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+    {10, false, 0, 0, 0, 0x100000000ULL, 0, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+    {10, false, 0, 0, 0, 0, 0x10000, SG_LIB_SYNTAX_ERROR, NULL},
+    {12, true, 0, 0, 0, 0xffffff00, 0x100, 0, NULL},
+    {12, true, 0, 0, 0, 0xffffff00, 0x101, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+    {16, false, 0, 0, 0, UINT64_MAX, 1, 0, NULL},
+    {16, false, 0, 0, 0, UINT64_MAX, 2, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+    {32, true, 1, 0, 0, UINT64_MAX - 1, 3, SG_LIB_LBA_OUT_OF_RANGE, NULL},
+};
+
+#define RW_EMU_BLKS 2048        /* blkemu:size=1m with 512 byte blocks */
+#define RW_EMU_NUM 16
+
+/* Issues READs and WRITEs with sg_rw_do() to an emulated device. Returns
+ * 0 if all give the expected result, else 1 . */
+static int
+test_rw_ctx(int num_passes, int vb)
+{
+    int k, fd, res, slen;
+    int ret = 1;
+    uint32_t ms;
+    struct sg_rw_ctx * rdp = NULL;
+    struct sg_rw_ctx * wrp = NULL;
+    const uint8_t * sbp;
+    struct timespec start_tm;
+    struct sg_rw_tmpl rd_tmpl, wr_tmpl;
+    struct sg_scsi_sense_hdr ssh;
+    uint8_t wb[RW_EMU_NUM * 512];
+    uint8_t rb[RW_EMU_NUM * 512];
+
+    fd = scsi_pt_open_device("blkemu:size=1m", false, vb);
+    if (fd < 0) {
+        printf("  no emulated device (%s), skip sg_rw_do() checks\n",
+               safe_strerror(-fd));
+        return 0;
+    }
+    sg_rw_tmpl_init(&rd_tmpl, 10, false, 0, 0, 0);
+    sg_rw_tmpl_init(&wr_tmpl, 16, true, 0, SG_RW_FL_FUA, 0);
+    rdp = sg_rw_ctx_new(fd, &rd_tmpl, 512, 0, vb);
+    wrp = sg_rw_ctx_new(fd, &wr_tmpl, 512, 0, vb);
+    if ((NULL == rdp) || (NULL == wrp)) {
+        printf("  sg_rw_ctx_new() failed\n");
+        goto fini;
+    }
+    for (k = 0; k < (int)sizeof(wb); k += 4)
+        sg_put_unaligned_be32(k, wb + k);
+    res = sg_rw_do(wrp, 100, RW_EMU_NUM, wb, NULL, vb > 0);
+    if (res) {
+        printf("  WRITE(16) failed: %d\n", res);
+        goto fini;
+    }
+    memset(rb, 0xff, sizeof(rb));
+    res = sg_rw_do(rdp, 100, RW_EMU_NUM, rb, NULL, vb > 0);
+    if (res || memcmp(wb, rb, sizeof(rb))) {
+        printf("  READ(10) after WRITE(16): res=%d or data differs\n", res);
+        goto fini;
+    }
+    /* straddles the end of the device: expect ILLEGAL REQUEST, LBA out
+     * of range */
+    res = sg_rw_do(rdp, RW_EMU_BLKS - 1, 2, rb, NULL, false);
+    sbp = sg_rw_get_sense(rdp, &slen);
+    if ((SG_LIB_LBA_OUT_OF_RANGE != res) ||
+        (! sg_scsi_normalize_sense(sbp, slen, &ssh)) || (0x21 != ssh.asc)) {
+        printf("  READ(10) past end: res=%d, sense length=%d\n", res, slen);
+        goto fini;
+    }
+    /* sense must not stick to the next good command */
+    res = sg_rw_do(rdp, 0, 1, rb, NULL, vb > 0);
+    sg_rw_get_sense(rdp, &slen);
+    if (res || slen) {
+        printf("  READ(10) after error: res=%d, sense length=%d\n", res,
+               slen);
+        goto fini;
+    }
+    if (SG_LIB_LBA_OUT_OF_RANGE != sg_rw_do(rdp, 0xffffffff, 2, rb, NULL,
+                                            false)) {
+        printf("  READ(10) with LBA overflow not rejected\n");
+        goto fini;
+    }
+    printf("  sg_rw_do() checks ok\n");
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (k = 0; k < num_passes * 1000; ++k) {
+        if (sg_rw_do(rdp, (k * 8) % RW_EMU_BLKS, 8, rb, NULL, false)) {
+            printf("  READ(10) failed at k=%d\n", k);
+            goto fini;
+        }
+    }
+    ms = elapsed_ms(&start_tm);
+    printf("  %d READ(10)s of 8 blocks: %u ms\n", num_passes * 1000, ms);
+    ret = 0;
+fini:
+    sg_rw_ctx_free(rdp);
+    sg_rw_ctx_free(wrp);
+    scsi_pt_close_device(fd);
+    return ret;
+}
+
+/* bpt chosen by sg_rw_bpt_auto() without a ramp, for emulated devices
+ * reporting various OPTIMAL TRANSFER LENGTHs. def_bpt=128, max_bpt=256 */
+static const struct rw_bpt_case {
+    const char * dev_name;
+    int exp_bpt;
+} rw_bpt_cases[] = {
+    {"blkemu:size=1m", 128},            /* none reported, use def_bpt */
+    {"blkemu:size=1m,oxl=64", 64},
+    {"blkemu:size=1m,oxl=4096", 256},   /* too large, clamp to max_bpt */
+};
+
+/* Returns 0 if sg_rw_bpt_auto() chooses the expected bpt for each entry
+ * in rw_bpt_cases[], else 1 . */
+static int
+test_rw_bpt_auto(int vb)
+{
+    int k, fd, res;
+    int ret = 0;
+    struct sg_rw_bpt_auto ba;
+
+    for (k = 0; k < (int)SG_ARRAY_SIZE(rw_bpt_cases); ++k) {
+        const struct rw_bpt_case * rp = rw_bpt_cases + k;
+
+        fd = scsi_pt_open_device(rp->dev_name, true, vb);
+        if (fd < 0) {
+            printf("  no emulated device (%s), skip sg_rw_bpt_auto() "
+                   "checks\n", safe_strerror(-fd));
+            return 0;
+        }
+        res = sg_rw_bpt_auto(fd, 512, 10, 0, 0, 128, 256, false, &ba, vb);
+        scsi_pt_close_device(fd);
+        if (res || (rp->exp_bpt != ba.bpt)) {
+            printf("  sg_rw_bpt_auto(%s): res=%d, bpt=%d, expected %d\n",
+                   rp->dev_name, res, ba.bpt, rp->exp_bpt);
+            ret = 1;
+        }
+    }
+    if (0 == ret)
+        printf("  sg_rw_bpt_auto() checks ok\n");
+    return ret;
+}
+
+/* Checks sg_rw_tmpl_init() and sg_rw_tmpl_patch() against known cdbs and
+ * range limits, then sg_rw_do() and sg_rw_bpt_auto() against emulated
+ * devices (if available). Returns 0 if all agree, else 1 . */
+static int
+test_rw_tmpl(int num_passes, int vb)
+{
+    int k, res;
+    int ret = 0;
+    struct sg_rw_tmpl tmpl;
+    char b[128];
+
+    printf("Test READ/WRITE cdb templates:\n");
+    for (k = 0; k < (int)SG_ARRAY_SIZE(rw_tmpl_cases); ++k) {
+        const struct rw_tmpl_case * rp = rw_tmpl_cases + k;
+
+        res = sg_rw_tmpl_init(&tmpl, rp->cdb_len, rp->is_write, rp->protect,
+                              rp->flags, rp->group_num);
+        if (0 == res) {
+            /* patch twice: the second must overwrite all of the first */
+            sg_rw_tmpl_patch(&tmpl, ~rp->lba, ~rp->num_blks & 0xff);
+            res = sg_rw_tmpl_patch(&tmpl, rp->lba, rp->num_blks);
+        }
+        if (res != rp->exp_res) {
+            printf("  case %d: %d byte cdb, lba=0x%" PRIx64 ", num=%u: "
+                   "got %d, expected %d\n", k, rp->cdb_len, rp->lba,
+                   rp->num_blks, res, rp->exp_res);
+            ret = 1;
+        } else if (rp->exp_cdb &&
+                   ((tmpl.cdb_len != rp->cdb_len) ||
+                    memcmp(tmpl.cdb, rp->exp_cdb, rp->cdb_len))) {
+            printf("  case %d: got cdb %s\n", k,
+                   sg_get_command_str(tmpl.cdb, tmpl.cdb_len, false,
+                                      sizeof(b), b));
+            ret = 1;
+        } else if (vb)
+            printf("  case %d: ok\n", k);
+    }
+    if (0 == ret)
+        printf("  %d template cases ok\n", (int)SG_ARRAY_SIZE(rw_tmpl_cases));
+    if (test_rw_ctx(num_passes, vb))
+        ret = 1;
+    if (test_rw_bpt_auto(vb))
+        ret = 1;
+    return ret;
+}
+
+/* What sg_get_additional_sense_str() did before it had an index: scan both
+ * tables from start to end, the last match wins */
+static char *
+ref_asc_ascq_str(int asc, int ascq, bool leadin, int buff_len, char * buff)
+{
+    bool found = false;
+    int k, num, rlen;
+
+    for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
+        const struct sg_lib_asc_ascq_range_t * ei2p =
+                                        &sg_lib_asc_ascq_range[k];
+
+        if ((ei2p->asc == asc) && (ascq >= ei2p->ascq_min)  &&
+            (ascq <= ei2p->ascq_max)) {
+            found = true;
+            num = leadin ? sg_scnpr(buff, buff_len, "Additional sense: ") : 0;
+            rlen = buff_len - num;
+            sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text, ascq);
+        }
+    }
+    if (found)
+        return buff;
+    for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
+        const struct sg_lib_asc_ascq_t * eip = &sg_lib_asc_ascq[k];
+
+        if (eip->asc == asc && eip->ascq == ascq) {
+            found = true;
+            if (leadin)
+                sg_scnpr(buff, buff_len, "Additional sense: %s", eip->text);
+            else
+                sg_scnpr(buff, buff_len, "%s", eip->text);
+        }
+    }
+    if (! found) {
+        if (asc >= 0x80)
+            sg_scnpr(buff, buff_len, "vendor specific ASC=%02x, ASCQ=%02x "
+                     "(hex)", asc, ascq);
+        else if (ascq >= 0x80)
+            sg_scnpr(buff, buff_len, "ASC=%02x, vendor specific qualification "
+                     "ASCQ=%02x (hex)", asc, ascq);
+        else
+            sg_scnpr(buff, buff_len, "ASC=%02x, ASCQ=%02x (hex)", asc, ascq);
+    }
+    return buff;
+}
+
+/* Outputs sg_lib_asc_ascq_idx[] and sg_lib_asc_ascq_range_map[] as they
+ * should appear in sg_lib_data.c . Returns 1 if sg_lib_asc_ascq[] is not
+ * sorted (so can not be indexed), else 0 . */
+static int
+gen_asc_idx(void)
+{
+    int k, asc, n;
+    uint8_t map[32];
+
+    for (k = 1; sg_lib_asc_ascq[k].text; ++k) {
+        const struct sg_lib_asc_ascq_t * eip = &sg_lib_asc_ascq[k];
+
+        if ((eip->asc < eip[-1].asc) ||
+            ((eip->asc == eip[-1].asc) && (eip->ascq <= eip[-1].ascq))) {
+            pr2serr("sg_lib_asc_ascq[%d] (0x%x,0x%x) out of order\n", k,
+                    eip->asc, eip->ascq);
+            return 1;
+        }
+    }
+    printf("const uint16_t sg_lib_asc_ascq_idx[257] =\n{");
+    for (asc = 0, k = 0; asc < 256; ++asc) {
+        for ( ; sg_lib_asc_ascq[k].text && (sg_lib_asc_ascq[k].asc < asc);
+             ++k)
+            ;
+        if (0 == (asc % 8))
+            printf("%s\n    /* 0x%02x */ %d", (asc ? "," : ""), asc, k);
+        else
+            printf(", %d", k);
+    }
+    for ( ; sg_lib_asc_ascq[k].text; ++k)
+        ;
+    printf(",\n    /* end */  %d\n};\n\n", k);
+    memset(map, 0, sizeof(map));
+    for (k = 0; sg_lib_asc_ascq_range[k].text; ++k) {
+        n = sg_lib_asc_ascq_range[k].asc;
+        map[n >> 3] |= (1 << (n & 0x7));
+    }
+    printf("const uint8_t sg_lib_asc_ascq_range_map[32] =\n{\n");
+    for (k = 0; k < 32; ++k)
+        printf("%s0x%02x%s", ((0 == (k % 8)) ? "    " : " "), map[k],
+               ((31 == k) ? "\n" : ((7 == (k % 8)) ? ",\n" : ",")));
+    printf("};\n");
+    return 0;
+}
+
+/* Checks sg_get_additional_sense_str() against ref_asc_ascq_str() for every
+ * ASC and ASCQ pair, then times num_passes over all defined codes with
+ * each. Returns 0 if all agree, else 1 . */
+static int
+test_asc_lookup(int num_passes, int vb)
+{
+    int k, asc, ascq, pass, num_bad, num_codes;
+    uint32_t ms, ms_ref;
+    uint64_t sum;
+    struct timespec start_tm;
+    char b[256];
+    char bb[256];
+
+    printf("Test ASC/ASCQ string lookup\n");
+    for (asc = 0, num_bad = 0; asc < 256; ++asc) {
+        for (ascq = 0; ascq < 256; ++ascq) {
+            for (k = 0; k < 2; ++k) {
+                sg_get_additional_sense_str(asc, ascq, !! k, sizeof(b), b);
+                ref_asc_ascq_str(asc, ascq, !! k, sizeof(bb), bb);
+                if (strcmp(b, bb)) {
+                    ++num_bad;
+                    if (vb)
+                        printf("  0x%02x,0x%02x: '%s' versus '%s'\n", asc,
+                               ascq, b, bb);
+                }
+            }
+        }
+    }
+    if (num_bad) {
+        printf("  %d mismatches, run 'tst_sg_lib --asc=gen'\n", num_bad);
+        return 1;
+    }
+    printf("  all 65536 ASC/ASCQ pairs agree with linear scan\n");
+
+    for (num_codes = 0; sg_lib_asc_ascq[num_codes].text; ++num_codes)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0, sum = 0; pass < num_passes; ++pass) {
+        for (k = 0; k < num_codes; ++k)
+            sum += strlen(sg_get_additional_sense_str(sg_lib_asc_ascq[k].asc,
+                                                      sg_lib_asc_ascq[k].ascq,
+                                                      false, sizeof(b), b));
+    }
+    ms = elapsed_ms(&start_tm);
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0; pass < num_passes; ++pass) {
+        for (k = 0; k < num_codes; ++k)
+            sum += strlen(ref_asc_ascq_str(sg_lib_asc_ascq[k].asc,
+                                           sg_lib_asc_ascq[k].ascq, false,
+                                           sizeof(b), b));
+    }
+    ms_ref = elapsed_ms(&start_tm);
+    printf("  %d passes over %d codes: %u ms, linear scan: %u ms [%" PRIu64
+           "]\n", num_passes, num_codes, ms, ms_ref, sum);
+    return 0;
+}
+
+/* What get_value_name() in sg_lib.c does, and what it did for all opcode
+ * name lookups before they were indexed by PDT class */
+static const struct sg_lib_value_name_t *
+ref_value_name(const struct sg_lib_value_name_t * arr, int value,
+               int peri_type)
+{
+    const struct sg_lib_value_name_t * vp = arr;
+    const struct sg_lib_value_name_t * holdp;
+
+    if (peri_type < 0)
+        peri_type = 0;
+    for (; vp->name; ++vp) {
+        if (value == vp->value) {
+            if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
+                return vp;
+            holdp = vp;
+            while ((vp + 1)->name && (value == (vp + 1)->value)) {
+                ++vp;
+                if (sg_pdt_s_eq(peri_type, vp->peri_dev_type))
+                    return vp;
+            }
+            return holdp;
+        }
+    }
+    return NULL;
+}
+
+static void
+ref_opcode_name(uint8_t cmd_byte0, int peri_type, int buff_len, char * buff)
+{
+    const struct sg_lib_value_name_t * vnp;
+    int grp;
+
+    if (SG_VARIABLE_LENGTH_CMD == cmd_byte0) {
+        sg_scnpr(buff, buff_len, "%s", "Variable length");
+        return;
+    }
+    grp = (cmd_byte0 >> 5) & 0x7;
+    switch (grp) {
+    case 0:
+    case 1:
+    case 2:
+    case 4:
+    case 5:
+        vnp = ref_value_name(sg_lib_normal_opcodes, cmd_byte0, peri_type);
+        if (vnp)
+            sg_scnpr(buff, buff_len, "%s", vnp->name);
+        else
+            sg_scnpr(buff, buff_len, "Opcode=0x%x", (int)cmd_byte0);
+        break;
+    case 3:
+        sg_scnpr(buff, buff_len, "Reserved [0x%x]", (int)cmd_byte0);
+        break;
+    case 6:
+    case 7:
+        sg_scnpr(buff, buff_len, "Vendor specific [0x%x]", (int)cmd_byte0);
+        break;
+    }
+}
+
+struct ref_op_code2sa_t {
+    int op_code;
+    int pdt_s;
+    const struct sg_lib_value_name_t * arr;
+    const char * prefix;
+};
+
+/* Copy of the table sg_get_opcode_sa_name() scanned before it was indexed
+ * by opcode */
+static const struct ref_op_code2sa_t ref_op_code2sa_arr[] = {
+    {SG_VARIABLE_LENGTH_CMD, PDT_ALL, sg_lib_variable_length_arr, NULL},
+    {SG_MAINTENANCE_IN, PDT_ALL, sg_lib_maint_in_arr, NULL},
+    {SG_MAINTENANCE_OUT, PDT_ALL, sg_lib_maint_out_arr, NULL},
+    {SG_SERVICE_ACTION_IN_12, PDT_ALL, sg_lib_serv_in12_arr, NULL},
+    {SG_SERVICE_ACTION_OUT_12, PDT_ALL, sg_lib_serv_out12_arr, NULL},
+    {SG_SERVICE_ACTION_IN_16, PDT_ALL, sg_lib_serv_in16_arr, NULL},
+    {SG_SERVICE_ACTION_OUT_16, PDT_ALL, sg_lib_serv_out16_arr, NULL},
+    {SG_SERVICE_ACTION_BIDI, PDT_ALL, sg_lib_serv_bidi_arr, NULL},
+    {SG_PERSISTENT_RESERVE_IN, PDT_ALL, sg_lib_pr_in_arr,
+     "Persistent reserve in"},
+    {SG_PERSISTENT_RESERVE_OUT, PDT_ALL, sg_lib_pr_out_arr,
+     "Persistent reserve out"},
+    {SG_3PARTY_COPY_OUT, PDT_ALL, sg_lib_xcopy_sa_arr, NULL},
+    {SG_3PARTY_COPY_IN, PDT_ALL, sg_lib_rec_copy_sa_arr, NULL},
+    {SG_READ_BUFFER, PDT_ALL, sg_lib_read_buff_arr, "Read buffer(10)"},
+    {SG_READ_BUFFER_16, PDT_ALL, sg_lib_read_buff_arr, "Read buffer(16)"},
+    {SG_READ_ATTRIBUTE, PDT_ALL, sg_lib_read_attr_arr, "Read attribute"},
+    {SG_READ_POSITION, PDT_TAPE, sg_lib_read_pos_arr, "Read position"},
+    {SG_SANITIZE, PDT_DISK_ZBC, sg_lib_sanitize_sa_arr, "Sanitize"},
+    {SG_WRITE_BUFFER, PDT_ALL, sg_lib_write_buff_arr, "Write buffer"},
+    {SG_ZONING_IN, PDT_DISK_ZBC, sg_lib_zoning_in_arr, NULL},
+    {SG_ZONING_OUT, PDT_DISK_ZBC, sg_lib_zoning_out_arr, NULL},
+    {0xffff, -1, NULL, NULL},
+};
+
+static void
+ref_opcode_sa_name(uint8_t cmd_byte0, int service_action, int peri_type,
+                   int buff_len, char * buff)
+{
+    int d_pdt;
+    const struct sg_lib_value_name_t * vnp;
+    const struct ref_op_code2sa_t * osp;
+    char b[80];
+
+    if (peri_type < 0)
+        peri_type = 0;
+    d_pdt = sg_lib_pdt_decay(peri_type);
+    for (osp = ref_op_code2sa_arr; osp->arr; ++osp) {
+        if ((int)cmd_byte0 == osp->op_code) {
+            if (sg_pdt_s_eq(osp->pdt_s, d_pdt)) {
+                vnp = ref_value_name(osp->arr, service_action, peri_type);
+                if (vnp) {
+                    if (osp->prefix)
+                        sg_scnpr(buff, buff_len, "%s, %s", osp->prefix,
+                                 vnp->name);
+                    else
+                        sg_scnpr(buff, buff_len, "%s", vnp->name);
+                } else {
+                    ref_opcode_name(cmd_byte0, peri_type, sizeof(b), b);
+                    sg_scnpr(buff, buff_len, "%s service action=0x%x", b,
+                             service_action);
+                }
+            } else
+                ref_opcode_name(cmd_byte0, peri_type, buff_len, buff);
+            return;
+        }
+    }
+    ref_opcode_name(cmd_byte0, peri_type, buff_len, buff);
+}
+
+/* Outputs sg_lib_normal_opcodes_pdt_class[] and sg_lib_normal_opcodes_idx[]
+ * as they should appear in sg_lib_data.c . Each PDT whose opcode to name
+ * mapping differs from those of all lower PDTs starts a new class. Returns
+ * 1 if sg_lib_normal_opcodes[] is too long to be indexed, else 0 . */
+static int
+gen_opcode_idx(void)
+{
+    int k, n, pdt, opc, num_cls;
+    int cls[PDT_MAX + 1];
+    uint16_t * rows;
+    const struct sg_lib_value_name_t * vnp;
+    char b[64];
+
+    for (n = 0; sg_lib_normal_opcodes[n].name; ++n)
+        ;
+    if (n > 0xfffe) {
+        pr2serr("sg_lib_normal_opcodes[] has too many (%d) entries\n", n);
+        return 1;
+    }
+    rows = (uint16_t *)calloc((PDT_MAX + 1) * 256, sizeof(uint16_t));
+    if (NULL == rows) {
+        pr2serr("%s: out of memory\n", __func__);
+        return 1;
+    }
+    for (pdt = 0, num_cls = 0; pdt <= PDT_MAX; ++pdt) {
+        uint16_t * rp = rows + (num_cls * 256);
+
+        for (opc = 0; opc < 256; ++opc) {
+            vnp = ref_value_name(sg_lib_normal_opcodes, opc, pdt);
+            rp[opc] = vnp ? (uint16_t)(vnp - sg_lib_normal_opcodes + 1) : 0;
+        }
+        for (k = 0; k < num_cls; ++k) {
+            if (0 == memcmp(rows + (k * 256), rp, 256 * sizeof(uint16_t)))
+                break;
+        }
+        cls[pdt] = k;
+        if (k == num_cls)
+            ++num_cls;
+    }
+    printf("const uint8_t sg_lib_normal_opcodes_pdt_class[32] =\n{\n");
+    for (k = 0; k <= PDT_MAX; ++k)
+        printf("%s%d%s", ((0 == (k % 8)) ? "    " : " "), cls[k],
+               ((PDT_MAX == k) ? "\n" : ((7 == (k % 8)) ? ",\n" : ",")));
+    printf("};\n\nconst uint16_t sg_lib_normal_opcodes_idx[%d][256] =\n{",
+           num_cls);
+    for (k = 0; k < num_cls; ++k) {
+        for (pdt = 0; cls[pdt] != k; ++pdt)
+            ;
+        printf("%s\n    {   /* class %d: %s */", (k ? "," : ""), k,
+               sg_get_pdt_str(pdt, sizeof(b), b));
+        for (opc = 0; opc < 256; ++opc) {
+            if (0 == (opc % 8))
+                printf("%s\n        /* 0x%02x */ %d", (opc ? "," : ""), opc,
+                       rows[(k * 256) + opc]);
+            else
+                printf(", %d", rows[(k * 256) + opc]);
+        }
+        printf("\n    }");
+    }
+    printf("\n};\n");
+    free(rows);
+    return 0;
+}
+
+/* Returns 1 if sg_get_opcode_sa_name() and ref_opcode_sa_name() disagree,
+ * else 0 */
+static int
+cmp_opcode_sa_name(int opc, int sa, int pdt, int vb)
+{
+    char b[128];
+    char bb[128];
+
+    sg_get_opcode_sa_name(opc, sa, pdt, sizeof(b), b);
+    ref_opcode_sa_name(opc, sa, pdt, sizeof(bb), bb);
+    if (0 == strcmp(b, bb))
+        return 0;
+    if (vb)
+        printf("  opcode=0x%02x sa=0x%x pdt=%d: '%s' versus '%s'\n", opc, sa,
+               pdt, b, bb);
+    return 1;
+}
+
+/* Checks sg_get_opcode_name() and sg_get_opcode_sa_name() against the
+ * linear scans they replaced for every opcode and PDT (and service actions
+ * 0 to 0x1f, plus those in the variable length table), then times
+ * num_passes over all opcodes with each. Returns 0 if all agree, else 1 . */
+static int
+test_opcode_lookup(int num_passes, int vb)
+{
+    int k, pdt, opc, pass, num_bad, num_calls;
+    uint32_t ms, ms_ref;
+    uint64_t sum;
+    struct timespec start_tm;
+    char b[128];
+    char bb[128];
+    static const int pdt_arr[] = {-1, PDT_DISK_ZBC, 0x7f};
+
+    printf("Test opcode and service action name lookup\n");
+    for (pdt = -1, num_bad = 0, num_calls = 0; pdt <= PDT_MAX + 3; ++pdt) {
+        int pt = (pdt > PDT_MAX) ? pdt_arr[pdt - (PDT_MAX + 1)] : pdt;
+
+        for (opc = 0; opc < 256; ++opc) {
+            sg_get_opcode_name(opc, pt, sizeof(b), b);
+            ref_opcode_name(opc, pt, sizeof(bb), bb);
+            ++num_calls;
+            if (strcmp(b, bb)) {
+                ++num_bad;
+                if (vb)
+                    printf("  opcode=0x%02x pdt=%d: '%s' versus '%s'\n", opc,
+                           pt, b, bb);
+            }
+            for (k = 0; k < 0x20; ++k)
+                num_bad += cmp_opcode_sa_name(opc, k, pt, vb);
+            num_calls += 0x20;
+            if (SG_VARIABLE_LENGTH_CMD != opc)
+                continue;
+            for (k = 0; sg_lib_variable_length_arr[k].name; ++k, ++num_calls)
+                num_bad += cmp_opcode_sa_name(opc,
+                                    sg_lib_variable_length_arr[k].value, pt,
+                                    vb);
+        }
+    }
+    if (num_bad) {
+        printf("  %d mismatches, run 'tst_sg_lib --opcode=gen'\n", num_bad);
+        return 1;
+    }
+    printf("  all %d opcode, service action and PDT combinations agree with "
+           "linear scan\n", num_calls);
+
+    num_calls = num_passes * 2 * 256;
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0, sum = 0; pass < num_passes; ++pass) {
+        for (opc = 0; opc < 256; ++opc) {
+            sg_get_opcode_name(opc, pass & PDT_MAX, sizeof(b), b);
+            sum += b[0];
+            sg_get_opcode_sa_name(opc, pass & 0x1f, PDT_DISK, sizeof(b), b);
+            sum += b[0];
+        }
+    }
+    ms = elapsed_ms(&start_tm);
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0; pass < num_passes; ++pass) {
+        for (opc = 0; opc < 256; ++opc) {
+            ref_opcode_name(opc, pass & PDT_MAX, sizeof(b), b);
+            sum += b[0];
+            ref_opcode_sa_name(opc, pass & 0x1f, PDT_DISK, sizeof(b), b);
+            sum += b[0];
+        }
+    }
+    ms_ref = elapsed_ms(&start_tm);
+    printf("  %d passes over 256 opcodes: %u ms, linear scan: %u ms "
+           "[%" PRIu64 "]\n", num_passes, ms, ms_ref, sum);
+    if (num_calls > 0)
+        printf("  per call: %.1f ns, linear scan: %.1f ns\n",
+               (ms * 1e6) / num_calls, (ms_ref * 1e6) / num_calls);
+    return 0;
+}
+
+/* What sg_sense_decode() should find in each test sense buffer, taken
+ * from the comments beside the bytes. Descriptor types end at a 0xff . */
+static const struct sense_exp {
+    const uint8_t * sbp;
+    int sb_len;
+    uint8_t resp_code;
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t ascq;
+    bool info_valid;
+    bool sks_valid;
+    bool ili;
+    uint8_t fru;
+    uint8_t sks[3];
+    int progress;               /* -1 for not present */
+    int64_t info;               /* -1 for not present */
+    int64_t cmd_spec;           /* -1 for not present */
+    uint8_t desc_types[8];
+} sense_exps[] = {
+    {desc_sense_data1, (int)sizeof(desc_sense_data1), 0x72, 0x1, 0x3, 0x2,
+     true, true, true, 0x45, {0x80, 0x1, 0x1}, 0x3201, 0x11223344556677bb,
+     0x3344556677bbccff, {0x0, 0x1, 0x2, 0x3, 0xa, 0x5, 0xb, 0xff}},
+    {desc_sense_data2, (int)sizeof(desc_sense_data2), 0x72, 0x5, 0x26, 0x0,
+     false, true, false, 0x45, {0x8f, 0x0, 0x34}, -1, -1, -1,
+     {0x2, 0x3, 0xff}},
+    {desc_sense_data3, (int)sizeof(desc_sense_data3), 0x72, 0x3, 0x9, 0x5,
+     true, true, true, 0x45, {0x80, 0x1, 0x1}, -1, 0x1122334455, 0x1,
+     {0xd, 0xe, 0xff}},
+    {desc_sense_data4, (int)sizeof(desc_sense_data4), 0x72, 0x5, 0x26, 0x0,
+     false, false, false, 0x0, {0x0, 0x0, 0x0}, -1, -1, -1, {0xc, 0xff}},
+    {desc_sense_data5, (int)sizeof(desc_sense_data5), 0x72, 0x0, 0x0, 0x1d,
+     false, false, false, 0x0, {0x0, 0x0, 0x0}, -1, -1, -1,
+     {0x9, 0x9, 0xff}},
+    {desc_sense_data6, (int)sizeof(desc_sense_data6), 0x72, 0x6, 0x3f, 0x1a,
+     true, false, false, 0x0, {0x0, 0x0, 0x0}, -1, 0x1000000000000, 0x1,
+     {0xe, 0x0, 0x1, 0xff}},
+    {fixed_sense_data1, (int)sizeof(fixed_sense_data1), 0x70, 0x3, 0x11,
+     0x0, true, true, false, 0x12, {0x80, 0x0, 0x5}, -1, 0x123456, 0x0,
+     {0xff}},
+};
+
+/* Returns the number of differences between *sdp and *ep, printing
+ * each. Descriptors must also point at their own type and length bytes
+ * in the sense buffer, and sg_scsi_normalize_sense() must agree. */
+static int
+sense_decode_check(int k, const struct sg_sense_decoded * sdp,
+                   const struct sense_exp * ep)
+{
+    int j, n;
+    int bad = 0;
+    struct sg_scsi_sense_hdr ssh;
+
+#define SD_CHK(cond, ...) \
+    do { if (! (cond)) { printf("  %d: ", k + 1); printf(__VA_ARGS__); \
+                         printf("\n"); ++bad; } } while (0)
+
+    SD_CHK(sdp->response_code == ep->resp_code, "resp_code=0x%x, expected "
+           "0x%x", sdp->response_code, ep->resp_code);
+    SD_CHK((sdp->sense_key == ep->sense_key) && (sdp->asc == ep->asc) &&
+           (sdp->ascq == ep->ascq), "sk,asc,ascq=0x%x,0x%x,0x%x, expected "
+           "0x%x,0x%x,0x%x", sdp->sense_key, sdp->asc, sdp->ascq,
+           ep->sense_key, ep->asc, ep->ascq);
+    SD_CHK(sg_scsi_normalize_sense(ep->sbp, ep->sb_len, &ssh) &&
+           (ssh.sense_key == ep->sense_key) && (ssh.asc == ep->asc) &&
+           (ssh.ascq == ep->ascq), "sg_scsi_normalize_sense() disagrees");
+    SD_CHK((ep->info < 0) ? (! sdp->info_present) :
+           (sdp->info_present && (sdp->info == (uint64_t)ep->info) &&
+            (sdp->info_valid == ep->info_valid)),
+           "info=0x%" PRIx64 " present=%d valid=%d", sdp->info,
+           sdp->info_present, sdp->info_valid);
+    SD_CHK((ep->cmd_spec < 0) ? (! sdp->cmd_spec_present) :
+           (sdp->cmd_spec_present &&
+            (sdp->cmd_spec == (uint64_t)ep->cmd_spec)),
+           "cmd_spec=0x%" PRIx64 " present=%d", sdp->cmd_spec,
+           sdp->cmd_spec_present);
+    SD_CHK((sdp->sks_valid == ep->sks_valid) &&
+           (0 == memcmp(sdp->sks, ep->sks, sizeof(ep->sks))),
+           "sks=%02x,%02x,%02x valid=%d", sdp->sks[0], sdp->sks[1],
+           sdp->sks[2], sdp->sks_valid);
+    SD_CHK((ep->progress < 0) ? (! sdp->progress_present) :
+           (sdp->progress_present && (sdp->progress == ep->progress)),
+           "progress=%u present=%d", sdp->progress, sdp->progress_present);
+    SD_CHK(sdp->fru == ep->fru, "fru=0x%x, expected 0x%x", sdp->fru,
+           ep->fru);
+    SD_CHK(sdp->ili == ep->ili, "ili=%d", sdp->ili);
+    for (n = 0; 0xff != ep->desc_types[n]; ++n)
+        ;
+    SD_CHK(sdp->num_desc == n, "num_desc=%d, expected %d", sdp->num_desc,
+           n);
+    for (j = 0; (j < n) && (j < sdp->num_desc); ++j) {
+        const struct sg_sense_desc * dp = sdp->desc + j;
+
+        SD_CHK((dp->type == ep->desc_types[j]) &&
+               ((dp->off + 2) <= ep->sb_len) &&
+               (ep->sbp[dp->off] == dp->type) &&
+               (ep->sbp[dp->off + 1] == dp->add_len),
+               "desc %d: type=0x%x off=%u add_len=%d, expected type 0x%x",
+               j, dp->type, dp->off, dp->add_len, ep->desc_types[j]);
+    }
+#undef SD_CHK
+    return bad;
+}
+
+/* Decodes each test sense buffer with sg_sense_decode(), shows the fields
+ * gathered and checks them against sense_exps[], then times num_passes
+ * over them with sg_sense_decode() and with sg_get_sense_str() . Returns
+ * 0 if all fields are as expected, else 1 . */
+static int
+test_sense_decode(int num_passes)
+{
+    int k, j, pass;
+    int num_bad = 0;
+    uint32_t ms, ms_str;
+    uint64_t sum;
+    struct timespec start_tm;
+    struct sg_sense_decoded sd;
+    char b[2048];
+    const struct sense_exp * sense_arr = sense_exps;
+    static const int num_sense = (int)SG_ARRAY_SIZE(sense_exps);
+
+    printf("sg_sense_decode() of test sense buffers:\n");
+    for (k = 0; k < num_sense; ++k) {
+        if (! sg_sense_decode(sense_arr[k].sbp, sense_arr[k].sb_len, &sd)) {
+            printf("  %d: unable to decode\n", k + 1);
+            ++num_bad;
+            continue;
+        }
+        printf("  %d: resp_code=0x%x sk=0x%x asc,ascq=0x%x,0x%x", k + 1,
+               sd.response_code, sd.sense_key, sd.asc, sd.ascq);
+        if (sd.info_present)
+            printf(" info=0x%" PRIx64 "%s", sd.info,
+                   sd.info_valid ? "" : "(invalid)");
+        if (sd.cmd_spec_present)
+            printf(" cmd_spec=0x%" PRIx64, sd.cmd_spec);
+        if (sd.sks_valid)
+            printf(" sks=%02x,%02x,%02x", sd.sks[0], sd.sks[1], sd.sks[2]);
+        if (sd.progress_present)
+            printf(" progress=%u", sd.progress);
+        if (sd.fru)
+            printf(" fru=0x%x", sd.fru);
+        if (sd.filemark || sd.eom || sd.ili)
+            printf(" fm,eom,ili=%d,%d,%d", sd.filemark, sd.eom, sd.ili);
+        if (sd.descriptor_format) {
+            printf(" descs:");
+            for (j = 0; j < sd.num_desc; ++j)
+                printf(" 0x%x", sd.desc[j].type);
+        }
+        printf("\n");
+        num_bad += sense_decode_check(k, &sd, sense_arr + k);
+    }
+    if (num_bad)
+        printf("  %d mismatches in decoded sense\n", num_bad);
+    else
+        printf("  decoded fields of %d sense buffers ok\n", num_sense);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0, sum = 0; pass < num_passes; ++pass) {
+        for (k = 0; k < num_sense; ++k) {
+            sg_sense_decode(sense_arr[k].sbp, sense_arr[k].sb_len, &sd);
+            sum += sd.sense_key + sd.num_desc;
+        }
+    }
+    ms = elapsed_ms(&start_tm);
+    clock_gettime(CLOCK_MONOTONIC, &start_tm);
+    for (pass = 0; pass < num_passes; ++pass) {
+        for (k = 0; k < num_sense; ++k)
+            sum += sg_get_sense_str(NULL, sense_arr[k].sbp,
+                                    sense_arr[k].sb_len, false, sizeof(b), b);
+    }
+    ms_str = elapsed_ms(&start_tm);
+    printf("  %d passes over %d sense buffers: sg_sense_decode: %u ms, "
+           "sg_get_sense_str: %u ms [%" PRIu64 "]\n", num_passes, num_sense,
+           ms, ms_str, sum);
+    return num_bad ? 1 : 0;
+}
+
+#define HEX_BENCH_LEN (1024 * 1024)
+
+/* Times num_passes of hex dumping HEX_BENCH_LEN bytes with each output
+ * format of dStrHexFp(), hex2fp() and hex2str(), writing to /dev/null .
+ * Returns 0 on success, else 1 . */
+static int
+test_hex_speed(int num_passes)
+{
+    int k, pass, blen;
+    uint32_t ms;
+    uint8_t * bp;
+    char * b;
+    FILE * fp;
+    struct timespec start_tm;
+    static const char * ld = "    ";
+
+    bp = (uint8_t *)malloc(HEX_BENCH_LEN);
+    blen = HEX_BENCH_LEN * 6;   /* oformat=0 needs about 4.5 chars/byte */
+    b = (char *)malloc(blen);
+    fp = fopen("/dev/null", "w");
+    if ((NULL == bp) || (NULL == b) || (NULL == fp)) {
+        pr2serr("%s: unable to set up\n", __func__);
+        free(bp);
+        free(b);
+        if (fp)
+            fclose(fp);
+        return 1;
+    }
+    for (k = 0; k < HEX_BENCH_LEN; ++k)
+        bp[k] = (uint8_t)((k * 7) + (k >> 9));
+    printf("Hex dump throughput, %d passes over %d KiB:\n", num_passes,
+           HEX_BENCH_LEN / 1024);
+    for (k = -1; k < 2; ++k) {
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass)
+            dStrHexFp((const char *)bp, HEX_BENCH_LEN, k, fp);
+        ms = elapsed_ms(&start_tm);
+        printf("  dStrHexFp(no_ascii=%d): %u ms, %.1f MB/s\n", k, ms,
+               ms ? ((double)num_passes * HEX_BENCH_LEN / 1000.0 / ms) : 0.0);
+    }
+    for (k = 0; k < 3; ++k) {
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass)
+            hex2fp(bp, HEX_BENCH_LEN, ld, k, fp);
+        ms = elapsed_ms(&start_tm);
+        printf("  hex2fp(oformat=%d): %u ms, %.1f MB/s\n", k, ms,
+               ms ? ((double)num_passes * HEX_BENCH_LEN / 1000.0 / ms) : 0.0);
+    }
+    for (k = 0; k < 3; ++k) {
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass)
+            hex2str(bp, HEX_BENCH_LEN, ld, k, blen, b);
+        ms = elapsed_ms(&start_tm);
+        printf("  hex2str(oformat=%d): %u ms, %.1f MB/s\n", k, ms,
+               ms ? ((double)num_passes * HEX_BENCH_LEN / 1000.0 / ms) : 0.0);
+    }
+    fclose(fp);
+    free(b);
+    free(bp);
+    return 0;
+}
+
+#define HEX_STRM_BENCH_LEN (4 * 1024 * 1024)
+
+/* Decodes whole of fname with sg_hex_strm_read() using chunks of chunk_sz
+ * bytes into bp (of max_len bytes). Returns number of bytes decoded or -1
+ * on error. */
+static int
+hex_strm_decode_all(const char * fname, bool no_space, bool skip_first,
+                    int chunk_sz, uint8_t * bp, int max_len)
+{
+    int n, res;
+    int k = 0;
+    struct sg_hex_strm * hsp;
+
+    if (sg_hex_strm_open(fname, false, no_space, skip_first, &hsp))
+        return -1;
+    do {
+        if (chunk_sz > (max_len - k))
+            chunk_sz = max_len - k;
+        res = sg_hex_strm_read(hsp, bp + k, chunk_sz, &n);
+        k += n;
+    } while ((0 == res) && (n > 0) && (k < max_len));
+    sg_hex_strm_close(hsp);
+    return res ? -1 : k;
+}
+
+/* Checks chunked decoding of ASCII hex input by sg_hex_strm_read() then
+ * times NUM passes. If fname is NULL generated inputs (spaced, spaced with
+ * a leading address and no_space) are used, otherwise fname is decoded in
+ * chunks of various sizes and compared with decoding it in one chunk. */
+static int
+test_hex_strm(const char * fname, int num_passes, int vb)
+{
+    bool no_space, skip_first;
+    int j, k, n, f, fd, pass, exp_len, in_sz;
+    int ret = 0;
+    uint32_t ms;
+    uint8_t * exp_bp;
+    uint8_t * bp;
+    FILE * fp;
+    struct timespec start_tm;
+    static const int chunk_szs[] = {1, 7, 61, 4096, 64 * 1024};
+    static const char * fmt_s[] = {"spaced", "spaced, address first",
+                                   "no_space", "user supplied"};
+    char tmp_fn[64];
+
+    exp_bp = (uint8_t *)malloc(HEX_STRM_BENCH_LEN);
+    bp = (uint8_t *)malloc(HEX_STRM_BENCH_LEN);
+    if ((NULL == exp_bp) || (NULL == bp)) {
+        pr2serr("%s: unable to allocate\n", __func__);
+        free(exp_bp);
+        free(bp);
+        return 1;
+    }
+    for (k = 0; k < HEX_STRM_BENCH_LEN; ++k)
+        exp_bp[k] = (uint8_t)((k * 13) + (k >> 11));
+    printf("Hex input decoding, %d passes:\n", num_passes);
+    for (f = (fname ? 3 : 0); f < (fname ? 4 : 3); ++f) {
+        no_space = (2 == f);
+        skip_first = (1 == f);
+        if (fname) {
+            snprintf(tmp_fn, sizeof(tmp_fn), "%s", fname);
+            exp_len = hex_strm_decode_all(tmp_fn, false, false,
+                                          HEX_STRM_BENCH_LEN, exp_bp,
+                                          HEX_STRM_BENCH_LEN);
+            if (exp_len < 0) {
+                ret = 1;
+                break;
+            }
+        } else {
+            snprintf(tmp_fn, sizeof(tmp_fn), "/tmp/%s_XXXXXX", MY_NAME);
+            fd = mkstemp(tmp_fn);
+            fp = (fd >= 0) ? fdopen(fd, "w") : NULL;
+            if (NULL == fp) {
+                pr2serr("%s: unable to create temporary file\n", __func__);
+                ret = 1;
+                break;
+            }
+            exp_len = HEX_STRM_BENCH_LEN;
+            for (k = 0; k < exp_len; k += 32) {
+                if (0 == (k % 4096))
+                    fprintf(fp, "# offset 0x%x\n", k);
+                if (skip_first)
+                    fprintf(fp, "%06x ", k);
+                for (j = 0; j < 32; ++j)
+                    fprintf(fp, (no_space ? "%02x" : ((15 == j) ?
+                                 "%02x  " : "%02x ")), exp_bp[k + j]);
+                fputc('\n', fp);
+            }
+            fclose(fp);
+        }
+        for (j = 0; j < (int)SG_ARRAY_SIZE(chunk_szs); ++j) {
+            memset(bp, 0, exp_len);
+            n = hex_strm_decode_all(tmp_fn, no_space, skip_first,
+                                    chunk_szs[j], bp, HEX_STRM_BENCH_LEN);
+            if ((n != exp_len) || memcmp(bp, exp_bp, exp_len)) {
+                printf("  %s, chunks of %d: mismatch, decoded %d bytes, "
+                       "expected %d\n", fmt_s[f], chunk_szs[j], n, exp_len);
+                ret = 1;
+            } else if (vb)
+                printf("  %s, chunks of %d: ok\n", fmt_s[f], chunk_szs[j]);
+        }
+        in_sz = 0;
+        fp = fopen(tmp_fn, "r");
+        if (fp) {
+            fseek(fp, 0, SEEK_END);
+            in_sz = (int)ftell(fp);
+            fclose(fp);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass)
+            hex_strm_decode_all(tmp_fn, no_space, skip_first, 64 * 1024, bp,
+                                HEX_STRM_BENCH_LEN);
+        ms = elapsed_ms(&start_tm);
+        printf("  %s: %d bytes from %d characters, %u ms, %.1f MB/s\n",
+               fmt_s[f], exp_len, in_sz, ms,
+               ms ? ((double)num_passes * in_sz / 1000.0 / ms) : 0.0);
+        if (NULL == fname)
+            unlink(tmp_fn);
+    }
+    free(exp_bp);
+    free(bp);
+    return ret;
+}
+
+/* Builds the same JSON tree whether streaming or not. With 'shapes' it
+ * holds: a list of objects each with a short (sometimes flushed) array
+ * and a member added after that, a nested object holding an empty array
+ * and an array added to after being flushed, then a last root member.
+ * Otherwise it is a list of 'num' zone descriptor like objects. */
+static void
+json_strm_tree(sgj_state * jsp, int num, bool shapes)
+{
+    int j, k;
+    sgj_opaque_p jop = jsp->basep;
+    sgj_opaque_p jap, ja2p, jo2p;
+
+    sgj_js_nv_i(jsp, jop, "first", 1);
+    jap = sgj_named_subarray_r(jsp, jop, "list");
+    for (k = 0; k < num; ++k) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        if (! shapes) {
+            sgj_js_nv_ihexstr(jsp, jo2p, "zone_type", 2, NULL,
+                              "Sequential write required");
+            sgj_js_nv_ihexstr(jsp, jo2p, "zone_condition", 1, NULL,
+                              "Empty");
+            sgj_js_nv_i(jsp, jo2p, "non_seq", 0);
+            sgj_js_nv_i(jsp, jo2p, "reset", 0);
+            sgj_js_nv_ihex(jsp, jo2p, "zone_length", 0x80000);
+            sgj_js_nv_ihex(jsp, jo2p, "zone_start_lba", (uint64_t)k << 19);
+            sgj_js_nv_ihex(jsp, jo2p, "write_pointer_lba",
+                           ((uint64_t)k << 19) + (k % 100));
+            if (0 == ((k + 1) % 64))
+                sgj_stream_flush(jsp, jap);
+            continue;
+        }
+        sgj_js_nv_ihex(jsp, jo2p, "index", k);
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "sub");
+        for (j = 0; j < (k % 3); ++j)
+            sgj_js_nv_i(jsp, ja2p, NULL /* name */, j);
+        if (k & 1)
+            sgj_stream_flush(jsp, ja2p);
+        sgj_js_nv_s(jsp, jo2p, "after", "tab\t, quote\" and \\");
+        if (0 == (k % 5))
+            sgj_stream_flush(jsp, jap);
+    }
+    sgj_stream_flush(jsp, jap);
+    if (! shapes)
+        return;
+    jo2p = sgj_named_subobject_r(jsp, jop, "mid");
+    sgj_named_subarray_r(jsp, jo2p, "empty");
+    ja2p = sgj_named_subarray_r(jsp, jo2p, "x");
+    sgj_stream_flush(jsp, ja2p);        /* empty, does nothing */
+    for (k = 0; k < 3; ++k)
+        sgj_js_nv_i(jsp, ja2p, NULL /* name */, k);
+    sgj_stream_flush(jsp, ja2p);
+    sgj_js_nv_i(jsp, ja2p, NULL /* name */, 99);
+    sgj_js_nv_s(jsp, jop, "last", "end");
+}
+
+/* Outputs json_strm_tree() to fp, streamed if 'strm' is true. Returns 0 on
+ * success. */
+static int
+json_strm_out(const char * j_opt, int num, bool shapes, bool strm, FILE * fp)
+{
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+
+    if ((! sgj_init_state(jsp, j_opt)) ||
+        (NULL == sgj_start_r(MY_NAME, version_str, 0, NULL, jsp)))
+        return 1;
+    if (strm && (! sgj_stream_start(jsp, fp))) {
+        sgj_finish(jsp);
+        return 1;
+    }
+    json_strm_tree(jsp, num, shapes);
+    sgj_js2file_estr(jsp, NULL, 0, NULL, fp);
+    sgj_finish(jsp);
+    return 0;
+}
+
+static long
+file_len(FILE * fp)
+{
+    fflush(fp);
+    return (0 == fseek(fp, 0, SEEK_END)) ? ftell(fp) : -1;
+}
+
+/* Returns true if the contents of fp1 and fp2 are identical, placing their
+ * lengths in *len1p and *len2p . If 'vb' > 1 and they differ, both are
+ * printed. */
+static bool
+same_file_content(FILE * fp1, FILE * fp2, long * len1p, long * len2p, int vb)
+{
+    bool same;
+    long len1 = file_len(fp1);
+    long len2 = file_len(fp2);
+    char * b1 = (char *)calloc(1, len1 + 1);
+    char * b2 = (char *)calloc(1, len2 + 1);
+
+    *len1p = len1;
+    *len2p = len2;
+    rewind(fp1);
+    rewind(fp2);
+    same = ((len1 == len2) && b1 && b2 && (1 == fread(b1, len1, 1, fp1)) &&
+            (1 == fread(b2, len2, 1, fp2)) && (0 == memcmp(b1, b2, len1)));
+    if ((! same) && (vb > 1))
+        printf("first:\n%s\nsecond:\n%s\n", b1 ? b1 : "", b2 ? b2 : "");
+    free(b1);
+    free(b2);
+    return same;
+}
+
+/* Checks that streamed JSON output (sgj_stream_start() and
+ * sgj_stream_flush()) is identical to tree output in several output
+ * modes, then times NUM passes of both over 75000 zone descriptor like
+ * objects. Returns 0 if all agree, else 1 . */
+static int
+test_json_strm(int num_passes, int vb)
+{
+    int j, k, pass;
+    int ret = 0;
+    long len1, len2;
+    uint32_t ms;
+    FILE * fp1;
+    FILE * fp2;
+    struct timespec start_tm;
+    struct rusage ru;
+    static const char * j_opts[] = {"", "2", "-p", "-pk", "-e", "h", "-l"};
+    static const int nums[] = {0, 1, 2, 6, 23};
+    static const int bench_num = 75000;
+
+    printf("Streamed JSON output:\n");
+    for (j = 0; j < (int)SG_ARRAY_SIZE(j_opts); ++j) {
+        for (k = 0; k < (int)SG_ARRAY_SIZE(nums); ++k) {
+            fp1 = tmpfile();
+            fp2 = tmpfile();
+            if ((NULL == fp1) || (NULL == fp2) ||
+                json_strm_out(j_opts[j], nums[k], true, false, fp1) ||
+                json_strm_out(j_opts[j], nums[k], true, true, fp2)) {
+                printf("  --json=%s, %d elements: failed\n", j_opts[j],
+                       nums[k]);
+                ret = 1;
+                if (fp1)
+                    fclose(fp1);
+                if (fp2)
+                    fclose(fp2);
+                continue;
+            }
+            if (! same_file_content(fp1, fp2, &len1, &len2, vb)) {
+                printf("  --json=%s, %d elements: mismatch, tree %ld "
+                       "bytes, streamed %ld bytes\n", j_opts[j], nums[k],
+                       len1, len2);
+                ret = 1;
+            } else if (vb)
+                printf("  --json=%s, %d elements: ok, %ld bytes\n",
+                       j_opts[j], nums[k], len1);
+            fclose(fp1);
+            fclose(fp2);
+        }
+    }
+    /* streamed first: ru_maxrss only ever grows */
+    for (j = 1; j >= 0; --j) {
+        fp1 = tmpfile();
+        if (NULL == fp1) {
+            ret = 1;
+            break;
+        }
+        len1 = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass) {
+            rewind(fp1);
+            if (json_strm_out("", bench_num, false, !! j, fp1))
+                ret = 1;
+            len1 = file_len(fp1);
+        }
+        ms = elapsed_ms(&start_tm);
+        getrusage(RUSAGE_SELF, &ru);
+        printf("  %s: %d objects, %ld bytes, %u ms, max rss %ld KB\n",
+               (j ? "streamed" : "tree    "), bench_num, len1, ms,
+               ru.ru_maxrss);
+        fclose(fp1);
+    }
+    return ret;
+}
+
+#define CORPUS_MAX_FILES 256
+#define CORPUS_MAX_LEN 8192
+#define ARENA_REPS 100          /* corpus trees built per pass */
+
+struct corpus_hexf {
+    char name[64];
+    int len;
+    uint8_t * bp;
+};
+
+static int
+corpus_select(const struct dirent * s)
+{
+    int n = strlen(s->d_name);
+
+    return (n > 4) && (n < 64) && (0 == strcmp(s->d_name + n - 4, ".hex"));
+}
+
+/* Reads the *.hex files in 'dir_name' into hfp[], in name order. Returns
+ * the number read. */
+static int
+corpus_load(const char * dir_name, struct corpus_hexf * hfp, int vb)
+{
+    int k, n, len;
+    int num = 0;
+    struct dirent ** namelist;
+    char b[1024];
+
+    n = scandir(dir_name, &namelist, corpus_select, alphasort);
+    if (n < 0) {
+        printf("  unable to scan directory %s: %s\n", dir_name,
+               strerror(errno));
+        return 0;
+    }
+    for (k = 0; k < n; ++k) {
+        struct corpus_hexf * p = hfp + num;
+
+        if (num >= CORPUS_MAX_FILES)
+            goto skip;
+        snprintf(b, sizeof(b), "%s/%s", dir_name, namelist[k]->d_name);
+        if (NULL == (p->bp = (uint8_t *)malloc(CORPUS_MAX_LEN)))
+            goto skip;
+        if (sg_f2hex_arr(b, false, false, p->bp, &len, CORPUS_MAX_LEN) ||
+            (len < 4)) {
+            if (vb)
+                printf("  %s: skipped\n", b);
+            free(p->bp);
+            goto skip;
+        }
+        p->len = len;
+        snprintf(p->name, sizeof(p->name), "%.*s",
+                 (int)strlen(namelist[k]->d_name) - 4, namelist[k]->d_name);
+        ++num;
+skip:
+        free(namelist[k]);
+    }
+    free(namelist);
+    return num;
+}
+
+/* Adds a page object for 'hfp' shaped like a utility's: a few header
+ * fields then a list of descriptor objects each with the same names. */
+static void
+corpus_page(sgj_state * jsp, const struct corpus_hexf * hfp)
+{
+    int k;
+    const uint8_t * bp = hfp->bp;
+    sgj_opaque_p jop, jap, jo2p;
+    char b[80];
+
+    jop = sgj_snake_named_subobject_r(jsp, NULL, hfp->name);
+    sgj_js_nv_ihexstr(jsp, jop, "peripheral_device_type", bp[0] & 0x1f,
+                      NULL, sg_get_pdt_str(bp[0] & 0x1f, sizeof(b), b));
+    sgj_js_nv_ihex(jsp, jop, "page_code", bp[1]);
+    sgj_js_nv_ihex(jsp, jop, "page_length", hfp->len - 4);
+    jap = sgj_named_subarray_r(jsp, jop, "descriptor_list");
+    for (k = 4; (k + 8) <= hfp->len; k += 8) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "offset", k);
+        sgj_js_nv_ihexstr(jsp, jo2p, "descriptor_type", bp[k], NULL,
+                          (bp[k] & 0x80) ? "Vendor specific" : "Standard");
+        sgj_js_nv_i(jsp, jo2p, "flags", bp[k + 1]);
+        sgj_js_nv_ihex(jsp, jo2p, "logical_block_address",
+                       sg_get_unaligned_be32(bp + k + 4));
+        sgj_js_nv_hex_bytes(jsp, jo2p, "raw", bp + k, 8);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+/* Builds a JSON tree holding every file in hfp[] then frees it, writing
+ * it to fp first if that is non-NULL. Returns 0 on success. */
+static int
+corpus_out(const char * j_opt, const struct corpus_hexf * hfp, int num,
+          bool no_arena, FILE * fp)
+{
+    int k;
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+
+    if (! sgj_init_state(jsp, j_opt))
+        return 1;
+    jsp->no_arena = no_arena;
+    if (NULL == sgj_start_r(MY_NAME, version_str, 0, NULL, jsp))
+        return 1;
+    for (k = 0; k < num; ++k)
+        corpus_page(jsp, hfp + k);
+    if (fp)
+        sgj_js2file(jsp, NULL, 0, fp);
+    sgj_finish(jsp);
+    return 0;
+}
+
+/* Checks that JSON trees built in the sgj_state arena serialize the same
+ * as those built on the heap, using the *.hex files in 'dir_name' (def:
+ * "inhex") as input, then times NUM passes of building and freeing each. */
+static int
+test_json_arena(const char * dir_name, int num_passes, int vb)
+{
+    int j, k, pass, num;
+    int ret = 0;
+    long len1, len2;
+    uint32_t ms[2];
+    FILE * fp1;
+    FILE * fp2;
+    struct timespec start_tm;
+    struct corpus_hexf hexf[CORPUS_MAX_FILES];
+    static const char * j_opts[] = {"", "-p", "h", "k", "-e"};
+
+    if (NULL == dir_name)
+        dir_name = "inhex";
+    printf("JSON arena, corpus %s:\n", dir_name);
+    num = corpus_load(dir_name, hexf, vb);
+    if (num <= 0) {
+        printf("  no usable *.hex files\n");
+        return 1;
+    }
+    for (j = 0; j < (int)SG_ARRAY_SIZE(j_opts); ++j) {
+        fp1 = tmpfile();
+        fp2 = tmpfile();
+        if ((NULL == fp1) || (NULL == fp2) ||
+            corpus_out(j_opts[j], hexf, num, true, fp1) ||
+            corpus_out(j_opts[j], hexf, num, false, fp2)) {
+            printf("  --json=%s: failed\n", j_opts[j]);
+            ret = 1;
+        } else if (! same_file_content(fp1, fp2, &len1, &len2, vb)) {
+            printf("  --json=%s: mismatch, heap %ld bytes, arena %ld "
+                   "bytes\n", j_opts[j], len1, len2);
+            ret = 1;
+        } else if (vb)
+            printf("  --json=%s: ok, %ld bytes\n", j_opts[j], len1);
+        if (fp1)
+            fclose(fp1);
+        if (fp2)
+            fclose(fp2);
+    }
+    for (j = 0; j < 2; ++j) {
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes; ++pass) {
+            for (k = 0; k < ARENA_REPS; ++k) {
+                if (corpus_out("", hexf, num, ! j, NULL))
+                    ret = 1;
+            }
+        }
+        ms[j] = elapsed_ms(&start_tm);
+    }
+    printf("  %d files, %d trees built and freed: heap %u ms, arena %u "
+           "ms\n", num, num_passes * ARENA_REPS, ms[0], ms[1]);
+    for (k = 0; k < num; ++k)
+        free(hexf[k].bp);
+    return ret;
+}
+
+/* Renders one CBOR data item at bp[*posp] as packed JSON text, as
+ * json_serialize_ex() would, appending to out[*op]. Only the subset of
+ * CBOR that json_cbor_serialize() yields (no floats) is accepted. Returns
+ * 0 on success, -1 if the item is malformed or does not fit. */
+static int
+cbor2json(const uint8_t * bp, int len, int * posp, char * out, int olen,
+          int * op, int depth)
+{
+    int k, n, mt, ai;
+    uint64_t arg = 0;
+
+    if ((*posp >= len) || (depth > 64))
+        return -1;
+    mt = bp[*posp] >> 5;
+    ai = bp[*posp] & 0x1f;
+    ++*posp;
+    if (7 == mt) {
+        const char * cp = (0x14 == ai) ? "false" : (0x15 == ai) ? "true" :
+                          (0x16 == ai) ? "null" : NULL;
+
+        n = cp ? (int)strlen(cp) : 0;
+        if ((NULL == cp) || ((*op + n) >= olen))
+            return -1;
+        memcpy(out + *op, cp, n);
+        *op += n;
+        return 0;
+    }
+    if (ai < 24)
+        arg = ai;
+    else if (ai < 28) {
+        n = 1 << (ai - 24);
+        if ((*posp + n) > len)
+            return -1;
+        for (k = 0; k < n; ++k)
+            arg = (arg << 8) | bp[(*posp)++];
+    } else
+        return -1;
+    if ((*op + 24) >= olen)
+        return -1;
+    switch (mt) {
+    case 0:
+        *op += sg_scnpr(out + *op, olen - *op, "%" PRIu64, arg);
+        return 0;
+    case 1:
+        *op += sg_scnpr(out + *op, olen - *op, "%" PRId64,
+                        (int64_t)(-1 - (int64_t)arg));
+        return 0;
+    case 3:
+        if ((*posp + (int)arg) > len)
+            return -1;
+        out[(*op)++] = '"';
+        for (k = 0; k < (int)arg; ++k) {
+            char e;
+            char c = (char)bp[(*posp)++];
+
+            if ((*op + 3) >= olen)
+                return -1;
+            switch (c) {
+            case '"': e = '"'; break;
+            case '\\': e = '\\'; break;
+            case '\b': e = 'b'; break;
+            case '\f': e = 'f'; break;
+            case '\n': e = 'n'; break;
+            case '\r': e = 'r'; break;
+            case '\t': e = 't'; break;
+            default: e = '\0'; break;
+            }
+            if (e) {
+                out[(*op)++] = '\\';
+                c = e;
+            }
+            out[(*op)++] = c;
+        }
+        out[(*op)++] = '"';
+        return 0;
+    case 4:
+    case 5:
+        out[(*op)++] = (4 == mt) ? '[' : '{';
+        for (k = 0; k < (int)arg; ++k) {
+            if (k)
+                out[(*op)++] = ',';
+            if (5 == mt) {
+                if ((*posp < len) && (3 != (bp[*posp] >> 5)))
+                    return -1;      /* keys are text strings */
+                if (cbor2json(bp, len, posp, out, olen, op, depth + 1))
+                    return -1;
+                out[(*op)++] = ':';
+            }
+            if (cbor2json(bp, len, posp, out, olen, op, depth + 1))
+                return -1;
+            if ((*op + 2) >= olen)
+                return -1;
+        }
+        out[(*op)++] = (4 == mt) ? ']' : '}';
+        return 0;
+    default:    /* byte strings, tags */
+        return -1;
+    }
+}
+
+/* Writes, with JO 'j_opt', a tree holding integers either side of each
+ * CBOR head size boundary plus strings needing escapes. Returns 0 on
+ * success. */
+static int
+cbor_edge_out(const char * j_opt, FILE * fp)
+{
+    int k;
+    sgj_opaque_p jap;
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+    static const int64_t edges[] = {0, 1, 23, 24, 255, 256, 65535, 65536,
+        0xffffffffLL, 0x100000000LL, INT64_MAX, -1, -24, -25, -256, -257,
+        -65536, -65537, -0x100000000LL, -0x100000001LL,
+        INT64_MIN + 1};     /* JSON text cannot yet render INT64_MIN */
+
+    if ((! sgj_init_state(jsp, j_opt)) ||
+        (NULL == sgj_start_r(MY_NAME, version_str, 0, NULL, jsp)))
+        return 1;
+    jap = sgj_named_subarray_r(jsp, NULL, "edges");
+    for (k = 0; k < (int)SG_ARRAY_SIZE(edges); ++k)
+        sgj_js_nv_i(jsp, jap, NULL /* name */, edges[k]);
+    sgj_js_nv_b(jsp, NULL, "yes", true);
+    sgj_js_nv_b(jsp, NULL, "no", false);
+    sgj_js_nv_s(jsp, NULL, "", "");
+    sgj_js_nv_s(jsp, NULL, "esc", test_str);
+    sgj_js_nv_s(jsp, NULL, "esc2", "tab\t, quote\" \\ \b\f\r\n");
+    sgj_js2file(jsp, NULL, 0, fp);
+    sgj_finish(jsp);
+    return 0;
+}
+
+/* Reads all of fp into a new heap buffer. Returns NULL on failure. */
+static uint8_t *
+file_read_all(FILE * fp, long * lenp)
+{
+    long len = file_len(fp);
+    uint8_t * bp = (len >= 0) ? (uint8_t *)malloc(len + 1) : NULL;
+
+    rewind(fp);
+    if (bp && (len > 0) && (1 != fread(bp, len, 1, fp))) {
+        free(bp);
+        return NULL;
+    }
+    *lenp = len;
+    return bp;
+}
+
+/* Checks CBOR output (JO 'B') of trees built from the *.hex files in
+ * 'dir_name' (def: "inhex") by rendering it back to packed JSON text and
+ * comparing with JO '-pk' output. Then, for one tree, reports the size of
+ * each output form and the time of NUM passes of writing it out. */
+static int
+test_json_cbor(const char * dir_name, int num_passes, int vb)
+{
+    int j, k, pass, num, pos, olen;
+    int ret = 0;
+    long len1, len2;
+    uint32_t ms;
+    FILE * fp1;
+    FILE * fp2;
+    uint8_t * b1;
+    uint8_t * b2;
+    char * out;
+    struct timespec start_tm;
+    sgj_state js SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &js;
+    struct corpus_hexf hexf[CORPUS_MAX_FILES];
+    char jo[16];
+    static const char * j_opts[] = {"", "h", "-s", "n", "o", "-l"};
+    static const char * t_opts[] = {"-e", "-e-p", "-e-pk", "-eB"};
+    static const char * t_names[] = {"pretty", "single line", "packed",
+                                     "CBOR"};
+
+    if (NULL == dir_name)
+        dir_name = "inhex";
+    printf("CBOR output, corpus %s:\n", dir_name);
+    num = corpus_load(dir_name, hexf, vb);
+    if (num <= 0) {
+        printf("  no usable *.hex files\n");
+        return 1;
+    }
+    /* last pass: integer and string edge cases rather than the corpus */
+    for (j = 0; j <= (int)SG_ARRAY_SIZE(j_opts); ++j) {
+        bool edge = (j == (int)SG_ARRAY_SIZE(j_opts));
+
+        b1 = NULL;
+        b2 = NULL;
+        out = NULL;
+        fp1 = tmpfile();
+        fp2 = tmpfile();
+        snprintf(jo, sizeof(jo), "%sB", edge ? "" : j_opts[j]);
+        if ((NULL == fp1) || (NULL == fp2) ||
+            (edge ? cbor_edge_out(jo, fp1) :
+                    corpus_out(jo, hexf, num, false, fp1))) {
+            printf("  --json=%s: failed\n", jo);
+            ret = 1;
+            goto next;
+        }
+        snprintf(jo, sizeof(jo), "%s-pk", edge ? "" : j_opts[j]);
+        if ((edge ? cbor_edge_out(jo, fp2) :
+                    corpus_out(jo, hexf, num, false, fp2)) ||
+            (NULL == (b1 = file_read_all(fp1, &len1))) ||
+            (NULL == (b2 = file_read_all(fp2, &len2)))) {
+            printf("  --json=%s: failed\n", jo);
+            ret = 1;
+            goto next;
+        }
+        olen = 2 * len2 + 64;
+        out = (char *)malloc(olen);
+        pos = 0;
+        k = 0;
+        if ((NULL == out) || cbor2json(b1, len1, &pos, out, olen, &k, 0) ||
+            (pos != len1)) {
+            printf("  --json=%sB: malformed CBOR at offset %d of %ld\n",
+                   edge ? "" : j_opts[j], pos, len1);
+            ret = 1;
+        } else if (((k + 1) != len2) || memcmp(out, b2, k)) {
+            printf("  --json=%sB: differs from --json=%s\n",
+                   edge ? "" : j_opts[j], jo);
+            if (vb > 1)
+                printf("CBOR as JSON:\n%.*s\nJSON:\n%s\n", k, out, b2);
+            ret = 1;
+        } else if (vb)
+            printf("  --json=%sB%s: ok, %ld bytes, packed JSON %ld bytes\n",
+                   edge ? "" : j_opts[j], edge ? " (edge cases)" : "", len1,
+                   len2);
+next:
+        free(out);
+        free(b1);
+        free(b2);
+        if (fp1)
+            fclose(fp1);
+        if (fp2)
+            fclose(fp2);
+    }
+    for (j = 0; j < (int)SG_ARRAY_SIZE(t_opts); ++j) {
+        if ((NULL == (fp1 = tmpfile())) || (! sgj_init_state(jsp, t_opts[j])) ||
+            (NULL == sgj_start_r(MY_NAME, version_str, 0, NULL, jsp))) {
+            ret = 1;
+            if (fp1)
+                fclose(fp1);
+            break;
+        }
+        for (k = 0; k < num; ++k)
+            corpus_page(jsp, hexf + k);
+        len1 = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start_tm);
+        for (pass = 0; pass < num_passes * ARENA_REPS; ++pass) {
+            rewind(fp1);
+            sgj_js2file(jsp, NULL, 0, fp1);
+        }
+        len1 = file_len(fp1);
+        ms = elapsed_ms(&start_tm);
+        printf("  %-11s: %8ld bytes, %d passes %5u ms\n", t_names[j], len1,
+               num_passes * ARENA_REPS, ms);
+        sgj_finish(jsp);
+        fclose(fp1);
+    }
+    for (k = 0; k < num; ++k)
+        free(hexf[k].bp);
+    return ret;
+}
+
 #define OFF 7   /* in byteswap mode, can test different alignments (def: 8) */
 
 int
@@ -231,17 +2100,28 @@ main(int argc, char * argv[])
     bool as_json = false;
     bool last_n_last_blank = false;
     bool do_exit_status = false;
+    bool do_inhex = false;
+    bool do_jstream = false;
+    bool do_arena = false;
+    bool do_cbor = false;
     bool ok;
     int k, c, n, len;
     int byteswap_sz = 0;
+    int do_asc = 0;
     int do_hex2 = 0;
     int do_num = 1;
+    int do_opcode = 0;
     int do_printf = 0;
+    int do_rw = 0;
+    int do_scan = 0;
     int do_sense = 0;
     int do_unaligned = 0;
     int did_something = 0;
     int vb = 0;
     int ret = 0;
+    const char * inhex_fn = NULL;
+    const char * arena_dir = NULL;
+    const char * cbor_dir = NULL;
     sgj_opaque_p jop = NULL;
     sgj_opaque_p jo2p;
     sgj_state json_st SG_C_CPP_ZERO_INIT;
@@ -253,12 +2133,26 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:B:ehHj::l:n:psuvV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "a::A::b:B:C::ehHi::j::Jl:n:o::prsS:uvV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'A':
+            do_arena = true;
+            arena_dir = optarg;
+            break;
+        case 'a':
+            if (NULL == optarg)
+                do_asc = 1;
+            else if (0 == strcmp("gen", optarg))
+                do_asc = 2;
+            else {
+                fprintf(stderr, "--asc= only accepts 'gen'\n");
+                return 1;
+            }
+            break;
         case 'b':
             byteswap_sz = sg_get_num(optarg);
             if (! ((16 == byteswap_sz) || (32 == byteswap_sz) ||
@@ -271,6 +2165,10 @@ main(int argc, char * argv[])
             do_num = sg_get_num(optarg);
             last_n_last_blank = true;
             break;
+        case 'C':
+            do_cbor = true;
+            cbor_dir = optarg;
+            break;
         case 'e':
             do_exit_status = true;
             break;
@@ -281,6 +2179,10 @@ main(int argc, char * argv[])
         case 'H':
             ++do_hex2;
             break;
+        case 'i':
+            do_inhex = true;
+            inhex_fn = optarg;
+            break;
         case 'j':
             if (! sgj_init_state(&json_st, optarg)) {
                 pr2serr("bad argument to --json= option, unrecognized "
@@ -288,7 +2190,9 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
-
+        case 'J':
+            do_jstream = true;
+            break;
         case 'l':
             leadin = optarg;
             break;
@@ -299,12 +2203,33 @@ main(int argc, char * argv[])
                 return 1;
             }
             break;
+        case 'o':
+            if (NULL == optarg)
+                do_opcode = 1;
+            else if (0 == strcmp("gen", optarg))
+                do_opcode = 2;
+            else {
+                fprintf(stderr, "--opcode= only accepts 'gen'\n");
+                return 1;
+            }
+            break;
         case 'p':
             ++do_printf;
             break;
+        case 'r':
+            ++do_rw;
+            break;
         case 's':
             ++do_sense;
             break;
+        case 'S':
+            do_scan = sg_get_num(optarg);
+            if (do_scan < 4) {
+                fprintf(stderr, "--scan= expects a block size of 4 or "
+                        "more\n");
+                return 1;
+            }
+            break;
         case 'u':
             ++do_unaligned;
             break;
@@ -470,6 +2395,8 @@ main(int argc, char * argv[])
                            (int)sizeof(desc_sense_data6), vb);
             printf("\n");
             printf("\n");
+            if (test_sense_decode(do_num))
+                ret = 1;
         }
     }
 
@@ -575,6 +2502,8 @@ main(int argc, char * argv[])
             hex2stdout(b, k, -1);
             printf("\n");
         }
+        if ((do_hex2 > 1) && test_hex_speed(do_num))
+            ret = SG_LIB_CAT_OTHER;
     }
     if (do_unaligned) {
         uint16_t u16 = 0x55aa;
@@ -757,6 +2686,60 @@ main(int argc, char * argv[])
     }
 #endif
 
+    if (do_rw) {
+        ++did_something;
+        if (test_rw_tmpl(do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_scan > 0) {
+        ++did_something;
+        if (test_blk_scan(do_scan, do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_inhex) {
+        ++did_something;
+        if (test_hex_strm(inhex_fn, do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_jstream) {
+        ++did_something;
+        if (test_json_strm(do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_arena) {
+        ++did_something;
+        if (test_json_arena(arena_dir, do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_cbor) {
+        ++did_something;
+        if (test_json_cbor(cbor_dir, do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_asc) {
+        ++did_something;
+        if (2 == do_asc) {
+            if (gen_asc_idx())
+                ret = SG_LIB_CAT_OTHER;
+        } else if (test_asc_lookup(do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
+    if (do_opcode) {
+        ++did_something;
+        if (2 == do_opcode) {
+            if (gen_opcode_idx())
+                ret = SG_LIB_CAT_OTHER;
+        } else if (test_opcode_lookup(do_num, vb))
+            ret = SG_LIB_CAT_OTHER;
+    }
+
     if (0 == did_something)
         printf("Looks like no tests done, check usage with '-h'\n");
     ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;